@@ -1082,6 +1082,213 @@ static int analyze_blame(int argc, char *argv[], void *userdata) {
         return 0;
 }
 
+typedef struct GeneratorTime {
+        const char *path;
+        usec_t time;
+} GeneratorTime;
+
+static int compare_generator_time(const void *a, const void *b) {
+        return compare(((const GeneratorTime *) b)->time,
+                       ((const GeneratorTime *) a)->time);
+}
+
+static int analyze_generators(int argc, char *argv[], void *userdata) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_free_ GeneratorTime *times = NULL;
+        size_t allocated = 0, n = 0, i;
+        const char *path;
+        uint64_t t;
+        int r;
+
+        r = acquire_bus(&bus, NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to create bus connection: %m");
+
+        r = sd_bus_get_property(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "GeneratorTimes",
+                        &error,
+                        &reply,
+                        "a(st)");
+        if (r < 0) {
+                log_error("Failed to get generator times: %s", bus_error_message(&error, -r));
+                return r;
+        }
+
+        r = sd_bus_message_enter_container(reply, 'a', "(st)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        while ((r = sd_bus_message_read(reply, "(st)", &path, &t)) > 0) {
+                if (!GREEDY_REALLOC(times, allocated, n + 1))
+                        return log_oom();
+
+                times[n++] = (GeneratorTime) {
+                        .path = path,
+                        .time = t,
+                };
+        }
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        qsort_safe(times, n, sizeof(GeneratorTime), compare_generator_time);
+
+        (void) pager_open(arg_no_pager, false);
+
+        for (i = 0; i < n; i++) {
+                char ts[FORMAT_TIMESPAN_MAX];
+
+                printf("%16s %s\n", format_timespan(ts, sizeof(ts), times[i].time, USEC_PER_MSEC), times[i].path);
+        }
+
+        return 0;
+}
+
+typedef struct TraceEvent {
+        const char *phase;
+        const char *unit;
+        usec_t begin;
+        usec_t end;
+} TraceEvent;
+
+static int compare_trace_event(const void *a, const void *b) {
+        const TraceEvent *x = a, *y = b;
+        int r;
+
+        r = compare(x->begin, y->begin);
+        if (r != 0)
+                return r;
+
+        return compare(x->end, y->end);
+}
+
+typedef struct TracePhaseTotal {
+        const char *phase;
+        usec_t time;
+        unsigned n;
+} TracePhaseTotal;
+
+static int compare_trace_phase_total(const void *a, const void *b) {
+        return compare(((const TracePhaseTotal *) b)->time,
+                       ((const TracePhaseTotal *) a)->time);
+}
+
+static int analyze_trace(int argc, char *argv[], void *userdata) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_free_ TracePhaseTotal *totals = NULL;
+        _cleanup_free_ TraceEvent *events = NULL;
+        size_t allocated = 0, n = 0, totals_allocated = 0, n_totals = 0, i, k;
+        const char *phase, *unit;
+        uint64_t begin, end, base = 0;
+        int r;
+
+        r = acquire_bus(&bus, NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to create bus connection: %m");
+
+        r = sd_bus_call_method(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "GetBootTrace",
+                        &error,
+                        &reply,
+                        NULL);
+        if (r < 0) {
+                log_error("Failed to get boot trace: %s", bus_error_message(&error, r));
+                return r;
+        }
+
+        r = sd_bus_message_enter_container(reply, 'a', "(sstt)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        while ((r = sd_bus_message_read(reply, "(sstt)", &phase, &unit, &begin, &end)) > 0) {
+                if (!GREEDY_REALLOC(events, allocated, n + 1))
+                        return log_oom();
+
+                events[n++] = (TraceEvent) {
+                        .phase = phase,
+                        .unit = unit,
+                        .begin = begin,
+                        .end = end,
+                };
+        }
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        if (n == 0) {
+                log_info("No boot trace recorded.");
+                return 0;
+        }
+
+        qsort_safe(events, n, sizeof(TraceEvent), compare_trace_event);
+
+        /* Show the events relative to the start of the manager, if we know it */
+        (void) bus_get_uint64_property(bus,
+                                       "/org/freedesktop/systemd1",
+                                       "org.freedesktop.systemd1.Manager",
+                                       "UserspaceTimestampMonotonic",
+                                       &base);
+        if (base == 0 || base > events[0].begin)
+                base = events[0].begin;
+
+        for (i = 0; i < n; i++) {
+                for (k = 0; k < n_totals; k++)
+                        if (streq(totals[k].phase, events[i].phase))
+                                break;
+
+                if (k >= n_totals) {
+                        if (!GREEDY_REALLOC(totals, totals_allocated, n_totals + 1))
+                                return log_oom();
+
+                        totals[n_totals++] = (TracePhaseTotal) {
+                                .phase = events[i].phase,
+                        };
+                }
+
+                totals[k].time += events[i].end - events[i].begin;
+                totals[k].n++;
+        }
+
+        qsort_safe(totals, n_totals, sizeof(TracePhaseTotal), compare_trace_phase_total);
+
+        (void) pager_open(arg_no_pager, false);
+
+        for (i = 0; i < n; i++) {
+                char ts[FORMAT_TIMESPAN_MAX], td[FORMAT_TIMESPAN_MAX];
+
+                printf("%16s %16s %-15s %s\n",
+                       format_timespan(ts, sizeof(ts), events[i].begin - base, USEC_PER_MSEC),
+                       format_timespan(td, sizeof(td), events[i].end - events[i].begin, 1),
+                       events[i].phase,
+                       events[i].unit);
+        }
+
+        /* Phases nest (units are loaded while transactions are built, for example), hence these don't add up
+         * to the total boot time */
+        printf("\n");
+
+        for (k = 0; k < n_totals; k++) {
+                char ts[FORMAT_TIMESPAN_MAX];
+
+                printf("%16s %-15s (%u events)\n",
+                       format_timespan(ts, sizeof(ts), totals[k].time, 1),
+                       totals[k].phase,
+                       totals[k].n);
+        }
+
+        return 0;
+}
+
 static int analyze_time(int argc, char *argv[], void *userdata) {
         _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         _cleanup_free_ char *buf = NULL;
@@ -1711,6 +1918,8 @@ static int help(int argc, char *argv[], void *userdata) {
                "Commands:\n"
                "  time                     Print time spent in the kernel\n"
                "  blame                    Print list of running units ordered by time to init\n"
+               "  generators               Print list of generators ordered by their run time\n"
+               "  trace                    Print the phases the manager went through while booting\n"
                "  critical-chain [UNIT...] Print a tree of the time critical chain of units\n"
                "  plot                     Output SVG graphic showing service initialization\n"
                "  dot [UNIT...]            Output dependency graph in man:dot(1) format\n"
@@ -1894,6 +2103,8 @@ int main(int argc, char *argv[]) {
                 { "help",              VERB_ANY, VERB_ANY, 0,            help                   },
                 { "time",              VERB_ANY, 1,        VERB_DEFAULT, analyze_time           },
                 { "blame",             VERB_ANY, 1,        0,            analyze_blame          },
+                { "generators",        VERB_ANY, 1,        0,            analyze_generators     },
+                { "trace",             VERB_ANY, 1,        0,            analyze_trace          },
                 { "critical-chain",    VERB_ANY, VERB_ANY, 0,            analyze_critical_chain },
                 { "plot",              VERB_ANY, 1,        0,            analyze_plot           },
                 { "dot",               VERB_ANY, VERB_ANY, 0,            dot                    },
@@ -1103,17 +1103,43 @@ int calendar_spec_from_string(const char *p, CalendarSpec **spec) {
         return 0;
 }
 
-static int find_end_of_month(struct tm *tm, bool utc, int day) {
-        struct tm t = *tm;
+/* The helpers below do date arithmetic without mktime(), which needs to consult the time zone and is hence
+ * comparatively slow. They are only valid for dates that went through tm_out_of_bounds() already. */
 
-        t.tm_mon++;
-        t.tm_mday = 1 - day;
+static int days_in_month(int year, int month) {
+        static const int days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
 
-        if (mktime_or_timegm(&t, utc) < 0 ||
-            t.tm_mon != tm->tm_mon)
+        assert(month >= 0 && month < 12);
+
+        if (month == 1 && ((year % 4 == 0 && year % 100 != 0) || year % 400 == 0))
+                return 29;
+
+        return days[month];
+}
+
+static int day_of_week(int year, int month, int mday) {
+        static const int offsets[12] = { 0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4 };
+        int y, k;
+
+        /* Returns the day of the week, with 0 for Monday, as in weekdays_bits */
+
+        y = year - (month < 2);
+        k = (y + y/4 - y/100 + y/400 + offsets[month] + mday) % 7;
+
+        return k == 0 ? 6 : k - 1;
+}
+
+static int find_end_of_month(const struct tm *tm, int day) {
+        int n;
+
+        if (tm->tm_mon < 0 || tm->tm_mon >= 12)
+                return -1;
+
+        n = days_in_month(tm->tm_year + 1900, tm->tm_mon);
+        if (day < 1 || day > n)
                 return -1;
 
-        return t.tm_mday;
+        return n - day + 1;
 }
 
 static int find_matching_component(const CalendarSpec *spec, const CalendarComponent *c,
@@ -1133,8 +1159,8 @@ static int find_matching_component(const CalendarSpec *spec, const CalendarCompo
                 stop = c->stop;
 
                 if (spec->end_of_month && p == spec->day) {
-                        start = find_end_of_month(tm, spec->utc, start);
-                        stop = find_end_of_month(tm, spec->utc, stop);
+                        start = find_end_of_month(tm, start);
+                        stop = find_end_of_month(tm, stop);
 
                         if (stop > 0)
                                 SWAP_TWO(start, stop);
@@ -1196,18 +1222,13 @@ static bool tm_out_of_bounds(const struct tm *tm, bool utc) {
                 t.tm_sec != tm->tm_sec;
 }
 
-static bool matches_weekday(int weekdays_bits, const struct tm *tm, bool utc) {
-        struct tm t;
+static bool matches_weekday(int weekdays_bits, const struct tm *tm) {
         int k;
 
         if (weekdays_bits < 0 || weekdays_bits >= BITS_WEEKDAYS)
                 return true;
 
-        t = *tm;
-        if (mktime_or_timegm(&t, utc) < 0)
-                return false;
-
-        k = t.tm_wday == 0 ? 6 : t.tm_wday - 1;
+        k = day_of_week(tm->tm_year + 1900, tm->tm_mon, tm->tm_mday);
         return (weekdays_bits & (1 << k));
 }
 
@@ -1267,7 +1288,7 @@ static int find_next(const CalendarSpec *spec, struct tm *tm, usec_t *usec) {
                         continue;
                 }
 
-                if (!matches_weekday(spec->weekdays_bits, &c, spec->utc)) {
+                if (!matches_weekday(spec->weekdays_bits, &c)) {
                         c.tm_mday++;
                         c.tm_hour = c.tm_min = c.tm_sec = tm_usec = 0;
                         continue;
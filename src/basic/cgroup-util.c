@@ -313,6 +313,148 @@ int cg_kill(
         return ret;
 }
 
+static int cg_kill_log_recursive(
+                const char *controller,
+                const char *path,
+                CGroupFlags flags,
+                Set *s,
+                cg_kill_log_func_t log_kill,
+                void *userdata) {
+
+        _cleanup_closedir_ DIR *d = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        pid_t pid, my_pid;
+        int r, ret = 0;
+        char *fn;
+
+        /* Goes through the tree once, logging and recording the processes the kernel is about to kill for
+         * us. Returns > 0 if there was any process at all. */
+
+        my_pid = getpid_cached();
+
+        r = cg_enumerate_processes(controller, path, &f);
+        if (r == -ENOENT)
+                return 0;
+        if (r < 0)
+                return r;
+
+        while ((r = cg_read_pid(f, &pid)) > 0) {
+                ret = 1;
+
+                if ((flags & CGROUP_IGNORE_SELF) && pid == my_pid)
+                        continue;
+
+                if (set_get(s, PID_TO_PTR(pid)) == PID_TO_PTR(pid))
+                        continue;
+
+                log_kill(pid, SIGKILL, userdata);
+
+                r = set_put(s, PID_TO_PTR(pid));
+                if (r < 0)
+                        return r;
+        }
+        if (r < 0)
+                return r;
+
+        r = cg_enumerate_subgroups(controller, path, &d);
+        if (r == -ENOENT)
+                return ret;
+        if (r < 0)
+                return r;
+
+        while ((r = cg_read_subgroup(d, &fn)) > 0) {
+                _cleanup_free_ char *p = NULL;
+
+                p = strjoin(path, "/", fn);
+                free(fn);
+                if (!p)
+                        return -ENOMEM;
+
+                r = cg_kill_log_recursive(controller, p, flags, s, log_kill, userdata);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        ret = 1;
+        }
+        if (r < 0)
+                return r;
+
+        return ret;
+}
+
+static int cg_kill_kernel_sigkill(
+                const char *controller,
+                const char *path,
+                CGroupFlags flags,
+                Set *s,
+                cg_kill_log_func_t log_kill,
+                void *userdata) {
+
+        _cleanup_free_ char *killfile = NULL;
+        int r;
+
+        assert(path);
+
+        /* Kills the whole subtree with a single write to cgroup.kill (kernel 5.14+). Unlike our own loop this
+         * doesn't race against forking processes, and costs the same however many processes there are.
+         * Returns -EOPNOTSUPP if this can't be used, in which case nothing was done. */
+
+        if (flags & CGROUP_REMOVE)
+                return -EOPNOTSUPP;
+
+        /* The root cgroup has no cgroup.kill */
+        if (empty_or_root(path))
+                return -EOPNOTSUPP;
+
+        r = cg_unified_controller(controller);
+        if (r < 0)
+                return r;
+        if (r == 0)
+                return -EOPNOTSUPP;
+
+        r = cg_get_path(controller, path, "cgroup.kill", &killfile);
+        if (r < 0)
+                return r;
+
+        /* If the cgroup is gone already, let the loop figure that out */
+        if (access(killfile, F_OK) < 0)
+                return -EOPNOTSUPP;
+
+        /* cgroup.kill can't spare us */
+        if (flags & CGROUP_IGNORE_SELF) {
+                _cleanup_free_ char *own = NULL;
+
+                r = cg_pid_get_path(controller, 0, &own);
+                if (r < 0)
+                        return r;
+
+                if (path_startswith(own, path))
+                        return -EOPNOTSUPP;
+        }
+
+        /* The processes in s were sent the signal already, killing them once more is harmless. The write
+         * doesn't tell us whether there was anything to kill, hence find out first. */
+        if (log_kill)
+                r = cg_kill_log_recursive(controller, path, flags, s, log_kill, userdata);
+        else {
+                r = cg_is_empty_recursive(controller, path);
+                if (r >= 0)
+                        r = !r;
+        }
+        if (r == -ENOENT)
+                return 0;
+        if (r <= 0)
+                return r;
+
+        r = write_string_file(killfile, "1", 0);
+        if (r == -ENOENT)
+                return 0;
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+
 int cg_kill_recursive(
                 const char *controller,
                 const char *path,
@@ -336,6 +478,12 @@ int cg_kill_recursive(
                         return -ENOMEM;
         }
 
+        if (sig == SIGKILL) {
+                r = cg_kill_kernel_sigkill(controller, path, flags, s, log_kill, userdata);
+                if (r != -EOPNOTSUPP)
+                        return r;
+        }
+
         ret = cg_kill(controller, path, sig, flags, s, log_kill, userdata);
 
         r = cg_enumerate_subgroups(controller, path, &d);
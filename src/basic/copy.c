@@ -14,6 +14,7 @@
 #include <string.h>
 #include <sys/sendfile.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <sys/xattr.h>
 #include <time.h>
 #include <unistd.h>
@@ -29,6 +30,9 @@
 #include "io-util.h"
 #include "macro.h"
 #include "missing.h"
+#include "rm-rf.h"
+#include "stat-util.h"
+#include "stdio-util.h"
 #include "string-util.h"
 #include "strv.h"
 #include "time-util.h"
@@ -84,6 +88,93 @@ static int fd_is_nonblock_pipe(int fd) {
         return (flags & O_NONBLOCK) == O_NONBLOCK ? FD_IS_NONBLOCKING_PIPE : FD_IS_BLOCKING_PIPE;
 }
 
+static int create_hole(int fd, off_t size) {
+        off_t offset, end;
+
+        /* Moves the write position of fd forward by size bytes, leaving a hole behind. If the file already has
+         * data there, deallocate it. */
+
+        offset = lseek(fd, 0, SEEK_CUR);
+        if (offset < 0)
+                return -errno;
+
+        end = lseek(fd, 0, SEEK_END);
+        if (end < 0)
+                return -errno;
+
+        if (end > offset &&
+            fallocate(fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE, offset, MIN(size, end - offset)) < 0)
+                return -errno;
+
+        if (end < offset + size &&
+            ftruncate(fd, offset + size) < 0)
+                return -errno;
+
+        if (lseek(fd, offset + size, SEEK_SET) < 0)
+                return -errno;
+
+        return 0;
+}
+
+static int skip_hole(int fdf, int fdt, uint64_t *max_bytes, size_t *ret_segment) {
+        off_t c, data, hole;
+        int r;
+
+        assert(max_bytes);
+        assert(ret_segment);
+
+        /* If the read position of fdf is in a hole, skips over it and creates a hole of the same size in fdt.
+         * Returns the size of the data segment that follows in ret_segment, which is 0 at EOF. Returns -ESPIPE
+         * if SEEK_DATA/SEEK_HOLE are not supported for this file. */
+
+        c = lseek(fdf, 0, SEEK_CUR);
+        if (c < 0)
+                return -errno;
+
+        data = lseek(fdf, c, SEEK_DATA);
+        if (data < 0) {
+                if (errno != ENXIO)
+                        return -errno;
+
+                /* There's only a hole left until the end of the file */
+                data = lseek(fdf, 0, SEEK_END);
+                if (data < 0)
+                        return -errno;
+        }
+
+        if (data > c) {
+                if (*max_bytes != UINT64_MAX && (uint64_t) (data - c) > *max_bytes)
+                        data = c + *max_bytes;
+
+                r = create_hole(fdt, data - c);
+                if (r < 0) {
+                        /* Go back, so that the caller may copy the hole the traditional way */
+                        if (lseek(fdf, c, SEEK_SET) < 0)
+                                return -errno;
+
+                        return r;
+                }
+
+                if (*max_bytes != UINT64_MAX)
+                        *max_bytes -= data - c;
+        }
+
+        hole = lseek(fdf, data, SEEK_HOLE);
+        if (hole < 0) {
+                if (errno != ENXIO)
+                        return -errno;
+
+                hole = data;
+        }
+
+        /* SEEK_HOLE moved the read position, go back to where the data starts */
+        if (lseek(fdf, data, SEEK_SET) < 0)
+                return -errno;
+
+        *ret_segment = (size_t) MIN((uint64_t) (hole - data), (uint64_t) SSIZE_MAX);
+        return 0;
+}
+
 int copy_bytes_full(
                 int fdf, int fdt,
                 uint64_t max_bytes,
@@ -91,9 +182,9 @@ int copy_bytes_full(
                 void **ret_remains,
                 size_t *ret_remains_size) {
 
-        bool try_cfr = true, try_sendfile = true, try_splice = true;
+        bool try_cfr = true, try_sendfile = true, try_splice = true, try_holes;
         int r, nonblock_pipe = -1;
-        size_t m = SSIZE_MAX; /* that is the maximum that sendfile and c_f_r accept */
+        size_t m, m_max = SSIZE_MAX; /* that is the maximum that sendfile and c_f_r accept */
 
         assert(fdf >= 0);
         assert(fdt >= 0);
@@ -111,8 +202,9 @@ int copy_bytes_full(
         if (ret_remains_size)
                 *ret_remains_size = 0;
 
-        /* Try btrfs reflinks first. This only works on regular, seekable files, hence let's check the file offsets of
-         * source and destination first. */
+        /* Try reflinks first. The ioctl is the same as FICLONE, hence this works on XFS too, not only btrfs. This
+         * only works on regular, seekable files, hence let's check the file offsets of source and destination
+         * first. */
         if ((copy_flags & COPY_REFLINK)) {
                 off_t foffset;
 
@@ -166,12 +258,37 @@ int copy_bytes_full(
                 }
         }
 
+        /* Holes can only be detected in regular files, and only need to be recreated in regular files */
+        try_holes = (copy_flags & COPY_HOLES) && fd_verify_regular(fdf) >= 0 && fd_verify_regular(fdt) >= 0;
+
         for (;;) {
                 ssize_t n;
 
                 if (max_bytes <= 0)
                         return 1; /* return > 0 if we hit the max_bytes limit */
 
+                m = m_max;
+
+                if (try_holes) {
+                        size_t segment;
+
+                        r = skip_hole(fdf, fdt, &max_bytes, &segment);
+                        if (r < 0) {
+                                if (!IN_SET(r, -ESPIPE, -EINVAL, -EOPNOTSUPP))
+                                        return r;
+
+                                log_debug_errno(r, "Can't copy holes, falling back to copying them as zeroes: %m");
+                                try_holes = false;
+                        } else {
+                                if (max_bytes <= 0)
+                                        return 1;
+                                if (segment == 0) /* EOF */
+                                        break;
+
+                                m = MIN(m, segment);
+                        }
+                }
+
                 if (max_bytes != UINT64_MAX && m > max_bytes)
                         m = max_bytes;
 
@@ -315,12 +432,147 @@ int copy_bytes_full(
                  * so reduce our maximum by the amount we already copied,
                  * but don't go below our copy buffer size, unless we are
                  * close the limit of bytes we are allowed to copy. */
-                m = MAX(MIN(COPY_BUFFER_SIZE, max_bytes), m - n);
+                m_max = MAX(MIN(COPY_BUFFER_SIZE, max_bytes), m_max - n);
         }
 
         return 0; /* return 0 if we hit EOF earlier than the size limit */
 }
 
+typedef struct HardlinkContext {
+        int dir_fd;    /* An fd to the directory we use as lookup table, created when needed */
+        int parent_fd; /* An fd to the directory containing it */
+        char *subdir;  /* The name of the lookup table directory, relative to parent_fd */
+} HardlinkContext;
+
+#define HARDLINK_CONTEXT_INIT { .dir_fd = -1, .parent_fd = -1 }
+
+static int hardlink_context_setup(HardlinkContext *c, int dt, const char *to, CopyFlags copy_flags) {
+        _cleanup_free_ char *t = NULL;
+        int r;
+
+        assert(c);
+        assert(c->dir_fd < 0);
+        assert(c->parent_fd < 0);
+        assert(!c->subdir);
+        assert(to);
+
+        if (!(copy_flags & COPY_HARDLINKS))
+                return 0;
+
+        /* Inodes with more than one link are linked into a hidden directory next to the destination, named by
+         * the source device and inode, when we copy them first. Further links to them are then created from
+         * there, and the directory is removed when we are done. */
+
+        if (dt == AT_FDCWD)
+                c->parent_fd = AT_FDCWD;
+        else {
+                c->parent_fd = fcntl(dt, F_DUPFD_CLOEXEC, 3);
+                if (c->parent_fd < 0)
+                        return -errno;
+        }
+
+        t = strdup(to);
+        if (!t)
+                return -ENOMEM;
+
+        /* Copying into "/"? Then we have nowhere to put the directory, and just copy each link. */
+        delete_trailing_chars(t, "/");
+        if (isempty(t))
+                return 0;
+
+        r = tempfn_random(t, "hardlink", &c->subdir);
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+
+static int hardlink_context_realize(HardlinkContext *c) {
+        int r;
+
+        assert(c);
+
+        if (c->dir_fd >= 0)
+                return 0;
+
+        if (mkdirat(c->parent_fd, c->subdir, 0700) < 0)
+                return -errno;
+
+        c->dir_fd = openat(c->parent_fd, c->subdir, O_RDONLY|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW);
+        if (c->dir_fd < 0) {
+                r = -errno;
+                (void) unlinkat(c->parent_fd, c->subdir, AT_REMOVEDIR);
+                return r;
+        }
+
+        return 0;
+}
+
+static void hardlink_context_destroy(HardlinkContext *c) {
+        assert(c);
+
+        if (c->dir_fd >= 0) {
+                /* rm_rf_children() takes possession of the fd */
+                (void) rm_rf_children(c->dir_fd, REMOVE_PHYSICAL, NULL);
+                c->dir_fd = -1;
+
+                (void) unlinkat(c->parent_fd, c->subdir, AT_REMOVEDIR);
+        }
+
+        if (c->parent_fd >= 0)
+                safe_close(c->parent_fd);
+        c->parent_fd = -1;
+
+        c->subdir = mfree(c->subdir);
+}
+
+static bool hardlink_context_wants(HardlinkContext *c, const struct stat *st) {
+        return c && c->subdir && !S_ISDIR(st->st_mode) && st->st_nlink > 1;
+}
+
+static int try_hardlink(HardlinkContext *c, const struct stat *st, int dt, const char *to) {
+        char dev_ino[DECIMAL_STR_MAX(unsigned)*2 + DECIMAL_STR_MAX(uint64_t) + 3];
+
+        assert(st);
+        assert(to);
+
+        /* Returns > 0 if we created a link to an inode we copied before, 0 if it needs to be copied */
+
+        if (!hardlink_context_wants(c, st) || c->dir_fd < 0)
+                return 0;
+
+        xsprintf(dev_ino, "%u:%u:%" PRIu64, major(st->st_dev), minor(st->st_dev), (uint64_t) st->st_ino);
+
+        if (linkat(c->dir_fd, dev_ino, dt, to, 0) < 0) {
+                /* Not seen yet, or we can't link (too many links, different file system): copy it */
+                if (IN_SET(errno, ENOENT, EMLINK, EXDEV, EPERM))
+                        return 0;
+
+                return -errno;
+        }
+
+        return 1;
+}
+
+static void memorize_hardlink(HardlinkContext *c, const struct stat *st, int dt, const char *to) {
+        char dev_ino[DECIMAL_STR_MAX(unsigned)*2 + DECIMAL_STR_MAX(uint64_t) + 3];
+
+        assert(st);
+        assert(to);
+
+        /* If this doesn't work, we merely copy the other links as well */
+
+        if (!hardlink_context_wants(c, st))
+                return;
+
+        if (hardlink_context_realize(c) < 0)
+                return;
+
+        xsprintf(dev_ino, "%u:%u:%" PRIu64, major(st->st_dev), minor(st->st_dev), (uint64_t) st->st_ino);
+
+        (void) linkat(dt, to, c->dir_fd, dev_ino, 0);
+}
+
 static int fd_copy_symlink(
                 int df,
                 const char *from,
@@ -329,7 +581,8 @@ static int fd_copy_symlink(
                 const char *to,
                 uid_t override_uid,
                 gid_t override_gid,
-                CopyFlags copy_flags) {
+                CopyFlags copy_flags,
+                HardlinkContext *hardlink_context) {
 
         _cleanup_free_ char *target = NULL;
         int r;
@@ -338,6 +591,10 @@ static int fd_copy_symlink(
         assert(st);
         assert(to);
 
+        r = try_hardlink(hardlink_context, st, dt, to);
+        if (r != 0)
+                return r < 0 ? r : 0;
+
         r = readlinkat_malloc(df, from, &target);
         if (r < 0)
                 return r;
@@ -351,6 +608,7 @@ static int fd_copy_symlink(
                      AT_SYMLINK_NOFOLLOW) < 0)
                 return -errno;
 
+        memorize_hardlink(hardlink_context, st, dt, to);
         return 0;
 }
 
@@ -362,7 +620,8 @@ static int fd_copy_regular(
                 const char *to,
                 uid_t override_uid,
                 gid_t override_gid,
-                CopyFlags copy_flags) {
+                CopyFlags copy_flags,
+                HardlinkContext *hardlink_context) {
 
         _cleanup_close_ int fdf = -1, fdt = -1;
         struct timespec ts[2];
@@ -372,6 +631,10 @@ static int fd_copy_regular(
         assert(st);
         assert(to);
 
+        r = try_hardlink(hardlink_context, st, dt, to);
+        if (r != 0)
+                return r < 0 ? r : 0;
+
         fdf = openat(df, from, O_RDONLY|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW);
         if (fdf < 0)
                 return -errno;
@@ -407,6 +670,9 @@ static int fd_copy_regular(
                 (void) unlinkat(dt, to, 0);
         }
 
+        if (r >= 0)
+                memorize_hardlink(hardlink_context, st, dt, to);
+
         return r;
 }
 
@@ -418,13 +684,18 @@ static int fd_copy_fifo(
                 const char *to,
                 uid_t override_uid,
                 gid_t override_gid,
-                CopyFlags copy_flags) {
+                CopyFlags copy_flags,
+                HardlinkContext *hardlink_context) {
         int r;
 
         assert(from);
         assert(st);
         assert(to);
 
+        r = try_hardlink(hardlink_context, st, dt, to);
+        if (r != 0)
+                return r < 0 ? r : 0;
+
         r = mkfifoat(dt, to, st->st_mode & 07777);
         if (r < 0)
                 return -errno;
@@ -438,6 +709,9 @@ static int fd_copy_fifo(
         if (fchmodat(dt, to, st->st_mode & 07777, 0) < 0)
                 r = -errno;
 
+        if (r >= 0)
+                memorize_hardlink(hardlink_context, st, dt, to);
+
         return r;
 }
 
@@ -449,13 +723,18 @@ static int fd_copy_node(
                 const char *to,
                 uid_t override_uid,
                 gid_t override_gid,
-                CopyFlags copy_flags) {
+                CopyFlags copy_flags,
+                HardlinkContext *hardlink_context) {
         int r;
 
         assert(from);
         assert(st);
         assert(to);
 
+        r = try_hardlink(hardlink_context, st, dt, to);
+        if (r != 0)
+                return r < 0 ? r : 0;
+
         r = mknodat(dt, to, st->st_mode, st->st_rdev);
         if (r < 0)
                 return -errno;
@@ -469,6 +748,9 @@ static int fd_copy_node(
         if (fchmodat(dt, to, st->st_mode & 07777, 0) < 0)
                 r = -errno;
 
+        if (r >= 0)
+                memorize_hardlink(hardlink_context, st, dt, to);
+
         return r;
 }
 
@@ -481,7 +763,8 @@ static int fd_copy_directory(
                 dev_t original_device,
                 uid_t override_uid,
                 gid_t override_gid,
-                CopyFlags copy_flags) {
+                CopyFlags copy_flags,
+                HardlinkContext *hardlink_context) {
 
         _cleanup_close_ int fdf = -1, fdt = -1;
         _cleanup_closedir_ DIR *d = NULL;
@@ -534,15 +817,15 @@ static int fd_copy_directory(
                         continue;
 
                 if (S_ISREG(buf.st_mode))
-                        q = fd_copy_regular(dirfd(d), de->d_name, &buf, fdt, de->d_name, override_uid, override_gid, copy_flags);
+                        q = fd_copy_regular(dirfd(d), de->d_name, &buf, fdt, de->d_name, override_uid, override_gid, copy_flags, hardlink_context);
                 else if (S_ISDIR(buf.st_mode))
-                        q = fd_copy_directory(dirfd(d), de->d_name, &buf, fdt, de->d_name, original_device, override_uid, override_gid, copy_flags);
+                        q = fd_copy_directory(dirfd(d), de->d_name, &buf, fdt, de->d_name, original_device, override_uid, override_gid, copy_flags, hardlink_context);
                 else if (S_ISLNK(buf.st_mode))
-                        q = fd_copy_symlink(dirfd(d), de->d_name, &buf, fdt, de->d_name, override_uid, override_gid, copy_flags);
+                        q = fd_copy_symlink(dirfd(d), de->d_name, &buf, fdt, de->d_name, override_uid, override_gid, copy_flags, hardlink_context);
                 else if (S_ISFIFO(buf.st_mode))
-                        q = fd_copy_fifo(dirfd(d), de->d_name, &buf, fdt, de->d_name, override_uid, override_gid, copy_flags);
+                        q = fd_copy_fifo(dirfd(d), de->d_name, &buf, fdt, de->d_name, override_uid, override_gid, copy_flags, hardlink_context);
                 else if (S_ISBLK(buf.st_mode) || S_ISCHR(buf.st_mode) || S_ISSOCK(buf.st_mode))
-                        q = fd_copy_node(dirfd(d), de->d_name, &buf, fdt, de->d_name, override_uid, override_gid, copy_flags);
+                        q = fd_copy_node(dirfd(d), de->d_name, &buf, fdt, de->d_name, override_uid, override_gid, copy_flags, hardlink_context);
                 else
                         q = -EOPNOTSUPP;
 
@@ -574,6 +857,29 @@ static int fd_copy_directory(
         return r;
 }
 
+static int fd_copy_tree_directory(
+                int df,
+                const char *from,
+                const struct stat *st,
+                int dt,
+                const char *to,
+                uid_t override_uid,
+                gid_t override_gid,
+                CopyFlags copy_flags) {
+
+        HardlinkContext hardlink_context = HARDLINK_CONTEXT_INIT;
+        int r;
+
+        r = hardlink_context_setup(&hardlink_context, dt, to, copy_flags);
+        if (r < 0)
+                return r;
+
+        r = fd_copy_directory(df, from, st, dt, to, st->st_dev, override_uid, override_gid, copy_flags, &hardlink_context);
+
+        hardlink_context_destroy(&hardlink_context);
+        return r;
+}
+
 int copy_tree_at(int fdf, const char *from, int fdt, const char *to, uid_t override_uid, gid_t override_gid, CopyFlags copy_flags) {
         struct stat st;
 
@@ -584,15 +890,15 @@ int copy_tree_at(int fdf, const char *from, int fdt, const char *to, uid_t overr
                 return -errno;
 
         if (S_ISREG(st.st_mode))
-                return fd_copy_regular(fdf, from, &st, fdt, to, override_uid, override_gid, copy_flags);
+                return fd_copy_regular(fdf, from, &st, fdt, to, override_uid, override_gid, copy_flags, NULL);
         else if (S_ISDIR(st.st_mode))
-                return fd_copy_directory(fdf, from, &st, fdt, to, st.st_dev, override_uid, override_gid, copy_flags);
+                return fd_copy_tree_directory(fdf, from, &st, fdt, to, override_uid, override_gid, copy_flags);
         else if (S_ISLNK(st.st_mode))
-                return fd_copy_symlink(fdf, from, &st, fdt, to, override_uid, override_gid, copy_flags);
+                return fd_copy_symlink(fdf, from, &st, fdt, to, override_uid, override_gid, copy_flags, NULL);
         else if (S_ISFIFO(st.st_mode))
-                return fd_copy_fifo(fdf, from, &st, fdt, to, override_uid, override_gid, copy_flags);
+                return fd_copy_fifo(fdf, from, &st, fdt, to, override_uid, override_gid, copy_flags, NULL);
         else if (S_ISBLK(st.st_mode) || S_ISCHR(st.st_mode) || S_ISSOCK(st.st_mode))
-                return fd_copy_node(fdf, from, &st, fdt, to, override_uid, override_gid, copy_flags);
+                return fd_copy_node(fdf, from, &st, fdt, to, override_uid, override_gid, copy_flags, NULL);
         else
                 return -EOPNOTSUPP;
 }
@@ -613,7 +919,7 @@ int copy_directory_fd(int dirfd, const char *to, CopyFlags copy_flags) {
         if (!S_ISDIR(st.st_mode))
                 return -ENOTDIR;
 
-        return fd_copy_directory(dirfd, NULL, &st, AT_FDCWD, to, st.st_dev, UID_INVALID, GID_INVALID, copy_flags);
+        return fd_copy_tree_directory(dirfd, NULL, &st, AT_FDCWD, to, UID_INVALID, GID_INVALID, copy_flags);
 }
 
 int copy_directory(const char *from, const char *to, CopyFlags copy_flags) {
@@ -628,7 +934,7 @@ int copy_directory(const char *from, const char *to, CopyFlags copy_flags) {
         if (!S_ISDIR(st.st_mode))
                 return -ENOTDIR;
 
-        return fd_copy_directory(AT_FDCWD, from, &st, AT_FDCWD, to, st.st_dev, UID_INVALID, GID_INVALID, copy_flags);
+        return fd_copy_tree_directory(AT_FDCWD, from, &st, AT_FDCWD, to, UID_INVALID, GID_INVALID, copy_flags);
 }
 
 int copy_file_fd(const char *from, int fdt, CopyFlags copy_flags) {
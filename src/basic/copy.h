@@ -13,9 +13,11 @@
 #include <sys/types.h>
 
 typedef enum CopyFlags {
-        COPY_REFLINK = 1U << 0, /* Try to reflink */
-        COPY_MERGE   = 1U << 1, /* Merge existing trees with our new one to copy */
-        COPY_REPLACE = 1U << 2, /* Replace an existing file if there's one */
+        COPY_REFLINK   = 1U << 0, /* Try to reflink */
+        COPY_MERGE     = 1U << 1, /* Merge existing trees with our new one to copy */
+        COPY_REPLACE   = 1U << 2, /* Replace an existing file if there's one */
+        COPY_HOLES     = 1U << 3, /* Copy holes as holes, instead of writing out zeroes */
+        COPY_HARDLINKS = 1U << 4, /* Recreate hardlinks within the tree, instead of copying each link */
 } CopyFlags;
 
 int copy_file_fd(const char *from, int to, CopyFlags copy_flags);
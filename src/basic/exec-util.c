@@ -9,6 +9,7 @@
 #include <errno.h>
 #include <sys/prctl.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <stdio.h>
 
@@ -19,7 +20,9 @@
 #include "fd-util.h"
 #include "fileio.h"
 #include "hashmap.h"
+#include "io-util.h"
 #include "macro.h"
+#include "parse-util.h"
 #include "process-util.h"
 #include "set.h"
 #include "signal-util.h"
@@ -42,7 +45,7 @@ static int do_spawn(const char *path, char *argv[], int stdout_fd, pid_t *pid) {
                 return 0;
         }
 
-        r = safe_fork("(direxec)", FORK_DEATHSIG|FORK_LOG, &_pid);
+        r = safe_fork("(direxec)", FORK_RESET_SIGNALS|FORK_DEATHSIG|FORK_LOG, &_pid);
         if (r < 0)
                 return r;
         if (r == 0) {
@@ -70,9 +73,96 @@ static int do_spawn(const char *path, char *argv[], int stdout_fd, pid_t *pid) {
         return 1;
 }
 
+typedef struct ExecChild {
+        usec_t start;
+        char path[];
+} ExecChild;
+
+static int wait_for_children(Hashmap *pids, usec_t timeout_per_binary, int timing_fd) {
+        sigset_t mask;
+
+        assert(pids);
+
+        /* Reaps children in the order they finish, so that we know how long each of them took, and kills
+         * those which exceed their time budget. SIGCHLD has been blocked by the caller, before the children
+         * were forked off. */
+
+        assert_se(sigemptyset(&mask) >= 0);
+        assert_se(sigaddset(&mask, SIGCHLD) >= 0);
+
+        while (!hashmap_isempty(pids)) {
+                _cleanup_free_ ExecChild *c = NULL;
+                usec_t n, deadline = USEC_INFINITY;
+                char ts[FORMAT_TIMESPAN_MAX];
+                siginfo_t si = {};
+                ExecChild *i;
+                Iterator it;
+                void *k;
+
+                n = now(CLOCK_MONOTONIC);
+
+                if (timeout_per_binary != USEC_INFINITY)
+                        HASHMAP_FOREACH_KEY(i, k, pids, it) {
+                                usec_t d;
+
+                                /* Children we already killed have their start time reset */
+                                d = usec_add(i->start, timeout_per_binary);
+                                if (d > n) {
+                                        deadline = MIN(deadline, d);
+                                        continue;
+                                }
+
+                                log_warning("%s took longer than %s, killing.", i->path,
+                                            format_timespan(ts, sizeof(ts), timeout_per_binary, 0));
+                                (void) kill(PTR_TO_PID(k), SIGKILL);
+                                i->start = USEC_INFINITY;
+                        }
+
+                if (waitid(P_ALL, 0, &si, WEXITED|WNOWAIT|WNOHANG) < 0)
+                        return log_error_errno(errno, "Failed to wait for children: %m");
+
+                if (si.si_pid == 0) {
+                        struct timespec timeout;
+
+                        if (sigtimedwait(&mask, NULL,
+                                         deadline == USEC_INFINITY ? NULL : timespec_store(&timeout, deadline - n)) < 0 &&
+                            !IN_SET(errno, EAGAIN, EINTR))
+                                return log_error_errno(errno, "Failed to wait for SIGCHLD: %m");
+                        continue;
+                }
+
+                c = hashmap_remove(pids, PID_TO_PTR(si.si_pid));
+                if (!c) {
+                        /* Not one of ours, just reap it */
+                        (void) waitpid(si.si_pid, NULL, 0);
+                        continue;
+                }
+
+                (void) wait_for_terminate_and_check(c->path, si.si_pid, WAIT_LOG);
+
+                if (c->start == USEC_INFINITY)
+                        continue;
+
+                n = now(CLOCK_MONOTONIC) - c->start;
+                log_debug("%s finished in %s.", c->path, format_timespan(ts, sizeof(ts), n, USEC_PER_MSEC));
+
+                if (timing_fd >= 0) {
+                        char line[DECIMAL_STR_MAX(usec_t) + 1 + PATH_MAX + 2];
+                        int l;
+
+                        l = snprintf(line, sizeof(line), USEC_FMT " %s\n", n, c->path);
+                        if (l > 0 && (size_t) l < sizeof(line))
+                                (void) loop_write(timing_fd, line, l, false);
+                }
+        }
+
+        return 0;
+}
+
 static int do_execute(
                 char **directories,
                 usec_t timeout,
+                usec_t timeout_per_binary,
                 gather_stdout_callback_t const callbacks[_STDOUT_CONSUME_MAX],
                 void* const callback_args[_STDOUT_CONSUME_MAX],
                 int output_fd,
@@ -86,7 +176,8 @@ static int do_execute(
         /* We fork this all off from a child process so that we can somewhat cleanly make
          * use of SIGALRM to set a time limit.
          *
-         * If callbacks is nonnull, execution is serial. Otherwise, we default to parallel.
+         * If callbacks is nonnull, execution is serial. Otherwise, we default to parallel,
+         * and output_fd, if set, receives the run time of each binary.
          */
 
         r = conf_files_list_strv(&paths, NULL, NULL, CONF_FILES_EXECUTABLE|CONF_FILES_REGULAR|CONF_FILES_FILTER_MASKED, (const char* const*) directories);
@@ -97,6 +188,9 @@ static int do_execute(
                 pids = hashmap_new(NULL);
                 if (!pids)
                         return log_oom();
+
+                /* So that we can wait for children with a timeout, see wait_for_children() */
+                assert_se(sigprocmask_many(SIG_BLOCK, NULL, SIGCHLD, -1) >= 0);
         }
 
         /* Abort execution of this process after the timout. We simply rely on SIGALRM as
@@ -120,16 +214,32 @@ static int do_execute(
                                 return log_error_errno(fd, "Failed to open serialization file: %m");
                 }
 
-                r = do_spawn(t, argv, fd, &pid);
-                if (r <= 0)
-                        continue;
-
                 if (pids) {
-                        r = hashmap_put(pids, PID_TO_PTR(pid), t);
+                        _cleanup_free_ ExecChild *c = NULL;
+                        usec_t start;
+
+                        c = malloc(offsetof(ExecChild, path) + strlen(*path) + 1);
+                        if (!c)
+                                return log_oom();
+
+                        start = now(CLOCK_MONOTONIC);
+
+                        r = do_spawn(t, argv, fd, &pid);
+                        if (r <= 0)
+                                continue;
+
+                        c->start = start;
+                        strcpy(c->path, *path);
+
+                        r = hashmap_put(pids, PID_TO_PTR(pid), c);
                         if (r < 0)
                                 return log_oom();
-                        t = NULL;
+                        c = NULL;
                 } else {
+                        r = do_spawn(t, argv, fd, &pid);
+                        if (r <= 0)
+                                continue;
+
                         r = wait_for_terminate_and_check(t, pid, WAIT_LOG);
                         if (r < 0)
                                 continue;
@@ -150,28 +260,81 @@ static int do_execute(
                         return log_error_errno(r, "Callback two failed: %m");
         }
 
-        while (!hashmap_isempty(pids)) {
-                _cleanup_free_ char *t = NULL;
-                pid_t pid;
+        if (pids)
+                return wait_for_children(pids, timeout_per_binary, output_fd);
+
+        return 0;
+}
+
+static int read_timings(int fd, ExecTiming **ret, size_t *ret_n) {
+        _cleanup_fclose_ FILE *f = NULL;
+        ExecTiming *t = NULL;
+        size_t allocated = 0, n = 0;
+        int r;
+
+        /* Parses what wait_for_children() wrote, consumes fd, even on error */
+
+        f = fdopen(fd, "r");
+        if (!f) {
+                safe_close(fd);
+                return -errno;
+        }
+
+        for (;;) {
+                _cleanup_free_ char *line = NULL;
+                const char *p;
+                usec_t usec;
+                char *e;
+
+                r = read_line(f, LONG_LINE_MAX, &line);
+                if (r < 0)
+                        goto fail;
+                if (r == 0)
+                        break;
+
+                p = line;
+                e = strchr(p, ' ');
+                if (!e) {
+                        r = -EBADMSG;
+                        goto fail;
+                }
+                *e = 0;
 
-                pid = PTR_TO_PID(hashmap_first_key(pids));
-                assert(pid > 0);
+                r = safe_atou64(p, &usec);
+                if (r < 0)
+                        goto fail;
 
-                t = hashmap_remove(pids, PID_TO_PTR(pid));
-                assert(t);
+                if (!GREEDY_REALLOC(t, allocated, n + 1)) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
 
-                (void) wait_for_terminate_and_check(t, pid, WAIT_LOG);
+                t[n].path = strdup(e + 1);
+                if (!t[n].path) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+                t[n++].usec = usec;
         }
 
+        *ret = t;
+        *ret_n = n;
         return 0;
+
+fail:
+        exec_timing_free_many(t, n);
+        return r;
 }
 
-int execute_directories(
+int execute_directories_full(
                 const char* const* directories,
                 usec_t timeout,
+                usec_t timeout_per_binary,
                 gather_stdout_callback_t const callbacks[_STDOUT_CONSUME_MAX],
                 void* const callback_args[_STDOUT_CONSUME_MAX],
-                char *argv[]) {
+                char *argv[],
+                ExecTiming **ret_timings,
+                size_t *ret_n_timings) {
 
         char **dirs = (char**) directories;
         _cleanup_close_ int fd = -1;
@@ -179,6 +342,8 @@ int execute_directories(
         int r;
 
         assert(!strv_isempty(dirs));
+        assert(!callbacks || !ret_timings);
+        assert(!ret_timings == !ret_n_timings);
 
         name = basename(dirs[0]);
         assert(!isempty(name));
@@ -188,30 +353,41 @@ int execute_directories(
                 assert(callbacks[STDOUT_GENERATE]);
                 assert(callbacks[STDOUT_COLLECT]);
                 assert(callbacks[STDOUT_CONSUME]);
+        }
 
+        if (callbacks || ret_timings) {
                 fd = open_serialization_fd(name);
                 if (fd < 0)
                         return log_error_errno(fd, "Failed to open serialization file: %m");
         }
 
         /* Executes all binaries in the directories serially or in parallel and waits for
-         * them to finish. Optionally a timeout is applied. If a file with the same name
+         * them to finish. Optionally a timeout is applied, to all of them together and to each
+         * binary individually, the latter only in parallel mode. If a file with the same name
          * exists in more than one directory, the earliest one wins. */
 
         r = safe_fork("(sd-executor)", FORK_RESET_SIGNALS|FORK_DEATHSIG|FORK_LOG|FORK_WAIT, NULL);
         if (r < 0)
                 return r;
         if (r == 0) {
-                r = do_execute(dirs, timeout, callbacks, callback_args, fd, argv);
+                r = do_execute(dirs, timeout, timeout_per_binary, callbacks, callback_args, fd, argv);
                 _exit(r < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
         }
 
-        if (!callbacks)
-                return 0;
-
         if (lseek(fd, 0, SEEK_SET) < 0)
                 return log_error_errno(errno, "Failed to rewind serialization fd: %m");
 
+        if (ret_timings) {
+                r = read_timings(fd, ret_timings, ret_n_timings);
+                fd = -1;
+                if (r < 0)
+                        return log_error_errno(r, "Failed to read back execution times: %m");
+                return 0;
+        }
+
+        if (!callbacks)
+                return 0;
+
         r = callbacks[STDOUT_CONSUME](fd, callback_args[STDOUT_CONSUME]);
         fd = -1;
         if (r < 0)
@@ -219,6 +395,25 @@ int execute_directories(
         return 0;
 }
 
+int execute_directories(
+                const char* const* directories,
+                usec_t timeout,
+                gather_stdout_callback_t const callbacks[_STDOUT_CONSUME_MAX],
+                void* const callback_args[_STDOUT_CONSUME_MAX],
+                char *argv[]) {
+
+        return execute_directories_full(directories, timeout, USEC_INFINITY, callbacks, callback_args, argv, NULL, NULL);
+}
+
+void exec_timing_free_many(ExecTiming *t, size_t n) {
+        size_t i;
+
+        for (i = 0; i < n; i++)
+                free(t[i].path);
+
+        free(t);
+}
+
 static int gather_environment_generate(int fd, void *arg) {
         char ***env = arg, **x, **y;
         _cleanup_fclose_ FILE *f = NULL;
@@ -1,4 +1,5 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
 /***
   This file is part of systemd.
 
@@ -18,6 +19,21 @@ enum {
         _STDOUT_CONSUME_MAX,
 };
 
+typedef struct ExecTiming {
+        char *path;
+        usec_t usec;
+} ExecTiming;
+
+int execute_directories_full(
+                const char* const* directories,
+                usec_t timeout,
+                usec_t timeout_per_binary,
+                gather_stdout_callback_t const callbacks[_STDOUT_CONSUME_MAX],
+                void* const callback_args[_STDOUT_CONSUME_MAX],
+                char *argv[],
+                ExecTiming **ret_timings,
+                size_t *ret_n_timings);
+
 int execute_directories(
                 const char* const* directories,
                 usec_t timeout,
@@ -25,4 +41,6 @@ int execute_directories(
                 void* const callback_args[_STDOUT_CONSUME_MAX],
                 char *argv[]);
 
+void exec_timing_free_many(ExecTiming *t, size_t n);
+
 extern const gather_stdout_callback_t gather_environment[_STDOUT_CONSUME_MAX];
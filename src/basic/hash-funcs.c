@@ -85,6 +85,27 @@ const struct hash_ops trivial_hash_ops = {
         .compare = trivial_compare_func
 };
 
+uint64_t trusted_trivial_hash_func(const void *p, const uint8_t *key) {
+        uint64_t x, k0, k1;
+
+        memcpy(&k0, key, sizeof(k0));
+        memcpy(&k1, key + sizeof(k0), sizeof(k1));
+
+        /* The splitmix64 finalizer, keyed. Every input bit affects every output bit, so that the low bits of
+         * pointers, which are always zero due to alignment, don't end up as collisions. */
+        x = ((uint64_t) (uintptr_t) p ^ k0) + k1;
+        x = (x ^ (x >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+        x = (x ^ (x >> 27)) * UINT64_C(0x94d049bb133111eb);
+
+        return x ^ (x >> 31);
+}
+
+const struct hash_ops trusted_trivial_hash_ops = {
+        .hash = trivial_hash_func,
+        .compare = trivial_compare_func,
+        .fast_hash = trusted_trivial_hash_func,
+};
+
 void uint64_hash_func(const void *p, struct siphash *state) {
         siphash24_compress(p, sizeof(uint64_t), state);
 }
@@ -12,11 +12,17 @@
 #include "siphash24.h"
 
 typedef void (*hash_func_t)(const void *p, struct siphash *state);
+typedef uint64_t (*fast_hash_func_t)(const void *p, const uint8_t *key);
 typedef int (*compare_func_t)(const void *a, const void *b);
 
 struct hash_ops {
         hash_func_t hash;
         compare_func_t compare;
+
+        /* If set, used instead of hash. Gets the 16 byte key of the hashmap instead of a SipHash state, and may
+         * use a cheaper mixing function that is not designed to resist hash flooding. Only use it for maps whose
+         * keys can't be influenced by untrusted parties. */
+        fast_hash_func_t fast_hash;
 };
 
 void string_hash_func(const void *p, struct siphash *state);
@@ -33,6 +39,11 @@ void trivial_hash_func(const void *p, struct siphash *state);
 int trivial_compare_func(const void *a, const void *b) _const_;
 extern const struct hash_ops trivial_hash_ops;
 
+/* Same as trivial_hash_ops, but with a fast_hash function. Suitable for pointers to our own objects, whose
+ * values nobody else controls. Don't use it for PIDs, UIDs or other integers stored in pointers. */
+uint64_t trusted_trivial_hash_func(const void *p, const uint8_t *key) _pure_;
+extern const struct hash_ops trusted_trivial_hash_ops;
+
 /* 32bit values we can always just embed in the pointer itself, but in order to support 32bit archs we need store 64bit
  * values indirectly, since they don't fit in a pointer. */
 void uint64_hash_func(const void *p, struct siphash *state);
@@ -215,7 +215,6 @@ struct HashmapBase {
         bool has_indirect:1;         /* whether indirect storage is used */
         unsigned n_direct_entries:3; /* Number of entries in direct storage.
                                       * Only valid if !has_indirect. */
-        bool from_pool:1;            /* whether was allocated from mempool */
         bool dirty:1;                /* whether dirtied since last iterated_cache_get() */
         bool cached:1;               /* whether this hashmap is being cached */
         HASHMAP_DEBUG_FIELDS         /* optional hashmap_debug_info */
@@ -288,9 +287,10 @@ __attribute__((destructor)) static void cleanup_pools(void) {
 
         /* Be nice to valgrind */
 
-        /* The pool is only allocated by the main thread, but the memory can
-         * be passed to other threads. Let's clean up if we are the main thread
-         * and no other threads are live. */
+        /* Every thread allocates from its own pools, but the memory can be
+         * passed to other threads. Let's clean up our pools and those of the
+         * exited threads if we are the main thread and no other threads are
+         * live. */
         if (!is_main_thread())
                 return;
 
@@ -341,6 +341,9 @@ static unsigned base_bucket_hash(HashmapBase *h, const void *p) {
         struct siphash state;
         uint64_t hash;
 
+        if (h->hash_ops->fast_hash)
+                return (unsigned) (h->hash_ops->fast_hash(p, hash_key(h)) % n_buckets(h));
+
         siphash24_init(&state, hash_key(h));
 
         h->hash_ops->hash(p, &state);
@@ -775,17 +778,12 @@ static void reset_direct_storage(HashmapBase *h) {
 static struct HashmapBase *hashmap_base_new(const struct hash_ops *hash_ops, enum HashmapType type HASHMAP_DEBUG_PARAMS) {
         HashmapBase *h;
         const struct hashmap_type_info *hi = &hashmap_type_info[type];
-        bool use_pool;
-
-        use_pool = is_main_thread();
-
-        h = use_pool ? mempool_alloc0_tile(hi->mempool) : malloc0(hi->head_size);
 
+        h = mempool_alloc0_tile(hi->mempool);
         if (!h)
                 return NULL;
 
         h->type = type;
-        h->from_pool = use_pool;
         h->hash_ops = hash_ops ? hash_ops : &trivial_hash_ops;
 
         if (type == HASHMAP_TYPE_ORDERED) {
@@ -863,10 +861,7 @@ static void hashmap_free_no_clear(HashmapBase *h) {
         assert_se(pthread_mutex_unlock(&hashmap_debug_list_mutex) == 0);
 #endif
 
-        if (h->from_pool)
-                mempool_free_tile(hashmap_type_info[h->type].mempool, h);
-        else
-                free(h);
+        mempool_free_tile(hashmap_type_info[h->type].mempool, h);
 }
 
 HashmapBase *internal_hashmap_free(HashmapBase *h) {
@@ -1235,7 +1230,10 @@ static unsigned base_bucket_scan(HashmapBase *h, unsigned idx, const void *key)
                         return IDX_NIL;
                 if (dib == distance) {
                         e = bucket_at(h, idx);
-                        if (h->hash_ops->compare(e->key, key) == 0)
+
+                        /* Lookups are frequently done with the very key object that is stored, e.g. a unit's
+                         * id string, in which case we can skip calling the compare function */
+                        if (e->key == key || h->hash_ops->compare(e->key, key) == 0)
                                 return idx;
                 }
 
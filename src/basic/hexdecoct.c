@@ -60,6 +60,45 @@ int unhexchar(char c) {
         return -EINVAL;
 }
 
+/* All byte values in hex, so that hexmem() needs a single lookup per byte */
+static const char hex_pairs[512] =
+        "000102030405060708090a0b0c0d0e0f"
+        "101112131415161718191a1b1c1d1e1f"
+        "202122232425262728292a2b2c2d2e2f"
+        "303132333435363738393a3b3c3d3e3f"
+        "404142434445464748494a4b4c4d4e4f"
+        "505152535455565758595a5b5c5d5e5f"
+        "606162636465666768696a6b6c6d6e6f"
+        "707172737475767778797a7b7c7d7e7f"
+        "808182838485868788898a8b8c8d8e8f"
+        "909192939495969798999a9b9c9d9e9f"
+        "a0a1a2a3a4a5a6a7a8a9aaabacadaeaf"
+        "b0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+        "c0c1c2c3c4c5c6c7c8c9cacbcccdcecf"
+        "d0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+        "e0e1e2e3e4e5e6e7e8e9eaebecedeeef"
+        "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+/* The value of each character as hex digit, or -1 */
+static const int8_t unhex_table[256] = {
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+         0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+        -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
 char *hexmem(const void *p, size_t l) {
         const uint8_t *x;
         char *r, *z;
@@ -68,10 +107,8 @@ char *hexmem(const void *p, size_t l) {
         if (!r)
                 return NULL;
 
-        for (x = p; x < (const uint8_t*) p + l; x++) {
-                *(z++) = hexchar(*x >> 4);
-                *(z++) = hexchar(*x & 15);
-        }
+        for (x = p; x < (const uint8_t*) p + l; x++, z += 2)
+                memcpy(z, hex_pairs + *x * 2, 2);
 
         *z = 0;
         return r;
@@ -133,6 +170,18 @@ int unhexmem(const char *p, size_t l, void **ret, size_t *ret_len) {
         for (x = p, z = buf;;) {
                 int a, b;
 
+                /* Decode runs of hex digits directly, and only go through unhex_next() for the
+                 * whitespace between them, at the end, and for invalid characters */
+                while (l >= 2) {
+                        a = unhex_table[(uint8_t) x[0]];
+                        b = unhex_table[(uint8_t) x[1]];
+                        if ((a | b) < 0)
+                                break;
+
+                        *(z++) = (uint8_t) a << 4 | (uint8_t) b;
+                        x += 2, l -= 2;
+                }
+
                 a = unhex_next(&x, &l);
                 if (a == -EPIPE) /* End of string */
                         break;
@@ -518,6 +567,26 @@ char base64char(int x) {
         return table[x & 63];
 }
 
+/* The value of each character in the base64 alphabet, or -1 for padding, whitespace and everything else */
+static const int8_t unbase64_table[256] = {
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+        52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+        -1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+        15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+        -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+        41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
 int unbase64char(char c) {
         unsigned offset;
 
@@ -711,6 +780,22 @@ int unbase64mem(const char *p, size_t l, void **ret, size_t *ret_size) {
         for (x = p, z = buf;;) {
                 int a, b, c, d; /* a == 00XXXXXX; b == 00YYYYYY; c == 00ZZZZZZ; d == 00WWWWWW */
 
+                /* Decode runs of complete groups directly, and only go through unbase64_next() for
+                 * whitespace, padding, the end, and invalid characters */
+                while (l >= 4) {
+                        a = unbase64_table[(uint8_t) x[0]];
+                        b = unbase64_table[(uint8_t) x[1]];
+                        c = unbase64_table[(uint8_t) x[2]];
+                        d = unbase64_table[(uint8_t) x[3]];
+                        if ((a | b | c | d) < 0)
+                                break;
+
+                        *(z++) = (uint8_t) a << 2 | (uint8_t) b >> 4; /* XXXXXXYY */
+                        *(z++) = (uint8_t) b << 4 | (uint8_t) c >> 2; /* YYYYZZZZ */
+                        *(z++) = (uint8_t) c << 6 | (uint8_t) d;      /* ZZWWWWWW */
+                        x += 4, l -= 4;
+                }
+
                 a = unbase64_next(&x, &l);
                 if (a == -EPIPE) /* End of string */
                         break;
@@ -71,7 +71,8 @@ static char* realloc_buffer(JournalImporter *imp, size_t size) {
         if (!b)
                 return NULL;
 
-        iovw_rebase(&imp->iovw, old, imp->buf);
+        if (b != old)
+                iovw_rebase(&imp->iovw, old, imp->buf);
 
         return b;
 }
@@ -431,9 +432,10 @@ int journal_importer_push_data(JournalImporter *imp, const char *data, size_t si
 void journal_importer_drop_iovw(JournalImporter *imp) {
         size_t remain, target;
 
-        /* This function drops processed data that along with the iovw that points at it */
+        /* This function drops processed data that along with the iovw that points at it. The iovec array
+         * itself is kept around, so that it can be reused for the next entry without reallocation. */
 
-        iovw_free_contents(&imp->iovw);
+        imp->iovw.count = 0;
 
         /* possibly reset buffer position */
         remain = imp->filled - imp->offset;
@@ -447,8 +449,10 @@ void journal_importer_drop_iovw(JournalImporter *imp) {
                 imp->filled = remain;
         }
 
+        /* Only give memory back if most of the buffer is unused. The buffer thus always keeps some room, and
+         * isn't reallocated back and forth when entries of varying size are received. */
         target = imp->size;
-        while (target > 16 * LINE_CHUNK && imp->filled < target / 2)
+        while (target > 16 * LINE_CHUNK && imp->filled < target / 4)
                 target /= 2;
         if (target < imp->size) {
                 char *tmp;
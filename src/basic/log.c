@@ -46,6 +46,10 @@
 
 #define SNDBUF_SIZE (8*1024*1024)
 
+/* Bounds for the datagrams we queue up for the journal in buffered mode */
+#define LOG_BUFFER_SIZE (64U*1024U)
+#define LOG_BUFFER_ENTRIES_MAX 128U
+
 static LogTarget log_target = LOG_TARGET_CONSOLE;
 static int log_max_level[] = {LOG_INFO, LOG_INFO};
 assert_cc(ELEMENTSOF(log_max_level) == _LOG_REALM_MAX);
@@ -65,6 +69,17 @@ static bool upgrade_syslog_to_journal = false;
 static bool always_reopen_console = false;
 static bool open_when_needed = false;
 static bool prohibit_ipc = false;
+static bool buffered = false;
+
+/* Datagrams queued up for the journal, and the process that queued them */
+static uint8_t log_buffer[LOG_BUFFER_SIZE];
+static size_t log_buffer_size = 0;
+static size_t log_buffer_entry_size[LOG_BUFFER_ENTRIES_MAX];
+static int log_buffer_entry_level[LOG_BUFFER_ENTRIES_MAX];
+static const char *log_buffer_entry_file[LOG_BUFFER_ENTRIES_MAX];
+static int log_buffer_entry_line[LOG_BUFFER_ENTRIES_MAX];
+static size_t log_buffer_n_entries = 0;
+static pid_t log_buffer_pid = 0;
 
 /* Akin to glibc's __abort_msg; which is private and we hence cannot
  * use here. */
@@ -192,6 +207,7 @@ fail:
 }
 
 static void log_close_journal(void) {
+        (void) log_flush();
         journal_fd = safe_close(journal_fd);
 }
 
@@ -317,6 +333,7 @@ void log_close(void) {
 void log_forget_fds(void) {
         /* Do not call from library code. */
 
+        log_buffer_size = log_buffer_n_entries = 0;
         console_fd = kmsg_fd = syslog_fd = journal_fd = -1;
 }
 
@@ -526,6 +543,151 @@ static int log_do_header(
         return 0;
 }
 
+static void log_flush_fallback(size_t i, size_t n, size_t offset) {
+
+        /* Hands the entries that couldn't be sent to the journal to kmsg or the console instead, the same
+         * way log_dispatch_internal() falls back for a single message. Only the message text is kept. */
+
+        if (IN_SET(log_target, LOG_TARGET_AUTO, LOG_TARGET_JOURNAL_OR_KMSG))
+                log_open_kmsg();
+        if (kmsg_fd < 0)
+                log_open_console();
+
+        for (; i < n; offset += log_buffer_entry_size[i++]) {
+                char *entry, *m, *e;
+                int k = 0;
+
+                entry = (char*) log_buffer + offset;
+
+                if (log_buffer_entry_size[i] > STRLEN("MESSAGE=") && startswith(entry, "MESSAGE="))
+                        m = entry;
+                else {
+                        m = memmem(entry, log_buffer_entry_size[i], "\nMESSAGE=", STRLEN("\nMESSAGE="));
+                        if (!m)
+                                continue;
+                        m++;
+                }
+
+                m += STRLEN("MESSAGE=");
+                e = memchr(m, '\n', entry + log_buffer_entry_size[i] - m);
+                if (!e)
+                        continue;
+
+                /* The queue is reset anyway, hence terminate the message in place */
+                *e = 0;
+
+                if (kmsg_fd >= 0) {
+                        k = write_to_kmsg(log_buffer_entry_level[i], 0, log_buffer_entry_file[i], log_buffer_entry_line[i], NULL, m);
+                        if (k < 0) {
+                                log_close_kmsg();
+                                log_open_console();
+                        }
+                }
+
+                if (k <= 0)
+                        (void) write_to_console(log_buffer_entry_level[i], 0, log_buffer_entry_file[i], log_buffer_entry_line[i], NULL, m);
+        }
+}
+
+int log_flush(void) {
+        struct mmsghdr mmsg[LOG_BUFFER_ENTRIES_MAX] = {};
+        struct iovec iovec[LOG_BUFFER_ENTRIES_MAX];
+        size_t i, n, offset = 0;
+        PROTECT_ERRNO;
+        int r = 0;
+
+        if (log_buffer_n_entries == 0)
+                return 0;
+
+        n = log_buffer_n_entries;
+        log_buffer_size = log_buffer_n_entries = 0;
+
+        /* Entries queued up by our parent before it forked us off are its business */
+        if (log_buffer_pid != getpid_cached() || journal_fd < 0)
+                return 0;
+
+        for (i = 0; i < n; i++) {
+                iovec[i] = IOVEC_MAKE(log_buffer + offset, log_buffer_entry_size[i]);
+                offset += log_buffer_entry_size[i];
+
+                mmsg[i].msg_hdr.msg_iov = &iovec[i];
+                mmsg[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        offset = 0;
+        for (i = 0; i < n; ) {
+                int k;
+
+                k = sendmmsg(journal_fd, mmsg + i, n - i, MSG_NOSIGNAL);
+                if (k < 0) {
+                        r = -errno;
+                        break;
+                }
+
+                for (; k > 0; k--)
+                        offset += log_buffer_entry_size[i++];
+        }
+
+        if (r < 0) {
+                if (r != -EAGAIN)
+                        log_close_journal();
+
+                log_flush_fallback(i, n, offset);
+        }
+
+        return r;
+}
+
+static int write_iovec_to_journal(int level, const char *file, int line, const struct iovec *iovec, size_t n) {
+        struct msghdr mh = {
+                .msg_iov = (struct iovec*) iovec,
+                .msg_iovlen = n,
+        };
+        size_t size, i;
+
+        /* In buffered mode, queue the datagram up, so that a whole batch can be sent with a single syscall
+         * later on. Critical messages are sent right away, as we might not get around to flushing the queue
+         * anymore. */
+
+        size = IOVEC_TOTAL_SIZE(iovec, n);
+
+        if (buffered && !open_when_needed && LOG_PRI(level) > LOG_CRIT && size <= LOG_BUFFER_SIZE) {
+                uint8_t *p;
+
+                if (log_buffer_n_entries >= LOG_BUFFER_ENTRIES_MAX ||
+                    log_buffer_size + size > LOG_BUFFER_SIZE ||
+                    log_buffer_pid != getpid_cached())
+                        (void) log_flush();
+
+                if (journal_fd < 0)
+                        return 0;
+
+                p = log_buffer + log_buffer_size;
+                for (i = 0; i < n; i++)
+                        p = mempcpy(p, iovec[i].iov_base, iovec[i].iov_len);
+
+                log_buffer_entry_level[log_buffer_n_entries] = level;
+                log_buffer_entry_file[log_buffer_n_entries] = file;
+                log_buffer_entry_line[log_buffer_n_entries] = line;
+                log_buffer_entry_size[log_buffer_n_entries++] = size;
+                log_buffer_size += size;
+                log_buffer_pid = getpid_cached();
+
+                return 1;
+        }
+
+        /* Don't let this one overtake anything still queued up */
+        (void) log_flush();
+
+        if (journal_fd < 0)
+                return 0;
+
+        if (sendmsg(journal_fd, &mh, MSG_NOSIGNAL) < 0)
+                return -errno;
+
+        return 1;
+}
+
 static int write_to_journal(
                 int level,
                 int error,
@@ -540,7 +702,6 @@ static int write_to_journal(
 
         char header[LINE_MAX];
         struct iovec iovec[4] = {};
-        struct msghdr mh = {};
 
         if (journal_fd < 0)
                 return 0;
@@ -552,13 +713,7 @@ static int write_to_journal(
         iovec[2] = IOVEC_MAKE_STRING(buffer);
         iovec[3] = IOVEC_MAKE_STRING("\n");
 
-        mh.msg_iov = iovec;
-        mh.msg_iovlen = ELEMENTSOF(iovec);
-
-        if (sendmsg(journal_fd, &mh, MSG_NOSIGNAL) < 0)
-                return -errno;
-
-        return 1;
+        return write_iovec_to_journal(level, file, line, iovec, ELEMENTSOF(iovec));
 }
 
 int log_dispatch_internal(
@@ -923,9 +1078,6 @@ int log_struct_internal(
                         struct iovec iovec[17] = {};
                         size_t n = 0, i;
                         int r;
-                        struct msghdr mh = {
-                                .msg_iov = iovec,
-                        };
                         bool fallback = false;
 
                         /* If the journal is available do structured logging */
@@ -936,10 +1088,8 @@ int log_struct_internal(
                         r = log_format_iovec(iovec, ELEMENTSOF(iovec), &n, true, error, format, ap);
                         if (r < 0)
                                 fallback = true;
-                        else {
-                                mh.msg_iovlen = n;
-                                (void) sendmsg(journal_fd, &mh, MSG_NOSIGNAL);
-                        }
+                        else
+                                (void) write_iovec_to_journal(level, file, line, iovec, n);
 
                         va_end(ap);
                         for (i = 1; i < n; i += 2)
@@ -1020,10 +1170,6 @@ int log_struct_iovec_internal(
 
                 struct iovec iovec[1 + n_input_iovec*2];
                 char header[LINE_MAX];
-                struct msghdr mh = {
-                        .msg_iov = iovec,
-                        .msg_iovlen = 1 + n_input_iovec*2,
-                };
 
                 log_do_header(header, sizeof(header), level, error, file, line, func, NULL, NULL, NULL, NULL);
                 iovec[0] = IOVEC_MAKE_STRING(header);
@@ -1033,7 +1179,7 @@ int log_struct_iovec_internal(
                         iovec[1+i*2+1] = IOVEC_MAKE_STRING("\n");
                 }
 
-                if (sendmsg(journal_fd, &mh, MSG_NOSIGNAL) >= 0)
+                if (write_iovec_to_journal(level, file, line, iovec, 1 + n_input_iovec*2) > 0)
                         return -error;
         }
 
@@ -1145,6 +1291,17 @@ void log_parse_environment_realm(LogRealm realm) {
         e = getenv("SYSTEMD_LOG_LOCATION");
         if (e && log_show_location_from_string(e) < 0)
                 log_warning("Failed to parse bool '%s'. Ignoring.", e);
+
+        e = getenv("SYSTEMD_LOG_BUFFERED");
+        if (e) {
+                int b;
+
+                b = parse_boolean(e);
+                if (b < 0)
+                        log_warning("Failed to parse bool '%s'. Ignoring.", e);
+                else
+                        log_set_buffered(b);
+        }
 }
 
 LogTarget log_get_target(void) {
@@ -1324,6 +1481,28 @@ void log_set_prohibit_ipc(bool b) {
         prohibit_ipc = b;
 }
 
+static void log_flush_atexit(void) {
+        (void) log_flush();
+}
+
+void log_set_buffered(bool b) {
+        static bool registered = false;
+
+        /* Do not call from library code. */
+
+        if (b && !registered) {
+                if (atexit(log_flush_atexit) != 0)
+                        return;
+
+                registered = true;
+        }
+
+        if (!b)
+                (void) log_flush();
+
+        buffered = b;
+}
+
 int log_emergency_level(void) {
         /* Returns the log level to use for log_emergency() logging. We use LOG_EMERG only when we are PID 1, as only
          * then the system of the whole system is obviously affected. */
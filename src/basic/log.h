@@ -80,6 +80,7 @@ int log_get_max_level_realm(LogRealm realm) _pure_;
 int log_open(void);
 void log_close(void);
 void log_forget_fds(void);
+int log_flush(void);
 
 void log_parse_environment_realm(LogRealm realm);
 #define log_parse_environment() \
@@ -284,6 +285,10 @@ void log_set_open_when_needed(bool b);
  * stderr, the console or kmsg */
 void log_set_prohibit_ipc(bool b);
 
+/* If turned on, messages for the journal are queued up and sent in batches, whenever the queue is full, before
+ * sd-event goes to sleep, on exit, and before any critical message. Call log_flush() to send them explicitly. */
+void log_set_buffered(bool b);
+
 int log_dup_console(void);
 
 int log_syntax_internal(
@@ -6,6 +6,7 @@
   Copyright 2014 Michal Schmidt
 ***/
 
+#include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
 
@@ -19,7 +20,98 @@ struct pool {
         size_t n_used;
 };
 
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t cache_key;
+static bool cache_key_valid = false;
+
+/* The caches used by the current thread, so that they can be handed over on thread exit */
+static thread_local struct mempool_cache *registered_caches = NULL;
+
+static void cache_release(struct mempool_cache *c) {
+        struct mempool *mp = c->mempool;
+        struct pool *last;
+        void *tail;
+
+        /* Turn the never used tiles of the current pool into free tiles too. The older pools are always fully
+         * used. The pools themselves are handed over to the mempool, the tiles might still be in use, and
+         * mempool_drop() needs to find them. */
+        if (c->first_pool)
+                while (c->first_pool->n_used < c->first_pool->n_tiles) {
+                        void *p;
+
+                        p = ((uint8_t*) c->first_pool) + ALIGN(sizeof(struct pool)) + c->first_pool->n_used++ * mp->tile_size;
+                        * (void**) p = c->freelist;
+                        c->freelist = p;
+                }
+
+        assert_se(pthread_mutex_lock(&mp->mutex) == 0);
+
+        if (c->freelist) {
+                for (tail = c->freelist; * (void**) tail; tail = * (void**) tail)
+                        ;
+
+                * (void**) tail = mp->freelist;
+                mp->freelist = c->freelist;
+        }
+
+        if (c->first_pool) {
+                for (last = c->first_pool; last->next; last = last->next)
+                        ;
+
+                last->next = mp->pools;
+                mp->pools = c->first_pool;
+        }
+
+        assert_se(pthread_mutex_unlock(&mp->mutex) == 0);
+
+        c->first_pool = NULL;
+        c->freelist = NULL;
+}
+
+static void cache_key_destroy(void *userdata) {
+        struct mempool_cache *c;
+
+        while ((c = registered_caches)) {
+                registered_caches = c->registered_next;
+                cache_release(c);
+                c->registered_next = NULL;
+                c->registered = false;
+        }
+}
+
+static void cache_key_create(void) {
+        cache_key_valid = pthread_key_create(&cache_key, cache_key_destroy) == 0;
+}
+
+static _destructor_ void cache_key_delete(void) {
+        /* We might be part of a shared object that is about to be unloaded. Make sure no exiting thread calls
+         * into cache_key_destroy() after that, and hand our own tiles over while we still can. The caches of
+         * other threads that are still running are leaked. */
+        if (!cache_key_valid)
+                return;
+
+        cache_key_valid = false;
+        (void) pthread_key_delete(cache_key);
+
+        cache_key_destroy(NULL);
+}
+
+static void cache_register(struct mempool_cache *c, struct mempool *mp) {
+        c->mempool = mp;
+
+        /* If we can't get notified about the thread exiting, we leak the free tiles at that point, but that's
+         * all. */
+        (void) pthread_once(&cache_key_once, cache_key_create);
+        if (cache_key_valid)
+                (void) pthread_setspecific(cache_key, INT_TO_PTR(1));
+
+        c->registered_next = registered_caches;
+        registered_caches = c;
+        c->registered = true;
+}
+
 void* mempool_alloc_tile(struct mempool *mp) {
+        struct mempool_cache *c;
         size_t i;
 
         /* When a tile is released we add it to the list and simply
@@ -28,20 +120,39 @@ void* mempool_alloc_tile(struct mempool *mp) {
         assert(mp->tile_size >= sizeof(void*));
         assert(mp->at_least > 0);
 
-        if (mp->freelist) {
+        c = mp->get_cache();
+
+        if (c->freelist) {
                 void *r;
 
-                r = mp->freelist;
-                mp->freelist = * (void**) mp->freelist;
+                r = c->freelist;
+                c->freelist = * (void**) c->freelist;
                 return r;
         }
 
-        if (_unlikely_(!mp->first_pool) ||
-            _unlikely_(mp->first_pool->n_used >= mp->first_pool->n_tiles)) {
+        if (_unlikely_(!c->registered))
+                cache_register(c, mp);
+
+        if (_unlikely_(!c->first_pool) ||
+            _unlikely_(c->first_pool->n_used >= c->first_pool->n_tiles)) {
                 size_t size, n;
                 struct pool *p;
 
-                n = mp->first_pool ? mp->first_pool->n_tiles : 0;
+                /* Before allocating more memory, take over the tiles left behind by exited threads */
+                assert_se(pthread_mutex_lock(&mp->mutex) == 0);
+                c->freelist = mp->freelist;
+                mp->freelist = NULL;
+                assert_se(pthread_mutex_unlock(&mp->mutex) == 0);
+
+                if (c->freelist) {
+                        void *r;
+
+                        r = c->freelist;
+                        c->freelist = * (void**) c->freelist;
+                        return r;
+                }
+
+                n = c->first_pool ? c->first_pool->n_tiles : 0;
                 n = MAX(mp->at_least, n * 2);
                 size = PAGE_ALIGN(ALIGN(sizeof(struct pool)) + n*mp->tile_size);
                 n = (size - ALIGN(sizeof(struct pool))) / mp->tile_size;
@@ -50,16 +161,16 @@ void* mempool_alloc_tile(struct mempool *mp) {
                 if (!p)
                         return NULL;
 
-                p->next = mp->first_pool;
+                p->next = c->first_pool;
                 p->n_tiles = n;
                 p->n_used = 0;
 
-                mp->first_pool = p;
+                c->first_pool = p;
         }
 
-        i = mp->first_pool->n_used++;
+        i = c->first_pool->n_used++;
 
-        return ((uint8_t*) mp->first_pool) + ALIGN(sizeof(struct pool)) + i*mp->tile_size;
+        return ((uint8_t*) c->first_pool) + ALIGN(sizeof(struct pool)) + i*mp->tile_size;
 }
 
 void* mempool_alloc0_tile(struct mempool *mp) {
@@ -72,14 +183,21 @@ void* mempool_alloc0_tile(struct mempool *mp) {
 }
 
 void mempool_free_tile(struct mempool *mp, void *p) {
-        * (void**) p = mp->freelist;
-        mp->freelist = p;
+        struct mempool_cache *c;
+
+        c = mp->get_cache();
+
+        /* A thread might only ever free tiles others allocated, make sure it hands them over too */
+        if (_unlikely_(!c->registered))
+                cache_register(c, mp);
+
+        * (void**) p = c->freelist;
+        c->freelist = p;
 }
 
 #if VALGRIND
 
-void mempool_drop(struct mempool *mp) {
-        struct pool *p = mp->first_pool;
+static void pool_free_all(struct pool *p) {
         while (p) {
                 struct pool *n;
                 n = p->next;
@@ -88,4 +206,22 @@ void mempool_drop(struct mempool *mp) {
         }
 }
 
+void mempool_drop(struct mempool *mp) {
+        struct mempool_cache *c;
+
+        /* Frees the pools of the calling thread and of all threads that exited, only call this when no other
+         * threads are around anymore */
+
+        c = mp->get_cache();
+        pool_free_all(c->first_pool);
+        c->first_pool = NULL;
+        c->freelist = NULL;
+
+        assert_se(pthread_mutex_lock(&mp->mutex) == 0);
+        pool_free_all(mp->pools);
+        mp->pools = NULL;
+        mp->freelist = NULL;
+        assert_se(pthread_mutex_unlock(&mp->mutex) == 0);
+}
+
 #endif
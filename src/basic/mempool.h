@@ -8,25 +8,52 @@
   Copyright 2014 Michal Schmidt
 ***/
 
+#include <pthread.h>
+#include <stdbool.h>
 #include <stddef.h>
 
-struct pool;
+#include "macro.h"
 
-struct mempool {
+struct pool;
+struct mempool;
+
+/* Each thread allocates tiles from its own pools and keeps its own list of freed tiles, hence the fast paths
+ * need no locking. Tiles may be freed by a different thread than the one that allocated them, they then simply
+ * end up on the freeing thread's list. When a thread exits, its free tiles are handed over to the shared list
+ * of the mempool, from where other threads take them before allocating new pools, and its pools are handed
+ * over too, so that mempool_drop() can free them. */
+struct mempool_cache {
+        struct mempool *mempool;
         struct pool *first_pool;
         void *freelist;
+        struct mempool_cache *registered_next;
+        bool registered;
+};
+
+struct mempool {
         size_t tile_size;
         unsigned at_least;
+        struct mempool_cache* (*get_cache)(void);
+
+        pthread_mutex_t mutex;
+        void *freelist;     /* free tiles of exited threads, protected by mutex */
+        struct pool *pools; /* pools of exited threads, protected by mutex */
 };
 
 void* mempool_alloc_tile(struct mempool *mp);
 void* mempool_alloc0_tile(struct mempool *mp);
 void mempool_free_tile(struct mempool *mp, void *p);
 
-#define DEFINE_MEMPOOL(pool_name, tile_type, alloc_at_least) \
-static struct mempool pool_name = { \
-        .tile_size = sizeof(tile_type), \
-        .at_least = alloc_at_least, \
+#define DEFINE_MEMPOOL(pool_name, tile_type, alloc_at_least)           \
+static thread_local struct mempool_cache pool_name##_cache;            \
+static struct mempool_cache* pool_name##_get_cache(void) {             \
+        return &pool_name##_cache;                                     \
+}                                                                      \
+static struct mempool pool_name = {                                    \
+        .tile_size = sizeof(tile_type),                                \
+        .at_least = alloc_at_least,                                    \
+        .get_cache = pool_name##_get_cache,                            \
+        .mutex = PTHREAD_MUTEX_INITIALIZER,                            \
 }
 
 #if VALGRIND
@@ -13,6 +13,19 @@
  * provide a pointer to an index which will be kept up-to-date by the prioq.
  *
  * The underlying algorithm used in this implementation is a Heap.
+ *
+ * Each item may carry a 64bit key, which is compared before the comparison
+ * function is called, so that queues ordered by a timestamp or similar need
+ * not chase the data pointers at all. The comparison function only breaks
+ * ties between equal keys, and may be NULL. Items put with prioq_put() have
+ * key 0, hence queues not using keys are ordered by the comparison function
+ * alone, as before.
+ *
+ * Queues not using keys are binary heaps of 16 byte items. Once a key is set,
+ * the keys are kept in an array of their own, and the queue becomes a 4-ary
+ * heap: it is half as deep, and the keys of the four children of a node
+ * share a cache line, which makes up for the extra comparison per level. For
+ * comparator-only queues it doesn't, as every comparison dereferences data.
  */
 
 #include <errno.h>
@@ -22,6 +35,10 @@
 #include "hashmap.h"
 #include "prioq.h"
 
+/* log2 of the number of children per node, for keyed and comparator-only queues */
+#define PRIOQ_SHIFT_KEYS 2U
+#define PRIOQ_SHIFT_PLAIN 1U
+
 struct prioq_item {
         void *data;
         unsigned *idx;
@@ -32,6 +49,7 @@ struct Prioq {
         unsigned n_items, n_allocated;
 
         struct prioq_item *items;
+        uint64_t *keys; /* NULL until the first key is set, all keys are 0 then */
 };
 
 Prioq *prioq_new(compare_func_t compare_func) {
@@ -50,6 +68,7 @@ Prioq* prioq_free(Prioq *q) {
                 return NULL;
 
         free(q->items);
+        free(q->keys);
         return mfree(q);
 }
 
@@ -66,95 +85,145 @@ int prioq_ensure_allocated(Prioq **q, compare_func_t compare_func) {
         return 0;
 }
 
-static void swap(Prioq *q, unsigned j, unsigned k) {
-        void *saved_data;
-        unsigned *saved_idx;
+/* The sifting functions are told once whether the queue is keyed, so that comparator-only queues never touch
+ * the keys, and sift the way they did before keys existed */
 
-        assert(q);
-        assert(j < q->n_items);
-        assert(k < q->n_items);
+static inline int compare(Prioq *q, bool keyed, unsigned a, const struct prioq_item *b, uint64_t b_key) {
+        if (keyed) {
+                if (q->keys[a] < b_key)
+                        return -1;
+                if (q->keys[a] > b_key)
+                        return 1;
 
-        assert(!q->items[j].idx || *(q->items[j].idx) == j);
-        assert(!q->items[k].idx || *(q->items[k].idx) == k);
+                if (!q->compare_func)
+                        return 0;
+        }
 
-        saved_data = q->items[j].data;
-        saved_idx = q->items[j].idx;
-        q->items[j].data = q->items[k].data;
-        q->items[j].idx = q->items[k].idx;
-        q->items[k].data = saved_data;
-        q->items[k].idx = saved_idx;
+        return q->compare_func(q->items[a].data, b->data);
+}
 
-        if (q->items[j].idx)
-                *q->items[j].idx = j;
+static inline void place(Prioq *q, bool keyed, unsigned idx, const struct prioq_item *i, uint64_t key) {
+        q->items[idx] = *i;
+        if (keyed)
+                q->keys[idx] = key;
 
-        if (q->items[k].idx)
-                *q->items[k].idx = k;
+        if (i->idx)
+                *i->idx = idx;
 }
 
-static unsigned shuffle_up(Prioq *q, unsigned idx) {
+static inline unsigned shuffle_up_internal(Prioq *q, bool keyed, unsigned idx) {
+        const unsigned shift = keyed ? PRIOQ_SHIFT_KEYS : PRIOQ_SHIFT_PLAIN;
+        struct prioq_item saved;
+        uint64_t saved_key;
+
         assert(q);
+        assert(idx < q->n_items);
+
+        /* Rather than swapping on each level, move the parents down into the hole, and put the item into
+         * its final spot only once */
+        if (idx == 0 || compare(q, keyed, (idx-1) >> shift, q->items + idx, keyed ? q->keys[idx] : 0) <= 0)
+                return idx;
+
+        saved = q->items[idx];
+        saved_key = keyed ? q->keys[idx] : 0;
 
         while (idx > 0) {
                 unsigned k;
 
-                k = (idx-1)/2;
+                k = (idx-1) >> shift;
 
-                if (q->compare_func(q->items[k].data, q->items[idx].data) <= 0)
+                if (compare(q, keyed, k, &saved, saved_key) <= 0)
                         break;
 
-                swap(q, idx, k);
+                place(q, keyed, idx, q->items + k, keyed ? q->keys[k] : 0);
                 idx = k;
         }
 
+        place(q, keyed, idx, &saved, saved_key);
         return idx;
 }
 
-static unsigned shuffle_down(Prioq *q, unsigned idx) {
+static inline unsigned shuffle_down_internal(Prioq *q, bool keyed, unsigned idx) {
+        const unsigned shift = keyed ? PRIOQ_SHIFT_KEYS : PRIOQ_SHIFT_PLAIN;
+        struct prioq_item saved;
+        uint64_t saved_key;
+
         assert(q);
+        assert(idx < q->n_items);
+
+        saved = q->items[idx];
+        saved_key = keyed ? q->keys[idx] : 0;
 
         for (;;) {
                 unsigned j, k, s;
 
-                k = (idx+1)*2; /* right child */
-                j = k-1;       /* left child */
-
+                j = (idx << shift) + 1; /* first child */
                 if (j >= q->n_items)
                         break;
 
-                if (q->compare_func(q->items[j].data, q->items[idx].data) < 0)
-
-                        /* So our left child is smaller than we are, let's
-                         * remember this fact */
-                        s = j;
-                else
-                        s = idx;
-
-                if (k < q->n_items &&
-                    q->compare_func(q->items[k].data, q->items[s].data) < 0)
-
-                        /* So our right child is smaller than we are, let's
-                         * remember this fact */
-                        s = k;
-
-                /* s now points to the smallest of the three items */
+                /* Find the smallest of our children */
+                s = j;
+                for (k = j + 1; k < j + (1U << shift) && k < q->n_items; k++)
+                        if (compare(q, keyed, k, q->items + s, keyed ? q->keys[s] : 0) < 0)
+                                s = k;
 
-                if (s == idx)
-                        /* No swap necessary, we're done */
+                if (compare(q, keyed, s, &saved, saved_key) >= 0)
+                        /* No child is smaller than we are, we're done */
                         break;
 
-                swap(q, idx, s);
+                place(q, keyed, idx, q->items + s, keyed ? q->keys[s] : 0);
                 idx = s;
         }
 
+        place(q, keyed, idx, &saved, saved_key);
         return idx;
 }
 
-int prioq_put(Prioq *q, void *data, unsigned *idx) {
+static unsigned shuffle_up(Prioq *q, unsigned idx) {
+        return q->keys ? shuffle_up_internal(q, true, idx) : shuffle_up_internal(q, false, idx);
+}
+
+static unsigned shuffle_down(Prioq *q, unsigned idx) {
+        return q->keys ? shuffle_down_internal(q, true, idx) : shuffle_down_internal(q, false, idx);
+}
+
+static inline uint64_t key_at(Prioq *q, unsigned idx) {
+        return q->keys ? q->keys[idx] : 0;
+}
+
+static int enable_keys(Prioq *q) {
+        unsigned k;
+
+        assert(q);
+
+        if (q->keys)
+                return 0;
+
+        q->keys = new0(uint64_t, MAX(q->n_allocated, 1u));
+        if (!q->keys)
+                return -ENOMEM;
+
+        /* All keys are 0 so far, but the heap needs to be rebuilt for the new arity */
+        for (k = (q->n_items >> PRIOQ_SHIFT_KEYS) + 1; k > 0; k--)
+                if (k - 1 < q->n_items)
+                        shuffle_down(q, k - 1);
+
+        return 0;
+}
+
+int prioq_put_key(Prioq *q, void *data, uint64_t key, unsigned *idx) {
         struct prioq_item *i;
         unsigned k;
+        int r;
 
         assert(q);
 
+        if (key != 0) {
+                r = enable_keys(q);
+                if (r < 0)
+                        return r;
+        }
+
         if (q->n_items >= q->n_allocated) {
                 unsigned n;
                 struct prioq_item *j;
@@ -165,6 +234,17 @@ int prioq_put(Prioq *q, void *data, unsigned *idx) {
                         return -ENOMEM;
 
                 q->items = j;
+
+                if (q->keys) {
+                        uint64_t *l;
+
+                        l = reallocarray(q->keys, n, sizeof(uint64_t));
+                        if (!l)
+                                return -ENOMEM;
+
+                        q->keys = l;
+                }
+
                 q->n_allocated = n;
         }
 
@@ -172,6 +252,8 @@ int prioq_put(Prioq *q, void *data, unsigned *idx) {
         i = q->items + k;
         i->data = data;
         i->idx = idx;
+        if (q->keys)
+                q->keys[k] = key;
 
         if (idx)
                 *idx = k;
@@ -181,6 +263,10 @@ int prioq_put(Prioq *q, void *data, unsigned *idx) {
         return 0;
 }
 
+int prioq_put(Prioq *q, void *data, unsigned *idx) {
+        return prioq_put_key(q, data, 0, idx);
+}
+
 static void remove_item(Prioq *q, struct prioq_item *i) {
         struct prioq_item *l;
 
@@ -200,8 +286,9 @@ static void remove_item(Prioq *q, struct prioq_item *i) {
 
                 k = i - q->items;
 
-                i->data = l->data;
-                i->idx = l->idx;
+                *i = *l;
+                if (q->keys)
+                        q->keys[k] = q->keys[q->n_items - 1];
                 if (i->idx)
                         *i->idx = k;
                 q->n_items--;
@@ -218,7 +305,7 @@ _pure_ static struct prioq_item* find_item(Prioq *q, void *data, unsigned *idx)
 
         if (idx) {
                 if (*idx == PRIOQ_IDX_NULL ||
-                    *idx > q->n_items)
+                    *idx >= q->n_items)
                         return NULL;
 
                 i = q->items + *idx;
@@ -264,6 +351,47 @@ int prioq_reshuffle(Prioq *q, void *data, unsigned *idx) {
         return 1;
 }
 
+int prioq_set_key(Prioq *q, void *data, uint64_t key, unsigned *idx) {
+        struct prioq_item *i;
+        uint64_t old;
+        unsigned k;
+        int r;
+
+        assert(q);
+
+        i = find_item(q, data, idx);
+        if (!i)
+                return 0;
+
+        k = i - q->items;
+
+        if (key != 0) {
+                r = enable_keys(q);
+                if (r < 0)
+                        return r;
+
+                /* Rebuilding the heap might have moved the item */
+                k = idx ? *idx : (unsigned) (find_item(q, data, NULL) - q->items);
+        }
+
+        old = key_at(q, k);
+        if (q->keys)
+                q->keys[k] = key;
+
+        /* A smaller key can only move the item towards the top, and a larger one only away from it, hence
+         * only one direction needs to be looked at. For equal keys the data might have changed, though. */
+        if (key < old)
+                shuffle_up(q, k);
+        else if (key > old)
+                shuffle_down(q, k);
+        else {
+                k = shuffle_down(q, k);
+                shuffle_up(q, k);
+        }
+
+        return 1;
+}
+
 void *prioq_peek(Prioq *q) {
 
         if (!q)
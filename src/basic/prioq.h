@@ -8,6 +8,7 @@
 ***/
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "hashmap.h"
 #include "macro.h"
@@ -21,8 +22,10 @@ Prioq *prioq_free(Prioq *q);
 int prioq_ensure_allocated(Prioq **q, compare_func_t compare_func);
 
 int prioq_put(Prioq *q, void *data, unsigned *idx);
+int prioq_put_key(Prioq *q, void *data, uint64_t key, unsigned *idx);
 int prioq_remove(Prioq *q, void *data, unsigned *idx);
 int prioq_reshuffle(Prioq *q, void *data, unsigned *idx);
+int prioq_set_key(Prioq *q, void *data, uint64_t key, unsigned *idx);
 
 void *prioq_peek(Prioq *q) _pure_;
 void *prioq_pop(Prioq *q);
@@ -40,6 +40,30 @@
 #include "macro.h"
 #include "utf8.h"
 
+/* Most strings we look at are plain ASCII, hence the functions below skip over such runs a word at a time,
+ * and only decode code points one by one where necessary. See the "Bit Twiddling Hacks" for how these
+ * work: they are exact as long as no byte has its high bit set, which is checked first. */
+#define WORD_ONES UINT64_C(0x0101010101010101)
+#define WORD_HIGH_BITS UINT64_C(0x8080808080808080)
+
+static inline uint64_t word_load(const char *p) {
+        uint64_t w;
+
+        memcpy(&w, p, sizeof(w));
+        return w;
+}
+
+static inline bool word_is_ascii(uint64_t w) {
+        return (w & WORD_HIGH_BITS) == 0;
+}
+
+static inline bool word_is_printable_ascii(uint64_t w) {
+        /* No byte is >= 0x80, < 0x20 or equal to 0x7F (DEL) */
+        return word_is_ascii(w) &&
+                ((w - WORD_ONES * 0x20) & ~w & WORD_HIGH_BITS) == 0 &&
+                (((w ^ (WORD_ONES * 0x7F)) - WORD_ONES) & ~(w ^ (WORD_ONES * 0x7F)) & WORD_HIGH_BITS) == 0;
+}
+
 bool unichar_is_valid(char32_t ch) {
 
         if (ch >= 0x110000) /* End of unicode space */
@@ -142,6 +166,22 @@ bool utf8_is_printable_newline(const char* str, size_t length, bool newline) {
                 int encoded_len, r;
                 char32_t val;
 
+                if (length >= sizeof(uint64_t) && word_is_printable_ascii(word_load(p))) {
+                        length -= sizeof(uint64_t);
+                        p += sizeof(uint64_t);
+                        continue;
+                }
+
+                if ((unsigned char) *p < 0x80) {
+                        if (unichar_is_control(*p) ||
+                            (!newline && *p == '\n'))
+                                return false;
+
+                        length--;
+                        p++;
+                        continue;
+                }
+
                 encoded_len = utf8_encoded_valid_unichar(p);
                 if (encoded_len < 0 ||
                     (size_t) encoded_len > length)
@@ -161,14 +201,27 @@ bool utf8_is_printable_newline(const char* str, size_t length, bool newline) {
 }
 
 const char *utf8_is_valid(const char *str) {
-        const uint8_t *p;
+        const char *p, *e;
 
         assert(str);
 
-        for (p = (const uint8_t*) str; *p; ) {
+        /* Determine the length first, so that the word-wise loads never go beyond the string */
+        e = str + strlen(str);
+
+        for (p = str; p < e; ) {
                 int len;
 
-                len = utf8_encoded_valid_unichar((const char *)p);
+                if ((size_t) (e - p) >= sizeof(uint64_t) && word_is_ascii(word_load(p))) {
+                        p += sizeof(uint64_t);
+                        continue;
+                }
+
+                if ((unsigned char) *p < 0x80) {
+                        p++;
+                        continue;
+                }
+
+                len = utf8_encoded_valid_unichar(p);
                 if (len < 0)
                         return NULL;
 
@@ -179,17 +232,26 @@ const char *utf8_is_valid(const char *str) {
 }
 
 char *utf8_escape_invalid(const char *str) {
+        const char *e;
         char *p, *s;
 
         assert(str);
 
-        p = s = malloc(strlen(str) * 4 + 1);
+        e = str + strlen(str);
+
+        p = s = malloc((e - str) * 4 + 1);
         if (!p)
                 return NULL;
 
         while (*str) {
                 int len;
 
+                if ((size_t) (e - str) >= sizeof(uint64_t) && word_is_ascii(word_load(str))) {
+                        s = mempcpy(s, str, sizeof(uint64_t));
+                        str += sizeof(uint64_t);
+                        continue;
+                }
+
                 len = utf8_encoded_valid_unichar(str);
                 if (len > 0) {
                         s = mempcpy(s, str, len);
@@ -206,17 +268,26 @@ char *utf8_escape_invalid(const char *str) {
 }
 
 char *utf8_escape_non_printable(const char *str) {
+        const char *e;
         char *p, *s;
 
         assert(str);
 
-        p = s = malloc(strlen(str) * 4 + 1);
+        e = str + strlen(str);
+
+        p = s = malloc((e - str) * 4 + 1);
         if (!p)
                 return NULL;
 
         while (*str) {
                 int len;
 
+                if ((size_t) (e - str) >= sizeof(uint64_t) && word_is_printable_ascii(word_load(str))) {
+                        s = mempcpy(s, str, sizeof(uint64_t));
+                        str += sizeof(uint64_t);
+                        continue;
+                }
+
                 len = utf8_encoded_valid_unichar(str);
                 if (len > 0) {
                         if (utf8_is_printable(str, len)) {
@@ -831,6 +831,100 @@ static int install_loader_config(const char *esp_path) {
         return 1;
 }
 
+/* The format of the entry index is described in src/boot/efi/boot.c, keep both in sync. The contents of
+ * larger entry files are not cached, sd-boot simply reads those. */
+#define ENTRY_INDEX_MAGIC "SDBIDX01"
+#define ENTRY_INDEX_CONTENTS_MAX (64U*1024U)
+
+static int write_entry_index_record(FILE *f, const char *name, const char *content, size_t size) {
+        static const uint8_t zeros[8] = {};
+        uint32_t name_size, content_size;
+        const char *c;
+        size_t n;
+
+        /* sd-boot compares names as UCS-2, plain ASCII ones are all we need to bother with */
+        for (c = name; *c; c++)
+                if ((unsigned char) *c >= 128)
+                        return 0;
+
+        n = strlen(name) + 1;
+        name_size = htole32(n * 2);
+        content_size = htole32(size);
+
+        fwrite(&name_size, sizeof(name_size), 1, f);
+        fwrite(&content_size, sizeof(content_size), 1, f);
+
+        for (c = name; c < name + n; c++) {
+                uint16_t u = htole16(*c);
+
+                fwrite(&u, sizeof(u), 1, f);
+        }
+
+        fwrite(content, 1, size, f);
+
+        n = 8 + n * 2 + size;
+        fwrite(zeros, 1, ALIGN_TO(n, 8) - n, f);
+
+        return 1;
+}
+
+static int write_entry_index(const char *esp_path) {
+        _cleanup_(unlink_and_freep) char *t = NULL;
+        _cleanup_closedir_ DIR *d = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        const char *p, *dir;
+        struct dirent *de;
+        unsigned n = 0;
+        int r;
+
+        dir = strjoina(esp_path, "/loader/entries");
+        p = strjoina(esp_path, "/loader/entries.idx");
+
+        d = opendir(dir);
+        if (!d)
+                return log_error_errno(errno, "Failed to open \"%s\": %m", dir);
+
+        r = fopen_temporary(p, &f, &t);
+        if (r < 0)
+                return log_error_errno(r, "Failed to open \"%s\" for writing: %m", p);
+
+        fputs(ENTRY_INDEX_MAGIC, f);
+
+        FOREACH_DIRENT(de, d, return log_error_errno(errno, "Failed to read \"%s\": %m", dir)) {
+                _cleanup_free_ char *content = NULL;
+                size_t size;
+
+                /* Skip what sd-boot skips */
+                if (!dirent_is_file_with_suffix(de, ".conf"))
+                        continue;
+                if (startswith(de->d_name, "auto-"))
+                        continue;
+
+                r = read_full_file(prefix_roota(dir, de->d_name), &content, &size);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to read \"%s/%s\": %m", dir, de->d_name);
+
+                if (size > ENTRY_INDEX_CONTENTS_MAX) {
+                        log_debug("Not caching \"%s/%s\", it is too large.", dir, de->d_name);
+                        continue;
+                }
+
+                n += write_entry_index_record(f, de->d_name, content, size);
+        }
+
+        r = fflush_sync_and_check(f);
+        if (r < 0)
+                return log_error_errno(r, "Failed to write \"%s\": %m", p);
+
+        if (rename(t, p) < 0)
+                return log_error_errno(errno, "Failed to move \"%s\" into place: %m", p);
+
+        t = mfree(t);
+
+        log_info("Cached %u boot loader entries in \"%s\".", n, p);
+        return 0;
+}
+
 static int help(int argc, char *argv[], void *userdata) {
 
         printf("%s [COMMAND] [OPTIONS...]\n"
@@ -847,7 +941,8 @@ static int help(int argc, char *argv[], void *userdata) {
                "     list            List boot entries\n"
                "     install         Install systemd-boot to the ESP and EFI variables\n"
                "     update          Update systemd-boot in the ESP and EFI variables\n"
-               "     remove          Remove systemd-boot from the ESP and EFI variables\n",
+               "     remove          Remove systemd-boot from the ESP and EFI variables\n"
+               "     cache-entries   Cache boot loader entries for faster loading\n",
                program_invocation_short_name);
 
         return 0;
@@ -916,6 +1011,35 @@ static void read_loader_efi_var(const char *name, char **var) {
                 log_warning_errno(r, "Failed to read EFI variable %s: %m", name);
 }
 
+static void print_loader_timing(void) {
+        static const char *const phases[] = {
+                "init",    "LoaderTimeInitUSec",
+                "entries", "LoaderTimeConfigUSec",
+                "menu",    "LoaderTimeMenuUSec",
+                "image",   "LoaderTimeImageUSec",
+                "exec",    "LoaderTimeExecUSec",
+        };
+        bool any = false;
+        size_t i;
+
+        /* sd-boot notes when it reached each of these phases, in µs since the CPU was reset */
+        for (i = 0; i < ELEMENTSOF(phases); i += 2) {
+                char ts[FORMAT_TIMESPAN_MAX];
+                _cleanup_free_ char *v = NULL;
+                uint64_t u;
+
+                read_loader_efi_var(phases[i+1], &v);
+                if (!v || safe_atou64(v, &u) < 0 || u == 0)
+                        continue;
+
+                printf("%s %s=%s", any ? "" : "       Timing:", phases[i], format_timespan(ts, sizeof(ts), u, USEC_PER_MSEC));
+                any = true;
+        }
+
+        if (any)
+                printf("\n");
+}
+
 static int verb_status(int argc, char *argv[], void *userdata) {
 
         sd_id128_t uuid = SD_ID128_NULL;
@@ -980,6 +1104,7 @@ static int verb_status(int argc, char *argv[], void *userdata) {
                 else
                         printf("          ESP: n/a\n");
                 printf("         File: %s%s\n", special_glyph(TREE_RIGHT), strna(loader_path));
+                print_loader_timing();
                 printf("\n");
         } else
                 printf("System:\n    Not booted with EFI\n\n");
@@ -1129,6 +1254,19 @@ static int verb_remove(int argc, char *argv[], void *userdata) {
         return r;
 }
 
+static int verb_cache_entries(int argc, char *argv[], void *userdata) {
+        int r;
+
+        r = acquire_esp(false, NULL, NULL, NULL, NULL);
+        if (r < 0)
+                return r;
+
+        RUN_WITH_UMASK(0002)
+                r = write_entry_index(arg_path);
+
+        return r;
+}
+
 static int bootctl_main(int argc, char *argv[]) {
 
         static const Verb verbs[] = {
@@ -1138,6 +1276,7 @@ static int bootctl_main(int argc, char *argv[]) {
                 { "install",         VERB_ANY, 1,        VERB_MUST_BE_ROOT, verb_install },
                 { "update",          VERB_ANY, 1,        VERB_MUST_BE_ROOT, verb_install },
                 { "remove",          VERB_ANY, 1,        VERB_MUST_BE_ROOT, verb_remove  },
+                { "cache-entries",   VERB_ANY, 1,        VERB_MUST_BE_ROOT, verb_cache_entries },
                 {}
         };
 
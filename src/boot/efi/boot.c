@@ -1191,10 +1191,64 @@ static VOID config_load_defaults(Config *config, EFI_FILE *root_dir) {
                 config->timeout_sec_efivar = -1;
 }
 
+/* "bootctl cache-entries" writes the contents of all entry files to \loader\entries.idx, so that we don't
+ * have to open and read each of them on firmware with slow file system drivers. The file starts with
+ * ENTRY_INDEX_MAGIC, followed by one record per entry file: the size of its name in bytes, including the
+ * terminating NUL, and the size of its contents, both as little endian UINT32, then the UCS-2 name, then the
+ * contents, padded with zeros to a multiple of 8 bytes. The directory is still listed, and the cached
+ * contents are only used if the size of the file still matches. */
+#define ENTRY_INDEX_MAGIC "SDBIDX01"
+#define ENTRY_INDEX_ALIGN(l) (((l) + 7) & ~((UINTN) 7))
+
+static CHAR8 *entry_index_lookup(CHAR8 *index, UINTN index_size, CHAR16 *name, UINT64 file_size) {
+        UINTN pos;
+
+        if (!index || index_size < 8 || CompareMem(index, ENTRY_INDEX_MAGIC, 8) != 0)
+                return NULL;
+
+        for (pos = 8; index_size - pos >= 8;) {
+                UINT32 name_size, content_size;
+                CHAR16 *n;
+
+                name_size = *(UINT32 *) (index + pos);
+                content_size = *(UINT32 *) (index + pos + 4);
+                if (name_size < sizeof(CHAR16) || name_size % sizeof(CHAR16) != 0)
+                        return NULL;
+                if (name_size > index_size - pos - 8 || content_size > index_size - pos - 8 - name_size)
+                        return NULL;
+
+                n = (CHAR16 *) (index + pos + 8);
+                if (n[name_size / sizeof(CHAR16) - 1] == '\0' && content_size == file_size && StriCmp(n, name) == 0) {
+                        CHAR8 *content;
+
+                        content = AllocatePool(content_size + 1);
+                        if (!content)
+                                return NULL;
+
+                        CopyMem(content, index + pos + 8 + name_size, content_size);
+                        content[content_size] = '\0';
+                        return content;
+                }
+
+                pos += 8 + name_size + content_size;
+                if (ENTRY_INDEX_ALIGN(pos) >= index_size)
+                        break;
+                pos = ENTRY_INDEX_ALIGN(pos);
+        }
+
+        return NULL;
+}
+
 static VOID config_load_entries(Config *config, EFI_HANDLE *device, EFI_FILE *root_dir, CHAR16 *loaded_image_path) {
+        _cleanup_freepool_ CHAR8 *index = NULL;
+        UINTN index_size = 0;
         EFI_FILE_HANDLE entries_dir;
         EFI_STATUS err;
 
+        err = file_read(root_dir, L"\\loader\\entries.idx", 0, 0, &index, &index_size);
+        if (EFI_ERROR(err))
+                index_size = 0;
+
         err = uefi_call_wrapper(root_dir->Open, 5, root_dir, &entries_dir, L"\\loader\\entries", EFI_FILE_MODE_READ, 0ULL);
         if (!EFI_ERROR(err)) {
                 for (;;) {
@@ -1223,9 +1277,14 @@ static VOID config_load_entries(Config *config, EFI_HANDLE *device, EFI_FILE *ro
                         if (StrnCmp(f->FileName, L"auto-", 5) == 0)
                                 continue;
 
-                        err = file_read(entries_dir, f->FileName, 0, 0, &content, NULL);
-                        if (!EFI_ERROR(err))
-                                config_entry_add_from_file(config, device, f->FileName, content, loaded_image_path);
+                        content = entry_index_lookup(index, index_size, f->FileName, f->FileSize);
+                        if (!content) {
+                                err = file_read(entries_dir, f->FileName, 0, 0, &content, NULL);
+                                if (EFI_ERROR(err))
+                                        continue;
+                        }
+
+                        config_entry_add_from_file(config, device, f->FileName, content, loaded_image_path);
                 }
                 uefi_call_wrapper(entries_dir->Close, 1, entries_dir);
         }
@@ -1637,6 +1696,9 @@ static VOID config_entry_add_linux(Config *config, EFI_LOADED_IMAGE *loaded_imag
 static EFI_STATUS image_start(EFI_HANDLE parent_image, const Config *config, const ConfigEntry *entry) {
         EFI_HANDLE image;
         _cleanup_freepool_ EFI_DEVICE_PATH *path = NULL;
+        CHAR8 *buffer = NULL;
+        UINTN buffer_size = 0;
+        EFI_FILE *root;
         CHAR16 *options;
         EFI_STATUS err;
 
@@ -1647,13 +1709,33 @@ static EFI_STATUS image_start(EFI_HANDLE parent_image, const Config *config, con
                 return EFI_INVALID_PARAMETER;
         }
 
-        err = uefi_call_wrapper(BS->LoadImage, 6, FALSE, parent_image, path, NULL, 0, &image);
+        /* Read the image with a single Read() call, and hand it to the firmware from memory. Left to itself,
+         * LoadImage() reads it in whatever chunks the firmware likes, which can be slow with some FAT
+         * drivers. If anything goes wrong, just let the firmware load it from the file. */
+        root = LibOpenRoot(entry->device);
+        if (root) {
+                err = file_read(root, entry->loader, 0, 0, &buffer, &buffer_size);
+                if (EFI_ERROR(err))
+                        buffer_size = 0;
+                uefi_call_wrapper(root->Close, 1, root);
+        }
+
+        err = EFI_LOAD_ERROR;
+        if (buffer_size > 0)
+                err = uefi_call_wrapper(BS->LoadImage, 6, FALSE, parent_image, path, buffer, buffer_size, &image);
+        if (buffer)
+                /* The firmware made its own copy */
+                FreePool(buffer);
+        if (EFI_ERROR(err))
+                err = uefi_call_wrapper(BS->LoadImage, 6, FALSE, parent_image, path, NULL, 0, &image);
         if (EFI_ERROR(err)) {
                 Print(L"Error loading %s: %r", entry->loader, err);
                 uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
                 return err;
         }
 
+        efivar_set_time_usec(L"LoaderTimeImageUSec", 0);
+
         if (config->options_edit)
                 options = config->options_edit;
         else if (entry->options)
@@ -1793,6 +1875,9 @@ EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table) {
         /* sort entries after version number */
         config_sort_entries(&config);
 
+        /* Entry discovery is done, which is what takes time on slow file systems */
+        efivar_set_time_usec(L"LoaderTimeConfigUSec", 0);
+
         /* if we find some well-known loaders, add them to the end of the list */
         config_entry_add_loader_auto(&config, loaded_image->DeviceHandle, root_dir, NULL,
                                      L"auto-windows", 'w', L"Windows Boot Manager", L"\\EFI\\Microsoft\\Boot\\bootmgfw.efi");
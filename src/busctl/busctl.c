@@ -13,6 +13,7 @@
 #include "alloc-util.h"
 #include "bus-dump.h"
 #include "bus-internal.h"
+#include "bus-message.h"
 #include "bus-signature.h"
 #include "bus-type.h"
 #include "bus-util.h"
@@ -25,6 +26,7 @@
 #include "parse-util.h"
 #include "path-util.h"
 #include "set.h"
+#include "stdio-util.h"
 #include "strv.h"
 #include "terminal-util.h"
 #include "user-util.h"
@@ -1129,6 +1131,365 @@ static int message_pcap(sd_bus_message *m, FILE *f) {
         return bus_message_pcap_frame(m, arg_snaplen, f);
 }
 
+/* "busctl top" aggregates the monitored traffic per message type, sender, interface and member, and prints
+ * the rates once per interval. Method calls that expect a reply are remembered by sender and cookie, so that
+ * the reply (which carries the cookie as reply cookie and has the caller as destination) can be paired with
+ * the call, and the round-trip latency attributed to the call's row. */
+
+#define TOP_INTERVAL_USEC USEC_PER_SEC
+#define TOP_PENDING_MAX 16384U
+
+typedef struct TopEntry {
+        char *key;
+        uint8_t type;
+
+        uint64_t n_messages;
+        uint64_t n_bytes;
+        uint64_t n_replies;
+        usec_t latency_sum;
+        usec_t latency_max;
+
+        unsigned n_pending;
+} TopEntry;
+
+typedef struct TopPending {
+        char *key;
+        usec_t timestamp;
+        TopEntry *entry;
+} TopPending;
+
+static Hashmap *top_entries = NULL;
+static Hashmap *top_pending = NULL;
+static usec_t top_last = 0;
+
+static TopEntry *top_entry_free(TopEntry *e) {
+        if (!e)
+                return NULL;
+
+        free(e->key);
+        return mfree(e);
+}
+
+static TopPending *top_pending_free(TopPending *p) {
+        if (!p)
+                return NULL;
+
+        if (p->entry)
+                p->entry->n_pending--;
+
+        free(p->key);
+        return mfree(p);
+}
+
+static void top_free(void) {
+        TopPending *p;
+        TopEntry *e;
+
+        while ((p = hashmap_steal_first(top_pending)))
+                top_pending_free(p);
+        top_pending = hashmap_free(top_pending);
+
+        while ((e = hashmap_steal_first(top_entries)))
+                top_entry_free(e);
+        top_entries = hashmap_free(top_entries);
+}
+
+static int top_get_entry(sd_bus_message *m, TopEntry **ret) {
+        _cleanup_free_ char *key = NULL;
+        char t[2] = {};
+        TopEntry *e;
+        uint8_t type;
+        int r;
+
+        r = sd_bus_message_get_type(m, &type);
+        if (r < 0)
+                return r;
+
+        /* The key is the type, followed by sender, interface and member, separated by newlines, which none
+         * of them may contain. */
+        t[0] = (char) ('0' + type);
+        key = strjoin(t,
+                      strempty(sd_bus_message_get_sender(m)), "\n",
+                      strempty(sd_bus_message_get_interface(m)), "\n",
+                      strempty(sd_bus_message_get_member(m)));
+        if (!key)
+                return -ENOMEM;
+
+        e = hashmap_get(top_entries, key);
+        if (e) {
+                *ret = e;
+                return 0;
+        }
+
+        r = hashmap_ensure_allocated(&top_entries, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        e = new0(TopEntry, 1);
+        if (!e)
+                return -ENOMEM;
+
+        e->key = TAKE_PTR(key);
+        e->type = type;
+
+        r = hashmap_put(top_entries, e->key, e);
+        if (r < 0) {
+                top_entry_free(e);
+                return r;
+        }
+
+        *ret = e;
+        return 1;
+}
+
+static int top_pending_key(const char *peer, uint64_t cookie, char **ret) {
+        char buf[DECIMAL_STR_MAX(uint64_t)];
+
+        xsprintf(buf, "%" PRIu64, cookie);
+
+        *ret = strjoin(peer, "/", buf);
+        return *ret ? 0 : -ENOMEM;
+}
+
+static int top_add_pending(sd_bus_message *m, TopEntry *e, usec_t n) {
+        _cleanup_free_ char *key = NULL;
+        const char *sender;
+        TopPending *p;
+        uint64_t cookie;
+        int r;
+
+        if (sd_bus_message_get_expect_reply(m) <= 0)
+                return 0;
+
+        sender = sd_bus_message_get_sender(m);
+        if (!sender)
+                return 0;
+
+        if (sd_bus_message_get_cookie(m, &cookie) < 0)
+                return 0;
+
+        /* Don't let callers that never get a reply make us eat all memory */
+        if (hashmap_size(top_pending) >= TOP_PENDING_MAX)
+                return 0;
+
+        r = top_pending_key(sender, cookie, &key);
+        if (r < 0)
+                return r;
+
+        r = hashmap_ensure_allocated(&top_pending, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        p = new0(TopPending, 1);
+        if (!p)
+                return -ENOMEM;
+
+        p->key = TAKE_PTR(key);
+        p->timestamp = n;
+
+        r = hashmap_put(top_pending, p->key, p);
+        if (r < 0) {
+                top_pending_free(p);
+                return r == -EEXIST ? 0 : r;
+        }
+
+        p->entry = e;
+        e->n_pending++;
+
+        return 0;
+}
+
+static int top_complete_pending(sd_bus_message *m, usec_t n) {
+        _cleanup_free_ char *key = NULL;
+        const char *destination;
+        TopPending *p;
+        uint64_t cookie;
+        usec_t t;
+        int r;
+
+        destination = sd_bus_message_get_destination(m);
+        if (!destination)
+                return 0;
+
+        if (sd_bus_message_get_reply_cookie(m, &cookie) < 0)
+                return 0;
+
+        r = top_pending_key(destination, cookie, &key);
+        if (r < 0)
+                return r;
+
+        p = hashmap_remove(top_pending, key);
+        if (!p)
+                return 0;
+
+        t = usec_sub_unsigned(n, p->timestamp);
+
+        p->entry->n_replies++;
+        p->entry->latency_sum += t;
+        p->entry->latency_max = MAX(p->entry->latency_max, t);
+
+        top_pending_free(p);
+        return 0;
+}
+
+static int top_entry_compare(TopEntry * const *a, TopEntry * const *b) {
+        if ((*a)->n_messages != (*b)->n_messages)
+                return (*a)->n_messages > (*b)->n_messages ? -1 : 1;
+        if ((*a)->n_bytes != (*b)->n_bytes)
+                return (*a)->n_bytes > (*b)->n_bytes ? -1 : 1;
+
+        return strcmp((*a)->key, (*b)->key);
+}
+
+static void top_expire(usec_t n) {
+        TopPending *p;
+        TopEntry *e;
+        Iterator i;
+
+        /* Forget about calls which didn't get a reply within the default method call timeout, the bus broker
+         * will have generated an error by then anyway, and about idle rows nobody refers to anymore. */
+        HASHMAP_FOREACH(p, top_pending, i)
+                if (n > p->timestamp + BUS_DEFAULT_TIMEOUT) {
+                        hashmap_remove(top_pending, p->key);
+                        top_pending_free(p);
+                }
+
+        HASHMAP_FOREACH(e, top_entries, i) {
+                if (e->n_messages > 0 || e->n_replies > 0 || e->n_pending > 0)
+                        continue;
+
+                hashmap_remove(top_entries, e->key);
+                top_entry_free(e);
+        }
+}
+
+static int top_display(FILE *f, usec_t n) {
+        _cleanup_free_ TopEntry **array = NULL;
+        uint64_t n_messages = 0, n_bytes = 0;
+        size_t k = 0, j, max_rows;
+        double seconds;
+        TopEntry *e;
+        Iterator i;
+
+        array = new(TopEntry*, hashmap_size(top_entries) + 1);
+        if (!array)
+                return -ENOMEM;
+
+        HASHMAP_FOREACH(e, top_entries, i) {
+                n_messages += e->n_messages;
+                n_bytes += e->n_bytes;
+
+                if (e->n_messages > 0 || e->n_replies > 0)
+                        array[k++] = e;
+        }
+
+        typesafe_qsort(array, k, top_entry_compare);
+
+        seconds = (double) usec_sub_unsigned(n, top_last) / USEC_PER_SEC;
+        if (seconds <= 0)
+                seconds = 1;
+
+        if (on_tty()) {
+                fputs(ANSI_HOME_CLEAR, f);
+                max_rows = lines() > 3 ? lines() - 3 : 1;
+        } else
+                max_rows = (size_t) -1;
+
+        fprintf(f, "%.1f msg/s, %.1f KiB/s, %u calls pending\n",
+                n_messages / seconds, n_bytes / seconds / 1024.0, hashmap_size(top_pending));
+
+        if (arg_legend)
+                fprintf(f, "%s%-13s %8s %10s %10s %10s %-20s %s%s\n",
+                        ansi_underline(),
+                        "TYPE", "MSG/S", "BYTES/S", "LAT(AVG)", "LAT(MAX)", "SENDER", "MEMBER",
+                        ansi_normal());
+
+        for (j = 0; j < k && j < max_rows; j++) {
+                char avg[FORMAT_TIMESPAN_MAX] = "-", max[FORMAT_TIMESPAN_MAX] = "-";
+                const char *sender, *interface, *member;
+
+                e = array[j];
+
+                /* Split the key into its parts again */
+                sender = e->key + 1;
+                interface = strchr(sender, '\n') + 1;
+                member = strchr(interface, '\n') + 1;
+
+                if (e->n_replies > 0) {
+                        format_timespan(avg, sizeof(avg), e->latency_sum / e->n_replies, 1);
+                        format_timespan(max, sizeof(max), e->latency_max, 1);
+                }
+
+                fprintf(f, "%-13s %8.1f %10.0f %10s %10s %-20.*s %.*s%s%s\n",
+                        bus_message_type_to_string(e->type),
+                        e->n_messages / seconds,
+                        e->n_bytes / seconds,
+                        avg, max,
+                        (int) (interface - sender - 1), sender,
+                        (int) (member - interface - 1), interface,
+                        isempty(member) ? "" : ".",
+                        member);
+        }
+
+        /* Start counting anew for the next interval */
+        for (j = 0; j < k; j++) {
+                array[j]->n_messages = array[j]->n_bytes = array[j]->n_replies = 0;
+                array[j]->latency_sum = array[j]->latency_max = 0;
+        }
+
+        if (!on_tty())
+                fputc('\n', f);
+
+        return 0;
+}
+
+static int message_top(sd_bus_message *m, FILE *f) {
+        TopEntry *e;
+        uint8_t type;
+        usec_t n;
+        int r;
+
+        n = now(CLOCK_MONOTONIC);
+        if (top_last == 0)
+                top_last = n;
+
+        if (sd_bus_message_is_signal(m, "org.freedesktop.DBus.Local", "Disconnected") > 0)
+                goto display;
+
+        r = top_get_entry(m, &e);
+        if (r < 0)
+                return log_oom();
+
+        e->n_messages++;
+        e->n_bytes += BUS_MESSAGE_SIZE(m);
+
+        r = sd_bus_message_get_type(m, &type);
+        if (r < 0)
+                return r;
+
+        if (type == SD_BUS_MESSAGE_METHOD_CALL)
+                r = top_add_pending(m, e, n);
+        else if (IN_SET(type, SD_BUS_MESSAGE_METHOD_RETURN, SD_BUS_MESSAGE_METHOD_ERROR))
+                r = top_complete_pending(m, n);
+        else
+                r = 0;
+        if (r < 0)
+                return log_oom();
+
+        if (n < top_last + TOP_INTERVAL_USEC)
+                return 0;
+
+display:
+        r = top_display(f, n);
+        if (r < 0)
+                return log_oom();
+
+        top_expire(n);
+        top_last = n;
+
+        return 0;
+}
+
 static int monitor(int argc, char **argv, int (*dump)(sd_bus_message *m, FILE *f)) {
         _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *message = NULL;
@@ -1253,6 +1614,15 @@ static int verb_monitor(int argc, char **argv, void *userdata) {
         return monitor(argc, argv, message_dump);
 }
 
+static int verb_top(int argc, char **argv, void *userdata) {
+        int r;
+
+        r = monitor(argc, argv, message_top);
+        top_free();
+
+        return r;
+}
+
 static int verb_capture(int argc, char **argv, void *userdata) {
         int r;
 
@@ -1798,6 +2168,7 @@ static int help(void) {
                "  status [SERVICE]        Show bus service, process or bus owner credentials\n"
                "  monitor [SERVICE...]    Show bus traffic\n"
                "  capture [SERVICE...]    Capture bus traffic as pcap\n"
+               "  top [SERVICE...]        Show bus traffic statistics\n"
                "  tree [SERVICE...]       Show object tree of service\n"
                "  introspect SERVICE OBJECT [INTERFACE]\n"
                "  call SERVICE OBJECT INTERFACE METHOD [SIGNATURE [ARGUMENT...]]\n"
@@ -2041,6 +2412,7 @@ static int busctl_main(int argc, char *argv[]) {
                 { "status",       VERB_ANY, 2,        0,            status         },
                 { "monitor",      VERB_ANY, VERB_ANY, 0,            verb_monitor   },
                 { "capture",      VERB_ANY, VERB_ANY, 0,            verb_capture   },
+                { "top",          VERB_ANY, VERB_ANY, 0,            verb_top       },
                 { "tree",         VERB_ANY, VERB_ANY, 0,            tree           },
                 { "introspect",   3,        4,        0,            introspect     },
                 { "call",         5,        VERB_ANY, 0,            call           },
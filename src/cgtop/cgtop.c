@@ -427,7 +427,7 @@ static int process(
 }
 
 static int refresh_one(
-                const char *controller,
+                char **controllers,
                 const char *path,
                 Hashmap *a,
                 Hashmap *b,
@@ -437,20 +437,25 @@ static int refresh_one(
 
         _cleanup_closedir_ DIR *d = NULL;
         Group *ours = NULL;
+        char **c;
         int r;
 
-        assert(controller);
+        assert(!strv_isempty(controllers));
         assert(path);
         assert(a);
 
         if (depth > arg_depth)
                 return 0;
 
-        r = process(controller, path, a, b, iteration, &ours);
-        if (r < 0)
-                return r;
+        /* All controllers listed must be attached to the same hierarchy, the first one is used for enumerating
+         * the subgroups. */
+        STRV_FOREACH(c, controllers) {
+                r = process(*c, path, a, b, iteration, &ours);
+                if (r < 0)
+                        return r;
+        }
 
-        r = cg_enumerate_subgroups(controller, path, &d);
+        r = cg_enumerate_subgroups(controllers[0], path, &d);
         if (r == -ENOENT)
                 return 0;
         if (r < 0)
@@ -472,7 +477,7 @@ static int refresh_one(
 
                 path_kill_slashes(p);
 
-                r = refresh_one(controller, p, a, b, iteration, depth + 1, &child);
+                r = refresh_one(controllers, p, a, b, iteration, depth + 1, &child);
                 if (r < 0)
                         return r;
 
@@ -480,7 +485,7 @@ static int refresh_one(
                     IN_SET(arg_count, COUNT_ALL_PROCESSES, COUNT_USERSPACE_PROCESSES) &&
                     child &&
                     child->n_tasks_valid &&
-                    streq(controller, SYSTEMD_CGROUP_CONTROLLER)) {
+                    streq(controllers[0], SYSTEMD_CGROUP_CONTROLLER)) {
 
                         /* Recursively sum up processes */
 
@@ -500,31 +505,31 @@ static int refresh_one(
 }
 
 static int refresh(const char *root, Hashmap *a, Hashmap *b, unsigned iteration) {
+        const char *c;
         int r;
 
         assert(a);
 
-        r = refresh_one(SYSTEMD_CGROUP_CONTROLLER, root, a, b, iteration, 0, NULL);
-        if (r < 0)
-                return r;
-        r = refresh_one("cpu", root, a, b, iteration, 0, NULL);
-        if (r < 0)
-                return r;
-        r = refresh_one("cpuacct", root, a, b, iteration, 0, NULL);
-        if (r < 0)
-                return r;
-        r = refresh_one("memory", root, a, b, iteration, 0, NULL);
-        if (r < 0)
-                return r;
-        r = refresh_one("io", root, a, b, iteration, 0, NULL);
-        if (r < 0)
-                return r;
-        r = refresh_one("blkio", root, a, b, iteration, 0, NULL);
-        if (r < 0)
-                return r;
-        r = refresh_one("pids", root, a, b, iteration, 0, NULL);
+        r = cg_all_unified();
         if (r < 0)
                 return r;
+        if (r > 0) {
+                /* On the unified hierarchy all controllers share the same tree, hence walk it only once, and read
+                 * all attributes of a group in one go. With many cgroups the directory enumeration is a good part
+                 * of the cost of each refresh. */
+                r = refresh_one(STRV_MAKE(SYSTEMD_CGROUP_CONTROLLER, "cpu", "memory", "io", "pids"),
+                                root, a, b, iteration, 0, NULL);
+                if (r < 0)
+                        return r;
+
+                return 0;
+        }
+
+        FOREACH_STRING(c, SYSTEMD_CGROUP_CONTROLLER, "cpu", "cpuacct", "memory", "io", "blkio", "pids") {
+                r = refresh_one(STRV_MAKE(c), root, a, b, iteration, 0, NULL);
+                if (r < 0)
+                        return r;
+        }
 
         return 0;
 }
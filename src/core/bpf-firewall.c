@@ -23,8 +23,13 @@
 #include "alloc-util.h"
 #include "bpf-firewall.h"
 #include "bpf-program.h"
+#include "cpu-set-util.h"
 #include "fd-util.h"
+#include "fileio.h"
+#include "in-addr-util.h"
 #include "ip-address-access.h"
+#include "random-util.h"
+#include "siphash24.h"
 #include "unit.h"
 
 enum {
@@ -446,9 +451,12 @@ static int bpf_firewall_prepare_accounting_maps(Unit *u, bool enabled, int *fd_i
         assert(fd_ingress);
         assert(fd_egress);
 
+        /* The counters are per CPU, so that packets processed in parallel don't fight over the cache lines the
+         * counters of a busy unit are in. They are summed up when read. */
+
         if (enabled) {
                 if (*fd_ingress < 0) {
-                        r = bpf_map_new(BPF_MAP_TYPE_ARRAY, sizeof(int), sizeof(uint64_t), 2, 0);
+                        r = bpf_map_new(BPF_MAP_TYPE_PERCPU_ARRAY, sizeof(int), sizeof(uint64_t), 2, 0);
                         if (r < 0)
                                 return r;
 
@@ -457,7 +465,7 @@ static int bpf_firewall_prepare_accounting_maps(Unit *u, bool enabled, int *fd_i
 
                 if (*fd_egress < 0) {
 
-                        r = bpf_map_new(BPF_MAP_TYPE_ARRAY, sizeof(int), sizeof(uint64_t), 2, 0);
+                        r = bpf_map_new(BPF_MAP_TYPE_PERCPU_ARRAY, sizeof(int), sizeof(uint64_t), 2, 0);
                         if (r < 0)
                                 return r;
 
@@ -474,7 +482,70 @@ static int bpf_firewall_prepare_accounting_maps(Unit *u, bool enabled, int *fd_i
         return 0;
 }
 
+static void bpf_firewall_hash_access_items(IPAddressAccessItem *list, struct siphash *state) {
+        IPAddressAccessItem *a;
+        uint64_t n = 0;
+
+        LIST_FOREACH(items, a, list) {
+                siphash24_compress(&a->family, sizeof(a->family), state);
+                siphash24_compress(&a->prefixlen, sizeof(a->prefixlen), state);
+                siphash24_compress(&a->address, FAMILY_ADDRESS_SIZE(a->family), state);
+                n++;
+        }
+
+        /* Terminate the list, so that items can't move between lists without changing the digest */
+        siphash24_compress(&n, sizeof(n), state);
+}
+
+static void bpf_firewall_digest(Unit *u, uint64_t ret[static 2]) {
+        static uint8_t keys[2][16];
+        static bool keys_initialized = false;
+        unsigned k;
+
+        assert(u);
+
+        /* Calculates a digest over everything that goes into the programs and access maps compiled for the unit.
+         * It is made up of two SipHash values with keys nobody outside of this process knows, so that a
+         * different configuration can't be made to look unchanged. */
+
+        if (!keys_initialized) {
+                random_bytes(keys, sizeof(keys));
+                keys_initialized = true;
+        }
+
+        for (k = 0; k < 2; k++) {
+                struct siphash state;
+                CGroupContext *cc;
+                bool b;
+                Unit *p;
+
+                siphash24_init(&state, keys[k]);
+
+                b = u->type == UNIT_SLICE;
+                siphash24_compress(&b, sizeof(b), &state);
+
+                b = unit_cgroup_delegate(u);
+                siphash24_compress(&b, sizeof(b), &state);
+
+                cc = unit_get_cgroup_context(u);
+                b = cc && cc->ip_accounting;
+                siphash24_compress(&b, sizeof(b), &state);
+
+                for (p = u; p; p = UNIT_DEREF(p->slice)) {
+                        cc = unit_get_cgroup_context(p);
+                        if (!cc)
+                                continue;
+
+                        bpf_firewall_hash_access_items(cc->ip_address_allow, &state);
+                        bpf_firewall_hash_access_items(cc->ip_address_deny, &state);
+                }
+
+                ret[k] = siphash24_finalize(&state);
+        }
+}
+
 int bpf_firewall_compile(Unit *u) {
+        uint64_t digest[2];
         CGroupContext *cc;
         int r, supported;
 
@@ -501,6 +572,15 @@ int bpf_firewall_compile(Unit *u) {
                 return -EOPNOTSUPP;
         }
 
+        /* cgroups are realized a lot more often than their firewall configuration changes, and filling access maps
+         * with many prefixes is expensive. If nothing changed since we compiled the firewall the last time, keep
+         * the programs and the maps we have. */
+        bpf_firewall_digest(u, digest);
+        if (u->ip_bpf_digest_valid && memcmp(u->ip_bpf_digest, digest, sizeof(digest)) == 0)
+                return 0;
+
+        u->ip_bpf_digest_valid = false;
+
         /* Note that when we compile a new firewall we first flush out the access maps and the BPF programs themselves,
          * but we reuse the the accounting maps. That way the firewall in effect always maps to the actual
          * configuration, but we don't flush out the accounting unnecessarily */
@@ -542,6 +622,9 @@ int bpf_firewall_compile(Unit *u) {
         if (r < 0)
                 return log_error_errno(r, "Compilation for egress BPF program failed: %m");
 
+        memcpy(u->ip_bpf_digest, digest, sizeof(digest));
+        u->ip_bpf_digest_valid = true;
+
         return 0;
 }
 
@@ -605,23 +688,86 @@ int bpf_firewall_install(Unit *u) {
         return 0;
 }
 
+void bpf_firewall_forget_installed(Unit *u) {
+        assert(u);
+
+        /* Called when the unit's cgroup was removed, which implicitly detached the programs from it. Make sure they
+         * are attached again should they be reused for the next incarnation of the cgroup. */
+
+        if (u->ip_bpf_ingress_installed)
+                (void) bpf_program_cgroup_detach(u->ip_bpf_ingress_installed);
+        if (u->ip_bpf_egress_installed)
+                (void) bpf_program_cgroup_detach(u->ip_bpf_egress_installed);
+
+        u->ip_bpf_ingress_installed = bpf_program_unref(u->ip_bpf_ingress_installed);
+        u->ip_bpf_egress_installed = bpf_program_unref(u->ip_bpf_egress_installed);
+}
+
+static int bpf_possible_cpus(void) {
+        static int cached = 0;
+        _cleanup_cpu_free_ cpu_set_t *cpus = NULL;
+        _cleanup_free_ char *s = NULL;
+        int n, r;
+
+        /* Values of per-CPU maps are copied from and to userspace for all possible CPUs at once */
+
+        if (cached > 0)
+                return cached;
+
+        r = read_one_line_file("/sys/devices/system/cpu/possible", &s);
+        if (r < 0)
+                return r;
+
+        n = parse_cpu_set(s, &cpus);
+        if (n < 0)
+                return n;
+        if (!cpus)
+                return -EINVAL;
+
+        n = CPU_COUNT_S(CPU_ALLOC_SIZE(n), cpus);
+        if (n <= 0)
+                return -EINVAL;
+
+        cached = n;
+        return n;
+}
+
+static int bpf_firewall_read_counter(int map_fd, uint64_t key, uint64_t *ret) {
+        uint64_t *values, sum = 0;
+        int n, i, r;
+
+        n = bpf_possible_cpus();
+        if (n < 0)
+                return n;
+
+        values = newa0(uint64_t, n);
+
+        r = bpf_map_lookup_element(map_fd, &key, values);
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < n; i++)
+                sum += values[i];
+
+        *ret = sum;
+        return 0;
+}
+
 int bpf_firewall_read_accounting(int map_fd, uint64_t *ret_bytes, uint64_t *ret_packets) {
-        uint64_t key, packets;
+        uint64_t packets;
         int r;
 
         if (map_fd < 0)
                 return -EBADF;
 
         if (ret_packets) {
-                key = MAP_KEY_PACKETS;
-                r = bpf_map_lookup_element(map_fd, &key, &packets);
+                r = bpf_firewall_read_counter(map_fd, MAP_KEY_PACKETS, &packets);
                 if (r < 0)
                         return r;
         }
 
         if (ret_bytes) {
-                key = MAP_KEY_BYTES;
-                r = bpf_map_lookup_element(map_fd, &key, ret_bytes);
+                r = bpf_firewall_read_counter(map_fd, MAP_KEY_BYTES, ret_bytes);
                 if (r < 0)
                         return r;
         }
@@ -633,19 +779,25 @@ int bpf_firewall_read_accounting(int map_fd, uint64_t *ret_bytes, uint64_t *ret_
 }
 
 int bpf_firewall_reset_accounting(int map_fd) {
-        uint64_t key, value = 0;
-        int r;
+        uint64_t key, *values;
+        int n, r;
 
         if (map_fd < 0)
                 return -EBADF;
 
+        n = bpf_possible_cpus();
+        if (n < 0)
+                return n;
+
+        values = newa0(uint64_t, n);
+
         key = MAP_KEY_PACKETS;
-        r = bpf_map_update_element(map_fd, &key, &value);
+        r = bpf_map_update_element(map_fd, &key, values);
         if (r < 0)
                 return r;
 
         key = MAP_KEY_BYTES;
-        return bpf_map_update_element(map_fd, &key, &value);
+        return bpf_map_update_element(map_fd, &key, values);
 }
 
 int bpf_firewall_supported(void) {
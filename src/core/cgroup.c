@@ -7,6 +7,7 @@
 
 #include <fcntl.h>
 #include <fnmatch.h>
+#include <poll.h>
 
 #include "alloc-util.h"
 #include "blockdev-util.h"
@@ -17,6 +18,7 @@
 #include "fd-util.h"
 #include "fileio.h"
 #include "fs-util.h"
+#include "io-util.h"
 #include "parse-util.h"
 #include "path-util.h"
 #include "process-util.h"
@@ -29,6 +31,9 @@
 
 #define CGROUP_CPU_QUOTA_PERIOD_USEC ((usec_t) 100 * USEC_PER_MSEC)
 
+/* How many queued cgroup empty notifications to process in one event loop iteration */
+#define CGROUP_EMPTY_BUDGET 64U
+
 bool manager_owns_root_cgroup(Manager *m) {
         assert(m);
 
@@ -1697,8 +1702,9 @@ static void unit_remove_from_cgroup_realize_queue(Unit *u) {
  *
  * Returns 0 on success and < 0 on failure. */
 static int unit_realize_cgroup_now(Unit *u, ManagerState state) {
-        CGroupMask target_mask, enable_mask;
+        CGroupMask target_mask, enable_mask, apply_mask;
         bool needs_bpf, apply_bpf;
+        usec_t t;
         int r;
 
         assert(u);
@@ -1717,6 +1723,12 @@ static int unit_realize_cgroup_now(Unit *u, ManagerState state) {
          * this will trickle down properly to cgroupfs. */
         apply_bpf = needs_bpf || u->cgroup_bpf_state != UNIT_CGROUP_BPF_OFF;
 
+        /* Only write the attributes of the controllers that aren't realized yet. For the others the cgroup already
+         * carries the right values, as changing any setting invalidates the controllers it affects. This matters
+         * for slices in particular, which otherwise would get all their attributes rewritten each time a member
+         * that needs one more controller enabled is started. */
+        apply_mask = u->cgroup_realized ? target_mask & ~u->cgroup_realized_mask : target_mask;
+
         /* First, realize parents */
         if (UNIT_ISSET(u->slice)) {
                 r = unit_realize_cgroup_now(UNIT_DEREF(u->slice), state);
@@ -1725,14 +1737,18 @@ static int unit_realize_cgroup_now(Unit *u, ManagerState state) {
         }
 
         /* And then do the real work */
+        t = manager_trace_begin(u->manager);
+
         r = unit_create_cgroup(u, target_mask, enable_mask, needs_bpf);
         if (r < 0)
                 return r;
 
         /* Finally, apply the necessary attributes. */
-        cgroup_context_apply(u, target_mask, apply_bpf, state);
+        cgroup_context_apply(u, apply_mask, apply_bpf, state);
         cgroup_xattr_apply(u);
 
+        manager_trace(u->manager, MANAGER_TRACE_CGROUP_REALIZE, u->id, t);
+
         return 0;
 }
 
@@ -1836,6 +1852,8 @@ void unit_release_cgroup(Unit *u) {
 
         /* Forgets all cgroup details for this cgroup */
 
+        unit_flush_accounting_cache(u);
+
         if (u->cgroup_path) {
                 (void) hashmap_remove(u->manager->cgroup_unit, u->cgroup_path);
                 u->cgroup_path = mfree(u->cgroup_path);
@@ -1874,6 +1892,8 @@ void unit_prune_cgroup(Unit *u) {
         if (is_root_slice)
                 return;
 
+        bpf_firewall_forget_installed(u);
+
         unit_release_cgroup(u);
 
         u->cgroup_realized = false;
@@ -2022,19 +2042,46 @@ int unit_watch_all_pids(Unit *u) {
 
 static int on_cgroup_empty_event(sd_event_source *s, void *userdata) {
         Manager *m = userdata;
+        unsigned n;
         Unit *u;
         int r;
 
         assert(s);
         assert(m);
 
-        u = m->cgroup_empty_queue;
-        if (!u)
-                return 0;
+        for (n = 0; n < CGROUP_EMPTY_BUDGET; n++) {
+
+                /* SIGCHLD is the better source of information, and is supposed to be processed first. If one
+                 * arrived meanwhile, leave the rest of the queue for the next iteration. */
+                if (n > 0 && m->signal_fd >= 0 && fd_wait_for_event(m->signal_fd, POLLIN, 0) > 0)
+                        break;
+
+                u = m->cgroup_empty_queue;
+                if (!u)
+                        break;
+
+                assert(u->in_cgroup_empty_queue);
+                u->in_cgroup_empty_queue = false;
+                LIST_REMOVE(cgroup_empty_queue, m->cgroup_empty_queue, u);
+
+                /* Let's verify that the cgroup is really empty. This is done here rather than when the
+                 * notification is queued, so that a cgroup that is notified about many times (which happens a lot
+                 * during mass teardown) is only checked once. */
+                if (!u->cgroup_path)
+                        continue;
+                r = cg_is_empty_recursive(SYSTEMD_CGROUP_CONTROLLER, u->cgroup_path);
+                if (r < 0) {
+                        log_unit_debug_errno(u, r, "Failed to determine whether cgroup %s is empty: %m", u->cgroup_path);
+                        continue;
+                }
+                if (r == 0)
+                        continue;
 
-        assert(u->in_cgroup_empty_queue);
-        u->in_cgroup_empty_queue = false;
-        LIST_REMOVE(cgroup_empty_queue, m->cgroup_empty_queue, u);
+                unit_add_to_gc_queue(u);
+
+                if (UNIT_VTABLE(u)->notify_cgroup_empty)
+                        UNIT_VTABLE(u)->notify_cgroup_empty(u);
+        }
 
         if (m->cgroup_empty_queue) {
                 /* More stuff queued, let's make sure we remain enabled */
@@ -2043,11 +2090,6 @@ static int on_cgroup_empty_event(sd_event_source *s, void *userdata) {
                         log_debug_errno(r, "Failed to reenable cgroup empty event source: %m");
         }
 
-        unit_add_to_gc_queue(u);
-
-        if (UNIT_VTABLE(u)->notify_cgroup_empty)
-                UNIT_VTABLE(u)->notify_cgroup_empty(u);
-
         return 0;
 }
 
@@ -2067,25 +2109,17 @@ void unit_add_to_cgroup_empty_queue(Unit *u) {
          * 4. On the legacy hierarchy, in service units we start watching all processes of the cgroup for SIGCHLD as
          *    soon as we get one SIGCHLD, to deal with unreliable cgroup notifications.
          *
-         * Regardless which way we got the notification, we'll verify it here, and then add it to a separate
-         * queue. This queue will be dispatched at a lower priority than the SIGCHLD handler, so that we always use
-         * SIGCHLD if we can get it first, and only use the cgroup empty notifications if there's no SIGCHLD pending
-         * (which might happen if the cgroup doesn't contain processes that are our own child, which is typically the
-         * case for scope units). */
+         * Regardless which way we got the notification, we'll add it to a separate queue, and verify it when
+         * dispatching it. This queue will be dispatched at a lower priority than the SIGCHLD handler, so that we
+         * always use SIGCHLD if we can get it first, and only use the cgroup empty notifications if there's no
+         * SIGCHLD pending (which might happen if the cgroup doesn't contain processes that are our own child, which
+         * is typically the case for scope units). */
 
         if (u->in_cgroup_empty_queue)
                 return;
 
-        /* Let's verify that the cgroup is really empty */
         if (!u->cgroup_path)
                 return;
-        r = cg_is_empty_recursive(SYSTEMD_CGROUP_CONTROLLER, u->cgroup_path);
-        if (r < 0) {
-                log_unit_debug_errno(u, r, "Failed to determine whether cgroup %s is empty: %m", u->cgroup_path);
-                return;
-        }
-        if (r == 0)
-                return;
 
         LIST_PREPEND(cgroup_empty_queue, u->manager->cgroup_empty_queue, u);
         u->in_cgroup_empty_queue = true;
@@ -2588,6 +2622,127 @@ int unit_get_ip_accounting(
         return r;
 }
 
+static bool accounting_cache_get(Unit *u, const CGroupAccountingCache *c, uint64_t *ret) {
+        assert(u);
+        assert(c);
+        assert(ret);
+
+        if (u->manager->accounting_cache_usec == 0 || c->timestamp == 0)
+                return false;
+
+        if (now(CLOCK_MONOTONIC) >= usec_add(c->timestamp, u->manager->accounting_cache_usec))
+                return false;
+
+        *ret = c->value;
+        return true;
+}
+
+static void accounting_cache_put(Unit *u, CGroupAccountingCache *c, uint64_t value) {
+        assert(u);
+        assert(c);
+
+        if (u->manager->accounting_cache_usec == 0)
+                return;
+
+        *c = (CGroupAccountingCache) {
+                .value = value,
+                .timestamp = now(CLOCK_MONOTONIC),
+        };
+}
+
+/* The _cached() variants are for the bus property getters: monitoring tools tend to poll the accounting
+ * properties of all units, often from more than one client at the same time, and each query results in a read of
+ * cgroupfs or of a BPF map, all serialized in PID 1. If AccountingCacheSec= is set, a value read for one query is
+ * served to the others for that long. Everything else, i.e. logging and serialization, uses the uncached
+ * calls. */
+
+int unit_get_memory_current_cached(Unit *u, uint64_t *ret) {
+        uint64_t v;
+        int r;
+
+        assert(u);
+        assert(ret);
+
+        if (accounting_cache_get(u, &u->memory_current_cache, ret))
+                return 0;
+
+        r = unit_get_memory_current(u, &v);
+        if (r < 0)
+                return r;
+
+        accounting_cache_put(u, &u->memory_current_cache, v);
+        *ret = v;
+        return 0;
+}
+
+int unit_get_tasks_current_cached(Unit *u, uint64_t *ret) {
+        uint64_t v;
+        int r;
+
+        assert(u);
+        assert(ret);
+
+        if (accounting_cache_get(u, &u->tasks_current_cache, ret))
+                return 0;
+
+        r = unit_get_tasks_current(u, &v);
+        if (r < 0)
+                return r;
+
+        accounting_cache_put(u, &u->tasks_current_cache, v);
+        *ret = v;
+        return 0;
+}
+
+int unit_get_cpu_usage_cached(Unit *u, nsec_t *ret) {
+        nsec_t ns;
+        int r;
+
+        assert(u);
+        assert(ret);
+
+        if (accounting_cache_get(u, &u->cpu_usage_cache, ret))
+                return 0;
+
+        r = unit_get_cpu_usage(u, &ns);
+        if (r < 0)
+                return r;
+
+        accounting_cache_put(u, &u->cpu_usage_cache, ns);
+        *ret = ns;
+        return 0;
+}
+
+int unit_get_ip_accounting_cached(Unit *u, CGroupIPAccountingMetric metric, uint64_t *ret) {
+        uint64_t v;
+        int r;
+
+        assert(u);
+        assert(metric >= 0);
+        assert(metric < _CGROUP_IP_ACCOUNTING_METRIC_MAX);
+        assert(ret);
+
+        if (accounting_cache_get(u, u->ip_accounting_cache + metric, ret))
+                return 0;
+
+        r = unit_get_ip_accounting(u, metric, &v);
+        if (r < 0)
+                return r;
+
+        accounting_cache_put(u, u->ip_accounting_cache + metric, v);
+        *ret = v;
+        return 0;
+}
+
+void unit_flush_accounting_cache(Unit *u) {
+        assert(u);
+
+        zero(u->memory_current_cache);
+        zero(u->tasks_current_cache);
+        zero(u->cpu_usage_cache);
+        zero(u->ip_accounting_cache);
+}
+
 int unit_reset_cpu_accounting(Unit *u) {
         nsec_t ns;
         int r;
@@ -2595,6 +2750,7 @@ int unit_reset_cpu_accounting(Unit *u) {
         assert(u);
 
         u->cpu_usage_last = NSEC_INFINITY;
+        zero(u->cpu_usage_cache);
 
         r = unit_get_cpu_usage_raw(u, &ns);
         if (r < 0) {
@@ -2618,6 +2774,7 @@ int unit_reset_ip_accounting(Unit *u) {
                 q = bpf_firewall_reset_accounting(u->ip_accounting_egress_map_fd);
 
         zero(u->ip_accounting_extra);
+        zero(u->ip_accounting_cache);
 
         return r < 0 ? r : q;
 }
@@ -2631,6 +2788,9 @@ void unit_invalidate_cgroup(Unit *u, CGroupMask m) {
         if (m == 0)
                 return;
 
+        /* Accounting might have been turned on or off */
+        unit_flush_accounting_cache(u);
+
         /* always invalidate compat pairs together */
         if (m & (CGROUP_MASK_IO | CGROUP_MASK_BLKIO))
                 m |= CGROUP_MASK_IO | CGROUP_MASK_BLKIO;
@@ -127,6 +127,12 @@ typedef enum CGroupIPAccountingMetric {
         _CGROUP_IP_ACCOUNTING_METRIC_INVALID = -1,
 } CGroupIPAccountingMetric;
 
+/* An accounting value as recently read from the kernel, see unit_get_memory_current_cached() and friends */
+typedef struct CGroupAccountingCache {
+        uint64_t value;
+        usec_t timestamp;
+} CGroupAccountingCache;
+
 typedef struct Unit Unit;
 typedef struct Manager Manager;
 
@@ -188,6 +194,12 @@ int unit_get_tasks_current(Unit *u, uint64_t *ret);
 int unit_get_cpu_usage(Unit *u, nsec_t *ret);
 int unit_get_ip_accounting(Unit *u, CGroupIPAccountingMetric metric, uint64_t *ret);
 
+int unit_get_memory_current_cached(Unit *u, uint64_t *ret);
+int unit_get_tasks_current_cached(Unit *u, uint64_t *ret);
+int unit_get_cpu_usage_cached(Unit *u, nsec_t *ret);
+int unit_get_ip_accounting_cached(Unit *u, CGroupIPAccountingMetric metric, uint64_t *ret);
+void unit_flush_accounting_cache(Unit *u);
+
 int unit_reset_cpu_accounting(Unit *u);
 int unit_reset_ip_accounting(Unit *u);
 
@@ -9,6 +9,7 @@
 
 #include "alloc-util.h"
 #include "dbus-job.h"
+#include "dbus-unit.h"
 #include "dbus.h"
 #include "job.h"
 #include "log.h"
@@ -227,6 +228,11 @@ void bus_job_send_removed_signal(Job *j) {
         if (!j->sent_dbus_new_signal)
                 bus_job_send_change_signal(j);
 
+        /* Unit change signals might be held back for a bit, see manager_dispatch_dbus_queue(). Make sure clients
+         * waiting for the job to complete see the new state of the unit before they learn that the job is gone. */
+        if (j->unit->in_dbus_queue)
+                bus_unit_send_change_signal(j->unit);
+
         r = bus_foreach_bus(j->manager, j->bus_track, send_removed_signal, j);
         if (r < 0)
                 log_debug_errno(r, "Failed to send job remove signal for %u: %m", j->id);
@@ -116,7 +116,6 @@ static int bus_path_set_transient_property(
                                 s->path = path_kill_slashes(k);
                                 k = NULL;
                                 s->type = t;
-                                s->inotify_fd = -1;
 
                                 LIST_PREPEND(spec, p->specs, s);
 
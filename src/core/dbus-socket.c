@@ -118,6 +118,7 @@ const sd_bus_vtable bus_socket_vtable[] = {
         SD_BUS_PROPERTY("MessageQueueMessageSize", "x", bus_property_get_long, offsetof(Socket, mq_msgsize), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("TCPCongestion", "s", NULL, offsetof(Socket, tcp_congestion), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("ReusePort", "b",  bus_property_get_bool, offsetof(Socket, reuse_port), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("ReusePortListeners", "u", bus_property_get_unsigned, offsetof(Socket, reuse_port_listeners), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("SmackLabel", "s", NULL, offsetof(Socket, smack), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("SmackLabelIPIn", "s", NULL, offsetof(Socket, smack_ip_in), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("SmackLabelIPOut", "s", NULL, offsetof(Socket, smack_ip_out), SD_BUS_VTABLE_PROPERTY_CONST),
@@ -229,6 +230,9 @@ static int bus_socket_set_transient_property(
         if (streq(name, "MaxConnectionsPerSource"))
                 return bus_set_transient_unsigned(u, name, &s->max_connections_per_source, message, flags, error);
 
+        if (streq(name, "ReusePortListeners"))
+                return bus_set_transient_unsigned(u, name, &s->reuse_port_listeners, message, flags, error);
+
         if (streq(name, "KeepAliveProbes"))
                 return bus_set_transient_unsigned(u, name, &s->keep_alive_cnt, message, flags, error);
 
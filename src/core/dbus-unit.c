@@ -12,7 +12,10 @@
 #include "bus-common-errors.h"
 #include "cgroup-util.h"
 #include "condition.h"
+#include "dbus-cgroup.h"
+#include "dbus-execute.h"
 #include "dbus-job.h"
+#include "dbus-kill.h"
 #include "dbus-unit.h"
 #include "dbus-util.h"
 #include "dbus.h"
@@ -700,7 +703,7 @@ static int property_get_current_memory(
         assert(reply);
         assert(u);
 
-        r = unit_get_memory_current(u, &sz);
+        r = unit_get_memory_current_cached(u, &sz);
         if (r < 0 && r != -ENODATA)
                 log_unit_warning_errno(u, r, "Failed to get memory.usage_in_bytes attribute: %m");
 
@@ -724,7 +727,7 @@ static int property_get_current_tasks(
         assert(reply);
         assert(u);
 
-        r = unit_get_tasks_current(u, &cn);
+        r = unit_get_tasks_current_cached(u, &cn);
         if (r < 0 && r != -ENODATA)
                 log_unit_warning_errno(u, r, "Failed to get pids.current attribute: %m");
 
@@ -748,7 +751,7 @@ static int property_get_cpu_usage(
         assert(reply);
         assert(u);
 
-        r = unit_get_cpu_usage(u, &ns);
+        r = unit_get_cpu_usage_cached(u, &ns);
         if (r < 0 && r != -ENODATA)
                 log_unit_warning_errno(u, r, "Failed to get cpuacct.usage attribute: %m");
 
@@ -955,7 +958,7 @@ static int property_get_ip_counter(
                 metric = CGROUP_IP_EGRESS_PACKETS;
         }
 
-        (void) unit_get_ip_accounting(u, metric, &value);
+        (void) unit_get_ip_accounting_cached(u, metric, &value);
         return sd_bus_message_append(reply, "t", value);
 }
 
@@ -1712,6 +1715,128 @@ int bus_unit_set_properties(
         return n;
 }
 
+static int append_vtable_properties(
+                sd_bus_message *reply,
+                const char *path,
+                const char *interface,
+                const sd_bus_vtable *vtable,
+                void *userdata,
+                char **properties,
+                sd_bus_error *error) {
+
+        const sd_bus_vtable *v;
+        int r;
+
+        assert(reply);
+        assert(vtable);
+
+        if (!userdata)
+                return 0;
+
+        for (v = vtable + 1; v->type != _SD_BUS_VTABLE_END; v++) {
+                void *p;
+
+                if (!IN_SET(v->type, _SD_BUS_VTABLE_PROPERTY, _SD_BUS_VTABLE_WRITABLE_PROPERTY))
+                        continue;
+
+                if (v->flags & SD_BUS_VTABLE_HIDDEN)
+                        continue;
+
+                /* Like GetAll(), skip the expensive properties unless explicitly asked for */
+                if (strv_isempty(properties) ? (v->flags & SD_BUS_VTABLE_PROPERTY_EXPLICIT) :
+                                               !strv_contains(properties, v->x.property.member))
+                        continue;
+
+                p = (uint8_t*) userdata + v->x.property.offset;
+
+                r = sd_bus_message_open_container(reply, 'e', "sv");
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_append(reply, "s", v->x.property.member);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_open_container(reply, 'v', v->x.property.signature);
+                if (r < 0)
+                        return r;
+
+                if (v->x.property.get) {
+                        r = v->x.property.get(sd_bus_message_get_bus(reply), path, interface, v->x.property.member, reply, p, error);
+                        if (r >= 0 && sd_bus_error_is_set(error))
+                                r = -sd_bus_error_get_errno(error);
+                } else if (streq(v->x.property.signature, "as"))
+                        r = sd_bus_message_append_strv(reply, *(char***) p);
+                else if (IN_SET(v->x.property.signature[0], SD_BUS_TYPE_STRING, SD_BUS_TYPE_OBJECT_PATH, SD_BUS_TYPE_SIGNATURE))
+                        r = sd_bus_message_append_basic(reply, v->x.property.signature[0], strempty(*(char**) p));
+                else
+                        r = sd_bus_message_append_basic(reply, v->x.property.signature[0], p);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_close_container(reply);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_close_container(reply);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+int bus_unit_append_properties(Unit *u, sd_bus_message *reply, char **properties, sd_bus_error *error) {
+        _cleanup_free_ char *path = NULL;
+        const char *interface;
+        int r;
+
+        assert(u);
+        assert(reply);
+
+        /* Appends the selected properties of all interfaces of the unit as one "a{sv}" array, the same way
+         * GetAll() would. If no properties are specified, all of them are appended. This allows clients to
+         * query many units with a single call, instead of one GetAll() per unit and interface. */
+
+        path = unit_dbus_path(u);
+        if (!path)
+                return -ENOMEM;
+
+        interface = unit_dbus_interface_from_type(u->type);
+
+        r = sd_bus_message_open_container(reply, 'a', "{sv}");
+        if (r < 0)
+                return r;
+
+        r = append_vtable_properties(reply, path, "org.freedesktop.systemd1.Unit", bus_unit_vtable, u, properties, error);
+        if (r < 0)
+                return r;
+
+        r = append_vtable_properties(reply, path, interface, UNIT_VTABLE(u)->bus_vtable, u, properties, error);
+        if (r < 0)
+                return r;
+
+        if (UNIT_VTABLE(u)->cgroup_context_offset > 0) {
+                r = append_vtable_properties(reply, path, interface, bus_unit_cgroup_vtable, u, properties, error);
+                if (r < 0)
+                        return r;
+
+                r = append_vtable_properties(reply, path, interface, bus_cgroup_vtable, unit_get_cgroup_context(u), properties, error);
+                if (r < 0)
+                        return r;
+        }
+
+        r = append_vtable_properties(reply, path, interface, bus_exec_vtable, unit_get_exec_context(u), properties, error);
+        if (r < 0)
+                return r;
+
+        r = append_vtable_properties(reply, path, interface, bus_kill_vtable, unit_get_kill_context(u), properties, error);
+        if (r < 0)
+                return r;
+
+        return sd_bus_message_close_container(reply);
+}
+
 int bus_unit_check_load_state(Unit *u, sd_bus_error *error) {
         assert(u);
 
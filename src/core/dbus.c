@@ -298,6 +298,33 @@ static int bus_job_find(sd_bus *bus, const char *path, const char *interface, vo
         return 1;
 }
 
+static void cache_unit_dbus_path(Manager *m, Unit *u, const char *path) {
+        _cleanup_free_ char *p = NULL;
+
+        assert(m);
+        assert(u);
+        assert(path);
+
+        /* Remembers the unit for its canonical path, so that subsequent lookups don't have to unescape and
+         * resolve it again. Paths by invocation ID or alias name are not cached, they are rare and their
+         * mapping to units changes more often. */
+
+        if (u->dbus_path)
+                return;
+
+        p = unit_dbus_path(u);
+        if (!p || !streq(p, path))
+                return;
+
+        if (hashmap_ensure_allocated(&m->units_by_dbus_path, &string_hash_ops) < 0)
+                return;
+
+        if (hashmap_put(m->units_by_dbus_path, p, u) < 0)
+                return;
+
+        u->dbus_path = TAKE_PTR(p);
+}
+
 static int find_unit(Manager *m, sd_bus *bus, const char *path, Unit **unit, sd_bus_error *error) {
         Unit *u = NULL;  /* just to appease gcc, initialization is not really necessary */
         int r;
@@ -327,10 +354,15 @@ static int find_unit(Manager *m, sd_bus *bus, const char *path, Unit **unit, sd_
                 if (!u)
                         return 0;
         } else {
-                r = manager_load_unit_from_dbus_path(m, path, error, &u);
-                if (r < 0)
-                        return 0;
-                assert(u);
+                u = hashmap_get(m->units_by_dbus_path, path);
+                if (!u) {
+                        r = manager_load_unit_from_dbus_path(m, path, error, &u);
+                        if (r < 0)
+                                return 0;
+                        assert(u);
+
+                        cache_unit_dbus_path(m, u, path);
+                }
         }
 
         *unit = u;
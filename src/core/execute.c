@@ -1391,8 +1391,57 @@ static bool skip_seccomp_unavailable(const Unit* u, const char* msg) {
         return true;
 }
 
+static void syscall_filter_actions(const ExecContext *c, uint32_t *ret_default_action, uint32_t *ret_action) {
+        uint32_t negative_action;
+
+        assert(c);
+        assert(ret_default_action);
+        assert(ret_action);
+
+        negative_action = c->syscall_errno == 0 ? SCMP_ACT_KILL : SCMP_ACT_ERRNO(c->syscall_errno);
+
+        if (c->syscall_whitelist) {
+                *ret_default_action = negative_action;
+                *ret_action = SCMP_ACT_ALLOW;
+        } else {
+                *ret_default_action = SCMP_ACT_ALLOW;
+                *ret_action = negative_action;
+        }
+}
+
+static void precompile_syscall_filter(const Unit *u, const ExecCommand *command, const ExecContext *c, const ExecParameters *params) {
+        uint32_t default_action, action;
+        int r;
+
+        assert(u);
+        assert(command);
+        assert(c);
+        assert(params);
+
+        /* Called in PID 1 before forking off the child, so that the filter is compiled only once, and not for
+         * each service start again. Not worth it if the child is going to extend the filter anyway. */
+
+        if (!(params->flags & EXEC_APPLY_SANDBOXING))
+                return;
+
+        if (!context_has_syscall_filters(c))
+                return;
+
+        if ((command->flags & EXEC_COMMAND_AMBIENT_MAGIC) && !ambient_capabilities_supported())
+                return;
+
+        if (!is_seccomp_available())
+                return;
+
+        syscall_filter_actions(c, &default_action, &action);
+
+        r = seccomp_precompile_syscall_filter_set_raw(default_action, c->syscall_filter, action);
+        if (r < 0)
+                log_unit_debug_errno(u, r, "Failed to precompile system call filter, ignoring: %m");
+}
+
 static int apply_syscall_filter(const Unit* u, const ExecContext *c, bool needs_ambient_hack) {
-        uint32_t negative_action, default_action, action;
+        uint32_t default_action, action;
         int r;
 
         assert(u);
@@ -1404,15 +1453,7 @@ static int apply_syscall_filter(const Unit* u, const ExecContext *c, bool needs_
         if (skip_seccomp_unavailable(u, "SystemCallFilter="))
                 return 0;
 
-        negative_action = c->syscall_errno == 0 ? SCMP_ACT_KILL : SCMP_ACT_ERRNO(c->syscall_errno);
-
-        if (c->syscall_whitelist) {
-                default_action = negative_action;
-                action = SCMP_ACT_ALLOW;
-        } else {
-                default_action = SCMP_ACT_ALLOW;
-                action = negative_action;
-        }
+        syscall_filter_actions(c, &default_action, &action);
 
         if (needs_ambient_hack) {
                 r = seccomp_filter_set_add(c->syscall_filter, c->syscall_whitelist, syscall_filter_sets + SYSCALL_FILTER_SET_SETUID);
@@ -3444,10 +3485,10 @@ int exec_spawn(Unit *unit,
         _cleanup_strv_free_ char **files_env = NULL;
         int *fds = NULL;
         size_t n_storage_fds = 0, n_socket_fds = 0;
-        _cleanup_free_ char *line = NULL;
         int socket_fd, r;
         int named_iofds[3] = { -1, -1, -1 };
         char **argv;
+        usec_t t;
         pid_t pid;
 
         assert(unit);
@@ -3457,6 +3498,8 @@ int exec_spawn(Unit *unit,
         assert(params);
         assert(params->fds || (params->n_storage_fds + params->n_socket_fds <= 0));
 
+        t = manager_trace_begin(unit->manager);
+
         if (context->std_input == EXEC_INPUT_SOCKET ||
             context->std_output == EXEC_OUTPUT_SOCKET ||
             context->std_error == EXEC_OUTPUT_SOCKET) {
@@ -3488,16 +3531,27 @@ int exec_spawn(Unit *unit,
                 return log_unit_error_errno(unit, r, "Failed to load environment files: %m");
 
         argv = params->argv ?: command->argv;
-        line = exec_command_line(argv);
-        if (!line)
-                return log_oom();
 
-        log_struct(LOG_DEBUG,
-                   LOG_UNIT_MESSAGE(unit, "About to execute: %s", line),
-                   "EXECUTABLE=%s", command->path,
-                   LOG_UNIT_ID(unit),
-                   LOG_UNIT_INVOCATION_ID(unit),
-                   NULL);
+        /* Formatting the command line is not free, and this is the hot path of every start, hence only do it
+         * if somebody is going to look at it. */
+        if (DEBUG_LOGGING) {
+                _cleanup_free_ char *line = NULL;
+
+                line = exec_command_line(argv);
+                if (!line)
+                        return log_oom();
+
+                log_struct(LOG_DEBUG,
+                           LOG_UNIT_MESSAGE(unit, "About to execute: %s", line),
+                           "EXECUTABLE=%s", command->path,
+                           LOG_UNIT_ID(unit),
+                           LOG_UNIT_INVOCATION_ID(unit),
+                           NULL);
+        }
+
+#if HAVE_SECCOMP
+        precompile_syscall_filter(unit, command, context, params);
+#endif
 
         pid = fork();
         if (pid < 0)
@@ -3549,6 +3603,8 @@ int exec_spawn(Unit *unit,
 
         exec_status_start(&command->exec_status, pid);
 
+        manager_trace(unit->manager, MANAGER_TRACE_SPAWN, unit->id, t);
+
         *ret = pid;
         return 0;
 }
@@ -3630,6 +3686,7 @@ void exec_context_done(ExecContext *c) {
                 c->directories[i].paths = strv_free(c->directories[i].paths);
 
         c->log_level_max = -1;
+        c->log_rate_limit_bytes = 0;
 
         exec_context_free_log_extra_fields(c);
 
@@ -4093,6 +4150,9 @@ void exec_context_dump(const ExecContext *c, FILE* f, const char *prefix) {
                 fprintf(f, "%sLogLevelMax: %s\n", prefix, strna(t));
         }
 
+        if (c->log_rate_limit_bytes > 0)
+                fprintf(f, "%sLogRateLimitBytes: %" PRIu64 "\n", prefix, c->log_rate_limit_bytes);
+
         if (c->n_log_extra_fields > 0) {
                 size_t j;
 
@@ -218,6 +218,7 @@ struct ExecContext {
         bool syslog_level_prefix;
 
         int log_level_max;
+        uint64_t log_rate_limit_bytes;
 
         struct iovec* log_extra_fields;
         size_t n_log_extra_fields;
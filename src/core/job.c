@@ -120,6 +120,8 @@ static void job_set_state(Job *j, JobState state) {
         if (!j->installed)
                 return;
 
+        manager_state_stream_add_job(j->manager, j, STATE_STREAM_JOB_CHANGED);
+
         if (j->state == JOB_RUNNING)
                 j->unit->manager->n_running_jobs++;
         else {
@@ -146,8 +148,10 @@ void job_uninstall(Job *j) {
         /* Detach from next 'bigger' objects */
 
         /* daemon-reload should be transparent to job observers */
-        if (!MANAGER_IS_RELOADING(j->manager))
+        if (!MANAGER_IS_RELOADING(j->manager)) {
                 bus_job_send_removed_signal(j);
+                manager_state_stream_add_job(j->manager, j, STATE_STREAM_JOB_REMOVED);
+        }
 
         *pj = NULL;
 
@@ -210,6 +214,7 @@ Job* job_install(Job *j) {
                                 log_unit_debug(uj->unit,
                                                "Merged into installed job %s/%s as %u",
                                                uj->unit->id, job_type_to_string(uj->type), (unsigned) uj->id);
+                                manager_state_stream_add_job(uj->manager, uj, STATE_STREAM_JOB_CHANGED);
                                 return uj;
                         } else {
                                 /* already running and not safe to merge into */
@@ -222,6 +227,7 @@ Job* job_install(Job *j) {
                                                uj->unit->id, job_type_to_string(uj->type), (unsigned) uj->id);
 
                                 job_set_state(uj, JOB_WAITING);
+                                manager_state_stream_add_job(uj->manager, uj, STATE_STREAM_JOB_CHANGED);
                                 return uj;
                         }
                 }
@@ -236,6 +242,8 @@ Job* job_install(Job *j) {
                        "Installed new job %s/%s as %u",
                        j->unit->id, job_type_to_string(j->type), (unsigned) j->id);
 
+        manager_state_stream_add_job(j->manager, j, STATE_STREAM_JOB_NEW);
+
         job_add_to_gc_queue(j);
 
         return j;
@@ -582,6 +590,9 @@ int job_run_and_invalidate(Job *j) {
         job_set_state(j, JOB_RUNNING);
         job_add_to_dbus_queue(j);
 
+        /* The time between installing the job and running it is spent waiting for dependencies */
+        manager_trace_full(j->manager, MANAGER_TRACE_JOB_WAIT, j->unit->id, j->begin_usec, j->begin_running_usec);
+
         switch (j->type) {
 
                 case JOB_VERIFY_ACTIVE: {
@@ -894,6 +905,9 @@ int job_finish_and_invalidate(Job *j, JobResult result, bool recursive, bool alr
 
         log_unit_debug(u, "Job %s/%s finished, result=%s", u->id, job_type_to_string(t), job_result_to_string(result));
 
+        if (j->state == JOB_RUNNING)
+                manager_trace(j->manager, MANAGER_TRACE_JOB_RUN, u->id, j->begin_running_usec);
+
         /* If this job did nothing to respective unit we don't log the status message */
         if (!already)
                 job_emit_status_message(u, t, result);
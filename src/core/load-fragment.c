@@ -33,6 +33,7 @@
 #include "errno-list.h"
 #include "escape.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "fs-util.h"
 #include "hexdecoct.h"
 #include "io-util.h"
@@ -1749,7 +1750,6 @@ int config_parse_path_spec(const char *unit,
         s->unit = UNIT(p);
         s->path = TAKE_PTR(k);
         s->type = b;
-        s->inotify_fd = -1;
 
         LIST_PREPEND(spec, p->specs, s);
 
@@ -4665,6 +4665,114 @@ static int merge_by_names(Unit **u, Set *names, const char *id) {
         return 0;
 }
 
+typedef struct FragmentCacheEntry {
+        char *path;
+        dev_t dev;
+        ino_t ino;
+        off_t size;
+        struct timespec mtim;
+        char *data;
+        size_t data_size;
+} FragmentCacheEntry;
+
+static FragmentCacheEntry* fragment_cache_entry_free(FragmentCacheEntry *e) {
+        if (!e)
+                return NULL;
+
+        free(e->path);
+        free(e->data);
+        return mfree(e);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(FragmentCacheEntry*, fragment_cache_entry_free);
+
+Hashmap* unit_fragment_cache_free(Hashmap *h) {
+        FragmentCacheEntry *e;
+
+        while ((e = hashmap_steal_first(h)))
+                fragment_cache_entry_free(e);
+
+        return hashmap_free(h);
+}
+
+static bool fragment_cache_entry_matches(const FragmentCacheEntry *e, const struct stat *st) {
+        return e->dev == st->st_dev &&
+                e->ino == st->st_ino &&
+                e->size == st->st_size &&
+                e->mtim.tv_sec == st->st_mtim.tv_sec &&
+                e->mtim.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static int fragment_cache_open(Manager *m, const char *filename, FILE **f, const struct stat *st) {
+        _cleanup_(fragment_cache_entry_freep) FragmentCacheEntry *n = NULL;
+        FragmentCacheEntry *e;
+        FILE *g;
+        int r;
+
+        assert(m);
+        assert(filename);
+        assert(f);
+        assert(*f);
+        assert(st);
+
+        /* While a set of units is loaded in one go, i.e. during startup and reload, the contents of every
+         * fragment are read only once and then parsed from memory for all units that use it. This matters
+         * for templates, which are otherwise read again for each instance. The file might have been replaced
+         * in the meantime, hence validate the cached copy against what we just opened. Returns > 0 if *f
+         * was replaced by a stream reading from the cache, 0 if the file should be parsed directly. */
+
+        if (!m->unit_path_cache)
+                return 0;
+
+        e = hashmap_get(m->fragment_cache, filename);
+        if (e && !fragment_cache_entry_matches(e, st)) {
+                assert_se(hashmap_remove(m->fragment_cache, filename) == e);
+                e = fragment_cache_entry_free(e);
+        }
+
+        if (!e) {
+                r = hashmap_ensure_allocated(&m->fragment_cache, &path_hash_ops);
+                if (r < 0)
+                        return r;
+
+                n = new0(FragmentCacheEntry, 1);
+                if (!n)
+                        return -ENOMEM;
+
+                n->path = strdup(filename);
+                if (!n->path)
+                        return -ENOMEM;
+
+                n->dev = st->st_dev;
+                n->ino = st->st_ino;
+                n->size = st->st_size;
+                n->mtim = st->st_mtim;
+
+                r = read_full_stream(*f, &n->data, &n->data_size);
+                if (r < 0)
+                        return r;
+
+                r = hashmap_put(m->fragment_cache, n->path, n);
+                if (r < 0)
+                        return r;
+
+                e = TAKE_PTR(n);
+        }
+
+        /* fmemopen() refuses empty buffers, let the caller deal with those */
+        if (e->data_size == 0)
+                return 0;
+
+        g = fmemopen(e->data, e->data_size, "re");
+        if (!g)
+                return -errno;
+
+        fclose(*f);
+        *f = g;
+
+        return 1;
+}
+
 static int load_from_path(Unit *u, const char *path) {
         _cleanup_set_free_free_ Set *symlink_names = NULL;
         _cleanup_fclose_ FILE *f = NULL;
@@ -4759,6 +4867,12 @@ static int load_from_path(Unit *u, const char *path) {
                 u->load_state = UNIT_LOADED;
                 u->fragment_mtime = timespec_load(&st.st_mtim);
 
+                r = fragment_cache_open(u->manager, filename, &f, &st);
+                if (r < 0)
+                        return r;
+                if (r == 0 && fseeko(f, 0, SEEK_SET) < 0)
+                        return -errno;
+
                 /* Now, parse the file contents */
                 r = config_parse(u->id, filename, f,
                                  UNIT_VTABLE(u)->sections,
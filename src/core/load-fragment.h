@@ -14,6 +14,8 @@
 
 int unit_load_fragment(Unit *u);
 
+Hashmap* unit_fragment_cache_free(Hashmap *h);
+
 void unit_dump_config_items(FILE *f);
 
 CONFIG_PARSER_PROTOTYPE(config_parse_unit_deps);
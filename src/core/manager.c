@@ -8,6 +8,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/kd.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdio_ext.h>
 #include <string.h>
@@ -53,6 +54,7 @@
 #include "hashmap.h"
 #include "io-util.h"
 #include "label.h"
+#include "load-fragment.h"
 #include "locale-setup.h"
 #include "log.h"
 #include "macro.h"
@@ -68,6 +70,7 @@
 #include "rm-rf.h"
 #include "signal-util.h"
 #include "socket-util.h"
+#include "siphash24.h"
 #include "special.h"
 #include "stat-util.h"
 #include "string-table.h"
@@ -99,6 +102,24 @@
 /* How many units and jobs to process of the bus queue before returning to the event loop. */
 #define MANAGER_BUS_MESSAGE_BUDGET 100U
 
+/* How long to spend on garbage collecting units in one go, before letting the event loop run again. */
+#define MANAGER_GC_BUDGET_USEC (10*USEC_PER_MSEC)
+
+/* How many notification messages and dead children to process in one go, before letting the event loop run
+ * other sources again. */
+#define MANAGER_NOTIFY_BUDGET 64U
+#define MANAGER_SIGCHLD_BUDGET 64U
+
+/* While booting, how long to hold back unit change signals, so that the many state changes units go through
+ * in quick succession are announced in one go. */
+#define MANAGER_DBUS_COALESCE_USEC (20*USEC_PER_MSEC)
+
+/* How long a single generator may run, all of them together are still bounded by DEFAULT_TIMEOUT_USEC */
+#define GENERATOR_TIMEOUT_USEC (DEFAULT_TIMEOUT_USEC / 3)
+
+/* Buffer size of the stream units are serialized to on daemon-reload and daemon-reexec */
+#define SERIALIZATION_BUFFER_SIZE (256U*1024U)
+
 static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 static int manager_dispatch_cgroups_agent_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 static int manager_dispatch_signal_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
@@ -704,8 +725,8 @@ int manager_new(UnitFileScope scope, unsigned test_run_flags, Manager **_m) {
         m->idle_pipe[0] = m->idle_pipe[1] = m->idle_pipe[2] = m->idle_pipe[3] = -1;
 
         m->pin_cgroupfs_fd = m->notify_fd = m->cgroups_agent_fd = m->signal_fd = m->time_change_fd =
-                m->dev_autofs_fd = m->private_listen_fd = m->cgroup_inotify_fd =
-                m->ask_password_inotify_fd = -1;
+                m->dev_autofs_fd = m->private_listen_fd = m->cgroup_inotify_fd = m->path_inotify_fd =
+                m->ask_password_inotify_fd = m->state_stream_fd = -1;
 
         m->user_lookup_fds[0] = m->user_lookup_fds[1] = -1;
 
@@ -751,6 +772,9 @@ int manager_new(UnitFileScope scope, unsigned test_run_flags, Manager **_m) {
         if (r < 0)
                 return r;
 
+        /* Keep track of which of our event sources take up the time, it's shown in the dump */
+        (void) sd_event_set_statistics(m->event, true);
+
         r = manager_setup_run_queue(m);
         if (r < 0)
                 return r;
@@ -985,7 +1009,7 @@ static int manager_setup_user_lookup_fd(Manager *m) {
         return 0;
 }
 
-static unsigned manager_dispatch_cleanup_queue(Manager *m) {
+unsigned manager_dispatch_cleanup_queue(Manager *m) {
         Unit *u;
         unsigned n = 0;
 
@@ -1088,14 +1112,20 @@ good:
         unit_gc_mark_good(u, gc_marker);
 }
 
-static unsigned manager_dispatch_gc_unit_queue(Manager *m) {
+unsigned manager_dispatch_gc_unit_queue(Manager *m) {
         unsigned n = 0, gc_marker;
+        usec_t deadline;
         Unit *u;
 
         assert(m);
 
         /* log_debug("Running GC..."); */
 
+        /* Only spend a limited amount of time here, see manager_loop(). Each unit is fully decided on in its
+         * sweep, so stopping in the middle is fine: the next run simply starts over with a new marker for the
+         * units still queued. */
+        deadline = usec_add(now(CLOCK_MONOTONIC), MANAGER_GC_BUDGET_USEC);
+
         m->gc_marker += _GC_OFFSET_MAX;
         if (m->gc_marker + _GC_OFFSET_MAX <= _GC_OFFSET_MAX)
                 m->gc_marker = 1;
@@ -1119,6 +1149,9 @@ static unsigned manager_dispatch_gc_unit_queue(Manager *m) {
                         u->gc_marker = gc_marker + GC_OFFSET_BAD;
                         unit_add_to_cleanup_queue(u);
                 }
+
+                if (now(CLOCK_MONOTONIC) >= deadline)
+                        break;
         }
 
         return n;
@@ -1173,6 +1206,18 @@ static void manager_clear_jobs_and_units(Manager *m) {
         m->n_running_jobs = 0;
 }
 
+static void manager_trace_free(Manager *m) {
+        size_t i;
+
+        assert(m);
+
+        for (i = 0; i < m->n_trace_events; i++)
+                free(m->trace_events[i].unit);
+
+        m->trace_events = mfree(m->trace_events);
+        m->n_trace_events = m->n_trace_events_allocated = 0;
+}
+
 Manager* manager_free(Manager *m) {
         UnitType c;
         ExecDirectoryType dt;
@@ -1201,6 +1246,7 @@ Manager* manager_free(Manager *m) {
 
         hashmap_free(m->units);
         hashmap_free(m->units_by_invocation_id);
+        hashmap_free(m->units_by_dbus_path);
         hashmap_free(m->jobs);
         hashmap_free(m->watch_pids);
         hashmap_free(m->watch_bus);
@@ -1224,6 +1270,7 @@ Manager* manager_free(Manager *m) {
         safe_close(m->time_change_fd);
         safe_close_pair(m->user_lookup_fds);
 
+        manager_close_state_stream(m);
         manager_close_ask_password(m);
 
         manager_close_idle_pipe(m);
@@ -1238,6 +1285,10 @@ Manager* manager_free(Manager *m) {
 
         hashmap_free(m->cgroup_unit);
         set_free_free(m->unit_path_cache);
+        unit_fragment_cache_free(m->fragment_cache);
+
+        exec_timing_free_many(m->generator_timings, m->n_generator_timings);
+        manager_trace_free(m);
 
         free(m->switch_root);
         free(m->switch_root_init);
@@ -1347,6 +1398,190 @@ fail:
         m->unit_path_cache = set_free_free(m->unit_path_cache);
 }
 
+static int fingerprint_directory(struct siphash *state, const char *path, bool generated, unsigned level) {
+        _cleanup_closedir_ DIR *d = NULL;
+        _cleanup_strv_free_ char **names = NULL;
+        size_t allocated = 0, n = 0;
+        struct dirent *de;
+        char **i;
+        int r;
+
+        assert(state);
+        assert(path);
+
+        d = opendir(path);
+        if (!d) {
+                if (errno == ENOENT)
+                        return 0;
+
+                return -errno;
+        }
+
+        FOREACH_DIRENT(de, d, return -errno) {
+                if (!GREEDY_REALLOC(names, allocated, n + 2))
+                        return -ENOMEM;
+
+                names[n] = strdup(de->d_name);
+                if (!names[n])
+                        return -ENOMEM;
+
+                names[++n] = NULL;
+        }
+
+        /* Generators recreate their output directories each time, hence don't rely on the readdir() order */
+        strv_sort(names);
+
+        siphash24_compress(path, strlen(path) + 1, state);
+
+        STRV_FOREACH(i, names) {
+                _cleanup_free_ char *p = NULL;
+                struct stat st;
+
+                p = path_join(NULL, path, *i);
+                if (!p)
+                        return -ENOMEM;
+
+                if (lstat(p, &st) < 0)
+                        return -errno;
+
+                siphash24_compress(*i, strlen(*i) + 1, state);
+                siphash24_compress(&st.st_mode, sizeof(st.st_mode), state);
+
+                if (S_ISLNK(st.st_mode)) {
+                        _cleanup_free_ char *target = NULL;
+
+                        r = readlink_malloc(p, &target);
+                        if (r < 0)
+                                return r;
+
+                        siphash24_compress(target, strlen(target) + 1, state);
+
+                        /* Linked unit files may live outside of the search path, so also include what the
+                         * symlink points to. Dangling symlinks are fine, that's simply reflected in the hash. */
+                        if (generated || stat(p, &st) < 0)
+                                continue;
+                }
+
+                if (S_ISDIR(st.st_mode)) {
+                        /* Drop-in and .wants/.requires directories, nothing below those is looked at */
+                        if (level > 0)
+                                continue;
+
+                        r = fingerprint_directory(state, p, generated, level + 1);
+                        if (r < 0)
+                                return r;
+
+                } else if (S_ISREG(st.st_mode) && generated) {
+                        _cleanup_free_ char *contents = NULL;
+                        size_t size;
+
+                        /* Generated files are written anew on each run, compare them by contents */
+                        r = read_full_file(p, &contents, &size);
+                        if (r < 0)
+                                return r;
+
+                        siphash24_compress(&size, sizeof(size), state);
+                        siphash24_compress(contents, size, state);
+                } else {
+                        siphash24_compress(&st.st_dev, sizeof(st.st_dev), state);
+                        siphash24_compress(&st.st_ino, sizeof(st.st_ino), state);
+                        siphash24_compress(&st.st_size, sizeof(st.st_size), state);
+                        siphash24_compress(&st.st_mtim, sizeof(st.st_mtim), state);
+                }
+        }
+
+        return 0;
+}
+
+static int manager_fingerprint_unit_files(Manager *m, uint64_t *ret) {
+        /* Any fixed key will do, this is not exposed anywhere */
+        static const uint8_t key[16] = {
+                0x7d, 0x1c, 0x4e, 0x93, 0x2a, 0xb5, 0x60, 0xf8,
+                0x05, 0xd7, 0x3f, 0x81, 0xc2, 0x6b, 0x99, 0x14,
+        };
+        struct siphash state;
+        char **p;
+        int r;
+
+        assert(m);
+        assert(ret);
+
+        /* Calculates a hash over everything in the unit search path that affects how units are loaded: the
+         * names of all unit files, drop-ins and .wants/.requires symlinks, and the inode, size and mtime of
+         * each of them. Unit files created by generators are hashed by contents, since they are recreated on
+         * each reload. */
+
+        siphash24_init(&state, key);
+
+        STRV_FOREACH(p, m->lookup_paths.search_path) {
+                bool generated;
+
+                generated = path_equal_ptr(*p, m->lookup_paths.generator) ||
+                            path_equal_ptr(*p, m->lookup_paths.generator_early) ||
+                            path_equal_ptr(*p, m->lookup_paths.generator_late);
+
+                r = fingerprint_directory(&state, *p, generated, 0);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = siphash24_finalize(&state);
+        return 0;
+}
+
+static void manager_update_unit_files_fingerprint(Manager *m) {
+        int r;
+
+        assert(m);
+
+        r = manager_fingerprint_unit_files(m, &m->unit_files_fingerprint);
+        if (r < 0)
+                log_debug_errno(r, "Failed to fingerprint unit files, the next reload will reload all units: %m");
+
+        m->unit_files_fingerprint_valid = r >= 0;
+}
+
+static bool manager_unit_files_changed(Manager *m) {
+        uint64_t fingerprint;
+        Iterator i;
+        Unit *u;
+        int r;
+
+        assert(m);
+
+        if (!m->unit_files_fingerprint_valid)
+                return true;
+
+        r = manager_fingerprint_unit_files(m, &fingerprint);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to fingerprint unit files, reloading all units: %m");
+                return true;
+        }
+
+        if (fingerprint != m->unit_files_fingerprint)
+                return true;
+
+        HASHMAP_FOREACH(u, m->units, i) {
+                struct stat st;
+                usec_t t = 0;
+
+                /* Loading might have failed for reasons that are gone by now, let's retry in that case */
+                if (u->load_state == UNIT_ERROR)
+                        return true;
+
+                /* Files units were generated from, such as /etc/fstab, are usually not in the search path */
+                if (!u->source_path)
+                        continue;
+
+                if (stat(u->source_path, &st) >= 0)
+                        t = timespec_load(&st.st_mtim);
+                if (t != u->source_mtime)
+                        return true;
+        }
+
+        return false;
+}
+
 static void manager_distribute_fds(Manager *m, FDSet *fds) {
         Iterator i;
         Unit *u;
@@ -1398,6 +1633,7 @@ static bool manager_dbus_is_running(Manager *m, bool deserialized) {
 }
 
 int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
+        usec_t t;
         int r;
 
         assert(m);
@@ -1420,6 +1656,10 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
         if (r < 0)
                 return r;
 
+        manager_trace_full(m, MANAGER_TRACE_GENERATORS, NULL,
+                           m->timestamps[MANAGER_TIMESTAMP_GENERATORS_START].monotonic,
+                           m->timestamps[MANAGER_TIMESTAMP_GENERATORS_FINISH].monotonic);
+
         /* If this is the first boot, and we are in the host system, then preset everything */
         if (m->first_boot > 0 &&
             MANAGER_IS_SYSTEM(m) &&
@@ -1435,6 +1675,7 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
 
         lookup_paths_reduce(&m->lookup_paths);
         manager_build_unit_path_cache(m);
+        manager_update_unit_files_fingerprint(m);
 
         /* If we will deserialize make sure that during enumeration
          * this is already known, so we increase the counter here
@@ -1447,6 +1688,10 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
         manager_enumerate(m);
         dual_timestamp_get(m->timestamps + MANAGER_TIMESTAMP_UNITS_LOAD_FINISH);
 
+        manager_trace_full(m, MANAGER_TRACE_ENUMERATE, NULL,
+                           m->timestamps[MANAGER_TIMESTAMP_UNITS_LOAD_START].monotonic,
+                           m->timestamps[MANAGER_TIMESTAMP_UNITS_LOAD_FINISH].monotonic);
+
         /* Second, deserialize if there is something to deserialize */
         if (serialization) {
                 r = manager_deserialize(m, serialization, fds);
@@ -1497,7 +1742,9 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
         m->deserialized_subscribed = strv_free(m->deserialized_subscribed);
 
         /* Third, fire things up! */
+        t = manager_trace_begin(m);
         manager_coldplug(m);
+        manager_trace(m, MANAGER_TRACE_COLDPLUG, NULL, t);
 
         /* Release any dynamic users no longer referenced */
         dynamic_user_vacuum(m, true);
@@ -1522,6 +1769,8 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
 }
 
 int manager_add_job(Manager *m, JobType type, Unit *unit, JobMode mode, sd_bus_error *e, Job **_ret) {
+        char ts[FORMAT_TIMESPAN_MAX];
+        usec_t start;
         int r;
         Transaction *tr;
 
@@ -1544,6 +1793,8 @@ int manager_add_job(Manager *m, JobType type, Unit *unit, JobMode mode, sd_bus_e
         if (!tr)
                 return -ENOMEM;
 
+        start = now(CLOCK_MONOTONIC);
+
         r = transaction_add_job_and_dependencies(tr, type, unit, NULL, true, false,
                                                  IN_SET(mode, JOB_IGNORE_DEPENDENCIES, JOB_IGNORE_REQUIREMENTS),
                                                  mode == JOB_IGNORE_DEPENDENCIES, e);
@@ -1556,10 +1807,16 @@ int manager_add_job(Manager *m, JobType type, Unit *unit, JobMode mode, sd_bus_e
                         goto tr_abort;
         }
 
+        log_unit_debug(unit, "Built transaction for %s/%s with jobs for %u units in %s.",
+                       unit->id, job_type_to_string(type), hashmap_size(tr->jobs),
+                       format_timespan(ts, sizeof(ts), now(CLOCK_MONOTONIC) - start, 1));
+
         r = transaction_activate(tr, m, mode, e);
         if (r < 0)
                 goto tr_abort;
 
+        manager_trace_full(m, MANAGER_TRACE_TRANSACTION, unit->id, start, now(CLOCK_MONOTONIC));
+
         log_unit_debug(unit,
                        "Enqueued job %s/%s as %u", unit->id,
                        job_type_to_string(type), (unsigned) tr->anchor_job->id);
@@ -1708,9 +1965,13 @@ unsigned manager_dispatch_load_queue(Manager *m) {
          * tries to load its data until the queue is empty */
 
         while ((u = m->load_queue)) {
+                usec_t t;
+
                 assert(u->in_load_queue);
 
+                t = manager_trace_begin(m);
                 unit_load(u);
+                manager_trace(m, MANAGER_TRACE_UNIT_LOAD, u->id, t);
                 n++;
         }
 
@@ -1866,6 +2127,28 @@ void manager_dump_units(Manager *s, FILE *f, const char *prefix) {
                         unit_dump(u, f, prefix);
 }
 
+static void manager_dump_event_source(sd_event_source *s, FILE *f, const char *prefix) {
+        char runtime[FORMAT_TIMESPAN_MAX], runtime_max[FORMAT_TIMESPAN_MAX], latency_max[FORMAT_TIMESPAN_MAX];
+        uint64_t n, t, t_max, l_max;
+        const char *description = NULL;
+
+        if (!s)
+                return;
+
+        if (sd_event_source_get_statistics(s, &n, &t, &t_max, NULL, &l_max) <= 0)
+                return;
+
+        (void) sd_event_source_get_description(s, &description);
+
+        fprintf(f, "%sEvent Source %s: %" PRIu64 " dispatches, runtime %s (max %s), max latency %s\n",
+                strempty(prefix),
+                strna(description),
+                n,
+                format_timespan(runtime, sizeof(runtime), t, 1),
+                format_timespan(runtime_max, sizeof(runtime_max), t_max, 1),
+                format_timespan(latency_max, sizeof(latency_max), l_max, 1));
+}
+
 void manager_dump(Manager *m, FILE *f, const char *prefix) {
         ManagerTimestamp q;
 
@@ -1882,6 +2165,22 @@ void manager_dump(Manager *m, FILE *f, const char *prefix) {
                                 format_timestamp(buf, sizeof(buf), m->timestamps[q].realtime));
         }
 
+        manager_dump_event_source(m->run_queue_event_source, f, prefix);
+        manager_dump_event_source(m->notify_event_source, f, prefix);
+        manager_dump_event_source(m->cgroups_agent_event_source, f, prefix);
+        manager_dump_event_source(m->signal_event_source, f, prefix);
+        manager_dump_event_source(m->sigchld_event_source, f, prefix);
+        manager_dump_event_source(m->time_change_event_source, f, prefix);
+        manager_dump_event_source(m->jobs_in_progress_event_source, f, prefix);
+        manager_dump_event_source(m->user_lookup_event_source, f, prefix);
+        manager_dump_event_source(m->udev_event_source, f, prefix);
+        manager_dump_event_source(m->mount_event_source, f, prefix);
+        manager_dump_event_source(m->swap_event_source, f, prefix);
+        manager_dump_event_source(m->private_listen_event_source, f, prefix);
+        manager_dump_event_source(m->cgroup_inotify_event_source, f, prefix);
+        manager_dump_event_source(m->cgroup_empty_event_source, f, prefix);
+        manager_dump_event_source(m->path_inotify_event_source, f, prefix);
+
         manager_dump_units(m, f, prefix);
         manager_dump_jobs(m, f, prefix);
 }
@@ -1947,8 +2246,29 @@ static int manager_dispatch_run_queue(sd_event_source *source, void *userdata) {
         return 1;
 }
 
+static usec_t manager_dbus_unit_queue_deadline(Manager *m) {
+        assert(m);
+
+        /* Returns when the unit change signals should be sent out at the latest, or 0 if right away.
+         *
+         * While booting up, units tend to go through several states within a few milliseconds (loaded, activating,
+         * active, …), and each of those would otherwise result in a PropertiesChanged signal with all properties
+         * of the unit, which every subscriber has to process. Hence, hold the unit queue back for a short while
+         * so that these changes are coalesced. Once we are up, changes are rare and clients expect them to be
+         * announced promptly, so don't delay anything. */
+
+        if (!m->dbus_unit_queue || MANAGER_IS_FINISHED(m))
+                return 0;
+
+        if (m->dbus_job_queue || m->send_reloading_done || m->queued_message)
+                return 0;
+
+        return usec_add(m->dbus_unit_queue_since, MANAGER_DBUS_COALESCE_USEC);
+}
+
 static unsigned manager_dispatch_dbus_queue(Manager *m) {
         unsigned n = 0, budget;
+        usec_t deadline;
         Unit *u;
         Job *j;
 
@@ -1966,6 +2286,11 @@ static unsigned manager_dispatch_dbus_queue(Manager *m) {
         if (manager_bus_n_queued_write(m) > MANAGER_BUS_BUSY_THRESHOLD)
                 return 0;
 
+        /* Are we still collecting unit changes? Then let's not send anything yet. */
+        deadline = manager_dbus_unit_queue_deadline(m);
+        if (deadline > 0 && now(CLOCK_MONOTONIC) < deadline)
+                return 0;
+
         /* Only process a certain number of units/jobs per event loop iteration. Even if the bus queue wasn't overly
          * full before this call we shouldn't increase it in size too wildly in one step, and we shouldn't monopolize
          * CPU time with generating these messages. Note the difference in counting of this "budget" and the
@@ -2056,6 +2381,14 @@ static void manager_invoke_notify_message(
                 return;
         u->notifygen = m->notifygen;
 
+        /* Keep-alive pings are by far the most frequent messages, don't bother splitting them up */
+        if (UNIT_VTABLE(u)->notify_watchdog &&
+            fdset_isempty(fds) &&
+            STR_IN_SET(buf, "WATCHDOG=1", "WATCHDOG=1\n")) {
+                UNIT_VTABLE(u)->notify_watchdog(u, ucred);
+                return;
+        }
+
         if (UNIT_VTABLE(u)->notify_message) {
                 _cleanup_strv_free_ char **tags = NULL;
 
@@ -2078,10 +2411,9 @@ static void manager_invoke_notify_message(
         }
 }
 
-static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+static int manager_receive_notify_message(Manager *m) {
 
         _cleanup_fdset_free_ FDSet *fds = NULL;
-        Manager *m = userdata;
         char buf[NOTIFY_BUFFER_MAX+1];
         struct iovec iovec = {
                 .iov_base = buf,
@@ -2109,17 +2441,13 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
         ssize_t n;
 
         assert(m);
-        assert(m->notify_fd == fd);
 
-        if (revents != EPOLLIN) {
-                log_warning("Got unexpected poll event for notify fd.");
-                return 0;
-        }
+        /* Returns 0 if there was no message to read, > 0 if one was read (and processed or ignored) */
 
         n = recvmsg(m->notify_fd, &msghdr, MSG_DONTWAIT|MSG_CMSG_CLOEXEC|MSG_TRUNC);
         if (n < 0) {
                 if (IN_SET(errno, EAGAIN, EINTR))
-                        return 0; /* Spurious wakeup, try again */
+                        return 0; /* Spurious wakeup or queue drained, try again */
 
                 /* If this is any other, real error, then let's stop processing this socket. This of course means we
                  * won't take notification messages anymore, but that's still better than busy looping around this:
@@ -2148,25 +2476,25 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
                 if (r < 0) {
                         close_many(fd_array, n_fds);
                         log_oom();
-                        return 0;
+                        return 1;
                 }
         }
 
         if (!ucred || !pid_is_valid(ucred->pid)) {
                 log_warning("Received notify message without valid credentials. Ignoring.");
-                return 0;
+                return 1;
         }
 
         if ((size_t) n >= sizeof(buf) || (msghdr.msg_flags & MSG_TRUNC)) {
                 log_warning("Received notify message exceeded maximum size. Ignoring.");
-                return 0;
+                return 1;
         }
 
         /* As extra safety check, let's make sure the string we get doesn't contain embedded NUL bytes. We permit one
          * trailing NUL byte in the message, but don't expect it. */
         if (n > 1 && memchr(buf, 0, n-1)) {
                 log_warning("Received notify message with embedded NUL bytes. Ignoring.");
-                return 0;
+                return 1;
         }
 
         /* Make sure it's NUL-terminated. */
@@ -2211,6 +2539,33 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
         if (fdset_size(fds) > 0)
                 log_warning("Got extra auxiliary fds with notification message, closing them.");
 
+        return 1;
+}
+
+static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        Manager *m = userdata;
+        unsigned n = 0;
+        int r;
+
+        assert(m);
+        assert(m->notify_fd == fd);
+
+        if (revents != EPOLLIN) {
+                log_warning("Got unexpected poll event for notify fd.");
+                return 0;
+        }
+
+        /* Read a batch of messages per wakeup, since services tend to send them in bursts (think READY=1 of
+         * many services at boot, or frequent STATUS= updates). But stop after a while, so that a chatty client
+         * cannot starve the other event sources: the socket stays readable, hence we'll be called again. */
+        while (n < MANAGER_NOTIFY_BUDGET) {
+                r = manager_receive_notify_message(m);
+                if (r <= 0)
+                        return r;
+
+                n++;
+        }
+
         return 0;
 }
 
@@ -2235,14 +2590,13 @@ static void manager_invoke_sigchld_event(
                 UNIT_VTABLE(u)->sigchld_event(u, si->si_pid, si->si_code, si->si_status);
 }
 
-static int manager_dispatch_sigchld(sd_event_source *source, void *userdata) {
-        Manager *m = userdata;
+static int manager_process_sigchld(Manager *m) {
         siginfo_t si = {};
-        int r;
 
-        assert(source);
         assert(m);
 
+        /* Returns 0 if there are no more dead children to process, > 0 if one was processed and reaped */
+
         /* First we call waitd() for a PID and do not reap the zombie. That way we can still access /proc/$PID for it
          * while it is a zombie. */
 
@@ -2251,11 +2605,11 @@ static int manager_dispatch_sigchld(sd_event_source *source, void *userdata) {
                 if (errno != ECHILD)
                         log_error_errno(errno, "Failed to peek for child with waitid(), ignoring: %m");
 
-                goto turn_off;
+                return 0;
         }
 
         if (si.si_pid <= 0)
-                goto turn_off;
+                return 0;
 
         if (IN_SET(si.si_code, CLD_EXITED, CLD_KILLED, CLD_DUMPED)) {
                 _cleanup_free_ Unit **array_copy = NULL;
@@ -2305,14 +2659,37 @@ static int manager_dispatch_sigchld(sd_event_source *source, void *userdata) {
         }
 
         /* And now, we actually reap the zombie. */
-        if (waitid(P_PID, si.si_pid, &si, WEXITED) < 0) {
+        if (waitid(P_PID, si.si_pid, &si, WEXITED) < 0)
                 log_error_errno(errno, "Failed to dequeue child, ignoring: %m");
-                return 0;
-        }
 
-        return 0;
+        return 1;
+}
+
+static int manager_dispatch_sigchld(sd_event_source *source, void *userdata) {
+        Manager *m = userdata;
+        unsigned n = 0;
+        int r;
+
+        assert(source);
+        assert(m);
+
+        /* Process a batch of dead children per iteration, which matters when many services exit at the same
+         * time, e.g. on shutdown. However, a service's notification messages must be processed before its
+         * SIGCHLD (which is why the notify fd has the higher priority), hence stop the batch as soon as there's
+         * a message waiting, and let the event loop dispatch it first. We stay enabled in that case. */
+        for (;;) {
+                if (n >= MANAGER_SIGCHLD_BUDGET)
+                        return 0;
+
+                if (n > 0 && m->notify_fd >= 0 && fd_wait_for_event(m->notify_fd, POLLIN, 0) > 0)
+                        return 0;
+
+                if (manager_process_sigchld(m) == 0)
+                        break;
+
+                n++;
+        }
 
-turn_off:
         /* All children processed for now, turn off event source */
 
         r = sd_event_source_set_enabled(m->sigchld_event_source, SD_EVENT_OFF);
@@ -2617,8 +2994,9 @@ int manager_loop(Manager *m) {
         assert(m);
         m->exit_code = MANAGER_OK;
 
-        /* Release the path cache */
+        /* Release the path and fragment caches */
         m->unit_path_cache = set_free_free(m->unit_path_cache);
+        m->fragment_cache = unit_fragment_cache_free(m->fragment_cache);
 
         manager_check_finished(m);
 
@@ -2628,7 +3006,7 @@ int manager_loop(Manager *m) {
                 return log_error_errno(r, "Failed to enable SIGCHLD event source: %m");
 
         while (m->exit_code == MANAGER_OK) {
-                usec_t wait_usec;
+                usec_t wait_usec, deadline;
 
                 if (m->runtime_watchdog > 0 && m->runtime_watchdog != USEC_INFINITY && MANAGER_IS_SYSTEM(m))
                         watchdog_ping();
@@ -2645,8 +3023,22 @@ int manager_loop(Manager *m) {
                 if (manager_dispatch_gc_job_queue(m) > 0)
                         continue;
 
-                if (manager_dispatch_gc_unit_queue(m) > 0)
+                if (manager_dispatch_gc_unit_queue(m) > 0) {
+                        /* When many units go away at once, collecting them all in one go might take a while.
+                         * Hence, free what we found so far right away, and if there's more left, let the
+                         * event loop run once before continuing, so that we don't fall behind on SIGCHLD and
+                         * notification messages. This is only done with the cleanup queue empty, so that no
+                         * event handler can pick up a reference to a unit that is about to be freed. */
+                        (void) manager_dispatch_cleanup_queue(m);
+
+                        if (m->gc_unit_queue) {
+                                r = sd_event_run(m->event, 0);
+                                if (r < 0)
+                                        return log_error_errno(r, "Failed to run event loop: %m");
+                        }
+
                         continue;
+                }
 
                 if (manager_dispatch_cleanup_queue(m) > 0)
                         continue;
@@ -2665,6 +3057,16 @@ int manager_loop(Manager *m) {
                 } else
                         wait_usec = USEC_INFINITY;
 
+                /* Wake up again in time to send out the unit change signals we are holding back */
+                deadline = manager_dbus_unit_queue_deadline(m);
+                if (deadline > 0) {
+                        usec_t n;
+
+                        n = now(CLOCK_MONOTONIC);
+                        if (deadline > n)
+                                wait_usec = MIN(wait_usec, deadline - n);
+                }
+
                 r = sd_event_run(m->event, wait_usec);
                 if (r < 0)
                         return log_error_errno(r, "Failed to run event loop: %m");
@@ -2832,6 +3234,16 @@ void manager_send_unit_plymouth(Manager *m, Unit *u) {
                         log_error_errno(errno, "Failed to write Plymouth message: %m");
 }
 
+void manager_setup_serialization_stream(FILE *f) {
+        assert(f);
+
+        /* The serialization is written and read in one go, line by line, and only ever by a single thread. Hence
+         * don't take the stream lock for every single character, and use a buffer large enough that a system
+         * with thousands of units isn't serialized in thousands of write() calls. */
+        (void) __fsetlocking(f, FSETLOCKING_BYCALLER);
+        (void) setvbuf(f, NULL, _IOFBF, SERIALIZATION_BUFFER_SIZE);
+}
+
 int manager_open_serialization(Manager *m, FILE **_f) {
         int fd;
         FILE *f;
@@ -2848,6 +3260,8 @@ int manager_open_serialization(Manager *m, FILE **_f) {
                 return -errno;
         }
 
+        manager_setup_serialization_stream(f);
+
         *_f = f;
         return 0;
 }
@@ -2910,6 +3324,16 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
                 fprintf(f, "cgroups-agent-fd=%i\n", copy);
         }
 
+        if (m->state_stream_fd >= 0) {
+                int copy;
+
+                copy = fdset_put_dup(fds, m->state_stream_fd);
+                if (copy < 0)
+                        return copy;
+
+                fprintf(f, "state-stream-fd=%i\n", copy);
+        }
+
         if (m->user_lookup_fds[0] >= 0) {
                 int copy0, copy1;
 
@@ -3097,6 +3521,19 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                                 m->cgroups_agent_fd = fdset_remove(fds, fd);
                         }
 
+                } else if ((val = startswith(l, "state-stream-fd="))) {
+                        int fd;
+
+                        if (safe_atoi(val, &fd) < 0 || fd < 0 || !fdset_contains(fds, fd))
+                                log_notice("Failed to parse state stream fd: %s", val);
+                        else {
+                                int k;
+
+                                k = manager_attach_state_stream(m, fdset_remove(fds, fd));
+                                if (k < 0)
+                                        log_notice_errno(k, "Failed to attach state stream, ignoring: %m");
+                        }
+
                 } else if ((val = startswith(l, "user-lookup="))) {
                         int fd0, fd1;
 
@@ -3217,12 +3654,45 @@ int manager_reload(Manager *m) {
                 return -ENOMEM;
         }
 
-        r = manager_serialize(m, f, fds, false);
-        if (r < 0) {
+        /* Units loaded on demand since the last reload might have cached fragments that are gone or stale
+         * by now, drop them along with the other lookup caches */
+        m->fragment_cache = unit_fragment_cache_free(m->fragment_cache);
+
+        /* Rerun the generators first, so that we can tell whether anything changed at all */
+        lookup_paths_flush_generator(&m->lookup_paths);
+        lookup_paths_free(&m->lookup_paths);
+
+        r = lookup_paths_init(&m->lookup_paths, m->unit_file_scope, 0, NULL);
+
+        q = manager_run_environment_generators(m);
+        if (q < 0 && r >= 0)
+                r = q;
+
+        /* Find new unit paths */
+        q = manager_run_generators(m);
+        if (q < 0 && r >= 0)
+                r = q;
+
+        lookup_paths_reduce(&m->lookup_paths);
+
+        /* If no unit file, drop-in or generator output changed since the last time all units were loaded,
+         * reloading them would get us the very same units again, so skip the expensive part. */
+        if (!manager_unit_files_changed(m)) {
+                log_debug("No unit files changed since the last reload, not reloading units.");
+
+                assert(m->n_reloading > 0);
                 m->n_reloading--;
+
+                m->send_reloading_done = true;
                 return r;
         }
 
+        q = manager_serialize(m, f, fds, false);
+        if (q < 0) {
+                m->n_reloading--;
+                return q;
+        }
+
         if (fseeko(f, 0, SEEK_SET) < 0) {
                 m->n_reloading--;
                 return -errno;
@@ -3230,28 +3700,13 @@ int manager_reload(Manager *m) {
 
         /* From here on there is no way back. */
         manager_clear_jobs_and_units(m);
-        lookup_paths_flush_generator(&m->lookup_paths);
-        lookup_paths_free(&m->lookup_paths);
         exec_runtime_vacuum(m);
         dynamic_user_vacuum(m, false);
         m->uid_refs = hashmap_free(m->uid_refs);
         m->gid_refs = hashmap_free(m->gid_refs);
 
-        q = lookup_paths_init(&m->lookup_paths, m->unit_file_scope, 0, NULL);
-        if (q < 0 && r >= 0)
-                r = q;
-
-        q = manager_run_environment_generators(m);
-        if (q < 0 && r >= 0)
-                r = q;
-
-        /* Find new unit paths */
-        q = manager_run_generators(m);
-        if (q < 0 && r >= 0)
-                r = q;
-
-        lookup_paths_reduce(&m->lookup_paths);
         manager_build_unit_path_cache(m);
+        manager_update_unit_files_fingerprint(m);
 
         /* First, enumerate what we can from all config files */
         manager_enumerate(m);
@@ -3293,6 +3748,9 @@ int manager_reload(Manager *m) {
 
         exec_runtime_vacuum(m);
 
+        /* All units are loaded now, no need to keep the fragment contents around */
+        m->fragment_cache = unit_fragment_cache_free(m->fragment_cache);
+
         assert(m->n_reloading > 0);
         m->n_reloading--;
 
@@ -3598,9 +4056,16 @@ static int manager_run_generators(Manager *m) {
         argv[3] = m->lookup_paths.generator_late;
         argv[4] = NULL;
 
+        exec_timing_free_many(m->generator_timings, m->n_generator_timings);
+        m->generator_timings = NULL;
+        m->n_generator_timings = 0;
+
+        /* Generators run in parallel. Each one gets a time budget of its own, so that a single broken
+         * generator does not take all the others down with it when the overall timeout hits. */
         RUN_WITH_UMASK(0022)
-                execute_directories((const char* const*) paths, DEFAULT_TIMEOUT_USEC,
-                                    NULL, NULL, (char**) argv);
+                (void) execute_directories_full((const char* const*) paths, DEFAULT_TIMEOUT_USEC, GENERATOR_TIMEOUT_USEC,
+                                                NULL, NULL, (char**) argv,
+                                                &m->generator_timings, &m->n_generator_timings);
 
 finish:
         lookup_paths_trim_generator(&m->lookup_paths);
@@ -3831,6 +4296,58 @@ void manager_set_first_boot(Manager *m, bool b) {
         m->first_boot = b;
 }
 
+usec_t manager_trace_begin(Manager *m) {
+        assert(m);
+
+        /* Returns the timestamp to pass to manager_trace() later on, or 0 if nothing is recorded anymore. Only
+         * the boot is traced, i.e. until the initial transaction is done. */
+
+        if (MANAGER_IS_FINISHED(m) || m->n_trace_events >= MANAGER_TRACE_EVENTS_MAX)
+                return 0;
+
+        return now(CLOCK_MONOTONIC);
+}
+
+void manager_trace_full(Manager *m, ManagerTracePhase phase, const char *unit, usec_t begin, usec_t end) {
+        _cleanup_free_ char *copy = NULL;
+
+        assert(m);
+        assert(phase >= 0);
+        assert(phase < _MANAGER_TRACE_PHASE_MAX);
+
+        if (begin == 0 || end < begin)
+                return;
+
+        if (MANAGER_IS_FINISHED(m) || m->n_trace_events >= MANAGER_TRACE_EVENTS_MAX)
+                return;
+
+        /* The trace is purely informational, hence silently drop the event if we are out of memory */
+        if (unit) {
+                copy = strdup(unit);
+                if (!copy)
+                        return;
+        }
+
+        if (!GREEDY_REALLOC(m->trace_events, m->n_trace_events_allocated, m->n_trace_events + 1))
+                return;
+
+        m->trace_events[m->n_trace_events++] = (ManagerTraceEvent) {
+                .phase = phase,
+                .unit = TAKE_PTR(copy),
+                .begin = begin,
+                .end = end,
+        };
+}
+
+void manager_trace(Manager *m, ManagerTracePhase phase, const char *unit, usec_t begin) {
+        assert(m);
+
+        if (begin == 0)
+                return;
+
+        manager_trace_full(m, phase, unit, begin, now(CLOCK_MONOTONIC));
+}
+
 void manager_disable_confirm_spawn(void) {
         (void) touch("/run/systemd/confirm_spawn_disabled");
 }
@@ -4323,3 +4840,17 @@ static const char *const manager_timestamp_table[_MANAGER_TIMESTAMP_MAX] = {
 };
 
 DEFINE_STRING_TABLE_LOOKUP(manager_timestamp, ManagerTimestamp);
+
+static const char *const manager_trace_phase_table[_MANAGER_TRACE_PHASE_MAX] = {
+        [MANAGER_TRACE_GENERATORS] = "generators",
+        [MANAGER_TRACE_ENUMERATE] = "enumerate",
+        [MANAGER_TRACE_COLDPLUG] = "coldplug",
+        [MANAGER_TRACE_UNIT_LOAD] = "unit-load",
+        [MANAGER_TRACE_TRANSACTION] = "transaction",
+        [MANAGER_TRACE_JOB_WAIT] = "job-wait",
+        [MANAGER_TRACE_JOB_RUN] = "job-run",
+        [MANAGER_TRACE_SPAWN] = "spawn",
+        [MANAGER_TRACE_CGROUP_REALIZE] = "cgroup-realize",
+};
+
+DEFINE_STRING_TABLE_LOOKUP(manager_trace_phase, ManagerTracePhase);
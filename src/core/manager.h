@@ -77,10 +77,37 @@ typedef enum ManagerTimestamp {
         _MANAGER_TIMESTAMP_INVALID = -1,
 } ManagerTimestamp;
 
+/* Phases inside the manager that are recorded while booting, see manager_trace() */
+typedef enum ManagerTracePhase {
+        MANAGER_TRACE_GENERATORS,
+        MANAGER_TRACE_ENUMERATE,
+        MANAGER_TRACE_COLDPLUG,
+        MANAGER_TRACE_UNIT_LOAD,
+        MANAGER_TRACE_TRANSACTION,
+        MANAGER_TRACE_JOB_WAIT,
+        MANAGER_TRACE_JOB_RUN,
+        MANAGER_TRACE_SPAWN,
+        MANAGER_TRACE_CGROUP_REALIZE,
+        _MANAGER_TRACE_PHASE_MAX,
+        _MANAGER_TRACE_PHASE_INVALID = -1,
+} ManagerTracePhase;
+
+typedef struct ManagerTraceEvent {
+        ManagerTracePhase phase;
+        char *unit;
+        usec_t begin;
+        usec_t end;
+} ManagerTraceEvent;
+
+/* Don't let the trace grow without bounds if booting takes forever */
+#define MANAGER_TRACE_EVENTS_MAX 16384U
+
+#include "exec-util.h"
 #include "execute.h"
 #include "job.h"
 #include "path-lookup.h"
 #include "show-status.h"
+#include "state-stream.h"
 #include "unit-name.h"
 
 enum {
@@ -101,6 +128,7 @@ struct Manager {
         /* Active jobs and units */
         Hashmap *units;  /* name string => Unit object n:1 */
         Hashmap *units_by_invocation_id;
+        Hashmap *units_by_dbus_path; /* canonical bus object path => Unit object, a cache for the bus object lookups */
         Hashmap *jobs;   /* job id => Job object 1:1 */
 
         /* To make it easy to iterate through the units of a specific
@@ -120,6 +148,9 @@ struct Manager {
         LIST_HEAD(Unit, dbus_unit_queue);
         LIST_HEAD(Job, dbus_job_queue);
 
+        /* When the first unit was added to dbus_unit_queue, for coalescing unit change signals during boot */
+        usec_t dbus_unit_queue_since;
+
         /* Units to remove */
         LIST_HEAD(Unit, cleanup_queue);
 
@@ -162,6 +193,10 @@ struct Manager {
         int cgroups_agent_fd;
         sd_event_source *cgroups_agent_event_source;
 
+        /* The memfd and mapping of the state stream, if anybody asked for it */
+        int state_stream_fd;
+        StateStreamHeader *state_stream;
+
         int signal_fd;
         sd_event_source *signal_event_source;
 
@@ -180,6 +215,19 @@ struct Manager {
         UnitFileScope unit_file_scope;
         LookupPaths lookup_paths;
         Set *unit_path_cache;
+        Hashmap *fragment_cache;
+
+        /* How long each generator took on the last run */
+        ExecTiming *generator_timings;
+        size_t n_generator_timings;
+
+        /* Trace of the internal phases during boot, in the order they finished */
+        ManagerTraceEvent *trace_events;
+        size_t n_trace_events, n_trace_events_allocated;
+
+        /* Hash over the unit search path, as of the last time all units were loaded, see manager_reload() */
+        uint64_t unit_files_fingerprint;
+        bool unit_files_fingerprint_valid;
 
         char **environment;
 
@@ -197,11 +245,16 @@ struct Manager {
 
         /* Data specific to the mount subsystem */
         struct libmnt_monitor *mount_monitor;
+        Hashmap *mount_info_cache;
         sd_event_source *mount_event_source;
+        sd_event_source *mount_rescan_event_source;
+        usec_t mount_last_rescan;
 
         /* Data specific to the swap filesystem */
         FILE *proc_swaps;
         sd_event_source *swap_event_source;
+        sd_event_source *swap_rescan_event_source;
+        usec_t swap_last_rescan;
         Hashmap *swaps_by_devnode;
 
         /* Data specific to the D-Bus subsystem */
@@ -241,6 +294,12 @@ struct Manager {
         sd_event_source *cgroup_inotify_event_source;
         Hashmap *cgroup_inotify_wd_unit;
 
+        /* The inotify instance shared by path units and PID file watches, and the PathSpecs by watch descriptor */
+        int path_inotify_fd;
+        sd_event_source *path_inotify_event_source;
+        Hashmap *path_inotify_wd_specs;
+        Set *path_inotify_pending;
+
         /* A defer event for handling cgroup empty events and processing them after SIGCHLD in all cases. */
         sd_event_source *cgroup_empty_event_source;
 
@@ -296,6 +355,9 @@ struct Manager {
         uint64_t default_tasks_max;
         usec_t default_timer_accuracy_usec;
 
+        /* For how long accounting values read for bus clients may be served to others again */
+        usec_t accounting_cache_usec;
+
         struct rlimit *rlimit[_RLIMIT_MAX];
 
         /* non-zero if we are reloading or reexecuting, */
@@ -402,12 +464,15 @@ int manager_get_dump_string(Manager *m, char **ret);
 void manager_clear_jobs(Manager *m);
 
 unsigned manager_dispatch_load_queue(Manager *m);
+unsigned manager_dispatch_gc_unit_queue(Manager *m);
+unsigned manager_dispatch_cleanup_queue(Manager *m);
 
 int manager_environment_add(Manager *m, char **minus, char **plus);
 int manager_set_default_rlimits(Manager *m, struct rlimit **default_rlimit);
 
 int manager_loop(Manager *m);
 
+void manager_setup_serialization_stream(FILE *f);
 int manager_open_serialization(Manager *m, FILE **_f);
 
 int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root);
@@ -466,5 +531,12 @@ const char *manager_get_confirm_spawn(Manager *m);
 bool manager_is_confirm_spawn_disabled(Manager *m);
 void manager_disable_confirm_spawn(void);
 
+usec_t manager_trace_begin(Manager *m);
+void manager_trace_full(Manager *m, ManagerTracePhase phase, const char *unit, usec_t begin, usec_t end);
+void manager_trace(Manager *m, ManagerTracePhase phase, const char *unit, usec_t begin);
+
 const char *manager_timestamp_to_string(ManagerTimestamp m) _const_;
 ManagerTimestamp manager_timestamp_from_string(const char *s) _pure_;
+
+const char *manager_trace_phase_to_string(ManagerTracePhase p) _const_;
+ManagerTracePhase manager_trace_phase_from_string(const char *s) _pure_;
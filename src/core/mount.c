@@ -39,6 +39,11 @@
 
 #define RETRY_UMOUNT_MAX 32
 
+/* Don't reparse mountinfo more often than this */
+#define MOUNT_RESCAN_INTERVAL_USEC (50*USEC_PER_MSEC)
+/* The timer slack for the delayed rescan, sd-event's default of 250ms would dwarf the interval */
+#define MOUNT_RESCAN_ACCURACY_USEC (10*USEC_PER_MSEC)
+
 DEFINE_TRIVIAL_CLEANUP_FUNC(struct libmnt_table*, mnt_free_table);
 DEFINE_TRIVIAL_CLEANUP_FUNC(struct libmnt_iter*, mnt_free_iter);
 
@@ -58,6 +63,8 @@ static const UnitActiveState state_translation_table[_MOUNT_STATE_MAX] = {
 
 static int mount_dispatch_timer(sd_event_source *source, usec_t usec, void *userdata);
 static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata);
+static bool mount_rescan_pending(Manager *m);
+static int mount_process_proc_self_mountinfo(Manager *m);
 
 static bool MOUNT_STATE_WITH_PROCESS(MountState state) {
         return IN_SET(state,
@@ -1244,6 +1251,11 @@ static void mount_sigchld_event(Unit *u, pid_t pid, int code, int status) {
         if (pid != m->control_pid)
                 return;
 
+        /* The state handling below relies on mountinfo being up-to-date, hence catch up if we are currently
+         * delaying a rescan. */
+        if (mount_rescan_pending(u->manager))
+                (void) mount_process_proc_self_mountinfo(u->manager);
+
         m->control_pid = 0;
 
         if (is_clean_exit(code, status, EXIT_CLEAN_COMMAND, NULL))
@@ -1528,7 +1540,8 @@ static int mount_setup_unit(
                 const char *where,
                 const char *options,
                 const char *fstype,
-                bool set_flags) {
+                bool set_flags,
+                Unit **ret) {
 
         _cleanup_free_ char *e = NULL;
         MountSetupFlags flags;
@@ -1540,6 +1553,9 @@ static int mount_setup_unit(
         assert(where);
         assert(options);
         assert(fstype);
+        assert(ret);
+
+        *ret = NULL;
 
         /* Ignore API mount points. They should never be referenced in
          * dependencies ever. */
@@ -1584,19 +1600,137 @@ static int mount_setup_unit(
         if (flags.just_changed)
                 unit_add_to_dbus_queue(u);
 
+        *ret = u;
         return 0;
 fail:
         log_warning_errno(r, "Failed to set up mount unit: %m");
         return r;
 }
 
+typedef struct MountInfoEntry {
+        char *source;
+        char *target;
+        char *options;
+        char *fstype;
+        char *what; /* unescaped source */
+        char *unit; /* NULL if the mount point has no unit */
+} MountInfoEntry;
+
+static MountInfoEntry *mount_info_entry_free(MountInfoEntry *e) {
+        if (!e)
+                return NULL;
+
+        free(e->source);
+        free(e->target);
+        free(e->options);
+        free(e->fstype);
+        free(e->what);
+        free(e->unit);
+
+        return mfree(e);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(MountInfoEntry*, mount_info_entry_free);
+
+static Hashmap *mount_info_cache_free(Hashmap *h) {
+        return hashmap_free_with_destructor(h, mount_info_entry_free);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(Hashmap*, mount_info_cache_free);
+
+static bool mount_info_entry_unchanged(
+                const MountInfoEntry *e,
+                const char *source,
+                const char *target,
+                const char *options,
+                const char *fstype) {
+
+        return e &&
+                streq_ptr(e->source, source) &&
+                streq_ptr(e->target, target) &&
+                streq_ptr(e->options, options) &&
+                streq_ptr(e->fstype, fstype);
+}
+
+static bool mount_info_entry_matches_unit(const MountInfoEntry *e, Unit *u) {
+        MountParameters *p;
+
+        assert(e);
+        assert(u);
+
+        /* If several file systems are mounted on top of each other, the unit carries the parameters of the
+         * topmost one. In that case the entries below need to be looked at again, the same as before. */
+
+        p = &MOUNT(u)->parameters_proc_self_mountinfo;
+
+        return MOUNT(u)->from_proc_self_mountinfo &&
+                streq_ptr(p->what, e->what) &&
+                streq_ptr(p->options, e->options) &&
+                streq_ptr(p->fstype, e->fstype);
+}
+
+static int mount_info_cache_add(
+                Hashmap **cache,
+                int id,
+                const char *source,
+                const char *target,
+                const char *options,
+                const char *fstype,
+                const char *what,
+                Unit *u) {
+
+        _cleanup_(mount_info_entry_freep) MountInfoEntry *e = NULL;
+        int r;
+
+        assert(cache);
+
+        r = hashmap_ensure_allocated(cache, NULL);
+        if (r < 0)
+                return r;
+
+        e = new0(MountInfoEntry, 1);
+        if (!e)
+                return -ENOMEM;
+
+        e->source = strdup(source);
+        e->target = strdup(target);
+        e->options = options ? strdup(options) : NULL;
+        e->fstype = fstype ? strdup(fstype) : NULL;
+        e->what = strdup(what);
+        if (!e->source || !e->target || (options && !e->options) || (fstype && !e->fstype) || !e->what)
+                return -ENOMEM;
+
+        if (u) {
+                e->unit = strdup(u->id);
+                if (!e->unit)
+                        return -ENOMEM;
+        }
+
+        r = hashmap_put(*cache, INT_TO_PTR(id), e);
+        if (r < 0)
+                return r;
+
+        e = NULL;
+        return 0;
+}
+
 static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
         _cleanup_(mnt_free_tablep) struct libmnt_table *t = NULL;
         _cleanup_(mnt_free_iterp) struct libmnt_iter *i = NULL;
+        _cleanup_(mount_info_cache_freep) Hashmap *previous = NULL, *cache = NULL;
         int r = 0;
 
         assert(m);
 
+        /* We remember what we saw last time, indexed by mount ID. On hosts with thousands of mounts (think
+         * containers) mountinfo changes all the time, but usually only a few entries at once. For entries that
+         * didn't change since the last time only the flags need to be set, which spares us unescaping them,
+         * looking up and updating their units and devices one by one. When enumerating (i.e. when not setting
+         * the flags) we always start from scratch. */
+        previous = TAKE_PTR(m->mount_info_cache);
+        if (!set_flags)
+                previous = mount_info_cache_free(previous);
+
         t = mnt_new_table();
         i = mnt_new_iter(MNT_ITER_FORWARD);
         if (!t || !i)
@@ -1608,10 +1742,12 @@ static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
 
         r = 0;
         for (;;) {
+                _cleanup_(mount_info_entry_freep) MountInfoEntry *e = NULL;
                 struct libmnt_fs *fs;
                 const char *device, *path, *options, *fstype;
                 _cleanup_free_ char *d = NULL, *p = NULL;
-                int k;
+                Unit *u = NULL;
+                int k, id;
 
                 k = mnt_table_next_fs(t, i, &fs);
                 if (k == 1)
@@ -1623,10 +1759,28 @@ static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
                 path = mnt_fs_get_target(fs);
                 options = mnt_fs_get_options(fs);
                 fstype = mnt_fs_get_fstype(fs);
+                id = mnt_fs_get_id(fs);
 
                 if (!device || !path)
                         continue;
 
+                e = hashmap_remove(previous, INT_TO_PTR(id));
+                if (mount_info_entry_unchanged(e, device, path, options, fstype)) {
+                        if (e->unit)
+                                u = manager_get_unit(m, e->unit);
+
+                        if (!e->unit || (u && mount_info_entry_matches_unit(e, u))) {
+                                if (u)
+                                        MOUNT(u)->is_mounted = true;
+
+                                if (hashmap_ensure_allocated(&cache, NULL) >= 0 &&
+                                    hashmap_put(cache, INT_TO_PTR(id), e) >= 0)
+                                        e = NULL;
+
+                                continue;
+                        }
+                }
+
                 if (cunescape(device, UNESCAPE_RELAX, &d) < 0)
                         return log_oom();
 
@@ -1635,11 +1789,21 @@ static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
 
                 (void) device_found_node(m, d, true, DEVICE_FOUND_MOUNT, set_flags);
 
-                k = mount_setup_unit(m, d, p, options, fstype, set_flags);
-                if (r == 0 && k < 0)
-                        r = k;
+                k = mount_setup_unit(m, d, p, options, fstype, set_flags, &u);
+                if (k < 0) {
+                        if (r == 0)
+                                r = k;
+                        continue;
+                }
+
+                /* If we can't remember this entry, we'll just look at it again next time */
+                if (id > 0)
+                        (void) mount_info_cache_add(&cache, id, device, path, options, fstype, d, u);
         }
 
+        if (r >= 0)
+                m->mount_info_cache = TAKE_PTR(cache);
+
         return r;
 }
 
@@ -1647,9 +1811,12 @@ static void mount_shutdown(Manager *m) {
         assert(m);
 
         m->mount_event_source = sd_event_source_unref(m->mount_event_source);
+        m->mount_rescan_event_source = sd_event_source_unref(m->mount_rescan_event_source);
 
         mnt_unref_monitor(m->mount_monitor);
         m->mount_monitor = NULL;
+
+        m->mount_info_cache = mount_info_cache_free(m->mount_info_cache);
 }
 
 static int mount_get_timeout(Unit *u, usec_t *timeout) {
@@ -1765,43 +1932,24 @@ fail:
         mount_shutdown(m);
 }
 
-static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+static int mount_process_proc_self_mountinfo(Manager *m) {
         _cleanup_set_free_ Set *around = NULL, *gone = NULL;
-        Manager *m = userdata;
         const char *what;
         Iterator i;
         Unit *u;
         int r;
 
         assert(m);
-        assert(revents & EPOLLIN);
 
-        if (fd == mnt_monitor_get_fd(m->mount_monitor)) {
-                bool rescan = false;
-
-                /* Drain all events and verify that the event is valid.
-                 *
-                 * Note that libmount also monitors /run/mount mkdir if the
-                 * directory does not exist yet. The mkdir may generate event
-                 * which is irrelevant for us.
-                 *
-                 * error: r < 0; valid: r == 0, false positive: rc == 1 */
-                do {
-                        r = mnt_monitor_next_change(m->mount_monitor, NULL, NULL);
-                        if (r == 0)
-                                rescan = true;
-                        else if (r < 0)
-                                return log_error_errno(r, "Failed to drain libmount events");
-                } while (r == 0);
+        m->mount_last_rescan = now(CLOCK_MONOTONIC);
 
-                log_debug("libmount event [rescan: %s]", yes_no(rescan));
-                if (!rescan)
-                        return 0;
-        }
+        if (m->mount_rescan_event_source)
+                (void) sd_event_source_set_enabled(m->mount_rescan_event_source, SD_EVENT_OFF);
 
         r = mount_load_proc_self_mountinfo(m, true);
         if (r < 0) {
-                /* Reset flags, just in case, for later calls */
+                /* Reset flags, just in case, for later calls. The cache was dropped, hence the next call will
+                 * look at everything again. */
                 LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
                         Mount *mount = MOUNT(u);
 
@@ -1877,19 +2025,24 @@ static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents,
                         }
                 }
 
-                if (mount_is_mounted(mount) &&
-                    mount->from_proc_self_mountinfo &&
-                    mount->parameters_proc_self_mountinfo.what) {
-
-                        if (set_ensure_allocated(&around, &path_hash_ops) < 0 ||
-                            set_put(around, mount->parameters_proc_self_mountinfo.what) < 0)
-                                log_oom();
-                }
-
                 /* Reset the flags for later calls */
                 mount->is_mounted = mount->just_mounted = mount->just_changed = false;
         }
 
+        /* Usually nothing went away, hence only figure out which devices are still mounted when needed */
+        if (!set_isempty(gone))
+                LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
+                        Mount *mount = MOUNT(u);
+
+                        if (mount->from_proc_self_mountinfo &&
+                            mount->parameters_proc_self_mountinfo.what) {
+
+                                if (set_ensure_allocated(&around, &path_hash_ops) < 0 ||
+                                    set_put(around, mount->parameters_proc_self_mountinfo.what) < 0)
+                                        log_oom();
+                        }
+                }
+
         SET_FOREACH(what, gone, i) {
                 if (set_contains(around, what))
                         continue;
@@ -1901,6 +2054,91 @@ static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents,
         return 0;
 }
 
+static int mount_dispatch_rescan(sd_event_source *source, usec_t usec, void *userdata) {
+        return mount_process_proc_self_mountinfo(userdata);
+}
+
+static bool mount_rescan_pending(Manager *m) {
+        int b;
+
+        assert(m);
+
+        return m->mount_rescan_event_source &&
+                sd_event_source_get_enabled(m->mount_rescan_event_source, &b) >= 0 &&
+                b != SD_EVENT_OFF;
+}
+
+static int mount_schedule_rescan(Manager *m) {
+        usec_t next;
+        int r;
+
+        assert(m);
+
+        /* When many file systems are mounted or unmounted in quick succession (think dozens of containers
+         * starting at once), we get woken up for each of them. Instead of reparsing mountinfo every single
+         * time, process the first change right away, but coalesce the ones following shortly after into one
+         * rescan at the end of the interval. */
+
+        if (mount_rescan_pending(m))
+                return 0;
+
+        next = usec_add(m->mount_last_rescan, MOUNT_RESCAN_INTERVAL_USEC);
+        if (now(CLOCK_MONOTONIC) >= next)
+                return mount_process_proc_self_mountinfo(m);
+
+        if (m->mount_rescan_event_source) {
+                r = sd_event_source_set_time(m->mount_rescan_event_source, next);
+                if (r >= 0)
+                        r = sd_event_source_set_enabled(m->mount_rescan_event_source, SD_EVENT_ONESHOT);
+        } else {
+                r = sd_event_add_time(m->event, &m->mount_rescan_event_source, CLOCK_MONOTONIC, next, MOUNT_RESCAN_ACCURACY_USEC, mount_dispatch_rescan, m);
+                if (r >= 0) {
+                        /* Same priority as the mount monitor itself, see below */
+                        (void) sd_event_source_set_priority(m->mount_rescan_event_source, SD_EVENT_PRIORITY_NORMAL-10);
+                        (void) sd_event_source_set_description(m->mount_rescan_event_source, "mount-rescan");
+                }
+        }
+        if (r < 0) {
+                log_warning_errno(r, "Failed to delay mountinfo rescan, processing it right away: %m");
+                return mount_process_proc_self_mountinfo(m);
+        }
+
+        return 0;
+}
+
+static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        Manager *m = userdata;
+        int r;
+
+        assert(m);
+        assert(revents & EPOLLIN);
+
+        if (fd == mnt_monitor_get_fd(m->mount_monitor)) {
+                bool rescan = false;
+
+                /* Drain all events and verify that the event is valid.
+                 *
+                 * Note that libmount also monitors /run/mount mkdir if the
+                 * directory does not exist yet. The mkdir may generate event
+                 * which is irrelevant for us.
+                 *
+                 * error: r < 0; valid: r == 0, false positive: rc == 1 */
+                do {
+                        r = mnt_monitor_next_change(m->mount_monitor, NULL, NULL);
+                        if (r == 0)
+                                rescan = true;
+                        else if (r < 0)
+                                return log_error_errno(r, "Failed to drain libmount events");
+                } while (r == 0);
+
+                log_debug("libmount event [rescan: %s]", yes_no(rescan));
+                if (!rescan)
+                        return 0;
+        }
+
+        return mount_schedule_rescan(m);
+}
+
 static void mount_reset_failed(Unit *u) {
         Mount *m = MOUNT(u);
 
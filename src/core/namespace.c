@@ -1145,7 +1145,8 @@ int setup_namespace(
                 mount_flags = MS_SHARED;
 
         if (root_image) {
-                dissect_image_flags |= DISSECT_IMAGE_REQUIRE_ROOT;
+                /* Services using the same image with the same root hash get to use the same verity device */
+                dissect_image_flags |= DISSECT_IMAGE_REQUIRE_ROOT|DISSECT_IMAGE_VERITY_SHARE;
 
                 if (protect_system == PROTECT_SYSTEM_STRICT &&
                     protect_home != PROTECT_HOME_NO &&
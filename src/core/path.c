@@ -33,9 +33,118 @@ static const UnitActiveState state_translation_table[_PATH_STATE_MAX] = {
         [PATH_FAILED] = UNIT_FAILED
 };
 
-static int path_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata);
+static int path_dispatch_io(PathSpec *s, bool changed);
 
-int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
+static int path_inotify_dispatch(sd_event_source *source, int fd, uint32_t revents, void *userdata);
+
+static int manager_setup_path_inotify(Manager *m) {
+        int r;
+
+        assert(m);
+
+        if (m->path_inotify_fd >= 0)
+                return 0;
+
+        /* All path units, and the PID file watches of services, share a single inotify instance. A watch
+         * descriptor maps to the set of specs watching it, hence a wakeup only costs as much as the specs
+         * actually affected, and we don't run out of inotify instances on hosts with many path units. */
+
+        m->path_inotify_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+        if (m->path_inotify_fd < 0)
+                return -errno;
+
+        r = sd_event_add_io(m->event, &m->path_inotify_event_source, m->path_inotify_fd, EPOLLIN, path_inotify_dispatch, m);
+        if (r < 0) {
+                m->path_inotify_fd = safe_close(m->path_inotify_fd);
+                return r;
+        }
+
+        (void) sd_event_source_set_description(m->path_inotify_event_source, "path");
+
+        return 0;
+}
+
+static PathSpecWatch *path_spec_find_watch(PathSpec *s, int wd) {
+        size_t i;
+
+        for (i = 0; i < s->n_watches; i++)
+                if (s->watches[i].wd == wd)
+                        return s->watches + i;
+
+        return NULL;
+}
+
+static void path_spec_drop_watch(PathSpec *s, int wd) {
+        PathSpecWatch *w;
+
+        w = path_spec_find_watch(s, wd);
+        if (!w)
+                return;
+
+        *w = s->watches[--s->n_watches];
+}
+
+static int path_spec_add_watch(PathSpec *s, const char *path, uint32_t mask) {
+        Manager *m = s->unit->manager;
+        PathSpecWatch *w;
+        Set *specs;
+        int wd, r;
+
+        if (!GREEDY_REALLOC(s->watches, s->n_watches_allocated, s->n_watches + 1))
+                return -ENOMEM;
+
+        /* Others may be watching the same inode already, hence only ever add to the mask. Which events we
+         * are interested in is tracked per spec, the others are filtered out when dispatching. */
+        wd = inotify_add_watch(m->path_inotify_fd, path, mask|IN_MASK_ADD);
+        if (wd < 0)
+                return -errno;
+
+        w = path_spec_find_watch(s, wd);
+        if (w) {
+                w->mask = mask;
+                return wd;
+        }
+
+        specs = hashmap_get(m->path_inotify_wd_specs, INT_TO_PTR(wd));
+        if (!specs) {
+                r = hashmap_ensure_allocated(&m->path_inotify_wd_specs, NULL);
+                if (r < 0)
+                        goto fail;
+
+                specs = set_new(NULL);
+                if (!specs) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                r = hashmap_put(m->path_inotify_wd_specs, INT_TO_PTR(wd), specs);
+                if (r < 0) {
+                        set_free(specs);
+                        goto fail;
+                }
+        }
+
+        r = set_put(specs, s);
+        if (r < 0)
+                goto fail;
+
+        s->watches[s->n_watches++] = (PathSpecWatch) {
+                .wd = wd,
+                .mask = mask,
+        };
+
+        return wd;
+
+fail:
+        if (set_isempty(specs)) {
+                set_free(hashmap_remove(m->path_inotify_wd_specs, INT_TO_PTR(wd)));
+                (void) inotify_rm_watch(m->path_inotify_fd, wd);
+        }
+
+        return r;
+}
+
+int path_spec_watch(PathSpec *s, PathSpecHandler handler) {
 
         static const int flags_table[_PATH_TYPE_MAX] = {
                 [PATH_EXISTS] = IN_DELETE_SELF|IN_MOVE_SELF|IN_ATTRIB,
@@ -55,17 +164,11 @@ int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
 
         path_spec_unwatch(s);
 
-        s->inotify_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
-        if (s->inotify_fd < 0) {
-                r = -errno;
-                goto fail;
-        }
-
-        r = sd_event_add_io(s->unit->manager->event, &s->event_source, s->inotify_fd, EPOLLIN, handler, s);
+        r = manager_setup_path_inotify(s->unit->manager);
         if (r < 0)
                 goto fail;
 
-        (void) sd_event_source_set_description(s->event_source, "path");
+        s->handler = handler;
 
         /* This function assumes the path was passed through path_kill_slashes()! */
         assert(!strstr(s->path, "//"));
@@ -84,15 +187,15 @@ int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
                 } else
                         flags = flags_table[s->type];
 
-                r = inotify_add_watch(s->inotify_fd, s->path, flags);
+                r = path_spec_add_watch(s, s->path, flags);
                 if (r < 0) {
-                        if (IN_SET(errno, EACCES, ENOENT)) {
+                        if (IN_SET(r, -EACCES, -ENOENT)) {
                                 if (cut)
                                         *cut = tmp;
                                 break;
                         }
 
-                        r = log_warning_errno(errno, "Failed to add watch on %s: %s", s->path, errno == ENOSPC ? "too many watches" : strerror(-r));
+                        r = log_warning_errno(r, "Failed to add watch on %s: %s", s->path, r == -ENOSPC ? "too many watches" : strerror(-r));
                         if (cut)
                                 *cut = tmp;
                         goto fail;
@@ -105,7 +208,7 @@ int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
                                 char tmp2 = *cut2;
                                 *cut2 = '\0';
 
-                                (void) inotify_add_watch(s->inotify_fd, s->path, IN_MOVE_SELF);
+                                (void) path_spec_add_watch(s, s->path, IN_MOVE_SELF);
                                 /* Error is ignored, the worst can happen is we get spurious events. */
 
                                 *cut2 = tmp2;
@@ -125,7 +228,7 @@ int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
         }
 
         if (!exists) {
-                r = log_error_errno(errno, "Failed to add watch on any of the components of %s: %m", s->path);
+                r = log_error_errno(r, "Failed to add watch on any of the components of %s: %m", s->path);
                 /* either EACCESS or ENOENT */
                 goto fail;
         }
@@ -138,38 +241,130 @@ fail:
 }
 
 void path_spec_unwatch(PathSpec *s) {
+        Manager *m;
+        size_t i;
+
         assert(s);
+        assert(s->unit);
+
+        m = s->unit->manager;
+
+        for (i = 0; i < s->n_watches; i++) {
+                int wd = s->watches[i].wd;
+                Set *specs;
+
+                specs = hashmap_get(m->path_inotify_wd_specs, INT_TO_PTR(wd));
+                if (!specs)
+                        continue;
+
+                (void) set_remove(specs, s);
+                if (!set_isempty(specs))
+                        continue;
+
+                set_free(hashmap_remove(m->path_inotify_wd_specs, INT_TO_PTR(wd)));
+                (void) inotify_rm_watch(m->path_inotify_fd, wd);
+        }
+
+        s->n_watches = 0;
+        s->pending_changed = false;
+        (void) set_remove(m->path_inotify_pending, s);
+}
+
+static int path_spec_queue(Manager *m, PathSpec *s, const struct inotify_event *e) {
+        int r;
+
+        r = set_ensure_allocated(&m->path_inotify_pending, NULL);
+        if (r < 0)
+                return r;
+
+        r = set_put(m->path_inotify_pending, s);
+        if (r < 0)
+                return r;
 
-        s->event_source = sd_event_source_unref(s->event_source);
-        s->inotify_fd = safe_close(s->inotify_fd);
+        if (e && IN_SET(s->type, PATH_CHANGED, PATH_MODIFIED) && s->primary_wd == e->wd)
+                s->pending_changed = true;
+
+        return 0;
 }
 
-int path_spec_fd_event(PathSpec *s, uint32_t revents) {
+static int path_inotify_dispatch(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
         union inotify_event_buffer buffer;
         struct inotify_event *e;
+        Manager *m = userdata;
+        PathSpec *s;
+        Iterator i;
         ssize_t l;
-        int r = 0;
+        int r;
+
+        assert(m);
+        assert(fd == m->path_inotify_fd);
 
         if (revents != EPOLLIN) {
                 log_error("Got invalid poll event on inotify.");
-                return -EINVAL;
+                return 0;
         }
 
-        l = read(s->inotify_fd, &buffer, sizeof(buffer));
+        l = read(fd, &buffer, sizeof(buffer));
         if (l < 0) {
                 if (IN_SET(errno, EAGAIN, EINTR))
                         return 0;
 
-                return log_error_errno(errno, "Failed to read inotify event: %m");
+                /* Don't disable the event source, that would leave all path units without notifications */
+                log_warning_errno(errno, "Failed to read inotify event, ignoring: %m");
+                return 0;
         }
 
+        /* First collect the specs affected by this batch of events, and only then dispatch them, as the
+         * handlers set up their watches anew, which changes the wd index under us. */
         FOREACH_INOTIFY_EVENT(e, buffer, l) {
-                if (IN_SET(s->type, PATH_CHANGED, PATH_MODIFIED) &&
-                    s->primary_wd == e->wd)
-                        r = 1;
+                Set *specs, *all;
+                Iterator j;
+
+                if (e->wd < 0) {
+                        /* Queue overflow, everybody has to check again */
+                        HASHMAP_FOREACH(all, m->path_inotify_wd_specs, i)
+                                SET_FOREACH(s, all, j) {
+                                        r = path_spec_queue(m, s, NULL);
+                                        if (r < 0)
+                                                log_oom();
+                                }
+                        continue;
+                }
+
+                specs = hashmap_get(m->path_inotify_wd_specs, INT_TO_PTR(e->wd));
+                if (!specs)
+                        /* Events may still be queued for a watch that was removed since */
+                        continue;
+
+                SET_FOREACH(s, specs, i) {
+                        PathSpecWatch *w;
+
+                        w = path_spec_find_watch(s, e->wd);
+                        if (!w || !(e->mask & (w->mask|IN_IGNORED)))
+                                continue;
+
+                        r = path_spec_queue(m, s, e);
+                        if (r < 0)
+                                log_oom();
+                }
+
+                if (e->mask & IN_IGNORED) {
+                        /* The kernel dropped the watch, the inode is gone. The wd may be reused later on. */
+                        SET_FOREACH(s, specs, i)
+                                path_spec_drop_watch(s, e->wd);
+
+                        set_free(hashmap_remove(m->path_inotify_wd_specs, INT_TO_PTR(e->wd)));
+                }
         }
 
-        return r;
+        while ((s = set_steal_first(m->path_inotify_pending))) {
+                bool changed = s->pending_changed;
+
+                s->pending_changed = false;
+                (void) s->handler(s, changed);
+        }
+
+        return 0;
 }
 
 static bool path_spec_check_good(PathSpec *s, bool initial) {
@@ -231,9 +426,10 @@ static void path_spec_dump(PathSpec *s, FILE *f, const char *prefix) {
 
 void path_spec_done(PathSpec *s) {
         assert(s);
-        assert(s->inotify_fd == -1);
+        assert(!path_spec_is_watched(s));
 
         free(s->path);
+        free(s->watches);
 }
 
 static void path_init(Unit *u) {
@@ -655,14 +851,11 @@ _pure_ static const char *path_sub_state_to_string(Unit *u) {
         return path_state_to_string(PATH(u)->state);
 }
 
-static int path_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
-        PathSpec *s = userdata;
+static int path_dispatch_io(PathSpec *s, bool changed) {
         Path *p;
-        int changed;
 
         assert(s);
         assert(s->unit);
-        assert(fd >= 0);
 
         p = PATH(s->unit);
 
@@ -671,19 +864,6 @@ static int path_dispatch_io(sd_event_source *source, int fd, uint32_t revents, v
 
         /* log_debug("inotify wakeup on %s.", u->id); */
 
-        LIST_FOREACH(spec, s, p->specs)
-                if (path_spec_owns_inotify_fd(s, fd))
-                        break;
-
-        if (!s) {
-                log_error("Got event on unknown fd.");
-                goto fail;
-        }
-
-        changed = path_spec_fd_event(s, revents);
-        if (changed < 0)
-                goto fail;
-
         /* If we are already running, then remember that one event was
          * dispatched so that we restart the service only if something
          * actually changed on disk */
@@ -695,10 +875,6 @@ static int path_dispatch_io(sd_event_source *source, int fd, uint32_t revents, v
                 path_enter_waiting(p, false, true);
 
         return 0;
-
-fail:
-        path_enter_dead(p, PATH_FAILURE_RESOURCES);
-        return 0;
 }
 
 static void path_trigger_notify(Unit *u, Unit *other) {
@@ -724,6 +900,16 @@ static void path_trigger_notify(Unit *u, Unit *other) {
         }
 }
 
+static void path_shutdown(Manager *m) {
+        assert(m);
+
+        /* All specs are gone by now, and so are their watches */
+        m->path_inotify_pending = set_free(m->path_inotify_pending);
+        m->path_inotify_wd_specs = hashmap_free(m->path_inotify_wd_specs);
+        m->path_inotify_event_source = sd_event_source_unref(m->path_inotify_event_source);
+        m->path_inotify_fd = safe_close(m->path_inotify_fd);
+}
+
 static void path_reset_failed(Unit *u) {
         Path *p = PATH(u);
 
@@ -785,6 +971,8 @@ const UnitVTable path_vtable = {
 
         .reset_failed = path_reset_failed,
 
+        .shutdown = path_shutdown,
+
         .bus_vtable = bus_path_vtable,
         .bus_set_property = bus_path_set_property,
 };
@@ -22,29 +22,38 @@ typedef enum PathType {
         _PATH_TYPE_INVALID = -1
 } PathType;
 
+typedef int (*PathSpecHandler)(PathSpec *s, bool changed);
+
+typedef struct PathSpecWatch {
+        int wd;
+        uint32_t mask;
+} PathSpecWatch;
+
 typedef struct PathSpec {
         Unit *unit;
 
         char *path;
 
-        sd_event_source *event_source;
+        /* The inotify instance is shared by all specs of the manager, these are just our watches on it */
+        PathSpecHandler handler;
+        PathSpecWatch *watches;
+        size_t n_watches, n_watches_allocated;
 
         LIST_FIELDS(struct PathSpec, spec);
 
         PathType type;
-        int inotify_fd;
         int primary_wd;
 
         bool previous_exists;
+        bool pending_changed;
 } PathSpec;
 
-int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler);
+int path_spec_watch(PathSpec *s, PathSpecHandler handler);
 void path_spec_unwatch(PathSpec *s);
-int path_spec_fd_event(PathSpec *s, uint32_t events);
 void path_spec_done(PathSpec *s);
 
-static inline bool path_spec_owns_inotify_fd(PathSpec *s, int fd) {
-        return s->inotify_fd == fd;
+static inline bool path_spec_is_watched(PathSpec *s) {
+        return s->n_watches > 0;
 }
 
 typedef enum PathResult {
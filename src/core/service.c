@@ -84,7 +84,7 @@ static const UnitActiveState state_translation_table_idle[_SERVICE_STATE_MAX] =
         [SERVICE_AUTO_RESTART] = UNIT_ACTIVATING
 };
 
-static int service_dispatch_io(sd_event_source *source, int fd, uint32_t events, void *userdata);
+static int service_dispatch_io(PathSpec *p, bool changed);
 static int service_dispatch_timer(sd_event_source *source, usec_t usec, void *userdata);
 static int service_dispatch_watchdog(sd_event_source *source, usec_t usec, void *userdata);
 
@@ -289,6 +289,26 @@ static void service_reset_watchdog(Service *s) {
         service_start_watchdog(s);
 }
 
+static void service_ping_watchdog(Service *s) {
+        int enabled;
+
+        assert(s);
+
+        /* A keep-alive ping only moves the timestamp, but leaves the timer where it is. Once it elapses,
+         * service_dispatch_watchdog() moves it to the deadline the last ping set. Hence a service pinging
+         * several times per watchdog period costs us a single timer update per period, rather than one
+         * per ping. */
+
+        dual_timestamp_get(&s->watchdog_timestamp);
+
+        if (s->watchdog_event_source &&
+            sd_event_source_get_enabled(s->watchdog_event_source, &enabled) >= 0 &&
+            enabled != SD_EVENT_OFF)
+                return;
+
+        service_start_watchdog(s);
+}
+
 static void service_reset_watchdog_timeout(Service *s, usec_t watchdog_override_usec) {
         assert(s);
 
@@ -2892,15 +2912,13 @@ static int service_demand_pid_file(Service *s) {
         /* PATH_CHANGED would not be enough. There are daemons (sendmail) that
          * keep their PID file open all the time. */
         ps->type = PATH_MODIFIED;
-        ps->inotify_fd = -1;
 
         s->pid_file_pathspec = ps;
 
         return service_watch_pid_file(s);
 }
 
-static int service_dispatch_io(sd_event_source *source, int fd, uint32_t events, void *userdata) {
-        PathSpec *p = userdata;
+static int service_dispatch_io(PathSpec *p, bool changed) {
         Service *s;
 
         assert(p);
@@ -2908,16 +2926,11 @@ static int service_dispatch_io(sd_event_source *source, int fd, uint32_t events,
         s = SERVICE(p->unit);
 
         assert(s);
-        assert(fd >= 0);
         assert(IN_SET(s->state, SERVICE_START, SERVICE_START_POST));
-        assert(s->pid_file_pathspec);
-        assert(path_spec_owns_inotify_fd(s->pid_file_pathspec, fd));
+        assert(s->pid_file_pathspec == p);
 
         log_unit_debug(UNIT(s), "inotify event");
 
-        if (path_spec_fd_event(p, events) < 0)
-                goto fail;
-
         if (service_retry_pid_file(s) == 0)
                 return 0;
 
@@ -3409,6 +3422,12 @@ static int service_dispatch_watchdog(sd_event_source *source, usec_t usec, void
 
         watchdog_usec = service_get_watchdog_usec(s);
 
+        /* Pings don't move the timer, see service_ping_watchdog(). Check if we got one since it was set. */
+        if (usec_add(s->watchdog_timestamp.monotonic, watchdog_usec) > usec) {
+                service_start_watchdog(s);
+                return 0;
+        }
+
         if (UNIT(s)->manager->service_watchdogs) {
                 log_unit_error(UNIT(s), "Watchdog timeout (limit %s)!",
                                format_timespan(t, sizeof(t), watchdog_usec, 1));
@@ -3455,6 +3474,20 @@ static bool service_notify_message_authorized(Service *s, pid_t pid, char **tags
         return true;
 }
 
+static void service_notify_watchdog(Unit *u, const struct ucred *ucred) {
+        Service *s = SERVICE(u);
+
+        assert(u);
+        assert(ucred);
+
+        if (!service_notify_message_authorized(s, ucred->pid, NULL, NULL))
+                return;
+
+        log_unit_debug(u, "Got notification message from PID "PID_FMT" (WATCHDOG=1)", ucred->pid);
+
+        service_ping_watchdog(s);
+}
+
 static void service_notify_message(
                 Unit *u,
                 const struct ucred *ucred,
@@ -3594,7 +3627,7 @@ static void service_notify_message(
 
         /* Interpret WATCHDOG= */
         if (strv_find(tags, "WATCHDOG=1"))
-                service_reset_watchdog(s);
+                service_ping_watchdog(s);
 
         e = strv_find_startswith(tags, "WATCHDOG_USEC=");
         if (e) {
@@ -3935,6 +3968,7 @@ const UnitVTable service_vtable = {
 
         .notify_cgroup_empty = service_notify_cgroup_empty_event,
         .notify_message = service_notify_message,
+        .notify_watchdog = service_notify_watchdog,
 
         .main_pid = service_main_pid,
         .control_pid = service_control_pid,
@@ -176,6 +176,7 @@ static void socket_done(Unit *u) {
         s->fdname = mfree(s->fdname);
 
         s->timer_event_source = sd_event_source_unref(s->timer_event_source);
+        s->prepare_event_source = sd_event_source_unref(s->prepare_event_source);
 }
 
 static int socket_arm_timer(Socket *s, usec_t usec) {
@@ -242,6 +243,60 @@ int socket_instantiate_service(Socket *s) {
         return unit_add_two_dependencies(UNIT(s), UNIT_BEFORE, UNIT_TRIGGERS, u, false, UNIT_DEPENDENCY_IMPLICIT);
 }
 
+static int socket_dispatch_prepare(sd_event_source *source, void *userdata) {
+        Socket *s = SOCKET(userdata);
+        int r;
+
+        assert(s);
+        assert(s->prepare_event_source == source);
+
+        if (!IN_SET(s->state, SOCKET_LISTENING, SOCKET_RUNNING) || unit_stop_pending(UNIT(s)))
+                return 0;
+
+        r = socket_instantiate_service(s);
+        if (r < 0)
+                log_unit_debug_errno(UNIT(s), r, "Failed to prepare service for next connection, ignoring: %m");
+
+        return 0;
+}
+
+static void socket_schedule_prepare(Socket *s) {
+        int r;
+
+        assert(s);
+
+        /* For Accept=yes sockets, loading the service instance is a good part of the work for each incoming
+         * connection. Do that ahead of time, once the manager has nothing better to do (in particular after the
+         * run queue has been dispatched and the service for the previous connection has been forked off), so
+         * that the next connection only needs to be handed over. */
+
+        if (!s->accept || UNIT_ISSET(s->service))
+                return;
+
+        if (s->prepare_event_source) {
+                r = sd_event_source_set_enabled(s->prepare_event_source, SD_EVENT_ONESHOT);
+                if (r < 0)
+                        log_unit_debug_errno(UNIT(s), r, "Failed to enable prepare event source, ignoring: %m");
+                return;
+        }
+
+        r = sd_event_add_defer(UNIT(s)->manager->event, &s->prepare_event_source, socket_dispatch_prepare, s);
+        if (r < 0) {
+                log_unit_debug_errno(UNIT(s), r, "Failed to add prepare event source, ignoring: %m");
+                return;
+        }
+
+        r = sd_event_source_set_priority(s->prepare_event_source, SD_EVENT_PRIORITY_IDLE+1);
+        if (r < 0)
+                log_unit_debug_errno(UNIT(s), r, "Failed to set priority of prepare event source, ignoring: %m");
+
+        r = sd_event_source_set_enabled(s->prepare_event_source, SD_EVENT_ONESHOT);
+        if (r < 0)
+                log_unit_debug_errno(UNIT(s), r, "Failed to enable prepare event source, ignoring: %m");
+
+        (void) sd_event_source_set_description(s->prepare_event_source, "socket-prepare");
+}
+
 static bool have_non_accept_socket(Socket *s) {
         SocketPort *p;
 
@@ -330,6 +385,53 @@ _pure_ static bool socket_has_exec(Socket *s) {
         return false;
 }
 
+static int socket_add_reuse_port_listeners(Socket *s) {
+        SocketPort *p;
+
+        assert(s);
+
+        /* With ReusePortListeners= we bind each IP address several times, so that the kernel distributes
+         * incoming connections and datagrams over the listeners, and with that over the processes of the
+         * service handling them. The copies are placed right after the original port, so that they appear
+         * next to each other in $LISTEN_FDS. */
+
+        if (s->reuse_port_listeners <= 1)
+                return 0;
+
+        if (s->reuse_port_listeners > SOCKET_REUSE_PORT_LISTENERS_MAX) {
+                log_unit_error(UNIT(s), "ReusePortListeners= setting too large. Refusing.");
+                return -EINVAL;
+        }
+
+        s->reuse_port = true;
+
+        LIST_FOREACH(port, p, s->ports) {
+                unsigned i;
+
+                if (p->type != SOCKET_SOCKET ||
+                    !IN_SET(socket_address_family(&p->address), AF_INET, AF_INET6))
+                        continue;
+
+                for (i = 1; i < s->reuse_port_listeners; i++) {
+                        SocketPort *c;
+
+                        c = new0(SocketPort, 1);
+                        if (!c)
+                                return -ENOMEM;
+
+                        c->socket = s;
+                        c->type = p->type;
+                        c->address = p->address;
+                        c->fd = -1;
+
+                        LIST_INSERT_AFTER(port, s->ports, p, c);
+                        p = c;
+                }
+        }
+
+        return 0;
+}
+
 static int socket_add_extras(Socket *s) {
         Unit *u = UNIT(s);
         int r;
@@ -372,6 +474,10 @@ static int socket_add_extras(Socket *s) {
                         return r;
         }
 
+        r = socket_add_reuse_port_listeners(s);
+        if (r < 0)
+                return r;
+
         r = socket_add_mount_dependencies(s);
         if (r < 0)
                 return r;
@@ -759,6 +865,11 @@ static void socket_dump(Unit *u, FILE *f, const char *prefix) {
                         "%sReusePort: %s\n",
                          prefix, yes_no(s->reuse_port));
 
+        if (s->reuse_port_listeners > 1)
+                fprintf(f,
+                        "%sReusePortListeners: %u\n",
+                        prefix, s->reuse_port_listeners);
+
         if (s->smack)
                 fprintf(f,
                         "%sSmackLabel: %s\n",
@@ -2116,6 +2227,7 @@ static void socket_enter_listening(Socket *s) {
         }
 
         socket_set_state(s, SOCKET_LISTENING);
+        socket_schedule_prepare(s);
         return;
 
 fail:
@@ -2362,6 +2474,8 @@ static void socket_enter_running(Socket *s, int cfd) {
 
                 /* Notify clients about changed counters */
                 unit_add_to_dbus_queue(UNIT(s));
+
+                socket_schedule_prepare(s);
         }
 
         return;
@@ -2656,7 +2770,9 @@ static int socket_deserialize_item(Unit *u, const char *key, const char *value,
                         log_unit_debug(u, "Failed to parse socket value: %s", value);
                 else
                         LIST_FOREACH(port, p, s->ports)
-                                if (socket_address_is(&p->address, value+skip, type)) {
+                                /* With ReusePortListeners= several ports share the same address */
+                                if (p->fd < 0 &&
+                                    socket_address_is(&p->address, value+skip, type)) {
                                         socket_port_take_fd(p, fds, fd);
                                         break;
                                 }
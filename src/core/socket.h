@@ -49,6 +49,9 @@ typedef enum SocketResult {
         _SOCKET_RESULT_INVALID = -1
 } SocketResult;
 
+/* Upper bound for ReusePortListeners=, each of them is a separate fd we pass */
+#define SOCKET_REUSE_PORT_LISTENERS_MAX 256U
+
 typedef struct SocketPort {
         Socket *socket;
 
@@ -100,6 +103,9 @@ struct Socket {
 
         sd_event_source *timer_event_source;
 
+        /* For Accept=yes sockets, loads the service for the next connection while the manager is idle */
+        sd_event_source *prepare_event_source;
+
         ExecCommand* control_command;
         SocketExecCommand control_command_id;
         pid_t control_pid;
@@ -139,6 +145,7 @@ struct Socket {
         char *bind_to_device;
         char *tcp_congestion;
         bool reuse_port;
+        unsigned reuse_port_listeners;
         long mq_maxmsg;
         long mq_msgsize;
 
@@ -0,0 +1,247 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+***/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fd-util.h"
+#include "job.h"
+#include "manager.h"
+#include "memfd-util.h"
+#include "missing.h"
+#include "state-stream.h"
+#include "string-util.h"
+#include "strxcpyx.h"
+#include "unit.h"
+
+/* Clients can't write to the stream, but don't trust the layout fields of the header regardless: the position
+ * of a record is only ever derived from the compile-time layout. */
+static StateStreamRecord *state_stream_slot(const StateStreamHeader *h, uint64_t seqnum) {
+        return (StateStreamRecord*) ((uint8_t*) h + sizeof(StateStreamHeader)) + (seqnum % STATE_STREAM_RECORDS_MAX);
+}
+
+static bool state_stream_header_valid(const StateStreamHeader *h) {
+        assert(h);
+
+        return memcmp(h->signature, STATE_STREAM_SIGNATURE, sizeof(h->signature)) == 0 &&
+                h->header_size == sizeof(StateStreamHeader) &&
+                h->record_size == sizeof(StateStreamRecord) &&
+                h->n_records == STATE_STREAM_RECORDS_MAX;
+}
+
+void state_stream_init(StateStreamHeader *h) {
+        assert(h);
+
+        memzero(h, sizeof(StateStreamHeader));
+        memcpy(h->signature, STATE_STREAM_SIGNATURE, sizeof(h->signature));
+        h->header_size = sizeof(StateStreamHeader);
+        h->record_size = sizeof(StateStreamRecord);
+        h->n_records = STATE_STREAM_RECORDS_MAX;
+}
+
+void state_stream_append(StateStreamHeader *h, const StateStreamRecord *record) {
+        StateStreamRecord *slot;
+        uint64_t seqnum;
+
+        assert(h);
+        assert(record);
+
+        seqnum = h->seqnum + 1;
+        slot = state_stream_slot(h, seqnum);
+
+        /* Invalidate the slot first, so that readers don't mistake a half-written record for the old one */
+        slot->seqnum = 0;
+        __sync_synchronize();
+
+        memcpy((uint8_t*) slot + sizeof(slot->seqnum),
+               (const uint8_t*) record + sizeof(record->seqnum),
+               sizeof(StateStreamRecord) - sizeof(record->seqnum));
+        __sync_synchronize();
+
+        slot->seqnum = seqnum;
+        __sync_synchronize();
+
+        h->seqnum = seqnum;
+}
+
+int state_stream_read(const StateStreamHeader *h, uint64_t seqnum, StateStreamRecord *ret) {
+        const StateStreamRecord *slot;
+        uint64_t current;
+
+        assert(h);
+        assert(ret);
+
+        /* Returns 0 if the record hasn't been written yet, > 0 if it was copied to ret, and -ESTALE if it was
+         * overwritten already and the reader needs to resync. */
+
+        if (seqnum == 0)
+                return -EINVAL;
+
+        current = h->seqnum;
+        if (seqnum > current)
+                return 0;
+        if (current - seqnum >= STATE_STREAM_RECORDS_MAX)
+                return -ESTALE;
+
+        slot = state_stream_slot(h, seqnum);
+
+        if (slot->seqnum != seqnum)
+                return -ESTALE;
+        __sync_synchronize();
+
+        memcpy(ret, slot, sizeof(StateStreamRecord));
+        __sync_synchronize();
+
+        if (slot->seqnum != seqnum || ret->seqnum != seqnum)
+                return -ESTALE;
+
+        return 1;
+}
+
+int manager_open_state_stream(Manager *m, int *ret_fd) {
+        int fd, r;
+
+        assert(m);
+        assert(ret_fd);
+
+        if (!m->state_stream) {
+                _cleanup_close_ int memfd = -1;
+                void *p;
+
+                memfd = memfd_new_and_map("systemd-state-stream", STATE_STREAM_SIZE, &p);
+                if (memfd < 0)
+                        return memfd;
+
+                state_stream_init(p);
+
+                /* The inode of a memfd is world-writable, and the fds we hand out can be reopened through
+                 * /proc/self/fd/. Make sure that doesn't give write access, nor a way to resize it under
+                 * us. */
+                if (fchmod(memfd, 0444) < 0 ||
+                    fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK|F_SEAL_GROW) < 0) {
+                        r = -errno;
+                        (void) munmap(p, STATE_STREAM_SIZE);
+                        return r;
+                }
+
+                m->state_stream = p;
+                m->state_stream_fd = TAKE_FD(memfd);
+        }
+
+        /* Hand out a read-only fd of the same memfd: clients cannot write to it, nor map it writable or
+         * change its size. */
+        fd = fd_reopen(m->state_stream_fd, O_RDONLY|O_CLOEXEC);
+        if (fd < 0)
+                return fd;
+
+        *ret_fd = fd;
+        return 0;
+}
+
+int manager_attach_state_stream(Manager *m, int fd) {
+        uint64_t size;
+        void *p;
+        int r;
+
+        assert(m);
+        assert(fd >= 0);
+
+        /* Takes over the stream after deserialization, so that clients can continue following it as if
+         * nothing happened. Consumes the fd. */
+
+        r = memfd_get_size(fd, &size);
+        if (r < 0)
+                goto fail;
+        if (size != STATE_STREAM_SIZE) {
+                r = -EBADMSG;
+                goto fail;
+        }
+
+        r = memfd_map(fd, 0, STATE_STREAM_SIZE, &p);
+        if (r < 0)
+                goto fail;
+
+        if (!state_stream_header_valid(p)) {
+                (void) munmap(p, STATE_STREAM_SIZE);
+                r = -EBADMSG;
+                goto fail;
+        }
+
+        manager_close_state_stream(m);
+
+        m->state_stream = p;
+        m->state_stream_fd = fd;
+
+        return 0;
+
+fail:
+        safe_close(fd);
+        return r;
+}
+
+void manager_close_state_stream(Manager *m) {
+        assert(m);
+
+        if (m->state_stream) {
+                (void) munmap(m->state_stream, STATE_STREAM_SIZE);
+                m->state_stream = NULL;
+        }
+
+        m->state_stream_fd = safe_close(m->state_stream_fd);
+}
+
+static void state_stream_record_init(StateStreamRecord *record, StateStreamRecordType type, Unit *u) {
+        dual_timestamp ts;
+
+        dual_timestamp_get(&ts);
+
+        *record = (StateStreamRecord) {
+                .realtime = ts.realtime,
+                .monotonic = ts.monotonic,
+                .type = type,
+        };
+
+        strscpy(record->unit, sizeof(record->unit), u->id);
+        strscpy(record->active_state, sizeof(record->active_state), unit_active_state_to_string(unit_active_state(u)));
+        strscpy(record->sub_state, sizeof(record->sub_state), strempty(unit_sub_state_to_string(u)));
+}
+
+void manager_state_stream_add_unit(Manager *m, Unit *u) {
+        StateStreamRecord record;
+
+        assert(m);
+        assert(u);
+
+        /* Nobody asked for the stream so far? Then there's nothing to do */
+        if (!m->state_stream)
+                return;
+
+        state_stream_record_init(&record, STATE_STREAM_UNIT, u);
+        state_stream_append(m->state_stream, &record);
+}
+
+void manager_state_stream_add_job(Manager *m, Job *j, StateStreamRecordType type) {
+        StateStreamRecord record;
+
+        assert(m);
+        assert(j);
+        assert(IN_SET(type, STATE_STREAM_JOB_NEW, STATE_STREAM_JOB_CHANGED, STATE_STREAM_JOB_REMOVED));
+
+        if (!m->state_stream)
+                return;
+
+        state_stream_record_init(&record, type, j->unit);
+
+        record.job_id = j->id;
+        strscpy(record.job_type, sizeof(record.job_type), job_type_to_string(j->type));
+        strscpy(record.job_state, sizeof(record.job_state), job_state_to_string(j->state));
+        if (type == STATE_STREAM_JOB_REMOVED)
+                strscpy(record.job_result, sizeof(record.job_result), strempty(job_result_to_string(j->result)));
+
+        state_stream_append(m->state_stream, &record);
+}
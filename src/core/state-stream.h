@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+/***
+  This file is part of systemd.
+***/
+
+#include <stdint.h>
+
+#include "macro.h"
+
+typedef struct Job Job;
+typedef struct Manager Manager;
+typedef struct Unit Unit;
+
+/* The state stream is a ring buffer of unit and job state changes in a memfd, which clients may acquire
+ * read-only with the OpenStateStream() bus call and follow without any further IPC. The header is followed by
+ * n_records fixed-size records, record number seqnum lives at index seqnum % n_records. Sequence numbers start
+ * at 1 and increase monotonically.
+ *
+ * A record is updated by first setting its seqnum to 0, then writing the payload, and finally setting its
+ * seqnum and the header's seqnum to the new value. A reader hence copies the record, and checks that its
+ * seqnum matches before and after the copy. If it doesn't, or if the writer is more than n_records ahead, the
+ * reader fell behind and needs to resync, e.g. with ListUnits() and ListJobs(), continuing from the header's
+ * current seqnum. All strings are NUL-terminated. */
+
+#define STATE_STREAM_SIGNATURE ((const char[8]) { 'S', 'D', 'S', 'T', 'A', 'T', 'E', '1' })
+#define STATE_STREAM_RECORDS_MAX 4096U
+
+typedef enum StateStreamRecordType {
+        STATE_STREAM_UNIT = 1,
+        STATE_STREAM_JOB_NEW,
+        STATE_STREAM_JOB_CHANGED,
+        STATE_STREAM_JOB_REMOVED,
+} StateStreamRecordType;
+
+typedef struct StateStreamHeader {
+        uint8_t signature[8];
+        uint64_t header_size;
+        uint64_t record_size;
+        uint64_t n_records;
+        uint64_t seqnum;
+        uint8_t reserved[24];
+} StateStreamHeader;
+
+typedef struct StateStreamRecord {
+        uint64_t seqnum;
+        uint64_t realtime;
+        uint64_t monotonic;
+        uint32_t type;
+        uint32_t job_id;
+        char unit[264];
+        char active_state[16];
+        char sub_state[32];
+        char job_type[24];
+        char job_state[16];
+        char job_result[16];
+} StateStreamRecord;
+
+assert_cc(sizeof(StateStreamHeader) == 64);
+assert_cc(sizeof(StateStreamRecord) == 400);
+
+#define STATE_STREAM_SIZE (sizeof(StateStreamHeader) + STATE_STREAM_RECORDS_MAX * sizeof(StateStreamRecord))
+
+void state_stream_init(StateStreamHeader *h);
+void state_stream_append(StateStreamHeader *h, const StateStreamRecord *record);
+int state_stream_read(const StateStreamHeader *h, uint64_t seqnum, StateStreamRecord *ret);
+
+int manager_open_state_stream(Manager *m, int *ret_fd);
+int manager_attach_state_stream(Manager *m, int fd);
+void manager_close_state_stream(Manager *m);
+
+void manager_state_stream_add_unit(Manager *m, Unit *u);
+void manager_state_stream_add_job(Manager *m, Job *j, StateStreamRecordType type);
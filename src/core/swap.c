@@ -32,6 +32,11 @@
 #include "unit.h"
 #include "virt.h"
 
+/* Don't reread /proc/swaps more often than this */
+#define SWAP_RESCAN_INTERVAL_USEC (50*USEC_PER_MSEC)
+/* The timer slack for the delayed rescan, sd-event's default of 250ms would dwarf the interval */
+#define SWAP_RESCAN_ACCURACY_USEC (10*USEC_PER_MSEC)
+
 static const UnitActiveState state_translation_table[_SWAP_STATE_MAX] = {
         [SWAP_DEAD] = UNIT_INACTIVE,
         [SWAP_ACTIVATING] = UNIT_ACTIVATING,
@@ -45,6 +50,8 @@ static const UnitActiveState state_translation_table[_SWAP_STATE_MAX] = {
 
 static int swap_dispatch_timer(sd_event_source *source, usec_t usec, void *userdata);
 static int swap_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata);
+static bool swap_rescan_pending(Manager *m);
+static int swap_process_proc_swaps(Manager *m);
 
 static bool SWAP_STATE_WITH_PROCESS(SwapState state) {
         return IN_SET(state,
@@ -987,6 +994,10 @@ static void swap_sigchld_event(Unit *u, pid_t pid, int code, int status) {
         if (pid != s->control_pid)
                 return;
 
+        /* Make sure we look at the current /proc/swaps, in case we are delaying a rescan */
+        if (swap_rescan_pending(u->manager))
+                (void) swap_process_proc_swaps(u->manager);
+
         s->control_pid = 0;
 
         if (is_clean_exit(code, status, EXIT_CLEAN_COMMAND, NULL))
@@ -1122,13 +1133,16 @@ static int swap_load_proc_swaps(Manager *m, bool set_flags) {
         return r;
 }
 
-static int swap_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
-        Manager *m = userdata;
+static int swap_process_proc_swaps(Manager *m) {
         Unit *u;
         int r;
 
         assert(m);
-        assert(revents & EPOLLPRI);
+
+        m->swap_last_rescan = now(CLOCK_MONOTONIC);
+
+        if (m->swap_rescan_event_source)
+                (void) sd_event_source_set_enabled(m->swap_rescan_event_source, SD_EVENT_OFF);
 
         r = swap_load_proc_swaps(m, true);
         if (r < 0) {
@@ -1202,6 +1216,58 @@ static int swap_dispatch_io(sd_event_source *source, int fd, uint32_t revents, v
         return 1;
 }
 
+static int swap_dispatch_rescan(sd_event_source *source, usec_t usec, void *userdata) {
+        return swap_process_proc_swaps(userdata);
+}
+
+static bool swap_rescan_pending(Manager *m) {
+        int b;
+
+        assert(m);
+
+        return m->swap_rescan_event_source &&
+                sd_event_source_get_enabled(m->swap_rescan_event_source, &b) >= 0 &&
+                b != SD_EVENT_OFF;
+}
+
+static int swap_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        Manager *m = userdata;
+        usec_t next;
+        int r;
+
+        assert(m);
+        assert(revents & EPOLLPRI);
+
+        /* Like for mountinfo, process the first change right away, but coalesce bursts of changes following
+         * shortly after into one rescan. Polling /proc/swaps acknowledges the change, hence we are not woken
+         * up again in the meantime. */
+
+        if (swap_rescan_pending(m))
+                return 0;
+
+        next = usec_add(m->swap_last_rescan, SWAP_RESCAN_INTERVAL_USEC);
+        if (now(CLOCK_MONOTONIC) >= next)
+                return swap_process_proc_swaps(m);
+
+        if (m->swap_rescan_event_source) {
+                r = sd_event_source_set_time(m->swap_rescan_event_source, next);
+                if (r >= 0)
+                        r = sd_event_source_set_enabled(m->swap_rescan_event_source, SD_EVENT_ONESHOT);
+        } else {
+                r = sd_event_add_time(m->event, &m->swap_rescan_event_source, CLOCK_MONOTONIC, next, SWAP_RESCAN_ACCURACY_USEC, swap_dispatch_rescan, m);
+                if (r >= 0) {
+                        (void) sd_event_source_set_priority(m->swap_rescan_event_source, SD_EVENT_PRIORITY_NORMAL-10);
+                        (void) sd_event_source_set_description(m->swap_rescan_event_source, "swap-rescan");
+                }
+        }
+        if (r < 0) {
+                log_warning_errno(r, "Failed to delay /proc/swaps rescan, processing it right away: %m");
+                return swap_process_proc_swaps(m);
+        }
+
+        return 0;
+}
+
 static Unit *swap_following(Unit *u) {
         Swap *s = SWAP(u);
         Swap *other, *first = NULL;
@@ -1270,6 +1336,7 @@ static void swap_shutdown(Manager *m) {
         assert(m);
 
         m->swap_event_source = sd_event_source_unref(m->swap_event_source);
+        m->swap_rescan_event_source = sd_event_source_unref(m->swap_rescan_event_source);
 
         m->proc_swaps = safe_fclose(m->proc_swaps);
 
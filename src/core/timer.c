@@ -378,9 +378,18 @@ static void timer_enter_waiting(Timer *t, bool initial) {
                                         b = ts.realtime;
                         }
 
-                        r = calendar_spec_next_usec(v->calendar_spec, b, &v->next_elapse);
-                        if (r < 0)
-                                continue;
+                        /* We are called on every state change of the triggered unit, while the base usually
+                         * only changes when we elapse. Calculating the next elapse from a calendar spec is
+                         * expensive, hence reuse the previous result if the base didn't change. */
+                        if (v->next_elapse_from == 0 || v->next_elapse_from != b) {
+                                r = calendar_spec_next_usec(v->calendar_spec, b, &v->next_elapse);
+                                if (r < 0) {
+                                        v->next_elapse_from = 0;
+                                        continue;
+                                }
+
+                                v->next_elapse_from = b;
+                        }
 
                         if (!found_realtime)
                                 t->next_elapse_realtime = v->next_elapse;
@@ -800,10 +809,15 @@ static void timer_reset_failed(Unit *u) {
 
 static void timer_time_change(Unit *u) {
         Timer *t = TIMER(u);
+        TimerValue *v;
         usec_t ts;
 
         assert(u);
 
+        /* The time zone might have changed along with the clock, hence don't trust any calendar results */
+        LIST_FOREACH(value, v, t->values)
+                v->next_elapse_from = 0;
+
         if (t->state != TIMER_WAITING)
                 return;
 
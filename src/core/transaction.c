@@ -293,8 +293,12 @@ static void transaction_drop_redundant(Transaction *tr) {
 
         assert(tr);
 
-rescan:
+        /* Whether a job is redundant only depends on the job itself and the
+         * state of its unit, so a single pass suffices. Deleting jobs without
+         * their dependencies only ever touches the entry of the current unit,
+         * which is safe while iterating. */
         HASHMAP_FOREACH(j, tr->jobs, i) {
+                Unit *u = j->unit;
                 Job *k;
 
                 LIST_FOREACH(transaction, k, j) {
@@ -306,8 +310,8 @@ rescan:
                 }
 
                 /* log_debug("Found redundant job %s/%s, dropping.", j->unit->id, job_type_to_string(j->type)); */
-                transaction_delete_job(tr, j, false);
-                goto rescan;
+                while ((k = hashmap_get(tr->jobs, u)))
+                        transaction_delete_job(tr, k, false);
         next_unit:;
         }
 }
@@ -490,27 +494,36 @@ static int transaction_verify_order(Transaction *tr, unsigned *generation, sd_bu
 }
 
 static void transaction_collect_garbage(Transaction *tr) {
-        Iterator i;
-        Job *j;
+        bool again;
 
         assert(tr);
 
         /* Drop jobs that are not required by any other job */
 
-rescan:
-        HASHMAP_FOREACH(j, tr->jobs, i) {
-                if (tr->anchor_job == j || j->object_list) {
-                        /* log_debug("Keeping job %s/%s because of %s/%s", */
-                        /*           j->unit->id, job_type_to_string(j->type), */
-                        /*           j->object_list->subject ? j->object_list->subject->unit->id : "root", */
-                        /*           j->object_list->subject ? job_type_to_string(j->object_list->subject->type) : "root"); */
-                        continue;
-                }
+        do {
+                Iterator i;
+                Job *j;
+
+                again = false;
+
+                /* A job without any object has nothing to delete along with it,
+                 * hence this only removes the current entry and we can keep on
+                 * iterating. Jobs only it required become garbage now, and are
+                 * caught by the next pass. */
+                HASHMAP_FOREACH(j, tr->jobs, i) {
+                        if (tr->anchor_job == j || j->object_list) {
+                                /* log_debug("Keeping job %s/%s because of %s/%s", */
+                                /*           j->unit->id, job_type_to_string(j->type), */
+                                /*           j->object_list->subject ? j->object_list->subject->unit->id : "root", */
+                                /*           j->object_list->subject ? job_type_to_string(j->object_list->subject->type) : "root"); */
+                                continue;
+                        }
 
-                /* log_debug("Garbage collecting job %s/%s", j->unit->id, job_type_to_string(j->type)); */
-                transaction_delete_job(tr, j, true);
-                goto rescan;
-        }
+                        /* log_debug("Garbage collecting job %s/%s", j->unit->id, job_type_to_string(j->type)); */
+                        transaction_delete_job(tr, j, true);
+                        again = true;
+                }
+        } while (again);
 }
 
 static int transaction_is_destructive(Transaction *tr, JobMode mode, sd_bus_error *e) {
@@ -659,9 +672,52 @@ rollback:
         return r;
 }
 
+typedef enum TransactionPhase {
+        TRANSACTION_PHASE_ANCHOR,
+        TRANSACTION_PHASE_MINIMIZE,
+        TRANSACTION_PHASE_REDUNDANT,
+        TRANSACTION_PHASE_GC,
+        TRANSACTION_PHASE_ORDER,
+        TRANSACTION_PHASE_MERGE,
+        TRANSACTION_PHASE_APPLY,
+        _TRANSACTION_PHASE_MAX,
+} TransactionPhase;
+
+static void transaction_phase_end(usec_t phases[], TransactionPhase p, usec_t *start) {
+        usec_t n;
+
+        /* Accounts the time since *start to phase p, and starts the next phase */
+
+        n = now(CLOCK_MONOTONIC);
+        phases[p] += n - *start;
+        *start = n;
+}
+
+static void transaction_log_phases(Job *anchor, unsigned n_units, const usec_t phases[]) {
+        char t[_TRANSACTION_PHASE_MAX][FORMAT_TIMESPAN_MAX];
+        TransactionPhase p;
+
+        if (log_get_max_level() < LOG_DEBUG)
+                return;
+
+        for (p = 0; p < _TRANSACTION_PHASE_MAX; p++)
+                format_timespan(t[p], sizeof(t[p]), phases[p], 1);
+
+        log_unit_debug(anchor->unit,
+                       "Transaction for %s/%s with jobs for %u units: anchor %s, minimize %s, redundant %s, "
+                       "gc %s, order %s, merge %s, apply %s.",
+                       anchor->unit->id, job_type_to_string(anchor->type), n_units,
+                       t[TRANSACTION_PHASE_ANCHOR], t[TRANSACTION_PHASE_MINIMIZE],
+                       t[TRANSACTION_PHASE_REDUNDANT], t[TRANSACTION_PHASE_GC],
+                       t[TRANSACTION_PHASE_ORDER], t[TRANSACTION_PHASE_MERGE],
+                       t[TRANSACTION_PHASE_APPLY]);
+}
+
 int transaction_activate(Transaction *tr, Manager *m, JobMode mode, sd_bus_error *e) {
+        usec_t phases[_TRANSACTION_PHASE_MAX] = {}, start;
         Iterator i;
         Job *j;
+        unsigned n_units;
         int r;
         unsigned generation = 1;
 
@@ -670,6 +726,9 @@ int transaction_activate(Transaction *tr, Manager *m, JobMode mode, sd_bus_error
         /* This applies the changes recorded in tr->jobs to
          * the actual list of jobs, if possible. */
 
+        n_units = hashmap_size(tr->jobs);
+        start = now(CLOCK_MONOTONIC);
+
         /* Reset the generation counter of all installed jobs. The detection of cycles
          * looks at installed jobs. If they had a non-zero generation from some previous
          * walk of the graph, the algorithm would break. */
@@ -678,25 +737,30 @@ int transaction_activate(Transaction *tr, Manager *m, JobMode mode, sd_bus_error
 
         /* First step: figure out which jobs matter */
         transaction_find_jobs_that_matter_to_anchor(tr->anchor_job, generation++);
+        transaction_phase_end(phases, TRANSACTION_PHASE_ANCHOR, &start);
 
         /* Second step: Try not to stop any running services if
          * we don't have to. Don't try to reverse running
          * jobs if we don't have to. */
         if (mode == JOB_FAIL)
                 transaction_minimize_impact(tr);
+        transaction_phase_end(phases, TRANSACTION_PHASE_MINIMIZE, &start);
 
         /* Third step: Drop redundant jobs */
         transaction_drop_redundant(tr);
+        transaction_phase_end(phases, TRANSACTION_PHASE_REDUNDANT, &start);
 
         for (;;) {
                 /* Fourth step: Let's remove unneeded jobs that might
                  * be lurking. */
                 if (mode != JOB_ISOLATE)
                         transaction_collect_garbage(tr);
+                transaction_phase_end(phases, TRANSACTION_PHASE_GC, &start);
 
                 /* Fifth step: verify order makes sense and correct
                  * cycles if necessary and possible */
                 r = transaction_verify_order(tr, &generation, e);
+                transaction_phase_end(phases, TRANSACTION_PHASE_ORDER, &start);
                 if (r >= 0)
                         break;
 
@@ -714,6 +778,7 @@ int transaction_activate(Transaction *tr, Manager *m, JobMode mode, sd_bus_error
                  * necessary and possible, merge entries we can
                  * merge */
                 r = transaction_merge_jobs(tr, e);
+                transaction_phase_end(phases, TRANSACTION_PHASE_MERGE, &start);
                 if (r >= 0)
                         break;
 
@@ -726,6 +791,7 @@ int transaction_activate(Transaction *tr, Manager *m, JobMode mode, sd_bus_error
                  * collect its dependencies. */
                 if (mode != JOB_ISOLATE)
                         transaction_collect_garbage(tr);
+                transaction_phase_end(phases, TRANSACTION_PHASE_GC, &start);
 
                 /* Let's see if the resulting transaction still has
                  * unmergeable entries ... */
@@ -733,6 +799,7 @@ int transaction_activate(Transaction *tr, Manager *m, JobMode mode, sd_bus_error
 
         /* Eights step: Drop redundant jobs again, if the merging now allows us to drop more. */
         transaction_drop_redundant(tr);
+        transaction_phase_end(phases, TRANSACTION_PHASE_REDUNDANT, &start);
 
         /* Ninth step: check whether we can actually apply this */
         r = transaction_is_destructive(tr, mode, e);
@@ -745,6 +812,10 @@ int transaction_activate(Transaction *tr, Manager *m, JobMode mode, sd_bus_error
         r = transaction_apply(tr, m, mode);
         if (r < 0)
                 return log_warning_errno(r, "Failed to apply transaction: %m");
+        transaction_phase_end(phases, TRANSACTION_PHASE_APPLY, &start);
+
+        /* If the anchor job was merged into an installed one, tr->anchor_job points to that one now */
+        transaction_log_phases(tr->anchor_job, n_units, phases);
 
         assert(hashmap_isempty(tr->jobs));
 
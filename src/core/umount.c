@@ -11,6 +11,7 @@
 #include <string.h>
 #include <sys/mount.h>
 #include <sys/swap.h>
+#include <sys/wait.h>
 
 /* This needs to be after sys/mount.h :( */
 #include <libmount.h>
@@ -389,19 +390,23 @@ static bool nonunmountable_path(const char *path) {
                 || path_startswith(path, "/run/initramfs");
 }
 
-static int remount_with_timeout(MountPoint *m, int umount_log_level) {
+typedef struct UmountJob {
+        MountPoint *mount_point;
         pid_t pid;
         int r;
+} UmountJob;
 
-        BLOCK_SIGNALS(SIGCHLD);
+static int remount_fork(MountPoint *m, int umount_log_level, pid_t *ret_pid) {
+        int r;
 
         assert(m);
+        assert(ret_pid);
 
         /* Due to the possiblity of a remount operation hanging, we
          * fork a child process and set a timeout. If the timeout
          * lapses, the assumption is that that particular remount
          * failed. */
-        r = safe_fork("(sd-remount)", FORK_RESET_SIGNALS|FORK_CLOSE_ALL_FDS|FORK_LOG|FORK_REOPEN_LOG, &pid);
+        r = safe_fork("(sd-remount)", FORK_RESET_SIGNALS|FORK_CLOSE_ALL_FDS|FORK_LOG|FORK_REOPEN_LOG, ret_pid);
         if (r < 0)
                 return r;
         if (r == 0) {
@@ -415,31 +420,20 @@ static int remount_with_timeout(MountPoint *m, int umount_log_level) {
                 _exit(r < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
         }
 
-        r = wait_for_terminate_with_timeout(pid, DEFAULT_TIMEOUT_USEC);
-        if (r == -ETIMEDOUT) {
-                log_error_errno(r, "Remounting '%s' timed out, issuing SIGKILL to PID " PID_FMT ".", m->path, pid);
-                (void) kill(pid, SIGKILL);
-        } else if (r == -EPROTO)
-                log_debug_errno(r, "Remounting '%s' failed abnormally, child process " PID_FMT " aborted or exited non-zero.", m->path, pid);
-        else if (r < 0)
-                log_error_errno(r, "Remounting '%s' failed unexpectedly, couldn't wait for child process " PID_FMT ": %m", m->path, pid);
-
-        return r;
+        return 0;
 }
 
-static int umount_with_timeout(MountPoint *m, int umount_log_level) {
-        pid_t pid;
+static int umount_fork(MountPoint *m, int umount_log_level, pid_t *ret_pid) {
         int r;
 
-        BLOCK_SIGNALS(SIGCHLD);
-
         assert(m);
+        assert(ret_pid);
 
         /* Due to the possiblity of a umount operation hanging, we
          * fork a child process and set a timeout. If the timeout
          * lapses, the assumption is that that particular umount
          * failed. */
-        r = safe_fork("(sd-umount)", FORK_RESET_SIGNALS|FORK_CLOSE_ALL_FDS|FORK_LOG|FORK_REOPEN_LOG, &pid);
+        r = safe_fork("(sd-umount)", FORK_RESET_SIGNALS|FORK_CLOSE_ALL_FDS|FORK_LOG|FORK_REOPEN_LOG, ret_pid);
         if (r < 0)
                 return r;
         if (r == 0) {
@@ -459,67 +453,141 @@ static int umount_with_timeout(MountPoint *m, int umount_log_level) {
                 _exit(r < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
         }
 
-        r = wait_for_terminate_with_timeout(pid, DEFAULT_TIMEOUT_USEC);
-        if (r == -ETIMEDOUT) {
-                log_error_errno(r, "Unmounting '%s' timed out, issuing SIGKILL to PID " PID_FMT ".", m->path, pid);
-                (void) kill(pid, SIGKILL);
-        } else if (r == -EPROTO)
-                log_debug_errno(r, "Unmounting '%s' failed abnormally, child process " PID_FMT " aborted or exited non-zero.", m->path, pid);
-        else if (r < 0)
-                log_error_errno(r, "Unmounting '%s' failed unexpectedly, couldn't wait for child process " PID_FMT ": %m", m->path, pid);
+        return 0;
+}
 
-        return r;
+static void umount_jobs_wait(UmountJob *jobs, size_t n_jobs, const char *what) {
+        sigset_t mask;
+        usec_t until;
+        size_t i;
+
+        assert(jobs || n_jobs == 0);
+        assert(what);
+
+        /* Waits for all children forked for the jobs at once. They were all started at the same time, hence
+         * sharing one deadline gives each of them the full timeout, while the whole batch takes no longer
+         * than a single one of them would. SIGCHLD must be blocked by the caller. */
+
+        assert_se(sigemptyset(&mask) == 0);
+        assert_se(sigaddset(&mask, SIGCHLD) == 0);
+
+        until = now(CLOCK_MONOTONIC) + DEFAULT_TIMEOUT_USEC;
+        for (;;) {
+                size_t n_pending = 0;
+                struct timespec ts;
+                usec_t n;
+
+                for (i = 0; i < n_jobs; i++) {
+                        siginfo_t status = {};
+
+                        if (jobs[i].pid <= 0)
+                                continue;
+
+                        if (waitid(P_PID, jobs[i].pid, &status, WEXITED|WNOHANG) < 0) {
+                                jobs[i].r = log_error_errno(errno, "%s '%s' failed unexpectedly, couldn't wait for child process " PID_FMT ": %m",
+                                                            what, jobs[i].mount_point->path, jobs[i].pid);
+                                jobs[i].pid = 0;
+                                continue;
+                        }
+
+                        if (status.si_pid != jobs[i].pid) {
+                                n_pending++;
+                                continue;
+                        }
+
+                        if (status.si_code == CLD_EXITED && status.si_status == 0)
+                                jobs[i].r = 0;
+                        else
+                                jobs[i].r = log_debug_errno(EPROTO, "%s '%s' failed abnormally, child process " PID_FMT " aborted or exited non-zero.",
+                                                            what, jobs[i].mount_point->path, jobs[i].pid);
+                        jobs[i].pid = 0;
+                }
+
+                if (n_pending == 0)
+                        return;
+
+                n = now(CLOCK_MONOTONIC);
+                if (n >= until)
+                        break;
+
+                if (sigtimedwait(&mask, NULL, timespec_store(&ts, until - n)) < 0 &&
+                    !IN_SET(errno, EAGAIN, EINTR)) {
+                        log_error_errno(errno, "Failed to wait for SIGCHLD: %m");
+                        break;
+                }
+        }
+
+        for (i = 0; i < n_jobs; i++) {
+                if (jobs[i].pid <= 0)
+                        continue;
+
+                jobs[i].r = log_error_errno(ETIMEDOUT, "%s '%s' timed out, issuing SIGKILL to PID " PID_FMT ".",
+                                            what, jobs[i].mount_point->path, jobs[i].pid);
+                (void) kill(jobs[i].pid, SIGKILL);
+                jobs[i].pid = 0;
+        }
 }
 
-/* This includes remounting readonly, which changes the kernel mount options.
- * Therefore the list passed to this function is invalidated, and should not be reused. */
-static int mount_points_list_umount(MountPoint **head, bool *changed, int umount_log_level) {
-        MountPoint *m;
+static int umount_jobs_run(UmountJob *jobs, size_t n_jobs, bool *changed, int umount_log_level) {
         int n_failed = 0;
+        size_t i;
 
-        assert(head);
+        BLOCK_SIGNALS(SIGCHLD);
+
+        assert(jobs || n_jobs == 0);
         assert(changed);
 
-        LIST_FOREACH(mount_point, m, *head) {
-                if (m->try_remount_ro) {
-                        /* We always try to remount directories
-                         * read-only first, before we go on and umount
-                         * them.
-                         *
-                         * Mount points can be stacked. If a mount
-                         * point is stacked below / or /usr, we
-                         * cannot umount or remount it directly,
-                         * since there is no way to refer to the
-                         * underlying mount. There's nothing we can do
-                         * about it for the general case, but we can
-                         * do something about it if it is aliased
-                         * somehwere else via a bind mount. If we
-                         * explicitly remount the super block of that
-                         * alias read-only we hence should be
-                         * relatively safe regarding keeping a dirty fs
-                         * we cannot otherwise see.
-                         *
-                         * Since the remount can hang in the instance of
-                         * remote filesystems, we remount asynchronously
-                         * and skip the subsequent umount if it fails. */
-                        if (remount_with_timeout(m, umount_log_level) < 0) {
-                                /* Remount failed, but try unmounting anyway,
-                                 * unless this is a mount point we want to skip. */
-                                if (nonunmountable_path(m->path)) {
-                                        n_failed++;
-                                        continue;
-                                }
-                        }
-                }
+        /* We always try to remount directories read-only first,
+         * before we go on and umount them.
+         *
+         * Mount points can be stacked. If a mount point is stacked
+         * below / or /usr, we cannot umount or remount it directly,
+         * since there is no way to refer to the underlying mount.
+         * There's nothing we can do about it for the general case,
+         * but we can do something about it if it is aliased
+         * somehwere else via a bind mount. If we explicitly remount
+         * the super block of that alias read-only we hence should be
+         * relatively safe regarding keeping a dirty fs we cannot
+         * otherwise see.
+         *
+         * Since the remount can hang in the instance of remote
+         * filesystems, we remount asynchronously and skip the
+         * subsequent umount if it fails. All mounts of the batch are
+         * independent of each other, hence the children for all of
+         * them run at the same time. */
+        for (i = 0; i < n_jobs; i++) {
+                jobs[i].pid = 0;
+                jobs[i].r = 0;
+
+                if (jobs[i].mount_point->try_remount_ro)
+                        jobs[i].r = remount_fork(jobs[i].mount_point, umount_log_level, &jobs[i].pid);
+        }
+
+        umount_jobs_wait(jobs, n_jobs, "Remounting");
+
+        for (i = 0; i < n_jobs; i++) {
+                bool skip;
 
                 /* Skip / and /usr since we cannot unmount that
                  * anyway, since we are running from it. They have
-                 * already been remounted ro. */
-                if (nonunmountable_path(m->path))
+                 * already been remounted ro. If the remount failed,
+                 * count them as failed. */
+                skip = nonunmountable_path(jobs[i].mount_point->path);
+                if (skip && jobs[i].r < 0)
+                        n_failed++;
+
+                /* Remount failed, but try unmounting anyway,
+                 * unless this is a mount point we want to skip. */
+                jobs[i].r = skip ? 1 : umount_fork(jobs[i].mount_point, umount_log_level, &jobs[i].pid);
+        }
+
+        umount_jobs_wait(jobs, n_jobs, "Unmounting");
+
+        for (i = 0; i < n_jobs; i++) {
+                if (jobs[i].r > 0)
                         continue;
 
-                /* Trying to umount */
-                if (umount_with_timeout(m, umount_log_level) < 0)
+                if (jobs[i].r < 0)
                         n_failed++;
                 else
                         *changed = true;
@@ -528,6 +596,70 @@ static int mount_points_list_umount(MountPoint **head, bool *changed, int umount
         return n_failed;
 }
 
+static bool mount_point_is_leaf(MountPoint *head, MountPoint *m) {
+        bool newer = true;
+        MountPoint *k;
+
+        assert(m);
+
+        /* A mount point may only be unmounted once nothing else is mounted below it, and once the mount
+         * points stacked on top of it are gone. The list is ordered newest first. */
+        LIST_FOREACH(mount_point, k, head) {
+                if (k == m) {
+                        newer = false;
+                        continue;
+                }
+
+                if (path_equal(k->path, m->path)) {
+                        if (newer)
+                                return false;
+                } else if (path_startswith(k->path, m->path))
+                        return false;
+        }
+
+        return true;
+}
+
+/* This includes remounting readonly, which changes the kernel mount options.
+ * Therefore the list passed to this function is invalidated, and is emptied. */
+static int mount_points_list_umount(MountPoint **head, bool *changed, int umount_log_level) {
+        _cleanup_free_ UmountJob *jobs = NULL;
+        size_t n_allocated = 0;
+        int n_failed = 0;
+
+        assert(head);
+        assert(changed);
+
+        /* The mount tree is processed level by level, starting with the leaves. All mount points of one
+         * level are remounted and unmounted in parallel, hence the time spent is bounded by the depth of the
+         * tree rather than by the number of mounts that hang. A mount point that failed to unmount is
+         * dropped all the same, so that its parent is still attempted. */
+        while (*head) {
+                size_t n_jobs = 0, i;
+                MountPoint *m;
+
+                LIST_FOREACH(mount_point, m, *head) {
+                        if (!mount_point_is_leaf(*head, m))
+                                continue;
+
+                        if (!GREEDY_REALLOC(jobs, n_allocated, n_jobs + 1))
+                                return log_oom();
+
+                        jobs[n_jobs++] = (UmountJob) { .mount_point = m };
+                }
+
+                /* The newest of the mount points with the longest path is always a leaf */
+                assert(n_jobs > 0);
+
+                n_failed += umount_jobs_run(jobs, n_jobs, changed, umount_log_level);
+
+                for (i = 0; i < n_jobs; i++)
+                        mount_point_free(head, jobs[i].mount_point);
+        }
+
+        return n_failed;
+}
+
 static int swap_points_list_off(MountPoint **head, bool *changed) {
         MountPoint *m, *n;
         int n_failed = 0;
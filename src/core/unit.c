@@ -439,6 +439,9 @@ void unit_add_to_dbus_queue(Unit *u) {
                 return;
         }
 
+        if (!u->manager->dbus_unit_queue)
+                u->manager->dbus_unit_queue_since = now(CLOCK_MONOTONIC);
+
         LIST_PREPEND(dbus_queue, u->manager->dbus_unit_queue, u);
         u->in_dbus_queue = true;
 }
@@ -580,6 +583,8 @@ void unit_free(Unit *u) {
         if (!sd_id128_is_null(u->invocation_id))
                 hashmap_remove_value(u->manager->units_by_invocation_id, &u->invocation_id, u);
 
+        unit_forget_dbus_path(u);
+
         if (u->job) {
                 Job *j = u->job;
                 job_uninstall(j);
@@ -892,6 +897,9 @@ int unit_merge(Unit *u, Unit *other) {
         other->load_state = UNIT_MERGED;
         other->merged_into = u;
 
+        /* Bus lookups by the other unit's path shall find the unit it was merged into from now on */
+        unit_forget_dbus_path(other);
+
         /* If there is still some data attached to the other node, we
          * don't need it anymore, and can free it. */
         if (other->load_state != UNIT_STUB)
@@ -2495,6 +2503,8 @@ void unit_notify(Unit *u, UnitActiveState os, UnitActiveState ns, bool reload_su
                         (void) emergency_action(u->manager, u->success_action, u->reboot_arg, "unit succeeded");
         }
 
+        manager_state_stream_add_unit(m, u);
+
         unit_add_to_dbus_queue(u);
         unit_add_to_gc_queue(u);
 }
@@ -2685,7 +2695,8 @@ static int unit_add_dependency_hashmap(
         assert(destination_mask < _UNIT_DEPENDENCY_MASK_FULL);
         assert(origin_mask > 0 || destination_mask > 0);
 
-        r = hashmap_ensure_allocated(h, NULL);
+        /* Keyed by Unit pointers, which nobody but us controls, hence use the cheaper hash function */
+        r = hashmap_ensure_allocated(h, &trusted_trivial_hash_ops);
         if (r < 0)
                 return r;
 
@@ -2897,6 +2908,16 @@ char *unit_dbus_path(Unit *u) {
         return unit_dbus_path_from_name(u->id);
 }
 
+void unit_forget_dbus_path(Unit *u) {
+        assert(u);
+
+        if (!u->dbus_path)
+                return;
+
+        (void) hashmap_remove_value(u->manager->units_by_dbus_path, u->dbus_path, u);
+        u->dbus_path = mfree(u->dbus_path);
+}
+
 char *unit_dbus_path_invocation_id(Unit *u) {
         assert(u);
 
@@ -3163,6 +3184,7 @@ int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs) {
 
         unit_serialize_item(u, f, "exported-invocation-id", yes_no(u->exported_invocation_id));
         unit_serialize_item(u, f, "exported-log-level-max", yes_no(u->exported_log_level_max));
+        unit_serialize_item(u, f, "exported-log-rate-limit-bytes", yes_no(u->exported_log_rate_limit_bytes));
         unit_serialize_item(u, f, "exported-log-extra-fields", yes_no(u->exported_log_extra_fields));
 
         unit_serialize_item_format(u, f, "cpu-usage-base", "%" PRIu64, u->cpu_usage_base);
@@ -3419,6 +3441,16 @@ int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
 
                         continue;
 
+                } else if (streq(l, "exported-log-rate-limit-bytes")) {
+
+                        r = parse_boolean(v);
+                        if (r < 0)
+                                log_unit_debug(u, "Failed to parse exported log rate limit bytes bool %s, ignoring.", v);
+                        else
+                                u->exported_log_rate_limit_bytes = r;
+
+                        continue;
+
                 } else if (streq(l, "exported-log-extra-fields")) {
 
                         r = parse_boolean(v);
@@ -5109,6 +5141,31 @@ static int unit_export_log_level_max(Unit *u, const ExecContext *c) {
         return 0;
 }
 
+static int unit_export_log_rate_limit_bytes(Unit *u, const ExecContext *c) {
+        char buf[DECIMAL_STR_MAX(uint64_t)];
+        const char *p;
+        int r;
+
+        assert(u);
+        assert(c);
+
+        if (u->exported_log_rate_limit_bytes)
+                return 0;
+
+        if (c->log_rate_limit_bytes == 0)
+                return 0;
+
+        xsprintf(buf, "%" PRIu64, c->log_rate_limit_bytes);
+
+        p = strjoina("/run/systemd/units/log-rate-limit-bytes:", u->id);
+        r = symlink_atomic(buf, p);
+        if (r < 0)
+                return log_unit_debug_errno(u, r, "Failed to create log rate limit symlink %s: %m", p);
+
+        u->exported_log_rate_limit_bytes = true;
+        return 0;
+}
+
 static int unit_export_log_extra_fields(Unit *u, const ExecContext *c) {
         _cleanup_close_ int fd = -1;
         struct iovec *iovec;
@@ -5195,6 +5252,7 @@ void unit_export_state_files(Unit *u) {
         c = unit_get_exec_context(u);
         if (c) {
                 (void) unit_export_log_level_max(u, c);
+                (void) unit_export_log_rate_limit_bytes(u, c);
                 (void) unit_export_log_extra_fields(u, c);
         }
 }
@@ -5226,6 +5284,13 @@ void unit_unlink_state_files(Unit *u) {
                 u->exported_log_level_max = false;
         }
 
+        if (u->exported_log_rate_limit_bytes) {
+                p = strjoina("/run/systemd/units/log-rate-limit-bytes:", u->id);
+                (void) unlink(p);
+
+                u->exported_log_rate_limit_bytes = false;
+        }
+
         if (u->exported_log_extra_fields) {
                 p = strjoina("/run/systemd/units/extra-fields:", u->id);
                 (void) unlink(p);
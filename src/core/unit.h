@@ -125,6 +125,7 @@ typedef struct Unit {
         Unit *merged_into;
 
         char *id; /* One name is special because we use it for identification. Points to an entry in the names set */
+        char *dbus_path; /* The canonical bus object path, if this unit is in the units_by_dbus_path cache */
         char *instance;
 
         Set *names;
@@ -277,8 +278,16 @@ typedef struct Unit {
         BPFProgram *ip_bpf_ingress, *ip_bpf_ingress_installed;
         BPFProgram *ip_bpf_egress, *ip_bpf_egress_installed;
 
+        /* Digest of the configuration the above programs and access maps were compiled from */
+        uint64_t ip_bpf_digest[2];
+        bool ip_bpf_digest_valid;
+
         uint64_t ip_accounting_extra[_CGROUP_IP_ACCOUNTING_METRIC_MAX];
 
+        /* Accounting values as served to bus clients recently */
+        CGroupAccountingCache memory_current_cache, tasks_current_cache, cpu_usage_cache;
+        CGroupAccountingCache ip_accounting_cache[_CGROUP_IP_ACCOUNTING_METRIC_MAX];
+
         /* How to start OnFailure units */
         JobMode on_failure_job_mode;
 
@@ -350,6 +359,7 @@ typedef struct Unit {
         /* Remember which unit state files we created */
         bool exported_invocation_id:1;
         bool exported_log_level_max:1;
+        bool exported_log_rate_limit_bytes:1;
         bool exported_log_extra_fields:1;
 
         /* When writing transient unit files, stores which section we stored last. If < 0, we didn't write any yet. If
@@ -490,6 +500,9 @@ typedef struct UnitVTable {
         /* Called whenever a process of this unit sends us a message */
         void (*notify_message)(Unit *u, const struct ucred *ucred, char **tags, FDSet *fds);
 
+        /* Called instead of the above for messages consisting of nothing but WATCHDOG=1 */
+        void (*notify_watchdog)(Unit *u, const struct ucred *ucred);
+
         /* Called whenever a name this Unit registered for comes or goes away. */
         void (*bus_name_owner_change)(Unit *u, const char *name, const char *old_owner, const char *new_owner);
 
@@ -657,6 +670,7 @@ int set_unit_path(const char *p);
 
 char *unit_dbus_path(Unit *u);
 char *unit_dbus_path_invocation_id(Unit *u);
+void unit_forget_dbus_path(Unit *u);
 
 int unit_load_related_unit(Unit *u, const char *type, Unit **_found);
 
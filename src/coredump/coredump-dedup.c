@@ -0,0 +1,429 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+***/
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "alloc-util.h"
+#include "coredump-dedup.h"
+#include "dirent-util.h"
+#include "fd-util.h"
+#include "hashmap.h"
+#include "io-util.h"
+#include "macro.h"
+#include "siphash24.h"
+#include "sparse-endian.h"
+#include "string-util.h"
+#include "time-util.h"
+#include "unaligned.h"
+#include "util.h"
+
+/* Cores are split into chunks at page boundaries that are chosen by the contents of the pages, so that the same
+ * memory ends up in the same chunks in two cores, even if mappings before it grew or shrank. Each chunk is
+ * compressed into a zstd frame of its own, which is padded to the file system block size with a skippable
+ * frame. The result is an ordinary zstd file, but chunks that are the same as in the previous core of the same
+ * program can share their blocks with it. This is done with FIDEDUPERANGE, i.e. the kernel compares the data
+ * before sharing it, so the chunk hashes only need to be good enough to find candidates. An index of the chunks
+ * is appended as another skippable frame, for use by the next core. */
+
+#define CHUNK_MIN (64U * 1024U)
+#define CHUNK_MAX (4U * 1024U * 1024U)
+
+/* On average one chunk boundary every 256 pages */
+#define CHUNK_BOUNDARY_MASK UINT64_C(0xff)
+
+#define ZSTD_SKIPPABLE_MAGIC 0x184D2A50U
+#define ZSTD_SKIPPABLE_HEADER_SIZE 8U
+
+#define INDEX_SIGNATURE (const uint8_t[]) { 'C', 'O', 'R', 'E', 'I', 'D', 'X', '1' }
+#define INDEX_ENTRIES_MAX (UINT64_C(1) << 24)
+
+typedef struct ChunkIndexEntry {
+        le64_t hash;
+        le64_t offset;
+        le64_t size;
+} _packed_ ChunkIndexEntry;
+
+typedef struct ChunkIndexFooter {
+        le64_t n_entries;
+        uint8_t signature[8];
+} _packed_ ChunkIndexFooter;
+
+typedef struct Chunk {
+        uint64_t hash;
+        uint64_t offset;
+        uint64_t size;
+} Chunk;
+
+static const uint8_t chunk_hash_key[16] = {
+        0x5c, 0x1e, 0x83, 0x2b, 0x9d, 0x47, 0xf0, 0x61,
+        0x36, 0xa8, 0x0d, 0xc4, 0x72, 0xe9, 0x15, 0xbb,
+};
+
+int coredump_dedup_find_reference(const char *directory, const char *prefix, const char *suffix, int *ret_fd) {
+        _cleanup_closedir_ DIR *d = NULL;
+        _cleanup_free_ char *best = NULL;
+        struct timespec best_mtime = {};
+        struct dirent *de;
+        int fd;
+
+        assert(directory);
+        assert(prefix);
+        assert(suffix);
+        assert(ret_fd);
+
+        /* Picks the most recent core whose file name starts with prefix and ends with suffix */
+
+        d = opendir(directory);
+        if (!d)
+                return -errno;
+
+        FOREACH_DIRENT(de, d, return -errno) {
+                struct stat st;
+
+                if (!startswith(de->d_name, prefix) || !endswith(de->d_name, suffix))
+                        continue;
+
+                if (fstatat(dirfd(d), de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+                        continue;
+
+                if (!S_ISREG(st.st_mode))
+                        continue;
+
+                if (best && timespec_load(&st.st_mtim) <= timespec_load(&best_mtime))
+                        continue;
+
+                if (free_and_strdup(&best, de->d_name) < 0)
+                        return -ENOMEM;
+
+                best_mtime = st.st_mtim;
+        }
+
+        if (!best)
+                return -ENOENT;
+
+        fd = openat(dirfd(d), best, O_RDONLY|O_CLOEXEC|O_NOFOLLOW|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        *ret_fd = fd;
+        return 0;
+}
+
+#if HAVE_ZSTD
+DEFINE_TRIVIAL_CLEANUP_FUNC(ZSTD_CCtx *, ZSTD_freeCCtx);
+
+static int read_index(int fd, Chunk **ret, size_t *ret_n) {
+        _cleanup_free_ ChunkIndexEntry *entries = NULL;
+        _cleanup_free_ Chunk *chunks = NULL;
+        ChunkIndexFooter footer;
+        uint64_t n, index_size;
+        le32_t header[2];
+        struct stat st;
+        ssize_t l;
+        size_t i;
+
+        assert(fd >= 0);
+        assert(ret);
+        assert(ret_n);
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        if ((uint64_t) st.st_size < ZSTD_SKIPPABLE_HEADER_SIZE + sizeof(footer))
+                return -EBADMSG;
+
+        l = pread(fd, &footer, sizeof(footer), st.st_size - sizeof(footer));
+        if (l < 0)
+                return -errno;
+        if (l != sizeof(footer))
+                return -EIO;
+
+        if (memcmp(footer.signature, INDEX_SIGNATURE, sizeof(footer.signature)) != 0)
+                return -EBADMSG;
+
+        n = le64toh(footer.n_entries);
+        if (n <= 0 || n > INDEX_ENTRIES_MAX)
+                return -EBADMSG;
+
+        index_size = n * sizeof(ChunkIndexEntry) + sizeof(footer);
+        if (index_size + ZSTD_SKIPPABLE_HEADER_SIZE > (uint64_t) st.st_size)
+                return -EBADMSG;
+
+        l = pread(fd, header, sizeof(header), st.st_size - index_size - ZSTD_SKIPPABLE_HEADER_SIZE);
+        if (l < 0)
+                return -errno;
+        if (l != sizeof(header))
+                return -EIO;
+
+        if (le32toh(header[0]) != ZSTD_SKIPPABLE_MAGIC + 1 ||
+            le32toh(header[1]) != index_size)
+                return -EBADMSG;
+
+        entries = new(ChunkIndexEntry, n);
+        chunks = new(Chunk, n);
+        if (!entries || !chunks)
+                return -ENOMEM;
+
+        l = pread(fd, entries, n * sizeof(ChunkIndexEntry), st.st_size - index_size);
+        if (l < 0)
+                return -errno;
+        if ((size_t) l != n * sizeof(ChunkIndexEntry))
+                return -EIO;
+
+        for (i = 0; i < n; i++)
+                chunks[i] = (Chunk) {
+                        .hash = le64toh(entries[i].hash),
+                        .offset = le64toh(entries[i].offset),
+                        .size = le64toh(entries[i].size),
+                };
+
+        *ret = TAKE_PTR(chunks);
+        *ret_n = n;
+
+        return 0;
+}
+
+static int dedupe_range(int src_fd, uint64_t src_offset, int dst_fd, uint64_t dst_offset, uint64_t length) {
+#ifdef FIDEDUPERANGE
+        _cleanup_free_ struct file_dedupe_range *range = NULL;
+
+        range = malloc0(sizeof(struct file_dedupe_range) + sizeof(struct file_dedupe_range_info));
+        if (!range)
+                return -ENOMEM;
+
+        range->src_offset = src_offset;
+        range->src_length = length;
+        range->dest_count = 1;
+        range->info[0].dest_fd = dst_fd;
+        range->info[0].dest_offset = dst_offset;
+
+        if (ioctl(src_fd, FIDEDUPERANGE, range) < 0)
+                return -errno;
+
+        if (range->info[0].status < 0)
+                return range->info[0].status;
+
+        return range->info[0].status == FILE_DEDUPE_RANGE_SAME && range->info[0].bytes_deduped > 0;
+#else
+        return -EOPNOTSUPP;
+#endif
+}
+
+static size_t find_boundary(const uint8_t *buf, size_t size, size_t page) {
+        size_t p;
+
+        /* Returns the end of the first chunk, or 0 if there is no boundary yet */
+
+        for (p = CHUNK_MIN; p + page <= size && p < CHUNK_MAX; p += page)
+                if ((siphash24(buf + p, page, chunk_hash_key) & CHUNK_BOUNDARY_MASK) == 0)
+                        return p;
+
+        return size >= CHUNK_MAX ? CHUNK_MAX : 0;
+}
+#endif
+
+int coredump_dedup_write(int input_fd, int output_fd, int copy_fd, uint64_t max_size, int reference_fd) {
+#if HAVE_ZSTD
+        _cleanup_(ZSTD_freeCCtxp) ZSTD_CCtx *cctx = NULL;
+        _cleanup_free_ uint8_t *buf = NULL, *frame = NULL;
+        _cleanup_free_ Chunk *chunks = NULL, *reference = NULL;
+        _cleanup_hashmap_free_ Hashmap *by_hash = NULL;
+        size_t n_chunks = 0, n_chunks_allocated = 0, n_reference = 0, filled = 0, page, block, frame_size, i;
+        uint64_t offset = 0, in_bytes = 0, shared = 0;
+        bool eof = false, truncated = false, can_dedupe;
+        struct stat st;
+        int r;
+
+        assert(input_fd >= 0);
+        assert(output_fd >= 0);
+
+        if (fstat(output_fd, &st) < 0)
+                return -errno;
+
+        page = page_size();
+
+        /* The frames have to be aligned to blocks for them to be shareable */
+        block = st.st_blksize;
+        if (block < page || (block & (block - 1)) != 0)
+                block = page;
+
+        frame_size = ZSTD_compressBound(CHUNK_MAX) + block + ZSTD_SKIPPABLE_HEADER_SIZE;
+
+        buf = malloc(CHUNK_MAX);
+        frame = malloc(frame_size);
+        cctx = ZSTD_createCCtx();
+        if (!buf || !frame || !cctx)
+                return -ENOMEM;
+
+        can_dedupe = reference_fd >= 0;
+        if (can_dedupe) {
+                r = read_index(reference_fd, &reference, &n_reference);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to read chunk index of previous core, not deduplicating: %m");
+                        can_dedupe = false;
+                }
+        }
+
+        if (can_dedupe) {
+                by_hash = hashmap_new(&uint64_hash_ops);
+                if (!by_hash)
+                        return -ENOMEM;
+
+                for (i = 0; i < n_reference; i++) {
+                        r = hashmap_put(by_hash, &reference[i].hash, reference + i);
+                        if (r < 0 && r != -EEXIST)
+                                return r;
+                }
+        }
+
+        for (;;) {
+                size_t boundary, zsize, total;
+                Chunk *c;
+
+                if (!eof) {
+                        size_t want;
+                        ssize_t n;
+
+                        want = MIN((uint64_t) (CHUNK_MAX - filled), max_size - in_bytes);
+
+                        n = loop_read(input_fd, buf + filled, want, true);
+                        if (n < 0)
+                                return (int) n;
+
+                        in_bytes += n;
+                        filled += n;
+
+                        if ((size_t) n < want)
+                                eof = true;
+                        else if (in_bytes >= max_size) {
+                                char ch;
+
+                                /* Check whether we actually cut something off */
+                                n = loop_read(input_fd, &ch, 1, true);
+                                if (n < 0)
+                                        return (int) n;
+
+                                truncated = n > 0;
+                                eof = true;
+                        }
+                }
+
+                if (filled == 0)
+                        break;
+
+                boundary = find_boundary(buf, filled, page);
+                if (boundary == 0) {
+                        if (!eof)
+                                continue;
+
+                        boundary = filled;
+                }
+
+                if (copy_fd >= 0) {
+                        ssize_t k;
+
+                        k = sparse_write(copy_fd, buf, boundary, 64);
+                        if (k < 0)
+                                return (int) k;
+                }
+
+                zsize = ZSTD_compressCCtx(cctx, frame, frame_size, buf, boundary, 0);
+                if (ZSTD_isError(zsize)) {
+                        log_debug("ZSTD encoder failed: %s", ZSTD_getErrorName(zsize));
+                        return -EIO;
+                }
+
+                /* Pad to the next block boundary, there must be room for at least the skippable frame header */
+                total = ALIGN_TO(zsize + ZSTD_SKIPPABLE_HEADER_SIZE, block);
+                memzero(frame + zsize, total - zsize);
+                unaligned_write_le32(frame + zsize, ZSTD_SKIPPABLE_MAGIC);
+                unaligned_write_le32(frame + zsize + 4, total - zsize - ZSTD_SKIPPABLE_HEADER_SIZE);
+
+                r = loop_write(output_fd, frame, total, false);
+                if (r < 0)
+                        return r;
+
+                if (!GREEDY_REALLOC(chunks, n_chunks_allocated, n_chunks + 1))
+                        return -ENOMEM;
+
+                chunks[n_chunks] = (Chunk) {
+                        .hash = siphash24(buf, boundary, chunk_hash_key),
+                        .offset = offset,
+                        .size = total,
+                };
+
+                c = can_dedupe ? hashmap_get(by_hash, &chunks[n_chunks].hash) : NULL;
+                if (c && c->size == total) {
+                        r = dedupe_range(reference_fd, c->offset, output_fd, offset, total);
+                        if (r < 0) {
+                                log_debug_errno(r, "Failed to share blocks with previous core, not deduplicating: %m");
+                                can_dedupe = false;
+                        } else if (r > 0)
+                                shared += total;
+                }
+
+                n_chunks++;
+                offset += total;
+
+                memmove(buf, buf + boundary, filled - boundary);
+                filled -= boundary;
+        }
+
+        if (n_chunks > 0) {
+                _cleanup_free_ ChunkIndexEntry *entries = NULL;
+                ChunkIndexFooter footer = {
+                        .n_entries = htole64(n_chunks),
+                };
+                le32_t header[2];
+
+                entries = new(ChunkIndexEntry, n_chunks);
+                if (!entries)
+                        return -ENOMEM;
+
+                for (i = 0; i < n_chunks; i++)
+                        entries[i] = (ChunkIndexEntry) {
+                                .hash = htole64(chunks[i].hash),
+                                .offset = htole64(chunks[i].offset),
+                                .size = htole64(chunks[i].size),
+                        };
+
+                memcpy(footer.signature, INDEX_SIGNATURE, sizeof(footer.signature));
+
+                header[0] = htole32(ZSTD_SKIPPABLE_MAGIC + 1);
+                header[1] = htole32(n_chunks * sizeof(ChunkIndexEntry) + sizeof(footer));
+
+                r = loop_write(output_fd, header, sizeof(header), false);
+                if (r < 0)
+                        return r;
+
+                r = loop_write(output_fd, entries, n_chunks * sizeof(ChunkIndexEntry), false);
+                if (r < 0)
+                        return r;
+
+                r = loop_write(output_fd, &footer, sizeof(footer), false);
+                if (r < 0)
+                        return r;
+        }
+
+        /* Trailing holes are not allocated by sparse_write(), make sure the copy has the full size */
+        if (copy_fd >= 0 && ftruncate(copy_fd, in_bytes) < 0)
+                return -errno;
+
+        log_debug("Stored core in %zu chunks (%"PRIu64" -> %"PRIu64" bytes), %"PRIu64" bytes shared with previous core.",
+                  n_chunks, in_bytes, offset, shared);
+
+        return truncated;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
@@ -0,0 +1,11 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+/***
+  This file is part of systemd.
+***/
+
+#include <inttypes.h>
+
+int coredump_dedup_find_reference(const char *directory, const char *prefix, const char *suffix, int *ret_fd);
+int coredump_dedup_write(int input_fd, int output_fd, int copy_fd, uint64_t max_size, int reference_fd);
@@ -29,6 +29,7 @@
 #include "compress.h"
 #include "conf-parser.h"
 #include "copy.h"
+#include "coredump-dedup.h"
 #include "coredump-vacuum.h"
 #include "dirent-util.h"
 #include "escape.h"
@@ -59,6 +60,9 @@
 /* The maximum size up to which we leave the coredump around on disk */
 #define EXTERNAL_SIZE_MAX PROCESS_SIZE_MAX
 
+/* The maximum number of threads to compress with */
+#define COMPRESS_THREADS_MAX 8U
+
 /* The maximum size up to which we store the coredump in the journal */
 #define JOURNAL_SIZE_MAX ((size_t) (767LU*1024LU*1024LU))
 
@@ -115,6 +119,7 @@ static DEFINE_CONFIG_PARSE_ENUM(config_parse_coredump_storage, coredump_storage,
 
 static CoredumpStorage arg_storage = COREDUMP_STORAGE_EXTERNAL;
 static bool arg_compress = true;
+static bool arg_deduplicate = false;
 static uint64_t arg_process_size_max = PROCESS_SIZE_MAX;
 static uint64_t arg_external_size_max = EXTERNAL_SIZE_MAX;
 static uint64_t arg_journal_size_max = JOURNAL_SIZE_MAX;
@@ -125,6 +130,7 @@ static int parse_config(void) {
         static const ConfigTableItem items[] = {
                 { "Coredump", "Storage",          config_parse_coredump_storage,  0, &arg_storage           },
                 { "Coredump", "Compress",         config_parse_bool,              0, &arg_compress          },
+                { "Coredump", "Deduplicate",      config_parse_bool,              0, &arg_deduplicate       },
                 { "Coredump", "ProcessSizeMax",   config_parse_iec_uint64,        0, &arg_process_size_max  },
                 { "Coredump", "ExternalSizeMax",  config_parse_iec_uint64,        0, &arg_external_size_max },
                 { "Coredump", "JournalSizeMax",   config_parse_iec_size,          0, &arg_journal_size_max  },
@@ -317,6 +323,44 @@ static int make_filename(const char *context[_CONTEXT_MAX], char **ret) {
         return 0;
 }
 
+#if HAVE_ZSTD
+static unsigned compress_threads(void) {
+        long n;
+
+        /* Leave some room for the rest of the system, a crashing process may well be one of many */
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+        if (n <= 1)
+                return 1;
+
+        return MIN((unsigned) n / 2, COMPRESS_THREADS_MAX);
+}
+
+static int find_reference(const char *fn, int *ret_fd) {
+        _cleanup_free_ char *prefix = NULL;
+        const char *e;
+        unsigned i;
+
+        assert(fn);
+        assert(ret_fd);
+
+        /* The file name ends in ".<boot id>.<pid>.<timestamp>", what comes before identifies the program and
+         * the user, so that only cores of the same user are shared with each other. */
+        prefix = strdup(basename(fn));
+        if (!prefix)
+                return -ENOMEM;
+
+        for (i = 0; i < 3; i++) {
+                e = strrchr(prefix, '.');
+                if (!e)
+                        return -EINVAL;
+
+                prefix[e - prefix] = 0;
+        }
+
+        return coredump_dedup_find_reference("/var/lib/systemd/coredump", strjoina(prefix, "."), COMPRESSED_EXT, ret_fd);
+}
+#endif
+
 static int save_external_coredump(
                 const char *context[_CONTEXT_MAX],
                 int input_fd,
@@ -328,7 +372,12 @@ static int save_external_coredump(
 
         _cleanup_free_ char *fn = NULL, *tmp = NULL;
         _cleanup_close_ int fd = -1;
+#if HAVE_COMPRESSION
+        _cleanup_free_ char *fn_compressed = NULL, *tmp_compressed = NULL;
+        _cleanup_close_ int fd_compressed = -1;
+#endif
         uint64_t rlimit, process_limit, max_size;
+        bool copied = false;
         struct stat st;
         uid_t uid;
         int r;
@@ -374,10 +423,48 @@ static int save_external_coredump(
         if (fd < 0)
                 return log_error_errno(fd, "Failed to create temporary file for coredump %s: %m", fn);
 
-        r = copy_bytes(input_fd, fd, max_size, 0);
-        if (r < 0) {
-                log_error_errno(r, "Cannot store coredump of %s (%s): %m", context[CONTEXT_PID], context[CONTEXT_COMM]);
-                goto fail;
+#if HAVE_ZSTD
+        /* When the core is going to be stored compressed anyway, compress it while reading it, with a few
+         * worker threads, instead of in a second pass over the file. The uncompressed copy is still needed
+         * for generating the backtrace, but it is written sparsely. */
+        if (arg_compress && arg_storage == COREDUMP_STORAGE_EXTERNAL) {
+                fn_compressed = strappend(fn, COMPRESSED_EXT);
+                if (!fn_compressed) {
+                        r = log_oom();
+                        goto fail;
+                }
+
+                fd_compressed = open_tmpfile_linkable(fn_compressed, O_RDWR|O_CLOEXEC, &tmp_compressed);
+                if (fd_compressed < 0)
+                        log_error_errno(fd_compressed, "Failed to create temporary file for coredump %s: %m", fn_compressed);
+                else {
+                        _cleanup_close_ int reference_fd = -1;
+
+                        if (arg_deduplicate) {
+                                r = find_reference(fn, &reference_fd);
+                                if (r < 0 && r != -ENOENT)
+                                        log_debug_errno(r, "Failed to find previous core of %s, ignoring: %m", context[CONTEXT_COMM]);
+
+                                r = coredump_dedup_write(input_fd, fd_compressed, fd, max_size, reference_fd);
+                        } else
+                                r = compress_stream_zstd_full(input_fd, fd_compressed, (uint64_t) -1, fd, max_size, compress_threads());
+                        if (r < 0) {
+                                log_error_errno(r, "Cannot store coredump of %s (%s): %m", context[CONTEXT_PID], context[CONTEXT_COMM]);
+                                (void) unlink(tmp_compressed);
+                                goto fail;
+                        }
+
+                        copied = true;
+                }
+        }
+#endif
+
+        if (!copied) {
+                r = copy_bytes(input_fd, fd, max_size, 0);
+                if (r < 0) {
+                        log_error_errno(r, "Cannot store coredump of %s (%s): %m", context[CONTEXT_PID], context[CONTEXT_COMM]);
+                        goto fail;
+                }
         }
         *ret_truncated = r == 1;
         if (*ret_truncated)
@@ -397,29 +484,35 @@ static int save_external_coredump(
                 goto fail;
         }
 
-#if HAVE_XZ || HAVE_LZ4
-        /* If we will remove the coredump anyway, do not compress. */
-        if (arg_compress && !maybe_remove_external_coredump(NULL, st.st_size)) {
-
-                _cleanup_free_ char *fn_compressed = NULL, *tmp_compressed = NULL;
-                _cleanup_close_ int fd_compressed = -1;
-
-                fn_compressed = strappend(fn, COMPRESSED_EXT);
-                if (!fn_compressed) {
-                        log_oom();
-                        goto uncompressed;
-                }
+#if HAVE_COMPRESSION
+        /* If we will remove the coredump anyway, do not compress, or drop what we compressed already. */
+        if (arg_compress && maybe_remove_external_coredump(NULL, st.st_size)) {
+                if (tmp_compressed)
+                        (void) unlink(tmp_compressed);
+                fd_compressed = safe_close(fd_compressed);
+        } else if (arg_compress) {
 
-                fd_compressed = open_tmpfile_linkable(fn_compressed, O_RDWR|O_CLOEXEC, &tmp_compressed);
                 if (fd_compressed < 0) {
-                        log_error_errno(fd_compressed, "Failed to create temporary file for coredump %s: %m", fn_compressed);
-                        goto uncompressed;
-                }
+                        if (!fn_compressed) {
+                                fn_compressed = strappend(fn, COMPRESSED_EXT);
+                                if (!fn_compressed) {
+                                        log_oom();
+                                        goto uncompressed;
+                                }
+                        }
 
-                r = compress_stream(fd, fd_compressed, -1);
-                if (r < 0) {
-                        log_error_errno(r, "Failed to compress %s: %m", coredump_tmpfile_name(tmp_compressed));
-                        goto fail_compressed;
+                        tmp_compressed = mfree(tmp_compressed);
+                        fd_compressed = open_tmpfile_linkable(fn_compressed, O_RDWR|O_CLOEXEC, &tmp_compressed);
+                        if (fd_compressed < 0) {
+                                log_error_errno(fd_compressed, "Failed to create temporary file for coredump %s: %m", fn_compressed);
+                                goto uncompressed;
+                        }
+
+                        r = compress_stream(fd, fd_compressed, -1);
+                        if (r < 0) {
+                                log_error_errno(r, "Failed to compress %s: %m", coredump_tmpfile_name(tmp_compressed));
+                                goto fail_compressed;
+                        }
                 }
 
                 r = fix_permissions(fd_compressed, tmp_compressed, fn_compressed, context, uid);
@@ -308,6 +308,22 @@ static int retrieve(const void *data,
         return 1;
 }
 
+static int retrieve_field(sd_journal *j, const char *name, char **var) {
+        const void *d;
+        size_t l;
+        int r;
+
+        r = sd_journal_get_data(j, name, &d, &l);
+        if (r == -ENOENT)
+                return 0;
+        if (r < 0) {
+                log_debug_errno(r, "Failed to read %s field, ignoring: %m", name);
+                return 0;
+        }
+
+        return retrieve(d, l, name, var);
+}
+
 static int print_field(FILE* file, sd_journal *j) {
         const void *d;
         size_t l;
@@ -349,32 +365,43 @@ static int print_list(FILE* file, sd_journal *j, int had_legend) {
         _cleanup_free_ char
                 *mid = NULL, *pid = NULL, *uid = NULL, *gid = NULL,
                 *sgnl = NULL, *exe = NULL, *comm = NULL, *cmdline = NULL,
-                *filename = NULL, *truncated = NULL, *coredump = NULL;
-        const void *d;
-        size_t l;
+                *filename = NULL, *truncated = NULL;
         usec_t t;
         char buf[FORMAT_TIMESTAMP_MAX];
         int r;
         const char *present;
-        bool normal_coredump;
+        bool normal_coredump, coredump;
+        const struct {
+                const char *name;
+                char **var;
+        } fields[] = {
+                { "MESSAGE_ID",         &mid       },
+                { "COREDUMP_PID",       &pid       },
+                { "COREDUMP_UID",       &uid       },
+                { "COREDUMP_GID",       &gid       },
+                { "COREDUMP_SIGNAL",    &sgnl      },
+                { "COREDUMP_EXE",       &exe       },
+                { "COREDUMP_COMM",      &comm      },
+                { "COREDUMP_CMDLINE",   &cmdline   },
+                { "COREDUMP_FILENAME",  &filename  },
+                { "COREDUMP_TRUNCATED", &truncated },
+        };
+        size_t i;
 
         assert(file);
         assert(j);
 
-        SD_JOURNAL_FOREACH_DATA(j, d, l) {
-                RETRIEVE(d, l, "MESSAGE_ID", mid);
-                RETRIEVE(d, l, "COREDUMP_PID", pid);
-                RETRIEVE(d, l, "COREDUMP_UID", uid);
-                RETRIEVE(d, l, "COREDUMP_GID", gid);
-                RETRIEVE(d, l, "COREDUMP_SIGNAL", sgnl);
-                RETRIEVE(d, l, "COREDUMP_EXE", exe);
-                RETRIEVE(d, l, "COREDUMP_COMM", comm);
-                RETRIEVE(d, l, "COREDUMP_CMDLINE", cmdline);
-                RETRIEVE(d, l, "COREDUMP_FILENAME", filename);
-                RETRIEVE(d, l, "COREDUMP_TRUNCATED", truncated);
-                RETRIEVE(d, l, "COREDUMP", coredump);
+        /* Only look up the fields we show, rather than enumerating all of them: the latter would mean
+         * reading (and decompressing) the COREDUMP= field, which might be huge, for every single entry. Its
+         * presence is all we need to know about it. */
+        for (i = 0; i < ELEMENTSOF(fields); i++) {
+                r = retrieve_field(j, fields[i].name, fields[i].var);
+                if (r < 0)
+                        return r;
         }
 
+        coredump = journal_get_data_size(j, "COREDUMP", NULL) >= 0;
+
         if (!pid && !uid && !gid && !sgnl && !exe && !comm && !cmdline && !filename) {
                 log_warning("Empty coredump log entry");
                 return -EINVAL;
@@ -757,7 +784,7 @@ static int save_core(sd_journal *j, FILE *file, char **path, bool *unlink_temp)
                 if (access(filename, R_OK) < 0)
                         return log_error_errno(errno, "File \"%s\" is not readable: %m", filename);
 
-                if (path && !endswith(filename, ".xz") && !endswith(filename, ".lz4")) {
+                if (path && !endswith(filename, ".xz") && !endswith(filename, ".lz4") && !endswith(filename, ".zst")) {
                         *path = TAKE_PTR(filename);
 
                         return 0;
@@ -802,7 +829,7 @@ static int save_core(sd_journal *j, FILE *file, char **path, bool *unlink_temp)
         }
 
         if (filename) {
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
                 _cleanup_close_ int fdf;
 
                 fdf = open(filename, O_RDONLY | O_CLOEXEC);
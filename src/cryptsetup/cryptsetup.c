@@ -41,6 +41,10 @@ static unsigned arg_tries = 3;
 static bool arg_readonly = false;
 static bool arg_verify = false;
 static bool arg_discards = false;
+static bool arg_same_cpu_crypt = false;
+static bool arg_submit_from_crypt_cpus = false;
+static bool arg_no_read_workqueue = false;
+static bool arg_no_write_workqueue = false;
 static bool arg_tcrypt_hidden = false;
 static bool arg_tcrypt_system = false;
 #ifdef CRYPT_TCRYPT_VERA_MODES
@@ -170,7 +174,25 @@ static int parse_one_option(const char *option) {
                 arg_verify = true;
         else if (STR_IN_SET(option, "allow-discards", "discard"))
                 arg_discards = true;
-        else if (streq(option, "luks"))
+        else if (streq(option, "same-cpu-crypt"))
+                arg_same_cpu_crypt = true;
+        else if (streq(option, "submit-from-crypt-cpus"))
+                arg_submit_from_crypt_cpus = true;
+        else if (streq(option, "no-read-workqueue")) {
+#ifdef CRYPT_ACTIVATE_NO_READ_WORKQUEUE
+                arg_no_read_workqueue = true;
+#else
+                log_error("This version of cryptsetup does not support no-read-workqueue; refusing.");
+                return -EINVAL;
+#endif
+        } else if (streq(option, "no-write-workqueue")) {
+#ifdef CRYPT_ACTIVATE_NO_WRITE_WORKQUEUE
+                arg_no_write_workqueue = true;
+#else
+                log_error("This version of cryptsetup does not support no-write-workqueue; refusing.");
+                return -EINVAL;
+#endif
+        } else if (streq(option, "luks"))
                 arg_type = ANY_LUKS;
         else if (streq(option, "tcrypt"))
                 arg_type = CRYPT_TCRYPT;
@@ -642,6 +664,25 @@ int main(int argc, char *argv[]) {
                 if (arg_discards)
                         flags |= CRYPT_ACTIVATE_ALLOW_DISCARDS;
 
+                /* dm-crypt normally queues encryption to a pool of kernel workers, and sorts writes before
+                 * submitting them. On fast storage, and especially on many NVMe devices at once, that adds
+                 * latency and contention rather than throughput, hence allow turning either off. */
+                if (arg_same_cpu_crypt)
+                        flags |= CRYPT_ACTIVATE_SAME_CPU_CRYPT;
+
+                if (arg_submit_from_crypt_cpus)
+                        flags |= CRYPT_ACTIVATE_SUBMIT_FROM_CRYPT_CPUS;
+
+#ifdef CRYPT_ACTIVATE_NO_READ_WORKQUEUE
+                if (arg_no_read_workqueue)
+                        flags |= CRYPT_ACTIVATE_NO_READ_WORKQUEUE;
+#endif
+
+#ifdef CRYPT_ACTIVATE_NO_WRITE_WORKQUEUE
+                if (arg_no_write_workqueue)
+                        flags |= CRYPT_ACTIVATE_NO_WRITE_WORKQUEUE;
+#endif
+
                 if (arg_timeout == USEC_INFINITY)
                         until = 0;
                 else
@@ -19,11 +19,14 @@
 #include "sd-device.h"
 
 #include "alloc-util.h"
+#include "blockdev-util.h"
 #include "bus-common-errors.h"
 #include "bus-error.h"
 #include "bus-util.h"
 #include "device-util.h"
+#include "dirent-util.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "fs-util.h"
 #include "parse-util.h"
 #include "path-util.h"
@@ -32,6 +35,7 @@
 #include "signal-util.h"
 #include "socket-util.h"
 #include "special.h"
+#include "stat-util.h"
 #include "stdio-util.h"
 #include "util.h"
 
@@ -244,6 +248,158 @@ static int process_progress(int fd) {
         return r;
 }
 
+static int collect_backing_disks(dev_t devnum, unsigned level, dev_t **disks, size_t *n_disks, size_t *n_allocated) {
+        char p[SYS_BLOCK_PATH_MAX("/slaves")];
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+        bool stacked = false;
+        dev_t whole;
+        size_t i;
+        int r;
+
+        assert(disks);
+        assert(n_disks);
+        assert(n_allocated);
+
+        if (level > 8)
+                return -ELOOP;
+
+        /* Follow device mapper and MD devices down to the disks they are stacked on */
+        xsprintf_sys_block_path(p, "/slaves", devnum);
+        d = opendir(p);
+        if (!d && errno != ENOENT)
+                return -errno;
+        if (d) {
+                FOREACH_DIRENT(de, d, return -errno) {
+                        _cleanup_free_ char *q = NULL, *line = NULL;
+                        dev_t slave;
+
+                        q = strjoin(p, "/", de->d_name, "/dev");
+                        if (!q)
+                                return -ENOMEM;
+
+                        r = read_one_line_file(q, &line);
+                        if (r < 0)
+                                return r;
+
+                        r = parse_dev(line, &slave);
+                        if (r < 0)
+                                return r;
+
+                        r = collect_backing_disks(slave, level + 1, disks, n_disks, n_allocated);
+                        if (r < 0)
+                                return r;
+
+                        stacked = true;
+                }
+        }
+
+        if (stacked)
+                return 0;
+
+        r = block_get_whole_disk(devnum, &whole);
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < *n_disks; i++)
+                if ((*disks)[i] == whole)
+                        return 0;
+
+        if (!GREEDY_REALLOC(*disks, *n_allocated, *n_disks + 1))
+                return -ENOMEM;
+
+        (*disks)[(*n_disks)++] = whole;
+        return 0;
+}
+
+static int compare_devnum(const void *a, const void *b) {
+        dev_t x = *(const dev_t*) a, y = *(const dev_t*) b;
+
+        return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static int lock_backing_disks(dev_t devnum, int **ret_fds, size_t *ret_n) {
+        char p[SYS_BLOCK_PATH_MAX("/slaves")];
+        _cleanup_free_ dev_t *disks = NULL;
+        size_t n_disks = 0, n_allocated = 0, i;
+        int *fds, r;
+
+        assert(ret_fds);
+        assert(ret_n);
+
+        /* With -l, fsck serializes all checks on the same disk by taking /run/fsck/<disk>.lock, so that
+         * checks of file systems on different disks run in parallel, but those sharing one don't thrash it.
+         * It skips that for stacked devices however. For those we take the same locks ourselves, on every
+         * disk the device is backed by, in a fixed order. */
+
+        *ret_fds = NULL;
+        *ret_n = 0;
+
+        xsprintf_sys_block_path(p, "/slaves", devnum);
+        r = dir_is_empty(p);
+        if (r == -ENOENT || r > 0)
+                return 0;
+        if (r < 0)
+                return r;
+
+        r = collect_backing_disks(devnum, 0, &disks, &n_disks, &n_allocated);
+        if (r < 0)
+                return r;
+
+        qsort_safe(disks, n_disks, sizeof(dev_t), compare_devnum);
+
+        fds = new(int, n_disks);
+        if (!fds)
+                return -ENOMEM;
+
+        (void) mkdir("/run/fsck", 0755);
+
+        for (i = 0; i < n_disks; i++) {
+                _cleanup_(sd_device_unrefp) sd_device *disk = NULL;
+                const char *name, *path;
+
+                r = sd_device_new_from_devnum(&disk, 'b', disks[i]);
+                if (r >= 0)
+                        r = sd_device_get_sysname(disk, &name);
+                if (r < 0)
+                        goto fail;
+
+                path = strjoina("/run/fsck/", name, ".lock");
+
+                fds[i] = open(path, O_RDONLY|O_CREAT|O_CLOEXEC|O_NOCTTY, 0644);
+                if (fds[i] < 0) {
+                        r = -errno;
+                        goto fail;
+                }
+
+                if (flock(fds[i], LOCK_EX|LOCK_NB) >= 0)
+                        continue;
+
+                if (errno != EWOULDBLOCK) {
+                        r = -errno;
+                        i++;
+                        goto fail;
+                }
+
+                log_info("Waiting for other file system checks on %s to finish.", name);
+
+                if (flock(fds[i], LOCK_EX) < 0) {
+                        r = -errno;
+                        i++;
+                        goto fail;
+                }
+        }
+
+        *ret_fds = fds;
+        *ret_n = n_disks;
+        return 0;
+
+fail:
+        close_many(fds, i);
+        free(fds);
+        return r;
+}
+
 static int fsck_progress_socket(void) {
         static const union sockaddr_union sa = {
                 .un.sun_family = AF_UNIX,
@@ -269,8 +425,11 @@ static int fsck_progress_socket(void) {
 int main(int argc, char *argv[]) {
         _cleanup_close_pair_ int progress_pipe[2] = { -1, -1 };
         _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
+        _cleanup_free_ int *lock_fds = NULL;
+        size_t n_lock_fds = 0;
         const char *device, *type;
         bool root_directory;
+        dev_t devnum;
         struct stat st;
         int r, exit_status;
         pid_t pid;
@@ -371,6 +530,12 @@ int main(int argc, char *argv[]) {
                 }
         }
 
+        r = sd_device_get_devnum(dev, &devnum);
+        if (r >= 0)
+                r = lock_backing_disks(devnum, &lock_fds, &n_lock_fds);
+        if (r < 0)
+                log_warning_errno(r, "Failed to lock the disks backing %s, proceeding: %m", device);
+
         if (arg_show_progress) {
                 if (pipe(progress_pipe) < 0) {
                         r = log_error_errno(errno, "pipe(): %m");
@@ -462,5 +627,7 @@ int main(int argc, char *argv[]) {
                 (void) touch("/run/systemd/quotacheck");
 
 finish:
+        close_many(lock_fds, n_lock_fds);
+
         return r < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -46,7 +46,9 @@ int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
         lease->expiration = UINT64_MAX;
         memcpy(lease->chaddr, chaddr, 16);
         pool_offset = get_pool_offset(server, lease->address);
-        server->bound_leases[pool_offset] = lease;
+        assert_se(pool_offset >= 0);
+        assert_se(hashmap_put(server->bound_leases_by_address, UINT32_TO_PTR(lease->address), lease) >= 0);
+        pool_mark_bound(server, pool_offset, true);
         assert_se(hashmap_put(server->leases_by_client_id, &lease->client_id, lease) >= 0);
 
         (void) dhcp_server_handle_message(server, (DHCPMessage*)data, size);
@@ -9,6 +9,8 @@
 #include "string-table.h"
 #include "util.h"
 
+#define IMPORT_UNCOMPRESS_THREADS_MAX 16U
+
 void import_compress_free(ImportCompress *c) {
         assert(c);
 
@@ -57,7 +59,20 @@ int import_uncompress_detect(ImportCompress *c, const void *data, size_t size) {
         if (memcmp(data, xz_signature, sizeof(xz_signature)) == 0) {
                 lzma_ret xzr;
 
+#if HAVE_LZMA_STREAM_DECODER_MT
+                /* Files compressed with more than one block (as "xz -T" does) can be decompressed in
+                 * parallel too. For single-block files this works just like the single-threaded decoder. */
+                lzma_mt mt = {
+                        .flags = LZMA_TELL_UNSUPPORTED_CHECK | LZMA_CONCATENATED,
+                        .threads = MIN(MAX(lzma_cputhreads(), 1U), IMPORT_UNCOMPRESS_THREADS_MAX),
+                        .memlimit_threading = lzma_physmem() / 4,
+                        .memlimit_stop = UINT64_MAX,
+                };
+
+                xzr = lzma_stream_decoder_mt(&c->xz, &mt);
+#else
                 xzr = lzma_stream_decoder(&c->xz, UINT64_MAX, LZMA_TELL_UNSUPPORTED_CHECK | LZMA_CONCATENATED);
+#endif
                 if (xzr != LZMA_OK)
                         return -EIO;
 
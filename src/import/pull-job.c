@@ -20,10 +20,30 @@
 #include "strv.h"
 #include "xattr-util.h"
 
+/* How often we try to continue an interrupted transfer, and how long we wait before each attempt (multiplied
+ * by the number of the attempt) */
+#define PULL_JOB_RESUME_MAX 10U
+#define PULL_JOB_RESUME_DELAY_USEC (2 * USEC_PER_SEC)
+
+/* How much downloaded data may be waiting for decompression before the download is held up */
+#define PULL_JOB_QUEUE_MAX (16U * 1024U * 1024U)
+
+struct PullJobBuffer {
+        LIST_FIELDS(PullJobBuffer, buffers);
+        size_t size;
+        uint8_t data[];
+};
+
+static int pull_job_worker_stop(PullJob *j);
+
 PullJob* pull_job_unref(PullJob *j) {
         if (!j)
                 return NULL;
 
+        (void) pull_job_worker_stop(j);
+
+        sd_event_source_unref(j->resume_event_source);
+
         curl_glue_remove_and_free(j->glue, j->curl);
         curl_slist_free_all(j->request_header);
 
@@ -49,6 +69,9 @@ static void pull_job_finish(PullJob *j, int ret) {
         if (IN_SET(j->state, PULL_JOB_DONE, PULL_JOB_FAILED))
                 return;
 
+        /* The handlers might do anything with the destination, make sure we are done with it */
+        (void) pull_job_worker_stop(j);
+
         if (ret == 0) {
                 j->state = PULL_JOB_DONE;
                 j->progress_percent = 100;
@@ -70,6 +93,9 @@ static int pull_job_restart(PullJob *j) {
         if (r < 0)
                 return r;
 
+        curl_glue_remove_and_free(j->glue, j->curl);
+        j->curl = NULL;
+
         free(j->url);
         j->url = chksum_url;
         j->state = PULL_JOB_INIT;
@@ -79,6 +105,9 @@ static int pull_job_restart(PullJob *j) {
         j->written_compressed = 0;
         j->written_uncompressed = 0;
         j->written_since_last_grow = 0;
+        j->accept_ranges = false;
+        j->n_resumes = 0;
+        j->resume_offset = 0;
 
         r = pull_job_begin(j);
         if (r < 0)
@@ -87,6 +116,92 @@ static int pull_job_restart(PullJob *j) {
         return 0;
 }
 
+static int pull_job_setup_curl(PullJob *j);
+
+static bool pull_job_can_resume(PullJob *j, CURLcode result) {
+        assert(j);
+
+        if (!IN_SET(result,
+                    CURLE_COULDNT_CONNECT,
+                    CURLE_PARTIAL_FILE,
+                    CURLE_OPERATION_TIMEDOUT,
+                    CURLE_GOT_NOTHING,
+                    CURLE_SEND_ERROR,
+                    CURLE_RECV_ERROR))
+                return false;
+
+        if (!IN_SET(j->state, PULL_JOB_ANALYZING, PULL_JOB_RUNNING))
+                return false;
+
+        /* If-Range needs a strong validator, otherwise we might stitch together two different files */
+        if (!j->accept_ranges || !j->etag || startswith(j->etag, "W/"))
+                return false;
+
+        return j->n_resumes < PULL_JOB_RESUME_MAX;
+}
+
+static int pull_job_on_resume(sd_event_source *s, uint64_t usec, void *userdata) {
+        _cleanup_free_ char *hdr = NULL;
+        PullJob *j = userdata;
+        int r;
+
+        assert(j);
+
+        j->resume_event_source = sd_event_source_unref(j->resume_event_source);
+
+        /* Continue where we left off. Everything we got so far went through the checksum and the decompressor
+         * already, and they simply carry on with the rest. */
+        j->resume_offset = j->state == PULL_JOB_ANALYZING ? j->payload_size : j->written_compressed;
+        j->resume_pending = true;
+
+        hdr = strappend("If-Range: ", j->etag);
+        if (!hdr) {
+                r = log_oom();
+                goto fail;
+        }
+
+        curl_slist_free_all(j->request_header);
+        j->request_header = curl_slist_new(hdr, NULL);
+        if (!j->request_header) {
+                r = log_oom();
+                goto fail;
+        }
+
+        r = pull_job_setup_curl(j);
+        if (r < 0) {
+                log_error_errno(r, "Failed to resume download of %s: %m", j->url);
+                goto fail;
+        }
+
+        return 0;
+
+fail:
+        pull_job_finish(j, r);
+        return 0;
+}
+
+static int pull_job_resume(PullJob *j, CURLcode result) {
+        int r;
+
+        assert(j);
+
+        j->n_resumes++;
+
+        log_warning("Transfer of %s interrupted: %s. Resuming (attempt %u of %u).",
+                    j->url, curl_easy_strerror(result), j->n_resumes, PULL_JOB_RESUME_MAX);
+
+        curl_glue_remove_and_free(j->glue, j->curl);
+        j->curl = NULL;
+
+        r = sd_event_add_time(j->glue->event, &j->resume_event_source, clock_boottime_or_monotonic(),
+                              now(clock_boottime_or_monotonic()) + j->n_resumes * PULL_JOB_RESUME_DELAY_USEC, 0,
+                              pull_job_on_resume, j);
+        if (r < 0)
+                return log_error_errno(r, "Failed to schedule resuming of download: %m");
+
+        return 0;
+}
+
 void pull_job_curl_on_finished(CurlGlue *g, CURL *curl, CURLcode result) {
         PullJob *j = NULL;
         CURLcode code;
@@ -100,6 +215,14 @@ void pull_job_curl_on_finished(CurlGlue *g, CURL *curl, CURLcode result) {
                 return;
 
         if (result != CURLE_OK) {
+                if (pull_job_can_resume(j, result)) {
+                        r = pull_job_resume(j, result);
+                        if (r < 0)
+                                goto finish;
+
+                        return;
+                }
+
                 log_error("Transfer failed: %s", curl_easy_strerror(result));
                 r = -EIO;
                 goto finish;
@@ -158,6 +281,11 @@ void pull_job_curl_on_finished(CurlGlue *g, CURL *curl, CURLcode result) {
                 goto finish;
         }
 
+        /* Wait until everything is decompressed and written */
+        r = pull_job_worker_stop(j);
+        if (r < 0)
+                goto finish;
+
         if (j->checksum_context) {
                 uint8_t *k;
 
@@ -260,6 +388,145 @@ static int pull_job_write_uncompressed(const void *p, size_t sz, void *userdata)
         return 0;
 }
 
+static void *pull_job_worker(void *userdata) {
+        PullJob *j = userdata;
+        int r = 0;
+
+        assert_se(pthread_mutex_lock(&j->worker_mutex) == 0);
+
+        for (;;) {
+                PullJobBuffer *b;
+
+                while (!j->worker_queue && !j->worker_quit)
+                        assert_se(pthread_cond_wait(&j->worker_cond, &j->worker_mutex) == 0);
+
+                b = j->worker_queue;
+                if (!b)
+                        break;
+
+                LIST_REMOVE(buffers, j->worker_queue, b);
+                if (j->worker_queue_tail == b)
+                        j->worker_queue_tail = NULL;
+
+                assert_se(pthread_mutex_unlock(&j->worker_mutex) == 0);
+
+                /* After a failure, we only drain the queue */
+                if (r >= 0)
+                        r = import_uncompress(&j->compress, b->data, b->size, pull_job_write_uncompressed, j);
+
+                assert_se(pthread_mutex_lock(&j->worker_mutex) == 0);
+
+                j->worker_queue_size -= b->size;
+                free(b);
+
+                if (r < 0 && j->worker_error == 0)
+                        j->worker_error = r;
+
+                assert_se(pthread_cond_broadcast(&j->worker_cond) == 0);
+        }
+
+        assert_se(pthread_mutex_unlock(&j->worker_mutex) == 0);
+
+        return NULL;
+}
+
+static void pull_job_worker_start(PullJob *j) {
+        int r;
+
+        assert(j);
+        assert(!j->worker_running);
+
+        /* Only large downloads that go to disk are worth a thread, the payload buffer is for the small
+         * checksum and signature files. */
+        if (j->disk_fd < 0)
+                return;
+
+        j->worker_quit = false;
+        j->worker_error = 0;
+
+        assert_se(pthread_mutex_init(&j->worker_mutex, NULL) == 0);
+        assert_se(pthread_cond_init(&j->worker_cond, NULL) == 0);
+
+        r = pthread_create(&j->worker, NULL, pull_job_worker, j);
+        if (r > 0) {
+                log_debug_errno(r, "Failed to start decompression thread, decompressing inline: %m");
+                pthread_cond_destroy(&j->worker_cond);
+                pthread_mutex_destroy(&j->worker_mutex);
+                return;
+        }
+
+        j->worker_running = true;
+}
+
+static int pull_job_worker_stop(PullJob *j) {
+        int r;
+
+        assert(j);
+
+        /* Waits until everything that is queued is written. Returns the first error the thread ran into. */
+
+        if (!j->worker_running)
+                return 0;
+
+        assert_se(pthread_mutex_lock(&j->worker_mutex) == 0);
+        j->worker_quit = true;
+        assert_se(pthread_cond_broadcast(&j->worker_cond) == 0);
+        assert_se(pthread_mutex_unlock(&j->worker_mutex) == 0);
+
+        (void) pthread_join(j->worker, NULL);
+
+        assert(!j->worker_queue);
+
+        pthread_cond_destroy(&j->worker_cond);
+        pthread_mutex_destroy(&j->worker_mutex);
+
+        j->worker_running = false;
+
+        r = j->worker_error;
+        j->worker_error = 0;
+
+        return r;
+}
+
+static int pull_job_worker_submit(PullJob *j, const void *p, size_t sz) {
+        PullJobBuffer *b;
+        int r;
+
+        assert(j);
+        assert(p);
+
+        if (!j->worker_running)
+                return import_uncompress(&j->compress, p, sz, pull_job_write_uncompressed, j);
+
+        b = malloc(offsetof(PullJobBuffer, data) + sz);
+        if (!b)
+                return log_oom();
+
+        b->size = sz;
+        memcpy(b->data, p, sz);
+
+        assert_se(pthread_mutex_lock(&j->worker_mutex) == 0);
+
+        /* Hold up the download while the queue is full, so that we don't buffer up the whole file if the
+         * disk or the decompression is slower than the network */
+        while (j->worker_error == 0 && j->worker_queue_size >= PULL_JOB_QUEUE_MAX)
+                assert_se(pthread_cond_wait(&j->worker_cond, &j->worker_mutex) == 0);
+
+        r = j->worker_error;
+        if (r == 0) {
+                LIST_INSERT_AFTER(buffers, j->worker_queue, j->worker_queue_tail, b);
+                j->worker_queue_tail = b;
+                j->worker_queue_size += sz;
+                assert_se(pthread_cond_broadcast(&j->worker_cond) == 0);
+                b = NULL;
+        }
+
+        assert_se(pthread_mutex_unlock(&j->worker_mutex) == 0);
+
+        free(b);
+        return r;
+}
+
 static int pull_job_write_compressed(PullJob *j, void *p, size_t sz) {
         int r;
 
@@ -288,7 +555,7 @@ static int pull_job_write_compressed(PullJob *j, void *p, size_t sz) {
         if (j->checksum_context)
                 gcry_md_write(j->checksum_context, p, sz);
 
-        r = import_uncompress(&j->compress, p, sz, pull_job_write_uncompressed, j);
+        r = pull_job_worker_submit(j, p, sz);
         if (r < 0)
                 return r;
 
@@ -351,6 +618,8 @@ static int pull_job_detect_compression(PullJob *j) {
         if (r < 0)
                 return r;
 
+        pull_job_worker_start(j);
+
         /* Now, take the payload we read so far, and decompress it */
         stub = j->payload;
         stub_size = j->payload_size;
@@ -376,6 +645,20 @@ static size_t pull_job_write_callback(void *contents, size_t size, size_t nmemb,
         assert(contents);
         assert(j);
 
+        if (j->resume_pending && IN_SET(j->state, PULL_JOB_ANALYZING, PULL_JOB_RUNNING)) {
+                long status;
+
+                /* The server sends the whole file again if it changed in between, which we can't use */
+                if (curl_easy_getinfo(j->curl, CURLINFO_RESPONSE_CODE, &status) != CURLE_OK ||
+                    status != 206) {
+                        log_error("Server did not continue the download of %s.", j->url);
+                        r = -EIO;
+                        goto fail;
+                }
+
+                j->resume_pending = false;
+        }
+
         switch (j->state) {
 
         case PULL_JOB_ANALYZING:
@@ -422,7 +705,7 @@ fail:
 static size_t pull_job_header_callback(void *contents, size_t size, size_t nmemb, void *userdata) {
         PullJob *j = userdata;
         size_t sz = size * nmemb;
-        _cleanup_free_ char *length = NULL, *last_modified = NULL;
+        _cleanup_free_ char *length = NULL, *last_modified = NULL, *ranges = NULL;
         char *etag;
         int r;
 
@@ -434,7 +717,7 @@ static size_t pull_job_header_callback(void *contents, size_t size, size_t nmemb
                 goto fail;
         }
 
-        assert(j->state == PULL_JOB_ANALYZING);
+        assert(j->state == PULL_JOB_ANALYZING || (j->resume_pending && j->state == PULL_JOB_RUNNING));
 
         r = curl_header_strdup(contents, sz, "ETag:", &etag);
         if (r < 0) {
@@ -442,6 +725,12 @@ static size_t pull_job_header_callback(void *contents, size_t size, size_t nmemb
                 goto fail;
         }
         if (r > 0) {
+                if (j->resume_pending) {
+                        /* If-Range makes sure this is the file we started with, if we get to continue at all */
+                        free(etag);
+                        return sz;
+                }
+
                 free(j->etag);
                 j->etag = etag;
 
@@ -463,6 +752,18 @@ static size_t pull_job_header_callback(void *contents, size_t size, size_t nmemb
         if (r > 0) {
                 (void) safe_atou64(length, &j->content_length);
 
+                /* A partial response carries the length of the rest only */
+                if (j->resume_pending && j->content_length != (uint64_t) -1) {
+                        if (j->content_length > UINT64_MAX - j->resume_offset) {
+                                log_error("Content too large.");
+                                r = -EFBIG;
+                                goto fail;
+                        }
+
+                        j->content_length += j->resume_offset;
+                        return sz;
+                }
+
                 if (j->content_length != (uint64_t) -1) {
                         char bytes[FORMAT_BYTES_MAX];
 
@@ -478,6 +779,17 @@ static size_t pull_job_header_callback(void *contents, size_t size, size_t nmemb
                 return sz;
         }
 
+        r = curl_header_strdup(contents, sz, "Accept-Ranges:", &ranges);
+        if (r < 0) {
+                log_oom();
+                goto fail;
+        }
+        if (r > 0) {
+                if (!j->resume_pending)
+                        j->accept_ranges = streq(ranges, "bytes");
+                return sz;
+        }
+
         r = curl_header_strdup(contents, sz, "Last-Modified:", &last_modified);
         if (r < 0) {
                 log_oom();
@@ -511,6 +823,10 @@ static int pull_job_progress_callback(void *userdata, curl_off_t dltotal, curl_o
         if (dltotal <= 0)
                 return 0;
 
+        /* After resuming, curl only counts what is transferred from there on */
+        dltotal += j->resume_offset;
+        dlnow += j->resume_offset;
+
         percent = ((100 * dlnow) / dltotal);
         n = now(CLOCK_MONOTONIC);
 
@@ -584,10 +900,6 @@ int pull_job_begin(PullJob *j) {
         if (j->grow_machine_directory)
                 grow_machine_directory();
 
-        r = curl_glue_make(&j->curl, j->url, j);
-        if (r < 0)
-                return r;
-
         if (!strv_isempty(j->old_etags)) {
                 _cleanup_free_ char *cc = NULL, *hdr = NULL;
 
@@ -614,6 +926,25 @@ int pull_job_begin(PullJob *j) {
                 }
         }
 
+        r = pull_job_setup_curl(j);
+        if (r < 0)
+                return r;
+
+        j->state = PULL_JOB_ANALYZING;
+
+        return 0;
+}
+
+static int pull_job_setup_curl(PullJob *j) {
+        int r;
+
+        assert(j);
+        assert(!j->curl);
+
+        r = curl_glue_make(&j->curl, j->url, j);
+        if (r < 0)
+                return r;
+
         if (j->request_header) {
                 if (curl_easy_setopt(j->curl, CURLOPT_HTTPHEADER, j->request_header) != CURLE_OK)
                         return -EIO;
@@ -640,11 +971,10 @@ int pull_job_begin(PullJob *j) {
         if (curl_easy_setopt(j->curl, CURLOPT_NOPROGRESS, 0) != CURLE_OK)
                 return -EIO;
 
-        r = curl_glue_add(j->glue, j->curl);
-        if (r < 0)
-                return r;
-
-        j->state = PULL_JOB_ANALYZING;
+        if (j->resume_offset > 0) {
+                if (curl_easy_setopt(j->curl, CURLOPT_RESUME_FROM_LARGE, (curl_off_t) j->resume_offset) != CURLE_OK)
+                        return -EIO;
+        }
 
-        return 0;
+        return curl_glue_add(j->glue, j->curl);
 }
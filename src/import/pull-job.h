@@ -8,12 +8,15 @@
 ***/
 
 #include <gcrypt.h>
+#include <pthread.h>
 
 #include "curl-util.h"
 #include "import-compress.h"
+#include "list.h"
 #include "macro.h"
 
 typedef struct PullJob PullJob;
+typedef struct PullJobBuffer PullJobBuffer;
 
 typedef void (*PullJobFinished)(PullJob *job);
 typedef int (*PullJobOpenDisk)(PullJob *job);
@@ -90,6 +93,27 @@ struct PullJob {
         uint64_t written_since_last_grow;
 
         VerificationStyle style;
+
+        /* Interrupted transfers are continued with a range request, as long as the server supports that
+         * and we have a strong ETag to make sure we continue with the same file */
+        bool accept_ranges;
+        bool resume_pending;
+        unsigned n_resumes;
+        uint64_t resume_offset;
+        sd_event_source *resume_event_source;
+
+        /* Once the destination is open, decompression and writing happen in a separate thread, so that
+         * the download and the checksumming are not held up by them. The thread is fed through a bounded
+         * queue of buffers. */
+        bool worker_running;
+        bool worker_quit;
+        int worker_error;
+        pthread_t worker;
+        pthread_mutex_t worker_mutex;
+        pthread_cond_t worker_cond;
+        LIST_HEAD(PullJobBuffer, worker_queue);
+        PullJobBuffer *worker_queue_tail;
+        size_t worker_queue_size;
 };
 
 int pull_job_new(PullJob **job, const char *url, CurlGlue *glue, void *userdata);
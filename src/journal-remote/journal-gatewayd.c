@@ -11,6 +11,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+#if HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 #include "sd-bus.h"
 #include "sd-daemon.h"
@@ -27,15 +33,39 @@
 #include "os-util.h"
 #include "parse-util.h"
 #include "sigbus.h"
+#include "strv.h"
 #include "util.h"
 
 #define JOURNAL_WAIT_TIMEOUT (10*USEC_PER_SEC)
 
+/* Block size for the entry responses, larger blocks mean fewer writes and chunks on busy streams */
+#define ENTRIES_BLOCK_SIZE (64*1024)
+
 static char *arg_key_pem = NULL;
 static char *arg_cert_pem = NULL;
 static char *arg_trust_pem = NULL;
 static char *arg_directory = NULL;
 
+typedef enum Encoding {
+        ENCODING_IDENTITY,
+        ENCODING_GZIP,
+        ENCODING_ZSTD,
+        _ENCODING_MAX,
+        _ENCODING_INVALID = -1,
+} Encoding;
+
+typedef enum EncoderAction {
+        ENCODER_CONTINUE,
+        ENCODER_FLUSH,
+        ENCODER_FINISH,
+} EncoderAction;
+
+static const char* const encoding_names[_ENCODING_MAX] = {
+        [ENCODING_IDENTITY] = "identity",
+        [ENCODING_GZIP] = "gzip",
+        [ENCODING_ZSTD] = "zstd",
+};
+
 typedef struct RequestMeta {
         sd_journal *journal;
 
@@ -56,6 +86,24 @@ typedef struct RequestMeta {
 
         uint64_t n_fields;
         bool n_fields_set;
+
+        usec_t since, until;
+        bool since_set, until_set;
+
+        char **output_fields;
+
+        /* Content-Encoding of the response, the uncompressed stream is read into ibuf and encoded from there */
+        Encoding encoding;
+        char *ibuf;
+        size_t ibuf_offset, ibuf_filled;
+        uint64_t raw_pos;
+        bool eof, flush_pending, finished;
+#if HAVE_ZLIB
+        z_stream *gzip;
+#endif
+#if HAVE_ZSTD
+        ZSTD_CCtx *zstd;
+#endif
 } RequestMeta;
 
 static const char* const mime_types[_OUTPUT_MODE_MAX] = {
@@ -95,6 +143,18 @@ static void request_meta_free(
 
         safe_fclose(m->tmp);
 
+#if HAVE_ZLIB
+        if (m->gzip) {
+                (void) deflateEnd(m->gzip);
+                free(m->gzip);
+        }
+#endif
+#if HAVE_ZSTD
+        ZSTD_freeCCtx(m->zstd);
+#endif
+        free(m->ibuf);
+
+        strv_free(m->output_fields);
         free(m->cursor);
         free(m);
 }
@@ -133,13 +193,12 @@ static int request_meta_ensure_tmp(RequestMeta *m) {
         return 0;
 }
 
-static ssize_t request_reader_entries(
-                void *cls,
+static ssize_t request_reader_entries_raw(
+                RequestMeta *m,
                 uint64_t pos,
                 char *buf,
                 size_t max) {
 
-        RequestMeta *m = cls;
         int r;
         size_t n, k;
 
@@ -187,6 +246,24 @@ static ssize_t request_reader_entries(
                         return MHD_CONTENT_READER_END_OF_STREAM;
                 }
 
+                if (m->since_set || m->until_set) {
+                        usec_t t;
+
+                        r = sd_journal_get_realtime_usec(m->journal, &t);
+                        if (r < 0) {
+                                log_error_errno(r, "Failed to get timestamp: %m");
+                                return MHD_CONTENT_READER_END_WITH_ERROR;
+                        }
+
+                        if (m->until_set && t > m->until)
+                                return MHD_CONTENT_READER_END_OF_STREAM;
+
+                        if (m->since_set && t < m->since) {
+                                m->n_skip = 0;
+                                continue;
+                        }
+                }
+
                 if (m->discrete) {
                         assert(m->cursor);
 
@@ -215,7 +292,7 @@ static ssize_t request_reader_entries(
                 }
 
                 r = output_journal(m->tmp, m->journal, m->mode, 0, OUTPUT_FULL_WIDTH,
-                                   NULL, NULL, NULL);
+                                   m->output_fields, NULL, NULL);
                 if (r < 0) {
                         log_error_errno(r, "Failed to serialize item: %m");
                         return MHD_CONTENT_READER_END_WITH_ERROR;
@@ -254,6 +331,284 @@ static ssize_t request_reader_entries(
         return (ssize_t) k;
 }
 
+static int encoder_init(RequestMeta *m) {
+        assert(m);
+
+        switch (m->encoding) {
+
+#if HAVE_ZLIB
+        case ENCODING_GZIP:
+                m->gzip = new0(z_stream, 1);
+                if (!m->gzip)
+                        return -ENOMEM;
+
+                /* 15 bits of window, plus 16 for a gzip rather than a zlib header */
+                if (deflateInit2(m->gzip, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                        m->gzip = mfree(m->gzip);
+                        return -ENOMEM;
+                }
+                break;
+#endif
+
+#if HAVE_ZSTD
+        case ENCODING_ZSTD:
+                m->zstd = ZSTD_createCCtx();
+                if (!m->zstd)
+                        return -ENOMEM;
+                break;
+#endif
+
+        default:
+                return 0;
+        }
+
+        m->ibuf = malloc(ENTRIES_BLOCK_SIZE);
+        if (!m->ibuf)
+                return -ENOMEM;
+
+        return 0;
+}
+
+static int encoder_run(
+                RequestMeta *m,
+                EncoderAction action,
+                size_t *ret_produced,
+                bool *ret_complete,
+                char *buf,
+                size_t max) {
+
+        const char *in;
+        size_t in_size;
+
+        assert(m);
+        assert(ret_produced);
+        assert(ret_complete);
+        assert(buf);
+
+        in = m->ibuf + m->ibuf_offset;
+        in_size = m->ibuf_filled - m->ibuf_offset;
+
+        switch (m->encoding) {
+
+#if HAVE_ZLIB
+        case ENCODING_GZIP: {
+                static const int flush[] = {
+                        [ENCODER_CONTINUE] = Z_NO_FLUSH,
+                        [ENCODER_FLUSH] = Z_SYNC_FLUSH,
+                        [ENCODER_FINISH] = Z_FINISH,
+                };
+                int r;
+
+                m->gzip->next_in = (Bytef*) in;
+                m->gzip->avail_in = in_size;
+                m->gzip->next_out = (Bytef*) buf;
+                m->gzip->avail_out = max;
+
+                r = deflate(m->gzip, flush[action]);
+                if (!IN_SET(r, Z_OK, Z_STREAM_END, Z_BUF_ERROR))
+                        return -EIO;
+
+                m->ibuf_offset += in_size - m->gzip->avail_in;
+                *ret_produced = max - m->gzip->avail_out;
+
+                /* A flush is done when there was room left in the output buffer, Z_BUF_ERROR means there
+                 * was nothing left to do at all. */
+                if (action == ENCODER_FINISH)
+                        *ret_complete = r == Z_STREAM_END;
+                else
+                        *ret_complete = m->gzip->avail_in == 0 && (m->gzip->avail_out > 0 || r == Z_BUF_ERROR);
+
+                return 0;
+        }
+#endif
+
+#if HAVE_ZSTD
+        case ENCODING_ZSTD: {
+                static const ZSTD_EndDirective directive[] = {
+                        [ENCODER_CONTINUE] = ZSTD_e_continue,
+                        [ENCODER_FLUSH] = ZSTD_e_flush,
+                        [ENCODER_FINISH] = ZSTD_e_end,
+                };
+                ZSTD_inBuffer input = {
+                        .src = in,
+                        .size = in_size,
+                };
+                ZSTD_outBuffer output = {
+                        .dst = buf,
+                        .size = max,
+                };
+                size_t k;
+
+                k = ZSTD_compressStream2(m->zstd, &output, &input, directive[action]);
+                if (ZSTD_isError(k))
+                        return -EIO;
+
+                m->ibuf_offset += input.pos;
+                *ret_produced = output.pos;
+                *ret_complete = k == 0 && input.pos == input.size;
+
+                return 0;
+        }
+#endif
+
+        default:
+                assert_not_reached("Unexpected encoding");
+        }
+}
+
+static ssize_t request_reader_entries_encoded(
+                RequestMeta *m,
+                char *buf,
+                size_t max) {
+
+        assert(m);
+        assert(buf);
+        assert(max > 0);
+
+        for (;;) {
+                EncoderAction action;
+                size_t produced;
+                bool complete;
+                int r;
+
+                if (m->finished)
+                        return MHD_CONTENT_READER_END_OF_STREAM;
+
+                if (m->ibuf_offset >= m->ibuf_filled && !m->eof && !m->flush_pending) {
+                        ssize_t n;
+
+                        n = request_reader_entries_raw(m, m->raw_pos, m->ibuf, ENTRIES_BLOCK_SIZE);
+                        if (n == MHD_CONTENT_READER_END_WITH_ERROR)
+                                return n;
+                        if (n == MHD_CONTENT_READER_END_OF_STREAM)
+                                m->eof = true;
+                        else if (n == 0)
+                                /* Nothing new while following, everything before was flushed already */
+                                return 0;
+                        else {
+                                m->raw_pos += n;
+                                m->ibuf_offset = 0;
+                                m->ibuf_filled = n;
+
+                                /* When following, the client wants to see each entry right away. The
+                                 * compression context is kept across flushes, so this costs only a few
+                                 * bytes per entry. */
+                                if (m->follow)
+                                        m->flush_pending = true;
+                        }
+                }
+
+                action = m->eof ? ENCODER_FINISH :
+                         m->flush_pending ? ENCODER_FLUSH : ENCODER_CONTINUE;
+
+                r = encoder_run(m, action, &produced, &complete, buf, max);
+                if (r < 0) {
+                        log_error_errno(r, "Failed to compress entries: %m");
+                        return MHD_CONTENT_READER_END_WITH_ERROR;
+                }
+
+                if (action != ENCODER_CONTINUE && complete) {
+                        m->flush_pending = false;
+                        m->finished = action == ENCODER_FINISH;
+                }
+
+                if (produced > 0)
+                        return (ssize_t) produced;
+        }
+}
+
+static ssize_t request_reader_entries(
+                void *cls,
+                uint64_t pos,
+                char *buf,
+                size_t max) {
+
+        RequestMeta *m = cls;
+
+        assert(m);
+
+        if (m->encoding == ENCODING_IDENTITY)
+                return request_reader_entries_raw(m, pos, buf, max);
+
+        return request_reader_entries_encoded(m, buf, max);
+}
+
+static bool encoding_supported(Encoding e) {
+        switch (e) {
+
+        case ENCODING_IDENTITY:
+                return true;
+
+        case ENCODING_GZIP:
+                return HAVE_ZLIB;
+
+        case ENCODING_ZSTD:
+                return HAVE_ZSTD;
+
+        default:
+                return false;
+        }
+}
+
+static int request_parse_accept_encoding(
+                RequestMeta *m,
+                struct MHD_Connection *connection) {
+
+        const char *header, *p;
+        bool accepted[_ENCODING_MAX] = {};
+        Encoding e;
+
+        assert(m);
+        assert(connection);
+
+        m->encoding = ENCODING_IDENTITY;
+
+        header = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Accept-Encoding");
+        if (!header)
+                return 0;
+
+        /* Only a q-value of zero is honoured, otherwise we simply pick the best encoding we support */
+        p = header;
+        for (;;) {
+                _cleanup_free_ char *word = NULL;
+                char *q;
+                int r;
+
+                r = extract_first_word(&p, &word, ",", 0);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+
+                q = strchr(word, ';');
+                if (q) {
+                        *q++ = 0;
+                        q += strspn(q, WHITESPACE);
+                        if (startswith(q, "q=") && strspn(q + 2, "0.") == strlen(q + 2))
+                                continue;
+                }
+
+                delete_trailing_chars(word, WHITESPACE);
+
+                if (streq(word, "*")) {
+                        for (e = 0; e < _ENCODING_MAX; e++)
+                                accepted[e] = true;
+                        continue;
+                }
+
+                for (e = 0; e < _ENCODING_MAX; e++)
+                        if (strcaseeq(word, encoding_names[e]))
+                                accepted[e] = true;
+        }
+
+        if (accepted[ENCODING_ZSTD] && encoding_supported(ENCODING_ZSTD))
+                m->encoding = ENCODING_ZSTD;
+        else if (accepted[ENCODING_GZIP] && encoding_supported(ENCODING_GZIP))
+                m->encoding = ENCODING_GZIP;
+
+        return 0;
+}
+
 static int request_parse_accept(
                 RequestMeta *m,
                 struct MHD_Connection *connection) {
@@ -392,6 +747,44 @@ static int request_parse_arguments_iterator(
                 return MHD_YES;
         }
 
+        if (STR_IN_SET(key, "since", "until")) {
+                usec_t t;
+
+                r = parse_timestamp(strempty(value), &t);
+                if (r < 0) {
+                        m->argument_parse_error = r;
+                        return MHD_NO;
+                }
+
+                if (streq(key, "since")) {
+                        m->since = t;
+                        m->since_set = true;
+                } else {
+                        m->until = t;
+                        m->until_set = true;
+                }
+
+                return MHD_YES;
+        }
+
+        if (streq(key, "fields")) {
+                _cleanup_strv_free_ char **l = NULL;
+
+                l = strv_split(strempty(value), ",");
+                if (!l) {
+                        m->argument_parse_error = log_oom();
+                        return MHD_NO;
+                }
+
+                r = strv_extend_strv(&m->output_fields, l, true);
+                if (r < 0) {
+                        m->argument_parse_error = r;
+                        return MHD_NO;
+                }
+
+                return MHD_YES;
+        }
+
         if (streq(key, "boot")) {
                 if (isempty(value))
                         r = true;
@@ -476,6 +869,15 @@ static int request_handler_entries(
         if (request_parse_arguments(m, connection) < 0)
                 return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Failed to parse URL arguments.");
 
+        if (request_parse_accept_encoding(m, connection) < 0)
+                return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Failed to parse Accept-Encoding header.");
+
+        if (m->since_set && m->until_set && m->since > m->until)
+                return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Lower time bound is past the upper one.");
+
+        if (encoder_init(m) < 0)
+                return respond_oom(connection);
+
         if (m->discrete) {
                 if (!m->cursor)
                         return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Discrete seeks require a cursor specification.");
@@ -486,6 +888,8 @@ static int request_handler_entries(
 
         if (m->cursor)
                 r = sd_journal_seek_cursor(m->journal, m->cursor);
+        else if (m->since_set && m->n_skip >= 0)
+                r = sd_journal_seek_realtime_usec(m->journal, m->since);
         else if (m->n_skip >= 0)
                 r = sd_journal_seek_head(m->journal);
         else if (m->n_skip < 0)
@@ -493,11 +897,14 @@ static int request_handler_entries(
         if (r < 0)
                 return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Failed to seek in journal.");
 
-        response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, 4*1024, request_reader_entries, m, NULL);
+        response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, ENTRIES_BLOCK_SIZE, request_reader_entries, m, NULL);
         if (!response)
                 return respond_oom(connection);
 
         MHD_add_response_header(response, "Content-Type", mime_types[m->mode]);
+        MHD_add_response_header(response, "Vary", "Accept-Encoding");
+        if (m->encoding != ENCODING_IDENTITY)
+                MHD_add_response_header(response, "Content-Encoding", encoding_names[m->encoding]);
 
         r = MHD_queue_response(connection, MHD_HTTP_OK, response);
         MHD_destroy_response(response);
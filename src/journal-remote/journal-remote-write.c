@@ -5,8 +5,52 @@
   Copyright 2012 Zbigniew Jędrzejewski-Szmek
 ***/
 
+#include <pthread.h>
+
 #include "alloc-util.h"
+#include "io-util.h"
 #include "journal-remote.h"
+#include "list.h"
+
+/* With --write-threads= writers are distributed over a number of shards, each of which is served by its own
+ * thread. Entries are still parsed on the event loop, but then copied and queued to the shard of their
+ * writer, which appends them to the writer's journal file. Each writer, along with its journal file and
+ * mmap cache, is only ever touched by its shard thread while the shard is running. */
+
+/* Don't let the queue grow without bounds if a shard can't keep up */
+#define WRITER_SHARD_QUEUE_MAX 1024U
+
+/* The maximum number of queued entries a shard appends in one go */
+#define WRITER_SHARD_BATCH_MAX 64U
+
+typedef struct PendingWrite PendingWrite;
+
+struct PendingWrite {
+        Writer *writer;
+        dual_timestamp ts;
+        bool compress;
+        bool seal;
+
+        LIST_FIELDS(PendingWrite, writes);
+
+        size_t n_iovec;
+        struct iovec iovec[];
+};
+
+struct WriterShard {
+        pthread_t thread;
+
+        pthread_mutex_t mutex;
+        pthread_cond_t work_cond; /* signalled when new entries are queued, or on shutdown */
+        pthread_cond_t done_cond; /* signalled when an entry has been written */
+        bool quit;
+
+        /* Everything below is protected by the mutex */
+        LIST_HEAD(PendingWrite, writes);
+        PendingWrite *writes_tail;
+        unsigned n_writes;
+        bool busy;
+};
 
 static int do_rotate(JournalFile **f, bool compress, bool seal) {
         int r = journal_file_rotate(f, compress, (uint64_t) -1, seal, NULL);
@@ -43,6 +87,10 @@ Writer* writer_free(Writer *w) {
         if (!w)
                 return NULL;
 
+        /* Entries queued for this writer refer to it, let them be written first */
+        if (w->shard)
+                writer_shard_drain(w->shard);
+
         if (w->journal) {
                 log_debug("Closing journal file %s.", w->journal->path);
                 journal_file_close(w->journal);
@@ -73,43 +121,286 @@ Writer* writer_ref(Writer *w) {
         return w;
 }
 
-int writer_write(Writer *w,
-                 struct iovec_wrapper *iovw,
-                 dual_timestamp *ts,
-                 bool compress,
-                 bool seal) {
+static int writer_append_entries(Writer *w,
+                                 const JournalFileEntry *entries,
+                                 size_t n_entries,
+                                 bool compress,
+                                 bool seal,
+                                 size_t *ret_n_appended) {
+        bool rotated = false;
+        size_t n = 0, k;
         int r;
 
         assert(w);
-        assert(iovw);
-        assert(iovw->count > 0);
+        assert(entries);
+        assert(n_entries > 0);
+        assert(ret_n_appended);
+
+        /* On failure, the number of entries appended before the one that failed is returned */
 
         if (journal_file_rotate_suggested(w->journal, 0)) {
                 log_info("%s: Journal header limits reached or header out-of-date, rotating",
                          w->journal->path);
                 r = do_rotate(&w->journal, compress, seal);
                 if (r < 0)
-                        return r;
+                        goto finish;
         }
 
-        r = journal_file_append_entry(w->journal, ts, iovw->iovec, iovw->count,
-                                      &w->seqnum, NULL, NULL);
-        if (r >= 0) {
-                if (w->server)
-                        w->server->event_count += 1;
-                return 1;
+        for (;;) {
+                r = journal_file_append_entries(w->journal, entries + n, n_entries - n, &w->seqnum, &k);
+                n += k;
+                if (r >= 0) {
+                        r = 1;
+                        break;
+                }
+
+                /* Rotate at most once for the same entry */
+                if ((rotated && k == 0) || n >= n_entries)
+                        break;
+
+                log_debug_errno(r, "%s: Write failed, rotating: %m", w->journal->path);
+                r = do_rotate(&w->journal, compress, seal);
+                if (r < 0)
+                        break;
+                else
+                        log_debug("%s: Successfully rotated journal", w->journal->path);
+
+                log_debug("Retrying write.");
+                rotated = true;
         }
 
-        log_debug_errno(r, "%s: Write failed, rotating: %m", w->journal->path);
-        r = do_rotate(&w->journal, compress, seal);
-        if (r < 0)
-                return r;
-        else
-                log_debug("%s: Successfully rotated journal", w->journal->path);
+finish:
+        *ret_n_appended = n;
+        return r;
+}
+
+static int writer_append(Writer *w,
+                         const struct iovec *iovec,
+                         size_t n_iovec,
+                         const dual_timestamp *ts,
+                         bool compress,
+                         bool seal) {
+        JournalFileEntry e = {
+                .ts = ts,
+                .iovec = iovec,
+                .n_iovec = n_iovec,
+        };
+        size_t n;
+
+        assert(iovec);
+        assert(n_iovec > 0);
+
+        return writer_append_entries(w, &e, 1, compress, seal, &n);
+}
+
+static PendingWrite* pending_write_new(Writer *w,
+                                       struct iovec_wrapper *iovw,
+                                       const dual_timestamp *ts,
+                                       bool compress,
+                                       bool seal) {
+        PendingWrite *p;
+        uint8_t *d;
+        size_t i;
+
+        /* The iovecs point into the importer's buffer, which is reused for the next entry, hence copy the
+         * fields along with the entry */
+        p = malloc(offsetof(PendingWrite, iovec) + iovw->count * sizeof(struct iovec) + iovw_size(iovw));
+        if (!p)
+                return NULL;
+
+        *p = (PendingWrite) {
+                .writer = w,
+                .ts = *ts,
+                .compress = compress,
+                .seal = seal,
+                .n_iovec = iovw->count,
+        };
+
+        d = (uint8_t*) (p->iovec + p->n_iovec);
+        for (i = 0; i < iovw->count; i++) {
+                p->iovec[i] = IOVEC_MAKE(d, iovw->iovec[i].iov_len);
+                d = mempcpy(d, iovw->iovec[i].iov_base, iovw->iovec[i].iov_len);
+        }
+
+        return p;
+}
+
+static void* writer_shard_thread(void *userdata) {
+        WriterShard *shard = userdata;
+
+        assert_se(pthread_mutex_lock(&shard->mutex) == 0);
+
+        for (;;) {
+                PendingWrite *batch[WRITER_SHARD_BATCH_MAX];
+                JournalFileEntry entries[WRITER_SHARD_BATCH_MAX];
+                size_t i, n = 0, k;
+                int r;
+
+                while (!shard->writes && !shard->quit)
+                        assert_se(pthread_cond_wait(&shard->work_cond, &shard->mutex) == 0);
+
+                if (!shard->writes)
+                        break; /* Only quit once everything queued has been written */
+
+                /* Take as many entries for the same journal file as we can, and append them together */
+                while (shard->writes && n < ELEMENTSOF(batch)) {
+                        PendingWrite *p = shard->writes;
+
+                        if (n > 0 &&
+                            (p->writer != batch[0]->writer || p->compress != batch[0]->compress || p->seal != batch[0]->seal))
+                                break;
+
+                        LIST_REMOVE(writes, shard->writes, p);
+                        if (shard->writes_tail == p)
+                                shard->writes_tail = NULL;
+                        shard->n_writes--;
+
+                        entries[n] = (JournalFileEntry) {
+                                .ts = &p->ts,
+                                .iovec = p->iovec,
+                                .n_iovec = p->n_iovec,
+                        };
+                        batch[n++] = p;
+                }
+
+                shard->busy = true;
+
+                assert_se(pthread_mutex_unlock(&shard->mutex) == 0);
+
+                for (i = 0; i < n; i += k + 1) {
+                        r = writer_append_entries(batch[0]->writer, entries + i, n - i, batch[0]->compress, batch[0]->seal, &k);
+                        if (r >= 0)
+                                break;
 
-        log_debug("Retrying write.");
-        r = journal_file_append_entry(w->journal, ts, iovw->iovec, iovw->count,
-                                      &w->seqnum, NULL, NULL);
+                        if (i + k >= n) {
+                                log_error_errno(r, "Failed to write entries: %m");
+                                break;
+                        }
+
+                        /* Drop the entry that failed, and continue with the rest */
+                        log_error_errno(r, "Failed to write entry of %zu bytes: %m",
+                                        IOVEC_TOTAL_SIZE(entries[i + k].iovec, entries[i + k].n_iovec));
+                }
+
+                for (i = 0; i < n; i++)
+                        free(batch[i]);
+
+                assert_se(pthread_mutex_lock(&shard->mutex) == 0);
+
+                shard->busy = false;
+                assert_se(pthread_cond_broadcast(&shard->done_cond) == 0);
+        }
+
+        assert_se(pthread_mutex_unlock(&shard->mutex) == 0);
+
+        return NULL;
+}
+
+int writer_shard_new(WriterShard **ret) {
+        _cleanup_free_ WriterShard *shard = NULL;
+        int r;
+
+        assert(ret);
+
+        shard = new0(WriterShard, 1);
+        if (!shard)
+                return -ENOMEM;
+
+        assert_se(pthread_mutex_init(&shard->mutex, NULL) == 0);
+        assert_se(pthread_cond_init(&shard->work_cond, NULL) == 0);
+        assert_se(pthread_cond_init(&shard->done_cond, NULL) == 0);
+
+        /* The thread inherits our signal mask, which blocks all signals we handle on the event loop */
+        r = pthread_create(&shard->thread, NULL, writer_shard_thread, shard);
+        if (r > 0) {
+                assert_se(pthread_cond_destroy(&shard->done_cond) == 0);
+                assert_se(pthread_cond_destroy(&shard->work_cond) == 0);
+                assert_se(pthread_mutex_destroy(&shard->mutex) == 0);
+                return -r;
+        }
+
+        *ret = TAKE_PTR(shard);
+        return 0;
+}
+
+WriterShard* writer_shard_free(WriterShard *shard) {
+        if (!shard)
+                return NULL;
+
+        /* The thread writes out everything still queued before it exits */
+        assert_se(pthread_mutex_lock(&shard->mutex) == 0);
+        shard->quit = true;
+        assert_se(pthread_cond_signal(&shard->work_cond) == 0);
+        assert_se(pthread_mutex_unlock(&shard->mutex) == 0);
+
+        assert_se(pthread_join(shard->thread, NULL) == 0);
+
+        assert(!shard->writes);
+
+        assert_se(pthread_cond_destroy(&shard->done_cond) == 0);
+        assert_se(pthread_cond_destroy(&shard->work_cond) == 0);
+        assert_se(pthread_mutex_destroy(&shard->mutex) == 0);
+
+        return mfree(shard);
+}
+
+void writer_shard_drain(WriterShard *shard) {
+        assert(shard);
+
+        assert_se(pthread_mutex_lock(&shard->mutex) == 0);
+
+        while (shard->writes || shard->busy)
+                assert_se(pthread_cond_wait(&shard->done_cond, &shard->mutex) == 0);
+
+        assert_se(pthread_mutex_unlock(&shard->mutex) == 0);
+}
+
+static int writer_queue(Writer *w,
+                        struct iovec_wrapper *iovw,
+                        dual_timestamp *ts,
+                        bool compress,
+                        bool seal) {
+        WriterShard *shard = w->shard;
+        PendingWrite *p;
+
+        p = pending_write_new(w, iovw, ts, compress, seal);
+        if (!p) {
+                /* Keep the order of entries, even if that means we have to wait for the shard */
+                writer_shard_drain(shard);
+                return writer_append(w, iovw->iovec, iovw->count, ts, compress, seal);
+        }
+
+        assert_se(pthread_mutex_lock(&shard->mutex) == 0);
+
+        while (shard->n_writes >= WRITER_SHARD_QUEUE_MAX)
+                assert_se(pthread_cond_wait(&shard->done_cond, &shard->mutex) == 0);
+
+        LIST_INSERT_AFTER(writes, shard->writes, shard->writes_tail, p);
+        shard->writes_tail = p;
+        shard->n_writes++;
+
+        assert_se(pthread_cond_signal(&shard->work_cond) == 0);
+        assert_se(pthread_mutex_unlock(&shard->mutex) == 0);
+
+        return 1;
+}
+
+int writer_write(Writer *w,
+                 struct iovec_wrapper *iovw,
+                 dual_timestamp *ts,
+                 bool compress,
+                 bool seal) {
+        int r;
+
+        assert(w);
+        assert(iovw);
+        assert(iovw->count > 0);
+
+        /* With a shard the entry is written asynchronously, and errors are only logged */
+        if (w->shard)
+                r = writer_queue(w, iovw, ts, compress, seal);
+        else
+                r = writer_append(w, iovw->iovec, iovw->count, ts, compress, seal);
         if (r < 0)
                 return r;
 
@@ -11,6 +11,7 @@
 #include "journal-importer.h"
 
 typedef struct RemoteServer RemoteServer;
+typedef struct WriterShard WriterShard;
 
 typedef struct Writer {
         JournalFile *journal;
@@ -22,6 +23,9 @@ typedef struct Writer {
 
         uint64_t seqnum;
 
+        /* If set, entries are written by the thread of this shard */
+        WriterShard *shard;
+
         int n_ref;
 } Writer;
 
@@ -39,6 +43,10 @@ int writer_write(Writer *s,
                  bool compress,
                  bool seal);
 
+int writer_shard_new(WriterShard **ret);
+WriterShard* writer_shard_free(WriterShard *shard);
+void writer_shard_drain(WriterShard *shard);
+
 typedef enum JournalWriteSplitMode {
         JOURNAL_WRITE_SPLIT_NONE,
         JOURNAL_WRITE_SPLIT_HOST,
@@ -45,6 +45,8 @@
 #define CERT_FILE     CERTIFICATE_ROOT "/certs/journal-remote.pem"
 #define TRUST_FILE    CERTIFICATE_ROOT "/ca/trusted.pem"
 
+#define WRITE_THREADS_MAX 64U
+
 static char* arg_url = NULL;
 static char* arg_getter = NULL;
 static char* arg_listen_raw = NULL;
@@ -58,6 +60,7 @@ static char** arg_gnutls_log = NULL;
 
 static JournalWriteSplitMode arg_split_mode = _JOURNAL_WRITE_SPLIT_INVALID;
 static char* arg_output = NULL;
+static unsigned arg_write_threads = 0;
 
 static char *arg_key = NULL;
 static char *arg_cert = NULL;
@@ -203,6 +206,37 @@ static int init_writer_hashmap(RemoteServer *s) {
         return 0;
 }
 
+static int init_writer_shards(RemoteServer *s) {
+        unsigned n;
+        int r;
+
+        assert(s);
+
+        if (arg_write_threads == 0)
+                return 0;
+
+        /* There's no point in more shards than output files */
+        n = arg_split_mode == JOURNAL_WRITE_SPLIT_NONE ? 1 : MIN(arg_write_threads, WRITE_THREADS_MAX);
+
+        s->shards = new0(WriterShard*, n);
+        if (!s->shards)
+                return log_oom();
+
+        for (; s->n_shards < n; s->n_shards++) {
+                r = writer_shard_new(s->shards + s->n_shards);
+                if (r < 0) {
+                        if (s->n_shards == 0)
+                                return log_error_errno(r, "Failed to start writer thread: %m");
+
+                        log_warning_errno(r, "Failed to start writer thread, continuing with %u threads: %m", s->n_shards);
+                        break;
+                }
+        }
+
+        log_debug("Started %u writer threads.", s->n_shards);
+        return 0;
+}
+
 static int get_writer(RemoteServer *s, const char *host, Writer **writer) {
         _cleanup_(writer_unrefp) Writer *w = NULL;
         const void *key;
@@ -230,6 +264,10 @@ static int get_writer(RemoteServer *s, const char *host, Writer **writer) {
                 if (!w)
                         return log_oom();
 
+                /* Distribute the writers over the shards round-robin */
+                if (s->n_shards > 0)
+                        w->shard = s->shards[s->next_shard++ % s->n_shards];
+
                 if (arg_split_mode == JOURNAL_WRITE_SPLIT_HOST) {
                         w->hashmap_key = strdup(key);
                         if (!w->hashmap_key)
@@ -865,6 +903,10 @@ static int remoteserver_init(RemoteServer *s,
         if (r < 0)
                 return r;
 
+        r = init_writer_shards(s);
+        if (r < 0)
+                return r;
+
         n = sd_listen_fds(true);
         if (n < 0)
                 return log_error_errno(n, "Failed to read listening file descriptors from environment: %m");
@@ -1030,6 +1072,11 @@ static void server_destroy(RemoteServer *s) {
         writer_unref(s->_single_writer);
         hashmap_free(s->writers);
 
+        /* All writers are gone now, hence nothing is queued anymore */
+        for (i = 0; i < s->n_shards; i++)
+                writer_shard_free(s->shards[i]);
+        free(s->shards);
+
         sd_event_source_unref(s->sigterm_event);
         sd_event_source_unref(s->sigint_event);
         sd_event_source_unref(s->listen_event);
@@ -1213,6 +1260,7 @@ static int parse_config(void) {
         const ConfigTableItem items[] = {
                 { "Remote",  "Seal",                   config_parse_bool,             0, &arg_seal       },
                 { "Remote",  "SplitMode",              config_parse_write_split_mode, 0, &arg_split_mode },
+                { "Remote",  "WriteThreads",           config_parse_unsigned,         0, &arg_write_threads },
                 { "Remote",  "ServerKeyFile",          config_parse_path,             0, &arg_key        },
                 { "Remote",  "ServerCertificateFile",  config_parse_path,             0, &arg_cert       },
                 { "Remote",  "TrustedCertificateFile", config_parse_path,             0, &arg_trust      },
@@ -1246,6 +1294,7 @@ static void help(void) {
                "     --gnutls-log=CATEGORY...\n"
                "                            Specify a list of gnutls logging categories\n"
                "     --split-mode=none|host How many output files to create\n"
+               "     --write-threads=N      Write output files from N threads (default: 0)\n"
                "\n"
                "Note: file descriptors from sd_listen_fds() will be consumed, too.\n"
                , program_invocation_short_name);
@@ -1260,6 +1309,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_LISTEN_HTTPS,
                 ARG_GETTER,
                 ARG_SPLIT_MODE,
+                ARG_WRITE_THREADS,
                 ARG_COMPRESS,
                 ARG_SEAL,
                 ARG_KEY,
@@ -1278,6 +1328,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "listen-https", required_argument, NULL, ARG_LISTEN_HTTPS },
                 { "output",       required_argument, NULL, 'o'              },
                 { "split-mode",   required_argument, NULL, ARG_SPLIT_MODE   },
+                { "write-threads", required_argument, NULL, ARG_WRITE_THREADS },
                 { "compress",     optional_argument, NULL, ARG_COMPRESS     },
                 { "seal",         optional_argument, NULL, ARG_SEAL         },
                 { "key",          required_argument, NULL, ARG_KEY          },
@@ -1418,6 +1469,12 @@ static int parse_argv(int argc, char *argv[]) {
                         }
                         break;
 
+                case ARG_WRITE_THREADS:
+                        r = safe_atou(optarg, &arg_write_threads);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse --write-threads= parameter: %s", optarg);
+                        break;
+
                 case ARG_COMPRESS:
                         if (optarg) {
                                 r = parse_boolean(optarg);
@@ -36,6 +36,10 @@ struct RemoteServer {
         Writer *_single_writer;
         uint64_t event_count;
 
+        WriterShard **shards;
+        unsigned n_shards;
+        unsigned next_shard;
+
         bool check_trust;
         Hashmap *daemons;
 };
@@ -263,6 +263,15 @@ static size_t journal_input_callback(void *buf, size_t size, size_t nmemb, void
 
         while (j && filled < size * nmemb) {
                 if (u->entry_state == ENTRY_DONE) {
+                        if (u->batch_max_entries > 0 && u->batch_entries >= u->batch_max_entries) {
+                                /* End this upload, so that the cursor is saved, and continue with the
+                                 * rest in the next one */
+                                log_debug("Uploaded %zu entries, finishing batch.", u->batch_entries);
+                                u->uploading = false;
+                                u->batch_pending = true;
+                                break;
+                        }
+
                         r = sd_journal_next(j);
                         if (r < 0) {
                                 log_error_errno(r, "Failed to move to next entry in journal: %m");
@@ -295,6 +304,8 @@ static size_t journal_input_callback(void *buf, size_t size, size_t nmemb, void
                         /* This means that all available space was used up */
                         break;
 
+                u->batch_entries++;
+
                 log_debug("Entry %zu (%s) has been uploaded.",
                           u->entries_sent, u->current_cursor);
         }
@@ -311,15 +322,54 @@ void close_journal_input(Uploader *u) {
                 sd_journal_close(u->journal);
                 u->journal = NULL;
         }
+        u->batch_timer = sd_event_source_unref(u->batch_timer);
         u->timeout = 0;
 }
 
+static int dispatch_batch_timer(sd_event_source *event, usec_t usec, void *userdata) {
+        /* Nothing to do here, the main loop checks for pending entries after each iteration */
+        return 0;
+}
+
+static int delay_batch(Uploader *u, usec_t until) {
+        int r;
+
+        assert(u);
+
+        u->batch_pending = true;
+
+        if (u->batch_timer) {
+                r = sd_event_source_set_time(u->batch_timer, until);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to set batch timer: %m");
+
+                r = sd_event_source_set_enabled(u->batch_timer, SD_EVENT_ONESHOT);
+        } else
+                r = sd_event_add_time(u->events, &u->batch_timer, CLOCK_MONOTONIC, until, 0,
+                                      dispatch_batch_timer, u);
+        if (r < 0)
+                return log_error_errno(r, "Failed to arm batch timer: %m");
+
+        return 0;
+}
+
 static int process_journal_input(Uploader *u, int skip) {
         int r;
 
         if (u->uploading)
                 return 0;
 
+        /* When following the journal, don't start a new upload for every single new entry, but let entries
+         * accumulate for a while after the last upload, so that they are sent in one go */
+        if (u->input_event && u->batch_delay > 0) {
+                usec_t until = usec_add(u->last_upload, u->batch_delay);
+
+                if (now(CLOCK_MONOTONIC) < until)
+                        return delay_batch(u, until);
+        }
+
+        u->batch_pending = false;
+
         r = sd_journal_next_skip(u->journal, skip);
         if (r < 0)
                 return log_error_errno(r, "Failed to skip to next entry: %m");
@@ -328,6 +378,7 @@ static int process_journal_input(Uploader *u, int skip) {
 
         /* have data */
         u->entry_state = ENTRY_CURSOR;
+        u->batch_entries = 0;
         return start_upload(u, journal_input_callback, u);
 }
 
@@ -342,7 +393,7 @@ int check_journal_input(Uploader *u) {
                         return r;
                 }
 
-                if (r == SD_JOURNAL_NOP)
+                if (r == SD_JOURNAL_NOP && !u->batch_pending)
                         return 0;
         }
 
@@ -48,6 +48,8 @@ static const char *arg_machine = NULL;
 static bool arg_merge = false;
 static int arg_follow = -1;
 static const char *arg_save_state = NULL;
+static usec_t arg_batch_delay = 0;
+static unsigned arg_batch_max_entries = 0;
 
 static void close_fd_input(Uploader *u);
 
@@ -242,6 +244,10 @@ int start_upload(Uploader *u,
                             "systemd-journal-upload " PACKAGE_STRING,
                             LOG_WARNING, );
 
+                /* the handle is reused for all uploads, keep the connection alive in between */
+                easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L,
+                            LOG_WARNING, );
+
                 if (arg_key || startswith(u->url, "https://")) {
                         easy_setopt(curl, CURLOPT_SSLKEY, arg_key ?: PRIV_KEY_FILE,
                                     LOG_ERR, return -EXFULL);
@@ -439,6 +445,8 @@ static int setup_uploader(Uploader *u, const char *url, const char *state_file)
                 return log_oom();
 
         u->state_file = state_file;
+        u->batch_delay = arg_batch_delay;
+        u->batch_max_entries = arg_batch_max_entries;
 
         r = sd_event_default(&u->events);
         if (r < 0)
@@ -512,6 +520,8 @@ static int perform_upload(Uploader *u) {
                 log_debug("Upload finished successfully with code %ld: %s",
                           status, strna(u->answer));
 
+        u->last_upload = now(CLOCK_MONOTONIC);
+
         free_and_replace(u->last_cursor, u->current_cursor);
 
         return update_cursor_state(u);
@@ -523,6 +533,8 @@ static int parse_config(void) {
                 { "Upload",  "ServerKeyFile",          config_parse_path,   0, &arg_key    },
                 { "Upload",  "ServerCertificateFile",  config_parse_path,   0, &arg_cert   },
                 { "Upload",  "TrustedCertificateFile", config_parse_path,   0, &arg_trust  },
+                { "Upload",  "BatchDelaySec",          config_parse_sec,    0, &arg_batch_delay },
+                { "Upload",  "BatchMaxEntries",        config_parse_unsigned, 0, &arg_batch_max_entries },
                 {}};
 
         return config_parse_many_nulstr(PKGSYSCONFDIR "/journal-upload.conf",
@@ -555,6 +567,9 @@ static void help(void) {
                "     --follow[=BOOL]        Do [not] wait for input\n"
                "     --save-state[=FILE]    Save uploaded cursors (default \n"
                "                            " STATE_FILE ")\n"
+               "     --batch-delay=SEC      Wait this long after an upload before starting\n"
+               "                            the next one when following the journal\n"
+               "     --batch-max-entries=N  Upload at most N entries at once\n"
                , program_invocation_short_name);
 }
 
@@ -571,6 +586,8 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_AFTER_CURSOR,
                 ARG_FOLLOW,
                 ARG_SAVE_STATE,
+                ARG_BATCH_DELAY,
+                ARG_BATCH_MAX_ENTRIES,
         };
 
         static const struct option options[] = {
@@ -590,6 +607,8 @@ static int parse_argv(int argc, char *argv[]) {
                 { "after-cursor", required_argument, NULL, ARG_AFTER_CURSOR   },
                 { "follow",       optional_argument, NULL, ARG_FOLLOW         },
                 { "save-state",   optional_argument, NULL, ARG_SAVE_STATE     },
+                { "batch-delay",  required_argument, NULL, ARG_BATCH_DELAY    },
+                { "batch-max-entries", required_argument, NULL, ARG_BATCH_MAX_ENTRIES },
                 {}
         };
 
@@ -718,6 +737,18 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_save_state = optarg ?: STATE_FILE;
                         break;
 
+                case ARG_BATCH_DELAY:
+                        r = parse_sec(optarg, &arg_batch_delay);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse --batch-delay= parameter: %s", optarg);
+                        break;
+
+                case ARG_BATCH_MAX_ENTRIES:
+                        r = safe_atou(optarg, &arg_batch_max_entries);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse --batch-max-entries= parameter: %s", optarg);
+                        break;
+
                 case '?':
                         log_error("Unknown option %s.", argv[optind-1]);
                         return -EINVAL;
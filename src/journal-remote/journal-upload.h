@@ -49,6 +49,15 @@ typedef struct Uploader {
 
         size_t entries_sent;
         char *last_cursor, *current_cursor;
+
+        /* batching of uploads */
+        usec_t batch_delay;
+        size_t batch_max_entries;
+        size_t batch_entries;
+        usec_t last_upload;
+        bool batch_pending;
+        sd_event_source *batch_timer;
+
         usec_t watchdog_timestamp;
         usec_t watchdog_usec;
 } Uploader;
@@ -20,6 +20,12 @@
 #include <lz4frame.h>
 #endif
 
+#if HAVE_ZSTD
+#include <zdict.h>
+#include <zstd.h>
+#include <zstd_errors.h>
+#endif
+
 #include "alloc-util.h"
 #include "compress.h"
 #include "fd-util.h"
@@ -36,11 +42,43 @@ DEFINE_TRIVIAL_CLEANUP_FUNC(LZ4F_compressionContext_t, LZ4F_freeCompressionConte
 DEFINE_TRIVIAL_CLEANUP_FUNC(LZ4F_decompressionContext_t, LZ4F_freeDecompressionContext);
 #endif
 
+#if HAVE_ZSTD
+DEFINE_TRIVIAL_CLEANUP_FUNC(ZSTD_CCtx *, ZSTD_freeCCtx);
+DEFINE_TRIVIAL_CLEANUP_FUNC(ZSTD_DCtx *, ZSTD_freeDCtx);
+
+static int zstd_ret_to_errno(size_t ret) {
+        switch (ZSTD_getErrorCode(ret)) {
+        case ZSTD_error_dstSize_tooSmall:
+                return -ENOBUFS;
+        case ZSTD_error_memory_allocation:
+                return -ENOMEM;
+        default:
+                return -EBADMSG;
+        }
+}
+#endif
+
 #define ALIGN_8(l) ALIGN_TO(l, sizeof(size_t))
 
+struct CompressDict {
+        void *data;
+        size_t size;
+#if HAVE_ZSTD
+        /* Digested versions of the dictionary and contexts to use
+         * them with, created on first use and reused afterwards,
+         * since setting them up is much more expensive than
+         * compressing a single short field. */
+        ZSTD_CDict *cdict;
+        ZSTD_DDict *ddict;
+        ZSTD_CCtx *cctx;
+        ZSTD_DCtx *dctx;
+#endif
+};
+
 static const char* const object_compressed_table[_OBJECT_COMPRESSED_MAX] = {
         [OBJECT_COMPRESSED_XZ] = "XZ",
         [OBJECT_COMPRESSED_LZ4] = "LZ4",
+        [OBJECT_COMPRESSED_ZSTD] = "ZSTD",
 };
 
 DEFINE_STRING_TABLE_LOOKUP(object_compressed, int);
@@ -117,6 +155,91 @@ int compress_blob_lz4(const void *src, uint64_t src_size,
 #endif
 }
 
+int compress_blob_zstd(const void *src, uint64_t src_size,
+                       void *dst, size_t dst_alloc_size, size_t *dst_size) {
+#if HAVE_ZSTD
+        size_t k;
+
+        assert(src);
+        assert(src_size > 0);
+        assert(dst);
+        assert(dst_alloc_size > 0);
+        assert(dst_size);
+
+        /* Returns < 0 if we couldn't compress the data or the
+         * compressed result is longer than the original. The frame
+         * header records the uncompressed size, so unlike LZ4 we
+         * don't need to prefix it ourselves. */
+
+        k = ZSTD_compress(dst, dst_alloc_size, src, src_size, 0);
+        if (ZSTD_isError(k))
+                return zstd_ret_to_errno(k);
+
+        *dst_size = k;
+        return 0;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
+int compress_blob_zstd_dict(CompressDict *d,
+                            const void *src, uint64_t src_size,
+                            void *dst, size_t dst_alloc_size, size_t *dst_size) {
+#if HAVE_ZSTD
+        size_t k;
+
+        assert(d);
+        assert(src);
+        assert(src_size > 0);
+        assert(dst);
+        assert(dst_alloc_size > 0);
+        assert(dst_size);
+
+        if (!d->cdict) {
+                d->cdict = ZSTD_createCDict(d->data, d->size, 0);
+                if (!d->cdict)
+                        return -ENOMEM;
+        }
+
+        if (!d->cctx) {
+                d->cctx = ZSTD_createCCtx();
+                if (!d->cctx)
+                        return -ENOMEM;
+        }
+
+        k = ZSTD_compress_usingCDict(d->cctx, dst, dst_alloc_size, src, src_size, d->cdict);
+        if (ZSTD_isError(k))
+                return zstd_ret_to_errno(k);
+
+        *dst_size = k;
+        return 0;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
+int compress_blob_explicit(int compression,
+                           const void *src, uint64_t src_size,
+                           void *dst, size_t dst_alloc_size, size_t *dst_size) {
+        int r;
+
+        /* Returns the OBJECT_COMPRESSED_xyz flag on success, or < 0 if
+         * the data couldn't be compressed with the requested codec */
+
+        if (compression == OBJECT_COMPRESSED_ZSTD)
+                r = compress_blob_zstd(src, src_size, dst, dst_alloc_size, dst_size);
+        else if (compression == OBJECT_COMPRESSED_LZ4)
+                r = compress_blob_lz4(src, src_size, dst, dst_alloc_size, dst_size);
+        else if (compression == OBJECT_COMPRESSED_XZ)
+                r = compress_blob_xz(src, src_size, dst, dst_alloc_size, dst_size);
+        else
+                return -EOPNOTSUPP;
+        if (r < 0)
+                return r;
+
+        return compression;
+}
+
 int decompress_blob_xz(const void *src, uint64_t src_size,
                        void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max) {
 
@@ -217,7 +340,118 @@ int decompress_blob_lz4(const void *src, uint64_t src_size,
 #endif
 }
 
-int decompress_blob(int compression,
+#if HAVE_ZSTD
+static int zstd_get_dctx(CompressDict *d, ZSTD_DCtx **temporary, ZSTD_DCtx **ret) {
+        size_t k;
+
+        assert(temporary);
+        assert(ret);
+
+        /* Without a dictionary we use a one-off context, which the
+         * caller frees via *temporary. With one, we reuse the
+         * context cached in the dictionary object. */
+
+        if (!d) {
+                *temporary = ZSTD_createDCtx();
+                if (!*temporary)
+                        return -ENOMEM;
+
+                *ret = *temporary;
+                return 0;
+        }
+
+        if (!d->ddict) {
+                d->ddict = ZSTD_createDDict(d->data, d->size);
+                if (!d->ddict)
+                        return -ENOMEM;
+        }
+
+        if (!d->dctx) {
+                d->dctx = ZSTD_createDCtx();
+                if (!d->dctx)
+                        return -ENOMEM;
+        } else {
+                /* A previous call might have failed half-way */
+                k = ZSTD_DCtx_reset(d->dctx, ZSTD_reset_session_only);
+                if (ZSTD_isError(k))
+                        return zstd_ret_to_errno(k);
+        }
+
+        k = ZSTD_DCtx_refDDict(d->dctx, d->ddict);
+        if (ZSTD_isError(k))
+                return zstd_ret_to_errno(k);
+
+        *ret = d->dctx;
+        return 0;
+}
+#endif
+
+int decompress_blob_zstd_dict(CompressDict *d,
+                              const void *src, uint64_t src_size,
+                              void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max) {
+
+#if HAVE_ZSTD
+        _cleanup_(ZSTD_freeDCtxp) ZSTD_DCtx *temporary = NULL;
+        ZSTD_DCtx *dctx;
+        ZSTD_inBuffer input;
+        ZSTD_outBuffer output;
+        uint64_t size;
+        size_t k;
+        int r;
+
+        assert(src);
+        assert(src_size > 0);
+        assert(dst);
+        assert(dst_alloc_size);
+        assert(dst_size);
+        assert(*dst_alloc_size == 0 || *dst);
+
+        size = ZSTD_getFrameContentSize(src, src_size);
+        if (IN_SET(size, ZSTD_CONTENTSIZE_ERROR, ZSTD_CONTENTSIZE_UNKNOWN))
+                return -EBADMSG;
+
+        if (dst_max > 0 && size > dst_max)
+                size = dst_max;
+        if (size > SIZE_MAX)
+                return -E2BIG;
+
+        if (!greedy_realloc(dst, dst_alloc_size, MAX(ZSTD_DStreamOutSize(), size), 1))
+                return -ENOMEM;
+
+        r = zstd_get_dctx(d, &temporary, &dctx);
+        if (r < 0)
+                return r;
+
+        input = (ZSTD_inBuffer) {
+                .src = src,
+                .size = src_size,
+        };
+        output = (ZSTD_outBuffer) {
+                .dst = *dst,
+                .size = *dst_alloc_size,
+        };
+
+        k = ZSTD_decompressStream(dctx, &output, &input);
+        if (ZSTD_isError(k)) {
+                log_debug("ZSTD decoder failed: %s", ZSTD_getErrorName(k));
+                return zstd_ret_to_errno(k);
+        }
+        if (output.pos < size)
+                return -EBADMSG;
+
+        *dst_size = size;
+        return 0;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
+int decompress_blob_zstd(const void *src, uint64_t src_size,
+                         void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max) {
+        return decompress_blob_zstd_dict(NULL, src, src_size, dst, dst_alloc_size, dst_size, dst_max);
+}
+
+int decompress_blob(int compression, CompressDict *dict,
                     const void *src, uint64_t src_size,
                     void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max) {
         if (compression == OBJECT_COMPRESSED_XZ)
@@ -226,6 +460,9 @@ int decompress_blob(int compression,
         else if (compression == OBJECT_COMPRESSED_LZ4)
                 return decompress_blob_lz4(src, src_size,
                                            dst, dst_alloc_size, dst_size, dst_max);
+        else if (compression == OBJECT_COMPRESSED_ZSTD)
+                return decompress_blob_zstd_dict(dict, src, src_size,
+                                                 dst, dst_alloc_size, dst_size, dst_max);
         else
                 return -EBADMSG;
 }
@@ -338,7 +575,77 @@ int decompress_startswith_lz4(const void *src, uint64_t src_size,
 #endif
 }
 
-int decompress_startswith(int compression,
+int decompress_startswith_zstd_dict(CompressDict *d,
+                                    const void *src, uint64_t src_size,
+                                    void **buffer, size_t *buffer_size,
+                                    const void *prefix, size_t prefix_len,
+                                    uint8_t extra) {
+#if HAVE_ZSTD
+        _cleanup_(ZSTD_freeDCtxp) ZSTD_DCtx *temporary = NULL;
+        ZSTD_DCtx *dctx;
+        ZSTD_inBuffer input;
+        ZSTD_outBuffer output;
+        uint64_t size;
+        size_t k;
+        int r;
+
+        /* Checks whether the decompressed blob starts with the
+         * mentioned prefix. The byte extra needs to follow the
+         * prefix */
+
+        assert(src);
+        assert(src_size > 0);
+        assert(buffer);
+        assert(buffer_size);
+        assert(prefix);
+        assert(*buffer_size == 0 || *buffer);
+
+        size = ZSTD_getFrameContentSize(src, src_size);
+        if (IN_SET(size, ZSTD_CONTENTSIZE_ERROR, ZSTD_CONTENTSIZE_UNKNOWN))
+                return -EBADMSG;
+
+        if (size < prefix_len + 1)
+                return 0; /* Decompressed text too short to match the prefix and extra */
+
+        r = zstd_get_dctx(d, &temporary, &dctx);
+        if (r < 0)
+                return r;
+
+        if (!(greedy_realloc(buffer, buffer_size, MAX(ZSTD_DStreamOutSize(), prefix_len + 1), 1)))
+                return -ENOMEM;
+
+        input = (ZSTD_inBuffer) {
+                .src = src,
+                .size = src_size,
+        };
+        output = (ZSTD_outBuffer) {
+                .dst = *buffer,
+                .size = *buffer_size,
+        };
+
+        k = ZSTD_decompressStream(dctx, &output, &input);
+        if (ZSTD_isError(k)) {
+                log_debug("ZSTD decoder failed: %s", ZSTD_getErrorName(k));
+                return zstd_ret_to_errno(k);
+        }
+        if (output.pos < prefix_len + 1)
+                return -EBADMSG;
+
+        return memcmp(*buffer, prefix, prefix_len) == 0 &&
+                ((const uint8_t*) *buffer)[prefix_len] == extra;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
+int decompress_startswith_zstd(const void *src, uint64_t src_size,
+                               void **buffer, size_t *buffer_size,
+                               const void *prefix, size_t prefix_len,
+                               uint8_t extra) {
+        return decompress_startswith_zstd_dict(NULL, src, src_size, buffer, buffer_size, prefix, prefix_len, extra);
+}
+
+int decompress_startswith(int compression, CompressDict *dict,
                           const void *src, uint64_t src_size,
                           void **buffer, size_t *buffer_size,
                           const void *prefix, size_t prefix_len,
@@ -353,10 +660,94 @@ int decompress_startswith(int compression,
                                                  buffer, buffer_size,
                                                  prefix, prefix_len,
                                                  extra);
+        else if (compression == OBJECT_COMPRESSED_ZSTD)
+                return decompress_startswith_zstd_dict(dict, src, src_size,
+                                                       buffer, buffer_size,
+                                                       prefix, prefix_len,
+                                                       extra);
         else
                 return -EBADMSG;
 }
 
+int compress_dict_new(const void *data, size_t size, CompressDict **ret) {
+#if HAVE_ZSTD
+        _cleanup_(compress_dict_freep) CompressDict *d = NULL;
+
+        assert(data);
+        assert(size > 0);
+        assert(ret);
+
+        d = new0(CompressDict, 1);
+        if (!d)
+                return -ENOMEM;
+
+        d->data = memdup(data, size);
+        if (!d->data)
+                return -ENOMEM;
+
+        d->size = size;
+
+        *ret = TAKE_PTR(d);
+        return 0;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
+int compress_dict_train(const void *samples, const size_t *sample_sizes, unsigned n_samples,
+                        size_t max_size, CompressDict **ret) {
+#if HAVE_ZSTD
+        _cleanup_free_ void *buf = NULL;
+        size_t k;
+
+        assert(samples);
+        assert(sample_sizes);
+        assert(max_size > 0);
+        assert(ret);
+
+        /* Trains a dictionary of at most max_size bytes from the
+         * passed samples, which are stored back-to-back in one
+         * buffer. This fails if the samples are too few or too
+         * uniform for zstd to find anything useful. */
+
+        buf = malloc(max_size);
+        if (!buf)
+                return -ENOMEM;
+
+        k = ZDICT_trainFromBuffer(buf, max_size, samples, sample_sizes, n_samples);
+        if (ZDICT_isError(k)) {
+                log_debug("Failed to train ZSTD dictionary from %u samples: %s", n_samples, ZDICT_getErrorName(k));
+                return -ENODATA;
+        }
+
+        return compress_dict_new(buf, k, ret);
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
+CompressDict* compress_dict_free(CompressDict *d) {
+        if (!d)
+                return NULL;
+
+#if HAVE_ZSTD
+        ZSTD_freeCCtx(d->cctx);
+        ZSTD_freeDCtx(d->dctx);
+        ZSTD_freeCDict(d->cdict);
+        ZSTD_freeDDict(d->ddict);
+#endif
+        free(d->data);
+        return mfree(d);
+}
+
+const void* compress_dict_data(const CompressDict *d, size_t *ret_size) {
+        assert(d);
+        assert(ret_size);
+
+        *ret_size = d->size;
+        return d->data;
+}
+
 int compress_stream_xz(int fdf, int fdt, uint64_t max_bytes) {
 #if HAVE_XZ
         _cleanup_(lzma_end) lzma_stream s = LZMA_STREAM_INIT;
@@ -526,6 +917,136 @@ int compress_stream_lz4(int fdf, int fdt, uint64_t max_bytes) {
 #endif
 }
 
+int compress_stream_zstd(int fdf, int fdt, uint64_t max_bytes) {
+        return compress_stream_zstd_full(fdf, fdt, max_bytes, -1, UINT64_MAX, 0);
+}
+
+/* Like compress_stream_zstd(), but reads at most max_input bytes and optionally writes the uncompressed input
+ * to fd_copy too, as a sparse file. Returns 1 if the input was longer than max_input, 0 otherwise. */
+int compress_stream_zstd_full(
+                int fdf,
+                int fdt,
+                uint64_t max_bytes,
+                int fd_copy,
+                uint64_t max_input,
+                unsigned n_threads) {
+#if HAVE_ZSTD
+        _cleanup_(ZSTD_freeCCtxp) ZSTD_CCtx *cctx = NULL;
+        _cleanup_free_ void *in_buff = NULL, *out_buff = NULL;
+        size_t in_allocsize, out_allocsize, z;
+        uint64_t left = max_bytes, in_bytes = 0;
+        bool truncated = false;
+
+        assert(fdf >= 0);
+        assert(fdt >= 0);
+
+        in_allocsize = ZSTD_CStreamInSize();
+        out_allocsize = ZSTD_CStreamOutSize();
+        in_buff = malloc(in_allocsize);
+        out_buff = malloc(out_allocsize);
+        cctx = ZSTD_createCCtx();
+        if (!cctx || !out_buff || !in_buff)
+                return -ENOMEM;
+
+        z = ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+        if (ZSTD_isError(z))
+                log_debug("Failed to enable ZSTD checksum, ignoring: %s", ZSTD_getErrorName(z));
+
+        /* With worker threads the compression happens in the background while we read and write, this fails
+         * if libzstd was built without multithreading support. */
+        if (n_threads > 0) {
+                z = ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, (int) n_threads);
+                if (ZSTD_isError(z))
+                        log_debug("Failed to enable %u ZSTD worker threads, ignoring: %s", n_threads, ZSTD_getErrorName(z));
+        }
+
+        /* Read a chunk from the input file, compress all of it and
+         * write out everything that was produced, so that the
+         * buffers can be reused for the next chunk. */
+        for (;;) {
+                ZSTD_inBuffer input = {
+                        .src = in_buff,
+                };
+                bool is_last_chunk, finished = false;
+                ssize_t n;
+
+                n = loop_read(fdf, in_buff, MIN(in_allocsize, max_input - in_bytes), true);
+                if (n < 0)
+                        return n;
+                is_last_chunk = n == 0;
+
+                if (is_last_chunk && in_bytes >= max_input) {
+                        char c;
+
+                        /* Check whether we actually cut something off */
+                        n = loop_read(fdf, &c, 1, true);
+                        if (n < 0)
+                                return n;
+                        truncated = n > 0;
+                        n = 0;
+                }
+
+                if (fd_copy >= 0 && n > 0) {
+                        ssize_t k;
+
+                        k = sparse_write(fd_copy, in_buff, n, 64);
+                        if (k < 0)
+                                return k;
+                }
+
+                in_bytes += n;
+                input.size = n;
+
+                while (!finished) {
+                        ZSTD_outBuffer output = {
+                                .dst = out_buff,
+                                .size = out_allocsize,
+                        };
+                        size_t remaining;
+                        int k;
+
+                        remaining = ZSTD_compressStream2(cctx, &output, &input,
+                                                         is_last_chunk ? ZSTD_e_end : ZSTD_e_continue);
+                        if (ZSTD_isError(remaining)) {
+                                log_debug("ZSTD encoder failed: %s", ZSTD_getErrorName(remaining));
+                                return zstd_ret_to_errno(remaining);
+                        }
+
+                        if (left < output.pos) {
+                                log_debug("Compressed stream longer than %"PRIu64" bytes", max_bytes);
+                                return -EFBIG;
+                        }
+
+                        k = loop_write(fdt, output.dst, output.pos, true);
+                        if (k < 0)
+                                return k;
+
+                        left -= output.pos;
+
+                        /* On the last chunk we are done once the frame
+                         * is flushed completely, otherwise as soon as
+                         * the input has been consumed. */
+                        finished = is_last_chunk ? remaining == 0 : input.pos == input.size;
+                }
+
+                if (is_last_chunk)
+                        break;
+        }
+
+        /* Trailing holes are not allocated by sparse_write(), make sure the copy has the full size */
+        if (fd_copy >= 0 && ftruncate(fd_copy, in_bytes) < 0)
+                return -errno;
+
+        log_debug("ZSTD compression finished (%"PRIu64" -> %"PRIu64" bytes, %.1f%%)",
+                  in_bytes, max_bytes - left,
+                  in_bytes > 0 ? (double) (max_bytes - left) / in_bytes * 100 : 0.0);
+
+        return truncated;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
 int decompress_stream_xz(int fdf, int fdt, uint64_t max_bytes) {
 
 #if HAVE_XZ
@@ -662,12 +1183,95 @@ int decompress_stream_lz4(int in, int out, uint64_t max_bytes) {
 #endif
 }
 
+int decompress_stream_zstd(int fdf, int fdt, uint64_t max_bytes) {
+#if HAVE_ZSTD
+        _cleanup_(ZSTD_freeDCtxp) ZSTD_DCtx *dctx = NULL;
+        _cleanup_free_ void *in_buff = NULL, *out_buff = NULL;
+        size_t in_allocsize, out_allocsize, last_result = 0;
+        uint64_t left = max_bytes, in_bytes = 0;
+
+        assert(fdf >= 0);
+        assert(fdt >= 0);
+
+        in_allocsize = ZSTD_DStreamInSize();
+        out_allocsize = ZSTD_DStreamOutSize();
+        in_buff = malloc(in_allocsize);
+        out_buff = malloc(out_allocsize);
+        dctx = ZSTD_createDCtx();
+        if (!dctx || !out_buff || !in_buff)
+                return -ENOMEM;
+
+        /* The input may consist of several concatenated frames,
+         * ZSTD_decompressStream() resets the context by itself once a
+         * frame is complete and returns 0 exactly at frame
+         * boundaries. */
+        for (;;) {
+                ZSTD_inBuffer input = {
+                        .src = in_buff,
+                };
+                ssize_t n;
+
+                n = loop_read(fdf, in_buff, in_allocsize, true);
+                if (n < 0)
+                        return n;
+                if (n == 0)
+                        break;
+
+                in_bytes += n;
+                input.size = n;
+
+                while (input.pos < input.size) {
+                        ZSTD_outBuffer output = {
+                                .dst = out_buff,
+                                .size = out_allocsize,
+                        };
+                        int k;
+
+                        last_result = ZSTD_decompressStream(dctx, &output, &input);
+                        if (ZSTD_isError(last_result)) {
+                                log_debug("ZSTD decoder failed: %s", ZSTD_getErrorName(last_result));
+                                return zstd_ret_to_errno(last_result);
+                        }
+
+                        if (left < output.pos) {
+                                log_debug("Decompressed stream longer than %"PRIu64" bytes", max_bytes);
+                                return -EFBIG;
+                        }
+
+                        k = loop_write(fdt, output.dst, output.pos, true);
+                        if (k < 0)
+                                return k;
+
+                        left -= output.pos;
+                }
+        }
+
+        if (in_bytes == 0 || last_result != 0) {
+                /* Either there was no data at all, or the stream did
+                 * not end on a frame boundary, i.e. it was truncated. */
+                log_debug("ZSTD decoder failed: truncated input");
+                return -EBADMSG;
+        }
+
+        log_debug("ZSTD decompression finished (%"PRIu64" -> %"PRIu64" bytes, %.1f%%)",
+                  in_bytes, max_bytes - left,
+                  (double) (max_bytes - left) / in_bytes * 100);
+
+        return 0;
+#else
+        log_debug("Cannot decompress file. Compiled without ZSTD support.");
+        return -EPROTONOSUPPORT;
+#endif
+}
+
 int decompress_stream(const char *filename, int fdf, int fdt, uint64_t max_bytes) {
 
         if (endswith(filename, ".lz4"))
                 return decompress_stream_lz4(fdf, fdt, max_bytes);
         else if (endswith(filename, ".xz"))
                 return decompress_stream_xz(fdf, fdt, max_bytes);
+        else if (endswith(filename, ".zst"))
+                return decompress_stream_zstd(fdf, fdt, max_bytes);
         else
                 return -EPROTONOSUPPORT;
 }
@@ -11,6 +11,8 @@
 
 #include "journal-def.h"
 
+typedef struct CompressDict CompressDict;
+
 const char* object_compressed_to_string(int compression);
 int object_compressed_from_string(const char *compression);
 
@@ -18,27 +20,43 @@ int compress_blob_xz(const void *src, uint64_t src_size,
                      void *dst, size_t dst_alloc_size, size_t *dst_size);
 int compress_blob_lz4(const void *src, uint64_t src_size,
                       void *dst, size_t dst_alloc_size, size_t *dst_size);
+int compress_blob_zstd(const void *src, uint64_t src_size,
+                       void *dst, size_t dst_alloc_size, size_t *dst_size);
 
-static inline int compress_blob(const void *src, uint64_t src_size,
-                                void *dst, size_t dst_alloc_size, size_t *dst_size) {
-        int r;
-#if HAVE_LZ4
-        r = compress_blob_lz4(src, src_size, dst, dst_alloc_size, dst_size);
-        if (r == 0)
-                return OBJECT_COMPRESSED_LZ4;
+int compress_blob_zstd_dict(CompressDict *d,
+                            const void *src, uint64_t src_size,
+                            void *dst, size_t dst_alloc_size, size_t *dst_size);
+
+int compress_blob_explicit(int compression,
+                           const void *src, uint64_t src_size,
+                           void *dst, size_t dst_alloc_size, size_t *dst_size);
+
+/* The codec used for newly created journal files and coredumps, in order of preference */
+#if HAVE_ZSTD
+#  define DEFAULT_COMPRESSION OBJECT_COMPRESSED_ZSTD
+#elif HAVE_LZ4
+#  define DEFAULT_COMPRESSION OBJECT_COMPRESSED_LZ4
+#elif HAVE_XZ
+#  define DEFAULT_COMPRESSION OBJECT_COMPRESSED_XZ
 #else
-        r = compress_blob_xz(src, src_size, dst, dst_alloc_size, dst_size);
-        if (r == 0)
-                return OBJECT_COMPRESSED_XZ;
+#  define DEFAULT_COMPRESSION 0
 #endif
-        return r;
+
+static inline int compress_blob(const void *src, uint64_t src_size,
+                                void *dst, size_t dst_alloc_size, size_t *dst_size) {
+        return compress_blob_explicit(DEFAULT_COMPRESSION, src, src_size, dst, dst_alloc_size, dst_size);
 }
 
 int decompress_blob_xz(const void *src, uint64_t src_size,
                        void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
 int decompress_blob_lz4(const void *src, uint64_t src_size,
                         void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
-int decompress_blob(int compression,
+int decompress_blob_zstd(const void *src, uint64_t src_size,
+                         void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
+int decompress_blob_zstd_dict(CompressDict *d,
+                              const void *src, uint64_t src_size,
+                              void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
+int decompress_blob(int compression, CompressDict *dict,
                     const void *src, uint64_t src_size,
                     void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
 
@@ -50,19 +68,41 @@ int decompress_startswith_lz4(const void *src, uint64_t src_size,
                               void **buffer, size_t *buffer_size,
                               const void *prefix, size_t prefix_len,
                               uint8_t extra);
-int decompress_startswith(int compression,
+int decompress_startswith_zstd(const void *src, uint64_t src_size,
+                               void **buffer, size_t *buffer_size,
+                               const void *prefix, size_t prefix_len,
+                               uint8_t extra);
+int decompress_startswith_zstd_dict(CompressDict *d,
+                                    const void *src, uint64_t src_size,
+                                    void **buffer, size_t *buffer_size,
+                                    const void *prefix, size_t prefix_len,
+                                    uint8_t extra);
+int decompress_startswith(int compression, CompressDict *dict,
                           const void *src, uint64_t src_size,
                           void **buffer, size_t *buffer_size,
                           const void *prefix, size_t prefix_len,
                           uint8_t extra);
 
+int compress_dict_new(const void *data, size_t size, CompressDict **ret);
+int compress_dict_train(const void *samples, const size_t *sample_sizes, unsigned n_samples,
+                        size_t max_size, CompressDict **ret);
+CompressDict* compress_dict_free(CompressDict *d);
+DEFINE_TRIVIAL_CLEANUP_FUNC(CompressDict*, compress_dict_free);
+const void* compress_dict_data(const CompressDict *d, size_t *ret_size);
+
 int compress_stream_xz(int fdf, int fdt, uint64_t max_bytes);
 int compress_stream_lz4(int fdf, int fdt, uint64_t max_bytes);
+int compress_stream_zstd(int fdf, int fdt, uint64_t max_bytes);
+int compress_stream_zstd_full(int fdf, int fdt, uint64_t max_bytes, int fd_copy, uint64_t max_input, unsigned n_threads);
 
 int decompress_stream_xz(int fdf, int fdt, uint64_t max_size);
 int decompress_stream_lz4(int fdf, int fdt, uint64_t max_size);
+int decompress_stream_zstd(int fdf, int fdt, uint64_t max_size);
 
-#if HAVE_LZ4
+#if HAVE_ZSTD
+#  define compress_stream compress_stream_zstd
+#  define COMPRESSED_EXT ".zst"
+#elif HAVE_LZ4
 #  define compress_stream compress_stream_lz4
 #  define COMPRESSED_EXT ".lz4"
 #else
@@ -37,6 +37,10 @@ int journal_file_append_tag(JournalFile *f) {
         if (!f->seal)
                 return 0;
 
+        r = journal_file_hmac_flush(f);
+        if (r < 0)
+                return r;
+
         if (!f->hmac_running)
                 return 0;
 
@@ -62,6 +66,7 @@ int journal_file_append_tag(JournalFile *f) {
         /* Get the HMAC tag and store it in the object */
         memcpy(o->tag.tag, gcry_md_read(f->hmac, 0), TAG_LENGTH);
         f->hmac_running = false;
+        f->hmac_offset = 0;
 
         return 0;
 }
@@ -271,6 +276,26 @@ int journal_file_hmac_put_object(JournalFile *f, ObjectType type, Object *o, uin
                 gcry_md_write(f->hmac, &o->tag.seqnum, sizeof(o->tag.seqnum));
                 gcry_md_write(f->hmac, &o->tag.epoch, sizeof(o->tag.epoch));
                 break;
+
+        case OBJECT_DICTIONARY:
+                /* All */
+                gcry_md_write(f->hmac, o->dictionary.payload, le64toh(o->object.size) - offsetof(DictionaryObject, payload));
+                break;
+
+        case OBJECT_BLOOM_FILTER:
+                /* All */
+                gcry_md_write(f->hmac, &o->bloom_filter.n_items, le64toh(o->object.size) - offsetof(BloomFilterObject, n_items));
+                break;
+
+        case OBJECT_REALTIME_INDEX:
+                /* All */
+                gcry_md_write(f->hmac, &o->realtime_index.n_entries, le64toh(o->object.size) - offsetof(RealtimeIndexObject, n_entries));
+                break;
+
+        case OBJECT_DATA_HASH_TABLE_SEGMENT:
+                /* Only the link to the previous segment, the rest is mutable */
+                gcry_md_write(f->hmac, &o->data_hash_table_segment.previous_offset, sizeof(o->data_hash_table_segment.previous_offset));
+                break;
         default:
                 return -EINVAL;
         }
@@ -278,6 +303,42 @@ int journal_file_hmac_put_object(JournalFile *f, ObjectType type, Object *o, uin
         return 0;
 }
 
+int journal_file_hmac_flush(JournalFile *f) {
+        uint64_t p, tail;
+        int r;
+
+        assert(f);
+
+        if (!f->seal)
+                return 0;
+
+        /* Objects are not fed into the HMAC as they are appended, but in one go once we need the tag, or
+         * when the file is synced. Everything the HMAC covers is immutable once the object is complete,
+         * and like journal_file_verify() we process the objects in file order. */
+
+        p = f->hmac_offset;
+        if (p == 0)
+                return 0;
+
+        tail = le64toh(f->header->tail_object_offset);
+        while (p <= tail) {
+                Object *o;
+
+                r = journal_file_move_to_object(f, OBJECT_UNUSED, p, &o);
+                if (r < 0)
+                        return r;
+
+                r = journal_file_hmac_put_object(f, OBJECT_UNUSED, o, p);
+                if (r < 0)
+                        return r;
+
+                p += ALIGN64(le64toh(o->object.size));
+                f->hmac_offset = p;
+        }
+
+        return 0;
+}
+
 int journal_file_hmac_put_header(JournalFile *f) {
         int r;
 
@@ -430,7 +491,6 @@ int journal_file_hmac_setup(JournalFile *f) {
 
 int journal_file_append_first_tag(JournalFile *f) {
         int r;
-        uint64_t p;
 
         if (!f->seal)
                 return 0;
@@ -441,23 +501,9 @@ int journal_file_append_first_tag(JournalFile *f) {
         if (r < 0)
                 return r;
 
-        p = le64toh(f->header->field_hash_table_offset);
-        if (p < offsetof(Object, hash_table.items))
-                return -EINVAL;
-        p -= offsetof(Object, hash_table.items);
-
-        r = journal_file_hmac_put_object(f, OBJECT_FIELD_HASH_TABLE, NULL, p);
-        if (r < 0)
-                return r;
-
-        p = le64toh(f->header->data_hash_table_offset);
-        if (p < offsetof(Object, hash_table.items))
-                return -EINVAL;
-        p -= offsetof(Object, hash_table.items);
-
-        r = journal_file_hmac_put_object(f, OBJECT_DATA_HASH_TABLE, NULL, p);
-        if (r < 0)
-                return r;
+        /* The first tag covers the header and all objects written so far, i.e. the hash tables and the
+         * dictionary, if there is one */
+        f->hmac_offset = le64toh(f->header->header_size);
 
         r = journal_file_append_tag(f);
         if (r < 0)
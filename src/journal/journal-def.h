@@ -30,6 +30,10 @@ typedef struct EntryObject EntryObject;
 typedef struct HashTableObject HashTableObject;
 typedef struct EntryArrayObject EntryArrayObject;
 typedef struct TagObject TagObject;
+typedef struct DictionaryObject DictionaryObject;
+typedef struct BloomFilterObject BloomFilterObject;
+typedef struct RealtimeIndexObject RealtimeIndexObject;
+typedef struct DataHashTableSegmentObject DataHashTableSegmentObject;
 
 typedef struct EntryItem EntryItem;
 typedef struct HashItem HashItem;
@@ -46,6 +50,10 @@ typedef enum ObjectType {
         OBJECT_FIELD_HASH_TABLE,
         OBJECT_ENTRY_ARRAY,
         OBJECT_TAG,
+        OBJECT_DICTIONARY,
+        OBJECT_BLOOM_FILTER,
+        OBJECT_REALTIME_INDEX,
+        OBJECT_DATA_HASH_TABLE_SEGMENT,
         _OBJECT_TYPE_MAX
 } ObjectType;
 
@@ -53,10 +61,11 @@ typedef enum ObjectType {
 enum {
         OBJECT_COMPRESSED_XZ = 1 << 0,
         OBJECT_COMPRESSED_LZ4 = 1 << 1,
+        OBJECT_COMPRESSED_ZSTD = 1 << 2,
         _OBJECT_COMPRESSED_MAX
 };
 
-#define OBJECT_COMPRESSION_MASK (OBJECT_COMPRESSED_XZ | OBJECT_COMPRESSED_LZ4)
+#define OBJECT_COMPRESSION_MASK (OBJECT_COMPRESSED_XZ | OBJECT_COMPRESSED_LZ4 | OBJECT_COMPRESSED_ZSTD)
 
 struct ObjectHeader {
         uint8_t type;
@@ -125,6 +134,41 @@ struct TagObject {
         uint8_t tag[TAG_LENGTH]; /* SHA-256 HMAC */
 } _packed_;
 
+/* A zstd dictionary that short DATA objects of the same file may be
+ * compressed against, see HEADER_INCOMPATIBLE_ZSTD_DICTIONARY */
+struct DictionaryObject {
+        ObjectHeader object;
+        uint8_t payload[];
+} _packed_;
+
+/* A bloom filter over the hashes of all DATA objects of an archived
+ * file, see HEADER_COMPATIBLE_BLOOM_FILTER */
+struct BloomFilterObject {
+        ObjectHeader object;
+        le64_t n_items;
+        uint8_t n_functions;
+        uint8_t reserved[7];
+        uint8_t bits[];
+} _packed_;
+
+/* The realtime timestamps of every stride-th entry of the main entry
+ * array of an archived file, see HEADER_COMPATIBLE_REALTIME_INDEX */
+struct RealtimeIndexObject {
+        ObjectHeader object;
+        le64_t n_entries;
+        le64_t stride;
+        le64_t items[];
+} _packed_;
+
+/* A table that extends the data hash table once it filled up, see
+ * HEADER_INCOMPATIBLE_EXTENSIBLE_HASH_TABLE */
+struct DataHashTableSegmentObject {
+        ObjectHeader object;
+        le64_t previous_offset;
+        le64_t n_data;
+        HashItem items[];
+} _packed_;
+
 union Object {
         ObjectHeader object;
         DataObject data;
@@ -133,6 +177,10 @@ union Object {
         HashTableObject hash_table;
         EntryArrayObject entry_array;
         TagObject tag;
+        DictionaryObject dictionary;
+        BloomFilterObject bloom_filter;
+        RealtimeIndexObject realtime_index;
+        DataHashTableSegmentObject data_hash_table_segment;
 };
 
 enum {
@@ -146,29 +194,40 @@ enum {
 enum {
         HEADER_INCOMPATIBLE_COMPRESSED_XZ = 1 << 0,
         HEADER_INCOMPATIBLE_COMPRESSED_LZ4 = 1 << 1,
+        HEADER_INCOMPATIBLE_COMPRESSED_ZSTD = 1 << 2,
+        HEADER_INCOMPATIBLE_ZSTD_DICTIONARY = 1 << 3,
+        HEADER_INCOMPATIBLE_EXTENSIBLE_HASH_TABLE = 1 << 4,
 };
 
-#define HEADER_INCOMPATIBLE_ANY (HEADER_INCOMPATIBLE_COMPRESSED_XZ|HEADER_INCOMPATIBLE_COMPRESSED_LZ4)
+#define HEADER_INCOMPATIBLE_ANY                 \
+        (HEADER_INCOMPATIBLE_COMPRESSED_XZ|     \
+         HEADER_INCOMPATIBLE_COMPRESSED_LZ4|    \
+         HEADER_INCOMPATIBLE_COMPRESSED_ZSTD|   \
+         HEADER_INCOMPATIBLE_ZSTD_DICTIONARY|   \
+         HEADER_INCOMPATIBLE_EXTENSIBLE_HASH_TABLE)
 
-#if HAVE_XZ && HAVE_LZ4
-#  define HEADER_INCOMPATIBLE_SUPPORTED HEADER_INCOMPATIBLE_ANY
-#elif HAVE_XZ
-#  define HEADER_INCOMPATIBLE_SUPPORTED HEADER_INCOMPATIBLE_COMPRESSED_XZ
-#elif HAVE_LZ4
-#  define HEADER_INCOMPATIBLE_SUPPORTED HEADER_INCOMPATIBLE_COMPRESSED_LZ4
-#else
-#  define HEADER_INCOMPATIBLE_SUPPORTED 0
-#endif
+#define HEADER_INCOMPATIBLE_SUPPORTED                                   \
+        ((HAVE_XZ ? HEADER_INCOMPATIBLE_COMPRESSED_XZ : 0) |            \
+         (HAVE_LZ4 ? HEADER_INCOMPATIBLE_COMPRESSED_LZ4 : 0) |          \
+         (HAVE_ZSTD ? HEADER_INCOMPATIBLE_COMPRESSED_ZSTD : 0) |        \
+         (HAVE_ZSTD ? HEADER_INCOMPATIBLE_ZSTD_DICTIONARY : 0) |        \
+         HEADER_INCOMPATIBLE_EXTENSIBLE_HASH_TABLE)
 
 enum {
-        HEADER_COMPATIBLE_SEALED = 1
+        HEADER_COMPATIBLE_SEALED = 1 << 0,
+        HEADER_COMPATIBLE_BLOOM_FILTER = 1 << 1,
+        HEADER_COMPATIBLE_REALTIME_INDEX = 1 << 2,
 };
 
-#define HEADER_COMPATIBLE_ANY HEADER_COMPATIBLE_SEALED
+#define HEADER_COMPATIBLE_ANY                   \
+        (HEADER_COMPATIBLE_SEALED|              \
+         HEADER_COMPATIBLE_BLOOM_FILTER|        \
+         HEADER_COMPATIBLE_REALTIME_INDEX)
+
 #if HAVE_GCRYPT
-#  define HEADER_COMPATIBLE_SUPPORTED HEADER_COMPATIBLE_SEALED
+#  define HEADER_COMPATIBLE_SUPPORTED HEADER_COMPATIBLE_ANY
 #else
-#  define HEADER_COMPATIBLE_SUPPORTED 0
+#  define HEADER_COMPATIBLE_SUPPORTED (HEADER_COMPATIBLE_BLOOM_FILTER|HEADER_COMPATIBLE_REALTIME_INDEX)
 #endif
 
 #define HEADER_SIGNATURE ((char[]) { 'L', 'P', 'K', 'S', 'H', 'H', 'R', 'H' })
@@ -204,8 +263,13 @@ struct Header {
         /* Added in 189 */
         le64_t n_tags;
         le64_t n_entry_arrays;
+        /* Added in 239 */
+        le64_t dictionary_offset;
+        le64_t bloom_filter_offset;
+        le64_t realtime_index_offset;
+        le64_t data_hash_table_segment_offset;
 
-        /* Size: 240 */
+        /* Size: 272 */
 } _packed_;
 
 #define FSS_HEADER_SIGNATURE ((char[]) { 'K', 'S', 'H', 'H', 'R', 'H', 'L', 'P' })
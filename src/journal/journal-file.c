@@ -38,8 +38,13 @@
 #define DEFAULT_DATA_HASH_TABLE_SIZE (2047ULL*sizeof(HashItem))
 #define DEFAULT_FIELD_HASH_TABLE_SIZE (333ULL*sizeof(HashItem))
 
-#define DEFAULT_COMPRESS_THRESHOLD (512ULL)
-#define MIN_COMPRESS_THRESHOLD (8ULL)
+/* Files with an extensible data hash table start out with this fraction of the table we'd reserve for them
+ * otherwise, and are extended by a segment this many times bigger than the newest table whenever it is
+ * filled beyond 75%. Once they have this many segments, rotation is suggested instead. */
+#define DATA_HASH_TABLE_INITIAL_FRACTION 16U
+#define DATA_HASH_TABLE_SEGMENT_GROWTH 4U
+#define DATA_HASH_TABLE_SEGMENTS_MAX 4U
+
 
 /* This is the minimum journal file size */
 #define JOURNAL_FILE_SIZE_MIN (512ULL*1024ULL)                 /* 512 KiB */
@@ -78,9 +83,35 @@
 /* Reread fstat() of the file for detecting deletions at least this often */
 #define LAST_STAT_REFRESH_USEC (5*USEC_PER_SEC)
 
+/* Short uncompressed DATA payloads of the previous file we train the dictionary of a new file on */
+#define DICTIONARY_SAMPLES_MAX (1024U*1024U)               /* 1 MiB */
+#define DICTIONARY_N_SAMPLES_MIN 1024U
+
+/* Maximum size of a trained dictionary */
+#define DICTIONARY_SIZE_MAX (16U*1024U)                    /* 16 KiB */
+
+/* Payloads shorter than this don't even gain from dictionary compression */
+#define DICTIONARY_COMPRESS_MIN 16U
+
+/* Bloom filter parameters: 10 bits per item and 7 hash functions give a false positive rate of about 1% */
+#define BLOOM_FILTER_BITS_PER_ITEM 10U
+#define BLOOM_FILTER_N_FUNCTIONS 7U
+
+/* We don't bother writing bloom filters bigger than this */
+#define BLOOM_FILTER_SIZE_MAX (4U*1024U*1024U)             /* 4 MiB */
+
+/* Every this many entries we note the realtime timestamp in the realtime index of archived files */
+#define REALTIME_INDEX_STRIDE 64U
+
+/* How many entries to read ahead of sequential iteration at once */
+#define PREFETCH_ENTRIES 64U
+
 /* The mmap context to use for the header we pick as one above the last defined typed */
 #define CONTEXT_HEADER _OBJECT_TYPE_MAX
 
+/* How many journal files we offline at the same time at most */
+#define OFFLINE_THREADS_MAX 8U
+
 #ifdef __clang__
 #  pragma GCC diagnostic ignored "-Waddress-of-packed-member"
 #endif
@@ -134,27 +165,109 @@ static void journal_file_set_offline_internal(JournalFile *f) {
         }
 }
 
-static void * journal_file_set_offline_thread(void *arg) {
-        JournalFile *f = arg;
+/* Offlines are carried out by a small pool of worker threads shared by all journal files, so that rotating
+ * hundreds of user journals at once gets the fsync()s going in parallel, without spawning as many threads.
+ * Workers exit as soon as the queue is empty. The queue and the thread counter are protected by
+ * offline_mutex, and offline_done is signalled whenever a worker is done with a file. */
+static pthread_mutex_t offline_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t offline_done = PTHREAD_COND_INITIALIZER;
+static LIST_HEAD(JournalFile, offline_queue) = NULL;
+static JournalFile *offline_queue_tail = NULL;
+static unsigned offline_n_threads = 0;
 
+static void * journal_file_set_offline_thread(void *arg) {
         (void) pthread_setname_np(pthread_self(), "journal-offline");
 
-        journal_file_set_offline_internal(f);
+        assert_se(pthread_mutex_lock(&offline_mutex) == 0);
+
+        for (;;) {
+                JournalFile *f;
+
+                f = offline_queue;
+                if (!f)
+                        break;
+
+                LIST_REMOVE(offline_queue, offline_queue, f);
+                if (offline_queue_tail == f)
+                        offline_queue_tail = NULL;
+
+                assert_se(pthread_mutex_unlock(&offline_mutex) == 0);
+
+                /* As soon as this marks the file done, a waiter may free it, hence don't touch it anymore */
+                journal_file_set_offline_internal(f);
+
+                assert_se(pthread_mutex_lock(&offline_mutex) == 0);
+                assert_se(pthread_cond_broadcast(&offline_done) == 0);
+        }
+
+        offline_n_threads--;
+        assert_se(pthread_mutex_unlock(&offline_mutex) == 0);
 
         return NULL;
 }
 
-static int journal_file_set_offline_thread_join(JournalFile *f) {
-        int r;
+static int journal_file_set_offline_thread_queue(JournalFile *f) {
+        int r = 0;
+
+        assert(f);
+
+        assert_se(pthread_mutex_lock(&offline_mutex) == 0);
+
+        LIST_INSERT_AFTER(offline_queue, offline_queue, offline_queue_tail, f);
+        offline_queue_tail = f;
+
+        /* The threads we have are all busy with a file of their own, add another one unless at the limit */
+        if (offline_n_threads < OFFLINE_THREADS_MAX) {
+                sigset_t ss, saved_ss;
+                pthread_attr_t attr;
+                pthread_t t;
+
+                assert_se(sigfillset(&ss) >= 0);
+
+                r = pthread_attr_init(&attr);
+                if (r == 0) {
+                        assert_se(pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED) == 0);
 
+                        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+                        if (r == 0) {
+                                r = pthread_create(&t, &attr, journal_file_set_offline_thread, NULL);
+                                if (r == 0)
+                                        offline_n_threads++;
+
+                                assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+                        }
+
+                        (void) pthread_attr_destroy(&attr);
+                }
+
+                if (r > 0) {
+                        if (offline_n_threads > 0)
+                                /* The existing threads will get to the file too, just a bit later */
+                                r = 0;
+                        else {
+                                /* Without any thread the queue only ever contains the file just added */
+                                LIST_REMOVE(offline_queue, offline_queue, f);
+                                offline_queue_tail = NULL;
+                        }
+                }
+        }
+
+        assert_se(pthread_mutex_unlock(&offline_mutex) == 0);
+
+        return -r;
+}
+
+static int journal_file_set_offline_thread_join(JournalFile *f) {
         assert(f);
 
         if (f->offline_state == OFFLINE_JOINED)
                 return 0;
 
-        r = pthread_join(f->offline_thread, NULL);
-        if (r)
-                return -r;
+        /* An offline is in flight or already done, wait until the worker is finished with the file */
+        assert_se(pthread_mutex_lock(&offline_mutex) == 0);
+        while (f->offline_state != OFFLINE_DONE)
+                assert_se(pthread_cond_wait(&offline_done, &offline_mutex) == 0);
+        assert_se(pthread_mutex_unlock(&offline_mutex) == 0);
 
         f->offline_state = OFFLINE_JOINED;
 
@@ -195,7 +308,7 @@ static bool journal_file_set_offline_try_restart(JournalFile *f) {
 
 /* Sets a journal offline.
  *
- * If wait is false then an offline is dispatched in a separate thread for a
+ * If wait is false then an offline is dispatched to the offline thread pool for a
  * subsequent journal_file_set_offline() or journal_file_set_online() of the
  * same journal to synchronize with.
  *
@@ -231,31 +344,24 @@ int journal_file_set_offline(JournalFile *f, bool wait) {
         if (restarted)
                 return 0;
 
+#if HAVE_GCRYPT
+        /* Catch up with the HMAC at sync points, so that the work doesn't pile up until the next tag */
+        r = journal_file_hmac_flush(f);
+        if (r < 0)
+                log_debug_errno(r, "Failed to update HMAC of %s, ignoring: %m", f->path);
+#endif
+
         /* Initiate a new offline. */
         f->offline_state = OFFLINE_SYNCING;
 
         if (wait) /* Without using a thread if waiting. */
                 journal_file_set_offline_internal(f);
         else {
-                sigset_t ss, saved_ss;
-                int k;
-
-                if (sigfillset(&ss) < 0)
-                        return -errno;
-
-                r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
-                if (r > 0)
-                        return -r;
-
-                r = pthread_create(&f->offline_thread, NULL, journal_file_set_offline_thread, f);
-
-                k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
-                if (r > 0) {
+                r = journal_file_set_offline_thread_queue(f);
+                if (r < 0) {
                         f->offline_state = OFFLINE_JOINED;
-                        return -r;
+                        return r;
                 }
-                if (k > 0)
-                        return -k;
         }
 
         return 0;
@@ -389,10 +495,17 @@ JournalFile* journal_file_close(JournalFile *f) {
 
         ordered_hashmap_free_free(f->chain_cache);
 
-#if HAVE_XZ || HAVE_LZ4
+        free(f->boots);
+        free(f->data_hash_tables);
+
+#if HAVE_COMPRESSION
         free(f->compress_buffer);
 #endif
 
+#if HAVE_ZSTD
+        compress_dict_free(f->compress_dict);
+#endif
+
 #if HAVE_GCRYPT
         if (f->fss_file)
                 munmap(f->fss_file, PAGE_ALIGN(f->fss_file_size));
@@ -420,7 +533,9 @@ static int journal_file_init_header(JournalFile *f, JournalFile *template) {
 
         h.incompatible_flags |= htole32(
                 f->compress_xz * HEADER_INCOMPATIBLE_COMPRESSED_XZ |
-                f->compress_lz4 * HEADER_INCOMPATIBLE_COMPRESSED_LZ4);
+                f->compress_lz4 * HEADER_INCOMPATIBLE_COMPRESSED_LZ4 |
+                f->compress_zstd * HEADER_INCOMPATIBLE_COMPRESSED_ZSTD |
+                HEADER_INCOMPATIBLE_EXTENSIBLE_HASH_TABLE);
 
         h.compatible_flags = htole32(
                 f->seal * HEADER_COMPATIBLE_SEALED);
@@ -487,7 +602,7 @@ static bool warn_wrong_flags(const JournalFile *f, bool compatible) {
                                   f->path, type, flags & ~any);
                 flags = (flags & any) & ~supported;
                 if (flags) {
-                        const char* strv[3];
+                        const char* strv[4];
                         unsigned n = 0;
                         _cleanup_free_ char *t = NULL;
 
@@ -497,6 +612,8 @@ static bool warn_wrong_flags(const JournalFile *f, bool compatible) {
                                 strv[n++] = "xz-compressed";
                         if (!compatible && (flags & HEADER_INCOMPATIBLE_COMPRESSED_LZ4))
                                 strv[n++] = "lz4-compressed";
+                        if (!compatible && (flags & HEADER_INCOMPATIBLE_COMPRESSED_ZSTD))
+                                strv[n++] = "zstd-compressed";
                         strv[n] = NULL;
                         assert(n < ELEMENTSOF(strv));
 
@@ -554,6 +671,10 @@ static int journal_file_verify_header(JournalFile *f) {
             !VALID64(le64toh(f->header->entry_array_offset)))
                 return -ENODATA;
 
+        if (JOURNAL_HEADER_CONTAINS(f->header, data_hash_table_segment_offset) &&
+            !VALID64(le64toh(f->header->data_hash_table_segment_offset)))
+                return -ENODATA;
+
         if (f->writable) {
                 sd_id128_t machine_id;
                 uint8_t state;
@@ -592,6 +713,7 @@ static int journal_file_verify_header(JournalFile *f) {
 
         f->compress_xz = JOURNAL_HEADER_COMPRESSED_XZ(f->header);
         f->compress_lz4 = JOURNAL_HEADER_COMPRESSED_LZ4(f->header);
+        f->compress_zstd = JOURNAL_HEADER_COMPRESSED_ZSTD(f->header);
 
         f->seal = JOURNAL_HEADER_SEALED(f->header);
 
@@ -734,6 +856,10 @@ static uint64_t minimum_header_size(Object *o) {
                 [OBJECT_FIELD_HASH_TABLE] = sizeof(HashTableObject),
                 [OBJECT_ENTRY_ARRAY] = sizeof(EntryArrayObject),
                 [OBJECT_TAG] = sizeof(TagObject),
+                [OBJECT_DICTIONARY] = sizeof(DictionaryObject),
+                [OBJECT_BLOOM_FILTER] = sizeof(BloomFilterObject),
+                [OBJECT_REALTIME_INDEX] = sizeof(RealtimeIndexObject),
+                [OBJECT_DATA_HASH_TABLE_SEGMENT] = sizeof(DataHashTableSegmentObject),
         };
 
         if (o->object.type >= ELEMENTSOF(table) || table[o->object.type] <= 0)
@@ -899,6 +1025,56 @@ static int journal_file_check_object(JournalFile *f, uint64_t offset, Object *o)
                         return -EBADMSG;
                 }
 
+                break;
+
+        case OBJECT_DICTIONARY:
+                if (le64toh(o->object.size) <= offsetof(DictionaryObject, payload)) {
+                        log_debug(
+                              "Invalid object dictionary size: %"PRIu64": %"PRIu64,
+                              le64toh(o->object.size),
+                              offset);
+                        return -EBADMSG;
+                }
+
+                break;
+
+        case OBJECT_BLOOM_FILTER:
+                if (le64toh(o->object.size) <= offsetof(BloomFilterObject, bits) ||
+                    o->bloom_filter.n_functions <= 0) {
+                        log_debug(
+                              "Invalid object bloom filter: %"PRIu64": %"PRIu64,
+                              le64toh(o->object.size),
+                              offset);
+                        return -EBADMSG;
+                }
+
+                break;
+
+        case OBJECT_REALTIME_INDEX:
+                if ((le64toh(o->object.size) - offsetof(RealtimeIndexObject, items)) % sizeof(le64_t) != 0 ||
+                    le64toh(o->realtime_index.stride) <= 0 ||
+                    DIV_ROUND_UP(le64toh(o->realtime_index.n_entries), le64toh(o->realtime_index.stride)) !=
+                    (le64toh(o->object.size) - offsetof(RealtimeIndexObject, items)) / sizeof(le64_t)) {
+                        log_debug(
+                              "Invalid object realtime index: %"PRIu64": %"PRIu64,
+                              le64toh(o->object.size),
+                              offset);
+                        return -EBADMSG;
+                }
+
+                break;
+
+        case OBJECT_DATA_HASH_TABLE_SEGMENT:
+                if ((le64toh(o->object.size) - offsetof(DataHashTableSegmentObject, items)) % sizeof(HashItem) != 0 ||
+                    (le64toh(o->object.size) - offsetof(DataHashTableSegmentObject, items)) / sizeof(HashItem) <= 0 ||
+                    le64toh(o->data_hash_table_segment.previous_offset) >= offset) {
+                        log_debug(
+                              "Invalid data hash table segment: %"PRIu64": %"PRIu64,
+                              le64toh(o->object.size),
+                              offset);
+                        return -EBADMSG;
+                }
+
                 break;
         }
 
@@ -1029,6 +1205,12 @@ int journal_file_append_object(JournalFile *f, ObjectType type, uint64_t size, O
                 p += ALIGN64(le64toh(tail->object.size));
         }
 
+#if HAVE_GCRYPT
+        /* The HMAC is calculated lazily, remember where to pick up, see journal_file_hmac_flush() */
+        if (f->seal && f->hmac_offset == 0)
+                f->hmac_offset = p;
+#endif
+
         r = journal_file_allocate(f, p, size);
         if (r < 0)
                 return r;
@@ -1066,6 +1248,12 @@ static int journal_file_setup_data_hash_table(JournalFile *f) {
            the maximum file size based on these metrics. */
 
         s = (f->metrics.max_size * 4 / 768 / 3) * sizeof(HashItem);
+
+        /* If we can add segments later on, start small, so that files with few distinct field values
+         * don't carry a mostly empty table around. */
+        if (JOURNAL_HEADER_EXTENSIBLE_HASH_TABLE(f->header))
+                s = s / DATA_HASH_TABLE_INITIAL_FRACTION / sizeof(HashItem) * sizeof(HashItem);
+
         if (s < DEFAULT_DATA_HASH_TABLE_SIZE)
                 s = DEFAULT_DATA_HASH_TABLE_SIZE;
 
@@ -1114,197 +1302,692 @@ static int journal_file_setup_field_hash_table(JournalFile *f) {
 }
 
 int journal_file_map_data_hash_table(JournalFile *f) {
-        uint64_t s, p;
+        _cleanup_free_ uint64_t *offsets = NULL;
+        size_t n_offsets = 0, n_allocated = 0;
+        uint64_t s, p, newest;
         void *t;
         int r;
 
         assert(f);
         assert(f->header);
 
-        if (f->data_hash_table)
-                return 0;
-
-        p = le64toh(f->header->data_hash_table_offset);
-        s = le64toh(f->header->data_hash_table_size);
+        if (!f->data_hash_table) {
+                p = le64toh(f->header->data_hash_table_offset);
+                s = le64toh(f->header->data_hash_table_size);
 
-        r = journal_file_move_to(f,
-                                 OBJECT_DATA_HASH_TABLE,
-                                 true,
-                                 p, s,
-                                 &t, NULL);
-        if (r < 0)
-                return r;
-
-        f->data_hash_table = t;
-        return 0;
-}
+                r = journal_file_move_to(f,
+                                         OBJECT_DATA_HASH_TABLE,
+                                         true,
+                                         p, s,
+                                         &t, NULL);
+                if (r < 0)
+                        return r;
 
-int journal_file_map_field_hash_table(JournalFile *f) {
-        uint64_t s, p;
-        void *t;
-        int r;
+                if (!GREEDY_REALLOC(f->data_hash_tables, f->n_data_hash_tables_allocated, 1))
+                        return -ENOMEM;
 
-        assert(f);
-        assert(f->header);
+                f->data_hash_tables[0] = (JournalHashTable) {
+                        .items = t,
+                        .n_items = s / sizeof(HashItem),
+                };
+                f->n_data_hash_tables = 1;
+                f->data_hash_table = t;
+        }
 
-        if (f->field_hash_table)
+        if (!JOURNAL_HEADER_EXTENSIBLE_HASH_TABLE(f->header) ||
+            !JOURNAL_HEADER_CONTAINS(f->header, data_hash_table_segment_offset))
                 return 0;
 
-        p = le64toh(f->header->field_hash_table_offset);
-        s = le64toh(f->header->field_hash_table_size);
+        /* A writer might have added segments since we last looked. They are linked newest first, hence
+         * collect the ones we don't know yet, and then map them oldest first. */
+        newest = f->data_hash_tables[f->n_data_hash_tables - 1].segment_offset;
 
-        r = journal_file_move_to(f,
-                                 OBJECT_FIELD_HASH_TABLE,
-                                 true,
-                                 p, s,
-                                 &t, NULL);
-        if (r < 0)
-                return r;
+        p = le64toh(f->header->data_hash_table_segment_offset);
+        while (p != newest) {
+                Object *o;
 
-        f->field_hash_table = t;
-        return 0;
-}
+                if (p == 0)
+                        return -EBADMSG;
 
-static int journal_file_link_field(
-                JournalFile *f,
-                Object *o,
-                uint64_t offset,
-                uint64_t hash) {
+                r = journal_file_move_to_object(f, OBJECT_DATA_HASH_TABLE_SEGMENT, p, &o);
+                if (r < 0)
+                        return r;
 
-        uint64_t p, h, m;
-        int r;
+                if (!GREEDY_REALLOC(offsets, n_allocated, n_offsets + 1))
+                        return -ENOMEM;
 
-        assert(f);
-        assert(f->header);
-        assert(f->field_hash_table);
-        assert(o);
-        assert(offset > 0);
+                offsets[n_offsets++] = p;
 
-        if (o->object.type != OBJECT_FIELD)
-                return -EINVAL;
+                /* journal_file_check_object() made sure this goes backwards */
+                p = le64toh(o->data_hash_table_segment.previous_offset);
+        }
 
-        m = le64toh(f->header->field_hash_table_size) / sizeof(HashItem);
-        if (m <= 0)
-                return -EBADMSG;
+        if (!GREEDY_REALLOC(f->data_hash_tables, f->n_data_hash_tables_allocated, f->n_data_hash_tables + n_offsets))
+                return -ENOMEM;
 
-        /* This might alter the window we are looking at */
-        o->field.next_hash_offset = o->field.head_data_offset = 0;
+        while (n_offsets > 0) {
+                Object *o;
 
-        h = hash % m;
-        p = le64toh(f->field_hash_table[h].tail_hash_offset);
-        if (p == 0)
-                f->field_hash_table[h].head_hash_offset = htole64(offset);
-        else {
-                r = journal_file_move_to_object(f, OBJECT_FIELD, p, &o);
+                p = offsets[--n_offsets];
+
+                r = journal_file_move_to_object(f, OBJECT_DATA_HASH_TABLE_SEGMENT, p, &o);
                 if (r < 0)
                         return r;
 
-                o->field.next_hash_offset = htole64(offset);
-        }
+                s = le64toh(o->object.size);
 
-        f->field_hash_table[h].tail_hash_offset = htole64(offset);
+                /* Keep the whole segment mapped, like the table itself */
+                r = journal_file_move_to(f,
+                                         OBJECT_DATA_HASH_TABLE_SEGMENT,
+                                         true,
+                                         p, s,
+                                         &t, NULL);
+                if (r < 0)
+                        return r;
 
-        if (JOURNAL_HEADER_CONTAINS(f->header, n_fields))
-                f->header->n_fields = htole64(le64toh(f->header->n_fields) + 1);
+                o = t;
+                f->data_hash_tables[f->n_data_hash_tables++] = (JournalHashTable) {
+                        .items = o->data_hash_table_segment.items,
+                        .n_items = (s - offsetof(Object, data_hash_table_segment.items)) / sizeof(HashItem),
+                        .segment = &o->data_hash_table_segment,
+                        .segment_offset = p,
+                };
+        }
 
         return 0;
 }
 
-static int journal_file_link_data(
-                JournalFile *f,
-                Object *o,
-                uint64_t offset,
-                uint64_t hash) {
-
-        uint64_t p, h, m;
-        int r;
+static uint64_t journal_file_data_hash_table_n_items(JournalFile *f) {
+        uint64_t n = 0;
+        size_t i;
 
         assert(f);
-        assert(f->header);
-        assert(f->data_hash_table);
-        assert(o);
-        assert(offset > 0);
 
-        if (o->object.type != OBJECT_DATA)
-                return -EINVAL;
+        for (i = 0; i < f->n_data_hash_tables; i++)
+                n += f->data_hash_tables[i].n_items;
 
-        m = le64toh(f->header->data_hash_table_size) / sizeof(HashItem);
-        if (m <= 0)
-                return -EBADMSG;
+        return n;
+}
 
-        /* This might alter the window we are looking at */
-        o->data.next_hash_offset = o->data.next_field_offset = 0;
-        o->data.entry_offset = o->data.entry_array_offset = 0;
-        o->data.n_entries = 0;
+/* Addresses the buckets of the data hash table and of all its segments as if they were one array, for
+ * callers that want to look at every data object once, in no particular order */
+static HashItem* journal_file_data_hash_table_item(JournalFile *f, uint64_t i) {
+        size_t j;
 
-        h = hash % m;
-        p = le64toh(f->data_hash_table[h].tail_hash_offset);
-        if (p == 0)
-                /* Only entry in the hash table is easy */
-                f->data_hash_table[h].head_hash_offset = htole64(offset);
-        else {
-                /* Move back to the previous data object, to patch in
-                 * pointer */
+        assert(f);
 
-                r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
-                if (r < 0)
-                        return r;
+        for (j = 0; j < f->n_data_hash_tables; j++) {
+                if (i < f->data_hash_tables[j].n_items)
+                        return f->data_hash_tables[j].items + i;
 
-                o->data.next_hash_offset = htole64(offset);
+                i -= f->data_hash_tables[j].n_items;
         }
 
-        f->data_hash_table[h].tail_hash_offset = htole64(offset);
+        assert_not_reached("Hash table item out of range");
+}
 
-        if (JOURNAL_HEADER_CONTAINS(f->header, n_data))
-                f->header->n_data = htole64(le64toh(f->header->n_data) + 1);
+static uint64_t journal_file_data_hash_table_n_data(JournalFile *f, JournalHashTable *t) {
+        uint64_t n;
+        size_t i;
 
-        return 0;
+        assert(f);
+        assert(t);
+
+        if (t->segment)
+                return le64toh(t->segment->n_data);
+
+        /* The table the header points to only counts what is not in any of the segments */
+        if (!JOURNAL_HEADER_CONTAINS(f->header, n_data))
+                return 0;
+
+        n = le64toh(f->header->n_data);
+        for (i = 1; i < f->n_data_hash_tables; i++)
+                n -= MIN(n, le64toh(f->data_hash_tables[i].segment->n_data));
+
+        return n;
 }
 
-int journal_file_find_field_object_with_hash(
-                JournalFile *f,
-                const void *field, uint64_t size, uint64_t hash,
-                Object **ret, uint64_t *offset) {
+static bool journal_file_data_hash_table_full(JournalFile *f, JournalHashTable *t) {
+        /* Same 75% fill level as for the rotation check */
+        return journal_file_data_hash_table_n_data(f, t) * 4ULL > t->n_items * 3ULL;
+}
 
-        uint64_t p, osize, h, m;
+static int journal_file_extend_data_hash_table(JournalFile *f) {
+        JournalHashTable *t;
+        uint64_t s, p;
+        Object *o;
         int r;
 
         assert(f);
         assert(f->header);
-        assert(field && size > 0);
 
-        /* If the field hash table is empty, we can't find anything */
-        if (le64toh(f->header->field_hash_table_size) <= 0)
+        if (!JOURNAL_HEADER_EXTENSIBLE_HASH_TABLE(f->header) ||
+            !JOURNAL_HEADER_CONTAINS(f->header, data_hash_table_segment_offset))
                 return 0;
 
-        /* Map the field hash table, if it isn't mapped yet. */
-        r = journal_file_map_field_hash_table(f);
+        r = journal_file_map_data_hash_table(f);
         if (r < 0)
                 return r;
 
-        osize = offsetof(Object, field.payload) + size;
+        /* New data objects are only ever linked into the newest table, hence that's the only one that can
+         * fill up */
+        t = f->data_hash_tables + f->n_data_hash_tables - 1;
+        if (!journal_file_data_hash_table_full(f, t))
+                return 0;
 
-        m = le64toh(f->header->field_hash_table_size) / sizeof(HashItem);
-        if (m <= 0)
-                return -EBADMSG;
+        /* We have enough segments, leave it to journal_file_rotate_suggested() */
+        if (f->n_data_hash_tables > DATA_HASH_TABLE_SEGMENTS_MAX)
+                return 0;
 
-        h = hash % m;
-        p = le64toh(f->field_hash_table[h].head_hash_offset);
+        s = t->n_items * DATA_HASH_TABLE_SEGMENT_GROWTH * sizeof(HashItem);
 
-        while (p > 0) {
-                Object *o;
+        r = journal_file_append_object(f,
+                                       OBJECT_DATA_HASH_TABLE_SEGMENT,
+                                       offsetof(Object, data_hash_table_segment.items) + s,
+                                       &o, &p);
+        if (r < 0)
+                return r;
 
-                r = journal_file_move_to_object(f, OBJECT_FIELD, p, &o);
-                if (r < 0)
-                        return r;
+        o->data_hash_table_segment.previous_offset = f->header->data_hash_table_segment_offset;
+        o->data_hash_table_segment.n_data = 0;
+        memzero(o->data_hash_table_segment.items, s);
 
-                if (le64toh(o->field.hash) == hash &&
-                    le64toh(o->object.size) == osize &&
-                    memcmp(o->field.payload, field, size) == 0) {
+        /* Only make the segment visible to readers once it is fully initialized */
+        f->header->data_hash_table_segment_offset = htole64(p);
 
-                        if (ret)
-                                *ret = o;
-                        if (offset)
+        log_debug("Extended data hash table of %s by %"PRIu64" entries.", f->path, s / sizeof(HashItem));
+
+        return journal_file_map_data_hash_table(f);
+}
+
+static int journal_file_data_hash_table_stats(
+                JournalFile *f,
+                uint64_t *ret_n_objects,
+                uint64_t *ret_n_chains,
+                uint64_t *ret_max_depth) {
+
+        uint64_t n_objects = 0, n_chains = 0, max_depth = 0;
+        size_t i;
+        int r;
+
+        assert(f);
+        assert(ret_n_objects);
+        assert(ret_n_chains);
+        assert(ret_max_depth);
+
+        /* How many data objects are linked into how many hash chains, and how long the longest one is.
+         * Note that this walks all data objects of the file. */
+
+        r = journal_file_map_data_hash_table(f);
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < f->n_data_hash_tables; i++) {
+                JournalHashTable *t = f->data_hash_tables + i;
+                uint64_t j;
+
+                for (j = 0; j < t->n_items; j++) {
+                        uint64_t p, depth = 0;
+
+                        p = le64toh(t->items[j].head_hash_offset);
+                        if (p == 0)
+                                continue;
+
+                        while (p > 0) {
+                                Object *o;
+
+                                r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+                                if (r < 0)
+                                        return r;
+
+                                depth++;
+                                p = le64toh(o->data.next_hash_offset);
+                        }
+
+                        n_objects += depth;
+                        n_chains++;
+                        max_depth = MAX(max_depth, depth);
+                }
+        }
+
+        *ret_n_objects = n_objects;
+        *ret_n_chains = n_chains;
+        *ret_max_depth = max_depth;
+        return 0;
+}
+
+#if HAVE_ZSTD
+static int journal_file_setup_dictionary(JournalFile *f, JournalFile *template) {
+        _cleanup_(compress_dict_freep) CompressDict *d = NULL;
+        _cleanup_free_ uint8_t *samples = NULL;
+        _cleanup_free_ size_t *sizes = NULL;
+        size_t samples_allocated = 0, sizes_allocated = 0, samples_size = 0, dsize;
+        unsigned n_samples = 0;
+        const void *dict;
+        uint64_t i, n, p;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(template);
+
+        /* Collects the short, uncompressed DATA payloads of the file we are rotating away from, and trains
+         * a dictionary for the new file on them. Walking the data hash table rather than the whole file
+         * remains cheap even for big files, as we stop as soon as we have enough samples, and it yields
+         * every distinct field value only once. */
+
+        if (!template->header || le64toh(template->header->n_entries) == 0)
+                return 0;
+
+        r = journal_file_map_data_hash_table(template);
+        if (r < 0)
+                return r;
+
+        n = journal_file_data_hash_table_n_items(template);
+        for (i = 0; i < n && samples_size < DICTIONARY_SAMPLES_MAX; i++) {
+
+                p = le64toh(journal_file_data_hash_table_item(template, i)->head_hash_offset);
+                while (p > 0 && samples_size < DICTIONARY_SAMPLES_MAX) {
+                        uint64_t l;
+
+                        r = journal_file_move_to_object(template, OBJECT_DATA, p, &o);
+                        if (r < 0)
+                                return r;
+
+                        p = le64toh(o->data.next_hash_offset);
+
+                        if (o->object.flags & OBJECT_COMPRESSION_MASK)
+                                continue;
+
+                        l = le64toh(o->object.size) - offsetof(Object, data.payload);
+                        if (l < DICTIONARY_COMPRESS_MIN || l >= f->compress_threshold_bytes)
+                                continue;
+
+                        if (!GREEDY_REALLOC(samples, samples_allocated, samples_size + l))
+                                return -ENOMEM;
+                        if (!GREEDY_REALLOC(sizes, sizes_allocated, n_samples + 1))
+                                return -ENOMEM;
+
+                        memcpy(samples + samples_size, o->data.payload, l);
+                        samples_size += l;
+                        sizes[n_samples++] = l;
+                }
+        }
+
+        if (n_samples < DICTIONARY_N_SAMPLES_MIN) {
+                log_debug("Only %u short data objects in %s, not training a compression dictionary.",
+                          n_samples, template->path);
+                return 0;
+        }
+
+        r = compress_dict_train(samples, sizes, n_samples, DICTIONARY_SIZE_MAX, &d);
+        if (r < 0)
+                return r;
+
+        dict = compress_dict_data(d, &dsize);
+
+        r = journal_file_append_object(f, OBJECT_DICTIONARY, offsetof(Object, dictionary.payload) + dsize, &o, &p);
+        if (r < 0)
+                return r;
+
+        memcpy(o->dictionary.payload, dict, dsize);
+
+        f->header->dictionary_offset = htole64(p);
+        f->header->incompatible_flags |= htole32(HEADER_INCOMPATIBLE_ZSTD_DICTIONARY);
+
+        f->compress_dict = TAKE_PTR(d);
+        f->compress_dict_loaded = true;
+
+        log_debug("Trained %zu byte compression dictionary for %s from %u data objects (%zu bytes).",
+                  dsize, f->path, n_samples, samples_size);
+
+        return 0;
+}
+#endif
+
+CompressDict* journal_file_compress_dict(JournalFile *f) {
+#if HAVE_ZSTD
+        uint64_t p;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+
+        /* Returns the dictionary of this file, loading it on first use. Returns NULL if there is none or it
+         * cannot be loaded, in which case objects compressed against it will fail to decompress. */
+
+        if (f->compress_dict_loaded)
+                return f->compress_dict;
+
+        f->compress_dict_loaded = true;
+
+        if (!JOURNAL_HEADER_ZSTD_DICTIONARY(f->header) ||
+            !JOURNAL_HEADER_CONTAINS(f->header, dictionary_offset))
+                return NULL;
+
+        p = le64toh(f->header->dictionary_offset);
+        if (p == 0)
+                return NULL;
+
+        r = journal_file_move_to_object(f, OBJECT_DICTIONARY, p, &o);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to move to compression dictionary of %s: %m", f->path);
+                return NULL;
+        }
+
+        r = compress_dict_new(o->dictionary.payload,
+                              le64toh(o->object.size) - offsetof(Object, dictionary.payload),
+                              &f->compress_dict);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to load compression dictionary of %s: %m", f->path);
+                return NULL;
+        }
+
+        return f->compress_dict;
+#else
+        return NULL;
+#endif
+}
+
+static uint64_t bloom_filter_bit(uint64_t hash, unsigned i, uint64_t n_bits) {
+        /* Derive the k hash functions from the two halves of the 64bit hash we already have for every
+         * DATA object, by means of double hashing */
+        return ((hash & UINT32_MAX) + i * ((hash >> 32) | 1)) % n_bits;
+}
+
+static int journal_file_append_bloom_filter(JournalFile *f) {
+        _cleanup_free_ uint8_t *bits = NULL;
+        uint64_t i, n, p, n_items = 0, n_bits, size;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+
+        /* Writes a bloom filter over the hashes of all DATA objects of the file, so that readers can skip
+         * the file quickly when looking for matches it cannot contain. Only ever call this right before
+         * archiving the file, as it isn't updated when further entries are appended. */
+
+        if (!f->writable ||
+            !JOURNAL_HEADER_CONTAINS(f->header, bloom_filter_offset) ||
+            JOURNAL_HEADER_BLOOM_FILTER(f->header))
+                return 0;
+
+        n = le64toh(f->header->n_data);
+        if (n == 0)
+                return 0;
+
+        if (n > BLOOM_FILTER_SIZE_MAX * 8 / BLOOM_FILTER_BITS_PER_ITEM) {
+                log_debug("Not writing bloom filter for %s, %"PRIu64" data objects are too many.", f->path, n);
+                return 0;
+        }
+
+        n_bits = ALIGN_TO(n * BLOOM_FILTER_BITS_PER_ITEM, 64);
+        size = n_bits / 8;
+
+        bits = new0(uint8_t, size);
+        if (!bits)
+                return -ENOMEM;
+
+        r = journal_file_map_data_hash_table(f);
+        if (r < 0)
+                return r;
+
+        n = journal_file_data_hash_table_n_items(f);
+        for (i = 0; i < n; i++) {
+
+                p = le64toh(journal_file_data_hash_table_item(f, i)->head_hash_offset);
+                while (p > 0) {
+                        uint64_t h;
+                        unsigned k;
+
+                        r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+                        if (r < 0)
+                                return r;
+
+                        h = le64toh(o->data.hash);
+                        for (k = 0; k < BLOOM_FILTER_N_FUNCTIONS; k++) {
+                                uint64_t b = bloom_filter_bit(h, k, n_bits);
+
+                                bits[b / 8] |= 1U << (b % 8);
+                        }
+
+                        n_items++;
+                        p = le64toh(o->data.next_hash_offset);
+                }
+        }
+
+        r = journal_file_append_object(f, OBJECT_BLOOM_FILTER, offsetof(Object, bloom_filter.bits) + size, &o, &p);
+        if (r < 0)
+                return r;
+
+        o->bloom_filter.n_items = htole64(n_items);
+        o->bloom_filter.n_functions = BLOOM_FILTER_N_FUNCTIONS;
+        memcpy(o->bloom_filter.bits, bits, size);
+
+        f->header->bloom_filter_offset = htole64(p);
+        f->header->compatible_flags |= htole32(HEADER_COMPATIBLE_BLOOM_FILTER);
+
+        log_debug("Wrote %"PRIu64" byte bloom filter over %"PRIu64" data objects for %s.", size, n_items, f->path);
+
+        return 0;
+}
+
+bool journal_file_maybe_contains_hash(JournalFile *f, uint64_t hash) {
+        uint64_t p, n_bits;
+        unsigned k;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+
+        /* Returns false if the file definitely contains no DATA object with the specified hash, true if it
+         * might. The bloom filter is only trusted on archived files, as nothing may be appended to them
+         * after it was written. */
+
+        if (f->header->state != STATE_ARCHIVED ||
+            !JOURNAL_HEADER_BLOOM_FILTER(f->header) ||
+            !JOURNAL_HEADER_CONTAINS(f->header, bloom_filter_offset))
+                return true;
+
+        p = le64toh(f->header->bloom_filter_offset);
+        if (p == 0)
+                return true;
+
+        r = journal_file_move_to_object(f, OBJECT_BLOOM_FILTER, p, &o);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to move to bloom filter of %s, ignoring: %m", f->path);
+                return true;
+        }
+
+        n_bits = (le64toh(o->object.size) - offsetof(Object, bloom_filter.bits)) * 8;
+
+        for (k = 0; k < o->bloom_filter.n_functions; k++) {
+                uint64_t b = bloom_filter_bit(hash, k, n_bits);
+
+                if (!(o->bloom_filter.bits[b / 8] & (1U << (b % 8))))
+                        return false;
+        }
+
+        return true;
+}
+
+int journal_file_map_field_hash_table(JournalFile *f) {
+        uint64_t s, p;
+        void *t;
+        int r;
+
+        assert(f);
+        assert(f->header);
+
+        if (f->field_hash_table)
+                return 0;
+
+        p = le64toh(f->header->field_hash_table_offset);
+        s = le64toh(f->header->field_hash_table_size);
+
+        r = journal_file_move_to(f,
+                                 OBJECT_FIELD_HASH_TABLE,
+                                 true,
+                                 p, s,
+                                 &t, NULL);
+        if (r < 0)
+                return r;
+
+        f->field_hash_table = t;
+        return 0;
+}
+
+static int journal_file_link_field(
+                JournalFile *f,
+                Object *o,
+                uint64_t offset,
+                uint64_t hash) {
+
+        uint64_t p, h, m;
+        int r;
+
+        assert(f);
+        assert(f->header);
+        assert(f->field_hash_table);
+        assert(o);
+        assert(offset > 0);
+
+        if (o->object.type != OBJECT_FIELD)
+                return -EINVAL;
+
+        m = le64toh(f->header->field_hash_table_size) / sizeof(HashItem);
+        if (m <= 0)
+                return -EBADMSG;
+
+        /* This might alter the window we are looking at */
+        o->field.next_hash_offset = o->field.head_data_offset = 0;
+
+        h = hash % m;
+        p = le64toh(f->field_hash_table[h].tail_hash_offset);
+        if (p == 0)
+                f->field_hash_table[h].head_hash_offset = htole64(offset);
+        else {
+                r = journal_file_move_to_object(f, OBJECT_FIELD, p, &o);
+                if (r < 0)
+                        return r;
+
+                o->field.next_hash_offset = htole64(offset);
+        }
+
+        f->field_hash_table[h].tail_hash_offset = htole64(offset);
+
+        if (JOURNAL_HEADER_CONTAINS(f->header, n_fields))
+                f->header->n_fields = htole64(le64toh(f->header->n_fields) + 1);
+
+        return 0;
+}
+
+static int journal_file_link_data(
+                JournalFile *f,
+                Object *o,
+                uint64_t offset,
+                uint64_t hash) {
+
+        JournalHashTable *t;
+        uint64_t p, h, m;
+        int r;
+
+        assert(f);
+        assert(f->header);
+        assert(f->data_hash_table);
+        assert(f->n_data_hash_tables > 0);
+        assert(o);
+        assert(offset > 0);
+
+        if (o->object.type != OBJECT_DATA)
+                return -EINVAL;
+
+        /* New data objects always go into the newest table, see journal_file_extend_data_hash_table() */
+        t = &f->data_hash_tables[f->n_data_hash_tables - 1];
+
+        m = t->n_items;
+        if (m <= 0)
+                return -EBADMSG;
+
+        /* This might alter the window we are looking at */
+        o->data.next_hash_offset = o->data.next_field_offset = 0;
+        o->data.entry_offset = o->data.entry_array_offset = 0;
+        o->data.n_entries = 0;
+
+        h = hash % m;
+        p = le64toh(t->items[h].tail_hash_offset);
+        if (p == 0)
+                /* Only entry in the hash table is easy */
+                t->items[h].head_hash_offset = htole64(offset);
+        else {
+                /* Move back to the previous data object, to patch in
+                 * pointer */
+
+                r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+                if (r < 0)
+                        return r;
+
+                o->data.next_hash_offset = htole64(offset);
+        }
+
+        t->items[h].tail_hash_offset = htole64(offset);
+
+        if (t->segment)
+                t->segment->n_data = htole64(le64toh(t->segment->n_data) + 1);
+
+        if (JOURNAL_HEADER_CONTAINS(f->header, n_data))
+                f->header->n_data = htole64(le64toh(f->header->n_data) + 1);
+
+        return 0;
+}
+
+int journal_file_find_field_object_with_hash(
+                JournalFile *f,
+                const void *field, uint64_t size, uint64_t hash,
+                Object **ret, uint64_t *offset) {
+
+        uint64_t p, osize, h, m;
+        int r;
+
+        assert(f);
+        assert(f->header);
+        assert(field && size > 0);
+
+        /* If the field hash table is empty, we can't find anything */
+        if (le64toh(f->header->field_hash_table_size) <= 0)
+                return 0;
+
+        /* Map the field hash table, if it isn't mapped yet. */
+        r = journal_file_map_field_hash_table(f);
+        if (r < 0)
+                return r;
+
+        osize = offsetof(Object, field.payload) + size;
+
+        m = le64toh(f->header->field_hash_table_size) / sizeof(HashItem);
+        if (m <= 0)
+                return -EBADMSG;
+
+        h = hash % m;
+        p = le64toh(f->field_hash_table[h].head_hash_offset);
+
+        while (p > 0) {
+                Object *o;
+
+                r = journal_file_move_to_object(f, OBJECT_FIELD, p, &o);
+                if (r < 0)
+                        return r;
+
+                if (le64toh(o->field.hash) == hash &&
+                    le64toh(o->object.size) == osize &&
+                    memcmp(o->field.payload, field, size) == 0) {
+
+                        if (ret)
+                                *ret = o;
+                        if (offset)
                                 *offset = p;
 
                         return 1;
@@ -1333,8 +2016,9 @@ int journal_file_find_field_object(
                                                         ret, offset);
 }
 
-int journal_file_find_data_object_with_hash(
+static int journal_file_find_data_object_in_hash_table(
                 JournalFile *f,
+                JournalHashTable *t,
                 const void *data, uint64_t size, uint64_t hash,
                 Object **ret, uint64_t *offset) {
 
@@ -1342,26 +2026,17 @@ int journal_file_find_data_object_with_hash(
         int r;
 
         assert(f);
-        assert(f->header);
+        assert(t);
         assert(data || size == 0);
 
-        /* If there's no data hash table, then there's no entry. */
-        if (le64toh(f->header->data_hash_table_size) <= 0)
-                return 0;
-
-        /* Map the data hash table, if it isn't mapped yet. */
-        r = journal_file_map_data_hash_table(f);
-        if (r < 0)
-                return r;
-
         osize = offsetof(Object, data.payload) + size;
 
-        m = le64toh(f->header->data_hash_table_size) / sizeof(HashItem);
+        m = t->n_items;
         if (m <= 0)
                 return -EBADMSG;
 
         h = hash % m;
-        p = le64toh(f->data_hash_table[h].head_hash_offset);
+        p = le64toh(t->items[h].head_hash_offset);
 
         while (p > 0) {
                 Object *o;
@@ -1374,7 +2049,7 @@ int journal_file_find_data_object_with_hash(
                         goto next;
 
                 if (o->object.flags & OBJECT_COMPRESSION_MASK) {
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
                         uint64_t l;
                         size_t rsize = 0;
 
@@ -1384,7 +2059,7 @@ int journal_file_find_data_object_with_hash(
 
                         l -= offsetof(Object, data.payload);
 
-                        r = decompress_blob(o->object.flags & OBJECT_COMPRESSION_MASK,
+                        r = decompress_blob(o->object.flags & OBJECT_COMPRESSION_MASK, journal_file_compress_dict(f),
                                             o->data.payload, l, &f->compress_buffer, &f->compress_buffer_size, &rsize, 0);
                         if (r < 0)
                                 return r;
@@ -1422,6 +2097,38 @@ int journal_file_find_data_object_with_hash(
         return 0;
 }
 
+int journal_file_find_data_object_with_hash(
+                JournalFile *f,
+                const void *data, uint64_t size, uint64_t hash,
+                Object **ret, uint64_t *offset) {
+
+        size_t i;
+        int r;
+
+        assert(f);
+        assert(f->header);
+        assert(data || size == 0);
+
+        /* If there's no data hash table, then there's no entry. */
+        if (le64toh(f->header->data_hash_table_size) <= 0)
+                return 0;
+
+        /* Map the data hash table and its segments, if they aren't mapped yet. */
+        r = journal_file_map_data_hash_table(f);
+        if (r < 0)
+                return r;
+
+        /* Every data object is linked into exactly one of the tables. Look at the oldest one first, as the
+         * values that are logged most often tend to show up early in the file. */
+        for (i = 0; i < f->n_data_hash_tables; i++) {
+                r = journal_file_find_data_object_in_hash_table(f, &f->data_hash_tables[i], data, size, hash, ret, offset);
+                if (r != 0)
+                        return r;
+        }
+
+        return 0;
+}
+
 int journal_file_find_data_object(
                 JournalFile *f,
                 const void *data, uint64_t size,
@@ -1486,12 +2193,6 @@ static int journal_file_append_field(
         if (r < 0)
                 return r;
 
-#if HAVE_GCRYPT
-        r = journal_file_hmac_put_object(f, OBJECT_FIELD, o, p);
-        if (r < 0)
-                return r;
-#endif
-
         if (ret)
                 *ret = o;
 
@@ -1501,9 +2202,22 @@ static int journal_file_append_field(
         return 0;
 }
 
+static bool compressed_field_usable(JournalFile *f, const CompressedField *c, uint64_t size) {
+        assert(f);
+
+        /* A field compressed ahead of time is only used if it was compressed with the codec of this file, and
+         * if the file would have compressed it anyway. */
+        return c && c->data &&
+                JOURNAL_FILE_COMPRESS(f) &&
+                c->compression == journal_file_compression(f) &&
+                size >= f->compress_threshold_bytes &&
+                c->size < size;
+}
+
 static int journal_file_append_data(
                 JournalFile *f,
                 const void *data, uint64_t size,
+                const CompressedField *c,
                 Object **ret, uint64_t *offset) {
 
         uint64_t hash, p;
@@ -1515,7 +2229,10 @@ static int journal_file_append_data(
         assert(f);
         assert(data || size == 0);
 
-        hash = hash64(data, size);
+        hash = c && c->hashed ? c->hash : hash64(data, size);
+
+        if (!compressed_field_usable(f, c, size))
+                c = NULL;
 
         r = journal_file_find_data_object_with_hash(f, data, size, hash, &o, &p);
         if (r < 0)
@@ -1531,6 +2248,11 @@ static int journal_file_append_data(
                 return 0;
         }
 
+        /* Do this before appending the object, as it might alter the window we are looking at */
+        r = journal_file_extend_data_hash_table(f);
+        if (r < 0)
+                return r;
+
         osize = offsetof(Object, data.payload) + size;
         r = journal_file_append_object(f, OBJECT_DATA, osize, &o, &p);
         if (r < 0)
@@ -1538,11 +2260,20 @@ static int journal_file_append_data(
 
         o->data.hash = htole64(hash);
 
-#if HAVE_XZ || HAVE_LZ4
-        if (JOURNAL_FILE_COMPRESS(f) && size >= f->compress_threshold_bytes) {
+        if (c) {
+                memcpy(o->data.payload, c->data, c->size);
+                compression = c->compression;
+
+                o->object.size = htole64(offsetof(Object, data.payload) + c->size);
+                o->object.flags |= compression;
+        }
+
+#if HAVE_COMPRESSION
+        if (!c && JOURNAL_FILE_COMPRESS(f) && size >= f->compress_threshold_bytes) {
                 size_t rsize = 0;
 
-                compression = compress_blob(data, size, o->data.payload, size - 1, &rsize);
+                compression = compress_blob_explicit(journal_file_compression(f),
+                                                     data, size, o->data.payload, size - 1, &rsize);
 
                 if (compression >= 0) {
                         o->object.size = htole64(offsetof(Object, data.payload) + rsize);
@@ -1556,6 +2287,23 @@ static int journal_file_append_data(
         }
 #endif
 
+#if HAVE_ZSTD
+        /* Short fields gain nothing from being compressed on their own, but they tend to be very repetitive,
+         * hence compress them against the dictionary of this file, if there is one. */
+        if (f->compress_zstd && size >= DICTIONARY_COMPRESS_MIN && size < f->compress_threshold_bytes) {
+                CompressDict *d;
+                size_t rsize = 0;
+
+                d = journal_file_compress_dict(f);
+                if (d && compress_blob_zstd_dict(d, data, size, o->data.payload, size - 1, &rsize) >= 0) {
+                        compression = OBJECT_COMPRESSED_ZSTD;
+
+                        o->object.size = htole64(offsetof(Object, data.payload) + rsize);
+                        o->object.flags |= compression;
+                }
+        }
+#endif
+
         if (compression == 0)
                 memcpy_safe(o->data.payload, data, size);
 
@@ -1563,12 +2311,6 @@ static int journal_file_append_data(
         if (r < 0)
                 return r;
 
-#if HAVE_GCRYPT
-        r = journal_file_hmac_put_object(f, OBJECT_DATA, o, p);
-        if (r < 0)
-                return r;
-#endif
-
         /* The linking might have altered the window, so let's
          * refresh our pointer */
         r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
@@ -1629,12 +2371,60 @@ uint64_t journal_file_hash_table_n_items(Object *o) {
         return (le64toh(o->object.size) - offsetof(Object, hash_table.items)) / sizeof(HashItem);
 }
 
+typedef struct ChainCacheItem {
+        uint64_t first; /* the array at the beginning of the chain */
+        uint64_t array; /* the cached array */
+        uint64_t begin; /* the first item in the cached array */
+        uint64_t total; /* the total number of items in all arrays before this one in the chain */
+        uint64_t last_index; /* the last index we looked at, to optimize locality when bisecting */
+} ChainCacheItem;
+
+static void chain_cache_put(
+                OrderedHashmap *h,
+                ChainCacheItem *ci,
+                uint64_t first,
+                uint64_t array,
+                uint64_t begin,
+                uint64_t total,
+                uint64_t last_index) {
+
+        if (!ci) {
+                /* If the chain item to cache for this chain is the
+                 * first one it's not worth caching anything */
+                if (array == first)
+                        return;
+
+                if (ordered_hashmap_size(h) >= CHAIN_CACHE_MAX) {
+                        ci = ordered_hashmap_steal_first(h);
+                        assert(ci);
+                } else {
+                        ci = new(ChainCacheItem, 1);
+                        if (!ci)
+                                return;
+                }
+
+                ci->first = first;
+
+                if (ordered_hashmap_put(h, &ci->first, ci) < 0) {
+                        free(ci);
+                        return;
+                }
+        } else
+                assert(ci->first == first);
+
+        ci->array = array;
+        ci->begin = begin;
+        ci->total = total;
+        ci->last_index = last_index;
+}
+
 static int link_entry_into_array(JournalFile *f,
                                  le64_t *first,
                                  le64_t *idx,
                                  uint64_t p) {
         int r;
-        uint64_t n = 0, ap = 0, q, i, a, hidx;
+        uint64_t n = 0, ap = 0, q, i, a, hidx, t = 0;
+        ChainCacheItem *ci;
         Object *o;
 
         assert(f);
@@ -1645,6 +2435,16 @@ static int link_entry_into_array(JournalFile *f,
 
         a = le64toh(*first);
         i = hidx = le64toh(*idx);
+
+        /* Long chains are appended to at their end, hence skip right to the last array we wrote to, if we
+         * still know it */
+        ci = a > 0 ? ordered_hashmap_get(f->chain_cache, &a) : NULL;
+        if (ci && i >= ci->total) {
+                a = ci->array;
+                i -= ci->total;
+                t = ci->total;
+        }
+
         while (a > 0) {
 
                 r = journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY, a, &o);
@@ -1655,10 +2455,13 @@ static int link_entry_into_array(JournalFile *f,
                 if (i < n) {
                         o->entry_array.items[i] = htole64(p);
                         *idx = htole64(hidx + 1);
+
+                        chain_cache_put(f->chain_cache, ci, le64toh(*first), a, le64toh(o->entry_array.items[0]), t, i);
                         return 0;
                 }
 
                 i -= n;
+                t += n;
                 ap = a;
                 a = le64toh(o->entry_array.next_entry_array_offset);
         }
@@ -1677,12 +2480,6 @@ static int link_entry_into_array(JournalFile *f,
         if (r < 0)
                 return r;
 
-#if HAVE_GCRYPT
-        r = journal_file_hmac_put_object(f, OBJECT_ENTRY_ARRAY, o, q);
-        if (r < 0)
-                return r;
-#endif
-
         o->entry_array.items[i] = htole64(p);
 
         if (ap == 0)
@@ -1825,12 +2622,6 @@ static int journal_file_append_entry_internal(
         o->entry.xor_hash = htole64(xor_hash);
         o->entry.boot_id = f->header->boot_id;
 
-#if HAVE_GCRYPT
-        r = journal_file_hmac_put_object(f, OBJECT_ENTRY, o, np);
-        if (r < 0)
-                return r;
-#endif
-
         r = journal_file_link_entry(f, o, np);
         if (r < 0)
                 return r;
@@ -1944,21 +2735,92 @@ static int entry_item_cmp(const void *_a, const void *_b) {
         return 0;
 }
 
-int journal_file_append_entry(JournalFile *f, const dual_timestamp *ts, const struct iovec iovec[], unsigned n_iovec, uint64_t *seqnum, Object **ret, uint64_t *offset) {
+/* A small direct-mapped cache of data objects looked up during one batch of appends: consecutive entries
+ * usually share most of their fields (_HOSTNAME=, _BOOT_ID=, _SYSTEMD_UNIT=, …), hence we can skip the walk
+ * of the hash table chain for them. */
+#define DATA_CACHE_SIZE 64U
+
+typedef struct DataCacheItem {
+        uint64_t hash;
+        uint64_t size;
+        uint64_t offset;
+} DataCacheItem;
+
+static int journal_file_append_data_cached(
+                JournalFile *f,
+                DataCacheItem *cache,
+                const void *data, uint64_t size,
+                const CompressedField *c,
+                Object **ret, uint64_t *offset) {
+
+        DataCacheItem *ci;
+        uint64_t hash;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(data || size == 0);
+        assert(ret);
+        assert(offset);
+
+        if (!cache)
+                return journal_file_append_data(f, data, size, c, ret, offset);
+
+        hash = c && c->hashed ? c->hash : hash64(data, size);
+        ci = cache + (hash % DATA_CACHE_SIZE);
+
+        if (ci->offset > 0 && ci->hash == hash && ci->size == size) {
+                r = journal_file_move_to_object(f, OBJECT_DATA, ci->offset, &o);
+                if (r < 0)
+                        return r;
+
+                /* Only trust objects we can compare without decompressing them, everything else takes the
+                 * slow path below */
+                if (le64toh(o->data.hash) == hash &&
+                    (o->object.flags & OBJECT_COMPRESSION_MASK) == 0 &&
+                    le64toh(o->object.size) - offsetof(Object, data.payload) == size &&
+                    memcmp(o->data.payload, data, size) == 0) {
+                        *ret = o;
+                        *offset = ci->offset;
+                        return 0;
+                }
+        }
+
+        r = journal_file_append_data(f, data, size, c, &o, offset);
+        if (r < 0)
+                return r;
+
+        *ci = (DataCacheItem) {
+                .hash = hash,
+                .size = size,
+                .offset = *offset,
+        };
+
+        *ret = o;
+        return 0;
+}
+
+static int journal_file_append_entry_items(
+                JournalFile *f,
+                DataCacheItem *cache,
+                const dual_timestamp *ts,
+                const struct iovec iovec[],
+                unsigned n_iovec,
+                const CompressedField compressed[],
+                unsigned n_compressed,
+                uint64_t *seqnum,
+                Object **ret, uint64_t *offset) {
+
         unsigned i;
         EntryItem *items;
         int r;
         uint64_t xor_hash = 0;
-        struct dual_timestamp _ts;
 
         assert(f);
-        assert(f->header);
+        assert(ts);
         assert(iovec || n_iovec == 0);
-
-        if (!ts) {
-                dual_timestamp_get(&_ts);
-                ts = &_ts;
-        }
+        assert(compressed || n_compressed == 0);
+        assert(n_compressed <= n_iovec);
 
 #if HAVE_GCRYPT
         r = journal_file_maybe_append_tag(f, ts->realtime);
@@ -1973,7 +2835,9 @@ int journal_file_append_entry(JournalFile *f, const dual_timestamp *ts, const st
                 uint64_t p;
                 Object *o;
 
-                r = journal_file_append_data(f, iovec[i].iov_base, iovec[i].iov_len, &o, &p);
+                r = journal_file_append_data_cached(f, cache, iovec[i].iov_base, iovec[i].iov_len,
+                                                    i >= n_iovec - n_compressed ? compressed + i - (n_iovec - n_compressed) : NULL,
+                                                    &o, &p);
                 if (r < 0)
                         return r;
 
@@ -1986,7 +2850,12 @@ int journal_file_append_entry(JournalFile *f, const dual_timestamp *ts, const st
          * times for rotating media. */
         qsort_safe(items, n_iovec, sizeof(EntryItem), entry_item_cmp);
 
-        r = journal_file_append_entry_internal(f, ts, xor_hash, items, n_iovec, seqnum, ret, offset);
+        return journal_file_append_entry_internal(f, ts, xor_hash, items, n_iovec, seqnum, ret, offset);
+}
+
+static void journal_file_append_finish(JournalFile *f, int *r) {
+        assert(f);
+        assert(r);
 
         /* If the memory mapping triggered a SIGBUS then we return an
          * IO error and ignore the error code passed down to us, since
@@ -1994,61 +2863,132 @@ int journal_file_append_entry(JournalFile *f, const dual_timestamp *ts, const st
          * mapping page */
 
         if (mmap_cache_got_sigbus(f->mmap, f->cache_fd))
-                r = -EIO;
+                *r = -EIO;
 
         if (f->post_change_timer)
                 schedule_post_change(f);
         else
                 journal_file_post_change(f);
+}
+
+int journal_file_append_entry_compressed(
+                JournalFile *f,
+                const dual_timestamp *ts,
+                const struct iovec iovec[],
+                unsigned n_iovec,
+                const CompressedField compressed[],
+                unsigned n_compressed,
+                uint64_t *seqnum,
+                Object **ret, uint64_t *offset) {
+
+        struct dual_timestamp _ts;
+        int r;
+
+        assert(f);
+        assert(f->header);
+        assert(iovec || n_iovec == 0);
+
+        /* compressed carries one element for each of the last n_compressed elements of iovec, with fields that
+         * were already hashed and compressed elsewhere (i.e. in a worker thread). Elements without data, or
+         * compressed with a codec other than the one of this file are compressed here as usual. Elements may
+         * also just carry the hash of a field that is appended over and over again. */
+
+        if (!ts) {
+                dual_timestamp_get(&_ts);
+                ts = &_ts;
+        }
+
+        r = journal_file_append_entry_items(f, NULL, ts, iovec, n_iovec, compressed, n_compressed, seqnum, ret, offset);
+        journal_file_append_finish(f, &r);
 
         return r;
 }
 
-typedef struct ChainCacheItem {
-        uint64_t first; /* the array at the beginning of the chain */
-        uint64_t array; /* the cached array */
-        uint64_t begin; /* the first item in the cached array */
-        uint64_t total; /* the total number of items in all arrays before this one in the chain */
-        uint64_t last_index; /* the last index we looked at, to optimize locality when bisecting */
-} ChainCacheItem;
+int journal_file_append_entry(JournalFile *f, const dual_timestamp *ts, const struct iovec iovec[], unsigned n_iovec, uint64_t *seqnum, Object **ret, uint64_t *offset) {
+        return journal_file_append_entry_compressed(f, ts, iovec, n_iovec, NULL, 0, seqnum, ret, offset);
+}
 
-static void chain_cache_put(
-                OrderedHashmap *h,
-                ChainCacheItem *ci,
-                uint64_t first,
-                uint64_t array,
-                uint64_t begin,
-                uint64_t total,
-                uint64_t last_index) {
+int compressed_field_compress(CompressedField *c, int compression, const void *data, size_t size) {
+        _cleanup_free_ void *buf = NULL;
+        size_t rsize = 0;
+        int r;
 
-        if (!ci) {
-                /* If the chain item to cache for this chain is the
-                 * first one it's not worth caching anything */
-                if (array == first)
-                        return;
+        assert(c);
+        assert(data || size == 0);
 
-                if (ordered_hashmap_size(h) >= CHAIN_CACHE_MAX) {
-                        ci = ordered_hashmap_steal_first(h);
-                        assert(ci);
-                } else {
-                        ci = new(ChainCacheItem, 1);
-                        if (!ci)
-                                return;
-                }
+        /* Hashes and compresses a field for later use by journal_file_append_entry_compressed(). This touches
+         * no JournalFile and no global state, hence it is safe to call from any thread. */
 
-                ci->first = first;
+        *c = (CompressedField) {
+                .hash = hash64(data, size),
+                .hashed = true,
+        };
 
-                if (ordered_hashmap_put(h, &ci->first, ci) < 0) {
-                        free(ci);
-                        return;
+        if (compression <= 0 || size <= 1)
+                return 0;
+
+        buf = malloc(size - 1);
+        if (!buf)
+                return -ENOMEM;
+
+        r = compress_blob_explicit(compression, data, size, buf, size - 1, &rsize);
+        if (r < 0)
+                /* Incompressible, the field is stored as is */
+                return 0;
+
+        c->compression = r;
+        c->data = TAKE_PTR(buf);
+        c->size = rsize;
+
+        return 1;
+}
+
+void compressed_field_done(CompressedField *c) {
+        assert(c);
+
+        c->data = mfree(c->data);
+        c->size = 0;
+}
+
+int journal_file_append_entries(
+                JournalFile *f,
+                const JournalFileEntry entries[], size_t n_entries,
+                uint64_t *seqnum,
+                size_t *ret_n_appended) {
+
+        DataCacheItem cache[DATA_CACHE_SIZE] = {};
+        struct dual_timestamp _ts;
+        size_t i;
+        int r = 0;
+
+        assert(f);
+        assert(f->header);
+        assert(entries || n_entries == 0);
+
+        /* Appends a number of entries in one go. Data objects shared between the entries are looked up only
+         * once, and the SIGBUS check and the change notification happen once for the whole batch rather than
+         * once per entry. On failure the entries before the failing one remain appended, and their number is
+         * returned in ret_n_appended. */
+
+        for (i = 0; i < n_entries; i++) {
+                const dual_timestamp *ts = entries[i].ts;
+
+                if (!ts) {
+                        dual_timestamp_get(&_ts);
+                        ts = &_ts;
                 }
-        } else
-                assert(ci->first == first);
 
-        ci->array = array;
-        ci->begin = begin;
-        ci->total = total;
-        ci->last_index = last_index;
+                r = journal_file_append_entry_items(f, cache, ts, entries[i].iovec, entries[i].n_iovec, NULL, 0, seqnum, NULL, NULL);
+                if (r < 0)
+                        break;
+        }
+
+        journal_file_append_finish(f, &r);
+
+        if (ret_n_appended)
+                *ret_n_appended = r < 0 ? i : n_entries;
+
+        return r;
 }
 
 static int generic_array_get(
@@ -2102,13 +3042,87 @@ found:
         if (r < 0)
                 return r;
 
-        if (ret)
-                *ret = o;
+        if (ret)
+                *ret = o;
+
+        if (offset)
+                *offset = p;
+
+        return 1;
+}
+
+static void generic_array_prefetch(JournalFile *f, uint64_t first, uint64_t i, direction_t direction) {
+        uint64_t a, k, j, from, to, lo = UINT64_MAX, hi = 0;
+        ChainCacheItem *ci;
+        Object *o;
+
+        assert(f);
+
+        /* Asks the kernel to read the entries following item i of an entry array chain, so that iterating
+         * through cold files doesn't stall on a synchronous page fault for each of them. We only do this
+         * every PREFETCH_ENTRIES items, and cover those in one go. The item itself was just looked up by
+         * generic_array_get(), hence the chain cache usually points us right to its array. Entries are
+         * written next to the data objects they introduced, hence their range covers most of those too. */
+
+        if (f->fd < 0 || i % PREFETCH_ENTRIES != 0)
+                return;
+
+        a = first;
+
+        ci = ordered_hashmap_get(f->chain_cache, &first);
+        if (ci && i >= ci->total) {
+                a = ci->array;
+                i -= ci->total;
+        }
+
+        for (;;) {
+                if (a == 0)
+                        return;
+
+                if (journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY, a, &o) < 0)
+                        return;
+
+                k = journal_file_entry_array_n_items(o);
+                if (i < k)
+                        break;
+
+                i -= k;
+                a = le64toh(o->entry_array.next_entry_array_offset);
+        }
+
+        if (direction == DIRECTION_DOWN) {
+                from = i + 1;
+                to = MIN(i + PREFETCH_ENTRIES, k - 1);
+
+                /* Crossing into the next array soon? Then read its beginning too. */
+                if (i + PREFETCH_ENTRIES >= k && o->entry_array.next_entry_array_offset != 0)
+                        (void) posix_fadvise(f->fd,
+                                             le64toh(o->entry_array.next_entry_array_offset),
+                                             offsetof(Object, entry_array.items) + PREFETCH_ENTRIES * sizeof(le64_t),
+                                             POSIX_FADV_WILLNEED);
+        } else {
+                if (i == 0)
+                        return;
+
+                from = i > PREFETCH_ENTRIES ? i - PREFETCH_ENTRIES : 0;
+                to = i - 1;
+        }
+
+        for (j = from; j <= to && j < k; j++) {
+                uint64_t p = le64toh(o->entry_array.items[j]);
+
+                /* The tail of the last array is unused */
+                if (p == 0)
+                        break;
 
-        if (offset)
-                *offset = p;
+                lo = MIN(lo, p);
+                hi = MAX(hi, p);
+        }
 
-        return 1;
+        if (lo > hi)
+                return;
+
+        (void) posix_fadvise(f->fd, lo, hi - lo + page_size(), POSIX_FADV_WILLNEED);
 }
 
 static int generic_array_get_plus_one(
@@ -2505,15 +3519,228 @@ static int test_object_realtime(JournalFile *f, uint64_t p, uint64_t needle) {
                 return TEST_RIGHT;
 }
 
+static int journal_file_append_realtime_index(JournalFile *f) {
+        _cleanup_free_ le64_t *items = NULL;
+        uint64_t a, i = 0, n, m, j = 0;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+
+        /* Notes the realtime timestamp of every REALTIME_INDEX_STRIDE-th entry in one compact object, so
+         * that seeking by time in an archived file needs to look at few scattered entries only. Like the
+         * bloom filter, only call this right before archiving the file. */
+
+        if (!f->writable ||
+            !JOURNAL_HEADER_CONTAINS(f->header, realtime_index_offset) ||
+            JOURNAL_HEADER_REALTIME_INDEX(f->header))
+                return 0;
+
+        n = le64toh(f->header->n_entries);
+        if (n <= REALTIME_INDEX_STRIDE)
+                return 0;
+
+        m = DIV_ROUND_UP(n, REALTIME_INDEX_STRIDE);
+        items = new(le64_t, m);
+        if (!items)
+                return -ENOMEM;
+
+        a = le64toh(f->header->entry_array_offset);
+        while (a > 0 && i < n) {
+                uint64_t k, l;
+
+                r = journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY, a, &o);
+                if (r < 0)
+                        return r;
+
+                k = journal_file_entry_array_n_items(o);
+
+                /* The first entry of this array we want in the index */
+                l = (REALTIME_INDEX_STRIDE - i % REALTIME_INDEX_STRIDE) % REALTIME_INDEX_STRIDE;
+                for (; l < k && i + l < n; l += REALTIME_INDEX_STRIDE) {
+                        Object *e;
+
+                        r = journal_file_move_to_object(f, OBJECT_ENTRY, le64toh(o->entry_array.items[l]), &e);
+                        if (r < 0)
+                                return r;
+
+                        assert(j < m);
+                        items[j++] = e->entry.realtime;
+                }
+
+                i += k;
+                a = le64toh(o->entry_array.next_entry_array_offset);
+        }
+
+        if (j != m)
+                return -EBADMSG;
+
+        r = journal_file_append_object(f, OBJECT_REALTIME_INDEX, offsetof(Object, realtime_index.items) + m * sizeof(le64_t), &o, &a);
+        if (r < 0)
+                return r;
+
+        o->realtime_index.n_entries = htole64(n);
+        o->realtime_index.stride = htole64(REALTIME_INDEX_STRIDE);
+        memcpy(o->realtime_index.items, items, m * sizeof(le64_t));
+
+        f->header->realtime_index_offset = htole64(a);
+        f->header->compatible_flags |= htole32(HEADER_COMPATIBLE_REALTIME_INDEX);
+
+        log_debug("Wrote realtime index with %"PRIu64" items for %s.", m, f->path);
+
+        return 0;
+}
+
+static int entry_realtime_by_index(JournalFile *f, uint64_t i, uint64_t *ret) {
+        Object *o;
+        int r;
+
+        r = generic_array_get(f, le64toh(f->header->entry_array_offset), i, &o, NULL);
+        if (r < 0)
+                return r;
+        if (r == 0)
+                return -EBADMSG;
+
+        *ret = le64toh(o->entry.realtime);
+        return 0;
+}
+
+static int journal_file_bisect_realtime_index(
+                JournalFile *f,
+                uint64_t realtime,
+                direction_t direction,
+                Object **ret,
+                uint64_t *offset) {
+
+        uint64_t p, n, m, stride, left, right, left_index, right_index, rt;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+
+        /* Returns -ENOENT if there is no (usable) realtime index, in which case the caller should fall back
+         * to bisecting the entry array chain. Otherwise we bisect the index first, which is a single
+         * object, and then the at most REALTIME_INDEX_STRIDE entries between the two items we end up
+         * with. */
+
+        if (f->header->state != STATE_ARCHIVED ||
+            !JOURNAL_HEADER_REALTIME_INDEX(f->header) ||
+            !JOURNAL_HEADER_CONTAINS(f->header, realtime_index_offset))
+                return -ENOENT;
+
+        p = le64toh(f->header->realtime_index_offset);
+        if (p == 0)
+                return -ENOENT;
+
+        r = journal_file_move_to_object(f, OBJECT_REALTIME_INDEX, p, &o);
+        if (r < 0)
+                return r;
+
+        n = le64toh(o->realtime_index.n_entries);
+        if (n != le64toh(f->header->n_entries))
+                return -ENOENT;
+
+        stride = le64toh(o->realtime_index.stride);
+        m = (le64toh(o->object.size) - offsetof(Object, realtime_index.items)) / sizeof(le64_t);
+
+        if (direction == DIRECTION_DOWN) {
+                /* Look for the first item not older than what we are looking for. The first entry with that
+                 * property is then between it and the item before. */
+                left = 0;
+                right = m;
+                while (left < right) {
+                        uint64_t mid = (left + right) / 2;
+
+                        if (le64toh(o->realtime_index.items[mid]) >= realtime)
+                                right = mid;
+                        else
+                                left = mid + 1;
+                }
+
+                if (left == 0)
+                        left_index = right_index = 0;
+                else {
+                        left_index = (left - 1) * stride + 1;
+                        right_index = MIN(left * stride, n - 1);
+
+                        /* Everything is older */
+                        if (left_index > right_index)
+                                return 0;
+                }
+
+                /* Now bisect the entries in between */
+                while (left_index < right_index) {
+                        uint64_t mid = (left_index + right_index) / 2;
+
+                        r = entry_realtime_by_index(f, mid, &rt);
+                        if (r < 0)
+                                return r;
+
+                        if (rt >= realtime)
+                                right_index = mid;
+                        else
+                                left_index = mid + 1;
+                }
+
+                r = entry_realtime_by_index(f, left_index, &rt);
+                if (r < 0)
+                        return r;
+                if (rt < realtime)
+                        return 0;
+        } else {
+                /* Look for the last item not newer than what we are looking for */
+                left = 0;
+                right = m;
+                while (left < right) {
+                        uint64_t mid = (left + right) / 2;
+
+                        if (le64toh(o->realtime_index.items[mid]) > realtime)
+                                right = mid;
+                        else
+                                left = mid + 1;
+                }
+
+                if (left == 0)
+                        return 0;
+
+                left_index = (left - 1) * stride;
+                right_index = MIN(left * stride - 1, n - 1);
+
+                while (left_index < right_index) {
+                        uint64_t mid = (left_index + right_index + 1) / 2;
+
+                        r = entry_realtime_by_index(f, mid, &rt);
+                        if (r < 0)
+                                return r;
+
+                        if (rt <= realtime)
+                                left_index = mid;
+                        else
+                                right_index = mid - 1;
+                }
+        }
+
+        return generic_array_get(f, le64toh(f->header->entry_array_offset), left_index, ret, offset);
+}
+
 int journal_file_move_to_entry_by_realtime(
                 JournalFile *f,
                 uint64_t realtime,
                 direction_t direction,
                 Object **ret,
                 uint64_t *offset) {
+
+        int r;
+
         assert(f);
         assert(f->header);
 
+        r = journal_file_bisect_realtime_index(f, realtime, direction, ret, offset);
+        if (r != -ENOENT)
+                return r;
+
         return generic_array_bisect(f,
                                     le64toh(f->header->entry_array_offset),
                                     le64toh(f->header->n_entries),
@@ -2743,6 +3970,8 @@ int journal_file_next_entry(
                         return r;
         }
 
+        generic_array_prefetch(f, le64toh(f->header->entry_array_offset), i, direction);
+
         /* Ensure our array is properly ordered. */
         if (p > 0 && !check_properly_ordered(ofs, p, direction)) {
                 log_debug("%s: entry array not properly ordered at entry %" PRIu64, f->path, i);
@@ -2819,6 +4048,9 @@ int journal_file_next_entry_for_data(
                         return r;
         }
 
+        if (i > 0)
+                generic_array_prefetch(f, le64toh(d->data.entry_array_offset), i - 1, direction);
+
         /* Ensure our array is properly ordered. */
         if (p > 0 && check_properly_ordered(ofs, p, direction)) {
                 log_debug("%s data entry array not properly ordered at entry %" PRIu64, f->path, i);
@@ -2831,6 +4063,110 @@ int journal_file_next_entry_for_data(
         return 1;
 }
 
+int journal_file_get_boots(JournalFile *f, const JournalBoot **ret, size_t *ret_n) {
+        _cleanup_free_ JournalBoot *boots = NULL;
+        size_t n_boots = 0, n_allocated = 0;
+        uint64_t n_entries, n_covered = 0, p;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+        assert(ret);
+        assert(ret_n);
+
+        /* Determines the boots the entries of this file belong to, by following the data objects of the
+         * _BOOT_ID= field, and looking only at the first and last entry of each. The result is cached until
+         * the file grows. Returns -EOPNOTSUPP if the entries aren't all covered by exactly one _BOOT_ID= data
+         * object matching the entry headers, in which case the caller has to iterate through the entries
+         * instead. */
+
+        n_entries = le64toh(f->header->n_entries);
+        if (f->boots_valid && f->boots_n_entries == n_entries)
+                goto finish;
+
+        r = journal_file_find_field_object(f, "_BOOT_ID", STRLEN("_BOOT_ID"), &o, NULL);
+        if (r < 0)
+                return r;
+
+        p = r > 0 ? le64toh(o->field.head_data_offset) : 0;
+        while (p > 0) {
+                JournalBoot *b;
+                uint64_t next, n;
+
+                r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+                if (r < 0)
+                        return r;
+
+                next = le64toh(o->data.next_field_offset);
+                n = le64toh(o->data.n_entries);
+
+                if (n > 0) {
+                        char t[32 + 1];
+
+                        /* The value is what _BOOT_ID= matches select on, hence go by it rather than the
+                         * boot id in the entry headers, but insist that both agree. */
+                        if ((o->object.flags & OBJECT_COMPRESSION_MASK) ||
+                            le64toh(o->object.size) != offsetof(Object, data.payload) + STRLEN("_BOOT_ID=") + 32)
+                                return -EOPNOTSUPP;
+
+                        if (!GREEDY_REALLOC(boots, n_allocated, n_boots + 1))
+                                return -ENOMEM;
+
+                        b = boots + n_boots;
+
+                        memcpy(t, o->data.payload + STRLEN("_BOOT_ID="), 32);
+                        t[32] = 0;
+                        if (sd_id128_from_string(t, &b->boot_id) < 0)
+                                return -EOPNOTSUPP;
+
+                        r = journal_file_next_entry_for_data(f, NULL, 0, p, DIRECTION_DOWN, &o, NULL);
+                        if (r < 0)
+                                return r;
+                        if (r == 0)
+                                return -EBADMSG;
+
+                        if (!sd_id128_equal(b->boot_id, o->entry.boot_id))
+                                return -EOPNOTSUPP;
+
+                        b->seqnum_id = f->header->seqnum_id;
+                        b->first_seqnum = le64toh(o->entry.seqnum);
+                        b->first_realtime = le64toh(o->entry.realtime);
+                        b->first_monotonic = le64toh(o->entry.monotonic);
+
+                        r = journal_file_next_entry_for_data(f, NULL, 0, p, DIRECTION_UP, &o, NULL);
+                        if (r < 0)
+                                return r;
+                        if (r == 0)
+                                return -EBADMSG;
+
+                        if (!sd_id128_equal(b->boot_id, o->entry.boot_id))
+                                return -EOPNOTSUPP;
+
+                        b->last_realtime = le64toh(o->entry.realtime);
+                        b->last_monotonic = le64toh(o->entry.monotonic);
+
+                        n_boots++;
+                        n_covered += n;
+                }
+
+                p = next;
+        }
+
+        if (n_covered != n_entries)
+                return -EOPNOTSUPP;
+
+        free_and_replace(f->boots, boots);
+        f->n_boots = n_boots;
+        f->boots_n_entries = n_entries;
+        f->boots_valid = true;
+
+finish:
+        *ret = f->boots;
+        *ret_n = f->n_boots;
+        return 0;
+}
+
 int journal_file_move_to_entry_by_offset_for_data(
                 JournalFile *f,
                 uint64_t data_offset,
@@ -3047,6 +4383,28 @@ void journal_file_dump(JournalFile *f) {
                                le64toh(o->tag.epoch));
                         break;
 
+                case OBJECT_DICTIONARY:
+                        printf("Type: OBJECT_DICTIONARY\n");
+                        break;
+
+                case OBJECT_BLOOM_FILTER:
+                        printf("Type: OBJECT_BLOOM_FILTER n_items=%"PRIu64" n_functions=%u\n",
+                               le64toh(o->bloom_filter.n_items),
+                               o->bloom_filter.n_functions);
+                        break;
+
+                case OBJECT_REALTIME_INDEX:
+                        printf("Type: OBJECT_REALTIME_INDEX n_entries=%"PRIu64" stride=%"PRIu64"\n",
+                               le64toh(o->realtime_index.n_entries),
+                               le64toh(o->realtime_index.stride));
+                        break;
+
+                case OBJECT_DATA_HASH_TABLE_SEGMENT:
+                        printf("Type: OBJECT_DATA_HASH_TABLE_SEGMENT n_data=%"PRIu64" previous=%"PRIu64"\n",
+                               le64toh(o->data_hash_table_segment.n_data),
+                               le64toh(o->data_hash_table_segment.previous_offset));
+                        break;
+
                 default:
                         printf("Type: unknown (%i)\n", o->object.type);
                         break;
@@ -3081,6 +4439,7 @@ void journal_file_print_header(JournalFile *f) {
         char x[FORMAT_TIMESTAMP_MAX], y[FORMAT_TIMESTAMP_MAX], z[FORMAT_TIMESTAMP_MAX];
         struct stat st;
         char bytes[FORMAT_BYTES_MAX];
+        uint64_t n_items, n_objects, n_chains, max_depth;
 
         assert(f);
         assert(f->header);
@@ -3091,8 +4450,8 @@ void journal_file_print_header(JournalFile *f) {
                "Boot ID: %s\n"
                "Sequential Number ID: %s\n"
                "State: %s\n"
-               "Compatible Flags:%s%s\n"
-               "Incompatible Flags:%s%s%s\n"
+               "Compatible Flags:%s%s%s%s\n"
+               "Incompatible Flags:%s%s%s%s%s%s\n"
                "Header size: %"PRIu64"\n"
                "Arena size: %"PRIu64"\n"
                "Data Hash Table Size: %"PRIu64"\n"
@@ -3114,9 +4473,14 @@ void journal_file_print_header(JournalFile *f) {
                f->header->state == STATE_ONLINE ? "ONLINE" :
                f->header->state == STATE_ARCHIVED ? "ARCHIVED" : "UNKNOWN",
                JOURNAL_HEADER_SEALED(f->header) ? " SEALED" : "",
+               JOURNAL_HEADER_BLOOM_FILTER(f->header) ? " BLOOM-FILTER" : "",
+               JOURNAL_HEADER_REALTIME_INDEX(f->header) ? " REALTIME-INDEX" : "",
                (le32toh(f->header->compatible_flags) & ~HEADER_COMPATIBLE_ANY) ? " ???" : "",
                JOURNAL_HEADER_COMPRESSED_XZ(f->header) ? " COMPRESSED-XZ" : "",
                JOURNAL_HEADER_COMPRESSED_LZ4(f->header) ? " COMPRESSED-LZ4" : "",
+               JOURNAL_HEADER_COMPRESSED_ZSTD(f->header) ? " COMPRESSED-ZSTD" : "",
+               JOURNAL_HEADER_ZSTD_DICTIONARY(f->header) ? " ZSTD-DICTIONARY" : "",
+               JOURNAL_HEADER_EXTENSIBLE_HASH_TABLE(f->header) ? " EXTENSIBLE-HASH-TABLE" : "",
                (le32toh(f->header->incompatible_flags) & ~HEADER_INCOMPATIBLE_ANY) ? " ???" : "",
                le64toh(f->header->header_size),
                le64toh(f->header->arena_size),
@@ -3131,11 +4495,30 @@ void journal_file_print_header(JournalFile *f) {
                le64toh(f->header->n_objects),
                le64toh(f->header->n_entries));
 
+        /* Count in the segments the data hash table was extended by, if we can get at them */
+        if (journal_file_map_data_hash_table(f) >= 0) {
+                n_items = journal_file_data_hash_table_n_items(f);
+
+                if (JOURNAL_HEADER_EXTENSIBLE_HASH_TABLE(f->header))
+                        printf("Data Hash Table Segments: %zu\n"
+                               "Data Hash Table Total Size: %"PRIu64"\n",
+                               f->n_data_hash_tables - 1,
+                               n_items);
+        } else
+                n_items = le64toh(f->header->data_hash_table_size) / sizeof(HashItem);
+
         if (JOURNAL_HEADER_CONTAINS(f->header, n_data))
                 printf("Data Objects: %"PRIu64"\n"
                        "Data Hash Table Fill: %.1f%%\n",
                        le64toh(f->header->n_data),
-                       100.0 * (double) le64toh(f->header->n_data) / ((double) (le64toh(f->header->data_hash_table_size) / sizeof(HashItem))));
+                       100.0 * (double) le64toh(f->header->n_data) / ((double) n_items));
+
+        if (journal_file_data_hash_table_stats(f, &n_objects, &n_chains, &max_depth) >= 0 && n_chains > 0)
+                printf("Data Hash Chains: %"PRIu64"\n"
+                       "Data Hash Chain Length: %.2f average, %"PRIu64" maximum\n",
+                       n_chains,
+                       (double) n_objects / (double) n_chains,
+                       max_depth);
 
         if (JOURNAL_HEADER_CONTAINS(f->header, n_fields))
                 printf("Field Objects: %"PRIu64"\n"
@@ -3228,7 +4611,9 @@ int journal_file_open(
         f->flags = flags;
         f->prot = prot_from_flags(flags);
         f->writable = (flags & O_ACCMODE) != O_RDONLY;
-#if HAVE_LZ4
+#if HAVE_ZSTD
+        f->compress_zstd = compress;
+#elif HAVE_LZ4
         f->compress_lz4 = compress;
 #elif HAVE_XZ
         f->compress_xz = compress;
@@ -3394,6 +4779,14 @@ int journal_file_open(
                 if (r < 0)
                         goto fail;
 
+#if HAVE_ZSTD
+                if (template && f->compress_zstd) {
+                        r = journal_file_setup_dictionary(f, template);
+                        if (r < 0)
+                                log_debug_errno(r, "Failed to set up compression dictionary for %s, ignoring: %m", f->path);
+                }
+#endif
+
 #if HAVE_GCRYPT
                 r = journal_file_append_first_tag(f);
                 if (r < 0)
@@ -3431,9 +4824,33 @@ fail:
         return r;
 }
 
+int journal_file_archived_path(JournalFile *f, char **ret) {
+        size_t l;
+
+        assert(f);
+        assert(ret);
+
+        /* Is this a journal file that was passed to us as fd? If so, we synthesized a path name for it, and we refuse
+         * rotation, since we don't know the actual path, and couldn't rename the file hence. */
+        if (path_startswith(f->path, "/proc/self/fd"))
+                return -EINVAL;
+
+        if (!endswith(f->path, ".journal"))
+                return -EINVAL;
+
+        l = strlen(f->path);
+        if (asprintf(ret, "%.*s@" SD_ID128_FORMAT_STR "-%016"PRIx64"-%016"PRIx64".journal",
+                     (int) l - 8, f->path,
+                     SD_ID128_FORMAT_VAL(f->header->seqnum_id),
+                     le64toh(f->header->head_entry_seqnum),
+                     le64toh(f->header->head_entry_realtime)) < 0)
+                return -ENOMEM;
+
+        return 0;
+}
+
 int journal_file_rotate(JournalFile **f, bool compress, uint64_t compress_threshold_bytes, bool seal, Set *deferred_closes) {
         _cleanup_free_ char *p = NULL;
-        size_t l;
         JournalFile *old_file, *new_file = NULL;
         int r;
 
@@ -3445,22 +4862,9 @@ int journal_file_rotate(JournalFile **f, bool compress, uint64_t compress_thresh
         if (!old_file->writable)
                 return -EINVAL;
 
-        /* Is this a journal file that was passed to us as fd? If so, we synthesized a path name for it, and we refuse
-         * rotation, since we don't know the actual path, and couldn't rename the file hence. */
-        if (path_startswith(old_file->path, "/proc/self/fd"))
-                return -EINVAL;
-
-        if (!endswith(old_file->path, ".journal"))
-                return -EINVAL;
-
-        l = strlen(old_file->path);
-        r = asprintf(&p, "%.*s@" SD_ID128_FORMAT_STR "-%016"PRIx64"-%016"PRIx64".journal",
-                     (int) l - 8, old_file->path,
-                     SD_ID128_FORMAT_VAL(old_file->header->seqnum_id),
-                     le64toh((*f)->header->head_entry_seqnum),
-                     le64toh((*f)->header->head_entry_realtime));
+        r = journal_file_archived_path(old_file, &p);
         if (r < 0)
-                return -ENOMEM;
+                return r;
 
         /* Try to rename the file to the archived version. If the file
          * already was deleted, we'll get ENOENT, let's ignore that
@@ -3472,6 +4876,15 @@ int journal_file_rotate(JournalFile **f, bool compress, uint64_t compress_thresh
         /* Sync the rename to disk */
         (void) fsync_directory_of_file(old_file->fd);
 
+        /* Nothing is appended to the file anymore from now on, hence summarize its contents for readers */
+        r = journal_file_append_bloom_filter(old_file);
+        if (r < 0)
+                log_debug_errno(r, "Failed to write bloom filter for %s, ignoring: %m", old_file->path);
+
+        r = journal_file_append_realtime_index(old_file);
+        if (r < 0)
+                log_debug_errno(r, "Failed to write realtime index for %s, ignoring: %m", old_file->path);
+
         /* Set as archive so offlining commits w/state=STATE_ARCHIVED.
          * Previously we would set old_file->header->state to STATE_ARCHIVED directly here,
          * but journal_file_set_offline() short-circuits when state != STATE_ONLINE, which
@@ -3563,7 +4976,14 @@ int journal_file_open_reliably(
                                  deferred_closes, template, ret);
 }
 
-int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint64_t p, uint64_t *seqnum, Object **ret, uint64_t *offset) {
+static int journal_file_copy_entry_internal(
+                JournalFile *from,
+                JournalFile *to,
+                DataCacheItem *cache,
+                Object *o, uint64_t p,
+                uint64_t *seqnum,
+                Object **ret, uint64_t *offset) {
+
         uint64_t i, n;
         uint64_t q, xor_hash = 0;
         int r;
@@ -3575,9 +4995,6 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
         assert(o);
         assert(p);
 
-        if (!to->writable)
-                return -EPERM;
-
         ts.monotonic = le64toh(o->entry.monotonic);
         ts.realtime = le64toh(o->entry.realtime);
 
@@ -3610,10 +5027,10 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
                         return -E2BIG;
 
                 if (o->object.flags & OBJECT_COMPRESSION_MASK) {
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
                         size_t rsize = 0;
 
-                        r = decompress_blob(o->object.flags & OBJECT_COMPRESSION_MASK,
+                        r = decompress_blob(o->object.flags & OBJECT_COMPRESSION_MASK, journal_file_compress_dict(from),
                                             o->data.payload, l, &from->compress_buffer, &from->compress_buffer_size, &rsize, 0);
                         if (r < 0)
                                 return r;
@@ -3626,7 +5043,7 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
                 } else
                         data = o->data.payload;
 
-                r = journal_file_append_data(to, data, l, &u, &h);
+                r = journal_file_append_data_cached(to, cache, data, l, NULL, &u, &h);
                 if (r < 0)
                         return r;
 
@@ -3639,7 +5056,18 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
                         return r;
         }
 
-        r = journal_file_append_entry_internal(to, &ts, xor_hash, items, n, seqnum, ret, offset);
+        return journal_file_append_entry_internal(to, &ts, xor_hash, items, n, seqnum, ret, offset);
+}
+
+int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint64_t p, uint64_t *seqnum, Object **ret, uint64_t *offset) {
+        int r;
+
+        assert(to);
+
+        if (!to->writable)
+                return -EPERM;
+
+        r = journal_file_copy_entry_internal(from, to, NULL, o, p, seqnum, ret, offset);
 
         if (mmap_cache_got_sigbus(to->mmap, to->cache_fd))
                 return -EIO;
@@ -3647,6 +5075,46 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
         return r;
 }
 
+int journal_file_copy_entries(
+                JournalFile *to,
+                const JournalFileCopyEntry entries[], size_t n_entries,
+                uint64_t *seqnum,
+                size_t *ret_n_copied) {
+
+        DataCacheItem cache[DATA_CACHE_SIZE] = {};
+        size_t i;
+        int r = 0;
+
+        assert(to);
+        assert(entries || n_entries == 0);
+
+        /* The batched counterpart of journal_file_copy_entry(), see journal_file_append_entries(). The entries
+         * are referenced by their offsets, as the mappings of earlier ones might be gone by the time we get to
+         * copy them. */
+
+        if (!to->writable)
+                return -EPERM;
+
+        for (i = 0; i < n_entries; i++) {
+                Object *o;
+
+                r = journal_file_move_to_object(entries[i].file, OBJECT_ENTRY, entries[i].offset, &o);
+                if (r < 0)
+                        break;
+
+                r = journal_file_copy_entry_internal(entries[i].file, to, cache, o, entries[i].offset, seqnum, NULL, NULL);
+                if (r < 0)
+                        break;
+        }
+
+        journal_file_append_finish(to, &r);
+
+        if (ret_n_copied)
+                *ret_n_copied = r < 0 ? i : n_entries;
+
+        return r;
+}
+
 void journal_reset_metrics(JournalMetrics *m) {
         assert(m);
 
@@ -3835,7 +5303,18 @@ bool journal_file_rotate_suggested(JournalFile *f, usec_t max_file_usec) {
          * the fill level we need the n_data field, which only exists
          * in newer versions. */
 
-        if (JOURNAL_HEADER_CONTAINS(f->header, n_data))
+        /* Files with an extensible data hash table only need rotation once they cannot grow the table
+         * anymore. */
+        if (JOURNAL_HEADER_EXTENSIBLE_HASH_TABLE(f->header) &&
+            JOURNAL_HEADER_CONTAINS(f->header, data_hash_table_segment_offset)) {
+                if (journal_file_map_data_hash_table(f) >= 0 &&
+                    f->n_data_hash_tables > DATA_HASH_TABLE_SEGMENTS_MAX &&
+                    journal_file_data_hash_table_full(f, f->data_hash_tables + f->n_data_hash_tables - 1)) {
+                        log_debug("Data hash table of %s has %zu segments and is filled up, suggesting rotation.",
+                                  f->path, f->n_data_hash_tables - 1);
+                        return true;
+                }
+        } else if (JOURNAL_HEADER_CONTAINS(f->header, n_data))
                 if (le64toh(f->header->n_data) * 4ULL > (le64toh(f->header->data_hash_table_size) / sizeof(HashItem)) * 3ULL) {
                         log_debug("Data hash table of %s has a fill level at %.1f (%"PRIu64" of %"PRIu64" items, %llu file size, %"PRIu64" bytes per hash table item), suggesting rotation.",
                                   f->path,
@@ -15,8 +15,10 @@
 
 #include "sd-id128.h"
 
+#include "compress.h"
 #include "hashmap.h"
 #include "journal-def.h"
+#include "list.h"
 #include "macro.h"
 #include "mmap-cache.h"
 #include "sd-event.h"
@@ -61,6 +63,25 @@ typedef enum OfflineState {
         OFFLINE_DONE
 } OfflineState;
 
+/* Where the entries of one boot start and end, see journal_file_get_boots() */
+typedef struct JournalBoot {
+        sd_id128_t boot_id;
+        sd_id128_t seqnum_id;
+        uint64_t first_seqnum;
+        uint64_t first_realtime;
+        uint64_t first_monotonic;
+        uint64_t last_realtime;
+        uint64_t last_monotonic;
+} JournalBoot;
+
+/* The data hash table of a file, or one of the segments it was extended by */
+typedef struct JournalHashTable {
+        HashItem *items;
+        uint64_t n_items;
+        DataHashTableSegmentObject *segment; /* NULL for the table the header points to */
+        uint64_t segment_offset;
+} JournalHashTable;
+
 typedef struct JournalFile {
         int fd;
         MMapFileDescriptor *cache_fd;
@@ -72,6 +93,7 @@ typedef struct JournalFile {
         bool writable:1;
         bool compress_xz:1;
         bool compress_lz4:1;
+        bool compress_zstd:1;
         bool seal:1;
         bool defrag_on_close:1;
         bool close_fd:1;
@@ -80,6 +102,7 @@ typedef struct JournalFile {
         direction_t last_direction;
         LocationType location_type;
         uint64_t last_n_entries;
+        unsigned prioq_idx;
 
         char *path;
         struct stat last_stat;
@@ -89,6 +112,11 @@ typedef struct JournalFile {
         HashItem *data_hash_table;
         HashItem *field_hash_table;
 
+        /* The data hash table is the first of these, followed by its segments, oldest first */
+        JournalHashTable *data_hash_tables;
+        size_t n_data_hash_tables;
+        size_t n_data_hash_tables_allocated;
+
         uint64_t current_offset;
         uint64_t current_seqnum;
         uint64_t current_realtime;
@@ -104,20 +132,31 @@ typedef struct JournalFile {
 
         OrderedHashmap *chain_cache;
 
-        pthread_t offline_thread;
+        /* Files waiting for a worker of the offline thread pool */
+        LIST_FIELDS(struct JournalFile, offline_queue);
         volatile OfflineState offline_state;
 
         unsigned last_seen_generation;
 
+        JournalBoot *boots;
+        size_t n_boots;
+        uint64_t boots_n_entries;
+        bool boots_valid;
+
         uint64_t compress_threshold_bytes;
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
         void *compress_buffer;
         size_t compress_buffer_size;
 #endif
+#if HAVE_ZSTD
+        CompressDict *compress_dict;
+        bool compress_dict_loaded:1;
+#endif
 
 #if HAVE_GCRYPT
         gcry_md_hd_t hmac;
         bool hmac_running;
+        uint64_t hmac_offset; /* first object not fed into the HMAC yet, 0 if there is none */
 
         FSSHeader *fss_file;
         size_t fss_file_size;
@@ -198,6 +237,21 @@ static inline bool VALID_EPOCH(uint64_t u) {
 #define JOURNAL_HEADER_COMPRESSED_LZ4(h) \
         (!!(le32toh((h)->incompatible_flags) & HEADER_INCOMPATIBLE_COMPRESSED_LZ4))
 
+#define JOURNAL_HEADER_COMPRESSED_ZSTD(h) \
+        (!!(le32toh((h)->incompatible_flags) & HEADER_INCOMPATIBLE_COMPRESSED_ZSTD))
+
+#define JOURNAL_HEADER_ZSTD_DICTIONARY(h) \
+        (!!(le32toh((h)->incompatible_flags) & HEADER_INCOMPATIBLE_ZSTD_DICTIONARY))
+
+#define JOURNAL_HEADER_EXTENSIBLE_HASH_TABLE(h) \
+        (!!(le32toh((h)->incompatible_flags) & HEADER_INCOMPATIBLE_EXTENSIBLE_HASH_TABLE))
+
+#define JOURNAL_HEADER_BLOOM_FILTER(h) \
+        (!!(le32toh((h)->compatible_flags) & HEADER_COMPATIBLE_BLOOM_FILTER))
+
+#define JOURNAL_HEADER_REALTIME_INDEX(h) \
+        (!!(le32toh((h)->compatible_flags) & HEADER_COMPATIBLE_REALTIME_INDEX))
+
 int journal_file_move_to_object(JournalFile *f, ObjectType type, uint64_t offset, Object **ret);
 
 uint64_t journal_file_entry_n_items(Object *o) _pure_;
@@ -207,6 +261,30 @@ uint64_t journal_file_hash_table_n_items(Object *o) _pure_;
 int journal_file_append_object(JournalFile *f, ObjectType type, uint64_t size, Object **ret, uint64_t *offset);
 int journal_file_append_entry(JournalFile *f, const dual_timestamp *ts, const struct iovec iovec[], unsigned n_iovec, uint64_t *seqno, Object **ret, uint64_t *offset);
 
+typedef struct JournalFileEntry {
+        const dual_timestamp *ts;
+        const struct iovec *iovec;
+        unsigned n_iovec;
+} JournalFileEntry;
+
+int journal_file_append_entries(JournalFile *f, const JournalFileEntry entries[], size_t n_entries, uint64_t *seqno, size_t *ret_n_appended);
+
+#define DEFAULT_COMPRESS_THRESHOLD (512ULL)
+#define MIN_COMPRESS_THRESHOLD (8ULL)
+
+typedef struct CompressedField {
+        uint64_t hash;
+        bool hashed;
+        int compression;
+        void *data;
+        size_t size;
+} CompressedField;
+
+int compressed_field_compress(CompressedField *c, int compression, const void *data, size_t size);
+void compressed_field_done(CompressedField *c);
+
+int journal_file_append_entry_compressed(JournalFile *f, const dual_timestamp *ts, const struct iovec iovec[], unsigned n_iovec, const CompressedField compressed[], unsigned n_compressed, uint64_t *seqno, Object **ret, uint64_t *offset);
+
 int journal_file_find_data_object(JournalFile *f, const void *data, uint64_t size, Object **ret, uint64_t *offset);
 int journal_file_find_data_object_with_hash(JournalFile *f, const void *data, uint64_t size, uint64_t hash, Object **ret, uint64_t *offset);
 
@@ -220,6 +298,8 @@ int journal_file_next_entry(JournalFile *f, uint64_t p, direction_t direction, O
 
 int journal_file_next_entry_for_data(JournalFile *f, Object *o, uint64_t p, uint64_t data_offset, direction_t direction, Object **ret, uint64_t *offset);
 
+int journal_file_get_boots(JournalFile *f, const JournalBoot **ret, size_t *ret_n);
+
 int journal_file_move_to_entry_by_seqnum(JournalFile *f, uint64_t seqnum, direction_t direction, Object **ret, uint64_t *offset);
 int journal_file_move_to_entry_by_realtime(JournalFile *f, uint64_t realtime, direction_t direction, Object **ret, uint64_t *offset);
 int journal_file_move_to_entry_by_monotonic(JournalFile *f, sd_id128_t boot_id, uint64_t monotonic, direction_t direction, Object **ret, uint64_t *offset);
@@ -231,9 +311,17 @@ int journal_file_move_to_entry_by_monotonic_for_data(JournalFile *f, uint64_t da
 
 int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint64_t p, uint64_t *seqnum, Object **ret, uint64_t *offset);
 
+typedef struct JournalFileCopyEntry {
+        JournalFile *file;
+        uint64_t offset;
+} JournalFileCopyEntry;
+
+int journal_file_copy_entries(JournalFile *to, const JournalFileCopyEntry entries[], size_t n_entries, uint64_t *seqnum, size_t *ret_n_copied);
+
 void journal_file_dump(JournalFile *f);
 void journal_file_print_header(JournalFile *f);
 
+int journal_file_archived_path(JournalFile *f, char **ret);
 int journal_file_rotate(JournalFile **f, bool compress, uint64_t compress_threshold_bytes, bool seal, Set *deferred_closes);
 
 void journal_file_post_change(JournalFile *f);
@@ -250,7 +338,25 @@ bool journal_file_rotate_suggested(JournalFile *f, usec_t max_file_usec);
 int journal_file_map_data_hash_table(JournalFile *f);
 int journal_file_map_field_hash_table(JournalFile *f);
 
+CompressDict* journal_file_compress_dict(JournalFile *f);
+bool journal_file_maybe_contains_hash(JournalFile *f, uint64_t hash);
+
 static inline bool JOURNAL_FILE_COMPRESS(JournalFile *f) {
         assert(f);
-        return f->compress_xz || f->compress_lz4;
+        return f->compress_xz || f->compress_lz4 || f->compress_zstd;
+}
+
+static inline int journal_file_compression(JournalFile *f) {
+        assert(f);
+
+        /* New objects must use the codec announced in the header, so
+         * that files created by older versions stay readable by them */
+
+        if (f->compress_zstd)
+                return OBJECT_COMPRESSED_ZSTD;
+        if (f->compress_lz4)
+                return OBJECT_COMPRESSED_LZ4;
+        if (f->compress_xz)
+                return OBJECT_COMPRESSED_XZ;
+        return 0;
 }
@@ -9,6 +9,7 @@
 
 #include <inttypes.h>
 #include <stdbool.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 
 #include "sd-id128.h"
@@ -18,6 +19,7 @@
 #include "journal-def.h"
 #include "journal-file.h"
 #include "list.h"
+#include "prioq.h"
 #include "set.h"
 
 typedef struct Match Match;
@@ -70,6 +72,11 @@ struct Directory {
         unsigned last_seen_generation;
 };
 
+typedef struct UniqueValue {
+        uint64_t hash;
+        JournalFile *file; /* the file we returned the value from */
+} UniqueValue;
+
 struct sd_journal {
         int toplevel_fd;
 
@@ -85,11 +92,19 @@ struct sd_journal {
         JournalFile *current_file;
         uint64_t current_field;
 
+        /* Files with a candidate entry in files_prioq_direction, ordered by it, and the files without one
+         * that might still grow. Only valid while iterating sequentially, rebuilt otherwise. */
+        Prioq *files_prioq;
+        Set *files_polled;
+        direction_t files_prioq_direction;
+        bool files_prioq_valid;
+
         Match *level0, *level1, *level2;
 
         pid_t original_pid;
 
         int inotify_fd;
+        int tail_wd;
         unsigned current_invalidate_counter, last_invalidate_counter;
         usec_t last_process_usec;
         unsigned generation;
@@ -98,6 +113,7 @@ struct sd_journal {
         char *unique_field;
         JournalFile *unique_file;
         uint64_t unique_offset;
+        Hashmap *unique_values; /* hash → UniqueValue, for the values returned so far */
 
         /* Iterating through known fields */
         JournalFile *fields_file;
@@ -125,10 +141,21 @@ struct sd_journal {
         Hashmap *directories_by_wd;
 
         Hashmap *errors;
+
+        /* Catalog texts looked up so far, id → CatalogCacheEntry, and the database they came from */
+        Hashmap *catalog_cache;
+        struct stat catalog_stat;
+        usec_t catalog_checked;
 };
 
+/* journald writes the seqnum of the last entry it wrote to this file, whenever that changes, so that
+ * followers can watch it for IN_MODIFY, instead of waiting for the journal files to be touched */
+#define JOURNAL_TAIL_PATH "/run/systemd/journal/tail"
+
 char *journal_make_match_string(sd_journal *j);
 void journal_print_header(sd_journal *j);
+int journal_get_boots(sd_journal *j, JournalBoot **ret, size_t *ret_n);
+int journal_get_data_size(sd_journal *j, const char *field, uint64_t *ret_size);
 
 #define JOURNAL_FOREACH_DATA_RETVAL(j, data, l, retval)                     \
         for (sd_journal_restart_data(j); ((retval) = sd_journal_enumerate_data((j), &(data), &(l))) > 0; )
@@ -0,0 +1,297 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+***/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "journal-ring.h"
+#include "memfd-util.h"
+#include "missing.h"
+
+static bool data_size_is_valid(uint64_t data_size) {
+        return data_size >= JOURNAL_RING_DATA_SIZE_MIN &&
+               data_size <= JOURNAL_RING_DATA_SIZE_MAX &&
+               (data_size & (data_size - 1)) == 0;
+}
+
+int journal_ring_new(size_t data_size, JournalRing **ret, int *ret_fd) {
+        _cleanup_(journal_ring_freep) JournalRing *r = NULL;
+        _cleanup_close_ int fd = -1;
+        JournalRingHeader *h;
+        size_t size;
+        void *p;
+
+        assert(data_size_is_valid(data_size));
+        assert(ret);
+        assert(ret_fd);
+
+        size = sizeof(JournalRingHeader) + data_size;
+
+        fd = memfd_new("journal-ring");
+        if (fd < 0)
+                return fd;
+
+        if (ftruncate(fd, size) < 0)
+                return -errno;
+
+        /* journald maps the ring for as long as we live, make sure it can rely on its size */
+        if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0)
+                return -errno;
+
+        p = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        r = new0(JournalRing, 1);
+        if (!r) {
+                (void) munmap(p, size);
+                return -ENOMEM;
+        }
+
+        r->header = h = p;
+        r->data = (uint8_t*) p + sizeof(JournalRingHeader);
+        r->data_size = data_size;
+        r->mapped_size = size;
+
+        memcpy(h->signature, JOURNAL_RING_SIGNATURE, sizeof(h->signature));
+        h->header_size = sizeof(JournalRingHeader);
+        h->data_size = data_size;
+        h->consumer = JOURNAL_RING_PENDING;
+
+        *ret = TAKE_PTR(r);
+        *ret_fd = TAKE_FD(fd);
+        return 0;
+}
+
+int journal_ring_consumer(JournalRing *r) {
+        assert(r);
+
+        __sync_synchronize();
+        return r->header->consumer;
+}
+
+int journal_ring_append(JournalRing *r, const struct iovec *iov, size_t n, usec_t realtime) {
+        JournalRingRecord *record;
+        size_t size = 0, need, offset, pad, i;
+        uint64_t tail, position;
+        uint8_t *p;
+
+        assert(r);
+        assert(!r->consumer);
+        assert(iov || n == 0);
+
+        /* Returns -ENOTCONN if journald doesn't (or no longer) read the ring, -E2BIG if the entry is too
+         * large for it, -ENOBUFS if the ring is full, and > 0 if journald needs to be woken up. */
+
+        if (journal_ring_consumer(r) != JOURNAL_RING_ATTACHED)
+                return -ENOTCONN;
+
+        for (i = 0; i < n; i++)
+                size += iov[i].iov_len;
+
+        need = ALIGN_TO(sizeof(JournalRingRecord) + size, JOURNAL_RING_ALIGN);
+        if (need > r->data_size / 4)
+                return -E2BIG;
+
+        position = r->position;
+        offset = position & (r->data_size - 1);
+        pad = offset + need > r->data_size ? r->data_size - offset : 0;
+
+        tail = r->header->tail;
+        __sync_synchronize();
+
+        if (position + pad + need - tail > r->data_size)
+                return -ENOBUFS;
+
+        if (pad > 0) {
+                record = (JournalRingRecord*) (r->data + offset);
+                record->size = JOURNAL_RING_RECORD_PAD;
+
+                position += pad;
+                offset = 0;
+        }
+
+        record = (JournalRingRecord*) (r->data + offset);
+        record->size = size;
+        record->reserved = 0;
+        record->realtime = realtime;
+
+        p = (uint8_t*) (record + 1);
+        for (i = 0; i < n; i++)
+                p = mempcpy(p, iov[i].iov_base, iov[i].iov_len);
+
+        position += need;
+
+        /* Publish the entry only once it is complete, and look at need_wakeup only after that: journald
+         * sets it before it checks head for the last time. */
+        __sync_synchronize();
+        r->header->head = r->position = position;
+        __sync_synchronize();
+
+        return __sync_bool_compare_and_swap(&r->header->need_wakeup, 1, 0);
+}
+
+int journal_ring_attach(int fd, JournalRing **ret) {
+        _cleanup_(journal_ring_freep) JournalRing *r = NULL;
+        JournalRingHeader *h;
+        uint64_t data_size;
+        struct stat st;
+        int seals;
+        void *p;
+
+        assert(fd >= 0);
+        assert(ret);
+
+        /* The client keeps writing to the ring, but it must not be able to take away pages we map */
+        seals = fcntl(fd, F_GET_SEALS);
+        if (seals < 0)
+                return -errno;
+        if ((seals & (F_SEAL_SHRINK | F_SEAL_GROW)) != (F_SEAL_SHRINK | F_SEAL_GROW))
+                return -EPERM;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        if (!S_ISREG(st.st_mode))
+                return -EBADF;
+
+        if (st.st_size < (off_t) (sizeof(JournalRingHeader) + JOURNAL_RING_DATA_SIZE_MIN) ||
+            st.st_size > (off_t) (sizeof(JournalRingHeader) + JOURNAL_RING_DATA_SIZE_MAX))
+                return -EBADMSG;
+
+        p = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        r = new0(JournalRing, 1);
+        if (!r) {
+                (void) munmap(p, st.st_size);
+                return -ENOMEM;
+        }
+
+        r->header = h = p;
+        r->mapped_size = st.st_size;
+        r->consumer = true;
+
+        /* Read the geometry once, and only use our own copy from now on */
+        data_size = h->data_size;
+
+        if (memcmp(h->signature, JOURNAL_RING_SIGNATURE, sizeof(h->signature)) != 0 ||
+            h->header_size != sizeof(JournalRingHeader) ||
+            !data_size_is_valid(data_size) ||
+            sizeof(JournalRingHeader) + data_size != (uint64_t) st.st_size)
+                return -EBADMSG;
+
+        /* Entries never straddle the end of the data area as long as we start out aligned */
+        r->position = h->tail;
+        if (r->position % JOURNAL_RING_ALIGN != 0)
+                return -EBADMSG;
+
+        r->data = (uint8_t*) p + sizeof(JournalRingHeader);
+        r->data_size = data_size;
+
+        __sync_synchronize();
+        h->consumer = JOURNAL_RING_ATTACHED;
+
+        *ret = TAKE_PTR(r);
+        return 0;
+}
+
+int journal_ring_drain(JournalRing *r, journal_ring_entry_t entry, void *userdata, char **buffer, size_t *allocated) {
+        size_t budget;
+
+        assert(r);
+        assert(r->consumer);
+        assert(entry);
+        assert(buffer);
+        assert(allocated);
+
+        /* Hands all entries in the ring to entry(), copied to buffer, so that the client can't change them
+         * under us. Returns -EBADMSG if the client corrupted the ring, 1 if we stopped after consuming a full
+         * ring worth of data, so that others get a chance too, and 0 once the ring was emptied and the client
+         * will wake us up for the next entry. */
+
+        budget = r->data_size;
+
+        for (;;) {
+                uint64_t head;
+
+                head = r->header->head;
+                __sync_synchronize();
+
+                if (head - r->position > r->data_size)
+                        return -EBADMSG;
+
+                while (r->position != head) {
+                        JournalRingRecord record;
+                        size_t offset, need;
+
+                        if (budget == 0)
+                                return 1;
+
+                        offset = r->position & (r->data_size - 1);
+                        memcpy(&record, r->data + offset, sizeof(record));
+
+                        if (record.size == JOURNAL_RING_RECORD_PAD)
+                                need = r->data_size - offset;
+                        else {
+                                need = ALIGN_TO(sizeof(record) + (size_t) record.size, JOURNAL_RING_ALIGN);
+                                if (need > r->data_size - offset)
+                                        return -EBADMSG;
+                        }
+
+                        if (need > head - r->position)
+                                return -EBADMSG;
+
+                        if (record.size != JOURNAL_RING_RECORD_PAD) {
+                                if (!GREEDY_REALLOC(*buffer, *allocated, (size_t) record.size + 1))
+                                        return -ENOMEM;
+
+                                memcpy(*buffer, r->data + offset + sizeof(record), record.size);
+                                (*buffer)[record.size] = 0;
+
+                                entry(*buffer, record.size, record.realtime, userdata);
+                        }
+
+                        r->position += need;
+                        budget -= MIN(budget, need);
+
+                        /* Hand the space back right away, the client might be waiting for it */
+                        __sync_synchronize();
+                        r->header->tail = r->position;
+                }
+
+                /* Everything is consumed, ask for a wakeup. Then check once more, the client might have added
+                 * an entry before it could see the flag. */
+                r->header->need_wakeup = 1;
+                __sync_synchronize();
+
+                if (r->header->head == r->position)
+                        return 0;
+        }
+}
+
+JournalRing *journal_ring_free(JournalRing *r) {
+        if (!r)
+                return NULL;
+
+        if (r->header) {
+                if (r->consumer) {
+                        /* Let the client know it needs to go back to the socket */
+                        __sync_synchronize();
+                        r->header->consumer = JOURNAL_RING_DETACHED;
+                }
+
+                (void) munmap(r->header, r->mapped_size);
+        }
+
+        return mfree(r);
+}
@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+/***
+  This file is part of systemd.
+***/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "macro.h"
+#include "time-util.h"
+
+/* A journal ring is a memfd a client shares with journald, into which it writes entries in the native
+ * protocol, so that logging costs a memcpy rather than a sendmsg(). The client passes the memfd, an eventfd
+ * and the read end of a pipe with an otherwise empty datagram on the native socket. journald sets consumer to
+ * JOURNAL_RING_ATTACHED once it took over the ring, and to JOURNAL_RING_DETACHED when it lets go of it. Until
+ * the client sees the former it keeps using the socket. journald notices the client going away by the pipe
+ * hanging up.
+ *
+ * The client is the only writer of head, journald the only writer of tail. Both count bytes and never wrap,
+ * the data area offset is taken modulo data_size. Every entry is prefixed by a JournalRingRecord and padded to
+ * a multiple of JOURNAL_RING_ALIGN, and never wraps around the end of the data area: if it doesn't fit, a
+ * record of size JOURNAL_RING_RECORD_PAD is written, and the entry starts at offset 0 again.
+ *
+ * journald sets need_wakeup when it has consumed everything, and the client clears it and writes to the
+ * eventfd after adding an entry it finds set. Hence at most one wakeup is sent per batch. The memfd is sealed
+ * against shrinking and growing, so that journald can't be made to SIGBUS. journald never trusts anything in
+ * the shared memory beyond its own copy of the geometry, and copies each entry out before parsing it. */
+
+#define JOURNAL_RING_SIGNATURE ((const char[8]) { 'S', 'D', 'J', 'R', 'I', 'N', 'G', '1' })
+
+#define JOURNAL_RING_DATA_SIZE_MIN (64U*1024U)
+#define JOURNAL_RING_DATA_SIZE_MAX (64U*1024U*1024U)
+#define JOURNAL_RING_DATA_SIZE_DEFAULT (1024U*1024U)
+
+#define JOURNAL_RING_ALIGN 16U
+#define JOURNAL_RING_RECORD_PAD UINT32_MAX
+
+enum {
+        JOURNAL_RING_PENDING,
+        JOURNAL_RING_ATTACHED,
+        JOURNAL_RING_DETACHED,
+};
+
+typedef struct JournalRingHeader {
+        uint8_t signature[8];
+        uint64_t header_size;
+        uint64_t data_size;
+        uint32_t consumer;
+        uint32_t need_wakeup;
+        uint8_t reserved0[32];
+
+        /* Keep producer and consumer positions on separate cache lines */
+        uint64_t head;
+        uint8_t reserved1[56];
+        uint64_t tail;
+        uint8_t reserved2[56];
+} JournalRingHeader;
+
+typedef struct JournalRingRecord {
+        uint32_t size;
+        uint32_t reserved;
+        uint64_t realtime;
+} JournalRingRecord;
+
+assert_cc(sizeof(JournalRingHeader) == 192);
+assert_cc(sizeof(JournalRingRecord) == JOURNAL_RING_ALIGN);
+
+typedef struct JournalRing {
+        JournalRingHeader *header;
+        uint8_t *data;
+        size_t data_size;
+        size_t mapped_size;
+        bool consumer;
+
+        /* Our own copy of head on the client side, and of tail in journald. The one in the shared memory is
+         * only ever written to by us. */
+        uint64_t position;
+} JournalRing;
+
+/* Client side */
+int journal_ring_new(size_t data_size, JournalRing **ret, int *ret_fd);
+int journal_ring_append(JournalRing *r, const struct iovec *iov, size_t n, usec_t realtime);
+int journal_ring_consumer(JournalRing *r);
+
+/* journald side */
+typedef void (*journal_ring_entry_t)(const void *data, size_t size, usec_t realtime, void *userdata);
+
+int journal_ring_attach(int fd, JournalRing **ret);
+int journal_ring_drain(JournalRing *r, journal_ring_entry_t entry, void *userdata, char **buffer, size_t *allocated);
+
+JournalRing *journal_ring_free(JournalRing *r);
+DEFINE_TRIVIAL_CLEANUP_FUNC(JournalRing*, journal_ring_free);
@@ -7,8 +7,11 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <printf.h>
+#include <pthread.h>
 #include <stddef.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
@@ -21,7 +24,10 @@
 #include "fd-util.h"
 #include "fileio.h"
 #include "io-util.h"
+#include "journal-ring.h"
 #include "memfd-util.h"
+#include "parse-util.h"
+#include "process-util.h"
 #include "socket-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
@@ -67,6 +73,136 @@ retry:
         return fd;
 }
 
+static int journal_ring_setup(
+                int fd,
+                const struct sockaddr *sa, socklen_t salen,
+                JournalRing **ret,
+                int *ret_event_fd,
+                int *ret_hangup_fd) {
+
+        _cleanup_(journal_ring_freep) JournalRing *ring = NULL;
+        _cleanup_close_ int ring_fd = -1, event_fd = -1;
+        _cleanup_close_pair_ int pipe_fds[2] = { -1, -1 };
+        union {
+                struct cmsghdr cmsghdr;
+                uint8_t buf[CMSG_SPACE(sizeof(int) * 3)];
+        } control = {};
+        struct msghdr mh = {
+                .msg_name = (struct sockaddr*) sa,
+                .msg_namelen = salen,
+                .msg_control = &control,
+                .msg_controllen = sizeof(control),
+        };
+        struct cmsghdr *cmsg;
+        int fds[3], r;
+
+        assert(fd >= 0);
+        assert(ret);
+        assert(ret_event_fd);
+        assert(ret_hangup_fd);
+
+        r = journal_ring_new(JOURNAL_RING_DATA_SIZE_DEFAULT, &ring, &ring_fd);
+        if (r < 0)
+                return r;
+
+        event_fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        if (event_fd < 0)
+                return -errno;
+
+        /* journald learns through the read end that we are gone */
+        if (pipe2(pipe_fds, O_CLOEXEC|O_NONBLOCK) < 0)
+                return -errno;
+
+        fds[0] = ring_fd;
+        fds[1] = event_fd;
+        fds[2] = pipe_fds[0];
+
+        cmsg = CMSG_FIRSTHDR(&mh);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+        if (sendmsg(fd, &mh, MSG_NOSIGNAL) < 0)
+                return -errno;
+
+        *ret = TAKE_PTR(ring);
+        *ret_event_fd = TAKE_FD(event_fd);
+        *ret_hangup_fd = TAKE_FD(pipe_fds[1]);
+        return 0;
+}
+
+/* With $SYSTEMD_JOURNAL_RING=1 entries are passed to journald through a ring in shared memory, see
+ * journal-ring.h. Returns 1 if the entry was written to the ring, and 0 if it needs to go through the socket:
+ * before journald picked up the ring, if it is full, or if journald doesn't support it. */
+static int journal_ring_send(int fd, const struct sockaddr *sa, socklen_t salen, const struct iovec *iov, size_t n) {
+        static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+        static JournalRing *ring = NULL;
+        static int event_fd = -1, hangup_fd = -1;
+        static pid_t ring_pid = 0;
+        static int enabled = -1;
+        bool drop = false;
+        int r;
+
+        if (enabled < 0) {
+                const char *e;
+
+                e = getenv("SYSTEMD_JOURNAL_RING");
+                enabled = e && parse_boolean(e) > 0;
+        }
+        if (!enabled)
+                return 0;
+
+        assert_se(pthread_mutex_lock(&mutex) == 0);
+
+        /* The ring belongs to the process that set it up, children set up their own. We only try once per
+         * process. */
+        if (ring_pid != getpid_cached()) {
+                ring = journal_ring_free(ring);
+                event_fd = safe_close(event_fd);
+                hangup_fd = safe_close(hangup_fd);
+
+                ring_pid = getpid_cached();
+                (void) journal_ring_setup(fd, sa, salen, &ring, &event_fd, &hangup_fd);
+        }
+
+        if (!ring) {
+                r = 0;
+                goto finish;
+        }
+
+        r = journal_ring_append(ring, iov, n, now(CLOCK_REALTIME));
+        if (r >= 0) {
+                if (r > 0)
+                        (void) eventfd_write(event_fd, 1);
+
+                r = 1;
+        } else if (r == -ENOTCONN) {
+                drop = journal_ring_consumer(ring) == JOURNAL_RING_DETACHED;
+                r = 0;
+        } else if (r == -ENOBUFS) {
+                struct pollfd pollfd = {
+                        .fd = hangup_fd,
+                        .events = POLLOUT,
+                };
+
+                /* If journald went away without detaching, nobody is going to make room again */
+                drop = poll(&pollfd, 1, 0) > 0 && (pollfd.revents & POLLERR);
+                r = 0;
+        } else
+                r = 0;
+
+        if (drop) {
+                ring = journal_ring_free(ring);
+                event_fd = safe_close(event_fd);
+                hangup_fd = safe_close(hangup_fd);
+        }
+
+finish:
+        assert_se(pthread_mutex_unlock(&mutex) == 0);
+        return r;
+}
+
 _public_ int sd_journal_print(int priority, const char *format, ...) {
         int r;
         va_list ap;
@@ -279,6 +415,9 @@ _public_ int sd_journal_sendv(const struct iovec *iov, int n) {
         if (_unlikely_(fd < 0))
                 return fd;
 
+        if (journal_ring_send(fd, mh.msg_name, mh.msg_namelen, w, j) > 0)
+                return 0;
+
         mh.msg_iov = w;
         mh.msg_iovlen = j;
 
@@ -14,6 +14,7 @@
 #include "alloc-util.h"
 #include "dirent-util.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "fs-util.h"
 #include "journal-def.h"
 #include "journal-file.h"
@@ -131,7 +132,237 @@ static int journal_file_empty(int dir_fd, const char *name) {
         return le64toh(n_entries) <= 0;
 }
 
-int journal_directory_vacuum(
+/* Even if nothing seems to have changed, rescan the directory once in a while, to pick up changes we might
+ * have missed and the final size of recently archived files */
+#define VACUUM_RESCAN_USEC (1 * USEC_PER_HOUR)
+
+struct JournalVacuumCache {
+        /* The archived files, sorted by vacuum_compare() */
+        struct vacuum_info *list;
+        size_t n_list, n_allocated;
+        uint64_t sum;
+
+        unsigned n_active_files;
+
+        bool valid;
+        usec_t timestamp;     /* when the directory was last scanned */
+        nsec_t mtime;         /* the mtime of the directory, when the list was last brought up to date */
+};
+
+static void vacuum_cache_reset(JournalVacuumCache *c) {
+        size_t i;
+
+        assert(c);
+
+        for (i = 0; i < c->n_list; i++)
+                free(c->list[i].filename);
+
+        c->n_list = 0;
+        c->sum = 0;
+        c->n_active_files = 0;
+        c->valid = false;
+}
+
+JournalVacuumCache* journal_vacuum_cache_free(JournalVacuumCache *c) {
+        if (!c)
+                return NULL;
+
+        vacuum_cache_reset(c);
+        free(c->list);
+
+        return mfree(c);
+}
+
+static int directory_mtime(int dir_fd, nsec_t *ret) {
+        struct stat st;
+
+        assert(dir_fd >= 0);
+        assert(ret);
+
+        if (fstat(dir_fd, &st) < 0)
+                return -errno;
+
+        *ret = timespec_load_nsec(&st.st_mtim);
+        return 0;
+}
+
+static int vacuum_parse_filename(const char *name, struct vacuum_info *info) {
+        unsigned long long seqnum, realtime, tmp;
+        char id[SD_ID128_STRING_MAX];
+        size_t q;
+
+        assert(name);
+        assert(info);
+
+        /* Returns > 0 for files we may vacuum, 0 for journal files we have to leave around, and -EINVAL for
+         * files that aren't journal files at all */
+
+        q = strlen(name);
+
+        if (endswith(name, ".journal")) {
+
+                /* Vacuum archived files. Active files are
+                 * left around */
+
+                if (q < 1 + 32 + 1 + 16 + 1 + 16 + 8)
+                        return 0;
+
+                if (name[q-8-16-1] != '-' ||
+                    name[q-8-16-1-16-1] != '-' ||
+                    name[q-8-16-1-16-1-32-1] != '@')
+                        return 0;
+
+                memcpy(id, name + q-8-16-1-16-1-32, 32);
+                id[32] = 0;
+                if (sd_id128_from_string(id, &info->seqnum_id) < 0)
+                        return 0;
+
+                if (sscanf(name + q-8-16-1-16, "%16llx-%16llx.journal", &seqnum, &realtime) != 2)
+                        return 0;
+
+                info->seqnum = seqnum;
+                info->realtime = realtime;
+                info->have_seqnum = true;
+                return 1;
+        }
+
+        if (endswith(name, ".journal~")) {
+
+                /* Vacuum corrupted files */
+
+                if (q < 1 + 16 + 1 + 16 + 8 + 1)
+                        return 0;
+
+                if (name[q-1-8-16-1] != '-' ||
+                    name[q-1-8-16-1-16-1] != '@')
+                        return 0;
+
+                if (sscanf(name + q-1-8-16-1-16, "%16llx-%16llx.journal~", &realtime, &tmp) != 2)
+                        return 0;
+
+                info->seqnum_id = SD_ID128_NULL;
+                info->seqnum = 0;
+                info->realtime = realtime;
+                info->have_seqnum = false;
+                return 1;
+        }
+
+        return -EINVAL;
+}
+
+static int vacuum_cache_add_file(
+                JournalVacuumCache *c,
+                int dir_fd,
+                const char *directory,
+                const char *name,
+                const struct stat *st,
+                bool verbose,
+                uint64_t *freed) {
+
+        char sbytes[FORMAT_BYTES_MAX];
+        struct vacuum_info info = {};
+        unsigned long long realtime;
+        uint64_t size;
+        int r;
+
+        assert(c);
+        assert(name);
+        assert(st);
+        assert(freed);
+
+        r = vacuum_parse_filename(name, &info);
+        if (r < 0) {
+                /* We do not vacuum unknown files! */
+                log_debug("Not vacuuming unknown file %s.", name);
+                return 0;
+        }
+        if (r == 0) {
+                c->n_active_files++;
+                return 0;
+        }
+
+        size = 512UL * (uint64_t) st->st_blocks;
+
+        r = journal_file_empty(dir_fd, name);
+        if (r < 0) {
+                log_debug_errno(r, "Failed check if %s is empty, ignoring: %m", name);
+                return 0;
+        }
+        if (r > 0) {
+                /* Always vacuum empty non-online files. */
+
+                r = unlinkat_deallocate(dir_fd, name, 0);
+                if (r >= 0) {
+
+                        log_full(verbose ? LOG_INFO : LOG_DEBUG,
+                                 "Deleted empty archived journal %s/%s (%s).", directory, name, format_bytes(sbytes, sizeof(sbytes), size));
+
+                        *freed += size;
+                } else if (r != -ENOENT)
+                        log_warning_errno(r, "Failed to delete empty archived journal %s/%s: %m", directory, name);
+
+                return 0;
+        }
+
+        realtime = info.realtime;
+        patch_realtime(dir_fd, name, st, &realtime);
+        info.realtime = realtime;
+
+        if (!GREEDY_REALLOC(c->list, c->n_allocated, c->n_list + 1))
+                return -ENOMEM;
+
+        info.filename = strdup(name);
+        if (!info.filename)
+                return -ENOMEM;
+
+        info.usage = size;
+
+        c->list[c->n_list++] = info;
+        c->sum += size;
+
+        return 1;
+}
+
+static int vacuum_cache_scan(JournalVacuumCache *c, int dir_fd, const char *directory, bool verbose, uint64_t *freed) {
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+        int r;
+
+        assert(c);
+        assert(dir_fd >= 0);
+
+        vacuum_cache_reset(c);
+
+        d = xopendirat(dir_fd, ".", 0);
+        if (!d)
+                return -errno;
+
+        FOREACH_DIRENT_ALL(de, d, return -errno) {
+                struct stat st;
+
+                if (fstatat(dirfd(d), de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+                        log_debug_errno(errno, "Failed to stat file %s while vacuuming, ignoring: %m", de->d_name);
+                        continue;
+                }
+
+                if (!S_ISREG(st.st_mode))
+                        continue;
+
+                r = vacuum_cache_add_file(c, dirfd(d), directory, de->d_name, &st, verbose, freed);
+                if (r < 0)
+                        return r;
+        }
+
+        qsort_safe(c->list, c->n_list, sizeof(struct vacuum_info), vacuum_compare);
+
+        c->valid = true;
+        c->timestamp = now(CLOCK_MONOTONIC);
+
+        return 0;
+}
+
+static int vacuum_directory(
+                JournalVacuumCache *c,
                 const char *directory,
                 uint64_t max_use,
                 uint64_t n_max_files,
@@ -139,16 +370,15 @@ int journal_directory_vacuum(
                 usec_t *oldest_usec,
                 bool verbose) {
 
-        _cleanup_closedir_ DIR *d = NULL;
-        struct vacuum_info *list = NULL;
-        unsigned n_list = 0, i, n_active_files = 0;
-        size_t n_allocated = 0;
-        uint64_t sum = 0, freed = 0;
+        _cleanup_close_ int dir_fd = -1;
+        uint64_t freed = 0;
         usec_t retention_limit = 0;
         char sbytes[FORMAT_BYTES_MAX];
-        struct dirent *de;
+        nsec_t mtime = NSEC_INFINITY;
+        size_t i, j;
         int r;
 
+        assert(c);
         assert(directory);
 
         if (max_use <= 0 && max_retention_usec <= 0 && n_max_files <= 0)
@@ -162,178 +392,174 @@ int journal_directory_vacuum(
                         max_retention_usec = retention_limit = 0;
         }
 
-        d = opendir(directory);
-        if (!d)
+        dir_fd = open(directory, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (dir_fd < 0)
                 return -errno;
 
-        FOREACH_DIRENT_ALL(de, d, r = -errno; goto finish) {
+        /* Only scan the directory again if somebody else changed it since we last looked */
+        (void) directory_mtime(dir_fd, &mtime);
+        if (!c->valid || mtime == NSEC_INFINITY || mtime != c->mtime ||
+            c->timestamp + VACUUM_RESCAN_USEC < now(CLOCK_MONOTONIC)) {
+                r = vacuum_cache_scan(c, dir_fd, directory, verbose, &freed);
+                if (r < 0) {
+                        vacuum_cache_reset(c);
+                        goto finish;
+                }
+        }
 
-                unsigned long long seqnum = 0, realtime;
-                _cleanup_free_ char *p = NULL;
-                sd_id128_t seqnum_id;
-                bool have_seqnum;
-                uint64_t size;
-                struct stat st;
-                size_t q;
+        for (i = 0; i < c->n_list; i++) {
+                unsigned left;
 
-                if (fstatat(dirfd(d), de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
-                        log_debug_errno(errno, "Failed to stat file %s while vacuuming, ignoring: %m", de->d_name);
-                        continue;
-                }
+                left = c->n_active_files + c->n_list - i;
 
-                if (!S_ISREG(st.st_mode))
-                        continue;
+                if ((max_retention_usec <= 0 || c->list[i].realtime >= retention_limit) &&
+                    (max_use <= 0 || c->sum <= max_use) &&
+                    (n_max_files <= 0 || left <= n_max_files))
+                        break;
 
-                q = strlen(de->d_name);
-
-                if (endswith(de->d_name, ".journal")) {
-
-                        /* Vacuum archived files. Active files are
-                         * left around */
-
-                        if (q < 1 + 32 + 1 + 16 + 1 + 16 + 8) {
-                                n_active_files++;
-                                continue;
-                        }
-
-                        if (de->d_name[q-8-16-1] != '-' ||
-                            de->d_name[q-8-16-1-16-1] != '-' ||
-                            de->d_name[q-8-16-1-16-1-32-1] != '@') {
-                                n_active_files++;
-                                continue;
-                        }
-
-                        p = strdup(de->d_name);
-                        if (!p) {
-                                r = -ENOMEM;
-                                goto finish;
-                        }
-
-                        de->d_name[q-8-16-1-16-1] = 0;
-                        if (sd_id128_from_string(de->d_name + q-8-16-1-16-1-32, &seqnum_id) < 0) {
-                                n_active_files++;
-                                continue;
-                        }
-
-                        if (sscanf(de->d_name + q-8-16-1-16, "%16llx-%16llx.journal", &seqnum, &realtime) != 2) {
-                                n_active_files++;
-                                continue;
-                        }
-
-                        have_seqnum = true;
-
-                } else if (endswith(de->d_name, ".journal~")) {
-                        unsigned long long tmp;
-
-                        /* Vacuum corrupted files */
-
-                        if (q < 1 + 16 + 1 + 16 + 8 + 1) {
-                                n_active_files++;
-                                continue;
-                        }
-
-                        if (de->d_name[q-1-8-16-1] != '-' ||
-                            de->d_name[q-1-8-16-1-16-1] != '@') {
-                                n_active_files++;
-                                continue;
-                        }
-
-                        p = strdup(de->d_name);
-                        if (!p) {
-                                r = -ENOMEM;
-                                goto finish;
-                        }
-
-                        if (sscanf(de->d_name + q-1-8-16-1-16, "%16llx-%16llx.journal~", &realtime, &tmp) != 2) {
-                                n_active_files++;
-                                continue;
-                        }
-
-                        have_seqnum = false;
-                } else {
-                        /* We do not vacuum unknown files! */
-                        log_debug("Not vacuuming unknown file %s.", de->d_name);
-                        continue;
-                }
+                r = unlinkat_deallocate(dir_fd, c->list[i].filename, 0);
+                if (r >= 0) {
+                        log_full(verbose ? LOG_INFO : LOG_DEBUG, "Deleted archived journal %s/%s (%s).", directory, c->list[i].filename, format_bytes(sbytes, sizeof(sbytes), c->list[i].usage));
+                        freed += c->list[i].usage;
 
-                size = 512UL * (uint64_t) st.st_blocks;
+                        if (c->list[i].usage < c->sum)
+                                c->sum -= c->list[i].usage;
+                        else
+                                c->sum = 0;
 
-                r = journal_file_empty(dirfd(d), p);
-                if (r < 0) {
-                        log_debug_errno(r, "Failed check if %s is empty, ignoring: %m", p);
-                        continue;
+                } else if (r != -ENOENT) {
+                        log_warning_errno(r, "Failed to delete archived journal %s/%s: %m", directory, c->list[i].filename);
+
+                        /* The file is still around, hence look at the directory again next time */
+                        c->valid = false;
                 }
-                if (r > 0) {
-                        /* Always vacuum empty non-online files. */
+        }
 
-                        r = unlinkat_deallocate(dirfd(d), p, 0);
-                        if (r >= 0) {
+        if (oldest_usec && i < c->n_list && (*oldest_usec == 0 || c->list[i].realtime < *oldest_usec))
+                *oldest_usec = c->list[i].realtime;
 
-                                log_full(verbose ? LOG_INFO : LOG_DEBUG,
-                                         "Deleted empty archived journal %s/%s (%s).", directory, p, format_bytes(sbytes, sizeof(sbytes), size));
+        /* Drop the entries for the files we just deleted */
+        for (j = 0; j < i; j++)
+                free(c->list[j].filename);
+        memmove(c->list, c->list + i, (c->n_list - i) * sizeof(struct vacuum_info));
+        c->n_list -= i;
 
-                                freed += size;
-                        } else if (r != -ENOENT)
-                                log_warning_errno(r, "Failed to delete empty archived journal %s/%s: %m", directory, p);
+        /* Our own deletions don't count as changes by others */
+        if (i > 0 || freed > 0)
+                (void) directory_mtime(dir_fd, &mtime);
+        c->mtime = mtime;
 
-                        continue;
-                }
+        r = 0;
 
-                patch_realtime(dirfd(d), p, &st, &realtime);
+finish:
+        log_full(verbose ? LOG_INFO : LOG_DEBUG, "Vacuuming done, freed %s of archived journals from %s.", format_bytes(sbytes, sizeof(sbytes), freed), directory);
 
-                if (!GREEDY_REALLOC(list, n_allocated, n_list + 1)) {
-                        r = -ENOMEM;
-                        goto finish;
-                }
+        return r;
+}
+
+int journal_directory_vacuum(
+                const char *directory,
+                uint64_t max_use,
+                uint64_t n_max_files,
+                usec_t max_retention_usec,
+                usec_t *oldest_usec,
+                bool verbose) {
+
+        JournalVacuumCache c = {};
+        int r;
+
+        r = vacuum_directory(&c, directory, max_use, n_max_files, max_retention_usec, oldest_usec, verbose);
+
+        vacuum_cache_reset(&c);
+        free(c.list);
+
+        return r;
+}
+
+int journal_directory_vacuum_cached(
+                JournalVacuumCache **cache,
+                const char *directory,
+                uint64_t max_use,
+                uint64_t n_max_files,
+                usec_t max_retention_usec,
+                usec_t *oldest_usec,
+                bool verbose) {
 
-                list[n_list].filename = TAKE_PTR(p);
-                list[n_list].usage = size;
-                list[n_list].seqnum = seqnum;
-                list[n_list].realtime = realtime;
-                list[n_list].seqnum_id = seqnum_id;
-                list[n_list].have_seqnum = have_seqnum;
-                n_list++;
+        assert(cache);
 
-                sum += size;
+        if (!*cache) {
+                *cache = new0(JournalVacuumCache, 1);
+                if (!*cache)
+                        return -ENOMEM;
         }
 
-        qsort_safe(list, n_list, sizeof(struct vacuum_info), vacuum_compare);
+        return vacuum_directory(*cache, directory, max_use, n_max_files, max_retention_usec, oldest_usec, verbose);
+}
 
-        for (i = 0; i < n_list; i++) {
-                unsigned left;
+void journal_vacuum_cache_verify(JournalVacuumCache *c, const char *directory) {
+        _cleanup_close_ int dir_fd = -1;
+        nsec_t mtime;
 
-                left = n_active_files + n_list - i;
+        assert(directory);
 
-                if ((max_retention_usec <= 0 || list[i].realtime >= retention_limit) &&
-                    (max_use <= 0 || sum <= max_use) &&
-                    (n_max_files <= 0 || left <= n_max_files))
-                        break;
+        /* Call this before changing the directory in a way that is reported with journal_vacuum_cache_add()
+         * afterwards. If somebody else changed the directory in the meantime, the cached list is dropped. */
 
-                r = unlinkat_deallocate(dirfd(d), list[i].filename, 0);
-                if (r >= 0) {
-                        log_full(verbose ? LOG_INFO : LOG_DEBUG, "Deleted archived journal %s/%s (%s).", directory, list[i].filename, format_bytes(sbytes, sizeof(sbytes), list[i].usage));
-                        freed += list[i].usage;
+        if (!c || !c->valid)
+                return;
 
-                        if (list[i].usage < sum)
-                                sum -= list[i].usage;
-                        else
-                                sum = 0;
+        dir_fd = open(directory, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (dir_fd < 0 || directory_mtime(dir_fd, &mtime) < 0 || mtime != c->mtime)
+                c->valid = false;
+}
 
-                } else if (r != -ENOENT)
-                        log_warning_errno(r, "Failed to delete archived journal %s/%s: %m", directory, list[i].filename);
+int journal_vacuum_cache_add(JournalVacuumCache *c, const char *directory, const char *filename) {
+        _cleanup_close_ int dir_fd = -1;
+        struct vacuum_info info;
+        uint64_t freed = 0;
+        struct stat st;
+        size_t k;
+        int r;
+
+        assert(directory);
+        assert(filename);
+
+        /* Adds a file that was just archived to the cached list, so that the directory doesn't need to be
+         * scanned again on the next vacuuming */
+
+        if (!c || !c->valid)
+                return 0;
+
+        dir_fd = open(directory, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (dir_fd < 0) {
+                r = -errno;
+                goto fail;
         }
 
-        if (oldest_usec && i < n_list && (*oldest_usec == 0 || list[i].realtime < *oldest_usec))
-                *oldest_usec = list[i].realtime;
+        if (fstatat(dir_fd, filename, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+                r = -errno;
+                goto fail;
+        }
 
-        r = 0;
+        r = vacuum_cache_add_file(c, dir_fd, directory, filename, &st, false, &freed);
+        if (r < 0)
+                goto fail;
+        if (r > 0) {
+                /* Archived files are usually the newest ones, hence start looking for the right place from
+                 * the end */
+                info = c->list[c->n_list - 1];
+                for (k = c->n_list - 1; k > 0 && vacuum_compare(&c->list[k - 1], &info) > 0; k--)
+                        c->list[k] = c->list[k - 1];
+                c->list[k] = info;
+        }
 
-finish:
-        for (i = 0; i < n_list; i++)
-                free(list[i].filename);
-        free(list);
+        r = directory_mtime(dir_fd, &c->mtime);
+        if (r < 0)
+                goto fail;
 
-        log_full(verbose ? LOG_INFO : LOG_DEBUG, "Vacuuming done, freed %s of archived journals from %s.", format_bytes(sbytes, sizeof(sbytes), freed), directory);
+        return 0;
 
+fail:
+        c->valid = false;
         return r;
 }
@@ -10,6 +10,18 @@
 #include <inttypes.h>
 #include <stdbool.h>
 
+#include "macro.h"
 #include "time-util.h"
 
+typedef struct JournalVacuumCache JournalVacuumCache;
+
 int journal_directory_vacuum(const char *directory, uint64_t max_use, uint64_t n_max_files, usec_t max_retention_usec, usec_t *oldest_usec, bool verbose);
+
+/* Like journal_directory_vacuum(), but keeps the list of archived files around between invocations */
+int journal_directory_vacuum_cached(JournalVacuumCache **cache, const char *directory, uint64_t max_use, uint64_t n_max_files, usec_t max_retention_usec, usec_t *oldest_usec, bool verbose);
+
+void journal_vacuum_cache_verify(JournalVacuumCache *c, const char *directory);
+int journal_vacuum_cache_add(JournalVacuumCache *c, const char *directory, const char *filename);
+
+JournalVacuumCache* journal_vacuum_cache_free(JournalVacuumCache *c);
+DEFINE_TRIVIAL_CLEANUP_FUNC(JournalVacuumCache*, journal_vacuum_cache_free);
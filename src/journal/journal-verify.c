@@ -122,7 +122,7 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
          * possible field values. It does not follow any references to
          * other objects. */
 
-        if ((o->object.flags & OBJECT_COMPRESSED_XZ) &&
+        if ((o->object.flags & OBJECT_COMPRESSION_MASK) &&
             o->object.type != OBJECT_DATA) {
                 error(offset, "Found compressed object that isn't of type DATA, which is not allowed.");
                 return -EBADMSG;
@@ -156,7 +156,7 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                         _cleanup_free_ void *b = NULL;
                         size_t alloc = 0, b_size;
 
-                        r = decompress_blob(compression,
+                        r = decompress_blob(compression, journal_file_compress_dict(f),
                                             o->data.payload,
                                             le64toh(o->object.size) - offsetof(Object, data.payload),
                                             &b, &alloc, &b_size, 0);
@@ -175,6 +175,11 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                         return -EBADMSG;
                 }
 
+                if (!journal_file_maybe_contains_hash(f, h1)) {
+                        error(offset, "Data object missing from bloom filter");
+                        return -EBADMSG;
+                }
+
                 if (!VALID64(le64toh(o->data.next_hash_offset)) ||
                     !VALID64(le64toh(o->data.next_field_offset)) ||
                     !VALID64(le64toh(o->data.entry_offset)) ||
@@ -348,6 +353,76 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                 }
 
                 break;
+
+        case OBJECT_DICTIONARY:
+                if (le64toh(o->object.size) <= offsetof(DictionaryObject, payload)) {
+                        error(offset,
+                              "Invalid object dictionary size: %"PRIu64,
+                              le64toh(o->object.size));
+                        return -EBADMSG;
+                }
+
+                break;
+
+        case OBJECT_BLOOM_FILTER:
+                if (le64toh(o->object.size) <= offsetof(BloomFilterObject, bits)) {
+                        error(offset,
+                              "Invalid object bloom filter size: %"PRIu64,
+                              le64toh(o->object.size));
+                        return -EBADMSG;
+                }
+
+                if (o->bloom_filter.n_functions <= 0) {
+                        error(offset, "Bloom filter without hash functions");
+                        return -EBADMSG;
+                }
+
+                break;
+
+        case OBJECT_REALTIME_INDEX:
+                if ((le64toh(o->object.size) - offsetof(RealtimeIndexObject, items)) % sizeof(le64_t) != 0 ||
+                    le64toh(o->realtime_index.stride) <= 0 ||
+                    DIV_ROUND_UP(le64toh(o->realtime_index.n_entries), le64toh(o->realtime_index.stride)) !=
+                    (le64toh(o->object.size) - offsetof(RealtimeIndexObject, items)) / sizeof(le64_t)) {
+                        error(offset,
+                              "Invalid realtime index: %"PRIu64" entries, stride %"PRIu64", size %"PRIu64,
+                              le64toh(o->realtime_index.n_entries),
+                              le64toh(o->realtime_index.stride),
+                              le64toh(o->object.size));
+                        return -EBADMSG;
+                }
+
+                break;
+
+        case OBJECT_DATA_HASH_TABLE_SEGMENT: {
+                uint64_t n;
+
+                if ((le64toh(o->object.size) - offsetof(DataHashTableSegmentObject, items)) % sizeof(HashItem) != 0 ||
+                    (le64toh(o->object.size) - offsetof(DataHashTableSegmentObject, items)) / sizeof(HashItem) <= 0) {
+                        error(offset,
+                              "Invalid data hash table segment size: %"PRIu64,
+                              le64toh(o->object.size));
+                        return -EBADMSG;
+                }
+
+                n = (le64toh(o->object.size) - offsetof(DataHashTableSegmentObject, items)) / sizeof(HashItem);
+                for (i = 0; i < n; i++) {
+                        const HashItem *item = o->data_hash_table_segment.items + i;
+
+                        if ((item->head_hash_offset != 0 && !VALID64(le64toh(item->head_hash_offset))) ||
+                            (item->tail_hash_offset != 0 && !VALID64(le64toh(item->tail_hash_offset))) ||
+                            (item->head_hash_offset != 0) != (item->tail_hash_offset != 0)) {
+                                error(offset,
+                                      "Invalid data hash table segment item (%"PRIu64"/%"PRIu64"): head_hash_offset="OFSfmt" tail_hash_offset="OFSfmt,
+                                      i, n,
+                                      le64toh(item->head_hash_offset),
+                                      le64toh(item->tail_hash_offset));
+                                return -EBADMSG;
+                        }
+                }
+
+                break;
+        }
         }
 
         return 0;
@@ -577,7 +652,7 @@ static int verify_hash_table(
                 usec_t *last_usec,
                 bool show_progress) {
 
-        uint64_t i, n;
+        uint64_t i, j, n, n_total = 0, k = 0;
         int r;
 
         assert(f);
@@ -594,47 +669,63 @@ static int verify_hash_table(
         if (r < 0)
                 return log_error_errno(r, "Failed to map data hash table: %m");
 
-        for (i = 0; i < n; i++) {
-                uint64_t last = 0, p;
+        for (j = 0; j < f->n_data_hash_tables; j++)
+                n_total += f->data_hash_tables[j].n_items;
 
-                if (show_progress)
-                        draw_progress(0xC000 + scale_progress(0x3FFF, i, n), last_usec);
+        for (j = 0; j < f->n_data_hash_tables; j++) {
+                JournalHashTable *t = f->data_hash_tables + j;
+                uint64_t n_linked = 0;
 
-                p = le64toh(f->data_hash_table[i].head_hash_offset);
-                while (p != 0) {
-                        Object *o;
-                        uint64_t next;
+                n = t->n_items;
 
-                        if (!contains_uint64(f->mmap, cache_data_fd, n_data, p)) {
-                                error(p, "Invalid data object at hash entry %"PRIu64" of %"PRIu64, i, n);
-                                return -EBADMSG;
-                        }
+                for (i = 0; i < n; i++, k++) {
+                        uint64_t last = 0, p;
 
-                        r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
-                        if (r < 0)
-                                return r;
+                        if (show_progress)
+                                draw_progress(0xC000 + scale_progress(0x3FFF, k, n_total), last_usec);
 
-                        next = le64toh(o->data.next_hash_offset);
-                        if (next != 0 && next <= p) {
-                                error(p, "Hash chain has a cycle in hash entry %"PRIu64" of %"PRIu64, i, n);
-                                return -EBADMSG;
+                        p = le64toh(t->items[i].head_hash_offset);
+                        while (p != 0) {
+                                Object *o;
+                                uint64_t next;
+
+                                if (!contains_uint64(f->mmap, cache_data_fd, n_data, p)) {
+                                        error(p, "Invalid data object at hash entry %"PRIu64" of %"PRIu64, i, n);
+                                        return -EBADMSG;
+                                }
+
+                                r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+                                if (r < 0)
+                                        return r;
+
+                                next = le64toh(o->data.next_hash_offset);
+                                if (next != 0 && next <= p) {
+                                        error(p, "Hash chain has a cycle in hash entry %"PRIu64" of %"PRIu64, i, n);
+                                        return -EBADMSG;
+                                }
+
+                                if (le64toh(o->data.hash) % n != i) {
+                                        error(p, "Hash value mismatch in hash entry %"PRIu64" of %"PRIu64, i, n);
+                                        return -EBADMSG;
+                                }
+
+                                r = verify_data(f, o, p, cache_entry_fd, n_entries, cache_entry_array_fd, n_entry_arrays);
+                                if (r < 0)
+                                        return r;
+
+                                n_linked++;
+                                last = p;
+                                p = next;
                         }
 
-                        if (le64toh(o->data.hash) % n != i) {
-                                error(p, "Hash value mismatch in hash entry %"PRIu64" of %"PRIu64, i, n);
+                        if (last != le64toh(t->items[i].tail_hash_offset)) {
+                                error(p, "Tail hash pointer mismatch in hash table");
                                 return -EBADMSG;
                         }
-
-                        r = verify_data(f, o, p, cache_entry_fd, n_entries, cache_entry_array_fd, n_entry_arrays);
-                        if (r < 0)
-                                return r;
-
-                        last = p;
-                        p = next;
                 }
 
-                if (last != le64toh(f->data_hash_table[i].tail_hash_offset)) {
-                        error(p, "Tail hash pointer mismatch in hash table");
+                if (t->segment && le64toh(t->segment->n_data) != n_linked) {
+                        error(t->segment_offset, "Data object number mismatch in hash table segment");
                         return -EBADMSG;
                 }
         }
@@ -644,6 +735,7 @@ static int verify_hash_table(
 
 static int data_object_in_hash_table(JournalFile *f, uint64_t hash, uint64_t p) {
         uint64_t n, h, q;
+        size_t j;
         int r;
         assert(f);
 
@@ -655,20 +747,24 @@ static int data_object_in_hash_table(JournalFile *f, uint64_t hash, uint64_t p)
         if (r < 0)
                 return log_error_errno(r, "Failed to map data hash table: %m");
 
-        h = hash % n;
+        for (j = 0; j < f->n_data_hash_tables; j++) {
+                JournalHashTable *t = f->data_hash_tables + j;
 
-        q = le64toh(f->data_hash_table[h].head_hash_offset);
-        while (q != 0) {
-                Object *o;
+                h = hash % t->n_items;
 
-                if (p == q)
-                        return 1;
+                q = le64toh(t->items[h].head_hash_offset);
+                while (q != 0) {
+                        Object *o;
 
-                r = journal_file_move_to_object(f, OBJECT_DATA, q, &o);
-                if (r < 0)
-                        return r;
+                        if (p == q)
+                                return 1;
+
+                        r = journal_file_move_to_object(f, OBJECT_DATA, q, &o);
+                        if (r < 0)
+                                return r;
 
-                q = le64toh(o->data.next_hash_offset);
+                        q = le64toh(o->data.next_hash_offset);
+                }
         }
 
         return 0;
@@ -819,7 +915,8 @@ int journal_file_verify(
         int data_fd = -1, entry_fd = -1, entry_array_fd = -1;
         MMapFileDescriptor *cache_data_fd = NULL, *cache_entry_fd = NULL, *cache_entry_array_fd = NULL;
         unsigned i;
-        bool found_last = false;
+        bool found_last = false, found_dictionary = false, found_bloom_filter = false, found_realtime_index = false;
+        uint64_t last_data_hash_table_segment = 0;
         const char *tmp_dir = NULL;
 
 #if HAVE_GCRYPT
@@ -928,8 +1025,7 @@ int journal_file_verify(
                         goto fail;
                 }
 
-                if ((o->object.flags & OBJECT_COMPRESSED_XZ) &&
-                    (o->object.flags & OBJECT_COMPRESSED_LZ4)) {
+                if (__builtin_popcount(o->object.flags & OBJECT_COMPRESSION_MASK) > 1) {
                         error(p, "Objected with double compression");
                         r = -EINVAL;
                         goto fail;
@@ -947,6 +1043,12 @@ int journal_file_verify(
                         goto fail;
                 }
 
+                if ((o->object.flags & OBJECT_COMPRESSED_ZSTD) && !JOURNAL_HEADER_COMPRESSED_ZSTD(f->header)) {
+                        error(p, "ZSTD compressed object in file without ZSTD compression");
+                        r = -EBADMSG;
+                        goto fail;
+                }
+
                 switch (o->object.type) {
 
                 case OBJECT_DATA:
@@ -1160,6 +1262,71 @@ int journal_file_verify(
                         n_tags++;
                         break;
 
+                case OBJECT_DICTIONARY:
+                        if (!JOURNAL_HEADER_ZSTD_DICTIONARY(f->header) ||
+                            !JOURNAL_HEADER_CONTAINS(f->header, dictionary_offset) ||
+                            le64toh(f->header->dictionary_offset) != p) {
+                                error(p, "Dictionary object not referenced by header");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        found_dictionary = true;
+                        break;
+
+                case OBJECT_BLOOM_FILTER:
+                        if (!JOURNAL_HEADER_BLOOM_FILTER(f->header) ||
+                            !JOURNAL_HEADER_CONTAINS(f->header, bloom_filter_offset) ||
+                            le64toh(f->header->bloom_filter_offset) != p) {
+                                error(p, "Bloom filter object not referenced by header");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        if (le64toh(o->bloom_filter.n_items) != le64toh(f->header->n_data)) {
+                                error(p, "Bloom filter item count mismatch");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        found_bloom_filter = true;
+                        break;
+
+                case OBJECT_REALTIME_INDEX:
+                        if (!JOURNAL_HEADER_REALTIME_INDEX(f->header) ||
+                            !JOURNAL_HEADER_CONTAINS(f->header, realtime_index_offset) ||
+                            le64toh(f->header->realtime_index_offset) != p) {
+                                error(p, "Realtime index object not referenced by header");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        if (le64toh(o->realtime_index.n_entries) != le64toh(f->header->n_entries)) {
+                                error(p, "Realtime index entry count mismatch");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        found_realtime_index = true;
+                        break;
+
+                case OBJECT_DATA_HASH_TABLE_SEGMENT:
+                        if (!JOURNAL_HEADER_EXTENSIBLE_HASH_TABLE(f->header) ||
+                            !JOURNAL_HEADER_CONTAINS(f->header, data_hash_table_segment_offset)) {
+                                error(p, "Data hash table segment in file without extensible hash table");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        if (le64toh(o->data_hash_table_segment.previous_offset) != last_data_hash_table_segment) {
+                                error(p, "Data hash table segment not linked to the previous one");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        last_data_hash_table_segment = p;
+                        break;
+
                 default:
                         n_weird++;
                 }
@@ -1178,6 +1345,31 @@ int journal_file_verify(
                 goto fail;
         }
 
+        if (JOURNAL_HEADER_CONTAINS(f->header, data_hash_table_segment_offset) &&
+            le64toh(f->header->data_hash_table_segment_offset) != last_data_hash_table_segment) {
+                error(offsetof(Header, data_hash_table_segment_offset), "Data hash table segment pointer dead");
+                r = -EBADMSG;
+                goto fail;
+        }
+
+        if (JOURNAL_HEADER_ZSTD_DICTIONARY(f->header) && !found_dictionary) {
+                error(offsetof(Header, incompatible_flags), "Dictionary object missing");
+                r = -EBADMSG;
+                goto fail;
+        }
+
+        if (JOURNAL_HEADER_REALTIME_INDEX(f->header) && !found_realtime_index) {
+                error(offsetof(Header, compatible_flags), "Realtime index object missing");
+                r = -EBADMSG;
+                goto fail;
+        }
+
+        if (JOURNAL_HEADER_BLOOM_FILTER(f->header) && !found_bloom_filter) {
+                error(offsetof(Header, compatible_flags), "Bloom filter object missing");
+                r = -EBADMSG;
+                goto fail;
+        }
+
         if (n_objects != le64toh(f->header->n_objects)) {
                 error(offsetof(Header, n_objects), "Object number mismatch");
                 r = -EBADMSG;
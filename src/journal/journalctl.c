@@ -55,6 +55,7 @@
 #include "pager.h"
 #include "parse-util.h"
 #include "path-util.h"
+#include "process-util.h"
 #include "rlimit-util.h"
 #include "set.h"
 #include "sigbus.h"
@@ -1224,6 +1225,73 @@ static int discover_next_boot(sd_journal *j,
         return 0;
 }
 
+static int get_boots_from_index(
+                sd_journal *j,
+                BootId **boots,
+                sd_id128_t *boot_id,
+                int offset) {
+
+        _cleanup_free_ JournalBoot *all = NULL;
+        BootId *head = NULL, *tail = NULL;
+        size_t n, k;
+        ssize_t idx;
+        int r;
+
+        assert(j);
+
+        /* Same as get_boots() below, but uses the boot summaries of the journal files, instead of seeking
+         * through the entries boot by boot. */
+
+        r = journal_get_boots(j, &all, &n);
+        if (r < 0)
+                return r;
+
+        if (!boot_id) {
+                for (k = 0; k < n; k++) {
+                        BootId *current;
+
+                        current = new0(BootId, 1);
+                        if (!current) {
+                                boot_id_free_all(head);
+                                return -ENOMEM;
+                        }
+
+                        current->id = all[k].boot_id;
+                        current->first = all[k].first_realtime;
+                        current->last = all[k].last_realtime;
+
+                        LIST_INSERT_AFTER(boot_list, head, tail, current);
+                        tail = current;
+                }
+
+                if (boots)
+                        *boots = head;
+                else
+                        boot_id_free_all(head);
+
+                return (int) n;
+        }
+
+        if (sd_id128_is_null(*boot_id))
+                /* Offset 0 is the last boot, while 1 is the first one */
+                idx = offset <= 0 ? (ssize_t) n - 1 + offset : offset - 1;
+        else {
+                for (k = 0; k < n; k++)
+                        if (sd_id128_equal(all[k].boot_id, *boot_id))
+                                break;
+                if (k >= n)
+                        return 0;
+
+                idx = (ssize_t) k + offset;
+        }
+
+        if (idx < 0 || (size_t) idx >= n)
+                return 0;
+
+        *boot_id = all[idx].boot_id;
+        return 1;
+}
+
 static int get_boots(
                 sd_journal *j,
                 BootId **boots,
@@ -1238,6 +1306,10 @@ static int get_boots(
 
         assert(j);
 
+        r = get_boots_from_index(j, boots, boot_id, offset);
+        if (r != -EOPNOTSUPP)
+                return r;
+
         /* Adjust for the asymmetry that offset 0 is
          * the last (and current) boot, while 1 is considered the
          * (chronological) first boot in the journal. */
@@ -1869,48 +1941,186 @@ finish:
 #endif
 }
 
+typedef struct VerifyResult {
+        int error;
+        usec_t first, validated, last;
+} VerifyResult;
+
+typedef struct VerifyJob {
+        pid_t pid;
+        int fd;
+} VerifyJob;
+
+static int verify_report(JournalFile *f, const VerifyResult *v) {
+        char a[FORMAT_TIMESTAMP_MAX], b[FORMAT_TIMESTAMP_MAX], c[FORMAT_TIMESPAN_MAX];
+
+        assert(f);
+        assert(v);
+
+        if (v->error == -EINVAL)
+                return v->error;
+        if (v->error < 0)
+                return log_warning_errno(v->error, "FAIL: %s (%m)", f->path);
+
+        log_info("PASS: %s", f->path);
+
+        if (arg_verify_key && JOURNAL_HEADER_SEALED(f->header)) {
+                if (v->validated > 0) {
+                        log_info("=> Validated from %s to %s, final %s entries not sealed.",
+                                 format_timestamp_maybe_utc(a, sizeof(a), v->first),
+                                 format_timestamp_maybe_utc(b, sizeof(b), v->validated),
+                                 format_timespan(c, sizeof(c), v->last > v->validated ? v->last - v->validated : 0, 0));
+                } else if (v->last > 0)
+                        log_info("=> No sealing yet, %s of entries not sealed.",
+                                 format_timespan(c, sizeof(c), v->last - v->first, 0));
+                else
+                        log_info("=> No sealing yet, no entries in file.");
+        }
+
+        return 0;
+}
+
+static int verify_job_start(JournalFile *f, VerifyJob *job) {
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        pid_t pid;
+        int r;
+
+        assert(f);
+        assert(job);
+
+        if (pipe2(pair, O_CLOEXEC) < 0)
+                return log_error_errno(errno, "Failed to create pipe: %m");
+
+        /* The SIGBUS handler is deliberately kept, truncated files must be reported, not crash the child */
+        r = safe_fork("(journal-verify)", FORK_DEATHSIG|FORK_LOG, &pid);
+        if (r < 0)
+                return r;
+        if (r == 0) {
+                VerifyResult v = {};
+
+                pair[0] = safe_close(pair[0]);
+
+                v.error = journal_file_verify(f, arg_verify_key, &v.first, &v.validated, &v.last, false);
+
+                r = loop_write(pair[1], &v, sizeof(v), false);
+                _exit(r < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+        }
+
+        pair[1] = safe_close(pair[1]);
+
+        job->pid = pid;
+        job->fd = TAKE_FD(pair[0]);
+
+        return 0;
+}
+
+static void verify_job_finish(VerifyJob *job, VerifyResult *ret) {
+        int r;
+
+        assert(job);
+        assert(ret);
+
+        r = loop_read_exact(job->fd, ret, sizeof(*ret), false);
+        if (r < 0) {
+                /* The child died before reporting anything, most likely the file is damaged in a way that
+                 * journal_file_verify() didn't cope with. */
+                *ret = (VerifyResult) { .error = -EBADMSG };
+                log_debug_errno(r, "Failed to read verification result: %m");
+        }
+
+        (void) wait_for_terminate_and_check("(journal-verify)", job->pid, WAIT_LOG);
+
+        job->fd = safe_close(job->fd);
+        job->pid = 0;
+}
+
+static void verify_jobs_kill(VerifyJob *jobs, size_t n_jobs) {
+        size_t i;
+
+        for (i = 0; i < n_jobs; i++) {
+                if (jobs[i].pid > 0)
+                        sigkill_wait(jobs[i].pid);
+
+                jobs[i].fd = safe_close(jobs[i].fd);
+                jobs[i].pid = 0;
+        }
+}
+
 static int verify(sd_journal *j) {
-        int r = 0;
-        Iterator i;
+        _cleanup_free_ JournalFile **files = NULL;
+        _cleanup_free_ VerifyJob *jobs = NULL;
+        size_t n_files = 0, n_jobs, started, done;
         JournalFile *f;
+        Iterator i;
+        long ncpus;
+        int r = 0, k;
 
         assert(j);
 
         log_show_color(true);
 
-        ORDERED_HASHMAP_FOREACH(f, j->files, i) {
-                int k;
-                usec_t first = 0, validated = 0, last = 0;
+        files = new(JournalFile*, ordered_hashmap_size(j->files));
+        if (!files)
+                return log_oom();
 
+        ORDERED_HASHMAP_FOREACH(f, j->files, i) {
 #if HAVE_GCRYPT
                 if (!arg_verify_key && JOURNAL_HEADER_SEALED(f->header))
                         log_notice("Journal file %s has sealing enabled but verification key has not been passed using --verify-key=.", f->path);
 #endif
 
-                k = journal_file_verify(f, arg_verify_key, &first, &validated, &last, true);
+                files[n_files++] = f;
+        }
+
+        /* Files are independent of each other, hence verify several of them at once, each in a child process
+         * of its own, since the mmap cache shared between the files is not thread-safe. The results are
+         * passed back to us and reported in the original order. */
+        ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_jobs = MIN(n_files, ncpus > 0 ? (size_t) ncpus : 1);
+
+        if (n_jobs <= 1) {
+                for (done = 0; done < n_files; done++) {
+                        VerifyResult v = {};
+
+                        v.error = journal_file_verify(files[done], arg_verify_key, &v.first, &v.validated, &v.last, true);
+
+                        k = verify_report(files[done], &v);
+                        if (k == -EINVAL) /* If the key was invalid give up right-away. */
+                                return k;
+                        if (k < 0)
+                                r = k;
+                }
+
+                return r;
+        }
+
+        jobs = new(VerifyJob, n_jobs);
+        if (!jobs)
+                return log_oom();
+
+        for (started = 0; started < n_jobs; started++)
+                jobs[started] = (VerifyJob) { .fd = -1 };
+
+        for (started = 0, done = 0; done < n_files; done++) {
+                VerifyResult v;
+
+                for (; started < n_files && started < done + n_jobs; started++) {
+                        k = verify_job_start(files[started], jobs + started % n_jobs);
+                        if (k < 0) {
+                                verify_jobs_kill(jobs, n_jobs);
+                                return k;
+                        }
+                }
+
+                verify_job_finish(jobs + done % n_jobs, &v);
+
+                k = verify_report(files[done], &v);
                 if (k == -EINVAL) {
-                        /* If the key was invalid give up right-away. */
+                        verify_jobs_kill(jobs, n_jobs);
                         return k;
-                } else if (k < 0) {
-                        log_warning_errno(k, "FAIL: %s (%m)", f->path);
-                        r = k;
-                } else {
-                        char a[FORMAT_TIMESTAMP_MAX], b[FORMAT_TIMESTAMP_MAX], c[FORMAT_TIMESPAN_MAX];
-                        log_info("PASS: %s", f->path);
-
-                        if (arg_verify_key && JOURNAL_HEADER_SEALED(f->header)) {
-                                if (validated > 0) {
-                                        log_info("=> Validated from %s to %s, final %s entries not sealed.",
-                                                 format_timestamp_maybe_utc(a, sizeof(a), first),
-                                                 format_timestamp_maybe_utc(b, sizeof(b), validated),
-                                                 format_timespan(c, sizeof(c), last > validated ? last - validated : 0, 0));
-                                } else if (last > 0)
-                                        log_info("=> No sealing yet, %s of entries not sealed.",
-                                                 format_timespan(c, sizeof(c), last - first, 0));
-                                else
-                                        log_info("=> No sealing yet, no entries in file.");
-                        }
                 }
+                if (k < 0)
+                        r = k;
         }
 
         return r;
@@ -0,0 +1,472 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "alloc-util.h"
+#include "compress.h"
+#include "fd-util.h"
+#include "io-util.h"
+#include "journald-compress.h"
+#include "journald-server.h"
+#include "list.h"
+#include "log.h"
+
+/* Compressing large fields is the most expensive part of writing an entry, hence we optionally hand it off to
+ * a few worker threads. Everything else, i.e. all accesses to the journal files, stays on the event loop: entries
+ * are queued in the order they were received, their large fields are compressed by the workers, and the entries
+ * are then written out from the head of the queue, in order, once all their fields are ready. */
+
+#define COMPRESS_THREADS_MAX 16U
+
+/* Don't let the queue grow without bounds if the workers can't keep up */
+#define COMPRESS_QUEUE_MAX 1024U
+
+typedef struct PendingEntry PendingEntry;
+
+struct PendingEntry {
+        uid_t uid;
+        int priority;
+        dual_timestamp ts;
+
+        struct iovec *iovec;
+        CompressedField *compressed;
+        size_t n;
+        void *buffer;
+
+        int compression;
+        uint64_t threshold;
+
+        size_t next_field; /* the next field to look at for a worker */
+        size_t n_left;     /* the number of fields that are not compressed yet */
+
+        LIST_FIELDS(PendingEntry, entries);
+};
+
+struct CompressWorkers {
+        Server *server;
+
+        pthread_t *threads;
+        unsigned n_threads;
+
+        pthread_mutex_t mutex;
+        pthread_cond_t work_cond; /* signalled when new fields are queued, or on shutdown */
+        pthread_cond_t done_cond; /* signalled when an entry is ready to be written */
+        bool quit;
+
+        int event_fd;
+        sd_event_source *event_source;
+
+        /* Set while entries are written out, see compress_workers_commit() */
+        bool committing;
+
+        /* Everything below is protected by the mutex */
+        LIST_HEAD(PendingEntry, entries);
+        PendingEntry *entries_tail;
+        unsigned n_entries;
+};
+
+static PendingEntry* pending_entry_free(PendingEntry *e) {
+        size_t i;
+
+        if (!e)
+                return NULL;
+
+        if (e->compressed)
+                for (i = 0; i < e->n; i++)
+                        compressed_field_done(e->compressed + i);
+
+        free(e->compressed);
+        free(e->iovec);
+        free(e->buffer);
+
+        return mfree(e);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(PendingEntry*, pending_entry_free);
+
+static PendingEntry* pending_entry_new(
+                Server *s,
+                uid_t uid,
+                const struct iovec *iovec,
+                size_t n,
+                const CompressedField *hashes,
+                size_t n_hashes,
+                const dual_timestamp *ts,
+                int priority) {
+
+        _cleanup_(pending_entry_freep) PendingEntry *e = NULL;
+        uint8_t *p;
+        size_t i;
+
+        e = new0(PendingEntry, 1);
+        if (!e)
+                return NULL;
+
+        e->uid = uid;
+        e->priority = priority;
+        e->ts = *ts;
+        e->n = n;
+
+        e->compression = DEFAULT_COMPRESSION;
+        e->threshold = s->compress.threshold_bytes == (uint64_t) -1 ?
+                DEFAULT_COMPRESS_THRESHOLD :
+                MAX(MIN_COMPRESS_THRESHOLD, s->compress.threshold_bytes);
+
+        e->iovec = new(struct iovec, n);
+        e->compressed = new0(CompressedField, n);
+        e->buffer = malloc(MAX(IOVEC_TOTAL_SIZE(iovec, n), (size_t) 1));
+        if (!e->iovec || !e->compressed || !e->buffer)
+                return NULL;
+
+        /* The caller's iovec typically points into stack buffers and the per-client context, hence copy all
+         * fields into one buffer of our own */
+        for (i = 0, p = e->buffer; i < n; i++) {
+                e->iovec[i] = IOVEC_MAKE(p, iovec[i].iov_len);
+                p = mempcpy(p, iovec[i].iov_base, iovec[i].iov_len);
+
+                if (s->compress.enabled && iovec[i].iov_len >= e->threshold)
+                        e->n_left++;
+                else if (i >= n - n_hashes && hashes[i - (n - n_hashes)].hashed)
+                        /* Fields the workers compress are hashed by them anyway */
+                        e->compressed[i] = (CompressedField) {
+                                .hash = hashes[i - (n - n_hashes)].hash,
+                                .hashed = true,
+                        };
+        }
+
+        return TAKE_PTR(e);
+}
+
+static bool pending_entry_next_field(PendingEntry *e, size_t *ret) {
+        assert(e);
+        assert(ret);
+
+        while (e->next_field < e->n) {
+                size_t i = e->next_field++;
+
+                if (e->iovec[i].iov_len >= e->threshold) {
+                        *ret = i;
+                        return true;
+                }
+        }
+
+        return false;
+}
+
+static bool compress_workers_next_job(CompressWorkers *w, PendingEntry **ret, size_t *ret_field) {
+        PendingEntry *e;
+
+        LIST_FOREACH(entries, e, w->entries)
+                if (e->n_left > 0 && pending_entry_next_field(e, ret_field)) {
+                        *ret = e;
+                        return true;
+                }
+
+        return false;
+}
+
+static void* compress_worker(void *p) {
+        CompressWorkers *w = p;
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        for (;;) {
+                PendingEntry *e;
+                CompressedField c;
+                size_t i;
+
+                while (!w->quit && !compress_workers_next_job(w, &e, &i))
+                        assert_se(pthread_cond_wait(&w->work_cond, &w->mutex) == 0);
+                if (w->quit)
+                        break;
+
+                /* The field data is not touched by anybody else until the entry is complete, hence we can
+                 * compress it without holding the lock */
+                assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+                if (compressed_field_compress(&c, e->compression, e->iovec[i].iov_base, e->iovec[i].iov_len) < 0)
+                        c = (CompressedField) {}; /* On OOM the field is simply compressed on the event loop */
+
+                assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+                e->compressed[i] = c;
+
+                assert(e->n_left > 0);
+                if (--e->n_left == 0) {
+                        assert_se(pthread_cond_broadcast(&w->done_cond) == 0);
+
+                        if (e == w->entries)
+                                (void) eventfd_write(w->event_fd, 1);
+                }
+        }
+
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        return NULL;
+}
+
+static void compress_workers_commit(CompressWorkers *w, bool wait) {
+        PendingEntry *e;
+
+        assert(w);
+
+        /* Writes out all entries at the head of the queue whose fields are ready. If wait is true, waits for
+         * the workers until the queue is empty.
+         *
+         * Writing an entry may request a sync, and a sync writes out the queue first, i.e. calls us again.
+         * Such syncs are deferred while we are at it, see server_sync_now(), and done by our callers
+         * afterwards, see compress_workers_sync_deferred(). */
+
+        if (w->committing)
+                return;
+
+        w->committing = true;
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        for (;;) {
+                e = w->entries;
+                if (!e)
+                        break;
+
+                if (e->n_left > 0) {
+                        if (!wait)
+                                break;
+
+                        assert_se(pthread_cond_wait(&w->done_cond, &w->mutex) == 0);
+                        continue;
+                }
+
+                LIST_REMOVE(entries, w->entries, e);
+                if (w->entries_tail == e)
+                        w->entries_tail = NULL;
+                w->n_entries--;
+
+                assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+                server_write_entry(w->server, e->uid, e->iovec, e->n, &e->ts, e->priority, e->compressed, e->n);
+                pending_entry_free(e);
+
+                assert_se(pthread_mutex_lock(&w->mutex) == 0);
+        }
+
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        w->committing = false;
+}
+
+static void compress_workers_sync_deferred(CompressWorkers *w) {
+        Server *s;
+
+        assert(w);
+
+        s = w->server;
+
+        /* Do the sync the entries we wrote out requested, unless the batch we are called from does it */
+        if (s->sync_requested && !s->dispatching_batch) {
+                s->sync_requested = false;
+                server_sync(s);
+        }
+}
+
+static int dispatch_compress_done(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        CompressWorkers *w = userdata;
+
+        assert(w);
+        assert(fd == w->event_fd);
+
+        (void) flush_fd(fd);
+        compress_workers_commit(w, false);
+        compress_workers_sync_deferred(w);
+
+        return 0;
+}
+
+bool server_compress_queue(
+                Server *s,
+                uid_t uid,
+                const struct iovec *iovec,
+                size_t n,
+                const CompressedField *hashes,
+                size_t n_hashes,
+                const dual_timestamp *ts,
+                int priority) {
+
+        CompressWorkers *w;
+        PendingEntry *e;
+        bool ready;
+
+        assert(s);
+        assert(iovec || n == 0);
+        assert(hashes || n_hashes == 0);
+        assert(n_hashes <= n);
+        assert(ts);
+
+        /* Returns true if the entry has been queued, and false if the caller shall write it out right away */
+
+        w = s->compress_workers;
+        if (!w)
+                return false;
+
+        if (w->n_entries >= COMPRESS_QUEUE_MAX) {
+                compress_workers_commit(w, true);
+                compress_workers_sync_deferred(w);
+        }
+
+        e = pending_entry_new(s, uid, iovec, n, hashes, n_hashes, ts, priority);
+        if (!e) {
+                /* Keep the order of entries, even if that means we have to wait for the workers */
+                log_oom();
+                compress_workers_commit(w, true);
+                compress_workers_sync_deferred(w);
+                return false;
+        }
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        /* Nothing to compress and nothing in front of us? Then write it out directly. */
+        if (e->n_left == 0 && !w->entries) {
+                assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+                pending_entry_free(e);
+                return false;
+        }
+
+        LIST_INSERT_AFTER(entries, w->entries, w->entries_tail, e);
+        w->entries_tail = e;
+        w->n_entries++;
+
+        /* An entry queued behind others stays there until those are written */
+        ready = e->n_left == 0 && w->entries == e;
+
+        if (e->n_left > 0)
+                assert_se(pthread_cond_broadcast(&w->work_cond) == 0);
+
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        if (ready) {
+                compress_workers_commit(w, false);
+                compress_workers_sync_deferred(w);
+        }
+
+        return true;
+}
+
+void server_compress_flush(Server *s) {
+        assert(s);
+
+        /* Syncs requested by the entries written here are left to the caller, see server_sync() */
+        if (s->compress_workers)
+                compress_workers_commit(s->compress_workers, true);
+}
+
+bool server_compress_committing(Server *s) {
+        assert(s);
+
+        return s->compress_workers && s->compress_workers->committing;
+}
+
+int server_compress_setup(Server *s) {
+        _cleanup_free_ CompressWorkers *w = NULL;
+        unsigned n_threads;
+        int r;
+
+        assert(s);
+        assert(!s->compress_workers);
+
+        if (s->compress_threads == 0 || !s->compress.enabled || DEFAULT_COMPRESSION == 0)
+                return 0;
+
+        n_threads = MIN(s->compress_threads, COMPRESS_THREADS_MAX);
+
+        w = new0(CompressWorkers, 1);
+        if (!w)
+                return log_oom();
+
+        w->server = s;
+        w->threads = new(pthread_t, n_threads);
+        if (!w->threads)
+                return log_oom();
+
+        w->event_fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+        if (w->event_fd < 0) {
+                r = log_error_errno(errno, "Failed to create eventfd for compression workers: %m");
+                goto fail;
+        }
+
+        r = sd_event_add_io(s->event, &w->event_source, w->event_fd, EPOLLIN, dispatch_compress_done, w);
+        if (r < 0) {
+                log_error_errno(r, "Failed to add compression worker event source: %m");
+                goto fail;
+        }
+
+        /* Write out finished entries before reading in new ones */
+        r = sd_event_source_set_priority(w->event_source, SD_EVENT_PRIORITY_NORMAL);
+        if (r < 0) {
+                log_error_errno(r, "Failed to adjust compression worker event source priority: %m");
+                goto fail;
+        }
+
+        assert_se(pthread_mutex_init(&w->mutex, NULL) == 0);
+        assert_se(pthread_cond_init(&w->work_cond, NULL) == 0);
+        assert_se(pthread_cond_init(&w->done_cond, NULL) == 0);
+
+        /* The threads inherit our signal mask, which blocks all signals we handle on the event loop */
+        for (; w->n_threads < n_threads; w->n_threads++) {
+                r = pthread_create(w->threads + w->n_threads, NULL, compress_worker, w);
+                if (r > 0) {
+                        log_warning_errno(r, "Failed to start compression worker thread, continuing with %u threads: %m", w->n_threads);
+                        break;
+                }
+        }
+
+        s->compress_workers = TAKE_PTR(w);
+
+        if (s->compress_workers->n_threads == 0) {
+                server_compress_done(s);
+                return -EAGAIN;
+        }
+
+        log_debug("Started %u compression worker threads.", s->compress_workers->n_threads);
+        return 0;
+
+fail:
+        sd_event_source_unref(w->event_source);
+        safe_close(w->event_fd);
+        free(w->threads);
+        return r;
+}
+
+void server_compress_done(Server *s) {
+        CompressWorkers *w;
+        unsigned i;
+
+        assert(s);
+
+        w = s->compress_workers;
+        if (!w)
+                return;
+
+        /* Write out everything that is still queued, then stop the workers */
+        compress_workers_commit(w, true);
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+        w->quit = true;
+        assert_se(pthread_cond_broadcast(&w->work_cond) == 0);
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        for (i = 0; i < w->n_threads; i++)
+                (void) pthread_join(w->threads[i], NULL);
+
+        assert(!w->entries);
+
+        pthread_cond_destroy(&w->done_cond);
+        pthread_cond_destroy(&w->work_cond);
+        pthread_mutex_destroy(&w->mutex);
+
+        sd_event_source_unref(w->event_source);
+        safe_close(w->event_fd);
+        free(w->threads);
+
+        s->compress_workers = mfree(w);
+}
@@ -0,0 +1,13 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+typedef struct CompressWorkers CompressWorkers;
+
+#include "journald-server.h"
+
+int server_compress_setup(Server *s);
+void server_compress_done(Server *s);
+
+bool server_compress_queue(Server *s, uid_t uid, const struct iovec *iovec, size_t n, const CompressedField *hashes, size_t n_hashes, const dual_timestamp *ts, int priority);
+void server_compress_flush(Server *s);
+bool server_compress_committing(Server *s);
@@ -5,6 +5,8 @@
   Copyright 2017 Lennart Poettering
 ***/
 
+#include <sys/inotify.h>
+
 #if HAVE_SELINUX
 #include <selinux/selinux.h>
 #endif
@@ -18,6 +20,8 @@
 #include "io-util.h"
 #include "journal-util.h"
 #include "journald-context.h"
+#include "lookup3.h"
+#include "parse-util.h"
 #include "process-util.h"
 #include "string-util.h"
 #include "syslog-util.h"
@@ -110,8 +114,8 @@ static int client_context_new(Server *s, pid_t pid, ClientContext **ret) {
         c->owner_uid = UID_INVALID;
         c->lru_index = PRIOQ_IDX_NULL;
         c->timestamp = USEC_INFINITY;
-        c->extra_fields_mtime = NSEC_INFINITY;
         c->log_level_max = -1;
+        c->log_rate_limit_bytes = 0;
 
         r = hashmap_put(s->client_contexts, PID_TO_PTR(pid), c);
         if (r < 0) {
@@ -123,7 +127,10 @@ static int client_context_new(Server *s, pid_t pid, ClientContext **ret) {
         return 0;
 }
 
-static void client_context_reset(ClientContext *c) {
+static ClientUnit* client_unit_unref(Server *s, ClientUnit *u);
+
+static void client_context_reset(Server *s, ClientContext *c) {
+        assert(s);
         assert(c);
 
         c->timestamp = USEC_INFINITY;
@@ -152,12 +159,12 @@ static void client_context_reset(ClientContext *c) {
         c->label = mfree(c->label);
         c->label_size = 0;
 
-        c->extra_fields_iovec = mfree(c->extra_fields_iovec);
-        c->extra_fields_n_iovec = 0;
-        c->extra_fields_data = mfree(c->extra_fields_data);
-        c->extra_fields_mtime = NSEC_INFINITY;
-
         c->log_level_max = -1;
+        c->log_rate_limit_bytes = 0;
+
+        c->unit_info = client_unit_unref(s, c->unit_info);
+
+        c->fields = mfree(c->fields);
 }
 
 static ClientContext* client_context_free(Server *s, ClientContext *c) {
@@ -171,7 +178,7 @@ static ClientContext* client_context_free(Server *s, ClientContext *c) {
         if (c->in_lru)
                 assert_se(prioq_remove(s->client_contexts_lru, c, &c->lru_index) >= 0);
 
-        client_context_reset(c);
+        client_context_reset(s, c);
 
         return mfree(c);
 }
@@ -296,42 +303,31 @@ static int client_context_read_cgroup(Server *s, ClientContext *c, const char *u
         return 0;
 }
 
-static int client_context_read_invocation_id(
-                Server *s,
-                ClientContext *c) {
-
+static int client_unit_read_invocation_id(ClientUnit *u) {
         _cleanup_free_ char *value = NULL;
         const char *p;
         int r;
 
-        assert(s);
-        assert(c);
+        assert(u);
 
         /* Read the invocation ID of a unit off a unit. PID 1 stores it in a per-unit symlink in /run/systemd/units/ */
 
-        if (!c->unit)
-                return 0;
-
-        p = strjoina("/run/systemd/units/invocation:", c->unit);
+        p = strjoina("/run/systemd/units/invocation:", u->id);
         r = readlink_malloc(p, &value);
         if (r < 0)
                 return r;
 
-        return sd_id128_from_string(value, &c->invocation_id);
+        return sd_id128_from_string(value, &u->invocation_id);
 }
 
-static int client_context_read_log_level_max(
-                Server *s,
-                ClientContext *c) {
-
+static int client_unit_read_log_level_max(ClientUnit *u) {
         _cleanup_free_ char *value = NULL;
         const char *p;
         int r, ll;
 
-        if (!c->unit)
-                return 0;
+        assert(u);
 
-        p = strjoina("/run/systemd/units/log-level-max:", c->unit);
+        p = strjoina("/run/systemd/units/log-level-max:", u->id);
         r = readlink_malloc(p, &value);
         if (r < 0)
                 return r;
@@ -340,13 +336,41 @@ static int client_context_read_log_level_max(
         if (ll < 0)
                 return -EINVAL;
 
-        c->log_level_max = ll;
+        u->log_level_max = ll;
         return 0;
 }
 
-static int client_context_read_extra_fields(
-                Server *s,
-                ClientContext *c) {
+static int client_unit_read_log_rate_limit_bytes(ClientUnit *u) {
+        _cleanup_free_ char *value = NULL;
+        const char *p;
+        uint64_t bytes;
+        int r;
+
+        assert(u);
+
+        p = strjoina("/run/systemd/units/log-rate-limit-bytes:", u->id);
+        r = readlink_malloc(p, &value);
+        if (r < 0)
+                return r;
+
+        r = safe_atou64(value, &bytes);
+        if (r < 0)
+                return r;
+
+        u->log_rate_limit_bytes = bytes;
+        return 0;
+}
+
+static void client_unit_free_extra_fields(ClientUnit *u) {
+        assert(u);
+
+        u->extra_fields_iovec = mfree(u->extra_fields_iovec);
+        u->extra_fields_n_iovec = 0;
+        u->extra_fields_data = mfree(u->extra_fields_data);
+        u->extra_fields_mtime = NSEC_INFINITY;
+}
+
+static int client_unit_read_extra_fields(ClientUnit *u) {
 
         size_t size = 0, n_iovec = 0, n_allocated = 0, left;
         _cleanup_free_ struct iovec *iovec = NULL;
@@ -357,27 +381,30 @@ static int client_context_read_extra_fields(
         uint8_t *q;
         int r;
 
-        if (!c->unit)
-                return 0;
+        assert(u);
 
-        p = strjoina("/run/systemd/units/log-extra-fields:", c->unit);
+        p = strjoina("/run/systemd/units/log-extra-fields:", u->id);
 
-        if (c->extra_fields_mtime != NSEC_INFINITY) {
+        if (u->extra_fields_mtime != NSEC_INFINITY) {
                 if (stat(p, &st) < 0) {
-                        if (errno == ENOENT)
+                        if (errno == ENOENT) {
+                                client_unit_free_extra_fields(u);
                                 return 0;
+                        }
 
                         return -errno;
                 }
 
-                if (timespec_load_nsec(&st.st_mtim) == c->extra_fields_mtime)
+                if (timespec_load_nsec(&st.st_mtim) == u->extra_fields_mtime)
                         return 0;
         }
 
         f = fopen(p, "re");
         if (!f) {
-                if (errno == ENOENT)
+                if (errno == ENOENT) {
+                        client_unit_free_extra_fields(u);
                         return 0;
+                }
 
                 return -errno;
         }
@@ -423,17 +450,126 @@ static int client_context_read_extra_fields(
                 left -= n, q += n;
         }
 
-        free(c->extra_fields_iovec);
-        free(c->extra_fields_data);
+        free(u->extra_fields_iovec);
+        free(u->extra_fields_data);
+
+        u->extra_fields_iovec = TAKE_PTR(iovec);
+        u->extra_fields_n_iovec = n_iovec;
+        u->extra_fields_data = TAKE_PTR(data);
+        u->extra_fields_mtime = timespec_load_nsec(&st.st_mtim);
+
+        return 0;
+}
+
+static ClientUnit* client_unit_unref(Server *s, ClientUnit *u) {
+        assert(s);
+
+        if (!u)
+                return NULL;
+
+        assert(u->n_ref > 0);
+        u->n_ref--;
+        if (u->n_ref > 0)
+                return NULL;
+
+        assert_se(hashmap_remove(s->client_units, u->id) == u);
+
+        client_unit_free_extra_fields(u);
+        free(u->id);
+        return mfree(u);
+}
+
+static int client_unit_get(Server *s, const char *id, ClientUnit **ret) {
+        _cleanup_free_ ClientUnit *u = NULL;
+        int r;
+
+        assert(s);
+        assert(id);
+        assert(ret);
+
+        u = hashmap_get(s->client_units, id);
+        if (u) {
+                u->n_ref++;
+                *ret = TAKE_PTR(u);
+                return 0;
+        }
+
+        r = hashmap_ensure_allocated(&s->client_units, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        u = new0(ClientUnit, 1);
+        if (!u)
+                return -ENOMEM;
+
+        u->id = strdup(id);
+        if (!u->id)
+                return -ENOMEM;
+
+        u->n_ref = 1;
+        u->timestamp = USEC_INFINITY;
+        u->log_level_max = -1;
+        u->extra_fields_mtime = NSEC_INFINITY;
 
-        c->extra_fields_iovec = TAKE_PTR(iovec);
-        c->extra_fields_n_iovec = n_iovec;
-        c->extra_fields_data = TAKE_PTR(data);
-        c->extra_fields_mtime = timespec_load_nsec(&st.st_mtim);
+        r = hashmap_put(s->client_units, u->id, u);
+        if (r < 0) {
+                free(u->id);
+                return r;
+        }
 
+        *ret = TAKE_PTR(u);
         return 0;
 }
 
+static void client_unit_maybe_refresh(Server *s, ClientUnit *u, usec_t timestamp) {
+        assert(s);
+        assert(u);
+
+        /* While we watch /run/systemd/units/ the data is valid until we are told it changed, otherwise we
+         * refresh it like the per-process data. */
+        if (u->timestamp != USEC_INFINITY &&
+            (s->units_inotify_fd >= 0 || u->timestamp + REFRESH_USEC >= timestamp))
+                return;
+
+        u->invocation_id = SD_ID128_NULL;
+        u->log_level_max = -1;
+        u->log_rate_limit_bytes = 0;
+
+        (void) client_unit_read_invocation_id(u);
+        (void) client_unit_read_log_level_max(u);
+        (void) client_unit_read_log_rate_limit_bytes(u);
+        (void) client_unit_read_extra_fields(u);
+
+        u->timestamp = timestamp;
+}
+
+static void client_context_read_unit(Server *s, ClientContext *c, usec_t timestamp) {
+        ClientUnit *u;
+
+        assert(s);
+        assert(c);
+
+        if (!c->unit) {
+                c->unit_info = client_unit_unref(s, c->unit_info);
+                return;
+        }
+
+        /* All processes of a unit share one copy of the unit metadata */
+        if (!c->unit_info || !streq(c->unit_info->id, c->unit)) {
+                if (client_unit_get(s, c->unit, &u) < 0)
+                        return;
+
+                client_unit_unref(s, c->unit_info);
+                c->unit_info = u;
+        }
+
+        client_unit_maybe_refresh(s, c->unit_info, timestamp);
+
+        c->invocation_id = c->unit_info->invocation_id;
+        c->log_level_max = c->unit_info->log_level_max;
+        c->log_rate_limit_bytes = c->unit_info->log_rate_limit_bytes;
+}
+
 static void client_context_really_refresh(
                 Server *s,
                 ClientContext *c,
@@ -457,10 +593,9 @@ static void client_context_really_refresh(
         (void) audit_loginuid_from_pid(c->pid, &c->loginuid);
 
         (void) client_context_read_cgroup(s, c, unit_id);
-        (void) client_context_read_invocation_id(s, c);
-        (void) client_context_read_log_level_max(s, c);
-        (void) client_context_read_extra_fields(s, c);
+        client_context_read_unit(s, c, timestamp);
 
+        c->fields = mfree(c->fields);
         c->timestamp = timestamp;
 
         if (c->in_lru) {
@@ -490,7 +625,7 @@ void client_context_maybe_refresh(
         /* If the data isn't pinned and if the cashed data is older than the upper limit, we flush it out
          * entirely. This follows the logic that as long as an entry is pinned the PID reuse is unlikely. */
         if (c->n_ref == 0 && c->timestamp + MAX_USEC < timestamp) {
-                client_context_reset(c);
+                client_context_reset(s, c);
                 goto refresh;
         }
 
@@ -514,6 +649,94 @@ refresh:
         client_context_really_refresh(s, c, ucred, label, label_size, unit_id, timestamp);
 }
 
+/* The longest field name plus the longest formatted number or ID, and a trailing NUL */
+#define FIELD_SIZE_MAX (STRLEN("_SYSTEMD_INVOCATION_ID=") + SD_ID128_STRING_MAX + 1)
+
+static void fields_add(ClientFields *f, char **p, size_t size) {
+        assert(f);
+        assert(f->n_iovec < N_IOVEC_CONTEXT_FIELDS);
+
+        f->hash[f->n_iovec] = hash64(*p, size);
+        f->iovec[f->n_iovec++] = IOVEC_MAKE(*p, size);
+        *p += size + 1;
+}
+
+#define FIELDS_ADD_NUMERIC(f, p, value, isset, format, field)           \
+        if (isset(value))                                               \
+                fields_add(f, &p, sprintf(p, field "=" format, value))
+
+#define FIELDS_ADD_STRING(f, p, value, field)                           \
+        if (!isempty(value))                                            \
+                fields_add(f, &p, stpcpy(stpcpy(p, field "="), value) - p)
+
+#define FIELDS_ADD_ID128(f, p, value, field)                            \
+        if (!sd_id128_is_null(value)) {                                 \
+                sd_id128_to_string(value, stpcpy(p, field "="));        \
+                fields_add(f, &p, STRLEN(field "=") + SD_ID128_STRING_MAX - 1); \
+        }
+
+#define FIELDS_ADD_SIZED(f, p, value, value_size, field)                \
+        if (value_size > 0) {                                           \
+                char *_e = mempcpy(stpcpy(p, field "="), value, value_size); \
+                *_e = 0;                                                \
+                fields_add(f, &p, _e - p);                              \
+        }
+
+int client_context_format_fields(ClientContext *c) {
+        ClientFields *f;
+        size_t size;
+        char *p;
+
+        assert(c);
+
+        /* Most clients log many entries between two refreshes of their metadata, hence format the trusted
+         * fields only once, and let dispatch_message_real() copy the iovecs and the hashes from here */
+
+        if (c->fields)
+                return 0;
+
+        size = N_IOVEC_CONTEXT_FIELDS * FIELD_SIZE_MAX +
+                strlen_ptr(c->comm) + strlen_ptr(c->exe) + strlen_ptr(c->cmdline) + strlen_ptr(c->capeff) +
+                strlen_ptr(c->cgroup) + strlen_ptr(c->session) + strlen_ptr(c->unit) + strlen_ptr(c->user_unit) +
+                strlen_ptr(c->slice) + strlen_ptr(c->user_slice) + c->label_size;
+
+        f = malloc(offsetof(ClientFields, data) + size);
+        if (!f)
+                return -ENOMEM;
+
+        f->n_iovec = 0;
+        p = f->data;
+
+        FIELDS_ADD_NUMERIC(f, p, c->pid, pid_is_valid, PID_FMT, "_PID");
+        FIELDS_ADD_NUMERIC(f, p, c->uid, uid_is_valid, UID_FMT, "_UID");
+        FIELDS_ADD_NUMERIC(f, p, c->gid, gid_is_valid, GID_FMT, "_GID");
+
+        FIELDS_ADD_STRING(f, p, c->comm, "_COMM");
+        FIELDS_ADD_STRING(f, p, c->exe, "_EXE");
+        FIELDS_ADD_STRING(f, p, c->cmdline, "_CMDLINE");
+        FIELDS_ADD_STRING(f, p, c->capeff, "_CAP_EFFECTIVE");
+
+        FIELDS_ADD_SIZED(f, p, c->label, c->label_size, "_SELINUX_CONTEXT");
+
+        FIELDS_ADD_NUMERIC(f, p, c->auditid, audit_session_is_valid, "%" PRIu32, "_AUDIT_SESSION");
+        FIELDS_ADD_NUMERIC(f, p, c->loginuid, uid_is_valid, UID_FMT, "_AUDIT_LOGINUID");
+
+        FIELDS_ADD_STRING(f, p, c->cgroup, "_SYSTEMD_CGROUP");
+        FIELDS_ADD_STRING(f, p, c->session, "_SYSTEMD_SESSION");
+        FIELDS_ADD_NUMERIC(f, p, c->owner_uid, uid_is_valid, UID_FMT, "_SYSTEMD_OWNER_UID");
+        FIELDS_ADD_STRING(f, p, c->unit, "_SYSTEMD_UNIT");
+        FIELDS_ADD_STRING(f, p, c->user_unit, "_SYSTEMD_USER_UNIT");
+        FIELDS_ADD_STRING(f, p, c->slice, "_SYSTEMD_SLICE");
+        FIELDS_ADD_STRING(f, p, c->user_slice, "_SYSTEMD_USER_SLICE");
+
+        FIELDS_ADD_ID128(f, p, c->invocation_id, "_SYSTEMD_INVOCATION_ID");
+
+        assert((size_t) (p - f->data) <= size);
+
+        c->fields = f;
+        return 0;
+}
+
 static void client_context_try_shrink_to(Server *s, size_t limit) {
         assert(s);
 
@@ -552,6 +775,93 @@ void client_context_flush_all(Server *s) {
 
         s->client_contexts_lru = prioq_free(s->client_contexts_lru);
         s->client_contexts = hashmap_free(s->client_contexts);
+
+        assert(hashmap_size(s->client_units) == 0);
+        s->client_units = hashmap_free(s->client_units);
+}
+
+static void client_context_invalidate_units(Server *s, const char *name) {
+        ClientUnit *u;
+        const char *colon;
+        Iterator i;
+
+        assert(s);
+
+        /* PID 1 names the files in /run/systemd/units/ "<setting>:<unit>". Drop the cached data of the unit
+         * it refers to, or of all units if we don't know which one changed. */
+
+        if (name) {
+                colon = strchr(name, ':');
+                if (!colon)
+                        return;
+
+                u = hashmap_get(s->client_units, colon + 1);
+                if (u)
+                        u->timestamp = USEC_INFINITY;
+                return;
+        }
+
+        HASHMAP_FOREACH(u, s->client_units, i)
+                u->timestamp = USEC_INFINITY;
+}
+
+static int dispatch_units_inotify(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        Server *s = userdata;
+        union inotify_event_buffer buffer;
+        struct inotify_event *e;
+        ssize_t l;
+
+        assert(s);
+        assert(fd == s->units_inotify_fd);
+
+        l = read(fd, &buffer, sizeof(buffer));
+        if (l < 0) {
+                if (IN_SET(errno, EAGAIN, EINTR))
+                        return 0;
+
+                log_warning_errno(errno, "Lost inotify watch on /run/systemd/units/, refreshing unit metadata periodically: %m");
+
+                s->units_inotify_event_source = sd_event_source_unref(s->units_inotify_event_source);
+                s->units_inotify_fd = safe_close(s->units_inotify_fd);
+                client_context_invalidate_units(s, NULL);
+                return 0;
+        }
+
+        FOREACH_INOTIFY_EVENT(e, buffer, l) {
+                if (e->mask & IN_Q_OVERFLOW) {
+                        client_context_invalidate_units(s, NULL);
+                        break;
+                }
+
+                if (e->len > 0)
+                        client_context_invalidate_units(s, e->name);
+        }
+
+        return 0;
+}
+
+int client_context_watch_units(Server *s) {
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        assert(s);
+
+        /* Unit metadata shared between client contexts is only reread when PID 1 touches the unit's files in
+         * /run/systemd/units/. If we can't watch the directory, we fall back to refreshing it periodically. */
+
+        fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+        if (fd < 0)
+                return log_debug_errno(errno, "Failed to allocate inotify fd, refreshing unit metadata periodically: %m");
+
+        if (inotify_add_watch(fd, "/run/systemd/units", IN_CREATE|IN_DELETE|IN_MOVED_TO|IN_MOVED_FROM|IN_CLOSE_WRITE|IN_ONLYDIR) < 0)
+                return log_debug_errno(errno, "Failed to watch /run/systemd/units/, refreshing unit metadata periodically: %m");
+
+        r = sd_event_add_io(s->event, &s->units_inotify_event_source, fd, EPOLLIN, dispatch_units_inotify, s);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to add inotify event source: %m");
+
+        s->units_inotify_fd = TAKE_FD(fd);
+        return 0;
 }
 
 static int client_context_get_internal(
@@ -13,9 +13,40 @@
 #include "sd-id128.h"
 
 typedef struct ClientContext ClientContext;
+typedef struct ClientUnit ClientUnit;
+typedef struct ClientFields ClientFields;
 
 #include "journald-server.h"
 
+/* The metadata PID 1 exports about a unit in /run/systemd/units/, shared by all clients of the same unit */
+struct ClientUnit {
+        unsigned n_ref;
+        char *id;
+        usec_t timestamp;
+
+        sd_id128_t invocation_id;
+        int log_level_max;
+        uint64_t log_rate_limit_bytes;
+
+        struct iovec *extra_fields_iovec;
+        size_t extra_fields_n_iovec;
+        void *extra_fields_data;
+        nsec_t extra_fields_mtime;
+};
+
+/* _PID=, _UID=, _GID=, _COMM=, _EXE=, _CMDLINE=, _CAP_EFFECTIVE=, _SELINUX_CONTEXT=, _AUDIT_SESSION=,
+ * _AUDIT_LOGINUID=, _SYSTEMD_CGROUP=, _SYSTEMD_SESSION=, _SYSTEMD_OWNER_UID=, _SYSTEMD_UNIT=,
+ * _SYSTEMD_USER_UNIT=, _SYSTEMD_SLICE=, _SYSTEMD_USER_SLICE=, _SYSTEMD_INVOCATION_ID= */
+#define N_IOVEC_CONTEXT_FIELDS 18
+
+/* The trusted fields of a client, formatted and hashed once, and then attached to each of its entries */
+struct ClientFields {
+        size_t n_iovec;
+        struct iovec iovec[N_IOVEC_CONTEXT_FIELDS];
+        uint64_t hash[N_IOVEC_CONTEXT_FIELDS];
+        char data[];
+};
+
 struct ClientContext {
         unsigned n_ref;
         unsigned lru_index;
@@ -49,12 +80,14 @@ struct ClientContext {
         char *label;
         size_t label_size;
 
+        /* Copied from the unit metadata on each refresh */
         int log_level_max;
+        uint64_t log_rate_limit_bytes;
 
-        struct iovec *extra_fields_iovec;
-        size_t extra_fields_n_iovec;
-        void *extra_fields_data;
-        nsec_t extra_fields_mtime;
+        ClientUnit *unit_info;
+
+        /* Formatted on first use after each refresh */
+        ClientFields *fields;
 };
 
 int client_context_get(
@@ -83,11 +116,15 @@ void client_context_maybe_refresh(
                 const char *unit_id,
                 usec_t tstamp);
 
+int client_context_format_fields(ClientContext *c);
+
 void client_context_acquire_default(Server *s);
 void client_context_flush_all(Server *s);
 
+int client_context_watch_units(Server *s);
+
 static inline size_t client_context_extra_fields_n_iovec(const ClientContext *c) {
-        return c ? c->extra_fields_n_iovec : 0;
+        return c && c->unit_info ? c->unit_info->extra_fields_n_iovec : 0;
 }
 
 static inline bool client_context_test_priority(const ClientContext *c, int priority) {
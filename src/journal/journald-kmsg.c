@@ -26,6 +26,7 @@
 #include "process-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
+#include "strv.h"
 
 void server_forward_kmsg(
         Server *s,
@@ -98,6 +99,116 @@ static bool is_us(const char *identifier, const char *pid) {
                streq(identifier, program_invocation_short_name);
 }
 
+/* How long we trust the udev metadata we looked up for a kernel device, and how many devices we remember */
+#define KMSG_DEVICE_CACHE_USEC (5 * USEC_PER_SEC)
+#define KMSG_DEVICE_CACHE_MAX 256U
+
+/* How many records we read from /dev/kmsg at most before giving other event sources a chance */
+#define DEV_KMSG_BUDGET 64U
+
+typedef struct KmsgDevice {
+        char *id;
+        char **fields;
+        usec_t timestamp;
+} KmsgDevice;
+
+static KmsgDevice *kmsg_device_free(KmsgDevice *d) {
+        if (!d)
+                return NULL;
+
+        free(d->id);
+        strv_free(d->fields);
+        return mfree(d);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(KmsgDevice*, kmsg_device_free);
+
+void server_flush_kmsg_devices(Server *s) {
+        assert(s);
+
+        s->kmsg_devices = hashmap_free_with_destructor(s->kmsg_devices, kmsg_device_free);
+}
+
+static KmsgDevice *dev_kmsg_get_device(Server *s, const char *id) {
+        _cleanup_(kmsg_device_freep) KmsgDevice *d = NULL;
+        struct udev_device *ud;
+        struct udev_list_entry *ll;
+        const char *g;
+        usec_t n;
+        size_t j;
+        int r;
+
+        assert(s);
+        assert(id);
+
+        /* During kernel message storms most records are about the same few devices, hence remember what
+         * udev told us about them for a bit, instead of asking for each record again */
+
+        n = now(CLOCK_MONOTONIC);
+
+        d = hashmap_remove(s->kmsg_devices, id);
+        if (d && d->timestamp + KMSG_DEVICE_CACHE_USEC > n) {
+                r = hashmap_put(s->kmsg_devices, d->id, d);
+                if (r < 0)
+                        return NULL;
+
+                return TAKE_PTR(d);
+        }
+
+        d = kmsg_device_free(d);
+
+        if (hashmap_size(s->kmsg_devices) >= KMSG_DEVICE_CACHE_MAX)
+                server_flush_kmsg_devices(s);
+
+        r = hashmap_ensure_allocated(&s->kmsg_devices, &string_hash_ops);
+        if (r < 0)
+                return NULL;
+
+        d = new0(KmsgDevice, 1);
+        if (!d)
+                return NULL;
+
+        d->id = strdup(id);
+        if (!d->id)
+                return NULL;
+
+        d->timestamp = n;
+
+        ud = udev_device_new_from_device_id(s->udev, id);
+        if (ud) {
+                g = udev_device_get_devnode(ud);
+                if (g)
+                        (void) strv_extend(&d->fields, strjoina("_UDEV_DEVNODE=", g));
+
+                g = udev_device_get_sysname(ud);
+                if (g)
+                        (void) strv_extend(&d->fields, strjoina("_UDEV_SYSNAME=", g));
+
+                j = 0;
+                ll = udev_device_get_devlinks_list_entry(ud);
+                udev_list_entry_foreach(ll, ll) {
+
+                        if (j > N_IOVEC_UDEV_FIELDS)
+                                break;
+
+                        g = udev_list_entry_get_name(ll);
+                        if (g)
+                                (void) strv_extend(&d->fields, strjoina("_UDEV_DEVLINK=", g));
+
+                        j++;
+                }
+
+                udev_device_unref(ud);
+        }
+
+        /* Devices udev doesn't know are remembered too, so that we don't keep asking */
+        r = hashmap_put(s->kmsg_devices, d->id, d);
+        if (r < 0)
+                return NULL;
+
+        return TAKE_PTR(d);
+}
+
 static void dev_kmsg_record(Server *s, const char *p, size_t l) {
 
         _cleanup_free_ char *message = NULL, *syslog_priority = NULL, *syslog_pid = NULL, *syslog_facility = NULL, *syslog_identifier = NULL, *source_time = NULL, *identifier = NULL, *pid = NULL;
@@ -214,53 +325,13 @@ static void dev_kmsg_record(Server *s, const char *p, size_t l) {
         }
 
         if (kernel_device) {
-                struct udev_device *ud;
-
-                ud = udev_device_new_from_device_id(s->udev, kernel_device);
-                if (ud) {
-                        const char *g;
-                        struct udev_list_entry *ll;
-                        char *b;
-
-                        g = udev_device_get_devnode(ud);
-                        if (g) {
-                                b = strappend("_UDEV_DEVNODE=", g);
-                                if (b) {
-                                        iovec[n++] = IOVEC_MAKE_STRING(b);
-                                        z++;
-                                }
-                        }
-
-                        g = udev_device_get_sysname(ud);
-                        if (g) {
-                                b = strappend("_UDEV_SYSNAME=", g);
-                                if (b) {
-                                        iovec[n++] = IOVEC_MAKE_STRING(b);
-                                        z++;
-                                }
-                        }
-
-                        j = 0;
-                        ll = udev_device_get_devlinks_list_entry(ud);
-                        udev_list_entry_foreach(ll, ll) {
-
-                                if (j > N_IOVEC_UDEV_FIELDS)
-                                        break;
-
-                                g = udev_list_entry_get_name(ll);
-                                if (g) {
-                                        b = strappend("_UDEV_DEVLINK=", g);
-                                        if (b) {
-                                                iovec[n++] = IOVEC_MAKE_STRING(b);
-                                                z++;
-                                        }
-                                }
-
-                                j++;
-                        }
-
-                        udev_device_unref(ud);
-                }
+                KmsgDevice *d;
+                char **field;
+
+                d = dev_kmsg_get_device(s, kernel_device);
+                if (d)
+                        STRV_FOREACH(field, d->fields)
+                                iovec[n++] = IOVEC_MAKE_STRING(*field);
         }
 
         if (asprintf(&source_time, "_SOURCE_MONOTONIC_TIMESTAMP=%llu", usec) >= 0)
@@ -363,6 +434,8 @@ int server_flush_dev_kmsg(Server *s) {
 
 static int dispatch_dev_kmsg(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
         Server *s = userdata;
+        unsigned i;
+        int r;
 
         assert(es);
         assert(fd == s->dev_kmsg_fd);
@@ -374,7 +447,15 @@ static int dispatch_dev_kmsg(sd_event_source *es, int fd, uint32_t revents, void
         if (!(revents & EPOLLIN))
                 log_error("Got invalid event from epoll for /dev/kmsg: %"PRIx32, revents);
 
-        return server_read_dev_kmsg(s);
+        /* Drain what is there, but only up to a budget, so that a kernel message storm doesn't starve the
+         * other sources. The fd stays readable, hence we'll be called again right away. */
+        for (i = 0; i < DEV_KMSG_BUDGET; i++) {
+                r = server_read_dev_kmsg(s);
+                if (r <= 0)
+                        return r;
+        }
+
+        return 0;
 }
 
 int server_open_dev_kmsg(Server *s) {
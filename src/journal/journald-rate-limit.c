@@ -32,6 +32,7 @@ static const int priority_map[] = {
 };
 
 typedef struct JournalRateLimitPool JournalRateLimitPool;
+typedef struct JournalRateLimitBucket JournalRateLimitBucket;
 typedef struct JournalRateLimitGroup JournalRateLimitGroup;
 
 struct JournalRateLimitPool {
@@ -40,11 +41,19 @@ struct JournalRateLimitPool {
         unsigned suppressed;
 };
 
+/* A token bucket of bytes, refilled continuously at the rate of the budget per interval */
+struct JournalRateLimitBucket {
+        usec_t timestamp;
+        uint64_t tokens;
+        unsigned suppressed;
+};
+
 struct JournalRateLimitGroup {
         JournalRateLimit *parent;
 
         char *id;
         JournalRateLimitPool pools[POOLS_MAX];
+        JournalRateLimitBucket bytes;
         uint64_t hash;
 
         LIST_FIELDS(JournalRateLimitGroup, bucket);
@@ -117,6 +126,10 @@ _pure_ static bool journal_rate_limit_group_expired(JournalRateLimitGroup *g, us
                 if (g->pools[i].begin + g->parent->interval >= ts)
                         return false;
 
+        /* After one interval the bucket is full again, hence there's nothing to remember */
+        if (g->bytes.timestamp + g->parent->interval >= ts)
+                return false;
+
         return true;
 }
 
@@ -124,7 +137,8 @@ static void journal_rate_limit_vacuum(JournalRateLimit *r, usec_t ts) {
         assert(r);
 
         /* Makes room for at least one new item, but drop all
-         * expored items too. */
+         * expired items too. Groups are moved to the front of the LRU list whenever they are used, hence
+         * we only need to look at the tail. */
 
         while (r->n_groups >= GROUPS_MAX ||
                (r->lru_tail && journal_rate_limit_group_expired(r->lru_tail, ts)))
@@ -166,7 +180,47 @@ fail:
         return NULL;
 }
 
-static unsigned burst_modulate(unsigned burst, uint64_t available) {
+static void journal_rate_limit_group_touch(JournalRateLimitGroup *g) {
+        JournalRateLimit *r;
+
+        assert(g);
+        assert(g->parent);
+
+        r = g->parent;
+
+        if (r->lru == g)
+                return;
+
+        if (r->lru_tail == g)
+                r->lru_tail = g->lru_prev;
+
+        LIST_REMOVE(lru, r->lru, g);
+        LIST_PREPEND(lru, r->lru, g);
+}
+
+static JournalRateLimitGroup* journal_rate_limit_get_group(JournalRateLimit *r, const char *id, usec_t ts) {
+        JournalRateLimitGroup *g;
+        struct siphash state;
+        uint64_t h;
+
+        assert(r);
+        assert(id);
+
+        siphash24_init(&state, r->hash_key);
+        string_hash_func(id, &state);
+        h = siphash24_finalize(&state);
+        g = r->buckets[h % BUCKETS_MAX];
+
+        LIST_FOREACH(bucket, g, g)
+                if (streq(g->id, id)) {
+                        journal_rate_limit_group_touch(g);
+                        return g;
+                }
+
+        return journal_rate_limit_group_new(r, id, ts);
+}
+
+static uint64_t burst_modulate(uint64_t burst, uint64_t available) {
         unsigned k;
 
         /* Modulates the burst rate a bit with the amount of available
@@ -194,12 +248,38 @@ static unsigned burst_modulate(unsigned burst, uint64_t available) {
         return burst;
 }
 
-int journal_rate_limit_test(JournalRateLimit *r, const char *id, int priority, uint64_t available) {
-        uint64_t h;
+static bool journal_rate_limit_bucket_take(JournalRateLimit *r, JournalRateLimitBucket *b, uint64_t budget, size_t size, usec_t ts) {
+        assert(r);
+        assert(b);
+
+        if (b->timestamp <= 0 || b->timestamp + r->interval <= ts)
+                b->tokens = budget;
+        else
+                b->tokens = MIN(budget, b->tokens + (uint64_t) ((double) budget * (ts - b->timestamp) / r->interval));
+
+        b->timestamp = ts;
+
+        /* A single message larger than the budget passes when the bucket is full */
+        size = MIN(size, budget);
+
+        if (b->tokens < size)
+                return false;
+
+        b->tokens -= size;
+        return true;
+}
+
+int journal_rate_limit_test(
+                JournalRateLimit *r,
+                const char *id,
+                int priority,
+                size_t size,
+                uint64_t budget,
+                uint64_t available) {
+
         JournalRateLimitGroup *g;
         JournalRateLimitPool *p;
-        struct siphash state;
-        unsigned burst;
+        unsigned burst, s = 0;
         usec_t ts;
 
         assert(id);
@@ -209,58 +289,87 @@ int journal_rate_limit_test(JournalRateLimit *r, const char *id, int priority, u
          * 0     → the log message shall be suppressed,
          * 1 + n → the log message shall be permitted, and n messages were dropped from the peer before
          * < 0   → error
+         *
+         * Messages are limited by their number (the burst of the rate limit, per priority), and if budget is
+         * non-zero also by their total size in bytes (for all priorities).
          */
 
         if (!r)
                 return 1;
 
-        if (r->interval == 0 || r->burst == 0)
+        if (r->interval == 0 || (r->burst == 0 && budget == 0))
                 return 1;
 
-        burst = burst_modulate(r->burst, available);
-
         ts = now(CLOCK_MONOTONIC);
 
-        siphash24_init(&state, r->hash_key);
-        string_hash_func(id, &state);
-        h = siphash24_finalize(&state);
-        g = r->buckets[h % BUCKETS_MAX];
+        g = journal_rate_limit_get_group(r, id, ts);
+        if (!g)
+                return -ENOMEM;
+
+        if (r->burst > 0) {
+                burst = burst_modulate(r->burst, available);
+
+                p = &g->pools[priority_map[priority]];
+
+                if (p->begin <= 0 || p->begin + r->interval < ts) {
+                        s = p->suppressed;
+                        p->suppressed = 0;
+                        p->num = 1;
+                        p->begin = ts;
+                } else if (p->num < burst)
+                        p->num++;
+                else {
+                        p->suppressed++;
+                        return 0;
+                }
+        }
 
-        LIST_FOREACH(bucket, g, g)
-                if (streq(g->id, id))
-                        break;
+        if (budget > 0) {
+                if (!journal_rate_limit_bucket_take(r, &g->bytes, burst_modulate(budget, available), size, ts)) {
+                        /* Don't lose what the pool reported as dropped */
+                        g->bytes.suppressed += s + 1;
+                        return 0;
+                }
 
-        if (!g) {
-                g = journal_rate_limit_group_new(r, id, ts);
-                if (!g)
-                        return -ENOMEM;
+                s += g->bytes.suppressed;
+                g->bytes.suppressed = 0;
         }
 
-        p = &g->pools[priority_map[priority]];
+        return 1 + s;
+}
 
-        if (p->begin <= 0) {
-                p->suppressed = 0;
-                p->num = 1;
-                p->begin = ts;
-                return 1;
-        }
+int journal_rate_limit_test_bytes(JournalRateLimit *r, const char *id, uint64_t budget, size_t size, uint64_t available) {
+        JournalRateLimitGroup *g;
+        JournalRateLimitBucket *b;
+        unsigned s;
+        usec_t ts;
 
-        if (p->begin + r->interval < ts) {
-                unsigned s;
+        assert(id);
 
-                s = p->suppressed;
-                p->suppressed = 0;
-                p->num = 1;
-                p->begin = ts;
+        /* Like journal_rate_limit_test(), but limits only the number of bytes logged by a group of services
+         * (i.e. a slice) to the budget per interval. Returns the same values. */
 
-                return 1 + s;
-        }
+        if (!r)
+                return 1;
 
-        if (p->num < burst) {
-                p->num++;
+        if (r->interval == 0 || budget == 0)
                 return 1;
+
+        ts = now(CLOCK_MONOTONIC);
+
+        g = journal_rate_limit_get_group(r, id, ts);
+        if (!g)
+                return -ENOMEM;
+
+        b = &g->bytes;
+
+        if (!journal_rate_limit_bucket_take(r, b, burst_modulate(budget, available), size, ts)) {
+                b->suppressed++;
+                return 0;
         }
 
-        p->suppressed++;
-        return 0;
+        s = b->suppressed;
+        b->suppressed = 0;
+
+        return 1 + s;
 }
@@ -13,4 +13,5 @@ typedef struct JournalRateLimit JournalRateLimit;
 
 JournalRateLimit *journal_rate_limit_new(usec_t interval, unsigned burst);
 void journal_rate_limit_free(JournalRateLimit *r);
-int journal_rate_limit_test(JournalRateLimit *r, const char *id, int priority, uint64_t available);
+int journal_rate_limit_test(JournalRateLimit *r, const char *id, int priority, size_t size, uint64_t budget, uint64_t available);
+int journal_rate_limit_test_bytes(JournalRateLimit *r, const char *id, uint64_t budget, size_t size, uint64_t available);
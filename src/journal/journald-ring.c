@@ -0,0 +1,287 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+***/
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "sd-event.h"
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "journal-ring.h"
+#include "journald-native.h"
+#include "journald-ring.h"
+#include "journald-server.h"
+#include "process-util.h"
+
+#define NATIVE_RINGS_MAX 256
+
+struct NativeRing {
+        Server *server;
+        JournalRing *ring;
+
+        int event_fd;
+        int hangup_fd;
+        sd_event_source *event_source;
+        sd_event_source *hangup_event_source;
+
+        struct ucred ucred;
+        uint64_t start_time;
+        bool peer_gone;
+        char *label;
+        size_t label_len;
+
+        /* The client picks the timestamps, keep them from going backwards or into the future */
+        usec_t realtime;
+
+        LIST_FIELDS(NativeRing, native_ring);
+};
+
+void native_ring_free(NativeRing *r) {
+        if (!r)
+                return;
+
+        if (r->server) {
+                assert(r->server->n_native_rings > 0);
+                r->server->n_native_rings--;
+                LIST_REMOVE(native_ring, r->server->native_rings, r);
+        }
+
+        sd_event_source_unref(r->event_source);
+        sd_event_source_unref(r->hangup_event_source);
+
+        safe_close(r->event_fd);
+        safe_close(r->hangup_fd);
+
+        journal_ring_free(r->ring);
+
+        free(r->label);
+        free(r);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(NativeRing*, native_ring_free);
+
+static void native_ring_entry(const void *data, size_t size, usec_t realtime, void *userdata) {
+        NativeRing *r = userdata;
+        struct ucred ucred;
+        struct timeval tv;
+
+        assert(r);
+
+        r->realtime = CLAMP(realtime, r->realtime, now(CLOCK_REALTIME));
+
+        /* Once the peer is gone its PID may be taken by another process, don't look up anything for it */
+        ucred = r->ucred;
+        if (r->peer_gone)
+                ucred.pid = 0;
+
+        server_process_native_message(r->server, data, size, &ucred, timeval_store(&tv, r->realtime), r->label, r->label_len);
+}
+
+static int native_ring_verify_peer(NativeRing *r) {
+        uint64_t t;
+        int k;
+
+        assert(r);
+
+        k = get_process_start_time(r->ucred.pid, &t);
+        if (k == -ESRCH) {
+                r->peer_gone = true;
+                return 0;
+        }
+        if (k < 0)
+                return log_warning_errno(k, "Failed to verify peer of journal ring of PID " PID_FMT ", detaching: %m", r->ucred.pid);
+
+        if (t != r->start_time) {
+                log_warning("PID " PID_FMT " of journal ring has been reused, detaching.", r->ucred.pid);
+                return -ESTALE;
+        }
+
+        return 1;
+}
+
+static int native_ring_dispatch(NativeRing *r) {
+        Server *s;
+        int k;
+
+        assert(r);
+        assert(r->server);
+
+        s = r->server;
+
+        /* The entries are attributed to the peer that attached the ring. Make sure its PID still refers to
+         * it before each drain, and detach once it does not. If the peer is gone, pick up what it left
+         * behind without its PID, and detach afterwards. */
+        k = native_ring_verify_peer(r);
+        if (k < 0)
+                return k;
+
+        /* The ring is drained into s->buffer, which is not ours while a batch of datagrams is dispatched */
+        assert(!s->dispatching_batch);
+
+        /* Same as for datagrams: entries of priority CRIT and above are synced once for the whole batch */
+        s->dispatching_batch = true;
+
+        k = journal_ring_drain(r->ring, native_ring_entry, r, &s->buffer, &s->buffer_size);
+
+        s->dispatching_batch = false;
+
+        if (s->sync_requested) {
+                s->sync_requested = false;
+                server_sync(s);
+        }
+
+        if (k < 0)
+                return log_warning_errno(k, "Failed to process journal ring of PID " PID_FMT ", detaching: %m", r->ucred.pid);
+
+        if (r->peer_gone) {
+                log_debug("Peer of journal ring of PID " PID_FMT " is gone, detaching.", r->ucred.pid);
+                return -ESRCH;
+        }
+
+        /* We stopped early to not starve the others, come back later */
+        if (k > 0)
+                (void) eventfd_write(r->event_fd, 1);
+
+        return 0;
+}
+
+static int native_ring_event(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        NativeRing *r = userdata;
+        eventfd_t v;
+
+        assert(r);
+
+        (void) eventfd_read(fd, &v);
+
+        if (native_ring_dispatch(r) < 0)
+                native_ring_free(r);
+
+        return 0;
+}
+
+static int native_ring_hangup(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        NativeRing *r = userdata;
+
+        assert(r);
+
+        /* The client is gone, pick up what it left behind */
+        (void) native_ring_dispatch(r);
+        native_ring_free(r);
+
+        return 0;
+}
+
+void server_process_native_ring(
+                Server *s,
+                int fds[3],
+                const struct ucred *ucred,
+                const char *label, size_t label_len) {
+
+        _cleanup_(native_ring_freep) NativeRing *r = NULL;
+        int k;
+
+        assert(s);
+        assert(fds);
+
+        /* All entries in the ring are attributed to the peer that passed it to us */
+        if (!ucred || !pid_is_valid(ucred->pid)) {
+                log_warning("Got journal ring without credentials. Ignoring.");
+                return;
+        }
+
+        if (s->n_native_rings >= NATIVE_RINGS_MAX) {
+                log_warning("Too many journal rings, refusing ring of PID " PID_FMT ".", ucred->pid);
+                return;
+        }
+
+        r = new0(NativeRing, 1);
+        if (!r) {
+                log_oom();
+                return;
+        }
+
+        r->event_fd = r->hangup_fd = -1;
+        r->ucred = *ucred;
+        r->realtime = now(CLOCK_REALTIME);
+
+        /* PIDs get reused, remember which process this one refers to now */
+        k = get_process_start_time(ucred->pid, &r->start_time);
+        if (k < 0) {
+                log_warning_errno(k, "Failed to get start time of PID " PID_FMT ", refusing journal ring: %m", ucred->pid);
+                return;
+        }
+
+        if (label) {
+                r->label = memdup_suffix0(label, label_len);
+                if (!r->label) {
+                        log_oom();
+                        return;
+                }
+
+                r->label_len = label_len;
+        }
+
+        k = journal_ring_attach(fds[0], &r->ring);
+        if (k < 0) {
+                log_warning_errno(k, "Failed to attach journal ring of PID " PID_FMT ", ignoring: %m", ucred->pid);
+                return;
+        }
+
+        r->event_fd = TAKE_FD(fds[1]);
+        r->hangup_fd = TAKE_FD(fds[2]);
+
+        k = sd_event_add_io(s->event, &r->event_source, r->event_fd, EPOLLIN, native_ring_event, r);
+        if (k < 0) {
+                log_warning_errno(k, "Failed to watch journal ring of PID " PID_FMT ", ignoring: %m", ucred->pid);
+                return;
+        }
+
+        k = sd_event_source_set_priority(r->event_source, SD_EVENT_PRIORITY_NORMAL+5);
+        if (k < 0) {
+                log_warning_errno(k, "Failed to adjust journal ring event source priority, ignoring: %m");
+                return;
+        }
+
+        k = sd_event_add_io(s->event, &r->hangup_event_source, r->hangup_fd, EPOLLIN, native_ring_hangup, r);
+        if (k < 0) {
+                log_warning_errno(k, "Failed to watch journal ring of PID " PID_FMT ", ignoring: %m", ucred->pid);
+                return;
+        }
+
+        /* Only once the client is gone, after its last entries */
+        k = sd_event_source_set_priority(r->hangup_event_source, SD_EVENT_PRIORITY_NORMAL+6);
+        if (k < 0) {
+                log_warning_errno(k, "Failed to adjust journal ring event source priority, ignoring: %m");
+                return;
+        }
+
+        r->server = s;
+        LIST_PREPEND(native_ring, s->native_rings, r);
+        s->n_native_rings++;
+
+        log_debug("Attached journal ring of PID " PID_FMT ".", ucred->pid);
+
+        /* The client might have written entries already, and we need to ask for wakeups. Don't drain the
+         * ring right here though: we are called in the middle of a batch of datagrams, which still live in
+         * s->buffer, the buffer the ring is drained into. Let the ring's own event source do it instead. */
+        k = eventfd_write(r->event_fd, 1);
+        if (k < 0) {
+                log_warning_errno(errno, "Failed to kick journal ring of PID " PID_FMT ", ignoring: %m", ucred->pid);
+                return;
+        }
+
+        TAKE_PTR(r);
+}
+
+void server_flush_native_rings(Server *s) {
+        assert(s);
+
+        /* Process what is left in the rings, then tell the clients to go back to the socket */
+        while (s->native_rings) {
+                (void) native_ring_dispatch(s->native_rings);
+                native_ring_free(s->native_rings);
+        }
+}
@@ -0,0 +1,15 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+/***
+  This file is part of systemd.
+***/
+
+typedef struct NativeRing NativeRing;
+
+#include "journald-server.h"
+
+void server_process_native_ring(Server *s, int fds[3], const struct ucred *ucred, const char *label, size_t label_len);
+void server_flush_native_rings(Server *s);
+
+void native_ring_free(NativeRing *r);
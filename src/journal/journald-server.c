@@ -47,6 +47,7 @@
 #include "journald-stream.h"
 #include "journald-syslog.h"
 #include "log.h"
+#include "lookup3.h"
 #include "missing.h"
 #include "mkdir.h"
 #include "parse-util.h"
@@ -76,6 +77,15 @@
 /* The period to insert between posting changes for coalescing */
 #define POST_CHANGE_TIMER_INTERVAL_USEC (250*USEC_PER_MSEC)
 
+/* The maximum number of datagrams we read with one recvmmsg() call, and the space we reserve for each. The
+ * latter is the largest datagram sd_journal_send() can send: it raises SO_SNDBUF to 8M, which the kernel
+ * doubles. The slots are only populated as far as datagrams are actually written into them. */
+#define DATAGRAM_BATCH_MAX 16U
+#define DATAGRAM_SLOT_SIZE (16U*1024U*1024U)
+
+/* The number of entries copied from the runtime journal in one go when flushing to /var */
+#define FLUSH_BATCH_MAX 64U
+
 /* Pick a good default that is likely to fit into AF_UNIX and AF_INET SOCK_DGRAM datagrams, and even leaves some room
  * for a bit of additional metadata. */
 #define DEFAULT_LINE_MAX (48*1024)
@@ -441,46 +451,71 @@ static JournalFile* find_journal(Server *s, uid_t uid) {
 
 static int do_rotate(
                 Server *s,
+                JournalStorage *storage,
                 JournalFile **f,
                 const char* name,
                 bool seal,
                 uint32_t uid) {
 
+        _cleanup_free_ char *archived = NULL;
         int r;
         assert(s);
+        assert(storage);
 
         if (!*f)
                 return -EINVAL;
 
+        /* Tell the vacuuming logic about the file we are about to archive, so that it doesn't have to scan
+         * the whole directory for it the next time */
+        if (journal_file_archived_path(*f, &archived) >= 0)
+                journal_vacuum_cache_verify(storage->vacuum_cache, storage->path);
+
         r = journal_file_rotate(f, s->compress.enabled, s->compress.threshold_bytes, seal, s->deferred_closes);
         if (r < 0) {
+                /* We don't know how far we got, hence let the next vacuuming look at the directory again */
+                storage->vacuum_cache = journal_vacuum_cache_free(storage->vacuum_cache);
+
                 if (*f)
                         return log_error_errno(r, "Failed to rotate %s: %m", (*f)->path);
                 else
                         return log_error_errno(r, "Failed to create new %s journal: %m", name);
         }
 
+        if (archived && path_startswith(archived, storage->path)) {
+                r = journal_vacuum_cache_add(storage->vacuum_cache, storage->path, basename(archived));
+                if (r < 0)
+                        log_debug_errno(r, "Failed to add %s to vacuum cache, ignoring: %m", archived);
+        }
+
         server_add_acls(*f, uid);
 
         return r;
 }
 
 void server_rotate(Server *s) {
+        char ts[FORMAT_TIMESPAN_MAX], ts_avg[FORMAT_TIMESPAN_MAX], ts_max[FORMAT_TIMESPAN_MAX];
         JournalFile *f;
         void *k;
         Iterator i;
+        usec_t start, duration;
+        unsigned n = 0;
         int r;
 
         log_debug("Rotating...");
 
-        (void) do_rotate(s, &s->runtime_journal, "runtime", false, 0);
-        (void) do_rotate(s, &s->system_journal, "system", s->seal, 0);
+        start = now(CLOCK_MONOTONIC);
+
+        if (do_rotate(s, &s->runtime_storage, &s->runtime_journal, "runtime", false, 0) >= 0)
+                n++;
+        if (do_rotate(s, &s->system_storage, &s->system_journal, "system", s->seal, 0) >= 0)
+                n++;
 
         ORDERED_HASHMAP_FOREACH_KEY(f, k, s->user_journals, i) {
-                r = do_rotate(s, &f, "user", s->seal, PTR_TO_UID(k));
-                if (r >= 0)
+                r = do_rotate(s, &s->system_storage, &f, "user", s->seal, PTR_TO_UID(k));
+                if (r >= 0) {
                         ordered_hashmap_replace(s->user_journals, k, f);
-                else if (!f)
+                        n++;
+                } else if (!f)
                         /* Old file has been closed and deallocated */
                         ordered_hashmap_remove(s->user_journals, k);
         }
@@ -491,13 +526,37 @@ void server_rotate(Server *s) {
                         (void) set_remove(s->deferred_closes, f);
                         (void) journal_file_close(f);
                 }
+
+        /* The archived files are still being offlined in the background, this is the time we blocked for */
+        duration = now(CLOCK_MONOTONIC) - start;
+
+        s->n_rotations++;
+        s->rotate_usec_total += duration;
+        s->rotate_usec_max = MAX(s->rotate_usec_max, duration);
+
+        log_debug("Rotated %u journal files in %s (%"PRIu64" rotations so far, %s on average, %s at most), %u still being offlined.",
+                  n,
+                  format_timespan(ts, sizeof(ts), duration, USEC_PER_MSEC / 10),
+                  s->n_rotations,
+                  format_timespan(ts_avg, sizeof(ts_avg), s->rotate_usec_total / s->n_rotations, USEC_PER_MSEC / 10),
+                  format_timespan(ts_max, sizeof(ts_max), s->rotate_usec_max, USEC_PER_MSEC / 10),
+                  set_size(s->deferred_closes));
 }
 
 void server_sync(Server *s) {
+        char ts[FORMAT_TIMESPAN_MAX], ts_avg[FORMAT_TIMESPAN_MAX], ts_max[FORMAT_TIMESPAN_MAX], bytes[FORMAT_BYTES_MAX];
         JournalFile *f;
         Iterator i;
+        usec_t start, duration;
         int r;
 
+        server_compress_flush(s);
+
+        /* This covers any sync that writing out the queued entries requested */
+        s->sync_requested = false;
+
+        start = now(CLOCK_MONOTONIC);
+
         if (s->system_journal) {
                 r = journal_file_set_offline(s->system_journal, false);
                 if (r < 0)
@@ -517,6 +576,22 @@ void server_sync(Server *s) {
         }
 
         s->sync_scheduled = false;
+
+        duration = now(CLOCK_MONOTONIC) - start;
+
+        s->n_syncs++;
+        s->sync_usec_total += duration;
+        s->sync_usec_max = MAX(s->sync_usec_max, duration);
+
+        log_debug("Synced %"PRIu64" entries (%s) to disk in %s (%"PRIu64" syncs so far, %s on average, %s at most).",
+                  s->sync_pending_entries,
+                  format_bytes(bytes, sizeof(bytes), s->sync_pending_bytes),
+                  format_timespan(ts, sizeof(ts), duration, USEC_PER_MSEC / 10),
+                  s->n_syncs,
+                  format_timespan(ts_avg, sizeof(ts_avg), s->sync_usec_total / s->n_syncs, USEC_PER_MSEC / 10),
+                  format_timespan(ts_max, sizeof(ts_max), s->sync_usec_max, USEC_PER_MSEC / 10));
+
+        s->sync_pending_entries = s->sync_pending_bytes = 0;
 }
 
 static void do_vacuum(Server *s, JournalStorage *storage, bool verbose) {
@@ -531,9 +606,9 @@ static void do_vacuum(Server *s, JournalStorage *storage, bool verbose) {
         if (verbose)
                 server_space_usage_message(s, storage);
 
-        r = journal_directory_vacuum(storage->path, storage->space.limit,
-                                     storage->metrics.n_max_files, s->max_retention_usec,
-                                     &s->oldest_file_usec, verbose);
+        r = journal_directory_vacuum_cached(&storage->vacuum_cache, storage->path, storage->space.limit,
+                                            storage->metrics.n_max_files, s->max_retention_usec,
+                                            &s->oldest_file_usec, verbose);
         if (r < 0 && r != -ENOENT)
                 log_warning_errno(r, "Failed to vacuum %s, ignoring: %m", storage->path);
 
@@ -566,6 +641,7 @@ static void server_cache_machine_id(Server *s) {
                 return;
 
         sd_id128_to_string(id, stpcpy(s->machine_id_field, "_MACHINE_ID="));
+        s->machine_id_hash = hash64(s->machine_id_field, strlen(s->machine_id_field));
 }
 
 static void server_cache_boot_id(Server *s) {
@@ -579,6 +655,7 @@ static void server_cache_boot_id(Server *s) {
                 return;
 
         sd_id128_to_string(id, stpcpy(s->boot_id_field, "_BOOT_ID="));
+        s->boot_id_hash = hash64(s->boot_id_field, strlen(s->boot_id_field));
 }
 
 static void server_cache_hostname(Server *s) {
@@ -597,6 +674,7 @@ static void server_cache_hostname(Server *s) {
 
         free(s->hostname_field);
         s->hostname_field = x;
+        s->hostname_hash = hash64(x, strlen(x));
 }
 
 static bool shall_try_append_again(JournalFile *f, int r) {
@@ -644,23 +722,40 @@ static bool shall_try_append_again(JournalFile *f, int r) {
         }
 }
 
-static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, size_t n, int priority) {
+static void server_entry_written(Server *s, const struct iovec *iovec, size_t n, int priority) {
+        assert(s);
+
+        /* Account for the entry in the next sync, and schedule that */
+        s->sync_pending_entries++;
+        s->sync_pending_bytes += IOVEC_TOTAL_SIZE(iovec, n);
+
+        (void) server_schedule_sync(s, priority);
+
+        /* Tell followers once we are done with this event loop iteration */
+        if (s->tail_event_source)
+                (void) sd_event_source_set_enabled(s->tail_event_source, SD_EVENT_ONESHOT);
+}
+
+void server_write_entry(
+                Server *s,
+                uid_t uid,
+                const struct iovec *iovec,
+                size_t n,
+                const dual_timestamp *ts,
+                int priority,
+                const CompressedField *compressed,
+                size_t n_compressed) {
+
         bool vacuumed = false, rotate = false;
-        struct dual_timestamp ts;
         JournalFile *f;
         int r;
 
         assert(s);
         assert(iovec);
         assert(n > 0);
+        assert(ts);
 
-        /* Get the closest, linearized time we have for this log event from the event loop. (Note that we do not use
-         * the source time, and not even the time the event was originally seen, but instead simply the time we started
-         * processing it, as we want strictly linear ordering in what we write out.) */
-        assert_se(sd_event_now(s->event, CLOCK_REALTIME, &ts.realtime) >= 0);
-        assert_se(sd_event_now(s->event, CLOCK_MONOTONIC, &ts.monotonic) >= 0);
-
-        if (ts.realtime < s->last_realtime_clock) {
+        if (ts->realtime < s->last_realtime_clock) {
                 /* When the time jumps backwards, let's immediately rotate. Of course, this should not happen during
                  * regular operation. However, when it does happen, then we should make sure that we start fresh files
                  * to ensure that the entries in the journal files are strictly ordered by time, in order to ensure
@@ -690,11 +785,11 @@ static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, size_t n
                         return;
         }
 
-        s->last_realtime_clock = ts.realtime;
+        s->last_realtime_clock = ts->realtime;
 
-        r = journal_file_append_entry(f, &ts, iovec, n, &s->seqnum, NULL, NULL);
+        r = journal_file_append_entry_compressed(f, ts, iovec, n, compressed, n_compressed, &s->seqnum, NULL, NULL);
         if (r >= 0) {
-                server_schedule_sync(s, priority);
+                server_entry_written(s, iovec, n, priority);
                 return;
         }
 
@@ -711,11 +806,37 @@ static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, size_t n
                 return;
 
         log_debug("Retrying write.");
-        r = journal_file_append_entry(f, &ts, iovec, n, &s->seqnum, NULL, NULL);
+        r = journal_file_append_entry_compressed(f, ts, iovec, n, compressed, n_compressed, &s->seqnum, NULL, NULL);
         if (r < 0)
                 log_error_errno(r, "Failed to write entry (%zu items, %zu bytes) despite vacuuming, ignoring: %m", n, IOVEC_TOTAL_SIZE(iovec, n));
         else
-                server_schedule_sync(s, priority);
+                server_entry_written(s, iovec, n, priority);
+}
+
+static void write_to_journal(
+                Server *s,
+                uid_t uid,
+                struct iovec *iovec, size_t n,
+                const CompressedField *hashes, size_t n_hashes,
+                int priority) {
+
+        struct dual_timestamp ts;
+
+        assert(s);
+        assert(iovec);
+        assert(n > 0);
+
+        /* Get the closest, linearized time we have for this log event from the event loop. (Note that we do not use
+         * the source time, and not even the time the event was originally seen, but instead simply the time we started
+         * processing it, as we want strictly linear ordering in what we write out.) */
+        assert_se(sd_event_now(s->event, CLOCK_REALTIME, &ts.realtime) >= 0);
+        assert_se(sd_event_now(s->event, CLOCK_MONOTONIC, &ts.monotonic) >= 0);
+
+        /* With compression workers enabled, the entry is written out once its large fields are compressed */
+        if (server_compress_queue(s, uid, iovec, n, hashes, n_hashes, &ts, priority))
+                return;
+
+        server_write_entry(s, uid, iovec, n, &ts, priority, hashes, n_hashes);
 }
 
 #define IOVEC_ADD_NUMERIC_FIELD(iovec, n, value, type, isset, format, field)  \
@@ -752,14 +873,16 @@ static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, size_t n
 static void dispatch_message_real(
                 Server *s,
                 struct iovec *iovec, size_t n, size_t m,
-                const ClientContext *c,
+                ClientContext *c,
                 const struct timeval *tv,
                 int priority,
                 pid_t object_pid) {
 
         char source_time[sizeof("_SOURCE_REALTIME_TIMESTAMP=") + DECIMAL_STR_MAX(usec_t)];
+        CompressedField hashes[N_IOVEC_META_FIELDS + N_IOVEC_OBJECT_FIELDS];
         uid_t journal_uid;
         ClientContext *o;
+        size_t i, k, n_fixed;
 
         assert(s);
         assert(iovec);
@@ -769,39 +892,37 @@ static void dispatch_message_real(
                (pid_is_valid(object_pid) ? N_IOVEC_OBJECT_FIELDS : 0) +
                client_context_extra_fields_n_iovec(c) <= m);
 
-        if (c) {
-                IOVEC_ADD_NUMERIC_FIELD(iovec, n, c->pid, pid_t, pid_is_valid, PID_FMT, "_PID");
-                IOVEC_ADD_NUMERIC_FIELD(iovec, n, c->uid, uid_t, uid_is_valid, UID_FMT, "_UID");
-                IOVEC_ADD_NUMERIC_FIELD(iovec, n, c->gid, gid_t, gid_is_valid, GID_FMT, "_GID");
-
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->comm, "_COMM");
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->exe, "_EXE");
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->cmdline, "_CMDLINE");
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->capeff, "_CAP_EFFECTIVE");
-
-                IOVEC_ADD_SIZED_FIELD(iovec, n, c->label, c->label_size, "_SELINUX_CONTEXT");
-
-                IOVEC_ADD_NUMERIC_FIELD(iovec, n, c->auditid, uint32_t, audit_session_is_valid, "%" PRIu32, "_AUDIT_SESSION");
-                IOVEC_ADD_NUMERIC_FIELD(iovec, n, c->loginuid, uid_t, uid_is_valid, UID_FMT, "_AUDIT_LOGINUID");
+        if (c && client_context_format_fields(c) < 0) {
+                log_oom();
+                return;
+        }
 
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->cgroup, "_SYSTEMD_CGROUP");
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->session, "_SYSTEMD_SESSION");
-                IOVEC_ADD_NUMERIC_FIELD(iovec, n, c->owner_uid, uid_t, uid_is_valid, UID_FMT, "_SYSTEMD_OWNER_UID");
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->unit, "_SYSTEMD_UNIT");
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->user_unit, "_SYSTEMD_USER_UNIT");
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->slice, "_SYSTEMD_SLICE");
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->user_slice, "_SYSTEMD_USER_SLICE");
+        if (client_context_extra_fields_n_iovec(c) > 0) {
+                memcpy(iovec + n, c->unit_info->extra_fields_iovec, c->unit_info->extra_fields_n_iovec * sizeof(struct iovec));
+                n += c->unit_info->extra_fields_n_iovec;
+        }
 
-                IOVEC_ADD_ID128_FIELD(iovec, n, c->invocation_id, "_SYSTEMD_INVOCATION_ID");
+        /* All fields from here on are ours, and mostly the same for each entry. Hence pass their hashes along
+         * so that they aren't calculated again for every entry. There's a fixed number of them, unlike the
+         * fields of the client before them. */
+        n_fixed = n;
 
-                if (c->extra_fields_n_iovec > 0) {
-                        memcpy(iovec + n, c->extra_fields_iovec, c->extra_fields_n_iovec * sizeof(struct iovec));
-                        n += c->extra_fields_n_iovec;
+        if (c) {
+                assert_cc(N_IOVEC_CONTEXT_FIELDS <= N_IOVEC_META_FIELDS);
+
+                for (i = 0; i < c->fields->n_iovec; i++, n++) {
+                        iovec[n] = c->fields->iovec[i];
+                        hashes[n - n_fixed] = (CompressedField) {
+                                .hash = c->fields->hash[i],
+                                .hashed = true,
+                        };
                 }
         }
 
         assert(n <= m);
 
+        k = n;
+
         if (pid_is_valid(object_pid) && client_context_get(s, object_pid, NULL, NULL, 0, NULL, &o) >= 0) {
 
                 IOVEC_ADD_NUMERIC_FIELD(iovec, n, o->pid, pid_t, pid_is_valid, PID_FMT, "OBJECT_PID");
@@ -836,19 +957,28 @@ static void dispatch_message_real(
                 iovec[n++] = IOVEC_MAKE_STRING(source_time);
         }
 
+        memzero(hashes + k - n_fixed, (n - k) * sizeof(CompressedField));
+
         /* Note that strictly speaking storing the boot id here is
          * redundant since the entry includes this in-line
          * anyway. However, we need this indexed, too. */
-        if (!isempty(s->boot_id_field))
+        if (!isempty(s->boot_id_field)) {
+                hashes[n - n_fixed] = (CompressedField) { .hash = s->boot_id_hash, .hashed = true };
                 iovec[n++] = IOVEC_MAKE_STRING(s->boot_id_field);
+        }
 
-        if (!isempty(s->machine_id_field))
+        if (!isempty(s->machine_id_field)) {
+                hashes[n - n_fixed] = (CompressedField) { .hash = s->machine_id_hash, .hashed = true };
                 iovec[n++] = IOVEC_MAKE_STRING(s->machine_id_field);
+        }
 
-        if (!isempty(s->hostname_field))
+        if (!isempty(s->hostname_field)) {
+                hashes[n - n_fixed] = (CompressedField) { .hash = s->hostname_hash, .hashed = true };
                 iovec[n++] = IOVEC_MAKE_STRING(s->hostname_field);
+        }
 
         assert(n <= m);
+        assert(n - n_fixed <= ELEMENTSOF(hashes));
 
         if (s->split_mode == SPLIT_UID && c && uid_is_valid(c->uid))
                 /* Split up strictly by (non-root) UID */
@@ -863,7 +993,7 @@ static void dispatch_message_real(
         else
                 journal_uid = 0;
 
-        write_to_journal(s, journal_uid, iovec, n, priority);
+        write_to_journal(s, journal_uid, iovec, n, hashes, n - n_fixed, priority);
 }
 
 void server_driver_message(Server *s, pid_t object_pid, const char *message_id, const char *format, ...) {
@@ -940,10 +1070,14 @@ void server_dispatch_message(
         if (s->storage == STORAGE_NONE)
                 return;
 
-        if (c && c->unit) {
+        if (c && (c->unit || c->slice))
                 (void) determine_space(s, &available, NULL);
 
-                rl = journal_rate_limit_test(s->rate_limit, c->unit, priority & LOG_PRIMASK, available);
+        if (c && c->unit) {
+                rl = journal_rate_limit_test(s->rate_limit, c->unit, priority & LOG_PRIMASK,
+                                             IOVEC_TOTAL_SIZE(iovec, n),
+                                             c->log_rate_limit_bytes > 0 ? c->log_rate_limit_bytes : s->rate_limit_burst_bytes,
+                                             available);
                 if (rl == 0)
                         return;
 
@@ -956,14 +1090,64 @@ void server_dispatch_message(
                                               NULL);
         }
 
+        /* On top of the per-service limits, all services in a slice share one budget of bytes */
+        if (c && c->slice && s->rate_limit_slice_bytes > 0) {
+                rl = journal_rate_limit_test_bytes(s->rate_limit, c->slice, s->rate_limit_slice_bytes, IOVEC_TOTAL_SIZE(iovec, n), available);
+                if (rl == 0)
+                        return;
+
+                if (rl > 1)
+                        server_driver_message(s, c->pid,
+                                              "MESSAGE_ID=" SD_MESSAGE_JOURNAL_DROPPED_STR,
+                                              LOG_MESSAGE("Suppressed %i messages from slice %s", rl - 1, c->slice),
+                                              "N_DROPPED=%i", rl - 1,
+                                              NULL);
+        }
+
         dispatch_message_real(s, iovec, n, m, c, tv, priority, object_pid);
 }
 
+static int server_flush_entries(Server *s, const JournalFileCopyEntry *entries, size_t n) {
+        bool rotated = false;
+        size_t k;
+        int r;
+
+        assert(s);
+
+        while (n > 0) {
+                r = journal_file_copy_entries(s->system_journal, entries, n, NULL, &k);
+                if (r >= 0)
+                        return 0;
+
+                /* Rotate at most once for the same entry */
+                if (!shall_try_append_again(s->system_journal, r) || (rotated && k == 0))
+                        return log_error_errno(r, "Can't write entry: %m");
+
+                entries += k;
+                n -= k;
+
+                server_rotate(s);
+                server_vacuum(s, false);
+
+                if (!s->system_journal) {
+                        log_notice("Didn't flush runtime journal since rotation of system journal wasn't successful.");
+                        return -EIO;
+                }
+
+                log_debug("Retrying write.");
+                rotated = true;
+        }
+
+        return 0;
+}
+
 int server_flush_to_var(Server *s, bool require_flag_file) {
+        JournalFileCopyEntry batch[FLUSH_BATCH_MAX];
         sd_id128_t machine;
         sd_journal *j = NULL;
         char ts[FORMAT_TIMESPAN_MAX];
         usec_t start;
+        size_t n_batch = 0;
         unsigned n = 0;
         int r;
 
@@ -978,6 +1162,10 @@ int server_flush_to_var(Server *s, bool require_flag_file) {
         if (require_flag_file && !flushed_flag_is_set())
                 return 0;
 
+        /* Entries still waiting for the compression workers go to the runtime journal first, so that they
+         * are copied over in order with everything else */
+        server_compress_flush(s);
+
         (void) system_journal_open(s, true);
 
         if (!s->system_journal)
@@ -997,8 +1185,8 @@ int server_flush_to_var(Server *s, bool require_flag_file) {
 
         sd_journal_set_data_threshold(j, 0);
 
+        /* Copy the entries in batches, so that the data objects they share are looked up only once per batch */
         SD_JOURNAL_FOREACH(j) {
-                Object *o = NULL;
                 JournalFile *f;
 
                 f = j->current_file;
@@ -1006,39 +1194,21 @@ int server_flush_to_var(Server *s, bool require_flag_file) {
 
                 n++;
 
-                r = journal_file_move_to_object(f, OBJECT_ENTRY, f->current_offset, &o);
-                if (r < 0) {
-                        log_error_errno(r, "Can't read entry: %m");
-                        goto finish;
-                }
-
-                r = journal_file_copy_entry(f, s->system_journal, o, f->current_offset, NULL, NULL, NULL);
-                if (r >= 0)
+                batch[n_batch++] = (JournalFileCopyEntry) {
+                        .file = f,
+                        .offset = f->current_offset,
+                };
+                if (n_batch < ELEMENTSOF(batch))
                         continue;
 
-                if (!shall_try_append_again(s->system_journal, r)) {
-                        log_error_errno(r, "Can't write entry: %m");
-                        goto finish;
-                }
-
-                server_rotate(s);
-                server_vacuum(s, false);
-
-                if (!s->system_journal) {
-                        log_notice("Didn't flush runtime journal since rotation of system journal wasn't successful.");
-                        r = -EIO;
+                r = server_flush_entries(s, batch, n_batch);
+                if (r < 0)
                         goto finish;
-                }
 
-                log_debug("Retrying write.");
-                r = journal_file_copy_entry(f, s->system_journal, o, f->current_offset, NULL, NULL, NULL);
-                if (r < 0) {
-                        log_error_errno(r, "Can't write entry: %m");
-                        goto finish;
-                }
+                n_batch = 0;
         }
 
-        r = 0;
+        r = server_flush_entries(s, batch, n_batch);
 
 finish:
         journal_file_post_change(s->system_journal);
@@ -1059,77 +1229,42 @@ finish:
         return r;
 }
 
-int server_process_datagram(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
-        Server *s = userdata;
+typedef union DatagramControl {
+        struct cmsghdr cmsghdr;
+
+        /* We use NAME_MAX space for the SELinux label
+         * here. The kernel currently enforces no
+         * limit, but according to suggestions from
+         * the SELinux people this will change and it
+         * will probably be identical to NAME_MAX. For
+         * now we use that, but this should be updated
+         * one day when the final limit is known. */
+        uint8_t buf[CMSG_SPACE(sizeof(struct ucred)) +
+                    CMSG_SPACE(sizeof(struct timeval)) +
+                    CMSG_SPACE(sizeof(int) * 3) + /* fds */
+                    CMSG_SPACE(NAME_MAX)]; /* selinux label */
+} DatagramControl;
+
+static void server_dispatch_datagram(
+                Server *s,
+                int fd,
+                struct msghdr *msghdr,
+                char *buffer,
+                size_t n) {
+
         struct ucred *ucred = NULL;
         struct timeval *tv = NULL;
         struct cmsghdr *cmsg;
         char *label = NULL;
-        size_t label_len = 0, m;
-        struct iovec iovec;
-        ssize_t n;
-        int *fds = NULL, v = 0;
+        size_t label_len = 0;
+        int *fds = NULL;
         size_t n_fds = 0;
 
-        union {
-                struct cmsghdr cmsghdr;
-
-                /* We use NAME_MAX space for the SELinux label
-                 * here. The kernel currently enforces no
-                 * limit, but according to suggestions from
-                 * the SELinux people this will change and it
-                 * will probably be identical to NAME_MAX. For
-                 * now we use that, but this should be updated
-                 * one day when the final limit is known. */
-                uint8_t buf[CMSG_SPACE(sizeof(struct ucred)) +
-                            CMSG_SPACE(sizeof(struct timeval)) +
-                            CMSG_SPACE(sizeof(int)) + /* fd */
-                            CMSG_SPACE(NAME_MAX)]; /* selinux label */
-        } control = {};
-
-        union sockaddr_union sa = {};
-
-        struct msghdr msghdr = {
-                .msg_iov = &iovec,
-                .msg_iovlen = 1,
-                .msg_control = &control,
-                .msg_controllen = sizeof(control),
-                .msg_name = &sa,
-                .msg_namelen = sizeof(sa),
-        };
-
         assert(s);
-        assert(fd == s->native_fd || fd == s->syslog_fd || fd == s->audit_fd);
-
-        if (revents != EPOLLIN) {
-                log_error("Got invalid event from epoll for datagram fd: %"PRIx32, revents);
-                return -EIO;
-        }
-
-        /* Try to get the right size, if we can. (Not all sockets support SIOCINQ, hence we just try, but don't rely on
-         * it.) */
-        (void) ioctl(fd, SIOCINQ, &v);
-
-        /* Fix it up, if it is too small. We use the same fixed value as auditd here. Awful! */
-        m = PAGE_ALIGN(MAX3((size_t) v + 1,
-                            (size_t) LINE_MAX,
-                            ALIGN(sizeof(struct nlmsghdr)) + ALIGN((size_t) MAX_AUDIT_MESSAGE_LENGTH)) + 1);
-
-        if (!GREEDY_REALLOC(s->buffer, s->buffer_size, m))
-                return log_oom();
+        assert(msghdr);
+        assert(buffer);
 
-        iovec.iov_base = s->buffer;
-        iovec.iov_len = s->buffer_size - 1; /* Leave room for trailing NUL we add later */
-
-        n = recvmsg(fd, &msghdr, MSG_DONTWAIT|MSG_CMSG_CLOEXEC);
-        if (n < 0) {
-                if (IN_SET(errno, EINTR, EAGAIN))
-                        return 0;
-
-                return log_error_errno(errno, "recvmsg() failed: %m");
-        }
-
-        CMSG_FOREACH(cmsg, &msghdr) {
+        CMSG_FOREACH(cmsg, msghdr) {
 
                 if (cmsg->cmsg_level == SOL_SOCKET &&
                     cmsg->cmsg_type == SCM_CREDENTIALS &&
@@ -1150,20 +1285,30 @@ int server_process_datagram(sd_event_source *es, int fd, uint32_t revents, void
                 }
         }
 
+        /* The rest of the datagram is gone, and half a message would only be misparsed */
+        if (msghdr->msg_flags & MSG_TRUNC) {
+                log_warning("Received truncated datagram of %zu bytes via %s socket, dropping.", n,
+                            fd == s->syslog_fd ? "syslog" : fd == s->native_fd ? "native" : "audit");
+                close_many(fds, n_fds);
+                return;
+        }
+
         /* And a trailing NUL, just in case */
-        s->buffer[n] = 0;
+        buffer[n] = 0;
 
         if (fd == s->syslog_fd) {
                 if (n > 0 && n_fds == 0)
-                        server_process_syslog_message(s, strstrip(s->buffer), ucred, tv, label, label_len);
+                        server_process_syslog_message(s, strstrip(buffer), ucred, tv, label, label_len);
                 else if (n_fds > 0)
                         log_warning("Got file descriptors via syslog socket. Ignoring.");
 
         } else if (fd == s->native_fd) {
                 if (n > 0 && n_fds == 0)
-                        server_process_native_message(s, s->buffer, n, ucred, tv, label, label_len);
+                        server_process_native_message(s, buffer, n, ucred, tv, label, label_len);
                 else if (n == 0 && n_fds == 1)
                         server_process_native_file(s, fds[0], ucred, tv, label, label_len);
+                else if (n == 0 && n_fds == 3)
+                        server_process_native_ring(s, fds, ucred, label, label_len);
                 else if (n_fds > 0)
                         log_warning("Got too many file descriptors via native socket. Ignoring.");
 
@@ -1171,12 +1316,135 @@ int server_process_datagram(sd_event_source *es, int fd, uint32_t revents, void
                 assert(fd == s->audit_fd);
 
                 if (n > 0 && n_fds == 0)
-                        server_process_audit_message(s, s->buffer, n, ucred, &sa, msghdr.msg_namelen);
+                        server_process_audit_message(s, buffer, n, ucred, msghdr->msg_name, msghdr->msg_namelen);
                 else if (n_fds > 0)
                         log_warning("Got file descriptors via audit socket. Ignoring.");
         }
 
         close_many(fds, n_fds);
+}
+
+static int server_reserve_buffer(Server *s, size_t size) {
+        char *p;
+
+        assert(s);
+
+        /* Unlike GREEDY_REALLOC() this doesn't round up, since batches of datagrams need a lot of space */
+
+        if (s->buffer_size >= size)
+                return 0;
+
+        p = realloc(s->buffer, size);
+        if (!p)
+                return -ENOMEM;
+
+        s->buffer = p;
+        s->buffer_size = size;
+        return 0;
+}
+
+int server_process_datagram(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        Server *s = userdata;
+        struct mmsghdr msgs[DATAGRAM_BATCH_MAX] = {};
+        struct iovec iovecs[DATAGRAM_BATCH_MAX];
+        DatagramControl control[DATAGRAM_BATCH_MAX];
+        union sockaddr_union sa[DATAGRAM_BATCH_MAX];
+        size_t m, i, n_batch;
+        int v = 0, n;
+
+        assert(s);
+        assert(fd == s->native_fd || fd == s->syslog_fd || fd == s->audit_fd);
+
+        if (revents != EPOLLIN) {
+                log_error("Got invalid event from epoll for datagram fd: %"PRIx32, revents);
+                return -EIO;
+        }
+
+        /* Try to get the right size, if we can. (Not all sockets support SIOCINQ, hence we just try, but don't rely on
+         * it.) */
+        (void) ioctl(fd, SIOCINQ, &v);
+
+        /* Fix it up, if it is too small. We use the same fixed value as auditd here. Awful! */
+        m = PAGE_ALIGN(MAX3((size_t) v + 1,
+                            (size_t) LINE_MAX,
+                            ALIGN(sizeof(struct nlmsghdr)) + ALIGN((size_t) MAX_AUDIT_MESSAGE_LENGTH)) + 1);
+
+        /* Under load we receive a number of datagrams with a single syscall. SIOCINQ only tells us the size of
+         * the first one, hence every slot of a batch is large enough for any datagram our clients can send.
+         * When the first datagram is even larger, or we can't get the memory for a batch, we read it on its
+         * own, sized from SIOCINQ as before. The number of slots follows the load we see, see below. */
+        n_batch = CLAMP(s->n_datagram_slots, 1U, DATAGRAM_BATCH_MAX);
+        if (n_batch > 1) {
+                if (m > DATAGRAM_SLOT_SIZE)
+                        n_batch = 1;
+                else if (server_reserve_buffer(s, DATAGRAM_SLOT_SIZE * n_batch) < 0)
+                        n_batch = s->n_datagram_slots = 1;
+                else
+                        m = DATAGRAM_SLOT_SIZE;
+        }
+
+        if (server_reserve_buffer(s, m * n_batch) < 0)
+                return log_oom();
+
+        for (i = 0; i < n_batch; i++) {
+                iovecs[i] = IOVEC_MAKE(s->buffer + i * m, m - 1); /* Leave room for trailing NUL we add later */
+
+                msgs[i].msg_hdr = (struct msghdr) {
+                        .msg_iov = iovecs + i,
+                        .msg_iovlen = 1,
+                        .msg_control = control + i,
+                        .msg_controllen = sizeof(control[i]),
+                        .msg_name = sa + i,
+                        .msg_namelen = sizeof(sa[i]),
+                };
+        }
+
+        n = recvmmsg(fd, msgs, n_batch, MSG_DONTWAIT|MSG_CMSG_CLOEXEC, NULL);
+        if (n < 0) {
+                if (IN_SET(errno, EINTR, EAGAIN))
+                        return 0;
+
+                return log_error_errno(errno, "recvmmsg() failed: %m");
+        }
+
+        /* Entries of priority CRIT and above are synced to disk right away, but do so only once for the whole
+         * batch */
+        s->dispatching_batch = true;
+
+        for (i = 0; i < (size_t) n; i++)
+                server_dispatch_datagram(s, fd, &msgs[i].msg_hdr, iovecs[i].iov_base, msgs[i].msg_len);
+
+        s->dispatching_batch = false;
+
+        if (s->sync_requested) {
+                s->sync_requested = false;
+                server_sync(s);
+        }
+
+        /* Double the number of slots when all of them were used and more datagrams are already queued, and
+         * halve it again (returning the memory) once the batches aren't filled anymore. */
+        if ((size_t) n == n_batch) {
+                v = 0;
+                if (n_batch < DATAGRAM_BATCH_MAX && ioctl(fd, SIOCINQ, &v) >= 0 && v > 0)
+                        s->n_datagram_slots = n_batch * 2;
+        } else if (n_batch > 1 && (size_t) n <= n_batch / 2) {
+                s->n_datagram_slots = n_batch / 2;
+
+                if (s->n_datagram_slots > 1) {
+                        char *p;
+
+                        p = realloc(s->buffer, m * s->n_datagram_slots);
+                        if (p) {
+                                s->buffer = p;
+                                s->buffer_size = m * s->n_datagram_slots;
+                        }
+                } else {
+                        /* Single datagrams are sized from SIOCINQ again, reallocated on the next call */
+                        s->buffer = mfree(s->buffer);
+                        s->buffer_size = 0;
+                }
+        }
+
         return 0;
 }
 
@@ -1422,53 +1690,90 @@ static int server_dispatch_sync(sd_event_source *es, usec_t t, void *userdata) {
         return 0;
 }
 
-int server_schedule_sync(Server *s, int priority) {
+static int server_arm_sync_timer(Server *s, usec_t delay) {
+        usec_t when;
         int r;
 
         assert(s);
 
-        if (priority <= LOG_CRIT) {
-                /* Immediately sync to disk when this is of priority CRIT, ALERT, EMERG */
-                server_sync(s);
-                return 0;
-        }
+        r = sd_event_now(s->event, CLOCK_MONOTONIC, &when);
+        if (r < 0)
+                return r;
 
-        if (s->sync_scheduled)
-                return 0;
+        when = usec_add(when, delay);
 
-        if (s->sync_interval_usec > 0) {
-                usec_t when;
+        if (s->sync_scheduled) {
+                usec_t t;
 
-                r = sd_event_now(s->event, CLOCK_MONOTONIC, &when);
+                /* Never postpone a sync that is already scheduled, but move it earlier if needed */
+                r = sd_event_source_get_time(s->sync_event_source, &t);
                 if (r < 0)
                         return r;
+                if (t <= when)
+                        return 0;
 
-                when += s->sync_interval_usec;
-
-                if (!s->sync_event_source) {
-                        r = sd_event_add_time(
-                                        s->event,
-                                        &s->sync_event_source,
-                                        CLOCK_MONOTONIC,
-                                        when, 0,
-                                        server_dispatch_sync, s);
-                        if (r < 0)
-                                return r;
+                return sd_event_source_set_time(s->sync_event_source, when);
+        }
 
-                        r = sd_event_source_set_priority(s->sync_event_source, SD_EVENT_PRIORITY_IMPORTANT);
-                } else {
-                        r = sd_event_source_set_time(s->sync_event_source, when);
-                        if (r < 0)
-                                return r;
+        if (!s->sync_event_source) {
+                r = sd_event_add_time(
+                                s->event,
+                                &s->sync_event_source,
+                                CLOCK_MONOTONIC,
+                                when, 0,
+                                server_dispatch_sync, s);
+                if (r < 0)
+                        return r;
 
-                        r = sd_event_source_set_enabled(s->sync_event_source, SD_EVENT_ONESHOT);
-                }
+                r = sd_event_source_set_priority(s->sync_event_source, SD_EVENT_PRIORITY_IMPORTANT);
+        } else {
+                r = sd_event_source_set_time(s->sync_event_source, when);
                 if (r < 0)
                         return r;
 
-                s->sync_scheduled = true;
+                r = sd_event_source_set_enabled(s->sync_event_source, SD_EVENT_ONESHOT);
+        }
+        if (r < 0)
+                return r;
+
+        s->sync_scheduled = true;
+        return 0;
+}
+
+static void server_sync_now(Server *s) {
+        assert(s);
+
+        /* If we are processing a batch of messages, sync only once at its end. Similarly, if we are writing out
+         * the entries of the compression workers, sync once they are all written. */
+        if (s->dispatching_batch || server_compress_committing(s))
+                s->sync_requested = true;
+        else
+                server_sync(s);
+}
+
+int server_schedule_sync(Server *s, int priority) {
+        assert(s);
+
+        /* Bound the amount of data that isn't synced yet, if so configured */
+        if (s->sync_max_bytes > 0 && s->sync_pending_bytes >= s->sync_max_bytes) {
+                server_sync_now(s);
+                return 0;
+        }
+
+        if (priority <= LOG_CRIT) {
+                /* Sync to disk when this is of priority CRIT, ALERT, EMERG: immediately by default, or within the
+                 * configured window, so that bursts of such messages are synced together */
+                if (s->sync_critical_usec == 0) {
+                        server_sync_now(s);
+                        return 0;
+                }
+
+                return server_arm_sync_timer(s, s->sync_critical_usec);
         }
 
+        if (s->sync_interval_usec > 0)
+                return server_arm_sync_timer(s, s->sync_interval_usec);
+
         return 0;
 }
 
@@ -1511,6 +1816,47 @@ static int server_open_hostname(Server *s) {
         return 0;
 }
 
+static int dispatch_tail(sd_event_source *es, void *userdata) {
+        Server *s = userdata;
+        le64_t seqnum;
+        ssize_t n;
+
+        assert(s);
+
+        if (s->seqnum == s->tail_seqnum)
+                return 0;
+
+        /* Entries are written through the mapping, which doesn't generate inotify events. Followers watch
+         * this file instead of waiting for the post-change timer of the journal files to touch those. */
+        seqnum = htole64(s->seqnum);
+        n = pwrite(s->tail_fd, &seqnum, sizeof(seqnum), 0);
+        if (n != sizeof(seqnum)) {
+                log_warning_errno(n < 0 ? errno : EIO, "Failed to update %s, ignoring: %m", JOURNAL_TAIL_PATH);
+                return 0;
+        }
+
+        s->tail_seqnum = s->seqnum;
+        return 0;
+}
+
+static int server_open_tail(Server *s) {
+        int r;
+
+        assert(s);
+
+        s->tail_fd = open(JOURNAL_TAIL_PATH, O_RDWR|O_CREAT|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW, 0644);
+        if (s->tail_fd < 0) {
+                log_warning_errno(errno, "Failed to open %s, ignoring: %m", JOURNAL_TAIL_PATH);
+                return 0;
+        }
+
+        r = sd_event_add_post(s->event, &s->tail_event_source, dispatch_tail, s);
+        if (r < 0)
+                return log_error_errno(r, "Failed to add tail event source: %m");
+
+        return sd_event_source_set_enabled(s->tail_event_source, SD_EVENT_OFF);
+}
+
 static int dispatch_notify_event(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
         Server *s = userdata;
         int r;
@@ -1683,7 +2029,8 @@ int server_init(Server *s) {
         assert(s);
 
         zero(*s);
-        s->syslog_fd = s->native_fd = s->stdout_fd = s->dev_kmsg_fd = s->audit_fd = s->hostname_fd = s->notify_fd = -1;
+        s->syslog_fd = s->native_fd = s->stdout_fd = s->dev_kmsg_fd = s->audit_fd = s->hostname_fd = s->notify_fd = s->units_inotify_fd = -1;
+        s->tail_fd = -1;
         s->compress.enabled = true;
         s->compress.threshold_bytes = (uint64_t) -1;
         s->seal = true;
@@ -1846,10 +2193,17 @@ int server_init(Server *s) {
         if (r < 0)
                 return r;
 
+        r = server_open_tail(s);
+        if (r < 0)
+                return r;
+
         r = setup_signals(s);
         if (r < 0)
                 return r;
 
+        /* Failing to start the workers is not fatal, we'll just compress on the event loop then */
+        (void) server_compress_setup(s);
+
         s->udev = udev_new();
         if (!s->udev)
                 return -ENOMEM;
@@ -1876,6 +2230,7 @@ int server_init(Server *s) {
 
         (void) server_connect_notify(s);
 
+        (void) client_context_watch_units(s);
         (void) client_context_acquire_default(s);
 
         return system_journal_open(s, false);
@@ -1900,11 +2255,17 @@ void server_maybe_append_tags(Server *s) {
 void server_done(Server *s) {
         assert(s);
 
+        server_flush_native_rings(s);
+
+        server_compress_done(s);
+
         set_free_with_destructor(s->deferred_closes, journal_file_close);
 
         while (s->stdout_streams)
                 stdout_stream_free(s->stdout_streams);
 
+        server_flush_syslog_forward(s);
+
         client_context_flush_all(s);
 
         if (s->system_journal)
@@ -1929,6 +2290,9 @@ void server_done(Server *s) {
         sd_event_source_unref(s->hostname_event_source);
         sd_event_source_unref(s->notify_event_source);
         sd_event_source_unref(s->watchdog_event_source);
+        sd_event_source_unref(s->units_inotify_event_source);
+        sd_event_source_unref(s->tail_event_source);
+        sd_event_source_unref(s->syslog_forward_event_source);
         sd_event_unref(s->event);
 
         safe_close(s->syslog_fd);
@@ -1938,6 +2302,8 @@ void server_done(Server *s) {
         safe_close(s->audit_fd);
         safe_close(s->hostname_fd);
         safe_close(s->notify_fd);
+        safe_close(s->units_inotify_fd);
+        safe_close(s->tail_fd);
 
         if (s->rate_limit)
                 journal_rate_limit_free(s->rate_limit);
@@ -1945,6 +2311,11 @@ void server_done(Server *s) {
         if (s->kernel_seqnum)
                 munmap(s->kernel_seqnum, sizeof(uint64_t));
 
+        free(s->syslog_forward);
+        free(s->syslog_forward_buffer);
+
+        server_flush_kmsg_devices(s);
+
         free(s->buffer);
         free(s->tty_path);
         free(s->cgroup_root);
@@ -1952,6 +2323,9 @@ void server_done(Server *s) {
         free(s->runtime_storage.path);
         free(s->system_storage.path);
 
+        journal_vacuum_cache_free(s->runtime_storage.vacuum_cache);
+        journal_vacuum_cache_free(s->system_storage.vacuum_cache);
+
         if (s->mmap)
                 mmap_cache_unref(s->mmap);
 
@@ -13,12 +13,16 @@
 #include "sd-event.h"
 
 typedef struct Server Server;
+typedef struct SyslogForward SyslogForward;
 
 #include "conf-parser.h"
 #include "hashmap.h"
 #include "journal-file.h"
+#include "journal-vacuum.h"
+#include "journald-compress.h"
 #include "journald-context.h"
 #include "journald-rate-limit.h"
+#include "journald-ring.h"
 #include "journald-stream.h"
 #include "list.h"
 #include "prioq.h"
@@ -61,6 +65,8 @@ typedef struct JournalStorage {
 
         JournalMetrics metrics;
         JournalStorageSpace space;
+
+        JournalVacuumCache *vacuum_cache;
 } JournalStorage;
 
 struct Server {
@@ -97,16 +103,23 @@ struct Server {
 
         char *buffer;
         size_t buffer_size;
+        unsigned n_datagram_slots;
 
         JournalRateLimit *rate_limit;
         usec_t sync_interval_usec;
+        usec_t sync_critical_usec;
+        uint64_t sync_max_bytes;
         usec_t rate_limit_interval;
         unsigned rate_limit_burst;
+        uint64_t rate_limit_burst_bytes;
+        uint64_t rate_limit_slice_bytes;
 
         JournalStorage runtime_storage;
         JournalStorage system_storage;
 
         JournalCompressOptions compress;
+        unsigned compress_threads;
+        CompressWorkers *compress_workers;
         bool seal;
         bool read_kmsg;
 
@@ -118,6 +131,13 @@ struct Server {
         unsigned n_forward_syslog_missed;
         usec_t last_warn_forward_syslog_missed;
 
+        /* Messages to forward to syslog, sent in one go at the end of the event loop iteration */
+        SyslogForward *syslog_forward;
+        size_t n_syslog_forward, n_syslog_forward_allocated;
+        char *syslog_forward_buffer;
+        size_t syslog_forward_buffer_size, syslog_forward_buffer_allocated;
+        sd_event_source *syslog_forward_event_source;
+
         uint64_t var_available_timestamp;
 
         usec_t max_retention_usec;
@@ -128,6 +148,9 @@ struct Server {
         LIST_HEAD(StdoutStream, stdout_streams_notify_queue);
         unsigned n_stdout_streams;
 
+        LIST_HEAD(NativeRing, native_rings);
+        unsigned n_native_rings;
+
         char *tty_path;
 
         int max_level_store;
@@ -146,15 +169,25 @@ struct Server {
         struct udev *udev;
 
         uint64_t *kernel_seqnum;
+        Hashmap *kmsg_devices; /* device id → KmsgDevice, udev metadata for kernel messages */
+
+        /* The seqnum of the last entry, as announced to followers via JOURNAL_TAIL_PATH */
+        int tail_fd;
+        uint64_t tail_seqnum;
+        sd_event_source *tail_event_source;
+
         bool dev_kmsg_readable:1;
 
         bool send_watchdog:1;
         bool sent_notify_ready:1;
         bool sync_scheduled:1;
+        bool dispatching_batch:1;
+        bool sync_requested:1;
 
         char machine_id_field[sizeof("_MACHINE_ID=") + 32];
         char boot_id_field[sizeof("_BOOT_ID=") + 32];
         char *hostname_field;
+        uint64_t machine_id_hash, boot_id_hash, hostname_hash;
 
         /* Cached cgroup root, so that we don't have to query that all the time */
         char *cgroup_root;
@@ -163,12 +196,29 @@ struct Server {
 
         usec_t last_realtime_clock;
 
+        /* What was written since the last sync, and how long syncs take */
+        uint64_t sync_pending_entries;
+        uint64_t sync_pending_bytes;
+        uint64_t n_syncs;
+        usec_t sync_usec_total;
+        usec_t sync_usec_max;
+
+        /* How long rotations take */
+        uint64_t n_rotations;
+        usec_t rotate_usec_total;
+        usec_t rotate_usec_max;
+
         size_t line_max;
 
         /* Caching of client metadata */
         Hashmap *client_contexts;
         Prioq *client_contexts_lru;
 
+        /* Unit metadata shared by all client contexts of the same unit */
+        Hashmap *client_units;
+        int units_inotify_fd;
+        sd_event_source *units_inotify_event_source;
+
         ClientContext *my_context; /* the context of journald itself */
         ClientContext *pid1_context; /* the context of PID 1 */
 };
@@ -192,6 +242,7 @@ struct Server {
 
 void server_dispatch_message(Server *s, struct iovec *iovec, size_t n, size_t m, ClientContext *c, const struct timeval *tv, int priority, pid_t object_pid);
 void server_driver_message(Server *s, pid_t object_pid, const char *message_id, const char *format, ...) _sentinel_ _printf_(4,0);
+void server_write_entry(Server *s, uid_t uid, const struct iovec *iovec, size_t n, const dual_timestamp *ts, int priority, const CompressedField *compressed, size_t n_compressed);
 
 /* gperf lookup function */
 const struct ConfigPerfItem* journald_gperf_lookup(const char *key, GPERF_LEN_TYPE length);
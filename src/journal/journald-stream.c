@@ -40,6 +40,9 @@
 
 #define STDOUT_STREAMS_MAX 4096
 
+/* We keep some room in front of the data in the buffer, so that we can prefix each line with MESSAGE= in place */
+#define STDOUT_STREAM_HEADROOM STRLEN("MESSAGE=")
+
 typedef enum StdoutStreamState {
         STDOUT_STREAM_IDENTIFIER,
         STDOUT_STREAM_UNIT_ID,
@@ -70,6 +73,7 @@ struct StdoutStream {
         struct ucred ucred;
         char *label;
         char *identifier;
+        char *identifier_field; /* SYSLOG_IDENTIFIER= followed by the identifier, built on first use */
         char *unit_id;
         int priority;
         bool level_prefix:1;
@@ -121,6 +125,7 @@ void stdout_stream_free(StdoutStream *s) {
         safe_close(s->fd);
         free(s->label);
         free(s->identifier);
+        free(s->identifier_field);
         free(s->unit_id);
         free(s->state_file);
         free(s->buffer);
@@ -238,18 +243,22 @@ fail:
         return log_error_errno(r, "Failed to save stream data %s: %m", s->state_file);
 }
 
-static int stdout_stream_log(StdoutStream *s, const char *p, LineBreak line_break) {
+static int stdout_stream_log(StdoutStream *s, char *p, LineBreak line_break) {
         struct iovec *iovec;
         int priority;
         char syslog_priority[] = "PRIORITY=\0";
         char syslog_facility[STRLEN("SYSLOG_FACILITY=") + DECIMAL_STR_MAX(int) + 1];
-        _cleanup_free_ char *message = NULL, *syslog_identifier = NULL;
+        char *message;
         size_t n = 0, m;
         int r;
 
         assert(s);
         assert(p);
 
+        /* Note that this is called for every single line a service writes to stdout, hence we avoid any heap
+         * allocations here: the static fields are built once per stream, and the message refers to the receive
+         * buffer directly. */
+
         if (s->context)
                 (void) client_context_maybe_refresh(s->server, s->context, NULL, NULL, 0, NULL, USEC_INFINITY);
         else if (pid_is_valid(s->ucred.pid)) {
@@ -260,8 +269,12 @@ static int stdout_stream_log(StdoutStream *s, const char *p, LineBreak line_brea
 
         priority = s->priority;
 
-        if (s->level_prefix)
-                syslog_parse_priority(&p, &priority, false);
+        if (s->level_prefix) {
+                const char *q = p;
+
+                syslog_parse_priority(&q, &priority, false);
+                p = (char*) q;
+        }
 
         if (!client_context_test_priority(s->context, priority))
                 return 0;
@@ -296,9 +309,10 @@ static int stdout_stream_log(StdoutStream *s, const char *p, LineBreak line_brea
         }
 
         if (s->identifier) {
-                syslog_identifier = strappend("SYSLOG_IDENTIFIER=", s->identifier);
-                if (syslog_identifier)
-                        iovec[n++] = IOVEC_MAKE_STRING(syslog_identifier);
+                if (!s->identifier_field)
+                        s->identifier_field = strappend("SYSLOG_IDENTIFIER=", s->identifier);
+                if (s->identifier_field)
+                        iovec[n++] = IOVEC_MAKE_STRING(s->identifier_field);
         }
 
         if (line_break != LINE_BREAK_NEWLINE) {
@@ -313,9 +327,11 @@ static int stdout_stream_log(StdoutStream *s, const char *p, LineBreak line_brea
                 iovec[n++] = IOVEC_MAKE_STRING(c);
         }
 
-        message = strappend("MESSAGE=", p);
-        if (message)
-                iovec[n++] = IOVEC_MAKE_STRING(message);
+        /* The line always lies behind the headroom of the buffer, and whatever precedes it has been processed
+         * already, hence we may overwrite it */
+        assert(p >= s->buffer + STDOUT_STREAM_HEADROOM);
+        message = memcpy(p - STRLEN("MESSAGE="), "MESSAGE=", STRLEN("MESSAGE="));
+        iovec[n++] = IOVEC_MAKE_STRING(message);
 
         server_dispatch_message(s->server, iovec, n, m, s->context, NULL, priority, 0);
         return 0;
@@ -432,7 +448,7 @@ static int stdout_stream_scan(StdoutStream *s, bool force_flush) {
 
         assert(s);
 
-        p = s->buffer;
+        p = s->buffer + STDOUT_STREAM_HEADROOM;
         remaining = s->length;
 
         /* XXX: This function does nothing if (s->length == 0) */
@@ -480,8 +496,8 @@ static int stdout_stream_scan(StdoutStream *s, bool force_flush) {
                 remaining = 0;
         }
 
-        if (p > s->buffer) {
-                memmove(s->buffer, p, remaining);
+        if (p > s->buffer + STDOUT_STREAM_HEADROOM) {
+                memmove(s->buffer + STDOUT_STREAM_HEADROOM, p, remaining);
                 s->length = remaining;
         }
 
@@ -502,8 +518,8 @@ static int stdout_stream_process(sd_event_source *es, int fd, uint32_t revents,
         }
 
         /* If the buffer is full already (discounting the extra NUL we need), add room for another 1K */
-        if (s->length + 1 >= s->allocated) {
-                if (!GREEDY_REALLOC(s->buffer, s->allocated, s->length + 1 + 1024)) {
+        if (STDOUT_STREAM_HEADROOM + s->length + 1 >= s->allocated) {
+                if (!GREEDY_REALLOC(s->buffer, s->allocated, STDOUT_STREAM_HEADROOM + s->length + 1 + 1024)) {
                         log_oom();
                         goto terminate;
                 }
@@ -511,9 +527,9 @@ static int stdout_stream_process(sd_event_source *es, int fd, uint32_t revents,
 
         /* Try to make use of the allocated buffer in full, but never read more than the configured line size. Also,
          * always leave room for a terminating NUL we might need to add. */
-        limit = MIN(s->allocated - 1, s->server->line_max);
+        limit = MIN(s->allocated - STDOUT_STREAM_HEADROOM - 1, s->server->line_max);
 
-        l = read(s->fd, s->buffer + s->length, limit - s->length);
+        l = read(s->fd, s->buffer + STDOUT_STREAM_HEADROOM + s->length, limit - s->length);
         if (l < 0) {
                 if (errno == EAGAIN)
                         return 0;
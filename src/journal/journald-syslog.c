@@ -30,77 +30,183 @@
 /* Warn once every 30s if we missed syslog message */
 #define WARN_FORWARD_SYSLOG_MISSED_USEC (30 * USEC_PER_SEC)
 
-static void forward_syslog_iovec(Server *s, const struct iovec *iovec, unsigned n_iovec, const struct ucred *ucred, const struct timeval *tv) {
+/* How many messages, and how many bytes of them, we queue for syslog at most before sending them */
+#define SYSLOG_FORWARD_MAX 64U
+#define SYSLOG_FORWARD_BUFFER_MAX (256U*1024U)
+
+struct SyslogForward {
+        size_t offset;
+        size_t size;
+        struct ucred ucred;
+        bool has_ucred;
+};
+
+static int forward_syslog_post(sd_event_source *es, void *userdata) {
+        server_flush_syslog_forward(userdata);
+        return 0;
+}
+
+void server_flush_syslog_forward(Server *s) {
 
         static const union sockaddr_union sa = {
                 .un.sun_family = AF_UNIX,
                 .un.sun_path = "/run/systemd/journal/syslog",
         };
-        struct msghdr msghdr = {
-                .msg_iov = (struct iovec *) iovec,
-                .msg_iovlen = n_iovec,
-                .msg_name = (struct sockaddr*) &sa.sa,
-                .msg_namelen = SOCKADDR_UN_LEN(sa.un),
-        };
-        struct cmsghdr *cmsg;
-        union {
+        union control {
                 struct cmsghdr cmsghdr;
                 uint8_t buf[CMSG_SPACE(sizeof(struct ucred))];
-        } control;
+        } control[SYSLOG_FORWARD_MAX];
+        struct iovec iovec[SYSLOG_FORWARD_MAX];
+        struct mmsghdr msgs[SYSLOG_FORWARD_MAX];
+        size_t i, n;
 
         assert(s);
-        assert(iovec);
-        assert(n_iovec > 0);
 
-        if (ucred) {
-                zero(control);
-                msghdr.msg_control = &control;
-                msghdr.msg_controllen = sizeof(control);
-
-                cmsg = CMSG_FIRSTHDR(&msghdr);
-                cmsg->cmsg_level = SOL_SOCKET;
-                cmsg->cmsg_type = SCM_CREDENTIALS;
-                cmsg->cmsg_len = CMSG_LEN(sizeof(struct ucred));
-                memcpy(CMSG_DATA(cmsg), ucred, sizeof(struct ucred));
-                msghdr.msg_controllen = cmsg->cmsg_len;
-        }
+        n = s->n_syslog_forward;
+        if (n == 0)
+                return;
 
-        /* Forward the syslog message we received via /dev/log to
+        assert(n <= SYSLOG_FORWARD_MAX);
+
+        /* Forward the syslog messages we received via /dev/log to
          * /run/systemd/syslog. Unfortunately we currently can't set
          * the SO_TIMESTAMP auxiliary data, and hence we don't. */
 
-        if (sendmsg(s->syslog_fd, &msghdr, MSG_NOSIGNAL) >= 0)
-                return;
+        zero(control);
+        for (i = 0; i < n; i++) {
+                SyslogForward *f = s->syslog_forward + i;
 
-        /* The socket is full? I guess the syslog implementation is
-         * too slow, and we shouldn't wait for that... */
-        if (errno == EAGAIN) {
-                s->n_forward_syslog_missed++;
-                return;
+                iovec[i] = IOVEC_MAKE(s->syslog_forward_buffer + f->offset, f->size);
+
+                msgs[i] = (struct mmsghdr) {
+                        .msg_hdr.msg_iov = iovec + i,
+                        .msg_hdr.msg_iovlen = 1,
+                        .msg_hdr.msg_name = (struct sockaddr*) &sa.sa,
+                        .msg_hdr.msg_namelen = SOCKADDR_UN_LEN(sa.un),
+                };
+
+                if (f->has_ucred) {
+                        struct cmsghdr *cmsg;
+
+                        msgs[i].msg_hdr.msg_control = control + i;
+                        msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+
+                        cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr);
+                        cmsg->cmsg_level = SOL_SOCKET;
+                        cmsg->cmsg_type = SCM_CREDENTIALS;
+                        cmsg->cmsg_len = CMSG_LEN(sizeof(struct ucred));
+                        memcpy(CMSG_DATA(cmsg), &f->ucred, sizeof(struct ucred));
+                        msgs[i].msg_hdr.msg_controllen = cmsg->cmsg_len;
+                }
         }
 
-        if (ucred && IN_SET(errno, ESRCH, EPERM)) {
-                struct ucred u;
+        s->n_syslog_forward = 0;
+        s->syslog_forward_buffer_size = 0;
 
-                /* Hmm, presumably the sender process vanished
-                 * by now, or we don't have CAP_SYS_AMDIN, so
-                 * let's fix it as good as we can, and retry */
+        i = 0;
+        while (i < n) {
+                bool retried = false;
+                int k;
 
-                u = *ucred;
-                u.pid = getpid_cached();
-                memcpy(CMSG_DATA(cmsg), &u, sizeof(struct ucred));
+                k = sendmmsg(s->syslog_fd, msgs + i, n - i, MSG_NOSIGNAL);
+                if (k > 0) {
+                        i += k;
+                        continue;
+                }
+
+                /* The socket is full? I guess the syslog implementation is
+                 * too slow, and we shouldn't wait for that... */
+                if (errno == EAGAIN) {
+                        s->n_forward_syslog_missed += n - i;
+                        return;
+                }
 
-                if (sendmsg(s->syslog_fd, &msghdr, MSG_NOSIGNAL) >= 0)
+                /* Nobody listening, don't bother with the rest */
+                if (errno == ENOENT)
                         return;
 
-                if (errno == EAGAIN) {
+                if (msgs[i].msg_hdr.msg_control && IN_SET(errno, ESRCH, EPERM)) {
+                        struct ucred u;
+
+                        /* Hmm, presumably the sender process vanished
+                         * by now, or we don't have CAP_SYS_AMDIN, so
+                         * let's fix it as good as we can, and retry */
+
+                        memcpy(&u, CMSG_DATA(CMSG_FIRSTHDR(&msgs[i].msg_hdr)), sizeof(struct ucred));
+                        if (u.pid != getpid_cached()) {
+                                u.pid = getpid_cached();
+                                memcpy(CMSG_DATA(CMSG_FIRSTHDR(&msgs[i].msg_hdr)), &u, sizeof(struct ucred));
+                                retried = true;
+                        }
+                }
+
+                if (!retried) {
+                        log_debug_errno(errno, "Failed to forward syslog message: %m");
+                        i++;
+                }
+        }
+}
+
+static void forward_syslog_iovec(Server *s, const struct iovec *iovec, unsigned n_iovec, const struct ucred *ucred, const struct timeval *tv) {
+        SyslogForward *f;
+        size_t size;
+        unsigned i;
+        int r;
+
+        assert(s);
+        assert(iovec);
+        assert(n_iovec > 0);
+
+        /* Messages are queued until the end of the event loop iteration, so that we pass all messages of a
+         * batch to the syslog socket with a single sendmmsg() */
+
+        size = IOVEC_TOTAL_SIZE(iovec, n_iovec);
+        if (size > SYSLOG_FORWARD_BUFFER_MAX)
+                size = SYSLOG_FORWARD_BUFFER_MAX;
+
+        if (s->n_syslog_forward >= SYSLOG_FORWARD_MAX ||
+            s->syslog_forward_buffer_size + size > SYSLOG_FORWARD_BUFFER_MAX)
+                server_flush_syslog_forward(s);
+
+        if (!s->syslog_forward_event_source) {
+                r = sd_event_add_post(s->event, &s->syslog_forward_event_source, forward_syslog_post, s);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to allocate syslog forwarding event source: %m");
                         s->n_forward_syslog_missed++;
                         return;
                 }
         }
 
-        if (errno != ENOENT)
-                log_debug_errno(errno, "Failed to forward syslog message: %m");
+        if (!GREEDY_REALLOC(s->syslog_forward, s->n_syslog_forward_allocated, s->n_syslog_forward + 1) ||
+            !GREEDY_REALLOC(s->syslog_forward_buffer, s->syslog_forward_buffer_allocated, s->syslog_forward_buffer_size + size)) {
+                log_oom();
+                s->n_forward_syslog_missed++;
+                return;
+        }
+
+        r = sd_event_source_set_enabled(s->syslog_forward_event_source, SD_EVENT_ONESHOT);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to enable syslog forwarding event source: %m");
+                s->n_forward_syslog_missed++;
+                return;
+        }
+
+        f = s->syslog_forward + s->n_syslog_forward++;
+        *f = (SyslogForward) {
+                .offset = s->syslog_forward_buffer_size,
+                .has_ucred = !!ucred,
+        };
+        if (ucred)
+                f->ucred = *ucred;
+
+        for (i = 0; i < n_iovec && f->size < size; i++) {
+                size_t l = MIN(iovec[i].iov_len, size - f->size);
+
+                memcpy(s->syslog_forward_buffer + f->offset + f->size, iovec[i].iov_base, l);
+                f->size += l;
+        }
+
+        s->syslog_forward_buffer_size += f->size;
 }
 
 static void forward_syslog_raw(Server *s, int priority, const char *buffer, const struct ucred *ucred, const struct timeval *tv) {
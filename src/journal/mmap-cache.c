@@ -6,6 +6,8 @@
 ***/
 
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <sys/mman.h>
 
@@ -16,14 +18,17 @@
 #include "log.h"
 #include "macro.h"
 #include "mmap-cache.h"
+#include "parse-util.h"
 #include "sigbus.h"
+#include "siphash24.h"
 #include "util.h"
 
 typedef struct Window Window;
 typedef struct Context Context;
+typedef struct MMapPool MMapPool;
 
 struct Window {
-        MMapCache *cache;
+        MMapPool *pool;
 
         bool invalidated:1;
         bool keep_always:1;
@@ -47,46 +52,200 @@ struct Context {
         unsigned id;
         Window *window;
 
+        /* The size of the next window we map for this context, and the range the last one covered, for
+         * detecting sequential access */
+        uint64_t window_size;
+        uint64_t last_offset;
+        uint64_t last_size;
+
         LIST_FIELDS(Context, by_window);
 };
 
+typedef struct FileId {
+        dev_t dev;
+        ino_t ino;
+} FileId;
+
 struct MMapFileDescriptor {
-        MMapCache *cache;
+        MMapPool *pool;
         int fd;
         bool sigbus;
         LIST_HEAD(Window, windows);
+
+        /* Only used by the shared pool: files are looked up by inode there, each cache adding them takes a
+         * reference, and the pool maps a duplicate of the fd it owns itself. */
+        FileId id;
+        unsigned n_ref;
 };
 
-struct MMapCache {
-        int n_ref;
+/* The windows and the files they map. A private pool belongs to a single cache and is only ever used by one
+ * thread at a time, like everything else in sd-journal. The shared one is used by all caches created with
+ * mmap_cache_new_shared() in the process, so that threads each reading the same files through their own
+ * sd_journal object map them only once. All of it is protected by the mutex then. */
+struct MMapPool {
+        unsigned n_ref;
+        bool shared;
+        pthread_mutex_t mutex;
+
         unsigned n_windows;
 
-        unsigned n_hit, n_missed;
+        uint64_t window_size_min, window_size_max;
 
         Hashmap *fds;
-        Context *contexts[MMAP_CACHE_MAX_CONTEXTS];
 
         LIST_HEAD(Window, unused);
         Window *last_unused;
 };
 
+struct MMapCache {
+        int n_ref;
+        MMapPool *pool;
+
+        unsigned n_context_cache_hit, n_window_list_hit, n_missed, n_sequential;
+
+        Context *contexts[MMAP_CACHE_MAX_CONTEXTS];
+};
+
 #define WINDOWS_MIN 64
 
 #if ENABLE_DEBUG_MMAP_CACHE
 /* Tiny windows increase mmap activity and the chance of exposing unsafe use. */
-# define WINDOW_SIZE (page_size())
+# define WINDOW_SIZE_MIN (page_size())
+# define WINDOW_SIZE_MAX (page_size())
 #else
-# define WINDOW_SIZE (8ULL*1024ULL*1024ULL)
+# define WINDOW_SIZE_MIN (8ULL*1024ULL*1024ULL)
+/* Windows grow up to this size while a context is accessed sequentially. Let's not eat up the
+ * address space of 32bit machines with that though. */
+# define WINDOW_SIZE_MAX (sizeof(void*) > 4 ? 64ULL*1024ULL*1024ULL : WINDOW_SIZE_MIN)
 #endif
 
-MMapCache* mmap_cache_new(void) {
+static pthread_mutex_t shared_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static MMapPool *shared_pool = NULL;
+
+static void file_id_hash_func(const void *p, struct siphash *state) {
+        const FileId *id = p;
+
+        siphash24_compress(&id->dev, sizeof(id->dev), state);
+        siphash24_compress(&id->ino, sizeof(id->ino), state);
+}
+
+static int file_id_compare_func(const void *a, const void *b) {
+        const FileId *x = a, *y = b;
+
+        if (x->dev != y->dev)
+                return x->dev < y->dev ? -1 : 1;
+        if (x->ino != y->ino)
+                return x->ino < y->ino ? -1 : 1;
+
+        return 0;
+}
+
+static const struct hash_ops file_id_hash_ops = {
+        .hash = file_id_hash_func,
+        .compare = file_id_compare_func,
+};
+
+static void parse_window_size_env(const char *name, uint64_t *ret) {
+        const char *e;
+        uint64_t sz;
+
+        assert(name);
+        assert(ret);
+
+        e = secure_getenv(name);
+        if (!e)
+                return;
+
+        if (parse_size(e, 1024, &sz) < 0 || sz < page_size() || sz > SIZE_MAX / 2) {
+                log_debug("Failed to parse $%s, ignoring: %s", name, e);
+                return;
+        }
+
+        *ret = PAGE_ALIGN(sz);
+}
+
+static inline void pool_lock(MMapPool *p) {
+        if (p->shared)
+                assert_se(pthread_mutex_lock(&p->mutex) == 0);
+}
+
+static inline void pool_unlock(MMapPool *p) {
+        if (p->shared)
+                assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+}
+
+static MMapPool* pool_new(bool shared) {
+        MMapPool *p;
+
+        p = new0(MMapPool, 1);
+        if (!p)
+                return NULL;
+
+        if (shared && pthread_mutex_init(&p->mutex, NULL) != 0)
+                return mfree(p);
+
+        p->n_ref = 1;
+        p->shared = shared;
+
+        p->window_size_min = WINDOW_SIZE_MIN;
+        p->window_size_max = WINDOW_SIZE_MAX;
+        parse_window_size_env("SYSTEMD_JOURNAL_MMAP_WINDOW_MIN", &p->window_size_min);
+        parse_window_size_env("SYSTEMD_JOURNAL_MMAP_WINDOW_MAX", &p->window_size_max);
+        p->window_size_max = MAX(p->window_size_max, p->window_size_min);
+
+        return p;
+}
+
+static MMapCache* cache_new(MMapPool *p) {
         MMapCache *m;
 
+        assert(p);
+
         m = new0(MMapCache, 1);
         if (!m)
                 return NULL;
 
         m->n_ref = 1;
+        m->pool = p;
+
+        return m;
+}
+
+MMapCache* mmap_cache_new(void) {
+        MMapCache *m;
+        MMapPool *p;
+
+        p = pool_new(false);
+        if (!p)
+                return NULL;
+
+        m = cache_new(p);
+        if (!m)
+                return mfree(p);
+
+        return m;
+}
+
+MMapCache* mmap_cache_new_shared(void) {
+        MMapCache *m = NULL;
+
+        assert_se(pthread_mutex_lock(&shared_pool_mutex) == 0);
+
+        if (shared_pool)
+                shared_pool->n_ref++;
+        else
+                shared_pool = pool_new(true);
+
+        if (shared_pool) {
+                m = cache_new(shared_pool);
+                if (!m && --shared_pool->n_ref == 0) {
+                        assert_se(pthread_mutex_destroy(&shared_pool->mutex) == 0);
+                        shared_pool = mfree(shared_pool);
+                }
+        }
+
+        assert_se(pthread_mutex_unlock(&shared_pool_mutex) == 0);
+
         return m;
 }
 
@@ -110,10 +269,10 @@ static void window_unlink(Window *w) {
                 LIST_REMOVE(by_fd, w->fd->windows, w);
 
         if (w->in_unused) {
-                if (w->cache->last_unused == w)
-                        w->cache->last_unused = w->unused_prev;
+                if (w->pool->last_unused == w)
+                        w->pool->last_unused = w->unused_prev;
 
-                LIST_REMOVE(unused, w->cache->unused, w);
+                LIST_REMOVE(unused, w->pool->unused, w);
         }
 
         LIST_FOREACH(by_window, c, w->contexts) {
@@ -141,7 +300,7 @@ static void window_free(Window *w) {
         assert(w);
 
         window_unlink(w);
-        w->cache->n_windows--;
+        w->pool->n_windows--;
         free(w);
 }
 
@@ -165,28 +324,28 @@ _pure_ static bool window_matches_fd(Window *w, MMapFileDescriptor *f, int prot,
                 window_matches(w, prot, offset, size);
 }
 
-static Window *window_add(MMapCache *m, MMapFileDescriptor *f, int prot, bool keep_always, uint64_t offset, size_t size, void *ptr) {
+static Window *window_add(MMapPool *p, MMapFileDescriptor *f, int prot, bool keep_always, uint64_t offset, size_t size, void *ptr) {
         Window *w;
 
-        assert(m);
+        assert(p);
         assert(f);
 
-        if (!m->last_unused || m->n_windows <= WINDOWS_MIN) {
+        if (!p->last_unused || p->n_windows <= WINDOWS_MIN) {
 
                 /* Allocate a new window */
                 w = new0(Window, 1);
                 if (!w)
                         return NULL;
-                m->n_windows++;
+                p->n_windows++;
         } else {
 
                 /* Reuse an existing one */
-                w = m->last_unused;
+                w = p->last_unused;
                 window_unlink(w);
                 zero(*w);
         }
 
-        w->cache = m;
+        w->pool = p;
         w->fd = f;
         w->prot = prot;
         w->keep_always = keep_always;
@@ -200,6 +359,7 @@ static Window *window_add(MMapCache *m, MMapFileDescriptor *f, int prot, bool ke
 }
 
 static void context_detach_window(Context *c) {
+        MMapPool *p;
         Window *w;
 
         assert(c);
@@ -207,6 +367,7 @@ static void context_detach_window(Context *c) {
         if (!c->window)
                 return;
 
+        p = c->cache->pool;
         w = TAKE_PTR(c->window);
         LIST_REMOVE(by_window, w->contexts, c);
 
@@ -217,9 +378,9 @@ static void context_detach_window(Context *c) {
                  * by SIGSEGV. */
                 window_free(w);
 #else
-                LIST_PREPEND(unused, c->cache->unused, w);
-                if (!c->cache->last_unused)
-                        c->cache->last_unused = w;
+                LIST_PREPEND(unused, p->unused, w);
+                if (!p->last_unused)
+                        p->last_unused = w;
 
                 w->in_unused = true;
 #endif
@@ -227,6 +388,8 @@ static void context_detach_window(Context *c) {
 }
 
 static void context_attach_window(Context *c, Window *w) {
+        MMapPool *p;
+
         assert(c);
         assert(w);
 
@@ -235,17 +398,21 @@ static void context_attach_window(Context *c, Window *w) {
 
         context_detach_window(c);
 
+        p = c->cache->pool;
         if (w->in_unused) {
                 /* Used again? */
-                LIST_REMOVE(unused, c->cache->unused, w);
-                if (c->cache->last_unused == w)
-                        c->cache->last_unused = w->unused_prev;
+                LIST_REMOVE(unused, p->unused, w);
+                if (p->last_unused == w)
+                        p->last_unused = w->unused_prev;
 
                 w->in_unused = false;
         }
 
         c->window = w;
         LIST_PREPEND(by_window, w->contexts, c);
+
+        c->last_offset = w->offset;
+        c->last_size = w->size;
 }
 
 static Context *context_add(MMapCache *m, unsigned id) {
@@ -263,6 +430,7 @@ static Context *context_add(MMapCache *m, unsigned id) {
 
         c->cache = m;
         c->id = id;
+        c->window_size = m->pool->window_size_min;
 
         assert(!m->contexts[id]);
         m->contexts[id] = c;
@@ -283,20 +451,54 @@ static void context_free(Context *c) {
         free(c);
 }
 
+static void pool_free(MMapPool *p) {
+        assert(p);
+
+        hashmap_free(p->fds);
+
+        while (p->unused)
+                window_free(p->unused);
+
+        if (p->shared)
+                assert_se(pthread_mutex_destroy(&p->mutex) == 0);
+
+        free(p);
+}
+
+static void pool_unref(MMapPool *p) {
+        assert(p);
+
+        if (!p->shared) {
+                pool_free(p);
+                return;
+        }
+
+        assert_se(pthread_mutex_lock(&shared_pool_mutex) == 0);
+
+        assert(p->n_ref > 0);
+        if (--p->n_ref == 0) {
+                assert(shared_pool == p);
+                shared_pool = NULL;
+                pool_free(p);
+        }
+
+        assert_se(pthread_mutex_unlock(&shared_pool_mutex) == 0);
+}
+
 static void mmap_cache_free(MMapCache *m) {
         int i;
 
         assert(m);
 
+        pool_lock(m->pool);
+
         for (i = 0; i < MMAP_CACHE_MAX_CONTEXTS; i++)
                 if (m->contexts[i])
                         context_free(m->contexts[i]);
 
-        hashmap_free(m->fds);
-
-        while (m->unused)
-                window_free(m->unused);
+        pool_unlock(m->pool);
 
+        pool_unref(m->pool);
         free(m);
 }
 
@@ -314,13 +516,13 @@ MMapCache* mmap_cache_unref(MMapCache *m) {
         return NULL;
 }
 
-static int make_room(MMapCache *m) {
-        assert(m);
+static int make_room(MMapPool *p) {
+        assert(p);
 
-        if (!m->last_unused)
+        if (!p->last_unused)
                 return 0;
 
-        window_free(m->last_unused);
+        window_free(p->last_unused);
         return 1;
 }
 
@@ -430,7 +632,7 @@ static int mmap_try_harder(MMapCache *m, void *addr, MMapFileDescriptor *f, int
                 if (errno != ENOMEM)
                         return negative_errno();
 
-                r = make_room(m);
+                r = make_room(m->pool);
                 if (r < 0)
                         return r;
                 if (r == 0)
@@ -453,7 +655,8 @@ static int add_mmap(
                 void **ret,
                 size_t *ret_size) {
 
-        uint64_t woffset, wsize;
+        uint64_t woffset, wsize, moffset, msize;
+        bool forward, backward;
         Context *c;
         Window *w;
         void *d;
@@ -465,21 +668,48 @@ static int add_mmap(
         assert(size > 0);
         assert(ret);
 
-        woffset = offset & ~((uint64_t) page_size() - 1ULL);
-        wsize = size + (offset - woffset);
-        wsize = PAGE_ALIGN(wsize);
+        c = context_add(m, context);
+        if (!c)
+                return -ENOMEM;
 
-        if (wsize < WINDOW_SIZE) {
+        moffset = offset & ~((uint64_t) page_size() - 1ULL);
+        msize = PAGE_ALIGN(size + (offset - moffset));
+
+        /* If the context moves on right past the window it used before, it is probably used for
+         * scanning the file, hence map bigger windows ahead of (or behind) it each time, and let the
+         * kernel start reading them. Otherwise fall back to small windows around the object. */
+        forward = c->last_size > 0 &&
+                offset >= c->last_offset + c->last_size &&
+                offset < c->last_offset + c->last_size + c->window_size;
+        backward = c->last_size > 0 &&
+                offset < c->last_offset &&
+                offset + size + c->window_size > c->last_offset;
+
+        if (forward || backward) {
+                c->window_size = MIN(c->window_size * 2, m->pool->window_size_max);
+                m->n_sequential++;
+        } else
+                c->window_size = m->pool->window_size_min;
+
+        woffset = moffset;
+        wsize = msize;
+
+        if (wsize < c->window_size) {
                 uint64_t delta;
 
-                delta = PAGE_ALIGN((WINDOW_SIZE - wsize) / 2);
+                if (forward)
+                        delta = 0;
+                else if (backward)
+                        delta = c->window_size - wsize;
+                else
+                        delta = PAGE_ALIGN((c->window_size - wsize) / 2);
 
-                if (delta > offset)
+                if (delta > woffset)
                         woffset = 0;
                 else
                         woffset -= delta;
 
-                wsize = WINDOW_SIZE;
+                wsize = c->window_size;
         }
 
         if (st) {
@@ -495,14 +725,22 @@ static int add_mmap(
         }
 
         r = mmap_try_harder(m, NULL, f, prot, MAP_SHARED, woffset, wsize, &d);
+        if (r == -ENOMEM && wsize > msize) {
+                /* Short on address space? Then map only what is needed, and start small again */
+                c->window_size = m->pool->window_size_min;
+                woffset = moffset;
+                wsize = msize;
+
+                r = mmap_try_harder(m, NULL, f, prot, MAP_SHARED, woffset, wsize, &d);
+        }
         if (r < 0)
                 return r;
 
-        c = context_add(m, context);
-        if (!c)
-                goto outofmem;
+        /* Writers only touch the tail of the file, but readers scanning it benefit from read-ahead */
+        if ((forward || backward) && !(prot & PROT_WRITE))
+                (void) madvise(d, wsize, MADV_WILLNEED);
 
-        w = window_add(m, f, prot, keep_always, woffset, wsize, d);
+        w = window_add(m->pool, f, prot, keep_always, woffset, wsize, d);
         if (!w)
                 goto outofmem;
 
@@ -540,45 +778,53 @@ int mmap_cache_get(
         assert(ret);
         assert(context < MMAP_CACHE_MAX_CONTEXTS);
 
+        pool_lock(m->pool);
+
         /* Check whether the current context is the right one already */
         r = try_context(m, f, prot, context, keep_always, offset, size, ret, ret_size);
         if (r != 0) {
-                m->n_hit++;
-                return r;
+                m->n_context_cache_hit++;
+                goto finish;
         }
 
         /* Search for a matching mmap */
         r = find_mmap(m, f, prot, context, keep_always, offset, size, ret, ret_size);
         if (r != 0) {
-                m->n_hit++;
-                return r;
+                m->n_window_list_hit++;
+                goto finish;
         }
 
         m->n_missed++;
 
         /* Create a new mmap */
-        return add_mmap(m, f, prot, context, keep_always, offset, size, st, ret, ret_size);
-}
+        r = add_mmap(m, f, prot, context, keep_always, offset, size, st, ret, ret_size);
 
-unsigned mmap_cache_get_hit(MMapCache *m) {
-        assert(m);
-
-        return m->n_hit;
+finish:
+        pool_unlock(m->pool);
+        return r;
 }
 
-unsigned mmap_cache_get_missed(MMapCache *m) {
+void mmap_cache_stats_log_debug(MMapCache *m) {
+        unsigned n_windows;
+
         assert(m);
 
-        return m->n_missed;
+        pool_lock(m->pool);
+        n_windows = m->pool->n_windows;
+        pool_unlock(m->pool);
+
+        log_debug("mmap cache statistics: %u context cache hit, %u window list hit, %u miss (%u sequential), %u windows%s",
+                  m->n_context_cache_hit, m->n_window_list_hit, m->n_missed, m->n_sequential, n_windows,
+                  m->pool->shared ? " (shared)" : "");
 }
 
-static void mmap_cache_process_sigbus(MMapCache *m) {
+static void mmap_cache_process_sigbus(MMapPool *p) {
         bool found = false;
         MMapFileDescriptor *f;
         Iterator i;
         int r;
 
-        assert(m);
+        assert(p);
 
         /* Iterate through all triggered pages and mark their files as
          * invalidated */
@@ -595,7 +841,7 @@ static void mmap_cache_process_sigbus(MMapCache *m) {
                 }
 
                 ours = false;
-                HASHMAP_FOREACH(f, m->fds, i) {
+                HASHMAP_FOREACH(f, p->fds, i) {
                         Window *w;
 
                         LIST_FOREACH(by_fd, w, f->windows) {
@@ -624,7 +870,7 @@ static void mmap_cache_process_sigbus(MMapCache *m) {
         if (_likely_(!found))
                 return;
 
-        HASHMAP_FOREACH(f, m->fds, i) {
+        HASHMAP_FOREACH(f, p->fds, i) {
                 Window *w;
 
                 if (!f->sigbus)
@@ -636,26 +882,34 @@ static void mmap_cache_process_sigbus(MMapCache *m) {
 }
 
 bool mmap_cache_got_sigbus(MMapCache *m, MMapFileDescriptor *f) {
+        bool sigbus;
+
         assert(m);
         assert(f);
 
-        mmap_cache_process_sigbus(m);
+        pool_lock(m->pool);
 
-        return f->sigbus;
+        mmap_cache_process_sigbus(m->pool);
+        sigbus = f->sigbus;
+
+        pool_unlock(m->pool);
+
+        return sigbus;
 }
 
-MMapFileDescriptor* mmap_cache_add_fd(MMapCache *m, int fd) {
+static MMapFileDescriptor* pool_add_fd(MMapPool *p, int fd) {
         MMapFileDescriptor *f;
         int r;
 
-        assert(m);
+        assert(p);
+        assert(!p->shared);
         assert(fd >= 0);
 
-        f = hashmap_get(m->fds, FD_TO_PTR(fd));
+        f = hashmap_get(p->fds, FD_TO_PTR(fd));
         if (f)
                 return f;
 
-        r = hashmap_ensure_allocated(&m->fds, NULL);
+        r = hashmap_ensure_allocated(&p->fds, NULL);
         if (r < 0)
                 return NULL;
 
@@ -663,31 +917,124 @@ MMapFileDescriptor* mmap_cache_add_fd(MMapCache *m, int fd) {
         if (!f)
                 return NULL;
 
-        f->cache = m;
+        f->pool = p;
         f->fd = fd;
 
-        r = hashmap_put(m->fds, FD_TO_PTR(fd), f);
+        r = hashmap_put(p->fds, FD_TO_PTR(fd), f);
+        if (r < 0)
+                return mfree(f);
+
+        return f;
+}
+
+static MMapFileDescriptor* pool_add_fd_shared(MMapPool *p, int fd) {
+        _cleanup_close_ int copy = -1;
+        MMapFileDescriptor *f;
+        struct stat st;
+        FileId id;
+        int r;
+
+        assert(p);
+        assert(p->shared);
+        assert(fd >= 0);
+
+        if (fstat(fd, &st) < 0)
+                return NULL;
+
+        id = (FileId) {
+                .dev = st.st_dev,
+                .ino = st.st_ino,
+        };
+
+        f = hashmap_get(p->fds, &id);
+        if (f) {
+                f->n_ref++;
+                return f;
+        }
+
+        r = hashmap_ensure_allocated(&p->fds, &file_id_hash_ops);
+        if (r < 0)
+                return NULL;
+
+        /* The file might outlive the JournalFile that added it, if others still use it */
+        copy = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+        if (copy < 0)
+                return NULL;
+
+        f = new0(MMapFileDescriptor, 1);
+        if (!f)
+                return NULL;
+
+        f->pool = p;
+        f->id = id;
+        f->n_ref = 1;
+
+        r = hashmap_put(p->fds, &f->id, f);
         if (r < 0)
                 return mfree(f);
 
+        f->fd = TAKE_FD(copy);
+
+        return f;
+}
+
+MMapFileDescriptor* mmap_cache_add_fd(MMapCache *m, int fd) {
+        MMapFileDescriptor *f;
+
+        assert(m);
+        assert(fd >= 0);
+
+        if (!m->pool->shared)
+                return pool_add_fd(m->pool, fd);
+
+        pool_lock(m->pool);
+        f = pool_add_fd_shared(m->pool, fd);
+        pool_unlock(m->pool);
+
         return f;
 }
 
 void mmap_cache_free_fd(MMapCache *m, MMapFileDescriptor *f) {
+        MMapPool *p;
+        unsigned i;
+
         assert(m);
         assert(f);
 
+        p = m->pool;
+        assert(f->pool == p);
+
+        pool_lock(p);
+
         /* Make sure that any queued SIGBUS are first dispatched, so
          * that we don't end up with a SIGBUS entry we cannot relate
          * to any existing memory map */
 
-        mmap_cache_process_sigbus(m);
+        mmap_cache_process_sigbus(p);
+
+        if (p->shared) {
+                /* Others might still use the file. Let go of the windows our own contexts hold on to, the
+                 * pool recycles them once nobody else does either. */
+                for (i = 0; i < MMAP_CACHE_MAX_CONTEXTS; i++)
+                        if (m->contexts[i] && m->contexts[i]->window && m->contexts[i]->window->fd == f)
+                                context_detach_window(m->contexts[i]);
+
+                if (--f->n_ref > 0) {
+                        pool_unlock(p);
+                        return;
+                }
+        }
 
         while (f->windows)
                 window_free(f->windows);
 
-        if (f->cache)
-                assert_se(hashmap_remove(f->cache->fds, FD_TO_PTR(f->fd)));
+        if (p->shared) {
+                assert_se(hashmap_remove(p->fds, &f->id));
+                safe_close(f->fd);
+        } else
+                assert_se(hashmap_remove(p->fds, FD_TO_PTR(f->fd)));
+
+        pool_unlock(p);
 
         free(f);
 }
@@ -11,12 +11,16 @@
 #include <sys/stat.h>
 
 /* One context per object type, plus one of the header, plus one "additional" one */
-#define MMAP_CACHE_MAX_CONTEXTS 9
+#define MMAP_CACHE_MAX_CONTEXTS 13
 
 typedef struct MMapCache MMapCache;
 typedef struct MMapFileDescriptor MMapFileDescriptor;
 
 MMapCache* mmap_cache_new(void);
+/* Like mmap_cache_new(), but all caches created this way share their memory maps of the same file, and may be
+ * used from different threads in parallel. Each cache on its own still may only be used by one thread at a
+ * time. */
+MMapCache* mmap_cache_new_shared(void);
 MMapCache* mmap_cache_ref(MMapCache *m);
 MMapCache* mmap_cache_unref(MMapCache *m);
 
@@ -34,7 +38,6 @@ int mmap_cache_get(
 MMapFileDescriptor * mmap_cache_add_fd(MMapCache *m, int fd);
 void mmap_cache_free_fd(MMapCache *m, MMapFileDescriptor *f);
 
-unsigned mmap_cache_get_hit(MMapCache *m);
-unsigned mmap_cache_get_missed(MMapCache *m);
+void mmap_cache_stats_log_debug(MMapCache *m);
 
 bool mmap_cache_got_sigbus(MMapCache *m, MMapFileDescriptor *f);
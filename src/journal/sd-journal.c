@@ -43,6 +43,7 @@
 #include "stdio-util.h"
 #include "string-util.h"
 #include "strv.h"
+#include "util.h"
 
 #define JOURNAL_FILES_MAX 7168
 
@@ -113,6 +114,7 @@ static void detach_location(sd_journal *j) {
 
         j->current_file = NULL;
         j->current_field = 0;
+        j->files_prioq_valid = false;
 
         ORDERED_HASHMAP_FOREACH(f, j->files, i)
                 journal_file_reset_location(f);
@@ -508,6 +510,11 @@ static int next_for_match(
         if (m->type == MATCH_DISCRETE) {
                 uint64_t dp;
 
+                /* Cheap check first, so that we don't have to look into the hash table of files that cannot
+                 * contain the match */
+                if (!journal_file_maybe_contains_hash(f, le64toh(m->le_hash)))
+                        return 0;
+
                 r = journal_file_find_data_object_with_hash(f, m->data, m->size, le64toh(m->le_hash), NULL, &dp);
                 if (r <= 0)
                         return r;
@@ -597,6 +604,9 @@ static int find_location_for_match(
         if (m->type == MATCH_DISCRETE) {
                 uint64_t dp;
 
+                if (!journal_file_maybe_contains_hash(f, le64toh(m->le_hash)))
+                        return 0;
+
                 r = journal_file_find_data_object_with_hash(f, m->data, m->size, le64toh(m->le_hash), NULL, &dp);
                 if (r <= 0)
                         return r;
@@ -808,15 +818,50 @@ static int next_beyond_location(sd_journal *j, JournalFile *f, direction_t direc
         }
 }
 
-static int real_journal_next(sd_journal *j, direction_t direction) {
-        JournalFile *new_file = NULL;
+static int compare_files_down(const void *a, const void *b) {
+        return journal_file_compare_locations((JournalFile*) a, (JournalFile*) b);
+}
+
+static int compare_files_up(const void *a, const void *b) {
+        return journal_file_compare_locations((JournalFile*) b, (JournalFile*) a);
+}
+
+static int files_prioq_add(sd_journal *j, JournalFile *f, int found) {
+        assert(j);
+        assert(f);
+
+        if (found > 0)
+                return prioq_put(j->files_prioq, f, &f->prioq_idx);
+
+        f->location_type = LOCATION_TAIL;
+
+        /* Nothing is ever appended to archived files, no need to look at them again */
+        if (f->header->state == STATE_ARCHIVED)
+                return 0;
+
+        return set_put(j->files_polled, f);
+}
+
+static int files_prioq_build(sd_journal *j, direction_t direction) {
         unsigned i, n_files;
         const void **files;
-        Object *o;
         int r;
 
-        assert_return(j, -EINVAL);
-        assert_return(!journal_pid_changed(j), -ECHILD);
+        assert(j);
+
+        /* Looks for the next candidate entry of every file, and orders the files by it */
+
+        j->files_prioq_valid = false;
+        j->files_prioq = prioq_free(j->files_prioq);
+        set_clear(j->files_polled);
+
+        j->files_prioq = prioq_new(direction == DIRECTION_DOWN ? compare_files_down : compare_files_up);
+        if (!j->files_prioq)
+                return -ENOMEM;
+
+        r = set_ensure_allocated(&j->files_polled, NULL);
+        if (r < 0)
+                return r;
 
         r = iterated_cache_get(j->files_cache, NULL, &files, &n_files);
         if (r < 0)
@@ -824,32 +869,108 @@ static int real_journal_next(sd_journal *j, direction_t direction) {
 
         for (i = 0; i < n_files; i++) {
                 JournalFile *f = (JournalFile *)files[i];
-                bool found;
 
                 r = next_beyond_location(j, f, direction);
                 if (r < 0) {
                         log_debug_errno(r, "Can't iterate through %s, ignoring: %m", f->path);
                         remove_file_real(j, f);
                         continue;
-                } else if (r == 0) {
-                        f->location_type = LOCATION_TAIL;
+                }
+
+                r = files_prioq_add(j, f, r);
+                if (r < 0)
+                        return r;
+        }
+
+        j->files_prioq_direction = direction;
+        j->files_prioq_valid = true;
+
+        return 0;
+}
+
+static int files_prioq_update(sd_journal *j, direction_t direction) {
+        JournalFile *f;
+        Iterator i;
+        int r;
+
+        assert(j);
+        assert(j->files_prioq_valid);
+
+        /* All files but the one we picked the current entry from still point to the same candidate entry
+         * as before, hence only that one needs to move on, plus any that we think are the same entry. This
+         * makes stepping through many files O(log n) rather than O(n). Files that ran out of entries
+         * before are checked for new ones only afterwards, as the comparisons require all files in the
+         * queue to point to a candidate. */
+
+        while ((f = prioq_peek(j->files_prioq))) {
+                LocationType t = f->location_type;
+                uint64_t p = f->current_offset;
+
+                r = next_beyond_location(j, f, direction);
+                if (r < 0) {
+                        log_debug_errno(r, "Can't iterate through %s, ignoring: %m", f->path);
+                        remove_file_real(j, f);
+                        return files_prioq_build(j, direction);
+                }
+                if (r == 0) {
+                        (void) prioq_remove(j->files_prioq, f, &f->prioq_idx);
+
+                        r = files_prioq_add(j, f, 0);
+                        if (r < 0)
+                                return r;
+
                         continue;
                 }
 
-                if (!new_file)
-                        found = true;
-                else {
-                        int k;
+                /* Still the same candidate, hence still the earliest one */
+                if (t == LOCATION_SEEK && f->current_offset == p)
+                        break;
 
-                        k = journal_file_compare_locations(f, new_file);
+                r = prioq_reshuffle(j->files_prioq, f, &f->prioq_idx);
+                if (r < 0)
+                        return r;
+        }
 
-                        found = direction == DIRECTION_DOWN ? k < 0 : k > 0;
+        SET_FOREACH(f, j->files_polled, i) {
+                r = next_beyond_location(j, f, direction);
+                if (r < 0) {
+                        log_debug_errno(r, "Can't iterate through %s, ignoring: %m", f->path);
+                        remove_file_real(j, f);
+                        return files_prioq_build(j, direction);
+                }
+                if (r == 0) {
+                        f->location_type = LOCATION_TAIL;
+                        continue;
                 }
 
-                if (found)
-                        new_file = f;
+                (void) set_remove(j->files_polled, f);
+
+                r = prioq_put(j->files_prioq, f, &f->prioq_idx);
+                if (r < 0)
+                        return r;
         }
 
+        return 0;
+}
+
+static int real_journal_next(sd_journal *j, direction_t direction) {
+        JournalFile *new_file;
+        Object *o;
+        int r;
+
+        assert_return(j, -EINVAL);
+        assert_return(!journal_pid_changed(j), -ECHILD);
+
+        if (j->files_prioq_valid && j->files_prioq_direction == direction)
+                r = files_prioq_update(j, direction);
+        else
+                r = files_prioq_build(j, direction);
+        if (r < 0) {
+                j->files_prioq_valid = false;
+                return r;
+        }
+
+        new_file = prioq_peek(j->files_prioq);
         if (!new_file)
                 return 0;
 
@@ -1347,6 +1468,7 @@ static int add_any_file(
         check_network(j, f->fd);
 
         j->current_invalidate_counter++;
+        j->files_prioq_valid = false;
 
         log_debug("File %s added.", f->path);
 
@@ -1419,6 +1541,16 @@ static void remove_file_real(sd_journal *j, JournalFile *f) {
                 j->current_field = 0;
         }
 
+        if (j->unique_values) {
+                UniqueValue *u;
+                Iterator i;
+
+                /* Forget which values this file contributed, we can't check them against it anymore */
+                HASHMAP_FOREACH(u, j->unique_values, i)
+                        if (u->file == f)
+                                free(hashmap_remove(j->unique_values, &u->hash));
+        }
+
         if (j->unique_file == f) {
                 /* Jump to the next unique_file or NULL if that one was last */
                 j->unique_file = ordered_hashmap_next(j->files, j->unique_file->path);
@@ -1437,6 +1569,7 @@ static void remove_file_real(sd_journal *j, JournalFile *f) {
         (void) journal_file_close(f);
 
         j->current_invalidate_counter++;
+        j->files_prioq_valid = false;
 }
 
 static int dirname_is_machine_id(const char *fn) {
@@ -1772,6 +1905,13 @@ static int add_search_paths(sd_journal *j) {
         if (!(j->flags & SD_JOURNAL_LOCAL_ONLY))
                 (void) add_root_directory(j, "/var/log/journal/remote", true);
 
+        /* Entries written by the local journald are announced right away through the tail file */
+        if (j->inotify_fd >= 0 && j->tail_wd < 0 && !(j->flags & SD_JOURNAL_OS_ROOT)) {
+                j->tail_wd = inotify_add_watch(j->inotify_fd, JOURNAL_TAIL_PATH, IN_MODIFY);
+                if (j->tail_wd < 0)
+                        log_debug_errno(errno, "Failed to watch %s, ignoring: %m", JOURNAL_TAIL_PATH);
+        }
+
         return 0;
 }
 
@@ -1823,6 +1963,7 @@ static sd_journal *journal_new(int flags, const char *path) {
         j->original_pid = getpid_cached();
         j->toplevel_fd = -1;
         j->inotify_fd = -1;
+        j->tail_wd = -1;
         j->flags = flags;
         j->data_threshold = DEFAULT_DATA_THRESHOLD;
 
@@ -1845,7 +1986,7 @@ static sd_journal *journal_new(int flags, const char *path) {
 
         j->files_cache = ordered_hashmap_iterated_cache_new(j->files);
         j->directories_by_path = hashmap_new(&path_hash_ops);
-        j->mmap = mmap_cache_new();
+        j->mmap = flags & SD_JOURNAL_SHARE_MAPPINGS ? mmap_cache_new_shared() : mmap_cache_new();
         if (!j->files_cache || !j->directories_by_path || !j->mmap)
                 return NULL;
 
@@ -1855,7 +1996,8 @@ static sd_journal *journal_new(int flags, const char *path) {
 #define OPEN_ALLOWED_FLAGS                              \
         (SD_JOURNAL_LOCAL_ONLY |                        \
          SD_JOURNAL_RUNTIME_ONLY |                      \
-         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER)
+         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER |  \
+         SD_JOURNAL_SHARE_MAPPINGS)
 
 _public_ int sd_journal_open(sd_journal **ret, int flags) {
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
@@ -1919,7 +2061,8 @@ _public_ int sd_journal_open_container(sd_journal **ret, const char *machine, in
 
 #define OPEN_DIRECTORY_ALLOWED_FLAGS                    \
         (SD_JOURNAL_OS_ROOT |                           \
-         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER )
+         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER |  \
+         SD_JOURNAL_SHARE_MAPPINGS)
 
 _public_ int sd_journal_open_directory(sd_journal **ret, const char *path, int flags) {
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
@@ -1950,7 +2093,7 @@ _public_ int sd_journal_open_files(sd_journal **ret, const char **paths, int fla
         int r;
 
         assert_return(ret, -EINVAL);
-        assert_return(flags == 0, -EINVAL);
+        assert_return((flags & ~SD_JOURNAL_SHARE_MAPPINGS) == 0, -EINVAL);
 
         j = journal_new(flags, NULL);
         if (!j)
@@ -1970,7 +2113,8 @@ _public_ int sd_journal_open_files(sd_journal **ret, const char **paths, int fla
 
 #define OPEN_DIRECTORY_FD_ALLOWED_FLAGS         \
         (SD_JOURNAL_OS_ROOT |                           \
-         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER )
+         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER |  \
+         SD_JOURNAL_SHARE_MAPPINGS)
 
 _public_ int sd_journal_open_directory_fd(sd_journal **ret, int fd, int flags) {
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
@@ -2013,7 +2157,7 @@ _public_ int sd_journal_open_files_fd(sd_journal **ret, int fds[], unsigned n_fd
 
         assert_return(ret, -EINVAL);
         assert_return(n_fds > 0, -EBADF);
-        assert_return(flags == 0, -EINVAL);
+        assert_return((flags & ~SD_JOURNAL_SHARE_MAPPINGS) == 0, -EINVAL);
 
         j = journal_new(flags, NULL);
         if (!j)
@@ -2056,6 +2200,23 @@ fail:
         return r;
 }
 
+#define CATALOG_CACHE_CHECK_USEC (5 * USEC_PER_SEC)
+
+typedef struct CatalogCacheEntry {
+        sd_id128_t id;
+        char *text; /* NULL if the id is not in the catalog */
+} CatalogCacheEntry;
+
+static CatalogCacheEntry *catalog_cache_entry_free(CatalogCacheEntry *e) {
+        if (!e)
+                return NULL;
+
+        free(e->text);
+        return mfree(e);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(CatalogCacheEntry*, catalog_cache_entry_free);
+
 _public_ void sd_journal_close(sd_journal *j) {
         Directory *d;
 
@@ -2064,6 +2225,9 @@ _public_ void sd_journal_close(sd_journal *j) {
 
         sd_journal_flush_matches(j);
 
+        prioq_free(j->files_prioq);
+        set_free(j->files_polled);
+
         ordered_hashmap_free_with_destructor(j->files, journal_file_close);
         iterated_cache_free(j->files_cache);
 
@@ -2079,11 +2243,13 @@ _public_ void sd_journal_close(sd_journal *j) {
         safe_close(j->inotify_fd);
 
         if (j->mmap) {
-                log_debug("mmap cache statistics: %u hit, %u miss", mmap_cache_get_hit(j->mmap), mmap_cache_get_missed(j->mmap));
+                mmap_cache_stats_log_debug(j->mmap);
                 mmap_cache_unref(j->mmap);
         }
 
         hashmap_free_free(j->errors);
+        hashmap_free_free(j->unique_values);
+        hashmap_free_with_destructor(j->catalog_cache, catalog_cache_entry_free);
 
         free(j->path);
         free(j->prefix);
@@ -2181,19 +2347,57 @@ static bool field_is_valid(const char *field) {
         return true;
 }
 
-_public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **data, size_t *size) {
+static int return_data(sd_journal *j, JournalFile *f, Object *o, const void **data, size_t *size) {
+        size_t t;
+        uint64_t l;
+        int compression;
+
+        l = le64toh(o->object.size) - offsetof(Object, data.payload);
+        t = (size_t) l;
+
+        /* We can't read objects larger than 4G on a 32bit machine */
+        if ((uint64_t) t != l)
+                return -E2BIG;
+
+        compression = o->object.flags & OBJECT_COMPRESSION_MASK;
+        if (compression) {
+#if HAVE_COMPRESSION
+                size_t rsize;
+                int r;
+
+                r = decompress_blob(compression, journal_file_compress_dict(f),
+                                    o->data.payload, l, &f->compress_buffer,
+                                    &f->compress_buffer_size, &rsize, j->data_threshold);
+                if (r < 0)
+                        return r;
+
+                *data = f->compress_buffer;
+                *size = (size_t) rsize;
+#else
+                return -EPROTONOSUPPORT;
+#endif
+        } else {
+                *data = o->data.payload;
+                *size = t;
+        }
+
+        return 0;
+}
+
+static int find_data(sd_journal *j, const char *field, JournalFile **ret_file, Object **ret_object) {
         JournalFile *f;
         uint64_t i, n;
         size_t field_length;
         int r;
         Object *o;
 
-        assert_return(j, -EINVAL);
-        assert_return(!journal_pid_changed(j), -ECHILD);
-        assert_return(field, -EINVAL);
-        assert_return(data, -EINVAL);
-        assert_return(size, -EINVAL);
-        assert_return(field_is_valid(field), -EINVAL);
+        assert(j);
+        assert(field);
+        assert(ret_file);
+        assert(ret_object);
+
+        /* Looks for the field in the current entry, and returns its DATA object, without decompressing more
+         * than the field name of any of the entry's objects. */
 
         f = j->current_file;
         if (!f)
@@ -2212,7 +2416,6 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
         for (i = 0; i < n; i++) {
                 uint64_t p, l;
                 le64_t le_hash;
-                size_t t;
                 int compression;
 
                 p = le64toh(o->entry.items[i].object_offset);
@@ -2228,8 +2431,8 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
 
                 compression = o->object.flags & OBJECT_COMPRESSION_MASK;
                 if (compression) {
-#if HAVE_XZ || HAVE_LZ4
-                        r = decompress_startswith(compression,
+#if HAVE_COMPRESSION
+                        r = decompress_startswith(compression, journal_file_compress_dict(f),
                                                   o->data.payload, l,
                                                   &f->compress_buffer, &f->compress_buffer_size,
                                                   field, field_length, '=');
@@ -2237,19 +2440,8 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
                                 log_debug_errno(r, "Cannot decompress %s object of length %"PRIu64" at offset "OFSfmt": %m",
                                                 object_compressed_to_string(compression), l, p);
                         else if (r > 0) {
-
-                                size_t rsize;
-
-                                r = decompress_blob(compression,
-                                                    o->data.payload, l,
-                                                    &f->compress_buffer, &f->compress_buffer_size, &rsize,
-                                                    j->data_threshold);
-                                if (r < 0)
-                                        return r;
-
-                                *data = f->compress_buffer;
-                                *size = (size_t) rsize;
-
+                                *ret_file = f;
+                                *ret_object = o;
                                 return 0;
                         }
 #else
@@ -2259,14 +2451,8 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
                            memcmp(o->data.payload, field, field_length) == 0 &&
                            o->data.payload[field_length] == '=') {
 
-                        t = (size_t) l;
-
-                        if ((uint64_t) t != l)
-                                return -E2BIG;
-
-                        *data = o->data.payload;
-                        *size = t;
-
+                        *ret_file = f;
+                        *ret_object = o;
                         return 0;
                 }
 
@@ -2278,39 +2464,43 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
         return -ENOENT;
 }
 
-static int return_data(sd_journal *j, JournalFile *f, Object *o, const void **data, size_t *size) {
-        size_t t;
-        uint64_t l;
-        int compression;
+_public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **data, size_t *size) {
+        JournalFile *f;
+        Object *o;
+        int r;
 
-        l = le64toh(o->object.size) - offsetof(Object, data.payload);
-        t = (size_t) l;
+        assert_return(j, -EINVAL);
+        assert_return(!journal_pid_changed(j), -ECHILD);
+        assert_return(field, -EINVAL);
+        assert_return(data, -EINVAL);
+        assert_return(size, -EINVAL);
+        assert_return(field_is_valid(field), -EINVAL);
 
-        /* We can't read objects larger than 4G on a 32bit machine */
-        if ((uint64_t) t != l)
-                return -E2BIG;
+        r = find_data(j, field, &f, &o);
+        if (r < 0)
+                return r;
 
-        compression = o->object.flags & OBJECT_COMPRESSION_MASK;
-        if (compression) {
-#if HAVE_XZ || HAVE_LZ4
-                size_t rsize;
-                int r;
+        return return_data(j, f, o, data, size);
+}
 
-                r = decompress_blob(compression,
-                                    o->data.payload, l, &f->compress_buffer,
-                                    &f->compress_buffer_size, &rsize, j->data_threshold);
-                if (r < 0)
-                        return r;
+int journal_get_data_size(sd_journal *j, const char *field, uint64_t *ret_size) {
+        JournalFile *f;
+        Object *o;
+        int r;
 
-                *data = f->compress_buffer;
-                *size = (size_t) rsize;
-#else
-                return -EPROTONOSUPPORT;
-#endif
-        } else {
-                *data = o->data.payload;
-                *size = t;
-        }
+        assert(j);
+        assert(field);
+
+        /* Like sd_journal_get_data(), but only returns the size of the field as stored in the file, i.e.
+         * compressed if it is, and never reads or decompresses the data itself. Useful to check for the
+         * presence of fields that might be huge. */
+
+        r = find_data(j, field, &f, &o);
+        if (r < 0)
+                return r;
+
+        if (ret_size)
+                *ret_size = le64toh(o->object.size) - offsetof(Object, data.payload);
 
         return 0;
 }
@@ -2499,6 +2689,13 @@ static void process_inotify_event(sd_journal *j, struct inotify_event *e) {
                 return;
         }
 
+        /* New entries from the local journald? Then there's nothing to do but report SD_JOURNAL_APPEND */
+        if (j->tail_wd >= 0 && e->wd == j->tail_wd) {
+                if (e->mask & IN_IGNORED)
+                        j->tail_wd = -1;
+                return;
+        }
+
         /* Is this a subdirectory we watch? */
         d = hashmap_get(j->directories_by_wd, INT_TO_PTR(e->wd));
         if (d) {
@@ -2723,6 +2920,90 @@ void journal_print_header(sd_journal *j) {
         }
 }
 
+static int journal_boot_compare(const void *a, const void *b) {
+        const JournalBoot *x = a, *y = b;
+
+        /* Order by the first entry of each boot, the same way journal_file_compare_locations() would */
+        if (sd_id128_equal(x->seqnum_id, y->seqnum_id) && x->first_seqnum != y->first_seqnum)
+                return x->first_seqnum < y->first_seqnum ? -1 : 1;
+
+        if (x->first_realtime != y->first_realtime)
+                return x->first_realtime < y->first_realtime ? -1 : 1;
+
+        return 0;
+}
+
+int journal_get_boots(sd_journal *j, JournalBoot **ret, size_t *ret_n) {
+        _cleanup_hashmap_free_ Hashmap *index = NULL;
+        _cleanup_free_ JournalBoot *boots = NULL;
+        size_t n_boots = 0, n_allocated = 0;
+        JournalFile *f;
+        Iterator i;
+        int r;
+
+        assert(j);
+        assert(ret);
+        assert(ret_n);
+
+        /* Merges the per-file boot summaries into one list of boots, sorted from the oldest to the newest.
+         * Returns -EOPNOTSUPP if any of the files can't provide one. */
+
+        index = hashmap_new(&id128_hash_ops);
+        if (!index)
+                return -ENOMEM;
+
+        ORDERED_HASHMAP_FOREACH(f, j->files, i) {
+                const JournalBoot *fb;
+                size_t fn, k;
+
+                r = journal_file_get_boots(f, &fb, &fn);
+                if (r < 0)
+                        return r;
+
+                for (k = 0; k < fn; k++) {
+                        JournalBoot *b;
+                        size_t idx;
+
+                        idx = PTR_TO_SIZE(hashmap_get(index, &fb[k].boot_id));
+                        if (idx == 0) {
+                                if (!GREEDY_REALLOC(boots, n_allocated, n_boots + 1))
+                                        return -ENOMEM;
+
+                                boots[n_boots++] = fb[k];
+
+                                /* The per-file arrays stay around until the files are closed, hence we can
+                                 * key by their boot ids */
+                                r = hashmap_put(index, &fb[k].boot_id, SIZE_TO_PTR(n_boots));
+                                if (r < 0)
+                                        return r;
+
+                                continue;
+                        }
+
+                        /* Same boot, hence the monotonic clocks are comparable */
+                        b = boots + idx - 1;
+
+                        if (fb[k].first_monotonic < b->first_monotonic) {
+                                b->seqnum_id = fb[k].seqnum_id;
+                                b->first_seqnum = fb[k].first_seqnum;
+                                b->first_realtime = fb[k].first_realtime;
+                                b->first_monotonic = fb[k].first_monotonic;
+                        }
+
+                        if (fb[k].last_monotonic > b->last_monotonic) {
+                                b->last_realtime = fb[k].last_realtime;
+                                b->last_monotonic = fb[k].last_monotonic;
+                        }
+                }
+        }
+
+        qsort_safe(boots, n_boots, sizeof(JournalBoot), journal_boot_compare);
+
+        *ret = TAKE_PTR(boots);
+        *ret_n = n_boots;
+        return 0;
+}
+
 _public_ int sd_journal_get_usage(sd_journal *j, uint64_t *bytes) {
         Iterator i;
         JournalFile *f;
@@ -2762,6 +3043,7 @@ _public_ int sd_journal_query_unique(sd_journal *j, const char *field) {
         j->unique_file = NULL;
         j->unique_offset = 0;
         j->unique_file_lost = false;
+        hashmap_clear_free(j->unique_values);
 
         return 0;
 }
@@ -2790,9 +3072,11 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
 
         for (;;) {
                 JournalFile *of;
+                UniqueValue *u;
                 Iterator i;
                 Object *o;
                 const void *odata;
+                uint64_t hash;
                 size_t ol;
                 bool found;
                 int r;
@@ -2836,6 +3120,8 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
                         return -EBADMSG;
                 }
 
+                hash = le64toh(o->data.hash);
+
                 r = return_data(j, j->unique_file, o, &odata, &ol);
                 if (r < 0)
                         return r;
@@ -2856,8 +3142,25 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
                 }
 
                 /* OK, now let's see if we already returned this data
-                 * object by checking if it exists in the earlier
-                 * traversed files. */
+                 * object. If we never returned anything with the same
+                 * hash we didn't, otherwise check the file we returned
+                 * it from. Only if that doesn't have it either (i.e. on
+                 * hash collisions) check all the earlier traversed
+                 * files. This keeps us from going quadratic in the
+                 * number of files. */
+                u = hashmap_get(j->unique_values, &hash);
+                if (!u)
+                        goto new_value;
+
+                /* Within one file all values are distinct anyway */
+                if (u->file != j->unique_file) {
+                        r = journal_file_find_data_object_with_hash(u->file, odata, ol, hash, NULL, NULL);
+                        if (r < 0)
+                                return r;
+                        if (r > 0)
+                                continue;
+                }
+
                 found = false;
                 ORDERED_HASHMAP_FOREACH(of, j->files, i) {
                         if (of == j->unique_file)
@@ -2879,6 +3182,28 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
                 if (found)
                         continue;
 
+        new_value:
+                r = hashmap_ensure_allocated(&j->unique_values, &uint64_hash_ops);
+                if (r < 0)
+                        return r;
+
+                if (!u) {
+                        _cleanup_free_ UniqueValue *n = NULL;
+
+                        n = new(UniqueValue, 1);
+                        if (!n)
+                                return -ENOMEM;
+
+                        n->hash = hash;
+                        n->file = j->unique_file;
+
+                        r = hashmap_put(j->unique_values, &n->hash, n);
+                        if (r < 0)
+                                return r;
+
+                        TAKE_PTR(n);
+                }
+
                 r = return_data(j, j->unique_file, o, data, l);
                 if (r < 0)
                         return r;
@@ -2894,6 +3219,7 @@ _public_ void sd_journal_restart_unique(sd_journal *j) {
         j->unique_file = NULL;
         j->unique_offset = 0;
         j->unique_file_lost = false;
+        hashmap_clear_free(j->unique_values);
 }
 
 _public_ int sd_journal_enumerate_fields(sd_journal *j, const char **field) {
@@ -3070,11 +3396,76 @@ static char *lookup_field(const char *field, void *userdata) {
         return strndup((const char*) data + d, size - d);
 }
 
+static int catalog_get_cached(sd_journal *j, sd_id128_t id, const char **ret) {
+        _cleanup_(catalog_cache_entry_freep) CatalogCacheEntry *e = NULL;
+        CatalogCacheEntry *c;
+        usec_t n;
+        int r;
+
+        assert(j);
+        assert(ret);
+
+        /* Opening and mapping the database for each lookup is expensive when the catalog is shown for many
+         * entries, hence remember what we found per message id. The database is checked for updates every
+         * few seconds, so that long-running readers eventually pick up changes. */
+
+        n = now(CLOCK_MONOTONIC);
+        if (n >= j->catalog_checked + CATALOG_CACHE_CHECK_USEC) {
+                struct stat st = {};
+
+                (void) stat(CATALOG_DATABASE, &st);
+
+                if (st.st_dev != j->catalog_stat.st_dev ||
+                    st.st_ino != j->catalog_stat.st_ino ||
+                    st.st_size != j->catalog_stat.st_size ||
+                    timespec_load_nsec(&st.st_mtim) != timespec_load_nsec(&j->catalog_stat.st_mtim))
+                        j->catalog_cache = hashmap_free_with_destructor(j->catalog_cache, catalog_cache_entry_free);
+
+                j->catalog_stat = st;
+                j->catalog_checked = n;
+        }
+
+        c = hashmap_get(j->catalog_cache, &id);
+        if (c) {
+                if (!c->text)
+                        return -ENOENT;
+
+                *ret = c->text;
+                return 0;
+        }
+
+        r = hashmap_ensure_allocated(&j->catalog_cache, &id128_hash_ops);
+        if (r < 0)
+                return r;
+
+        e = new0(CatalogCacheEntry, 1);
+        if (!e)
+                return -ENOMEM;
+
+        e->id = id;
+
+        r = catalog_get(CATALOG_DATABASE, id, &e->text);
+        if (r < 0 && r != -ENOENT)
+                return r;
+
+        r = hashmap_put(j->catalog_cache, &e->id, e);
+        if (r < 0)
+                return r;
+
+        c = TAKE_PTR(e);
+        if (!c->text)
+                return -ENOENT;
+
+        *ret = c->text;
+        return 0;
+}
+
 _public_ int sd_journal_get_catalog(sd_journal *j, char **ret) {
         const void *data;
         size_t size;
         sd_id128_t id;
-        _cleanup_free_ char *text = NULL, *cid = NULL;
+        _cleanup_free_ char *cid = NULL;
+        const char *text;
         char *t;
         int r;
 
@@ -3094,11 +3485,14 @@ _public_ int sd_journal_get_catalog(sd_journal *j, char **ret) {
         if (r < 0)
                 return r;
 
-        r = catalog_get(CATALOG_DATABASE, id, &text);
+        r = catalog_get_cached(j, id, &text);
         if (r < 0)
                 return r;
 
-        t = replace_var(text, lookup_field, j);
+        if (strchr(text, '@'))
+                t = replace_var(text, lookup_field, j);
+        else
+                t = strdup(text);
         if (!t)
                 return -ENOMEM;
 
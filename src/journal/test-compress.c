@@ -14,6 +14,7 @@
 #include "fd-util.h"
 #include "fileio.h"
 #include "fs-util.h"
+#include "io-util.h"
 #include "macro.h"
 #include "path-util.h"
 #include "random-util.h"
@@ -31,6 +32,12 @@
 # define LZ4_OK -EPROTONOSUPPORT
 #endif
 
+#if HAVE_ZSTD
+# define ZSTD_OK 0
+#else
+# define ZSTD_OK -EPROTONOSUPPORT
+#endif
+
 typedef int (compress_blob_t)(const void *src, uint64_t src_size,
                               void *dst, size_t dst_alloc_size, size_t *dst_size);
 typedef int (decompress_blob_t)(const void *src, uint64_t src_size,
@@ -44,7 +51,7 @@ typedef int (decompress_sw_t)(const void *src, uint64_t src_size,
 typedef int (compress_stream_t)(int fdf, int fdt, uint64_t max_bytes);
 typedef int (decompress_stream_t)(int fdf, int fdt, uint64_t max_size);
 
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
 static void test_compress_decompress(int compression,
                                      compress_blob_t compress,
                                      decompress_blob_t decompress,
@@ -200,6 +207,109 @@ static void test_compress_stream(int compression,
 }
 #endif
 
+#if HAVE_ZSTD
+static void test_zstd_dict(void) {
+        _cleanup_(compress_dict_freep) CompressDict *d = NULL;
+        _cleanup_free_ char *samples = NULL, *decompressed = NULL;
+        size_t sizes[2048], samples_size = 0, csize, usize = 0, dsize;
+        const char *text = "MESSAGE=Started Session 4711 of user lennart.";
+        char compressed[512];
+        unsigned i;
+        int r;
+
+        log_info("/* testing ZSTD dictionary compression */");
+
+        samples = malloc(ELEMENTSOF(sizes) * 64);
+        assert_se(samples);
+
+        for (i = 0; i < ELEMENTSOF(sizes); i++) {
+                r = sprintf(samples + samples_size, "%s=%s %u of user %s.",
+                            i % 2 ? "MESSAGE" : "SYSLOG_IDENTIFIER",
+                            i % 3 ? "Started Session" : "Stopping Session",
+                            i, i % 5 ? "nobody" : "root");
+                assert_se(r > 0);
+                sizes[i] = r;
+                samples_size += r;
+        }
+
+        r = compress_dict_train(samples, sizes, ELEMENTSOF(sizes), 4096, &d);
+        if (r == -ENODATA) {
+                log_info_errno(r, "Dictionary training failed, skipping: %m");
+                return;
+        }
+        assert_se(r == 0);
+        assert_se(compress_dict_data(d, &dsize));
+        assert_se(dsize > 0 && dsize <= 4096);
+
+        assert_se(compress_blob_zstd_dict(d, text, strlen(text), compressed, sizeof(compressed), &csize) == 0);
+        log_info("Compressed %zu → %zu bytes using a %zu byte dictionary", strlen(text), csize, dsize);
+
+        assert_se(decompress_blob_zstd_dict(d, compressed, csize, (void **) &decompressed, &usize, &csize, 0) == 0);
+        assert_se(csize == strlen(text));
+        assert_se(memcmp(decompressed, text, csize) == 0);
+
+        /* Objects compressed against a dictionary cannot be decompressed without it */
+        assert_se(compress_blob_zstd_dict(d, text, strlen(text), compressed, sizeof(compressed), &csize) == 0);
+        assert_se(decompress_blob_zstd(compressed, csize, (void **) &decompressed, &usize, &dsize, 0) < 0);
+
+        assert_se(decompress_startswith(OBJECT_COMPRESSED_ZSTD, d, compressed, csize,
+                                        (void **) &decompressed, &usize, "MESSAGE", 7, '=') > 0);
+        assert_se(decompress_startswith(OBJECT_COMPRESSED_ZSTD, d, compressed, csize,
+                                        (void **) &decompressed, &usize, "MESSAGE", 7, 'X') == 0);
+}
+#endif
+
+#if HAVE_ZSTD
+static void test_zstd_stream_copy(void) {
+        _cleanup_close_ int src = -1, dst = -1, copy = -1, out = -1;
+        _cleanup_(unlink_tempfilep) char
+                pattern_src[] = "/tmp/systemd-test.source.XXXXXX",
+                pattern_dst[] = "/tmp/systemd-test.compressed.XXXXXX",
+                pattern_copy[] = "/tmp/systemd-test.copy.XXXXXX",
+                pattern_out[] = "/tmp/systemd-test.decompressed.XXXXXX";
+        _cleanup_free_ char *buf = NULL, *cmd = NULL;
+        const size_t size = 1024 * 1024;
+        struct stat st;
+
+        log_info("/* testing ZSTD stream compression with a sparse copy */");
+
+        /* Mostly zeroes with some data somewhere in the middle, like a core file */
+        assert_se(buf = malloc0(size));
+        memset(buf + size / 2, 'x', 4096);
+
+        assert_se((src = mkostemp_safe(pattern_src)) >= 0);
+        assert_se(loop_write(src, buf, size, false) >= 0);
+        assert_se(lseek(src, 0, SEEK_SET) == 0);
+
+        assert_se((dst = mkostemp_safe(pattern_dst)) >= 0);
+        assert_se((copy = mkostemp_safe(pattern_copy)) >= 0);
+
+        assert_se(compress_stream_zstd_full(src, dst, (uint64_t) -1, copy, (uint64_t) -1, 2) == 0);
+
+        assert_se(fstat(copy, &st) >= 0);
+        assert_se((size_t) st.st_size == size);
+        assert_se(asprintf(&cmd, "cmp %s %s", pattern_src, pattern_copy) > 0);
+        assert_se(system(cmd) == 0);
+
+        assert_se((out = mkostemp_safe(pattern_out)) >= 0);
+        assert_se(lseek(dst, 0, SEEK_SET) == 0);
+        assert_se(decompress_stream_zstd(dst, out, size) == 0);
+        cmd = mfree(cmd);
+        assert_se(asprintf(&cmd, "cmp %s %s", pattern_src, pattern_out) > 0);
+        assert_se(system(cmd) == 0);
+
+        /* Truncation at the input limit is reported, and the copy stops there as well */
+        assert_se(lseek(src, 0, SEEK_SET) == 0);
+        assert_se(ftruncate(dst, 0) >= 0 && lseek(dst, 0, SEEK_SET) == 0);
+        assert_se(ftruncate(copy, 0) >= 0 && lseek(copy, 0, SEEK_SET) == 0);
+
+        assert_se(compress_stream_zstd_full(src, dst, (uint64_t) -1, copy, size / 2, 0) == 1);
+
+        assert_se(fstat(copy, &st) >= 0);
+        assert_se((size_t) st.st_size == size / 2);
+}
+#endif
+
 #if HAVE_LZ4
 static void test_lz4_decompress_partial(void) {
         char buf[20000];
@@ -243,7 +353,7 @@ static void test_lz4_decompress_partial(void) {
 #endif
 
 int main(int argc, char *argv[]) {
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
         const char text[] =
                 "text\0foofoofoofoo AAAA aaaaaaaaa ghost busters barbarbar FFF"
                 "foofoofoofoo AAAA aaaaaaaaa ghost busters barbarbar FFF";
@@ -308,6 +418,31 @@ int main(int argc, char *argv[]) {
         log_info("/* LZ4 test skipped */");
 #endif
 
+#if HAVE_ZSTD
+        test_compress_decompress(OBJECT_COMPRESSED_ZSTD, compress_blob_zstd, decompress_blob_zstd,
+                                 text, sizeof(text), false);
+        test_compress_decompress(OBJECT_COMPRESSED_ZSTD, compress_blob_zstd, decompress_blob_zstd,
+                                 data, sizeof(data), true);
+
+        test_decompress_startswith(OBJECT_COMPRESSED_ZSTD,
+                                   compress_blob_zstd, decompress_startswith_zstd,
+                                   text, sizeof(text), false);
+        test_decompress_startswith(OBJECT_COMPRESSED_ZSTD,
+                                   compress_blob_zstd, decompress_startswith_zstd,
+                                   data, sizeof(data), true);
+        test_decompress_startswith(OBJECT_COMPRESSED_ZSTD,
+                                   compress_blob_zstd, decompress_startswith_zstd,
+                                   huge, sizeof(huge), true);
+
+        test_compress_stream(OBJECT_COMPRESSED_ZSTD, "zstdcat",
+                             compress_stream_zstd, decompress_stream_zstd, srcfile);
+
+        test_zstd_dict();
+        test_zstd_stream_copy();
+#else
+        log_info("/* ZSTD test skipped */");
+#endif
+
         return 0;
 #else
         return EXIT_TEST_SKIP;
@@ -0,0 +1,298 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+***/
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "sd-journal.h"
+
+#include "alloc-util.h"
+#include "env-util.h"
+#include "io-util.h"
+#include "journal-file.h"
+#include "log.h"
+#include "parse-util.h"
+#include "rm-rf.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "util.h"
+
+/* This program generates a set of interleaved journal files with a somewhat realistic distribution of
+ * fields and measures how quickly the typical journalctl queries run on them.
+ *
+ * Usage: test-journal-query-benchmark [ENTRIES [DIRECTORY]]
+ *
+ * If DIRECTORY is specified it is kept around and, if it already contains journal files, reused as is, so
+ * that large journals only need to be generated once. The results are logged together with the page faults
+ * they caused, and written to stdout in the format of benchmark_report(). */
+
+#define N_FILES 4
+#define N_UNITS 64
+#define N_BOOTS 4
+
+static uint64_t arg_entries;
+
+/* With a fixed seed the generated journals are identical between runs, apart from the boot IDs */
+static uint64_t random_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_random(void) {
+        random_state ^= random_state << 13;
+        random_state ^= random_state >> 7;
+        random_state ^= random_state << 17;
+        return random_state;
+}
+
+static unsigned pick_unit(void) {
+        uint64_t a = next_random(), b = next_random();
+
+        /* Skew towards the first units, a few services usually produce most of the logs */
+        return (a % N_UNITS) * (b % N_UNITS) / N_UNITS;
+}
+
+static void generate(const char *directory) {
+        JournalFile *files[N_FILES] = {};
+        sd_id128_t boots[N_BOOTS];
+        dual_timestamp ts;
+        uint64_t i;
+        unsigned k;
+
+        for (k = 0; k < N_FILES; k++) {
+                char fn[STRLEN("/bench-.journal") + DECIMAL_STR_MAX(unsigned)];
+                const char *p;
+
+                xsprintf(fn, "/bench-%u.journal", k);
+                p = strjoina(directory, fn);
+
+                assert_se(journal_file_open(-1, p, O_RDWR|O_CREAT, 0644, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &files[k]) == 0);
+        }
+
+        for (k = 0; k < N_BOOTS; k++)
+                assert_se(sd_id128_randomize(&boots[k]) >= 0);
+
+        dual_timestamp_get(&ts);
+        ts.realtime -= arg_entries * USEC_PER_MSEC;
+
+        for (i = 0; i < arg_entries; i++) {
+                char unit[STRLEN("_SYSTEMD_UNIT=bench-.service") + DECIMAL_STR_MAX(unsigned)];
+                char identifier[STRLEN("SYSLOG_IDENTIFIER=bench-") + DECIMAL_STR_MAX(unsigned)];
+                char pid[STRLEN("_PID=") + DECIMAL_STR_MAX(unsigned)];
+                char priority[STRLEN("PRIORITY=") + DECIMAL_STR_MAX(unsigned)];
+                char boot[STRLEN("_BOOT_ID=") + SD_ID128_STRING_MAX];
+                char message[STRLEN("MESSAGE=") + 512];
+                struct iovec iovec[6];
+                unsigned u, len;
+                uint64_t r;
+
+                u = pick_unit();
+                r = next_random();
+
+                xsprintf(unit, "_SYSTEMD_UNIT=bench-%u.service", u);
+                xsprintf(identifier, "SYSLOG_IDENTIFIER=bench-%u", u);
+                xsprintf(pid, "_PID=%u", 1000 + u * 7 + (unsigned) (r % 3));
+                xsprintf(priority, "PRIORITY=%u", (r % 100) < 90 ? 6 : (unsigned) (r % 6));
+                xsprintf(boot, "_BOOT_ID=" SD_ID128_FORMAT_STR, SD_ID128_FORMAT_VAL(boots[i * N_BOOTS / arg_entries]));
+
+                /* Mostly short messages with a few long ones, and enough variety to not be all duplicates */
+                len = (r >> 8) % 100 < 95 ? 30 + (unsigned) ((r >> 16) % 60) : 200 + (unsigned) ((r >> 16) % 300);
+                xsprintf(message, "MESSAGE=Request %" PRIu64 " handled in %u ms %.*s",
+                         i, (unsigned) ((r >> 24) % 1000), (int) len,
+                         "lorem ipsum dolor sit amet consectetur adipiscing elit sed do eiusmod tempor incididunt "
+                         "ut labore et dolore magna aliqua ut enim ad minim veniam quis nostrud exercitation "
+                         "ullamco laboris nisi ut aliquip ex ea commodo consequat duis aute irure dolor in "
+                         "reprehenderit in voluptate velit esse cillum dolore eu fugiat nulla pariatur excepteur "
+                         "sint occaecat cupidatat non proident sunt in culpa qui officia deserunt mollit anim id");
+
+                iovec[0] = IOVEC_MAKE_STRING(message);
+                iovec[1] = IOVEC_MAKE_STRING(unit);
+                iovec[2] = IOVEC_MAKE_STRING(identifier);
+                iovec[3] = IOVEC_MAKE_STRING(pid);
+                iovec[4] = IOVEC_MAKE_STRING(priority);
+                iovec[5] = IOVEC_MAKE_STRING(boot);
+
+                ts.realtime += USEC_PER_MSEC;
+                ts.monotonic += USEC_PER_MSEC;
+
+                /* Spread entries over several files, like the per-user and system journals */
+                assert_se(journal_file_append_entry(files[(r >> 32) % N_FILES], &ts, iovec, ELEMENTSOF(iovec), NULL, NULL, NULL) == 0);
+        }
+
+        for (k = 0; k < N_FILES; k++)
+                (void) journal_file_close(files[k]);
+}
+
+typedef struct Measurement {
+        usec_t start;
+        struct rusage rusage;
+} Measurement;
+
+static void measure_start(Measurement *m) {
+        assert_se(getrusage(RUSAGE_SELF, &m->rusage) >= 0);
+        m->start = now(CLOCK_MONOTONIC);
+}
+
+static void measure_end(const Measurement *m, const char *label, uint64_t n) {
+        struct rusage rusage;
+
+        assert_se(getrusage(RUSAGE_SELF, &rusage) >= 0);
+
+        benchmark_report(label, n, m->start);
+        log_info("%-32s %10ld minor, %ld major page faults",
+                 label, rusage.ru_minflt - m->rusage.ru_minflt, rusage.ru_majflt - m->rusage.ru_majflt);
+}
+
+static void bench_query(const char *directory, const char *label, const char *match1, const char *match2) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        Measurement m;
+        uint64_t n = 0;
+        const void *d;
+        size_t l;
+
+        assert_se(sd_journal_open_directory(&j, directory, 0) >= 0);
+
+        if (match1)
+                assert_se(sd_journal_add_match(j, match1, 0) >= 0);
+        if (match2)
+                assert_se(sd_journal_add_match(j, match2, 0) >= 0);
+
+        measure_start(&m);
+
+        /* Like the default output mode, this needs to read at least the message of each entry */
+        SD_JOURNAL_FOREACH(j) {
+                assert_se(sd_journal_get_data(j, "MESSAGE", &d, &l) >= 0);
+                n++;
+        }
+
+        measure_end(&m, label, n);
+}
+
+static void bench_boot(const char *directory) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        _cleanup_free_ char *match = NULL;
+        const void *d;
+        size_t l;
+
+        /* Pick the boot of the last entry, like "journalctl -b" */
+        assert_se(sd_journal_open_directory(&j, directory, 0) >= 0);
+        assert_se(sd_journal_seek_tail(j) >= 0);
+        assert_se(sd_journal_previous(j) > 0);
+        assert_se(sd_journal_get_data(j, "_BOOT_ID", &d, &l) >= 0);
+        assert_se(match = strndup(d, l));
+
+        bench_query(directory, "per-boot", match, NULL);
+}
+
+static void bench_since_until(const char *directory) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        uint64_t from, to, ts, n = 0;
+        Measurement m;
+        int r;
+
+        assert_se(sd_journal_open_directory(&j, directory, 0) >= 0);
+
+        assert_se(sd_journal_seek_head(j) >= 0);
+        assert_se(sd_journal_next(j) > 0);
+        assert_se(sd_journal_get_realtime_usec(j, &from) >= 0);
+        assert_se(sd_journal_seek_tail(j) >= 0);
+        assert_se(sd_journal_previous(j) > 0);
+        assert_se(sd_journal_get_realtime_usec(j, &to) >= 0);
+
+        /* The middle tenth of the time range */
+        from += (to - from) / 20 * 9;
+        to = from + (to - from) / 10;
+
+        measure_start(&m);
+
+        assert_se(sd_journal_seek_realtime_usec(j, from) >= 0);
+        while ((r = sd_journal_next(j)) > 0) {
+                assert_se(sd_journal_get_realtime_usec(j, &ts) >= 0);
+                if (ts > to)
+                        break;
+                n++;
+        }
+        assert_se(r >= 0);
+
+        measure_end(&m, "--since/--until", n);
+}
+
+static void bench_unique(const char *directory, const char *field) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        Measurement m;
+        uint64_t n = 0;
+        const void *d;
+        size_t l;
+
+        assert_se(sd_journal_open_directory(&j, directory, 0) >= 0);
+
+        measure_start(&m);
+
+        assert_se(sd_journal_query_unique(j, field) >= 0);
+        SD_JOURNAL_FOREACH_UNIQUE(j, d, l)
+                n++;
+
+        measure_end(&m, strjoina("-F ", field), n);
+}
+
+int main(int argc, char *argv[]) {
+        char t[] = "/tmp/journal-query-benchmark-XXXXXX";
+        const char *directory;
+        bool keep = false;
+        int r;
+
+        /* journal_file_open requires a valid machine id */
+        if (access("/etc/machine-id", F_OK) != 0)
+                return EXIT_TEST_SKIP;
+
+        log_set_max_level(LOG_INFO);
+
+        if (argc >= 2)
+                assert_se(safe_atou64(argv[1], &arg_entries) >= 0);
+        else {
+                bool slow;
+
+                r = getenv_bool("SYSTEMD_SLOW_TESTS");
+                slow = r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT;
+
+                arg_entries = slow ? 1000000 : 10000;
+        }
+        assert_se(arg_entries > 0);
+
+        if (argc >= 3) {
+                directory = argv[2];
+                keep = true;
+        } else {
+                assert_se(mkdtemp(t));
+                directory = t;
+        }
+
+        {
+                _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+
+                r = sd_journal_open_directory(&j, directory, 0);
+                if (r < 0 || sd_journal_next(j) <= 0) {
+                        Measurement m;
+
+                        measure_start(&m);
+                        generate(directory);
+                        measure_end(&m, "generate", arg_entries);
+                } else
+                        log_info("Reusing journal files in %s.", directory);
+        }
+
+        bench_query(directory, "all", NULL, NULL);
+        bench_query(directory, "per-unit", "_SYSTEMD_UNIT=bench-3.service", NULL);
+        bench_query(directory, "per-unit, rare", "_SYSTEMD_UNIT=bench-60.service", NULL);
+        bench_boot(directory);
+        bench_query(directory, "per-unit, priority", "_SYSTEMD_UNIT=bench-0.service", "PRIORITY=3");
+        bench_since_until(directory);
+        bench_unique(directory, "_SYSTEMD_UNIT");
+        bench_unique(directory, "_PID");
+
+        if (!keep)
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        return 0;
+}
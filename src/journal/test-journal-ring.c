@@ -0,0 +1,140 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+***/
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "io-util.h"
+#include "journal-ring.h"
+#include "log.h"
+#include "macro.h"
+#include "missing.h"
+#include "stdio-util.h"
+#include "string-util.h"
+
+typedef struct Collected {
+        unsigned n;
+        uint64_t next;
+        usec_t realtime;
+} Collected;
+
+static void collect(const void *data, size_t size, usec_t realtime, void *userdata) {
+        Collected *c = userdata;
+        char expected[LINE_MAX];
+
+        xsprintf(expected, "MESSAGE=entry %" PRIu64 "\n", c->next);
+
+        assert_se(size == strlen(expected));
+        assert_se(memcmp(data, expected, size) == 0);
+        assert_se(((const char*) data)[size] == 0);
+
+        c->realtime = realtime;
+        c->next++;
+        c->n++;
+}
+
+static int append(JournalRing *r, uint64_t i) {
+        char s[LINE_MAX];
+        struct iovec iov[2];
+
+        xsprintf(s, "entry %" PRIu64, i);
+        iov[0] = IOVEC_MAKE_STRING("MESSAGE=");
+        iov[1] = IOVEC_MAKE_STRING(strjoina(s, "\n"));
+
+        return journal_ring_append(r, iov, ELEMENTSOF(iov), 4711 + i);
+}
+
+static void test_ring(void) {
+        _cleanup_(journal_ring_freep) JournalRing *producer = NULL, *consumer = NULL;
+        _cleanup_close_ int fd = -1;
+        _cleanup_free_ char *buffer = NULL, *big = NULL;
+        size_t allocated = 0;
+        Collected c = {};
+        struct iovec iov;
+        uint64_t i = 0;
+        int r;
+
+        assert_se(journal_ring_new(JOURNAL_RING_DATA_SIZE_MIN, &producer, &fd) >= 0);
+
+        /* Nobody is reading yet */
+        assert_se(append(producer, i) == -ENOTCONN);
+        assert_se(journal_ring_consumer(producer) == JOURNAL_RING_PENDING);
+
+        assert_se(journal_ring_attach(fd, &consumer) >= 0);
+        assert_se(journal_ring_consumer(producer) == JOURNAL_RING_ATTACHED);
+
+        /* Nobody asked for a wakeup yet */
+        assert_se(append(producer, i++) == 0);
+        assert_se(journal_ring_drain(consumer, collect, &c, &buffer, &allocated) == 0);
+        assert_se(c.n == 1);
+        assert_se(c.realtime == 4711);
+
+        /* Only the first entry after draining wakes up the consumer */
+        assert_se(append(producer, i++) == 1);
+        assert_se(append(producer, i++) == 0);
+        assert_se(journal_ring_drain(consumer, collect, &c, &buffer, &allocated) == 0);
+        assert_se(c.n == 3);
+
+        /* Fill it up, and go around the end a few times */
+        while ((r = append(producer, i)) >= 0)
+                i++;
+        assert_se(r == -ENOBUFS);
+        assert_se(journal_ring_drain(consumer, collect, &c, &buffer, &allocated) == 0);
+        assert_se(c.next == i);
+
+        for (; i < 20000; i++) {
+                assert_se(append(producer, i) >= 0);
+                if (i % 1000 == 0)
+                        assert_se(journal_ring_drain(consumer, collect, &c, &buffer, &allocated) == 0);
+        }
+        assert_se(journal_ring_drain(consumer, collect, &c, &buffer, &allocated) == 0);
+        assert_se(c.next == i);
+
+        /* Entries too large to be worth it go into the socket */
+        assert_se(big = malloc(JOURNAL_RING_DATA_SIZE_MIN / 4));
+        memset(big, 'x', JOURNAL_RING_DATA_SIZE_MIN / 4);
+        iov = IOVEC_MAKE(big, JOURNAL_RING_DATA_SIZE_MIN / 4);
+        assert_se(journal_ring_append(producer, &iov, 1, 0) == -E2BIG);
+
+        /* The client can't make us read beyond the ring */
+        producer->header->head += 2 * JOURNAL_RING_DATA_SIZE_MIN;
+        assert_se(journal_ring_drain(consumer, collect, &c, &buffer, &allocated) == -EBADMSG);
+        producer->header->head -= 2 * JOURNAL_RING_DATA_SIZE_MIN;
+
+        /* Once journald lets go, the client notices */
+        consumer = journal_ring_free(consumer);
+        assert_se(journal_ring_consumer(producer) == JOURNAL_RING_DETACHED);
+        assert_se(append(producer, i) == -ENOTCONN);
+}
+
+static void test_attach_unsealed(void) {
+        _cleanup_(journal_ring_freep) JournalRing *consumer = NULL;
+        _cleanup_close_ int fd = -1;
+
+        /* Rings whose size the client could still change are refused */
+        fd = memfd_create("test-journal-ring", MFD_CLOEXEC);
+        if (fd < 0) {
+                log_info_errno(errno, "memfd_create() failed, skipping: %m");
+                return;
+        }
+
+        assert_se(ftruncate(fd, sizeof(JournalRingHeader) + JOURNAL_RING_DATA_SIZE_MIN) >= 0);
+        assert_se(journal_ring_attach(fd, &consumer) == -EPERM);
+}
+
+int main(int argc, char *argv[]) {
+        log_set_max_level(LOG_DEBUG);
+        log_parse_environment();
+        log_open();
+
+        test_ring();
+        test_attach_unsealed();
+
+        return 0;
+}
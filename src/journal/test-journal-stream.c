@@ -6,6 +6,7 @@
 ***/
 
 #include <fcntl.h>
+#include <pthread.h>
 #include <unistd.h>
 
 #include "sd-journal.h"
@@ -17,9 +18,11 @@
 #include "macro.h"
 #include "parse-util.h"
 #include "rm-rf.h"
+#include "stdio-util.h"
 #include "util.h"
 
 #define N_ENTRIES 200
+#define N_THREADS 4
 
 static void verify_contents(sd_journal *j, unsigned skip) {
         unsigned i;
@@ -61,6 +64,49 @@ static void verify_contents(sd_journal *j, unsigned skip) {
                 assert_se(i == N_ENTRIES);
 }
 
+static void *reader_thread(void *p) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        const char *directory = p;
+        unsigned pass;
+
+        /* Each thread has its own journal object and hence its own position, only the maps are shared */
+        assert_se(sd_journal_open_directory(&j, directory, SD_JOURNAL_SHARE_MAPPINGS) >= 0);
+
+        for (pass = 0; pass < 10; pass++) {
+                unsigned i = 0;
+
+                SD_JOURNAL_FOREACH(j) {
+                        char number[DECIMAL_STR_MAX(unsigned) + 8];
+                        const void *d;
+                        size_t l;
+
+                        assert_se(sd_journal_get_data(j, "NUMBER", &d, &l) >= 0);
+                        xsprintf(number, "NUMBER=%u", i);
+                        assert_se(l == strlen(number));
+                        assert_se(memcmp(d, number, l) == 0);
+                        i++;
+                }
+                assert_se(i == N_ENTRIES);
+
+                SD_JOURNAL_FOREACH_BACKWARDS(j)
+                        i--;
+                assert_se(i == 0);
+        }
+
+        return NULL;
+}
+
+static void test_shared_mappings(const char *directory) {
+        pthread_t threads[N_THREADS];
+        unsigned i;
+
+        for (i = 0; i < N_THREADS; i++)
+                assert_se(pthread_create(threads + i, NULL, reader_thread, (void*) directory) == 0);
+
+        for (i = 0; i < N_THREADS; i++)
+                assert_se(pthread_join(threads[i], NULL) == 0);
+}
+
 int main(int argc, char *argv[]) {
         JournalFile *one, *two, *three;
         char t[] = "/tmp/journal-stream-XXXXXX";
@@ -178,6 +224,8 @@ int main(int argc, char *argv[]) {
         SD_JOURNAL_FOREACH_UNIQUE(j, data, l)
                 printf("%.*s\n", (int) l, (const char*) data);
 
+        test_shared_mappings(t);
+
         assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
 
         return 0;
@@ -8,11 +8,21 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include "alloc-util.h"
+#include "dirent-util.h"
+#include "fd-util.h"
+#include "glob-util.h"
+#include "io-util.h"
 #include "journal-authenticate.h"
 #include "journal-file.h"
 #include "journal-vacuum.h"
+#include "journal-verify.h"
 #include "log.h"
+#include "lookup3.h"
 #include "rm-rf.h"
+#include "set.h"
+#include "stdio-util.h"
+#include "string-util.h"
 
 static bool arg_keep = false;
 
@@ -110,6 +120,465 @@ static void test_non_empty(void) {
         puts("------------------------------------------------------------");
 }
 
+static void test_append_entries(void) {
+        JournalFileEntry entries[100];
+        JournalFileCopyEntry copies[ELEMENTSOF(entries)];
+        struct iovec iovec[ELEMENTSOF(entries)][2];
+        char numbers[ELEMENTSOF(entries)][DECIMAL_STR_MAX(unsigned) + 3];
+        static const char host[] = "HOST=foo";
+        dual_timestamp ts;
+        JournalFile *f, *g;
+        size_t n = 0;
+        uint64_t seqnum = 0, p;
+        Object *o;
+        unsigned i;
+        char t[] = "/tmp/journal-XXXXXX";
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, true, NULL, NULL, NULL, NULL, &f) == 0);
+
+        dual_timestamp_get(&ts);
+
+        for (i = 0; i < ELEMENTSOF(entries); i++) {
+                xsprintf(numbers[i], "N=%u", i);
+
+                iovec[i][0].iov_base = (void*) host;
+                iovec[i][0].iov_len = strlen(host);
+                iovec[i][1].iov_base = numbers[i];
+                iovec[i][1].iov_len = strlen(numbers[i]);
+
+                entries[i] = (JournalFileEntry) {
+                        .ts = &ts,
+                        .iovec = iovec[i],
+                        .n_iovec = 2,
+                };
+        }
+
+        assert_se(journal_file_append_entries(f, entries, ELEMENTSOF(entries), &seqnum, &n) == 0);
+        assert_se(n == ELEMENTSOF(entries));
+        assert_se(seqnum == ELEMENTSOF(entries));
+        assert_se(le64toh(f->header->n_entries) == ELEMENTSOF(entries));
+
+        /* An empty batch is fine too */
+        assert_se(journal_file_append_entries(f, NULL, 0, &seqnum, &n) == 0);
+        assert_se(n == 0);
+
+        p = 0;
+        for (i = 0; i < ELEMENTSOF(entries); i++) {
+                assert_se(journal_file_next_entry(f, p, DIRECTION_DOWN, &o, &p) == 1);
+                assert_se(le64toh(o->entry.seqnum) == i + 1);
+                assert_se(journal_file_entry_n_items(o) == 2);
+        }
+        assert_se(journal_file_next_entry(f, p, DIRECTION_DOWN, &o, &p) == 0);
+
+        /* The shared field must have been stored only once, and be linked to all entries */
+        assert_se(journal_file_find_data_object(f, host, strlen(host), &o, &p) == 1);
+        assert_se(le64toh(o->data.n_entries) == ELEMENTSOF(entries));
+        assert_se(journal_file_next_entry_for_data(f, NULL, 0, p, DIRECTION_DOWN, &o, NULL) == 1);
+        assert_se(le64toh(o->entry.seqnum) == 1);
+        assert_se(journal_file_next_entry_for_data(f, NULL, 0, p, DIRECTION_UP, &o, NULL) == 1);
+        assert_se(le64toh(o->entry.seqnum) == ELEMENTSOF(entries));
+
+        assert_se(journal_file_find_data_object(f, "N=42", 4, NULL, &p) == 1);
+        assert_se(journal_file_next_entry_for_data(f, NULL, 0, p, DIRECTION_DOWN, &o, NULL) == 1);
+        assert_se(le64toh(o->entry.seqnum) == 43);
+
+        assert_se(journal_file_move_to_entry_by_seqnum(f, 77, DIRECTION_DOWN, &o, NULL) == 1);
+        assert_se(le64toh(o->entry.seqnum) == 77);
+
+        /* Copy everything over in one batch, the way journald flushes to /var */
+        assert_se(journal_file_open(-1, "copy.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, true, NULL, NULL, NULL, NULL, &g) == 0);
+
+        p = 0;
+        for (i = 0; i < ELEMENTSOF(copies); i++) {
+                assert_se(journal_file_next_entry(f, p, DIRECTION_DOWN, &o, &p) == 1);
+                copies[i] = (JournalFileCopyEntry) {
+                        .file = f,
+                        .offset = p,
+                };
+        }
+
+        seqnum = 0;
+        assert_se(journal_file_copy_entries(g, copies, ELEMENTSOF(copies), &seqnum, &n) == 0);
+        assert_se(n == ELEMENTSOF(copies));
+        assert_se(seqnum == ELEMENTSOF(copies));
+        assert_se(le64toh(g->header->n_entries) == ELEMENTSOF(copies));
+
+        assert_se(journal_file_find_data_object(g, host, strlen(host), &o, &p) == 1);
+        assert_se(le64toh(o->data.n_entries) == ELEMENTSOF(copies));
+        assert_se(journal_file_find_data_object(g, "N=42", 4, NULL, &p) == 1);
+        assert_se(journal_file_next_entry_for_data(g, NULL, 0, p, DIRECTION_DOWN, &o, NULL) == 1);
+        assert_se(le64toh(o->entry.seqnum) == 43);
+
+        (void) journal_file_close(g);
+        (void) journal_file_close(f);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+#if HAVE_COMPRESSION
+static void test_append_compressed(void) {
+        CompressedField compressed[2] = {};
+        struct iovec iovec[2];
+        char big[4096];
+        static const char small[] = "SMALL=foo";
+        JournalFile *f;
+        uint64_t p;
+        Object *o;
+        char t[] = "/tmp/journal-XXXXXX";
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, true, NULL, NULL, NULL, NULL, &f) == 0);
+
+        memcpy(big, "BIG=", 4);
+        memset(big + 4, 'x', sizeof(big) - 4);
+
+        iovec[0] = IOVEC_MAKE(big, sizeof(big));
+        iovec[1] = IOVEC_MAKE_STRING(small);
+
+        /* Only the large field is compressed ahead of time, the other one is left to the file */
+        assert_se(compressed_field_compress(compressed, journal_file_compression(f), big, sizeof(big)) == 1);
+        assert_se(compressed[0].hash == hash64(big, sizeof(big)));
+        assert_se(compressed[0].size < sizeof(big));
+
+        assert_se(journal_file_append_entry_compressed(f, NULL, iovec, 2, compressed, 2, NULL, NULL, NULL) == 0);
+
+        assert_se(journal_file_find_data_object(f, big, sizeof(big), &o, &p) == 1);
+        assert_se((o->object.flags & OBJECT_COMPRESSION_MASK) == compressed[0].compression);
+        assert_se(le64toh(o->object.size) == offsetof(Object, data.payload) + compressed[0].size);
+        assert_se(memcmp(o->data.payload, compressed[0].data, compressed[0].size) == 0);
+
+        assert_se(journal_file_find_data_object(f, small, strlen(small), NULL, NULL) == 1);
+
+        compressed_field_done(compressed);
+        assert_se(!compressed[0].data);
+
+        assert_se(journal_file_verify(f, NULL, NULL, NULL, NULL, false) >= 0);
+
+        (void) journal_file_close(f);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+#endif
+
+static void test_append_hashed(void) {
+        static const char field[] = "_HOSTNAME=waldo";
+        CompressedField hashed = {
+                .hash = hash64(field, strlen(field)),
+                .hashed = true,
+        };
+        struct iovec iovec = IOVEC_MAKE_STRING(field), both[2] = {
+                IOVEC_MAKE_STRING("MESSAGE=foo"),
+                IOVEC_MAKE_STRING(field),
+        };
+        JournalFile *f;
+        uint64_t p, q, n_data;
+        Object *o;
+        char t[] = "/tmp/journal-XXXXXX";
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        /* A field that comes with its hash is stored the same as one without */
+        assert_se(journal_file_append_entry(f, NULL, &iovec, 1, NULL, NULL, NULL) == 0);
+        assert_se(journal_file_find_data_object(f, field, strlen(field), NULL, &p) == 1);
+        n_data = le64toh(f->header->n_data);
+
+        assert_se(journal_file_append_entry_compressed(f, NULL, &iovec, 1, &hashed, 1, NULL, NULL, NULL) == 0);
+
+        /* The hashes only cover the trailing fields */
+        assert_se(journal_file_append_entry_compressed(f, NULL, both, 2, &hashed, 1, NULL, NULL, NULL) == 0);
+        assert_se(journal_file_find_data_object(f, field, strlen(field), &o, &q) == 1);
+        assert_se(p == q);
+        assert_se(le64toh(o->data.hash) == hashed.hash);
+        assert_se(le64toh(o->data.n_entries) == 3);
+        assert_se(le64toh(f->header->n_data) == n_data + 1);
+        assert_se(journal_file_find_data_object(f, "MESSAGE=foo", STRLEN("MESSAGE=foo"), NULL, NULL) == 1);
+
+        assert_se(journal_file_verify(f, NULL, NULL, NULL, NULL, false) >= 0);
+
+        (void) journal_file_close(f);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_bloom_filter(void) {
+        _cleanup_globfree_ glob_t g = {};
+        char number[DECIMAL_STR_MAX(unsigned) + 3];
+        struct iovec iovec;
+        JournalFile *f;
+        unsigned i, n_maybe = 0;
+        char t[] = "/tmp/journal-XXXXXX";
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, true, NULL, NULL, NULL, NULL, &f) == 0);
+
+        for (i = 0; i < 1000; i++) {
+                xsprintf(number, "N=%u", i);
+                iovec = IOVEC_MAKE_STRING(number);
+                assert_se(journal_file_append_entry(f, NULL, &iovec, 1, NULL, NULL, NULL) == 0);
+        }
+
+        /* Online files don't carry a bloom filter */
+        assert_se(!JOURNAL_HEADER_BLOOM_FILTER(f->header));
+
+        assert_se(journal_file_rotate(&f, true, (uint64_t) -1, true, NULL) >= 0);
+        (void) journal_file_close(f);
+
+        assert_se(safe_glob("test@*.journal", 0, &g) == 0);
+        assert_se(g.gl_pathc == 1);
+
+        assert_se(journal_file_open(-1, g.gl_pathv[0], O_RDONLY, 0, false, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+        assert_se(f->header->state == STATE_ARCHIVED);
+        assert_se(JOURNAL_HEADER_BLOOM_FILTER(f->header));
+        assert_se(journal_file_verify(f, NULL, NULL, NULL, NULL, false) >= 0);
+
+        /* No false negatives… */
+        for (i = 0; i < 1000; i++) {
+                xsprintf(number, "N=%u", i);
+                assert_se(journal_file_maybe_contains_hash(f, hash64(number, strlen(number))));
+        }
+
+        /* …and only few false positives */
+        for (i = 1000; i < 2000; i++) {
+                xsprintf(number, "N=%u", i);
+                if (journal_file_maybe_contains_hash(f, hash64(number, strlen(number))))
+                        n_maybe++;
+        }
+        log_info("%u false positives of 1000 misses.", n_maybe);
+        assert_se(n_maybe < 100);
+
+        (void) journal_file_close(f);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_realtime_index(void) {
+        _cleanup_globfree_ glob_t g = {};
+        char number[DECIMAL_STR_MAX(unsigned) + 3];
+        struct iovec iovec;
+        dual_timestamp ts;
+        JournalFile *f;
+        Object *o;
+        unsigned i;
+        char t[] = "/tmp/journal-XXXXXX";
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, true, NULL, NULL, NULL, NULL, &f) == 0);
+
+        for (i = 0; i < 1000; i++) {
+                ts.realtime = 1000000 + i * 10;
+                ts.monotonic = 1000 + i;
+
+                xsprintf(number, "N=%u", i);
+                iovec = IOVEC_MAKE_STRING(number);
+                assert_se(journal_file_append_entry(f, &ts, &iovec, 1, NULL, NULL, NULL) == 0);
+        }
+
+        assert_se(journal_file_rotate(&f, true, (uint64_t) -1, true, NULL) >= 0);
+        (void) journal_file_close(f);
+
+        assert_se(safe_glob("test@*.journal", 0, &g) == 0);
+        assert_se(g.gl_pathc == 1);
+
+        assert_se(journal_file_open(-1, g.gl_pathv[0], O_RDONLY, 0, false, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+        assert_se(JOURNAL_HEADER_REALTIME_INDEX(f->header));
+        assert_se(journal_file_verify(f, NULL, NULL, NULL, NULL, false) >= 0);
+
+        for (i = 0; i < 1000; i++) {
+                assert_se(journal_file_move_to_entry_by_realtime(f, 1000000 + i * 10, DIRECTION_DOWN, &o, NULL) == 1);
+                assert_se(le64toh(o->entry.seqnum) == i + 1);
+
+                assert_se(journal_file_move_to_entry_by_realtime(f, 1000000 + i * 10, DIRECTION_UP, &o, NULL) == 1);
+                assert_se(le64toh(o->entry.seqnum) == i + 1);
+
+                assert_se(journal_file_move_to_entry_by_realtime(f, 1000000 + i * 10 + 5, DIRECTION_UP, &o, NULL) == 1);
+                assert_se(le64toh(o->entry.seqnum) == i + 1);
+
+                if (i < 999) {
+                        assert_se(journal_file_move_to_entry_by_realtime(f, 1000000 + i * 10 + 5, DIRECTION_DOWN, &o, NULL) == 1);
+                        assert_se(le64toh(o->entry.seqnum) == i + 2);
+                }
+        }
+
+        assert_se(journal_file_move_to_entry_by_realtime(f, 999999, DIRECTION_UP, &o, NULL) == 0);
+        assert_se(journal_file_move_to_entry_by_realtime(f, 999999, DIRECTION_DOWN, &o, NULL) == 1);
+        assert_se(le64toh(o->entry.seqnum) == 1);
+        assert_se(journal_file_move_to_entry_by_realtime(f, 1000000 + 999 * 10 + 1, DIRECTION_DOWN, &o, NULL) == 0);
+        assert_se(journal_file_move_to_entry_by_realtime(f, 1000000 + 999 * 10 + 1, DIRECTION_UP, &o, NULL) == 1);
+        assert_se(le64toh(o->entry.seqnum) == 1000);
+
+        (void) journal_file_close(f);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_extensible_hash_table(void) {
+        char number[DECIMAL_STR_MAX(unsigned) + 3];
+        JournalFile *f, *reader;
+        struct iovec iovec;
+        dual_timestamp ts;
+        unsigned i;
+        char t[] = "/tmp/journal-XXXXXX";
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, false, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+        assert_se(JOURNAL_HEADER_EXTENSIBLE_HASH_TABLE(f->header));
+
+        /* Open a reader before the table is extended, it needs to pick up the segments on its own */
+        assert_se(journal_file_open(-1, "test.journal", O_RDONLY, 0, false, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &reader) == 0);
+        assert_se(journal_file_find_data_object(reader, "N=0", 3, NULL, NULL) == 0);
+
+        for (i = 0; i < 40000; i++) {
+                dual_timestamp_get(&ts);
+
+                xsprintf(number, "N=%u", i);
+                iovec = IOVEC_MAKE_STRING(number);
+                assert_se(journal_file_append_entry(f, &ts, &iovec, 1, NULL, NULL, NULL) == 0);
+        }
+
+        assert_se(journal_file_map_data_hash_table(f) >= 0);
+        assert_se(f->n_data_hash_tables > 1);
+        assert_se(!journal_file_rotate_suggested(f, 0));
+
+        for (i = 0; i < 40000; i += 7) {
+                xsprintf(number, "N=%u", i);
+                assert_se(journal_file_find_data_object(f, number, strlen(number), NULL, NULL) == 1);
+                assert_se(journal_file_find_data_object(reader, number, strlen(number), NULL, NULL) == 1);
+        }
+
+        assert_se(reader->n_data_hash_tables == f->n_data_hash_tables);
+        assert_se(journal_file_find_data_object(reader, "N=40000", 7, NULL, NULL) == 0);
+
+        journal_file_print_header(f);
+        assert_se(journal_file_verify(f, NULL, NULL, NULL, NULL, false) >= 0);
+
+        (void) journal_file_close(reader);
+        (void) journal_file_close(f);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_boots(void) {
+        const JournalBoot *boots;
+        char field[STRLEN("_BOOT_ID=") + 32 + 1] = "_BOOT_ID=";
+        sd_id128_t ids[2];
+        struct iovec iovec;
+        dual_timestamp ts;
+        JournalFile *f;
+        size_t n;
+        unsigned i;
+        char t[] = "/tmp/journal-XXXXXX";
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, true, NULL, NULL, NULL, NULL, &f) == 0);
+
+        assert_se(journal_file_get_boots(f, &boots, &n) == 0);
+        assert_se(n == 0);
+
+        assert_se(sd_id128_randomize(&ids[0]) >= 0);
+        assert_se(sd_id128_randomize(&ids[1]) >= 0);
+
+        for (i = 0; i < 20; i++) {
+                /* The entry headers carry the boot id of the writer */
+                f->header->boot_id = ids[i / 10];
+                sd_id128_to_string(ids[i / 10], field + 9);
+
+                ts.realtime = 1000000 + i * 10;
+                ts.monotonic = 1000 + i % 10;
+
+                iovec = IOVEC_MAKE_STRING(field);
+                assert_se(journal_file_append_entry(f, &ts, &iovec, 1, NULL, NULL, NULL) == 0);
+        }
+
+        assert_se(journal_file_get_boots(f, &boots, &n) == 0);
+        assert_se(n == 2);
+
+        for (i = 0; i < 2; i++) {
+                const JournalBoot *b;
+
+                b = sd_id128_equal(boots[0].boot_id, ids[i]) ? boots : boots + 1;
+                assert_se(sd_id128_equal(b->boot_id, ids[i]));
+                assert_se(b->first_seqnum == i * 10 + 1);
+                assert_se(b->first_realtime == 1000000 + i * 100);
+                assert_se(b->first_monotonic == 1000);
+                assert_se(b->last_realtime == 1000000 + i * 100 + 90);
+                assert_se(b->last_monotonic == 1009);
+        }
+
+        /* An entry without a _BOOT_ID= field can only be found by iterating */
+        iovec = IOVEC_MAKE_STRING("N=1");
+        assert_se(journal_file_append_entry(f, &ts, &iovec, 1, NULL, NULL, NULL) == 0);
+        assert_se(journal_file_get_boots(f, &boots, &n) == -EOPNOTSUPP);
+
+        (void) journal_file_close(f);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
 static void test_empty(void) {
         JournalFile *f1, *f2, *f3, *f4;
         char t[] = "/tmp/journal-XXXXXX";
@@ -152,7 +621,83 @@ static void test_empty(void) {
         (void) journal_file_close(f4);
 }
 
-#if HAVE_XZ || HAVE_LZ4
+static unsigned count_journal_files(const char *directory) {
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+        unsigned n = 0;
+
+        assert_se(d = opendir(directory));
+
+        FOREACH_DIRENT(de, d, assert_se(false))
+                if (endswith(de->d_name, ".journal"))
+                        n++;
+
+        return n;
+}
+
+static void append_and_rotate(JournalFile **f, JournalVacuumCache *cache) {
+        static const char message[] = "MESSAGE=foo";
+        _cleanup_free_ char *archived = NULL;
+        struct iovec iovec = IOVEC_INIT_STRING(message);
+        dual_timestamp ts;
+
+        dual_timestamp_get(&ts);
+        assert_se(journal_file_append_entry(*f, &ts, &iovec, 1, NULL, NULL, NULL) == 0);
+
+        assert_se(journal_file_archived_path(*f, &archived) >= 0);
+        journal_vacuum_cache_verify(cache, ".");
+        assert_se(journal_file_rotate(f, true, (uint64_t) -1, false, NULL) >= 0);
+        assert_se(journal_vacuum_cache_add(cache, ".", basename(archived)) >= 0);
+}
+
+static void test_vacuum_cache(void) {
+        _cleanup_(journal_vacuum_cache_freep) JournalVacuumCache *cache = NULL;
+        JournalFile *f;
+        char t[] = "/tmp/journal-XXXXXX";
+        unsigned i;
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        for (i = 0; i < 3; i++)
+                append_and_rotate(&f, cache);
+
+        /* Populates the cache, without deleting anything */
+        assert_se(journal_directory_vacuum_cached(&cache, ".", 0, 100, 0, NULL, true) >= 0);
+        assert_se(cache);
+        assert_se(count_journal_files(".") == 4);
+
+        /* These are added to the cache, without rescanning */
+        for (i = 0; i < 3; i++)
+                append_and_rotate(&f, cache);
+        assert_se(count_journal_files(".") == 7);
+
+        /* The active file counts against the limit, but is never deleted */
+        assert_se(journal_directory_vacuum_cached(&cache, ".", 0, 3, 0, NULL, true) >= 0);
+        assert_se(count_journal_files(".") == 3);
+
+        /* Files deleted behind our back are noticed */
+        assert_se(journal_directory_vacuum(".", 0, 1, 0, NULL, true) >= 0);
+        assert_se(count_journal_files(".") == 1);
+        append_and_rotate(&f, cache);
+        assert_se(journal_directory_vacuum_cached(&cache, ".", 0, 1, 0, NULL, true) >= 0);
+        assert_se(count_journal_files(".") == 1);
+
+        (void) journal_file_close(f);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+#if HAVE_COMPRESSION
 static bool check_compressed(uint64_t compress_threshold, uint64_t data_size) {
         dual_timestamp ts;
         JournalFile *f;
@@ -237,6 +782,61 @@ static void test_min_compress_size(void) {
 }
 #endif
 
+static void test_offline_pool(void) {
+        static const char message[] = "MESSAGE=foo";
+        struct iovec iovec = IOVEC_INIT_STRING(message);
+        JournalFile *files[32], *f;
+        Set *deferred_closes;
+        char t[] = "/tmp/journal-XXXXXX";
+        dual_timestamp ts;
+        Iterator it;
+        unsigned i;
+
+        /* Offline more files at once than there are offline threads */
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(deferred_closes = set_new(NULL));
+
+        dual_timestamp_get(&ts);
+
+        for (i = 0; i < ELEMENTSOF(files); i++) {
+                char fn[STRLEN("test-") + DECIMAL_STR_MAX(unsigned) + STRLEN(".journal")];
+
+                xsprintf(fn, "test-%u.journal", i);
+                assert_se(journal_file_open(-1, fn, O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, deferred_closes, NULL, &files[i]) == 0);
+                assert_se(journal_file_append_entry(files[i], &ts, &iovec, 1, NULL, NULL, NULL) == 0);
+        }
+
+        /* Some are brought online again right away, cancelling or waiting for their offline */
+        for (i = 0; i < ELEMENTSOF(files); i++)
+                assert_se(journal_file_set_offline(files[i], false) >= 0);
+        for (i = 0; i < ELEMENTSOF(files); i += 3)
+                assert_se(journal_file_append_entry(files[i], &ts, &iovec, 1, NULL, NULL, NULL) == 0);
+
+        for (i = 0; i < ELEMENTSOF(files); i++)
+                assert_se(journal_file_rotate(&files[i], true, (uint64_t) -1, false, deferred_closes) >= 0);
+        assert_se(set_size(deferred_closes) == ELEMENTSOF(files));
+
+        SET_FOREACH(f, deferred_closes, it) {
+                assert_se(journal_file_set_offline(f, true) >= 0);
+                assert_se(!journal_file_is_offlining(f));
+                assert_se(f->header->state == STATE_ARCHIVED);
+        }
+
+        set_free_with_destructor(deferred_closes, journal_file_close);
+
+        for (i = 0; i < ELEMENTSOF(files); i++) {
+                assert_se(journal_file_set_offline(files[i], false) >= 0);
+                (void) journal_file_close(files[i]);
+        }
+
+        assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
 int main(int argc, char *argv[]) {
         arg_keep = argc > 1;
 
@@ -245,8 +845,19 @@ int main(int argc, char *argv[]) {
                 return EXIT_TEST_SKIP;
 
         test_non_empty();
+        test_append_entries();
+#if HAVE_COMPRESSION
+        test_append_compressed();
+#endif
+        test_append_hashed();
+        test_bloom_filter();
+        test_realtime_index();
+        test_extensible_hash_table();
+        test_boots();
         test_empty();
-#if HAVE_XZ || HAVE_LZ4
+        test_vacuum_cache();
+        test_offline_pool();
+#if HAVE_COMPRESSION
         test_min_compress_size();
 #endif
 
@@ -22,6 +22,7 @@ int main(int argc, char *argv[]) {
         char px[] = "/tmp/testmmapXXXXXXX", py[] = "/tmp/testmmapYXXXXXX", pz[] = "/tmp/testmmapZXXXXXX";
         MMapCache *m;
         void *p, *q;
+        size_t a, b;
 
         assert_se(m = mmap_cache_new());
 
@@ -60,6 +61,21 @@ int main(int argc, char *argv[]) {
 
         assert_se((uint8_t*) p + 1 == (uint8_t*) q);
 
+        /* Windows grow when a context moves on sequentially */
+        r = mmap_cache_get(m, fx, PROT_READ, 2, false, 0, 2, NULL, &p, &a);
+        assert_se(r >= 0);
+
+        r = mmap_cache_get(m, fx, PROT_READ, 2, false, a, 2, NULL, &q, &b);
+        assert_se(r >= 0);
+
+        assert_se(b >= a);
+#if !ENABLE_DEBUG_MMAP_CACHE
+        if (sizeof(void*) > 4 && !getenv("SYSTEMD_JOURNAL_MMAP_WINDOW_MAX"))
+                assert_se(b == 2 * a);
+#endif
+
+        mmap_cache_stats_log_debug(m);
+
         mmap_cache_free_fd(m, fx);
         mmap_cache_unref(m);
 
@@ -16,6 +16,9 @@
 #include "log.h"
 #include "util.h"
 
+/* Maximum number of datagrams processed per wakeup of the server socket */
+#define DHCP_SERVER_RECEIVE_BATCH_MAX 64U
+
 typedef struct DHCPClientId {
         size_t length;
         void *data;
@@ -54,7 +57,11 @@ struct sd_dhcp_server {
         bool emit_router;
 
         Hashmap *leases_by_client_id;
-        DHCPLease **bound_leases;
+        /* Address in the pool → DHCPLease, the server's own address maps to invalid_lease. Together with
+         * the bitmap of bound addresses, that takes a bit per address in the pool plus the actual leases,
+         * so that even pools spanning big subnets are cheap. */
+        Hashmap *bound_leases_by_address;
+        uint64_t *bound_addresses;
         DHCPLease invalid_lease;
 
         uint32_t max_lease_time, default_lease_time;
@@ -12,6 +12,7 @@
 #include "in-addr-util.h"
 #include "lldp-internal.h"
 #include "lldp-neighbor.h"
+#include "sparse-endian.h"
 #include "unaligned.h"
 
 static void lldp_neighbor_id_hash_func(const void *p, struct siphash *state) {
@@ -665,6 +666,62 @@ _public_ int sd_lldp_neighbor_from_raw(sd_lldp_neighbor **ret, const void *raw,
         return r;
 }
 
+_public_ int sd_lldp_neighbors_from_raw(sd_lldp_neighbor ***ret, const void *raw, size_t raw_size) {
+        sd_lldp_neighbor **l = NULL;
+        size_t n = 0, allocated = 0, i;
+        const uint8_t *p = raw;
+        int r;
+
+        assert_return(ret, -EINVAL);
+        assert_return(raw || raw_size <= 0, -EINVAL);
+
+        /* Parses a list of datagrams, each prefixed by its size as 64bit little endian integer, as networkd
+         * writes them to /run/systemd/netif/lldp/. Returns the number of neighbors. */
+
+        while (raw_size > 0) {
+                uint64_t sz;
+                le64_t u;
+
+                if (raw_size < sizeof(u)) {
+                        r = -EBADMSG;
+                        goto fail;
+                }
+
+                memcpy(&u, p, sizeof(u));
+                sz = le64toh(u);
+                p += sizeof(u);
+                raw_size -= sizeof(u);
+
+                if (sz > raw_size) {
+                        r = -EBADMSG;
+                        goto fail;
+                }
+
+                if (!GREEDY_REALLOC(l, allocated, n + 1)) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                r = sd_lldp_neighbor_from_raw(l + n, p, sz);
+                if (r < 0)
+                        goto fail;
+
+                n++;
+                p += sz;
+                raw_size -= sz;
+        }
+
+        *ret = l;
+        return (int) n;
+
+fail:
+        for (i = 0; i < n; i++)
+                sd_lldp_neighbor_unref(l[i]);
+        free(l);
+
+        return r;
+}
+
 _public_ int sd_lldp_neighbor_tlv_rewind(sd_lldp_neighbor *n) {
         assert_return(n, -EINVAL);
 
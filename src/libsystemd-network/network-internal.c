@@ -114,34 +114,37 @@ bool net_match_config(Set *match_mac,
                       const char *dev_type,
                       const char *dev_name) {
 
-        if (match_host && condition_test(match_host) <= 0)
+        /* Check the properties of the device first: most configurations do not apply to a given device,
+         * and that is cheap to find out, while the conditions on the system may need to read files. */
+
+        if (match_mac && dev_mac && !set_contains(match_mac, dev_mac))
                 return false;
 
-        if (match_virt && condition_test(match_virt) <= 0)
+        if (!net_condition_test_strv(match_paths, dev_path))
                 return false;
 
-        if (match_kernel_cmdline && condition_test(match_kernel_cmdline) <= 0)
+        if (!net_condition_test_strv(match_drivers, dev_driver))
                 return false;
 
-        if (match_kernel_version && condition_test(match_kernel_version) <= 0)
+        if (!net_condition_test_strv(match_types, dev_type))
                 return false;
 
-        if (match_arch && condition_test(match_arch) <= 0)
+        if (!net_condition_test_strv(match_names, dev_name))
                 return false;
 
-        if (match_mac && dev_mac && !set_contains(match_mac, dev_mac))
+        if (match_host && condition_test(match_host) <= 0)
                 return false;
 
-        if (!net_condition_test_strv(match_paths, dev_path))
+        if (match_virt && condition_test(match_virt) <= 0)
                 return false;
 
-        if (!net_condition_test_strv(match_drivers, dev_driver))
+        if (match_kernel_cmdline && condition_test(match_kernel_cmdline) <= 0)
                 return false;
 
-        if (!net_condition_test_strv(match_types, dev_type))
+        if (match_kernel_version && condition_test(match_kernel_version) <= 0)
                 return false;
 
-        if (!net_condition_test_strv(match_names, dev_name))
+        if (match_arch && condition_test(match_arch) <= 0)
                 return false;
 
         return true;
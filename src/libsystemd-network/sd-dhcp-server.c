@@ -31,6 +31,44 @@ static void dhcp_lease_free(DHCPLease *lease) {
         free(lease);
 }
 
+static void pool_mark_bound(sd_dhcp_server *server, uint32_t offset, bool bound) {
+        assert(server);
+        assert(offset < server->pool_size);
+
+        if (bound)
+                server->bound_addresses[offset / 64] |= UINT64_C(1) << (offset % 64);
+        else
+                server->bound_addresses[offset / 64] &= ~(UINT64_C(1) << (offset % 64));
+}
+
+static int pool_find_free(sd_dhcp_server *server, uint32_t start) {
+        size_t n_words, i, w;
+
+        assert(server);
+        assert(start < server->pool_size);
+
+        /* Returns the offset of the first free address at or after start, wrapping around at the end of the
+         * pool. Checks 64 addresses at a time, so that this stays cheap even for big, nearly full pools. */
+
+        n_words = DIV_ROUND_UP(server->pool_size, 64);
+        w = start / 64;
+
+        /* Visit the first word twice: first only the bits from start on, then all of them */
+        for (i = 0; i <= n_words; i++) {
+                uint64_t word = server->bound_addresses[w];
+
+                if (i == 0)
+                        word |= (UINT64_C(1) << (start % 64)) - 1;
+
+                if (word != UINT64_MAX)
+                        return w * 64 + __builtin_ctzll(~word);
+
+                w = (w + 1) % n_words;
+        }
+
+        return -ENOSPC;
+}
+
 /* configures the server's address and subnet, and optionally the pool's size and offset into the subnet
  * the whole pool must fit into the subnet, and may not contain the first (any) nor last (broadcast) address
  * moreover, the server's own address may be in the pool, and is in that case reserved in order not to
@@ -75,12 +113,24 @@ int sd_dhcp_server_configure_pool(sd_dhcp_server *server, struct in_addr *addres
                 size = size_max;
 
         if (server->address != address->s_addr || server->netmask != netmask || server->pool_size != size || server->pool_offset != offset) {
+                int r;
+
+                uint64_t *bound;
 
-                free(server->bound_leases);
-                server->bound_leases = new0(DHCPLease*, size);
-                if (!server->bound_leases)
+                bound = new0(uint64_t, DIV_ROUND_UP(size, 64));
+                if (!bound)
                         return -ENOMEM;
 
+                /* The bits past the end of the pool are never free */
+                if (size % 64 != 0)
+                        bound[size / 64] = ~((UINT64_C(1) << (size % 64)) - 1);
+
+                /* Drop any leases associated with the old address range */
+                hashmap_clear(server->bound_leases_by_address);
+                hashmap_clear_with_destructor(server->leases_by_client_id, dhcp_lease_free);
+
+                free_and_replace(server->bound_addresses, bound);
+
                 server->pool_offset = offset;
                 server->pool_size = size;
 
@@ -88,11 +138,15 @@ int sd_dhcp_server_configure_pool(sd_dhcp_server *server, struct in_addr *addres
                 server->netmask = netmask;
                 server->subnet = address->s_addr & netmask;
 
-                if (server_off >= offset && server_off - offset < size)
-                        server->bound_leases[server_off - offset] = &server->invalid_lease;
+                if (server_off >= offset && server_off - offset < size) {
+                        r = hashmap_put(server->bound_leases_by_address, UINT32_TO_PTR(server->address), &server->invalid_lease);
+                        if (r < 0) {
+                                server->pool_size = 0;
+                                return r;
+                        }
 
-                /* Drop any leases associated with the old address range */
-                hashmap_clear_with_destructor(server->leases_by_client_id, dhcp_lease_free);
+                        pool_mark_bound(server, server_off - offset, true);
+                }
         }
 
         return 0;
@@ -172,7 +226,8 @@ sd_dhcp_server *sd_dhcp_server_unref(sd_dhcp_server *server) {
                 dhcp_lease_free(lease);
         hashmap_free(server->leases_by_client_id);
 
-        free(server->bound_leases);
+        hashmap_free(server->bound_leases_by_address);
+        free(server->bound_addresses);
         return mfree(server);
 }
 
@@ -197,6 +252,10 @@ int sd_dhcp_server_new(sd_dhcp_server **ret, int ifindex) {
         if (!server->leases_by_client_id)
                 return -ENOMEM;
 
+        server->bound_leases_by_address = hashmap_new(NULL);
+        if (!server->bound_leases_by_address)
+                return -ENOMEM;
+
         server->default_lease_time = DIV_ROUND_UP(DHCP_DEFAULT_LEASE_TIME_USEC, USEC_PER_SEC);
         server->max_lease_time = DIV_ROUND_UP(DHCP_MAX_LEASE_TIME_USEC, USEC_PER_SEC);
 
@@ -730,7 +789,6 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
 
         case DHCP_DISCOVER: {
                 be32_t address = INADDR_ANY;
-                unsigned i;
 
                 log_dhcp_server(server, "DISCOVER (0x%x)",
                                 be32toh(req->message->xid));
@@ -745,7 +803,7 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
                 else {
                         struct siphash state;
                         uint64_t hash;
-                        uint32_t next_offer;
+                        int next_offer;
 
                         /* even with no persistence of leases, we try to offer the same client
                            the same IP address. we do this by using the hash of the client id
@@ -754,16 +812,10 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
                         siphash24_init(&state, HASH_KEY.bytes);
                         client_id_hash_func(&req->client_id, &state);
                         hash = htole64(siphash24_finalize(&state));
-                        next_offer = hash % server->pool_size;
 
-                        for (i = 0; i < server->pool_size; i++) {
-                                if (!server->bound_leases[next_offer]) {
-                                        address = server->subnet | htobe32(server->pool_offset + next_offer);
-                                        break;
-                                }
-
-                                next_offer = (next_offer + 1) % server->pool_size;
-                        }
+                        next_offer = pool_find_free(server, hash % server->pool_size);
+                        if (next_offer >= 0)
+                                address = server->subnet | htobe32(server->pool_offset + next_offer);
                 }
 
                 if (address == INADDR_ANY)
@@ -840,7 +892,7 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
                 /* verify that the requested address is from the pool, and either
                    owned by the current client or free */
                 if (pool_offset >= 0 &&
-                    server->bound_leases[pool_offset] == existing_lease) {
+                    hashmap_get(server->bound_leases_by_address, UINT32_TO_PTR(address)) == existing_lease) {
                         DHCPLease *lease;
                         usec_t time_now = 0;
 
@@ -886,7 +938,15 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
                                 log_dhcp_server(server, "ACK (0x%x)",
                                                 be32toh(req->message->xid));
 
-                                server->bound_leases[pool_offset] = lease;
+                                r = hashmap_put(server->bound_leases_by_address, UINT32_TO_PTR(address), lease);
+                                if (r < 0) {
+                                        if (!existing_lease)
+                                                dhcp_lease_free(lease);
+                                        return r;
+                                }
+
+                                pool_mark_bound(server, pool_offset, true);
+
                                 hashmap_put(server->leases_by_client_id,
                                             &lease->client_id, lease);
 
@@ -922,8 +982,9 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
                 if (pool_offset < 0)
                         return 0;
 
-                if (server->bound_leases[pool_offset] == existing_lease) {
-                        server->bound_leases[pool_offset] = NULL;
+                if (hashmap_get(server->bound_leases_by_address, UINT32_TO_PTR(existing_lease->address)) == existing_lease) {
+                        hashmap_remove(server->bound_leases_by_address, UINT32_TO_PTR(existing_lease->address));
+                        pool_mark_bound(server, pool_offset, false);
                         hashmap_remove(server->leases_by_client_id, existing_lease);
                         dhcp_lease_free(existing_lease);
                 }
@@ -934,11 +995,9 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
         return 0;
 }
 
-static int server_receive_message(sd_event_source *s, int fd,
-                                  uint32_t revents, void *userdata) {
+static int server_receive_one(sd_dhcp_server *server, int fd) {
         _cleanup_free_ DHCPMessage *message = NULL;
         uint8_t cmsgbuf[CMSG_LEN(sizeof(struct in_pktinfo))];
-        sd_dhcp_server *server = userdata;
         struct iovec iov = {};
         struct msghdr msg = {
                 .msg_iov = &iov,
@@ -952,7 +1011,11 @@ static int server_receive_message(sd_event_source *s, int fd,
 
         assert(server);
 
+        /* Returns 0 if there was nothing to read, > 0 otherwise */
+
         buflen = next_datagram_size_fd(fd);
+        if (buflen == -EAGAIN)
+                return 0;
         if (buflen < 0)
                 return buflen;
 
@@ -971,7 +1034,7 @@ static int server_receive_message(sd_event_source *s, int fd,
                 return -errno;
         }
         if ((size_t)len < sizeof(DHCPMessage))
-                return 0;
+                return 1;
 
         CMSG_FOREACH(cmsg, &msg) {
                 if (cmsg->cmsg_level == IPPROTO_IP &&
@@ -982,7 +1045,7 @@ static int server_receive_message(sd_event_source *s, int fd,
                         /* TODO figure out if this can be done as a filter on
                          * the socket, like for IPv6 */
                         if (server->ifindex != info->ipi_ifindex)
-                                return 0;
+                                return 1;
 
                         break;
                 }
@@ -992,6 +1055,25 @@ static int server_receive_message(sd_event_source *s, int fd,
         if (r < 0)
                 log_dhcp_server_errno(server, r, "Couldn't process incoming message: %m");
 
+        return 1;
+}
+
+static int server_receive_message(sd_event_source *s, int fd,
+                                  uint32_t revents, void *userdata) {
+        sd_dhcp_server *server = userdata;
+        unsigned i;
+        int r;
+
+        assert(server);
+
+        /* When many clients talk to us at once, handle a bunch of requests per wakeup, but not so many that
+         * other event sources starve */
+        for (i = 0; i < DHCP_SERVER_RECEIVE_BATCH_MAX; i++) {
+                r = server_receive_one(server, fd);
+                if (r <= 0)
+                        return r;
+        }
+
         return 0;
 }
 
@@ -1041,16 +1123,14 @@ int sd_dhcp_server_start(sd_dhcp_server *server) {
 }
 
 int sd_dhcp_server_forcerenew(sd_dhcp_server *server) {
-        unsigned i;
+        DHCPLease *lease;
+        Iterator i;
         int r = 0;
 
         assert_return(server, -EINVAL);
-        assert(server->bound_leases);
-
-        for (i = 0; i < server->pool_size; i++) {
-                DHCPLease *lease = server->bound_leases[i];
 
-                if (!lease || lease == &server->invalid_lease)
+        HASHMAP_FOREACH(lease, server->bound_leases_by_address, i) {
+                if (lease == &server->invalid_lease)
                         continue;
 
                 r = server_send_forcerenew(server, lease->address,
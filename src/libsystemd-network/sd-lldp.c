@@ -21,6 +21,10 @@
 
 #define LLDP_DEFAULT_NEIGHBORS_MAX 128U
 
+/* An LLDPDU has to fit into a single frame. Refuse anything bigger than a jumbo frame, so that together with
+ * neighbors_max the memory a link's neighbors may take up stays bounded. */
+#define LLDP_DATAGRAM_SIZE_MAX 9216U
+
 static void lldp_flush_neighbors(sd_lldp *lldp) {
         sd_lldp_neighbor *n;
 
@@ -199,6 +203,13 @@ static int lldp_receive_datagram(sd_event_source *s, int fd, uint32_t revents, v
         space = next_datagram_size_fd(fd);
         if (space < 0)
                 return log_lldp_errno(space, "Failed to determine datagram size to read: %m");
+        if ((size_t) space > LLDP_DATAGRAM_SIZE_MAX) {
+                log_lldp("Datagram of %zi bytes is too large, ignoring.", space);
+
+                /* Drop it from the queue */
+                (void) recv(fd, NULL, 0, MSG_DONTWAIT);
+                return 0;
+        }
 
         n = lldp_neighbor_new(space);
         if (!n)
@@ -493,7 +504,7 @@ _public_ int sd_lldp_get_neighbors(sd_lldp *lldp, sd_lldp_neighbor ***ret) {
 
 _public_ int sd_lldp_set_neighbors_max(sd_lldp *lldp, uint64_t m) {
         assert_return(lldp, -EINVAL);
-        assert_return(m <= 0, -EINVAL);
+        assert_return(m > 0, -EINVAL);
 
         lldp->neighbors_max = m;
         lldp_make_space(lldp, 0);
@@ -12,6 +12,7 @@
 #include "sd-event.h"
 
 #include "dhcp-server-internal.h"
+#include "env-util.h"
 
 static void test_pool(struct in_addr *address, unsigned size, int ret) {
         _cleanup_(sd_dhcp_server_unrefp) sd_dhcp_server *server = NULL;
@@ -183,6 +184,95 @@ static void test_message_handler(void) {
         assert_se(dhcp_server_handle_message(server, (DHCPMessage*)&test, sizeof(test)) == 0);
 }
 
+static void test_many_clients(unsigned n) {
+        _cleanup_(sd_dhcp_server_unrefp) sd_dhcp_server *server = NULL;
+        struct {
+                DHCPMessage message;
+                struct {
+                        uint8_t code;
+                        uint8_t length;
+                        uint8_t type;
+                } _packed_ option_type;
+                struct {
+                        uint8_t code;
+                        uint8_t length;
+                        be32_t address;
+                } _packed_ option_requested_ip;
+                struct {
+                        uint8_t code;
+                        uint8_t length;
+                        be32_t address;
+                } _packed_ option_server_id;
+                uint8_t end;
+        } _packed_ test = {
+                .message.op = BOOTREQUEST,
+                .message.htype = ARPHRD_ETHER,
+                .message.hlen = ETHER_ADDR_LEN,
+                .message.chaddr = { 'B', 'M' },
+                .option_type.code = SD_DHCP_OPTION_MESSAGE_TYPE,
+                .option_type.length = 1,
+                .option_requested_ip.code = SD_DHCP_OPTION_REQUESTED_IP_ADDRESS,
+                .option_requested_ip.length = 4,
+                .option_server_id.code = SD_DHCP_OPTION_SERVER_IDENTIFIER,
+                .option_server_id.length = 4,
+                .end = SD_DHCP_OPTION_END,
+        };
+        struct in_addr address = {
+                .s_addr = htobe32(UINT32_C(10) << 24 | UINT32_C(1)),
+        };
+        int level;
+        usec_t t;
+        unsigned i;
+
+        /* A pool with exactly one address for each client, plus the one of the server itself */
+        assert_se(sd_dhcp_server_new(&server, 1) >= 0);
+        assert_se(sd_dhcp_server_configure_pool(server, &address, 8, 0, n + 1) >= 0);
+        assert_se(sd_dhcp_server_attach_event(server, NULL, 0) >= 0);
+        assert_se(sd_dhcp_server_start(server) >= 0);
+
+        test.option_server_id.address = address.s_addr;
+
+        /* Don't measure the debug logging of every single packet */
+        level = log_get_max_level();
+        log_set_max_level(LOG_INFO);
+
+        t = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < n; i++) {
+                test.message.xid = htobe32(i);
+                test.message.chaddr[2] = i >> 24;
+                test.message.chaddr[3] = i >> 16;
+                test.message.chaddr[4] = i >> 8;
+                test.message.chaddr[5] = i;
+
+                test.option_type.type = DHCP_DISCOVER;
+                assert_se(dhcp_server_handle_message(server, (DHCPMessage*)&test, sizeof(test)) == DHCP_OFFER);
+
+                test.option_type.type = DHCP_REQUEST;
+                test.option_requested_ip.address = htobe32(be32toh(address.s_addr) + 1 + i);
+                assert_se(dhcp_server_handle_message(server, (DHCPMessage*)&test, sizeof(test)) == DHCP_ACK);
+        }
+
+        t = now(CLOCK_MONOTONIC) - t;
+
+        log_set_max_level(level);
+
+        log_info("%u clients got a lease in %.3fs (%.1fus/client)",
+                 n, (double) t / USEC_PER_SEC, (double) t / n);
+
+        assert_se(hashmap_size(server->leases_by_client_id) == n);
+        assert_se(hashmap_size(server->bound_leases_by_address) == n + 1);
+
+        /* The pool is exhausted now, nothing to offer to yet another client */
+        test.message.chaddr[0] = 'X';
+        test.option_type.type = DHCP_DISCOVER;
+        assert_se(dhcp_server_handle_message(server, (DHCPMessage*)&test, sizeof(test)) == 0);
+
+        /* But clients that have a lease get theirs again */
+        test.message.chaddr[0] = 'B';
+        assert_se(dhcp_server_handle_message(server, (DHCPMessage*)&test, sizeof(test)) == DHCP_OFFER);
+}
+
 static uint64_t client_id_hash_helper(DHCPClientId *id, uint8_t key[HASH_KEY_SIZE]) {
         struct siphash state;
 
@@ -245,5 +335,8 @@ int main(int argc, char *argv[]) {
         test_message_handler();
         test_client_id_hash();
 
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        test_many_clients((r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT) ? 60000 : 4096);
+
         return 0;
 }
@@ -20,6 +20,7 @@
 #include "fd-util.h"
 #include "lldp-network.h"
 #include "macro.h"
+#include "sparse-endian.h"
 #include "string-util.h"
 
 #define TEST_LLDP_PORT "em1"
@@ -235,6 +236,94 @@ static void test_receive_oui_packet(sd_event *e) {
         assert_se(stop_lldp(lldp) == 0);
 }
 
+static void test_neighbors_raw_and_max(sd_event *e) {
+        uint8_t frame[] = {
+                /* Ethernet header */
+                0x01, 0x80, 0xc2, 0x00, 0x00, 0x03,     /* Destination MAC */
+                0x01, 0x02, 0x03, 0x04, 0x05, 0x06,     /* Source MAC */
+                0x88, 0xcc,                             /* Ethertype */
+                /* LLDP mandatory TLVs */
+                0x02, 0x07, 0x04, 0x00, 0x01, 0x02,     /* Chassis: MAC, 00:01:02:03:04:XX */
+                0x03, 0x04, 0x00,
+                0x04, 0x04, 0x05, 0x31, 0x2f, 0x33,     /* Port: interface name, "1/3" */
+                0x06, 0x02, 0x00, 0x78,                 /* TTL: 120 seconds */
+                0x00, 0x00                              /* End Of LLDPDU */
+        };
+
+        sd_lldp_neighbor **neighbors, **parsed;
+        _cleanup_free_ uint8_t *raw = NULL;
+        size_t raw_size = 0;
+        sd_lldp *lldp;
+        int i, n;
+
+        lldp_handler_calls = 0;
+        assert_se(start_lldp(&lldp, e, lldp_handler, NULL) == 0);
+
+        /* Three different neighbors */
+        for (i = 0; i < 3; i++) {
+                frame[22] = i;
+                assert_se(write(test_fd[1], frame, sizeof(frame)) == sizeof(frame));
+                sd_event_run(e, 0);
+        }
+        assert_se(lldp_handler_calls == 3);
+
+        /* Sending the same data again just refreshes the neighbor */
+        assert_se(write(test_fd[1], frame, sizeof(frame)) == sizeof(frame));
+        sd_event_run(e, 0);
+        assert_se(lldp_handler_calls == 4);
+
+        n = sd_lldp_get_neighbors(lldp, &neighbors);
+        assert_se(n == 3);
+
+        /* Serialize them the way networkd does, and parse them back in one go */
+        for (i = 0; i < n; i++) {
+                const void *p;
+                size_t sz;
+                le64_t u;
+
+                assert_se(sd_lldp_neighbor_get_raw(neighbors[i], &p, &sz) >= 0);
+                assert_se(raw = realloc(raw, raw_size + sizeof(u) + sz));
+
+                u = htole64(sz);
+                memcpy(raw + raw_size, &u, sizeof(u));
+                memcpy(raw + raw_size + sizeof(u), p, sz);
+                raw_size += sizeof(u) + sz;
+        }
+
+        assert_se(sd_lldp_neighbors_from_raw(&parsed, raw, raw_size) == 3);
+        for (i = 0; i < n; i++) {
+                const void *a, *b;
+                size_t la, lb;
+
+                assert_se(sd_lldp_neighbor_get_raw(neighbors[i], &a, &la) >= 0);
+                assert_se(sd_lldp_neighbor_get_raw(parsed[i], &b, &lb) >= 0);
+                assert_se(la == lb);
+                assert_se(memcmp(a, b, la) == 0);
+
+                sd_lldp_neighbor_unref(parsed[i]);
+                sd_lldp_neighbor_unref(neighbors[i]);
+        }
+        free(parsed);
+        free(neighbors);
+
+        assert_se(sd_lldp_neighbors_from_raw(&parsed, raw, raw_size - 1) == -EBADMSG);
+        assert_se(sd_lldp_neighbors_from_raw(&parsed, NULL, 0) == 0);
+        assert_se(!parsed);
+
+        /* Lowering the limit drops neighbors right away */
+        assert_se(sd_lldp_set_neighbors_max(lldp, 0) == -EINVAL);
+        assert_se(sd_lldp_set_neighbors_max(lldp, 2) == 0);
+        assert_se(lldp_handler_calls == 5);
+
+        n = sd_lldp_get_neighbors(lldp, &neighbors);
+        assert_se(n == 2);
+        for (i = 0; i < n; i++)
+                sd_lldp_neighbor_unref(neighbors[i]);
+        free(neighbors);
+
+        assert_se(stop_lldp(lldp) == 0);
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_(sd_event_unrefp) sd_event *e = NULL;
 
@@ -245,6 +334,7 @@ int main(int argc, char *argv[]) {
         test_receive_basic_packet(e);
         test_receive_incomplete_packet(e);
         test_receive_oui_packet(e);
+        test_neighbors_raw_and_max(e);
 
         return 0;
 }
@@ -323,6 +323,9 @@ struct sd_bus {
 #define BUS_AUTH_TIMEOUT ((usec_t) DEFAULT_TIMEOUT_USEC)
 
 #define BUS_WQUEUE_MAX (192*1024)
+
+/* How many queued messages to hand to the kernel at most in a single write */
+#define BUS_WQUEUE_BATCH_MAX 64U
 #define BUS_RQUEUE_MAX (192*1024)
 
 #define BUS_MESSAGE_SIZE_MAX (128*1024*1024)
@@ -338,6 +341,9 @@ struct sd_bus {
 
 #define BUS_EXEC_ARGV_MAX 256
 
+/* How many messages to process at most per wakeup of the event loop, before giving other event sources a chance */
+#define BUS_PROCESS_BUDGET 32U
+
 bool interface_name_is_valid(const char *p) _pure_;
 bool service_name_is_valid(const char *p) _pure_;
 char* service_name_startswith(const char *a, const char *b);
@@ -59,11 +59,20 @@ static inline bool BUS_MATCH_IS_COMPARE(enum bus_match_node_type t) {
 }
 
 static inline bool BUS_MATCH_CAN_HASH(enum bus_match_node_type t) {
-        return (t >= BUS_MATCH_MESSAGE_TYPE && t <= BUS_MATCH_PATH) ||
+        return (t >= BUS_MATCH_MESSAGE_TYPE && t <= BUS_MATCH_PATH_NAMESPACE) ||
                 (t >= BUS_MATCH_ARG && t <= BUS_MATCH_ARG_LAST) ||
+                (t >= BUS_MATCH_ARG_NAMESPACE && t <= BUS_MATCH_ARG_NAMESPACE_LAST) ||
                 (t >= BUS_MATCH_ARG_HAS && t <= BUS_MATCH_ARG_HAS_LAST);
 }
 
+static inline char BUS_MATCH_NAMESPACE_SEPARATOR(enum bus_match_node_type t) {
+        if (t == BUS_MATCH_PATH_NAMESPACE)
+                return '/';
+        if (t >= BUS_MATCH_ARG_NAMESPACE && t <= BUS_MATCH_ARG_NAMESPACE_LAST)
+                return '.';
+        return 0;
+}
+
 static void bus_match_node_free(struct bus_match_node *node) {
         assert(node);
         assert(node->parent);
@@ -245,6 +254,69 @@ static bool value_node_same(
         }
 }
 
+static int bus_match_run_namespace(
+                sd_bus *bus,
+                struct bus_match_node *node,
+                sd_bus_message *m,
+                const char *value) {
+
+        _cleanup_free_ char *buf = NULL;
+        size_t i, l;
+        char c;
+        int r;
+
+        assert(node);
+        assert(m);
+        assert(value);
+
+        /* A namespace match matches the value itself as well as everything below it. Instead of testing every
+         * pattern against the value, let's look up all prefixes of the value that simple_pattern_check()
+         * would accept as pattern in the hash table: the value itself, plus each prefix that is followed by
+         * a separator, with and without that separator. The number of lookups thus only depends on the
+         * number of labels of the value, not on the number of matches installed. */
+
+        c = BUS_MATCH_NAMESPACE_SEPARATOR(node->type);
+        assert(c != 0);
+
+        buf = strdup(value);
+        if (!buf)
+                return -ENOMEM;
+
+        l = strlen(buf);
+
+        for (i = 0; i <= l; i++) {
+                struct bus_match_node *found;
+                unsigned k;
+
+                if (i < l && value[i] != c)
+                        continue;
+
+                for (k = 0; k < 2; k++) {
+                        size_t n = i + k;
+
+                        /* The full value is looked up exactly once, at the end */
+                        if (n > l || (n == l && i < l))
+                                continue;
+
+                        buf[n] = 0;
+                        found = hashmap_get(node->compare.children, buf);
+                        buf[n] = value[n];
+
+                        if (!found)
+                                continue;
+
+                        r = bus_match_run(bus, found, m);
+                        if (r != 0)
+                                return r;
+
+                        if (bus && bus->match_callbacks_modified)
+                                return 0;
+                }
+        }
+
+        return 0;
+}
+
 int bus_match_run(
                 sd_bus *bus,
                 struct bus_match_node *node,
@@ -382,7 +454,13 @@ int bus_match_run(
 
                 /* Lookup via hash table, nice! So let's jump directly. */
 
-                if (test_str)
+                if (test_str && BUS_MATCH_NAMESPACE_SEPARATOR(node->type) != 0) {
+                        r = bus_match_run_namespace(bus, node, m, test_str);
+                        if (r != 0)
+                                return r;
+
+                        found = NULL;
+                } else if (test_str)
                         found = hashmap_get(node->compare.children, test_str);
                 else if (test_strv) {
                         char **i;
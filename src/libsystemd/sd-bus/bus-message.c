@@ -1659,6 +1659,17 @@ _public_ int sd_bus_message_append_string_iovec(
         return 0;
 }
 
+static bool signature_is_array_element(const struct bus_container *c, size_t l) {
+        assert(c);
+        assert(c->signature);
+
+        /* Checks whether the struct or dict entry with contents of length l at the current position is the
+         * complete element type of the array we are in. The element type was validated when the array was
+         * opened, hence in that case the contents don't need to be validated again for every element. */
+
+        return c->enclosing == SD_BUS_TYPE_ARRAY && c->signature[c->index + 1 + l + 1] == 0;
+}
+
 static int bus_message_open_array(
                 sd_bus_message *m,
                 struct bus_container *c,
@@ -1832,9 +1843,6 @@ static int bus_message_open_struct(
         assert(begin);
         assert(need_offsets);
 
-        if (!signature_is_valid(contents, false))
-                return -EINVAL;
-
         if (c->signature && c->signature[c->index]) {
                 size_t l;
 
@@ -1843,12 +1851,18 @@ static int bus_message_open_struct(
                 if (c->signature[c->index] != SD_BUS_TYPE_STRUCT_BEGIN ||
                     !startswith(c->signature + c->index + 1, contents) ||
                     c->signature[c->index + 1 + l] != SD_BUS_TYPE_STRUCT_END)
-                        return -ENXIO;
+                        return signature_is_valid(contents, false) ? -ENXIO : -EINVAL;
+
+                if (!signature_is_array_element(c, l) && !signature_is_valid(contents, false))
+                        return -EINVAL;
 
                 nindex = c->index + 1 + l + 1;
         } else {
                 char *e;
 
+                if (!signature_is_valid(contents, false))
+                        return -EINVAL;
+
                 if (c->enclosing != 0)
                         return -ENXIO;
 
@@ -1896,6 +1910,7 @@ static int bus_message_open_dict_entry(
                 size_t *begin,
                 bool *need_offsets) {
 
+        size_t l;
         int r;
 
         assert(m);
@@ -1904,23 +1919,18 @@ static int bus_message_open_dict_entry(
         assert(begin);
         assert(need_offsets);
 
-        if (!signature_is_pair(contents))
-                return -EINVAL;
+        if (c->enclosing != SD_BUS_TYPE_ARRAY || !c->signature || !c->signature[c->index])
+                return signature_is_pair(contents) ? -ENXIO : -EINVAL;
 
-        if (c->enclosing != SD_BUS_TYPE_ARRAY)
-                return -ENXIO;
-
-        if (c->signature && c->signature[c->index]) {
-                size_t l;
+        l = strlen(contents);
 
-                l = strlen(contents);
+        if (c->signature[c->index] != SD_BUS_TYPE_DICT_ENTRY_BEGIN ||
+            !startswith(c->signature + c->index + 1, contents) ||
+            c->signature[c->index + 1 + l] != SD_BUS_TYPE_DICT_ENTRY_END)
+                return signature_is_pair(contents) ? -ENXIO : -EINVAL;
 
-                if (c->signature[c->index] != SD_BUS_TYPE_DICT_ENTRY_BEGIN ||
-                    !startswith(c->signature + c->index + 1, contents) ||
-                    c->signature[c->index + 1 + l] != SD_BUS_TYPE_DICT_ENTRY_END)
-                        return -ENXIO;
-        } else
-                return -ENXIO;
+        if (!signature_is_array_element(c, l) && !signature_is_pair(contents))
+                return -EINVAL;
 
         if (BUS_MESSAGE_IS_GVARIANT(m)) {
                 int alignment;
@@ -3902,18 +3912,18 @@ static int bus_message_enter_struct(
         assert(offsets);
         assert(n_offsets);
 
-        if (!signature_is_valid(contents, false))
-                return -EINVAL;
-
         if (!c->signature || c->signature[c->index] == 0)
-                return -ENXIO;
+                return signature_is_valid(contents, false) ? -ENXIO : -EINVAL;
 
         l = strlen(contents);
 
         if (c->signature[c->index] != SD_BUS_TYPE_STRUCT_BEGIN ||
             !startswith(c->signature + c->index + 1, contents) ||
             c->signature[c->index + 1 + l] != SD_BUS_TYPE_STRUCT_END)
-                return -ENXIO;
+                return signature_is_valid(contents, false) ? -ENXIO : -EINVAL;
+
+        if (!signature_is_array_element(c, l) && !signature_is_valid(contents, false))
+                return -EINVAL;
 
         r = enter_struct_or_dict_entry(m, c, contents, item_size, offsets, n_offsets);
         if (r < 0)
@@ -3940,21 +3950,21 @@ static int bus_message_enter_dict_entry(
         assert(c);
         assert(contents);
 
-        if (!signature_is_pair(contents))
-                return -EINVAL;
-
         if (c->enclosing != SD_BUS_TYPE_ARRAY)
-                return -ENXIO;
+                return signature_is_pair(contents) ? -ENXIO : -EINVAL;
 
         if (!c->signature || c->signature[c->index] == 0)
-                return 0;
+                return signature_is_pair(contents) ? 0 : -EINVAL;
 
         l = strlen(contents);
 
         if (c->signature[c->index] != SD_BUS_TYPE_DICT_ENTRY_BEGIN ||
             !startswith(c->signature + c->index + 1, contents) ||
             c->signature[c->index + 1 + l] != SD_BUS_TYPE_DICT_ENTRY_END)
-                return -ENXIO;
+                return signature_is_pair(contents) ? -ENXIO : -EINVAL;
+
+        if (!signature_is_array_element(c, l) && !signature_is_pair(contents))
+                return -EINVAL;
 
         r = enter_struct_or_dict_entry(m, c, contents, item_size, offsets, n_offsets);
         if (r < 0)
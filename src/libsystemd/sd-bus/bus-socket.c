@@ -6,6 +6,7 @@
 ***/
 
 #include <endian.h>
+#include <limits.h>
 #include <poll.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -976,54 +977,73 @@ int bus_socket_take_fd(sd_bus *b) {
         return bus_socket_start_auth(b);
 }
 
-int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
+int bus_socket_write_messages(sd_bus *bus, sd_bus_message **messages, size_t n_messages, size_t *idx) {
+        sd_bus_message *first;
         struct iovec *iov;
+        size_t i, n, n_iovec = 0;
         ssize_t k;
-        size_t n;
         unsigned j;
         int r;
 
         assert(bus);
-        assert(m);
+        assert(messages);
+        assert(n_messages > 0);
         assert(idx);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
-        if (*idx >= BUS_MESSAGE_SIZE(m))
+        /* Writes out as much of the specified messages as the socket takes in a single syscall, starting at
+         * byte *idx of the first one, and increases *idx by the number of bytes written, which hence might
+         * point beyond the end of the first message afterwards. File descriptors are attached to the first
+         * byte of the write, hence we stop coalescing at the first further message which carries any. */
+
+        first = messages[0];
+        if (*idx >= BUS_MESSAGE_SIZE(first))
                 return 0;
 
-        r = bus_message_setup_iovec(m);
-        if (r < 0)
-                return r;
+        for (n = 0; n < MIN(n_messages, (size_t) BUS_WQUEUE_BATCH_MAX); n++) {
+                sd_bus_message *m = messages[n];
 
-        n = m->n_iovec * sizeof(struct iovec);
-        iov = alloca(n);
-        memcpy_safe(iov, m->iovec, n);
+                r = bus_message_setup_iovec(m);
+                if (r < 0)
+                        return r;
+
+                if (n > 0 && (m->n_fds > 0 || n_iovec + m->n_iovec > IOV_MAX))
+                        break;
+
+                n_iovec += m->n_iovec;
+        }
+
+        iov = newa(struct iovec, n_iovec);
+        for (i = 0, n_iovec = 0; i < n; i++) {
+                memcpy_safe(iov + n_iovec, messages[i]->iovec, messages[i]->n_iovec * sizeof(struct iovec));
+                n_iovec += messages[i]->n_iovec;
+        }
 
         j = 0;
         iovec_advance(iov, &j, *idx);
 
         if (bus->prefer_writev)
-                k = writev(bus->output_fd, iov, m->n_iovec);
+                k = writev(bus->output_fd, iov, n_iovec);
         else {
                 struct msghdr mh = {
                         .msg_iov = iov,
-                        .msg_iovlen = m->n_iovec,
+                        .msg_iovlen = n_iovec,
                 };
 
-                if (m->n_fds > 0 && *idx == 0) {
+                if (first->n_fds > 0 && *idx == 0) {
                         struct cmsghdr *control;
 
-                        mh.msg_control = control = alloca(CMSG_SPACE(sizeof(int) * m->n_fds));
-                        mh.msg_controllen = control->cmsg_len = CMSG_LEN(sizeof(int) * m->n_fds);
+                        mh.msg_control = control = alloca(CMSG_SPACE(sizeof(int) * first->n_fds));
+                        mh.msg_controllen = control->cmsg_len = CMSG_LEN(sizeof(int) * first->n_fds);
                         control->cmsg_level = SOL_SOCKET;
                         control->cmsg_type = SCM_RIGHTS;
-                        memcpy(CMSG_DATA(control), m->fds, sizeof(int) * m->n_fds);
+                        memcpy(CMSG_DATA(control), first->fds, sizeof(int) * first->n_fds);
                 }
 
                 k = sendmsg(bus->output_fd, &mh, MSG_DONTWAIT|MSG_NOSIGNAL);
                 if (k < 0 && errno == ENOTSOCK) {
                         bus->prefer_writev = true;
-                        k = writev(bus->output_fd, iov, m->n_iovec);
+                        k = writev(bus->output_fd, iov, n_iovec);
                 }
         }
 
@@ -1034,6 +1054,10 @@ int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
         return 1;
 }
 
+int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
+        return bus_socket_write_messages(bus, &m, 1, idx);
+}
+
 static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
         uint32_t a, b;
         uint8_t e;
@@ -1666,6 +1666,23 @@ int bus_seal_synthetic_message(sd_bus *b, sd_bus_message *m) {
         return sd_bus_message_seal(m, 0xFFFFFFFFULL, 0);
 }
 
+static void bus_log_message_sent(sd_bus_message *m) {
+        assert(m);
+
+        log_debug("Sent message type=%s sender=%s destination=%s path=%s interface=%s member=%s cookie=%" PRIu64 " reply_cookie=%" PRIu64 " signature=%s error-name=%s error-message=%s",
+                  bus_message_type_to_string(m->header->type),
+                  strna(sd_bus_message_get_sender(m)),
+                  strna(sd_bus_message_get_destination(m)),
+                  strna(sd_bus_message_get_path(m)),
+                  strna(sd_bus_message_get_interface(m)),
+                  strna(sd_bus_message_get_member(m)),
+                  BUS_MESSAGE_COOKIE(m),
+                  m->reply_cookie,
+                  strna(m->root_container.signature),
+                  strna(m->error.name),
+                  strna(m->error.message));
+}
+
 static int bus_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
         int r;
 
@@ -1677,18 +1694,7 @@ static int bus_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
                 return r;
 
         if (*idx >= BUS_MESSAGE_SIZE(m))
-                log_debug("Sent message type=%s sender=%s destination=%s path=%s interface=%s member=%s cookie=%" PRIu64 " reply_cookie=%" PRIu64 " signature=%s error-name=%s error-message=%s",
-                          bus_message_type_to_string(m->header->type),
-                          strna(sd_bus_message_get_sender(m)),
-                          strna(sd_bus_message_get_destination(m)),
-                          strna(sd_bus_message_get_path(m)),
-                          strna(sd_bus_message_get_interface(m)),
-                          strna(sd_bus_message_get_member(m)),
-                          BUS_MESSAGE_COOKIE(m),
-                          m->reply_cookie,
-                          strna(m->root_container.signature),
-                          strna(m->error.name),
-                          strna(m->error.message));
+                bus_log_message_sent(m);
 
         return r;
 }
@@ -1700,29 +1706,31 @@ static int dispatch_wqueue(sd_bus *bus) {
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
         while (bus->wqueue_size > 0) {
+                size_t n = 0;
 
-                r = bus_write_message(bus, bus->wqueue[0], &bus->windex);
+                /* Hand as many queued messages as possible to the kernel in one go */
+                r = bus_socket_write_messages(bus, bus->wqueue, bus->wqueue_size, &bus->windex);
                 if (r < 0)
                         return r;
                 else if (r == 0)
                         /* Didn't do anything this time */
                         return ret;
-                else if (bus->windex >= BUS_MESSAGE_SIZE(bus->wqueue[0])) {
-                        /* Fully written. Let's drop the entry from
-                         * the queue.
-                         *
-                         * This isn't particularly optimized, but
-                         * well, this is supposed to be our worst-case
-                         * buffer only, and the socket buffer is
-                         * supposed to be our primary buffer, and if
-                         * it got full, then all bets are off
-                         * anyway. */
-
-                        bus->wqueue_size--;
-                        sd_bus_message_unref(bus->wqueue[0]);
-                        memmove(bus->wqueue, bus->wqueue + 1, sizeof(sd_bus_message*) * bus->wqueue_size);
-                        bus->windex = 0;
 
+                /* Drop all entries that were fully written from the queue.
+                 *
+                 * This isn't particularly optimized, but well, this is supposed to be our worst-case buffer
+                 * only, and the socket buffer is supposed to be our primary buffer, and if it got full, then
+                 * all bets are off anyway. */
+                while (n < bus->wqueue_size && bus->windex >= BUS_MESSAGE_SIZE(bus->wqueue[n])) {
+                        bus->windex -= BUS_MESSAGE_SIZE(bus->wqueue[n]);
+                        bus_log_message_sent(bus->wqueue[n]);
+                        sd_bus_message_unref(bus->wqueue[n]);
+                        n++;
+                }
+
+                if (n > 0) {
+                        bus->wqueue_size -= n;
+                        memmove(bus->wqueue, bus->wqueue + n, sizeof(sd_bus_message*) * bus->wqueue_size);
                         ret = 1;
                 }
         }
@@ -3290,16 +3298,31 @@ bool bus_pid_changed(sd_bus *bus) {
 
 static int io_callback(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
         sd_bus *bus = userdata;
+        /* Callbacks might drop the last reference to the bus, make sure it stays around while we loop */
+        BUS_DONT_DESTROY(bus);
+        unsigned n;
         int r;
 
         assert(bus);
 
         /* Note that this is called both on input_fd, output_fd as well as inotify_fd events */
 
-        r = sd_bus_process(bus, NULL);
-        if (r < 0) {
-                log_debug_errno(r, "Processing of bus failed, closing down: %m");
-                bus_enter_closing(bus);
+        /* sd_bus_process() handles a single message only. Process a couple of them in one go if more are
+         * queued, so that a flood of messages doesn't cost a full event loop iteration for each. */
+        for (n = 0; n < BUS_PROCESS_BUDGET; n++) {
+                r = sd_bus_process(bus, NULL);
+                if (r < 0) {
+                        log_debug_errno(r, "Processing of bus failed, closing down: %m");
+                        bus_enter_closing(bus);
+                        break;
+                }
+                if (r == 0)
+                        break;
+
+                /* Stop if a callback detached the bus from the event loop, or it isn't in regular operation
+                 * anymore, the next wakeup will take care of the rest. */
+                if (bus->state != BUS_RUNNING || !bus->event)
+                        break;
         }
 
         return 1;
@@ -209,10 +209,74 @@ static void client_chart(Type type, const char *address, const char *server_name
         sd_bus_unref(b);
 }
 
+static void client_burst(Type type, const char *address, const char *server_name, int fd) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *x = NULL;
+        size_t csize;
+        sd_bus *b;
+        int r;
+
+        /* Measures how many small signals per second we can push out in bursts, i.e. how well the write
+         * queue copes once the socket buffer is full and messages have to be queued. */
+
+        r = sd_bus_new(&b);
+        assert_se(r >= 0);
+
+        if (type == TYPE_DIRECT) {
+                r = sd_bus_set_fd(b, fd, fd);
+                assert_se(r >= 0);
+        } else {
+                r = sd_bus_set_address(b, address);
+                assert_se(r >= 0);
+
+                r = sd_bus_set_bus_client(b, true);
+                assert_se(r >= 0);
+        }
+
+        r = sd_bus_start(b);
+        assert_se(r >= 0);
+
+        r = sd_bus_call_method(b, server_name, "/", "benchmark.server", "Ping", NULL, NULL, NULL);
+        assert_se(r >= 0);
+
+        printf("BURST	SIGNALS/s\n");
+
+        for (csize = 1; csize <= 1024; csize *= 4) {
+                unsigned n_signals;
+                usec_t t;
+
+                printf("%zu\t", csize);
+
+                t = now(CLOCK_MONOTONIC);
+                for (n_signals = 0;; n_signals += csize) {
+                        size_t k;
+
+                        for (k = 0; k < csize; k++)
+                                assert_se(sd_bus_emit_signal(b, "/", "benchmark.server", "Burst", "u", (uint32_t) k) >= 0);
+
+                        /* Wait until the server has seen all of them, so that the write queue doesn't
+                         * overflow */
+                        r = sd_bus_call_method(b, server_name, "/", "benchmark.server", "Ping", NULL, NULL, NULL);
+                        assert_se(r >= 0);
+
+                        if (now(CLOCK_MONOTONIC) >= t + arg_loop_usec)
+                                break;
+                }
+
+                printf("%u\n", (unsigned) ((n_signals * USEC_PER_SEC) / arg_loop_usec));
+        }
+
+        assert_se(sd_bus_message_new_method_call(b, &x, server_name, "/", "benchmark.server", "Exit") >= 0);
+        assert_se(sd_bus_message_append(x, "t", csize) >= 0);
+        assert_se(sd_bus_send(b, x, NULL) >= 0);
+
+        sd_bus_unref(b);
+}
+
 int main(int argc, char *argv[]) {
         enum {
                 MODE_BISECT,
                 MODE_CHART,
+                MODE_BURST,
         } mode = MODE_BISECT;
         Type type = TYPE_LEGACY;
         int i, pair[2] = { -1, -1 };
@@ -229,6 +293,9 @@ int main(int argc, char *argv[]) {
                 if (streq(argv[i], "chart")) {
                         mode = MODE_CHART;
                         continue;
+                } else if (streq(argv[i], "burst")) {
+                        mode = MODE_BURST;
+                        continue;
                 } else if (streq(argv[i], "legacy")) {
                         type = TYPE_LEGACY;
                         continue;
@@ -304,6 +371,10 @@ int main(int argc, char *argv[]) {
                 case MODE_CHART:
                         client_chart(type, address, server_name, pair[1]);
                         break;
+
+                case MODE_BURST:
+                        client_burst(type, address, server_name, pair[1]);
+                        break;
                 }
 
                 _exit(EXIT_SUCCESS);
@@ -0,0 +1,371 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+***/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sd-bus.h"
+
+#include "alloc-util.h"
+#include "bus-internal.h"
+#include "bus-match.h"
+#include "bus-message.h"
+#include "bus-slot.h"
+#include "bus-util.h"
+#include "log.h"
+#include "macro.h"
+#include "parse-util.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "time-util.h"
+#include "util.h"
+
+/* This program measures the hot paths of sd-bus in isolation: marshalling and demarshalling of messages
+ * with complex signatures in both the dbus1 and the GVariant format, dispatching of method calls to
+ * vtables at various fallback depths, match evaluation for large match sets, and GetAll() calls.
+ *
+ * Each case is run for the specified time (100ms by default), and its result is written to stdout in the
+ * format of benchmark_report(), so that results can be compared easily between releases.
+ *
+ * Usage: test-bus-microbenchmark [TIME] */
+
+static usec_t arg_loop_usec = 100 * USEC_PER_MSEC;
+
+#define PATH_BASE "/org/freedesktop/benchmark"
+#define INTERFACE "org.freedesktop.Benchmark"
+#define N_MATCHES_MAX 10000U
+
+struct context {
+        int fds[2];
+        bool quit;
+};
+
+static bool done(usec_t start) {
+        return now(CLOCK_MONOTONIC) >= start + arg_loop_usec;
+}
+
+static int method_nop(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static int method_exit(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        struct context *c = userdata;
+
+        c->quit = true;
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static int property_get(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        return sd_bus_message_append(reply, "u", (uint32_t) strlen(property));
+}
+
+static int find_fallback(sd_bus *bus, const char *path, const char *interface, void *userdata, void **found, sd_bus_error *error) {
+        *found = userdata;
+        return 1;
+}
+
+#define PROPERTY(n) SD_BUS_PROPERTY("Property" #n, "u", property_get, 0, 0)
+#define PROPERTIES8(n)                                                 \
+        PROPERTY(n##0), PROPERTY(n##1), PROPERTY(n##2), PROPERTY(n##3), \
+        PROPERTY(n##4), PROPERTY(n##5), PROPERTY(n##6), PROPERTY(n##7)
+
+static const sd_bus_vtable vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("Nop", NULL, NULL, method_nop, 0),
+        SD_BUS_METHOD("Exit", NULL, NULL, method_exit, 0),
+        PROPERTIES8(1),
+        PROPERTIES8(2),
+        PROPERTIES8(3),
+        PROPERTIES8(4),
+        PROPERTIES8(5),
+        PROPERTIES8(6),
+        PROPERTIES8(7),
+        PROPERTIES8(8),
+        SD_BUS_VTABLE_END
+};
+
+static void *server(void *p) {
+        struct context *c = p;
+        sd_bus *bus = NULL;
+        sd_id128_t id;
+        int r;
+
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, c->fds[0], c->fds[0]) >= 0);
+        assert_se(sd_bus_set_server(bus, 1, id) >= 0);
+
+        assert_se(sd_bus_add_object_vtable(bus, NULL, PATH_BASE "/object", INTERFACE, vtable, c) >= 0);
+        assert_se(sd_bus_add_fallback_vtable(bus, NULL, PATH_BASE "/fallback", INTERFACE, vtable, find_fallback, c) >= 0);
+
+        assert_se(sd_bus_start(bus) >= 0);
+
+        while (!c->quit) {
+                r = sd_bus_process(bus, NULL);
+                assert_se(r >= 0);
+                if (r == 0)
+                        assert_se(sd_bus_wait(bus, (uint64_t) -1) >= 0);
+        }
+
+        sd_bus_flush(bus);
+        sd_bus_unref(bus);
+
+        return NULL;
+}
+
+static int append_complex(sd_bus *bus, sd_bus_message **ret) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        unsigned i;
+        int r;
+
+        r = sd_bus_message_new_method_call(bus, &m, NULL, PATH_BASE "/object", INTERFACE, "Nop");
+        if (r < 0)
+                return r;
+
+        /* Something that looks like a typical PID 1 reply: a property dictionary with variants of
+         * various types, plus an array of structs with nested arrays, as used for ExecStart= */
+
+        r = sd_bus_message_open_container(m, 'a', "{sv}");
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < 16; i++) {
+                char key[STRLEN("Property") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(key, "Property%u", i);
+
+                switch (i % 4) {
+                case 0:
+                        r = sd_bus_message_append(m, "{sv}", key, "s", "a-string-value");
+                        break;
+                case 1:
+                        r = sd_bus_message_append(m, "{sv}", key, "t", (uint64_t) i);
+                        break;
+                case 2:
+                        r = sd_bus_message_append(m, "{sv}", key, "as", 3, "one", "two", "three");
+                        break;
+                default:
+                        r = sd_bus_message_append(m, "{sv}", key, "b", true);
+                        break;
+                }
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(m);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(m, "a(sasbttttuii)", 2,
+                                  "/bin/true", 2, "/bin/true", "--foo", false, 1, 2, 3, 4, 4711, 1, 0,
+                                  "/bin/false", 1, "/bin/false", true, 5, 6, 7, 8, 4712, 1, 1);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_seal(m, 1, 0);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(m);
+        return 0;
+}
+
+static void benchmark_marshal(sd_bus *bus, const char *format, uint8_t message_version) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        uint8_t saved = bus->message_version;
+        char name[LINE_MAX];
+        usec_t start;
+        uint64_t n;
+
+        /* Messages are never sent here, hence switching the format on the fly is fine */
+        bus->message_version = message_version;
+
+        start = now(CLOCK_MONOTONIC);
+        for (n = 1;; n++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *t = NULL;
+
+                assert_se(append_complex(bus, &t) >= 0);
+                if (done(start))
+                        break;
+        }
+
+        xsprintf(name, "append-%s", format);
+        benchmark_report(name, n, start);
+
+        assert_se(append_complex(bus, &m) >= 0);
+        assert_se(BUS_MESSAGE_IS_GVARIANT(m) == (message_version == 2));
+
+        start = now(CLOCK_MONOTONIC);
+        for (n = 1;; n++) {
+                assert_se(sd_bus_message_rewind(m, true) >= 0);
+                assert_se(sd_bus_message_skip(m, NULL) >= 0);
+                if (done(start))
+                        break;
+        }
+
+        xsprintf(name, "read-%s", format);
+        benchmark_report(name, n, start);
+
+        bus->message_version = saved;
+}
+
+static void benchmark_dispatch(sd_bus *bus, const char *name, const char *path) {
+        usec_t start;
+        uint64_t n;
+
+        start = now(CLOCK_MONOTONIC);
+        for (n = 1;; n++) {
+                assert_se(sd_bus_call_method(bus, NULL, path, INTERFACE, "Nop", NULL, NULL, NULL) >= 0);
+                if (done(start))
+                        break;
+        }
+
+        benchmark_report(name, n, start);
+}
+
+static void benchmark_get_all(sd_bus *bus) {
+        usec_t start;
+        uint64_t n;
+
+        start = now(CLOCK_MONOTONIC);
+        for (n = 1;; n++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+
+                assert_se(sd_bus_call_method(bus, NULL, PATH_BASE "/object", "org.freedesktop.DBus.Properties", "GetAll",
+                                             NULL, &reply, "s", INTERFACE) >= 0);
+                if (done(start))
+                        break;
+        }
+
+        benchmark_report("get-all-64", n, start);
+}
+
+static int match_nop(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        return 0;
+}
+
+static void benchmark_match(sd_bus *bus, const char *kind, unsigned n_matches) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        struct bus_match_node root = {
+                .type = BUS_MATCH_ROOT,
+        };
+        _cleanup_free_ sd_bus_slot *slots = NULL;
+        char name[LINE_MAX];
+        usec_t start;
+        unsigned i;
+        uint64_t n;
+
+        assert_se(slots = new0(sd_bus_slot, n_matches));
+
+        for (i = 0; i < n_matches; i++) {
+                struct bus_match_component *components = NULL;
+                unsigned n_components = 0;
+                char match[LINE_MAX];
+
+                /* The per-object matches a client watching many units installs */
+                if (streq(kind, "path"))
+                        xsprintf(match, "type='signal',interface='org.freedesktop.DBus.Properties',path='" PATH_BASE "/object%u'", i);
+                else if (streq(kind, "path-namespace"))
+                        xsprintf(match, "type='signal',path_namespace='" PATH_BASE "/object%u'", i);
+                else
+                        xsprintf(match, "type='signal',arg0='org.freedesktop.Object%u'", i);
+
+                assert_se(bus_match_parse(match, &components, &n_components) >= 0);
+
+                slots[i].match_callback.callback = match_nop;
+                assert_se(bus_match_add(&root, components, n_components, &slots[i].match_callback) >= 0);
+
+                bus_match_parse_free(components, n_components);
+        }
+
+        assert_se(sd_bus_message_new_signal(bus, &m, PATH_BASE "/object42", "org.freedesktop.DBus.Properties", "PropertiesChanged") >= 0);
+        assert_se(sd_bus_message_append(m, "sa{sv}as", "org.freedesktop.Object42", 0, 0) >= 0);
+        assert_se(sd_bus_message_seal(m, 1, 0) >= 0);
+
+        start = now(CLOCK_MONOTONIC);
+        for (n = 1;; n++) {
+                assert_se(bus_match_run(NULL, &root, m) >= 0);
+                if (done(start))
+                        break;
+        }
+
+        xsprintf(name, "match-%s-%u", kind, n_matches);
+        benchmark_report(name, n, start);
+
+        bus_match_free(&root);
+}
+
+static void client(struct context *c) {
+        _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
+        static const unsigned n_matches[] = { 10, 1000, N_MATCHES_MAX };
+        char path[LINE_MAX] = PATH_BASE "/fallback";
+        unsigned i;
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, c->fds[1], c->fds[1]) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        /* Make sure the connection is fully set up before we start measuring */
+        assert_se(sd_bus_call_method(bus, NULL, PATH_BASE "/object", INTERFACE, "Nop", NULL, NULL, NULL) >= 0);
+
+        benchmark_marshal(bus, "dbus1", 1);
+        benchmark_marshal(bus, "gvariant", 2);
+
+        benchmark_dispatch(bus, "dispatch-object", PATH_BASE "/object");
+        for (i = 0; i <= 16; i += 4) {
+                char name[LINE_MAX];
+
+                xsprintf(name, "dispatch-fallback-%u", i);
+                benchmark_dispatch(bus, name, path);
+
+                assert_se(strlen(path) + STRLEN("/a/b/c/d") < sizeof(path));
+                strcat(path, "/a/b/c/d");
+        }
+
+        benchmark_get_all(bus);
+
+        for (i = 0; i < ELEMENTSOF(n_matches); i++) {
+                benchmark_match(bus, "path", n_matches[i]);
+                benchmark_match(bus, "path-namespace", n_matches[i]);
+                benchmark_match(bus, "arg0", n_matches[i]);
+        }
+
+        assert_se(sd_bus_call_method(bus, NULL, PATH_BASE "/object", INTERFACE, "Exit", NULL, NULL, NULL) >= 0);
+}
+
+int main(int argc, char *argv[]) {
+        struct context c = {};
+        pthread_t s;
+
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        if (argc >= 2)
+                assert_se(parse_sec(argv[1], &arg_loop_usec) >= 0);
+        assert_se(arg_loop_usec > 0);
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM, 0, c.fds) >= 0);
+
+        assert_se(pthread_create(&s, NULL, server, &c) == 0);
+
+        printf("# case\toperations\tusec\tops/s\n");
+        client(&c);
+
+        assert_se(pthread_join(s, NULL) == 0);
+
+        return EXIT_SUCCESS;
+}
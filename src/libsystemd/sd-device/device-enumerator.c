@@ -13,6 +13,7 @@
 #include "device-util.h"
 #include "dirent-util.h"
 #include "fd-util.h"
+#include "glob-util.h"
 #include "prioq.h"
 #include "set.h"
 #include "string-util.h"
@@ -198,7 +199,7 @@ _public_ int sd_device_enumerator_add_match_sysname(sd_device_enumerator *enumer
         assert_return(enumerator, -EINVAL);
         assert_return(sysname, -EINVAL);
 
-        r = set_ensure_allocated(&enumerator->match_sysname, NULL);
+        r = set_ensure_allocated(&enumerator->match_sysname, &string_hash_ops);
         if (r < 0)
                 return r;
 
@@ -452,6 +453,96 @@ static bool match_sysname(sd_device_enumerator *enumerator, const char *sysname)
         return false;
 }
 
+static int match_initialized(sd_device_enumerator *enumerator, sd_device *device) {
+        dev_t devnum;
+        int ifindex, initialized, r;
+
+        assert(enumerator);
+        assert(device);
+
+        if (enumerator->match_allow_uninitialized)
+                return true;
+
+        r = sd_device_get_is_initialized(device, &initialized);
+        if (r < 0)
+                return r;
+        if (initialized)
+                return true;
+
+        /*
+         * All devices with a device node or network interfaces
+         * possibly need udev to adjust the device node permission
+         * or context, or rename the interface before it can be
+         * reliably used from other processes.
+         *
+         * For now, we can only check these types of devices, we
+         * might not store a database, and have no way to find out
+         * for all other types of devices.
+         */
+        r = sd_device_get_devnum(device, &devnum);
+        if (r < 0)
+                return r;
+        if (major(devnum) > 0)
+                return false;
+
+        r = sd_device_get_ifindex(device, &ifindex);
+        if (r < 0)
+                return r;
+
+        return ifindex <= 0;
+}
+
+static int enumerator_add_device_from_syspath(sd_device_enumerator *enumerator, const char *syspath) {
+        _cleanup_(sd_device_unrefp) sd_device *device = NULL;
+        int r;
+
+        assert(enumerator);
+        assert(syspath);
+
+        r = sd_device_new_from_syspath(&device, syspath);
+        if (r == -ENODEV)
+                /* this is necessarily racey, so ignore missing devices */
+                return 0;
+        if (r < 0)
+                return r;
+
+        /* Check the cheap matches first, so that the uevent file and the database only need to be read
+         * for the devices we might actually return */
+        if (!match_parent(enumerator, device))
+                return 0;
+
+        r = match_initialized(enumerator, device);
+        if (r <= 0)
+                return r;
+
+        if (!match_tag(enumerator, device))
+                return 0;
+
+        if (!match_property(enumerator, device))
+                return 0;
+
+        if (!match_sysattr(enumerator, device))
+                return 0;
+
+        return device_enumerator_add_device(enumerator, device);
+}
+
+static bool match_sysname_is_literal(sd_device_enumerator *enumerator) {
+        const char *sysname_match;
+        Iterator i;
+
+        assert(enumerator);
+
+        if (set_isempty(enumerator->match_sysname))
+                return false;
+
+        SET_FOREACH(sysname_match, enumerator->match_sysname, i)
+                if (string_is_glob(sysname_match) || strchr(sysname_match, '/'))
+                        return false;
+
+        return true;
+}
+
 static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator, const char *basedir, const char *subdir1, const char *subdir2) {
         _cleanup_closedir_ DIR *dir = NULL;
         char *path;
@@ -469,79 +560,51 @@ static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator,
         if (subdir2)
                 path = strjoina(path, subdir2, "/");
 
-        dir = opendir(path);
-        if (!dir)
-                return -errno;
+        /* If only specific devices are asked for, there's no need to read the whole directory */
+        if (match_sysname_is_literal(enumerator)) {
+                const char *sysname;
+                Iterator i;
 
-        FOREACH_DIRENT_ALL(dent, dir, return -errno) {
-                _cleanup_(sd_device_unrefp) sd_device *device = NULL;
-                char syspath[strlen(path) + 1 + strlen(dent->d_name) + 1];
-                dev_t devnum;
-                int ifindex, initialized, k;
+                SET_FOREACH(sysname, enumerator->match_sysname, i) {
+                        const char *syspath;
+                        int k;
 
-                if (dent->d_name[0] == '.')
-                        continue;
+                        if (sysname[0] == '.')
+                                continue;
 
-                if (!match_sysname(enumerator, dent->d_name))
-                        continue;
+                        syspath = strjoina(path, sysname);
+                        if (access(syspath, F_OK) < 0) {
+                                if (errno != ENOENT)
+                                        r = -errno;
 
-                (void)sprintf(syspath, "%s%s", path, dent->d_name);
+                                continue;
+                        }
 
-                k = sd_device_new_from_syspath(&device, syspath);
-                if (k < 0) {
-                        if (k != -ENODEV)
-                                /* this is necessarily racey, so ignore missing devices */
+                        k = enumerator_add_device_from_syspath(enumerator, syspath);
+                        if (k < 0)
                                 r = k;
-
-                        continue;
                 }
 
-                k = sd_device_get_devnum(device, &devnum);
-                if (k < 0) {
-                        r = k;
-                        continue;
-                }
-
-                k = sd_device_get_ifindex(device, &ifindex);
-                if (k < 0) {
-                        r = k;
-                        continue;
-                }
-
-                k = sd_device_get_is_initialized(device, &initialized);
-                if (k < 0) {
-                        r = k;
-                        continue;
-                }
+                return r;
+        }
 
-                /*
-                 * All devices with a device node or network interfaces
-                 * possibly need udev to adjust the device node permission
-                 * or context, or rename the interface before it can be
-                 * reliably used from other processes.
-                 *
-                 * For now, we can only check these types of devices, we
-                 * might not store a database, and have no way to find out
-                 * for all other types of devices.
-                 */
-                if (!enumerator->match_allow_uninitialized &&
-                    !initialized &&
-                    (major(devnum) > 0 || ifindex > 0))
-                        continue;
+        dir = opendir(path);
+        if (!dir)
+                return -errno;
 
-                if (!match_parent(enumerator, device))
-                        continue;
+        FOREACH_DIRENT_ALL(dent, dir, return -errno) {
+                char syspath[strlen(path) + 1 + strlen(dent->d_name) + 1];
+                int k;
 
-                if (!match_tag(enumerator, device))
+                if (dent->d_name[0] == '.')
                         continue;
 
-                if (!match_property(enumerator, device))
+                if (!match_sysname(enumerator, dent->d_name))
                         continue;
 
-                if (!match_sysattr(enumerator, device))
-                        continue;
+                (void)sprintf(syspath, "%s%s", path, dent->d_name);
 
-                k = device_enumerator_add_device(enumerator, device);
+                k = enumerator_add_device_from_syspath(enumerator, syspath);
                 if (k < 0)
                         r = k;
         }
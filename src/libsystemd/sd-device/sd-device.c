@@ -1288,21 +1288,11 @@ int device_get_id_filename(sd_device *device, const char **ret) {
 
 int device_read_db_aux(sd_device *device, bool force) {
         _cleanup_free_ char *db = NULL;
-        char *path;
-        const char *id, *value;
-        char key;
+        char *path, *line, *end;
+        const char *id;
         size_t db_len;
-        unsigned i;
         int r;
 
-        enum {
-                PRE_KEY,
-                KEY,
-                PRE_VALUE,
-                VALUE,
-                INVALID_LINE,
-        } state = PRE_KEY;
-
         if (device->db_loaded || (!force && device->sealed))
                 return 0;
 
@@ -1325,53 +1315,24 @@ int device_read_db_aux(sd_device *device, bool force) {
         /* devices with a database entry are initialized */
         device->is_initialized = true;
 
-        for (i = 0; i < db_len; i++) {
-                switch (state) {
-                case PRE_KEY:
-                        if (!strchr(NEWLINE, db[i])) {
-                                key = db[i];
-
-                                state = KEY;
-                        }
-
-                        break;
-                case KEY:
-                        if (db[i] != ':') {
-                                log_debug("sd-device: ignoring invalid db entry with key '%c'", key);
-
-                                state = INVALID_LINE;
-                        } else {
-                                db[i] = '\0';
+        /* Every line is of the form "K:value", split the buffer in place */
+        for (line = db, end = db + db_len; line < end; line += strcspn(line, NEWLINE) + 1) {
+                size_t n;
 
-                                state = PRE_VALUE;
-                        }
+                n = strcspn(line, NEWLINE);
+                line[n] = '\0';
 
-                        break;
-                case PRE_VALUE:
-                        value = &db[i];
-
-                        state = VALUE;
-
-                        break;
-                case INVALID_LINE:
-                        if (strchr(NEWLINE, db[i]))
-                                state = PRE_KEY;
-
-                        break;
-                case VALUE:
-                        if (strchr(NEWLINE, db[i])) {
-                                db[i] = '\0';
-                                r = handle_db_line(device, key, value);
-                                if (r < 0)
-                                        log_debug_errno(r, "sd-device: failed to handle db entry '%c:%s': %m", key, value);
-
-                                state = PRE_KEY;
-                        }
+                if (n == 0)
+                        continue;
 
-                        break;
-                default:
-                        assert_not_reached("invalid state when parsing db");
+                if (n < 2 || line[1] != ':') {
+                        log_debug("sd-device: ignoring invalid db entry with key '%c'", line[0]);
+                        continue;
                 }
+
+                r = handle_db_line(device, line[0], line + 2);
+                if (r < 0)
+                        log_debug_errno(r, "sd-device: failed to handle db entry '%c:%s': %m", line[0], line + 2);
         }
 
         return 0;
@@ -1673,6 +1634,23 @@ _public_ int sd_device_has_tag(sd_device *device, const char *tag) {
         assert_return(device, -EINVAL);
         assert_return(tag, -EINVAL);
 
+        /* As long as the database of the device has not been read, look the tag up in the tag index
+         * rather than reading and parsing the whole database entry, e.g. when matching on the tags of
+         * all the parents of a device. */
+        if (!device->db_loaded && !device->sealed && set_isempty(device->tags) && filename_is_valid(tag)) {
+                const char *id;
+
+                if (device_get_id_filename(device, &id) >= 0) {
+                        const char *path;
+
+                        path = strjoina("/run/udev/tags/", tag, "/", id);
+                        if (access(path, F_OK) >= 0)
+                                return true;
+                        if (errno == ENOENT)
+                                return false;
+                }
+        }
+
         (void) device_read_db(device);
 
         return !!set_contains(device->tags, tag);
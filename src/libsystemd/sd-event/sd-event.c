@@ -100,7 +100,13 @@ struct sd_event_source {
         uint64_t pending_iteration;
         uint64_t prepare_iteration;
 
+        /* Only maintained if statistics are enabled for the event loop */
+        uint64_t n_dispatch;
+        usec_t runtime, runtime_max;
+        usec_t latency, latency_max;
+
         LIST_FIELDS(sd_event_source, sources);
+        LIST_FIELDS(sd_event_source, io_dirty);
 
         union {
                 struct {
@@ -108,7 +114,10 @@ struct sd_event_source {
                         int fd;
                         uint32_t events;
                         uint32_t revents;
+                        uint32_t epoll_events; /* what the kernel currently has, if registered and armed */
                         bool registered:1;
+                        bool armed:1;
+                        bool dirty:1;
                         bool owned:1;
                 } io;
                 struct {
@@ -212,6 +221,7 @@ struct sd_event {
         bool need_process_child:1;
         bool watchdog:1;
         bool profile_delays:1;
+        bool statistics:1;
 
         int exit_code;
 
@@ -224,6 +234,9 @@ struct sd_event {
 
         LIST_HEAD(sd_event_source, sources);
 
+        /* IO sources whose epoll registration needs to be updated before the next epoll_wait() */
+        LIST_HEAD(sd_event_source, io_dirty);
+
         usec_t last_run, last_log;
         unsigned delays[sizeof(usec_t) * 8];
 };
@@ -493,12 +506,24 @@ static bool event_pid_changed(sd_event *e) {
         return e->original_pid != getpid_cached();
 }
 
+static void source_io_clear_dirty(sd_event_source *s) {
+        assert(s);
+
+        if (!s->io.dirty)
+                return;
+
+        LIST_REMOVE(io_dirty, s->event->io_dirty, s);
+        s->io.dirty = false;
+}
+
 static void source_io_unregister(sd_event_source *s) {
         int r;
 
         assert(s);
         assert(s->type == SOURCE_IO);
 
+        source_io_clear_dirty(s);
+
         if (event_pid_changed(s->event))
                 return;
 
@@ -513,6 +538,38 @@ static void source_io_unregister(sd_event_source *s) {
         s->io.registered = false;
 }
 
+static uint32_t source_io_epoll_events(int enabled, uint32_t events) {
+        assert(enabled != SD_EVENT_OFF);
+
+        return enabled == SD_EVENT_ONESHOT ? events | EPOLLONESHOT : events;
+}
+
+static int source_io_update(sd_event_source *s, int enabled, uint32_t events) {
+        struct epoll_event ev = {};
+
+        assert(s);
+        assert(s->type == SOURCE_IO);
+        assert(s->io.registered);
+
+        ev.events = source_io_epoll_events(enabled, events);
+        ev.data.ptr = s;
+
+        if (epoll_ctl(s->event->epoll_fd, EPOLL_CTL_MOD, s->io.fd, &ev) < 0) {
+                /* While a fired oneshot source stays registered, the fd might have been closed and reused,
+                 * which drops it from the epoll set. Then it needs to be added again. */
+                if (errno != ENOENT)
+                        return -errno;
+
+                if (epoll_ctl(s->event->epoll_fd, EPOLL_CTL_ADD, s->io.fd, &ev) < 0)
+                        return -errno;
+        }
+
+        s->io.armed = true;
+        s->io.epoll_events = ev.events;
+
+        return 0;
+}
+
 static int source_io_register(
                 sd_event_source *s,
                 int enabled,
@@ -525,24 +582,75 @@ static int source_io_register(
         assert(s->type == SOURCE_IO);
         assert(enabled != SD_EVENT_OFF);
 
-        ev.events = events;
-        ev.data.ptr = s;
+        /* A fired oneshot source is re-enabled. That always costs a syscall, hence do it right away, so that
+         * the caller learns about failures. */
+        if (s->io.registered && !s->io.armed) {
+                source_io_clear_dirty(s);
+                return source_io_update(s, enabled, events);
+        }
 
-        if (enabled == SD_EVENT_ONESHOT)
-                ev.events |= EPOLLONESHOT;
+        if (s->io.registered) {
+                /* The fd is in the epoll set already, hence only remember that its mask needs to be updated, and do
+                 * so right before we wait for events the next time, in event_flush_io_changes(). That way,
+                 * changes cancelling each other out, like EPOLLOUT being set and unset again between two
+                 * iterations, cost no syscall at all, and multiple changes cost a single one. The caller updates
+                 * s->enabled and s->io.events, which are what gets flushed. */
+                if (!s->io.dirty) {
+                        LIST_PREPEND(io_dirty, s->event->io_dirty, s);
+                        s->io.dirty = true;
+                }
 
-        if (s->io.registered)
-                r = epoll_ctl(s->event->epoll_fd, EPOLL_CTL_MOD, s->io.fd, &ev);
-        else
-                r = epoll_ctl(s->event->epoll_fd, EPOLL_CTL_ADD, s->io.fd, &ev);
+                return 0;
+        }
+
+        ev.events = source_io_epoll_events(enabled, events);
+        ev.data.ptr = s;
+
+        r = epoll_ctl(s->event->epoll_fd, EPOLL_CTL_ADD, s->io.fd, &ev);
         if (r < 0)
                 return -errno;
 
         s->io.registered = true;
+        s->io.armed = true;
+        s->io.epoll_events = ev.events;
+        source_io_clear_dirty(s);
 
         return 0;
 }
 
+static void event_flush_io_changes(sd_event *e) {
+        sd_event_source *s;
+
+        assert(e);
+
+        while ((s = e->io_dirty)) {
+                int r;
+
+                source_io_clear_dirty(s);
+
+                assert(s->io.registered);
+
+                /* Disabled in the meantime by dispatching it as oneshot source, see source_dispatch() */
+                if (s->enabled == SD_EVENT_OFF)
+                        continue;
+
+                /* Edge-triggered updates are never skipped, so that edges are reset */
+                if (s->io.armed &&
+                    s->io.epoll_events == source_io_epoll_events(s->enabled, s->io.events) &&
+                    !(s->io.events & EPOLLET))
+                        continue;
+
+                r = source_io_update(s, s->enabled, s->io.events);
+                if (r < 0) {
+                        /* The source can't be watched the way it's supposed to be anymore, don't leave it
+                         * around looking fine while it never fires */
+                        log_debug_errno(r, "Failed to update source %s (type %s) in epoll, disabling: %m",
+                                        strna(s->description), event_source_type_to_string(s->type));
+                        (void) sd_event_source_set_enabled(s, SD_EVENT_OFF);
+                }
+        }
+}
+
 static clockid_t event_source_type_to_clock(EventSourceType t) {
 
         switch (t) {
@@ -1466,8 +1574,9 @@ _public_ int sd_event_source_set_io_fd(sd_event_source *s, int fd) {
                 return 0;
 
         if (s->enabled == SD_EVENT_OFF) {
+                /* A disabled oneshot source might still be registered, see source_dispatch() */
+                source_io_unregister(s);
                 s->io.fd = fd;
-                s->io.registered = false;
         } else {
                 int saved_fd;
 
@@ -1633,6 +1742,20 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
         if (s->enabled == m)
                 return 0;
 
+        /* Switching between SD_EVENT_ON and SD_EVENT_ONESHOT doesn't move the source in any of the queues, as
+         * they only distinguish enabled from disabled sources. Only for IO sources EPOLLONESHOT needs to be
+         * updated. */
+        if (s->enabled != SD_EVENT_OFF && m != SD_EVENT_OFF) {
+                if (s->type == SOURCE_IO) {
+                        r = source_io_register(s, m, s->io.events);
+                        if (r < 0)
+                                return r;
+                }
+
+                s->enabled = m;
+                return 0;
+        }
+
         if (m == SD_EVENT_OFF) {
 
                 switch (s->type) {
@@ -1788,6 +1911,10 @@ _public_ int sd_event_source_set_time(sd_event_source *s, uint64_t usec) {
         assert_return(s->event->state != SD_EVENT_FINISHED, -ESTALE);
         assert_return(!event_pid_changed(s->event), -ECHILD);
 
+        /* Nothing changes in that case, so let's not reshuffle the queues and rearm the timer for nothing */
+        if (s->time.next == usec && !s->pending)
+                return 0;
+
         s->time.next = usec;
 
         source_set_pending(s, false);
@@ -1824,6 +1951,9 @@ _public_ int sd_event_source_set_time_accuracy(sd_event_source *s, uint64_t usec
         if (usec == 0)
                 usec = DEFAULT_ACCURACY_USEC;
 
+        if (s->time.accuracy == usec && !s->pending)
+                return 0;
+
         s->time.accuracy = usec;
 
         source_set_pending(s, false);
@@ -1986,6 +2116,63 @@ static usec_t sleep_between(sd_event *e, usec_t a, usec_t b) {
         return b;
 }
 
+static usec_t event_coalesce_wakeup(sd_event *e, struct clock_data *d, usec_t a, usec_t b) {
+        struct clock_data *all[] = {
+                &e->realtime,
+                &e->boottime,
+                &e->monotonic,
+                &e->realtime_alarm,
+                &e->boottime_alarm,
+        };
+        static const clockid_t clocks[] = {
+                CLOCK_REALTIME,
+                CLOCK_BOOTTIME,
+                CLOCK_MONOTONIC,
+                CLOCK_REALTIME_ALARM,
+                CLOCK_BOOTTIME_ALARM,
+        };
+        usec_t base = USEC_INFINITY, best = USEC_INFINITY;
+        size_t i;
+
+        assert(e);
+        assert(d);
+
+        /* The timer of another clock will wake us up anyway at the time it is armed for. If that time lies within
+         * the window of this clock too, let's use it, so that the timers of both are dispatched in a single
+         * wakeup, instead of each clock going its own way. The clocks are related to each other via the
+         * timestamps taken at the last wakeup. That's accurate enough, unless a clock jumped in the meantime, in
+         * which case we just don't coalesce as well as we could. */
+
+        if (!triple_timestamp_is_set(&e->timestamp))
+                return USEC_INFINITY;
+
+        for (i = 0; i < ELEMENTSOF(all); i++)
+                if (all[i] == d)
+                        base = triple_timestamp_by_clock(&e->timestamp, clocks[i]);
+        assert(base != USEC_INFINITY);
+
+        for (i = 0; i < ELEMENTSOF(all); i++) {
+                usec_t other, t;
+
+                if (all[i] == d || all[i]->fd < 0 || IN_SET(all[i]->next, 0, USEC_INFINITY))
+                        continue;
+
+                other = triple_timestamp_by_clock(&e->timestamp, clocks[i]);
+                if (all[i]->next + base < other)
+                        continue;
+
+                t = all[i]->next + base - other;
+                if (t < a || t > b)
+                        continue;
+
+                /* Prefer later times, as sleep_between() does */
+                if (best == USEC_INFINITY || t > best)
+                        best = t;
+        }
+
+        return best;
+}
+
 static int event_arm_timer(
                 sd_event *e,
                 struct clock_data *d) {
@@ -2024,7 +2211,9 @@ static int event_arm_timer(
         b = prioq_peek(d->latest);
         assert_se(b && b->enabled != SD_EVENT_OFF);
 
-        t = sleep_between(e, a->time.next, time_event_source_latest(b));
+        t = event_coalesce_wakeup(e, d, a->time.next, time_event_source_latest(b));
+        if (t == USEC_INFINITY)
+                t = sleep_between(e, a->time.next, time_event_source_latest(b));
         if (d->next == t)
                 return 0;
 
@@ -2247,6 +2436,7 @@ static int process_signal(sd_event *e, struct signal_data *d, uint32_t events) {
 }
 
 static int source_dispatch(sd_event_source *s) {
+        usec_t start = USEC_INFINITY, latency;
         EventSourceType saved_type;
         int r = 0;
 
@@ -2281,9 +2471,28 @@ static int source_dispatch(sd_event_source *s) {
         }
 
         if (s->enabled == SD_EVENT_ONESHOT) {
-                r = sd_event_source_set_enabled(s, SD_EVENT_OFF);
-                if (r < 0)
-                        return r;
+                if (s->type == SOURCE_IO) {
+                        /* The kernel already disarmed the fd when it reported the event, due to EPOLLONESHOT,
+                         * hence there's no need to remove it from the epoll set. Leave it registered, so
+                         * that enabling it again is a single EPOLL_CTL_MOD instead of a DEL and an ADD. */
+                        s->enabled = SD_EVENT_OFF;
+                        s->io.armed = false;
+                } else {
+                        r = sd_event_source_set_enabled(s, SD_EVENT_OFF);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        if (s->event->statistics) {
+                start = now(CLOCK_MONOTONIC);
+
+                /* The time from the wakeup that found this source pending until it is dispatched */
+                if (s->event->timestamp.monotonic > 0) {
+                        latency = usec_sub_unsigned(start, s->event->timestamp.monotonic);
+                        s->latency += latency;
+                        s->latency_max = MAX(s->latency_max, latency);
+                }
         }
 
         s->dispatching = true;
@@ -2340,6 +2549,15 @@ static int source_dispatch(sd_event_source *s) {
 
         s->dispatching = false;
 
+        if (start != USEC_INFINITY) {
+                usec_t runtime;
+
+                runtime = usec_sub_unsigned(now(CLOCK_MONOTONIC), start);
+                s->n_dispatch++;
+                s->runtime += runtime;
+                s->runtime_max = MAX(s->runtime_max, runtime);
+        }
+
         if (r < 0)
                 log_debug_errno(r, "Event source %s (type %s) returned error, disabling: %m",
                                 strna(s->description), event_source_type_to_string(saved_type));
@@ -2506,6 +2724,9 @@ _public_ int sd_event_prepare(sd_event *e) {
         if (r < 0)
                 return r;
 
+        /* Make sure the epoll fd reflects all changes made so far, in case the caller polls it itself */
+        event_flush_io_changes(e);
+
         if (event_next_pending(e) || e->need_process_child)
                 goto pending;
 
@@ -2538,6 +2759,11 @@ _public_ int sd_event_wait(sd_event *e, uint64_t timeout) {
                 return 1;
         }
 
+        event_flush_io_changes(e);
+
+        /* Send out log messages queued up while dispatching before we might go to sleep for a while */
+        (void) log_flush();
+
         ev_queue_max = MAX(e->n_sources, 1u);
         ev_queue = newa(struct epoll_event, ev_queue_max);
 
@@ -2903,6 +3129,23 @@ _public_ int sd_event_get_watchdog(sd_event *e) {
         return e->watchdog;
 }
 
+_public_ int sd_event_set_statistics(sd_event *e, int b) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        e->statistics = !!b;
+        return e->statistics;
+}
+
+_public_ int sd_event_get_statistics(sd_event *e) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        return e->statistics;
+}
+
 _public_ int sd_event_get_iteration(sd_event *e, uint64_t *ret) {
         assert_return(e, -EINVAL);
         assert_return(e = event_resolve(e), -ENOPKG);
@@ -2911,3 +3154,28 @@ _public_ int sd_event_get_iteration(sd_event *e, uint64_t *ret) {
         *ret = e->iteration;
         return 0;
 }
+
+_public_ int sd_event_source_get_statistics(
+                sd_event_source *s,
+                uint64_t *ret_n_dispatch,
+                uint64_t *ret_runtime,
+                uint64_t *ret_runtime_max,
+                uint64_t *ret_latency,
+                uint64_t *ret_latency_max) {
+
+        assert_return(s, -EINVAL);
+        assert_return(!event_pid_changed(s->event), -ECHILD);
+
+        if (ret_n_dispatch)
+                *ret_n_dispatch = s->n_dispatch;
+        if (ret_runtime)
+                *ret_runtime = s->runtime;
+        if (ret_runtime_max)
+                *ret_runtime_max = s->runtime_max;
+        if (ret_latency)
+                *ret_latency = s->latency;
+        if (ret_latency_max)
+                *ret_latency_max = s->latency_max;
+
+        return s->event->statistics;
+}
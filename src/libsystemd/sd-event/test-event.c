@@ -5,6 +5,8 @@
   Copyright 2013 Lennart Poettering
 ***/
 
+#include <poll.h>
+#include <sys/socket.h>
 #include <sys/wait.h>
 
 #include "sd-event.h"
@@ -342,6 +344,228 @@ static void test_rtqueue(void) {
         sd_event_unref(e);
 }
 
+static unsigned n_oneshot;
+
+static int oneshot_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        n_oneshot++;
+        return 0;
+}
+
+static void test_oneshot_io(void) {
+        sd_event_source *s = NULL, *t = NULL;
+        sd_event *e = NULL;
+        int a[2], b[2];
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        assert_se(pipe2(a, O_CLOEXEC|O_NONBLOCK) >= 0);
+        assert_se(pipe2(b, O_CLOEXEC|O_NONBLOCK) >= 0);
+        assert_se(write(a[1], "x", 1) == 1);
+        assert_se(write(b[1], "x", 1) == 1);
+
+        assert_se(sd_event_add_io(e, &s, a[0], EPOLLIN, oneshot_handler, NULL) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+
+        /* The pipe stays readable, but the source must only be dispatched once */
+        assert_se(sd_event_run(e, 0) >= 1);
+        assert_se(n_oneshot == 1);
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(n_oneshot == 1);
+
+        /* Re-enabling it rearms it */
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+        assert_se(sd_event_run(e, 0) >= 1);
+        assert_se(n_oneshot == 2);
+        assert_se(sd_event_run(e, 0) == 0);
+
+        /* Moving the disabled source to another fd must release the old one, so that it may be added again */
+        assert_se(sd_event_source_set_io_fd(s, b[0]) >= 0);
+        assert_se(sd_event_add_io(e, &t, a[0], EPOLLIN, oneshot_handler, NULL) >= 0);
+        assert_se(sd_event_run(e, 0) >= 1);
+        assert_se(n_oneshot == 3);
+
+        assert_se(sd_event_source_set_enabled(t, SD_EVENT_OFF) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ON) >= 0);
+        assert_se(sd_event_run(e, 0) >= 1);
+        assert_se(n_oneshot == 4);
+
+        /* A fired oneshot source whose fd got closed and reused in the meantime must be re-added on enabling */
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+        assert_se(sd_event_run(e, 0) >= 1);
+        assert_se(n_oneshot == 5);
+        assert_se(dup3(a[0], b[0], O_CLOEXEC) == b[0]);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+        assert_se(sd_event_run(e, 0) >= 1);
+        assert_se(n_oneshot == 6);
+
+        sd_event_source_unref(s);
+        sd_event_source_unref(t);
+        sd_event_unref(e);
+
+        safe_close_pair(a);
+        safe_close_pair(b);
+}
+
+static unsigned n_io_events;
+
+static int io_events_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        assert_se(revents & EPOLLOUT);
+        n_io_events++;
+        return 0;
+}
+
+static void test_io_events_changes(void) {
+        sd_event_source *s = NULL;
+        sd_event *e = NULL;
+        struct pollfd p = {};
+        int fds[2];
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, fds) >= 0);
+
+        /* The socket is writable but never readable, hence only EPOLLOUT will ever fire */
+        assert_se(sd_event_add_io(e, &s, fds[0], EPOLLIN, io_events_handler, NULL) >= 0);
+        assert_se(sd_event_run(e, 0) == 0);
+
+        /* Changes that cancel each other out have no effect */
+        assert_se(sd_event_source_set_io_events(s, EPOLLOUT) >= 0);
+        assert_se(sd_event_source_set_io_events(s, EPOLLIN) >= 0);
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(n_io_events == 0);
+
+        assert_se(sd_event_source_set_io_events(s, EPOLLIN|EPOLLOUT) >= 0);
+        assert_se(sd_event_run(e, 0) >= 1);
+        assert_se(n_io_events == 1);
+
+        assert_se(sd_event_source_set_io_events(s, EPOLLIN) >= 0);
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(n_io_events == 1);
+
+        /* Changes must have reached the epoll fd once sd_event_prepare() returns, for those who poll it
+         * themselves */
+        assert_se(sd_event_source_set_io_events(s, EPOLLOUT) >= 0);
+        assert_se(sd_event_prepare(e) == 0);
+        p.fd = sd_event_get_fd(e);
+        p.events = POLLIN;
+        assert_se(poll(&p, 1, 0) == 1);
+        assert_se(sd_event_wait(e, 0) >= 1);
+        assert_se(sd_event_dispatch(e) >= 1);
+        assert_se(n_io_events == 2);
+
+        sd_event_source_unref(s);
+        sd_event_unref(e);
+
+        safe_close_pair(fds);
+}
+
+static unsigned n_time;
+
+static int time_enable_handler(sd_event_source *s, uint64_t usec, void *userdata) {
+        n_time++;
+        return 0;
+}
+
+static void test_time_enable(void) {
+        sd_event_source *s = NULL;
+        sd_event *e = NULL;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        /* Starts out as oneshot source, in the past */
+        assert_se(sd_event_add_time(e, &s, CLOCK_MONOTONIC, 1, 0, time_enable_handler, NULL) >= 0);
+
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ON) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+        assert_se(sd_event_source_set_time(s, 1) >= 0);
+        assert_se(sd_event_run(e, 0) >= 1);
+        assert_se(n_time == 1);
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(n_time == 1);
+
+        /* As enabled source it fires again after every change of the time, even if it's the same */
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ON) >= 0);
+        assert_se(sd_event_run(e, 0) >= 1);
+        assert_se(n_time == 2);
+        assert_se(sd_event_source_set_time(s, 1) >= 0);
+        assert_se(sd_event_run(e, 0) >= 1);
+        assert_se(n_time == 3);
+
+        sd_event_source_unref(s);
+        sd_event_unref(e);
+}
+
+static int statistics_handler(sd_event_source *s, void *userdata) {
+        usleep(1000);
+        return 0;
+}
+
+static void test_statistics(void) {
+        uint64_t n, runtime, runtime_max, latency, latency_max;
+        sd_event_source *s = NULL;
+        sd_event *e = NULL;
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_event_add_defer(e, &s, statistics_handler, NULL) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ON) >= 0);
+
+        /* Nothing is collected unless asked for */
+        assert_se(sd_event_get_statistics(e) == 0);
+        assert_se(sd_event_run(e, 0) >= 1);
+        assert_se(sd_event_source_get_statistics(s, &n, &runtime, NULL, NULL, NULL) == 0);
+        assert_se(n == 0);
+        assert_se(runtime == 0);
+
+        assert_se(sd_event_set_statistics(e, true) == 1);
+        assert_se(sd_event_get_statistics(e) == 1);
+        assert_se(sd_event_run(e, 0) >= 1);
+        assert_se(sd_event_run(e, 0) >= 1);
+
+        assert_se(sd_event_source_get_statistics(s, &n, &runtime, &runtime_max, &latency, &latency_max) == 1);
+        assert_se(n == 2);
+        assert_se(runtime >= 2 * USEC_PER_MSEC);
+        assert_se(runtime_max >= USEC_PER_MSEC);
+        assert_se(runtime_max <= runtime);
+        assert_se(latency_max <= latency);
+
+        sd_event_source_unref(s);
+        sd_event_unref(e);
+}
+
+static unsigned n_coalesce;
+
+static int coalesce_handler(sd_event_source *s, uint64_t usec, void *userdata) {
+        n_coalesce++;
+        return 0;
+}
+
+static void test_coalesce_clocks(void) {
+        sd_event_source *x = NULL, *y = NULL;
+        sd_event *e = NULL;
+        usec_t m, b;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        /* Make sure the event loop took its timestamps */
+        assert_se(sd_event_run(e, 0) == 0);
+
+        assert_se(sd_event_now(e, CLOCK_BOOTTIME, &b) >= 0);
+        assert_se(sd_event_now(e, CLOCK_MONOTONIC, &m) >= 0);
+
+        /* The boottime timer has to be dispatched at a precise time, the monotonic one may be dispatched at the
+         * same time, hence both should be dispatched after a single wakeup */
+        assert_se(sd_event_add_time(e, &x, CLOCK_BOOTTIME, b + 300 * USEC_PER_MSEC, 1, coalesce_handler, NULL) >= 0);
+        assert_se(sd_event_add_time(e, &y, CLOCK_MONOTONIC, m + 100 * USEC_PER_MSEC, 220 * USEC_PER_MSEC, coalesce_handler, NULL) >= 0);
+
+        assert_se(sd_event_run(e, (uint64_t) -1) >= 1);
+        assert_se(n_coalesce == 1);
+        assert_se(sd_event_run(e, 0) >= 1);
+        assert_se(n_coalesce == 2);
+
+        sd_event_source_unref(x);
+        sd_event_source_unref(y);
+        sd_event_unref(e);
+}
+
 int main(int argc, char *argv[]) {
 
         log_set_max_level(LOG_DEBUG);
@@ -350,6 +574,11 @@ int main(int argc, char *argv[]) {
         test_basic();
         test_sd_event_now();
         test_rtqueue();
+        test_oneshot_io();
+        test_io_events_changes();
+        test_time_enable();
+        test_statistics();
+        test_coalesce_clocks();
 
         return 0;
 }
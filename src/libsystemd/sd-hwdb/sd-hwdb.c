@@ -39,8 +39,13 @@ struct sd_hwdb {
         OrderedHashmap *properties;
         Iterator properties_iterator;
         bool properties_modified;
+
+        /* modalias → properties of recent lookups, least recently used first */
+        OrderedHashmap *cache;
 };
 
+#define HWDB_CACHE_MAX 64
+
 struct linebuf {
         char bytes[LINE_MAX];
         size_t size;
@@ -373,12 +378,37 @@ _public_ sd_hwdb *sd_hwdb_ref(sd_hwdb *hwdb) {
         return hwdb;
 }
 
+static bool hwdb_cache_evict_oldest(sd_hwdb *hwdb) {
+        const char *oldest;
+        char *modalias;
+
+        assert(hwdb);
+
+        oldest = ordered_hashmap_first_key(hwdb->cache);
+        if (!oldest)
+                return false;
+
+        ordered_hashmap_free(ordered_hashmap_remove2(hwdb->cache, oldest, (void**) &modalias));
+        free(modalias);
+
+        return true;
+}
+
+static void hwdb_cache_clear(sd_hwdb *hwdb) {
+        assert(hwdb);
+
+        while (hwdb_cache_evict_oldest(hwdb))
+                ;
+}
+
 _public_ sd_hwdb *sd_hwdb_unref(sd_hwdb *hwdb) {
         if (hwdb && REFCNT_DEC(hwdb->n_ref) == 0) {
                 if (hwdb->map)
                         munmap((void *)hwdb->map, hwdb->st.st_size);
                 safe_fclose(hwdb->f);
                 ordered_hashmap_free(hwdb->properties);
+                hwdb_cache_clear(hwdb);
+                ordered_hashmap_free(hwdb->cache);
                 free(hwdb);
         }
 
@@ -411,13 +441,77 @@ bool hwdb_validate(sd_hwdb *hwdb) {
 }
 
 static int properties_prepare(sd_hwdb *hwdb, const char *modalias) {
+        _cleanup_free_ char *key = NULL;
+        OrderedHashmap *cached;
+        int r;
+
         assert(hwdb);
         assert(modalias);
 
         ordered_hashmap_clear(hwdb->properties);
         hwdb->properties_modified = true;
 
-        return trie_search_f(hwdb, modalias);
+        /* The same devices, and their parents, are looked up over and over again, hence remember the
+         * results of the last lookups. The properties refer to the mapped database only. */
+        cached = ordered_hashmap_remove2(hwdb->cache, modalias, (void**) &key);
+        if (cached) {
+                const struct trie_value_entry_f *entry;
+                Iterator i;
+                const void *k;
+
+                /* move to the end, it's the most recently used one now */
+                r = ordered_hashmap_put(hwdb->cache, key, cached);
+                if (r < 0) {
+                        ordered_hashmap_free(cached);
+                        return r;
+                }
+                key = NULL;
+
+                if (ordered_hashmap_isempty(cached))
+                        return 0;
+
+                r = ordered_hashmap_ensure_allocated(&hwdb->properties, &string_hash_ops);
+                if (r < 0)
+                        return r;
+
+                ORDERED_HASHMAP_FOREACH_KEY(entry, k, cached, i) {
+                        r = ordered_hashmap_put(hwdb->properties, k, (void*) entry);
+                        if (r < 0)
+                                return r;
+                }
+
+                return 0;
+        }
+
+        r = trie_search_f(hwdb, modalias);
+        if (r < 0)
+                return r;
+
+        /* Failing to cache the result is not fatal */
+        if (ordered_hashmap_ensure_allocated(&hwdb->cache, &string_hash_ops) < 0)
+                return 0;
+
+        if (ordered_hashmap_size(hwdb->cache) >= HWDB_CACHE_MAX)
+                (void) hwdb_cache_evict_oldest(hwdb);
+
+        key = strdup(modalias);
+        if (!key)
+                return 0;
+
+        if (hwdb->properties)
+                cached = ordered_hashmap_copy(hwdb->properties);
+        else
+                cached = ordered_hashmap_new(&string_hash_ops);
+        if (!cached)
+                return 0;
+
+        if (ordered_hashmap_put(hwdb->cache, key, cached) < 0) {
+                ordered_hashmap_free(cached);
+                return 0;
+        }
+        key = NULL;
+
+        return 0;
 }
 
 _public_ int sd_hwdb_get(sd_hwdb *hwdb, const char *modalias, const char *key, const char **_value) {
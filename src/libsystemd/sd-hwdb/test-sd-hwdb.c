@@ -0,0 +1,85 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+***/
+
+#include <errno.h>
+
+#include "sd-hwdb.h"
+
+#include "alloc-util.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "util.h"
+
+static char *enumerate(sd_hwdb *hwdb, const char *modalias) {
+        _cleanup_free_ char *s = NULL;
+        const char *key, *value;
+
+        SD_HWDB_FOREACH_PROPERTY(hwdb, modalias, key, value)
+                assert_se(strextend(&s, key, "=", value, "\n", NULL));
+
+        return s ? TAKE_PTR(s) : strdup("");
+}
+
+static void test_lookup_cache(sd_hwdb *hwdb) {
+        static const char *modaliases[] = {
+                "usb:v046DpC52B",
+                "usb:v1D6Bp0002d0415dc09dsc00dp03ic09isc00ip00in00",
+                "pci:v00008086d00001E3A",
+                "acpi:PNP0C0A:",
+                "dmi:bvnLENOVO:bvr:bd:svnLENOVO:pn:pvrThinkPadX230:rvn:rn:rvr:cvn:ct10:cvr:",
+                "nonexistent:foo",
+        };
+        _cleanup_strv_free_ char **first = NULL;
+        char buf[64];
+        unsigned i, j;
+
+        assert_se(first = new0(char*, ELEMENTSOF(modaliases) + 1));
+
+        for (i = 0; i < ELEMENTSOF(modaliases); i++)
+                assert_se(first[i] = enumerate(hwdb, modaliases[i]));
+
+        /* Looking up the same modaliases again must yield the same results, as must doing so after the
+         * cached entries got pushed out by a lot of other lookups */
+        for (j = 0; j < 2; j++) {
+                for (i = 0; i < ELEMENTSOF(modaliases); i++) {
+                        _cleanup_free_ char *s = NULL;
+                        const char *value;
+
+                        assert_se(s = enumerate(hwdb, modaliases[i]));
+                        assert_se(streq(s, first[i]));
+
+                        if (isempty(s))
+                                assert_se(sd_hwdb_get(hwdb, modaliases[i], "ID_VENDOR_FROM_DATABASE", &value) == -ENOENT);
+                }
+
+                for (i = 0; i < 1000; i++) {
+                        _cleanup_free_ char *s = NULL;
+
+                        xsprintf(buf, "usb:v%04Xp0001", i);
+                        assert_se(s = enumerate(hwdb, buf));
+                }
+        }
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(sd_hwdb_unrefp) sd_hwdb *hwdb = NULL;
+        int r;
+
+        log_set_max_level(LOG_DEBUG);
+        log_parse_environment();
+        log_open();
+
+        r = sd_hwdb_new(&hwdb);
+        if (r == -ENOENT) {
+                log_notice_errno(r, "Skipping test: cannot open hwdb: %m");
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+
+        test_lookup_cache(hwdb);
+
+        return 0;
+}
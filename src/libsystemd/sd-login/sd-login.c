@@ -7,8 +7,11 @@
 
 #include <errno.h>
 #include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
 #include <string.h>
 #include <sys/inotify.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "sd-login.h"
@@ -43,6 +46,156 @@
  *    requested metadata on object is missing → -ENODATA
  */
 
+/* The state files in /run/systemd are always replaced atomically by their owners, hence a file whose inode, size
+ * and modification time did not change since we last parsed it still has the same contents. Remember the last
+ * few files we parsed, so that repeated queries for the same session, user or seat cost a single stat() instead
+ * of reading and parsing the file every time. The cache is shared by all threads, and only accessed with
+ * state_file_cache_mutex held. */
+#define STATE_FILE_CACHE_MAX 16U
+
+typedef struct StateFileCacheEntry {
+        char *path;
+        dev_t dev;
+        ino_t ino;
+        off_t size;
+        struct timespec mtime;
+        char **pairs;
+} StateFileCacheEntry;
+
+static StateFileCacheEntry state_file_cache[STATE_FILE_CACHE_MAX] = {};
+static unsigned state_file_cache_next = 0;
+static pthread_mutex_t state_file_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static _destructor_ void state_file_cache_free(void) {
+        unsigned i;
+
+        for (i = 0; i < STATE_FILE_CACHE_MAX; i++) {
+                state_file_cache[i].path = mfree(state_file_cache[i].path);
+                state_file_cache[i].pairs = strv_free(state_file_cache[i].pairs);
+        }
+}
+
+static bool state_file_cache_entry_matches(const StateFileCacheEntry *e, const struct stat *st) {
+        return e->dev == st->st_dev &&
+                e->ino == st->st_ino &&
+                e->size == st->st_size &&
+                e->mtime.tv_sec == st->st_mtim.tv_sec &&
+                e->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static int state_file_get_pairs(const char *path, char ***ret) {
+        _cleanup_strv_free_ char **pairs = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *copy = NULL;
+        StateFileCacheEntry *e = NULL;
+        struct stat st;
+        unsigned i;
+        int r;
+
+        assert(path);
+        assert(ret);
+
+        /* Returns the key/value pairs in the file, owned by the cache and valid until the next call. Must be
+         * called with state_file_cache_mutex held. */
+
+        if (stat(path, &st) < 0)
+                return -errno;
+
+        for (i = 0; i < STATE_FILE_CACHE_MAX; i++)
+                if (state_file_cache[i].path && streq(state_file_cache[i].path, path)) {
+                        e = state_file_cache + i;
+                        break;
+                }
+
+        if (e && state_file_cache_entry_matches(e, &st)) {
+                *ret = e->pairs;
+                return 0;
+        }
+
+        f = fopen(path, "re");
+        if (!f)
+                return -errno;
+
+        if (fstat(fileno(f), &st) < 0)
+                return -errno;
+
+        r = load_env_file_pairs(f, path, NEWLINE, &pairs);
+        if (r < 0)
+                return r;
+
+        if (!e) {
+                copy = strdup(path);
+                if (!copy)
+                        return -ENOMEM;
+
+                e = state_file_cache + state_file_cache_next;
+                state_file_cache_next = (state_file_cache_next + 1) % STATE_FILE_CACHE_MAX;
+
+                free_and_replace(e->path, copy);
+        }
+
+        strv_free_and_replace(e->pairs, pairs);
+        e->dev = st.st_dev;
+        e->ino = st.st_ino;
+        e->size = st.st_size;
+        e->mtime = st.st_mtim;
+
+        *ret = e->pairs;
+        return 0;
+}
+
+static int parse_state_file(const char *path, ...) _sentinel_;
+static int parse_state_file(const char *path, ...) {
+        const char *key;
+        char **pairs;
+        va_list ap;
+        int r, n = 0;
+
+        assert(path);
+
+        /* Like parse_env_file(), but goes through the cache above */
+
+        assert_se(pthread_mutex_lock(&state_file_cache_mutex) == 0);
+
+        r = state_file_get_pairs(path, &pairs);
+        if (r < 0) {
+                assert_se(pthread_mutex_unlock(&state_file_cache_mutex) == 0);
+                return r;
+        }
+
+        va_start(ap, path);
+        while ((key = va_arg(ap, const char*))) {
+                char **value, **k, **v;
+
+                value = va_arg(ap, char**);
+
+                STRV_FOREACH_PAIR(k, v, pairs) {
+                        char *c = NULL;
+
+                        if (!streq(*k, key))
+                                continue;
+
+                        /* parse_env_file() returns empty values as NULL, do the same */
+                        if (!isempty(*v)) {
+                                c = strdup(*v);
+                                if (!c) {
+                                        va_end(ap);
+                                        assert_se(pthread_mutex_unlock(&state_file_cache_mutex) == 0);
+                                        return -ENOMEM;
+                                }
+                        }
+
+                        free_and_replace(*value, c);
+                        n++;
+                }
+        }
+        va_end(ap);
+
+        assert_se(pthread_mutex_unlock(&state_file_cache_mutex) == 0);
+
+        return n;
+}
+
 _public_ int sd_pid_get_session(pid_t pid, char **session) {
         int r;
 
@@ -273,7 +426,7 @@ _public_ int sd_uid_get_state(uid_t uid, char**state) {
         if (r < 0)
                 return r;
 
-        r = parse_env_file(NULL, p, NEWLINE, "STATE", &s, NULL);
+        r = parse_state_file(p, "STATE", &s, NULL);
         if (r == -ENOENT) {
                 free(s);
                 s = strdup("offline");
@@ -304,7 +457,7 @@ _public_ int sd_uid_get_display(uid_t uid, char **session) {
         if (r < 0)
                 return r;
 
-        r = parse_env_file(NULL, p, NEWLINE, "DISPLAY", &s, NULL);
+        r = parse_state_file(p, "DISPLAY", &s, NULL);
         if (r == -ENOENT)
                 return -ENODATA;
         if (r < 0)
@@ -359,7 +512,7 @@ _public_ int sd_uid_is_on_seat(uid_t uid, int require_active, const char *seat)
 
         variable = require_active ? "ACTIVE_UID" : "UIDS";
 
-        r = parse_env_file(NULL, p, NEWLINE, variable, &s, NULL);
+        r = parse_state_file(p, variable, &s, NULL);
         if (r == -ENOENT)
                 return 0;
         if (r < 0)
@@ -388,7 +541,7 @@ static int uid_get_array(uid_t uid, const char *variable, char ***array) {
         if (r < 0)
                 return r;
 
-        r = parse_env_file(NULL, p, NEWLINE, variable, &s, NULL);
+        r = parse_state_file(p, variable, &s, NULL);
         if (r == -ENOENT || (r >= 0 && isempty(s))) {
                 if (array)
                         *array = NULL;
@@ -466,7 +619,7 @@ _public_ int sd_session_is_active(const char *session) {
         if (r < 0)
                 return r;
 
-        r = parse_env_file(NULL, p, NEWLINE, "ACTIVE", &s, NULL);
+        r = parse_state_file(p, "ACTIVE", &s, NULL);
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -485,7 +638,7 @@ _public_ int sd_session_is_remote(const char *session) {
         if (r < 0)
                 return r;
 
-        r = parse_env_file(NULL, p, NEWLINE, "REMOTE", &s, NULL);
+        r = parse_state_file(p, "REMOTE", &s, NULL);
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -506,7 +659,7 @@ _public_ int sd_session_get_state(const char *session, char **state) {
         if (r < 0)
                 return r;
 
-        r = parse_env_file(NULL, p, NEWLINE, "STATE", &s, NULL);
+        r = parse_state_file(p, "STATE", &s, NULL);
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -529,7 +682,7 @@ _public_ int sd_session_get_uid(const char *session, uid_t *uid) {
         if (r < 0)
                 return r;
 
-        r = parse_env_file(NULL, p, NEWLINE, "UID", &s, NULL);
+        r = parse_state_file(p, "UID", &s, NULL);
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -551,7 +704,7 @@ static int session_get_string(const char *session, const char *field, char **val
         if (r < 0)
                 return r;
 
-        r = parse_env_file(NULL, p, NEWLINE, field, &s, NULL);
+        r = parse_state_file(p, field, &s, NULL);
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -643,10 +796,10 @@ _public_ int sd_seat_get_active(const char *seat, char **session, uid_t *uid) {
         if (r < 0)
                 return r;
 
-        r = parse_env_file(NULL, p, NEWLINE,
-                           "ACTIVE", &s,
-                           "ACTIVE_UID", &t,
-                           NULL);
+        r = parse_state_file(p,
+                             "ACTIVE", &s,
+                             "ACTIVE_UID", &t,
+                             NULL);
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -681,10 +834,10 @@ _public_ int sd_seat_get_sessions(const char *seat, char ***sessions, uid_t **ui
         if (r < 0)
                 return r;
 
-        r = parse_env_file(NULL, p, NEWLINE,
-                           "SESSIONS", &s,
-                           "UIDS", &t,
-                           NULL);
+        r = parse_state_file(p,
+                             "SESSIONS", &s,
+                             "UIDS", &t,
+                             NULL);
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -750,9 +903,9 @@ static int seat_get_can(const char *seat, const char *variable) {
         if (r < 0)
                 return r;
 
-        r = parse_env_file(NULL, p, NEWLINE,
-                           variable, &s,
-                           NULL);
+        r = parse_state_file(p,
+                             variable, &s,
+                             NULL);
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -899,7 +1052,7 @@ _public_ int sd_machine_get_class(const char *machine, char **class) {
         assert_return(class, -EINVAL);
 
         p = strjoina("/run/systemd/machines/", machine);
-        r = parse_env_file(NULL, p, NEWLINE, "CLASS", &c, NULL);
+        r = parse_state_file(p, "CLASS", &c, NULL);
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -923,7 +1076,7 @@ _public_ int sd_machine_get_ifindices(const char *machine, int **ifindices) {
         assert_return(ifindices, -EINVAL);
 
         p = strjoina("/run/systemd/machines/", machine);
-        r = parse_env_file(NULL, p, NEWLINE, "NETIF", &netif, NULL);
+        r = parse_state_file(p, "NETIF", &netif, NULL);
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -19,8 +19,13 @@
 #define RTNL_DEFAULT_TIMEOUT ((usec_t) (25 * USEC_PER_SEC))
 
 #define RTNL_WQUEUE_MAX 1024
+/* Upper bound for the messages packed into a single sendmsg(), well below the default socket send buffer */
+#define RTNL_WQUEUE_BATCH_SIZE_MAX (64U*1024U)
 #define RTNL_RQUEUE_MAX 64*1024
 
+/* The receive buffer is doubled whenever the kernel had to drop messages, but not beyond this */
+#define RTNL_RCVBUF_MAX (128U*1024U*1024U)
+
 #define RTNL_CONTAINER_DEPTH 32
 
 struct reply_callback {
@@ -62,10 +67,22 @@ struct sd_netlink {
         unsigned rqueue_partial_size;
         size_t rqueue_partial_allocated;
 
+        /* Messages sent while batching, see sd_netlink_batch_begin() */
+        sd_netlink_message **wqueue;
+        unsigned wqueue_size;
+        size_t wqueue_allocated;
+        unsigned n_batch;
+
         struct nlmsghdr *rbuffer;
         size_t rbuffer_allocated;
 
         bool processing:1;
+        bool overrun_pending:1;
+
+        /* How often the kernel dropped messages because the receive buffer was full */
+        uint64_t n_overruns;
+        sd_netlink_overrun_handler_t overrun_callback;
+        void *overrun_userdata;
 
         uint32_t serial;
 
@@ -121,10 +138,12 @@ int socket_bind(sd_netlink *nl);
 int socket_broadcast_group_ref(sd_netlink *nl, unsigned group);
 int socket_broadcast_group_unref(sd_netlink *nl, unsigned group);
 int socket_write_message(sd_netlink *nl, sd_netlink_message *m);
+int socket_writev_message(sd_netlink *nl, sd_netlink_message **m, size_t n);
 int socket_read_message(sd_netlink *nl);
 
 int rtnl_rqueue_make_room(sd_netlink *rtnl);
 int rtnl_rqueue_partial_make_room(sd_netlink *rtnl);
+void rtnl_overrun(sd_netlink *rtnl);
 
 /* Make sure callbacks don't destroy the rtnl connection */
 #define NETLINK_DONT_DESTROY(rtnl) \
@@ -14,6 +14,7 @@
 #include "alloc-util.h"
 #include "fd-util.h"
 #include "format-util.h"
+#include "io-util.h"
 #include "missing.h"
 #include "netlink-internal.h"
 #include "netlink-types.h"
@@ -244,6 +245,44 @@ int socket_write_message(sd_netlink *nl, sd_netlink_message *m) {
         return k;
 }
 
+/* sends all messages in a single datagram, the kernel processes and acknowledges each of them separately. Returns the
+ * number of bytes sent, or a negative error code */
+int socket_writev_message(sd_netlink *nl, sd_netlink_message **m, size_t n) {
+        union {
+                struct sockaddr sa;
+                struct sockaddr_nl nl;
+        } addr = {
+                .nl.nl_family = AF_NETLINK,
+        };
+        struct iovec *iovs;
+        struct msghdr mh = {
+                .msg_name = &addr.sa,
+                .msg_namelen = sizeof(addr),
+        };
+        size_t i;
+        ssize_t k;
+
+        assert(nl);
+        assert(m);
+        assert(n > 0);
+        assert(n <= IOV_MAX);
+
+        iovs = newa(struct iovec, n);
+        for (i = 0; i < n; i++) {
+                assert(m[i]->hdr);
+                iovs[i] = IOVEC_MAKE(m[i]->hdr, m[i]->hdr->nlmsg_len);
+        }
+
+        mh.msg_iov = iovs;
+        mh.msg_iovlen = n;
+
+        k = sendmsg(nl->fd, &mh, 0);
+        if (k < 0)
+                return -errno;
+
+        return k;
+}
+
 static int socket_recv_message(int fd, struct iovec *iov, uint32_t *_group, bool peek) {
         union sockaddr_union sender;
         uint8_t cmsg_buffer[CMSG_SPACE(sizeof(struct nl_pktinfo))];
@@ -265,9 +304,7 @@ static int socket_recv_message(int fd, struct iovec *iov, uint32_t *_group, bool
         n = recvmsg(fd, &msg, MSG_TRUNC | (peek ? MSG_PEEK : 0));
         if (n < 0) {
                 /* no data */
-                if (errno == ENOBUFS)
-                        log_debug("rtnl: kernel receive buffer overrun");
-                else if (errno == EAGAIN)
+                if (errno == EAGAIN)
                         log_debug("rtnl: no data in socket");
 
                 return IN_SET(errno, EAGAIN, EINTR) ? 0 : -errno;
@@ -328,6 +365,11 @@ int socket_read_message(sd_netlink *rtnl) {
 
         /* read nothing, just get the pending message size */
         r = socket_recv_message(rtnl->fd, &iov, NULL, true);
+        if (r == -ENOBUFS) {
+                /* The kernel dropped messages, but the socket is still perfectly usable */
+                rtnl_overrun(rtnl);
+                return 0;
+        }
         if (r <= 0)
                 return r;
         else
@@ -344,6 +386,10 @@ int socket_read_message(sd_netlink *rtnl) {
 
         /* read the pending message */
         r = socket_recv_message(rtnl->fd, &iov, &group, false);
+        if (r == -ENOBUFS) {
+                rtnl_overrun(rtnl);
+                return 0;
+        }
         if (r <= 0)
                 return r;
         else
@@ -179,6 +179,10 @@ sd_netlink *sd_netlink_unref(sd_netlink *rtnl) {
                         sd_netlink_message_unref(rtnl->rqueue_partial[i]);
                 free(rtnl->rqueue_partial);
 
+                for (i = 0; i < rtnl->wqueue_size; i++)
+                        sd_netlink_message_unref(rtnl->wqueue[i]);
+                free(rtnl->wqueue);
+
                 free(rtnl->rbuffer);
 
                 hashmap_free_free(rtnl->reply_callbacks);
@@ -216,6 +220,66 @@ static void rtnl_seal_message(sd_netlink *rtnl, sd_netlink_message *m) {
         return;
 }
 
+static void rtnl_wqueue_fail(sd_netlink *rtnl, unsigned n, int error) {
+        unsigned i;
+
+        assert(rtnl);
+        assert(n <= rtnl->wqueue_size);
+        assert(error < 0);
+
+        /* Sending failed, turn that into an error reply for each of the messages, so that whoever waits for
+         * the reply learns about it the same way as about any other failure */
+        for (i = 0; i < n; i++) {
+                _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
+
+                if (rtnl_message_new_synthetic_error(rtnl, error, rtnl_message_get_serial(rtnl->wqueue[i]), &m) < 0)
+                        continue;
+
+                if (rtnl_rqueue_make_room(rtnl) < 0)
+                        continue;
+
+                rtnl->rqueue[rtnl->rqueue_size++] = TAKE_PTR(m);
+        }
+}
+
+static int rtnl_wqueue_flush(sd_netlink *rtnl) {
+        int r = 0;
+
+        assert(rtnl);
+
+        while (rtnl->wqueue_size > 0) {
+                size_t size = 0;
+                unsigned n, i;
+                int k;
+
+                /* Pack as many messages as we can into one datagram */
+                for (n = 0; n < rtnl->wqueue_size; n++) {
+                        size_t l = rtnl->wqueue[n]->hdr->nlmsg_len;
+
+                        if (n > 0 && size + l > RTNL_WQUEUE_BATCH_SIZE_MAX)
+                                break;
+
+                        size += l;
+                }
+
+                k = socket_writev_message(rtnl, rtnl->wqueue, n);
+                if (k < 0) {
+                        log_debug_errno(k, "sd-netlink: failed to send %u queued messages: %m", n);
+                        rtnl_wqueue_fail(rtnl, n, k);
+                        if (r == 0)
+                                r = k;
+                }
+
+                for (i = 0; i < n; i++)
+                        sd_netlink_message_unref(rtnl->wqueue[i]);
+
+                rtnl->wqueue_size -= n;
+                memmove(rtnl->wqueue, rtnl->wqueue + n, sizeof(sd_netlink_message*) * rtnl->wqueue_size);
+        }
+
+        return r;
+}
+
 int sd_netlink_send(sd_netlink *nl,
                  sd_netlink_message *message,
                  uint32_t *serial) {
@@ -226,11 +290,22 @@ int sd_netlink_send(sd_netlink *nl,
         assert_return(message, -EINVAL);
         assert_return(!message->sealed, -EPERM);
 
-        rtnl_seal_message(nl, message);
+        if (nl->n_batch > 0) {
+                if (nl->wqueue_size >= RTNL_WQUEUE_MAX)
+                        (void) rtnl_wqueue_flush(nl);
 
-        r = socket_write_message(nl, message);
-        if (r < 0)
-                return r;
+                if (!GREEDY_REALLOC(nl->wqueue, nl->wqueue_allocated, nl->wqueue_size + 1))
+                        return -ENOMEM;
+
+                rtnl_seal_message(nl, message);
+                nl->wqueue[nl->wqueue_size++] = sd_netlink_message_ref(message);
+        } else {
+                rtnl_seal_message(nl, message);
+
+                r = socket_write_message(nl, message);
+                if (r < 0)
+                        return r;
+        }
 
         if (serial)
                 *serial = rtnl_message_get_serial(message);
@@ -238,6 +313,34 @@ int sd_netlink_send(sd_netlink *nl,
         return 1;
 }
 
+int sd_netlink_batch_begin(sd_netlink *nl) {
+        assert_return(nl, -EINVAL);
+        assert_return(!rtnl_pid_changed(nl), -ECHILD);
+
+        /* Until the matching sd_netlink_batch_end(), messages are not sent right away, but queued up and then
+         * sent together with as few syscalls as possible. Replies are still dispatched for each message
+         * individually. Calls may be nested. Note that the kernel drops replies that do not fit into the
+         * receive buffer, hence callers that batch up many requests should raise it accordingly. */
+
+        nl->n_batch++;
+        return 0;
+}
+
+int sd_netlink_batch_end(sd_netlink *nl) {
+        assert_return(nl, -EINVAL);
+        assert_return(!rtnl_pid_changed(nl), -ECHILD);
+        assert_return(nl->n_batch > 0, -EINVAL);
+
+        /* Returns an error if some messages could not be sent. In that case, an error reply is queued for each
+         * of them too. */
+
+        nl->n_batch--;
+        if (nl->n_batch > 0)
+                return 0;
+
+        return rtnl_wqueue_flush(nl);
+}
+
 int rtnl_rqueue_make_room(sd_netlink *rtnl) {
         assert(rtnl);
 
@@ -267,6 +370,38 @@ int rtnl_rqueue_partial_make_room(sd_netlink *rtnl) {
         return 0;
 }
 
+void rtnl_overrun(sd_netlink *rtnl) {
+        socklen_t l = sizeof(int);
+        int value, r;
+
+        assert(rtnl);
+
+        /* The kernel had to drop messages, most likely multicast notifications. Remember that, so that the
+         * overrun handler can resynchronize, and make it less likely to happen again by growing the receive
+         * buffer. */
+
+        rtnl->n_overruns++;
+        rtnl->overrun_pending = true;
+
+        if (getsockopt(rtnl->fd, SOL_SOCKET, SO_RCVBUF, &value, &l) < 0 || l != sizeof(value) || value <= 0) {
+                log_debug("rtnl: kernel receive buffer overrun");
+                return;
+        }
+
+        /* The kernel reports twice the size that was set, hence asking for the reported size doubles it */
+        if ((size_t) value / 2 >= RTNL_RCVBUF_MAX) {
+                log_debug("rtnl: kernel receive buffer overrun, buffer is already at its maximum size");
+                return;
+        }
+
+        r = fd_inc_rcvbuf(rtnl->fd, MIN((size_t) value, RTNL_RCVBUF_MAX));
+        if (r < 0)
+                log_debug_errno(r, "rtnl: kernel receive buffer overrun, failed to increase buffer size: %m");
+        else
+                log_debug("rtnl: kernel receive buffer overrun, increased buffer size to %zu",
+                          MIN((size_t) value, RTNL_RCVBUF_MAX));
+}
+
 static int dispatch_rqueue(sd_netlink *rtnl, sd_netlink_message **message) {
         int r;
 
@@ -276,7 +411,7 @@ static int dispatch_rqueue(sd_netlink *rtnl, sd_netlink_message **message) {
         if (rtnl->rqueue_size <= 0) {
                 /* Try to read a new message */
                 r = socket_read_message(rtnl);
-                if (r == -ENOBUFS) { /* FIXME: ignore buffer overruns for now */
+                if (r == -ENOBUFS) { /* our read queue is exhausted, the message got dropped */
                         log_debug_errno(r, "Got ENOBUFS from netlink socket, ignoring.");
                         return 1;
                 }
@@ -388,6 +523,19 @@ static int process_running(sd_netlink *rtnl, sd_netlink_message **ret) {
 
         assert(rtnl);
 
+        if (rtnl->overrun_pending) {
+                rtnl->overrun_pending = false;
+
+                if (rtnl->overrun_callback) {
+                        r = rtnl->overrun_callback(rtnl, rtnl->n_overruns, rtnl->overrun_userdata);
+                        if (r < 0)
+                                log_debug_errno(r, "sd-netlink: overrun callback failed: %m");
+
+                        r = 1;
+                        goto null_message;
+                }
+        }
+
         r = process_timeout(rtnl);
         if (r != 0)
                 goto null_message;
@@ -617,6 +765,10 @@ int sd_netlink_call(sd_netlink *rtnl,
         if (r < 0)
                 return r;
 
+        /* We are about to wait for the reply, hence make sure the request actually goes out. If that fails, the
+         * error reply for it is found below. */
+        (void) rtnl_wqueue_flush(rtnl);
+
         timeout = calc_elapse(usec);
 
         for (;;) {
@@ -702,7 +854,7 @@ int sd_netlink_get_timeout(sd_netlink *rtnl, uint64_t *timeout_usec) {
         assert_return(timeout_usec, -EINVAL);
         assert_return(!rtnl_pid_changed(rtnl), -ECHILD);
 
-        if (rtnl->rqueue_size > 0) {
+        if (rtnl->rqueue_size > 0 || rtnl->overrun_pending) {
                 *timeout_usec = 0;
                 return 1;
         }
@@ -752,6 +904,9 @@ static int prepare_callback(sd_event_source *s, void *userdata) {
         assert(s);
         assert(rtnl);
 
+        /* Never go to sleep with requests still queued up */
+        (void) rtnl_wqueue_flush(rtnl);
+
         e = sd_netlink_get_events(rtnl);
         if (e < 0)
                 return e;
@@ -966,3 +1121,25 @@ int sd_netlink_remove_match(sd_netlink *rtnl,
 
         return 0;
 }
+
+int sd_netlink_set_overrun_handler(sd_netlink *rtnl, sd_netlink_overrun_handler_t callback, void *userdata) {
+        assert_return(rtnl, -EINVAL);
+        assert_return(!rtnl_pid_changed(rtnl), -ECHILD);
+
+        /* The callback is invoked from sd_netlink_process() after the kernel had to drop messages for us,
+         * so that whatever state was derived from notifications can be enumerated again */
+
+        rtnl->overrun_callback = callback;
+        rtnl->overrun_userdata = userdata;
+
+        return 0;
+}
+
+int sd_netlink_get_overruns(sd_netlink *rtnl, uint64_t *ret) {
+        assert_return(rtnl, -EINVAL);
+        assert_return(ret, -EINVAL);
+        assert_return(!rtnl_pid_changed(rtnl), -ECHILD);
+
+        *ret = rtnl->n_overruns;
+        return 0;
+}
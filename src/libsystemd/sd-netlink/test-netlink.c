@@ -13,6 +13,7 @@
 #include "ether-addr-util.h"
 #include "macro.h"
 #include "missing.h"
+#include "netlink-internal.h"
 #include "netlink-util.h"
 #include "socket-util.h"
 #include "string-util.h"
@@ -277,6 +278,104 @@ static void test_pipe(int ifindex) {
         assert_se((rtnl = sd_netlink_unref(rtnl)) == NULL);
 }
 
+static int batch_handler(sd_netlink *rtnl, sd_netlink_message *m, void *userdata) {
+        unsigned *counter = userdata;
+
+        assert_se(sd_netlink_message_get_errno(m) >= 0);
+        (*counter)--;
+
+        return 1;
+}
+
+static void test_batch(int ifindex) {
+        _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL, *r = NULL;
+        unsigned counter = 0, i;
+        uint16_t type;
+
+        assert_se(sd_netlink_open(&rtnl) >= 0);
+
+        assert_se(sd_netlink_batch_end(rtnl) == -EINVAL);
+
+        /* Batches nest, only the outermost end flushes. Keep the number of requests low, so that all the
+         * replies fit into the default receive buffer. */
+        assert_se(sd_netlink_batch_begin(rtnl) >= 0);
+        assert_se(sd_netlink_batch_begin(rtnl) >= 0);
+
+        for (i = 0; i < 20; i++) {
+                _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *q = NULL;
+
+                assert_se(sd_rtnl_message_new_link(rtnl, &q, RTM_GETLINK, ifindex) >= 0);
+                assert_se(sd_netlink_call_async(rtnl, q, batch_handler, &counter, 0, NULL) >= 0);
+                counter++;
+        }
+
+        /* A synchronous call in the middle of a batch must not wait for a request that was never sent */
+        assert_se(sd_rtnl_message_new_link(rtnl, &m, RTM_GETLINK, ifindex) >= 0);
+        assert_se(sd_netlink_call(rtnl, m, 0, &r) == 1);
+        assert_se(sd_netlink_message_get_type(r, &type) >= 0);
+        assert_se(type == RTM_NEWLINK);
+
+        assert_se(sd_netlink_batch_end(rtnl) >= 0);
+        assert_se(rtnl->wqueue_size == 0);
+        assert_se(sd_netlink_batch_end(rtnl) >= 0);
+        assert_se(rtnl->wqueue_size == 0);
+
+        while (counter > 0) {
+                assert_se(sd_netlink_wait(rtnl, 0) >= 0);
+                assert_se(sd_netlink_process(rtnl, NULL) >= 0);
+        }
+}
+
+static int overrun_handler(sd_netlink *rtnl, uint64_t n_overruns, void *userdata) {
+        uint64_t *seen = userdata;
+
+        assert_se(n_overruns > 0);
+        *seen = n_overruns;
+
+        return 0;
+}
+
+static void test_overrun(int ifindex) {
+        _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
+        uint64_t seen = 0, n;
+        int value = 0, before = 0, i;
+        socklen_t l = sizeof(value);
+
+        assert_se(sd_netlink_open(&rtnl) >= 0);
+        assert_se(sd_netlink_set_overrun_handler(rtnl, overrun_handler, &seen) >= 0);
+
+        /* Shrink the receive buffer as far as possible, and fire off more requests than replies fit in */
+        value = 1;
+        assert_se(setsockopt(rtnl->fd, SOL_SOCKET, SO_RCVBUF, &value, sizeof(value)) >= 0);
+        assert_se(getsockopt(rtnl->fd, SOL_SOCKET, SO_RCVBUF, &before, &l) >= 0);
+
+        for (i = 0; i < 16; i++) {
+                _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
+
+                assert_se(sd_rtnl_message_new_link(rtnl, &m, RTM_GETLINK, ifindex) >= 0);
+                assert_se(sd_netlink_send(rtnl, m, NULL) >= 0);
+        }
+
+        for (i = 0; i < 64 && seen == 0; i++) {
+                int r;
+
+                r = sd_netlink_process(rtnl, NULL);
+                assert_se(r >= 0);
+                if (r == 0)
+                        assert_se(sd_netlink_wait(rtnl, 100 * USEC_PER_MSEC) >= 0);
+        }
+
+        assert_se(sd_netlink_get_overruns(rtnl, &n) >= 0);
+        assert_se(n > 0);
+        assert_se(seen == n);
+
+        /* The receive buffer has been grown */
+        l = sizeof(value);
+        assert_se(getsockopt(rtnl->fd, SOL_SOCKET, SO_RCVBUF, &value, &l) >= 0);
+        assert_se(value > before);
+}
+
 static void test_container(sd_netlink *rtnl) {
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
         uint16_t u16_data;
@@ -390,6 +489,10 @@ int main(void) {
 
         test_pipe(if_loopback);
 
+        test_batch(if_loopback);
+
+        test_overrun(if_loopback);
+
         test_event_loop(if_loopback);
 
         test_link_configure(rtnl, if_loopback);
@@ -0,0 +1,490 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+***/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "network-state-db.h"
+#include "util.h"
+
+/* How often a reader retries copying a record that is being updated, before giving up and falling back to
+ * the state files */
+#define NETWORK_STATE_DB_READ_ATTEMPTS 8U
+
+struct NetworkStateDB {
+        int fd;
+        NetworkStateDBHeader *header;
+        int32_t *index;
+        bool changed;
+};
+
+/* Readers keep the database mapped between calls, and only check whether the file was replaced. There is one
+ * mapping per process, which is only accessed with cache_mutex held, and dropped when the library is
+ * unloaded. */
+static struct {
+        const NetworkStateDBHeader *header;
+        size_t size;
+        dev_t dev;
+        ino_t ino;
+} cache = {};
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const int32_t *header_index(const NetworkStateDBHeader *h) {
+        return (const int32_t*) ((const uint8_t*) h + h->header_size);
+}
+
+static const NetworkStateDBRecord *header_record(const NetworkStateDBHeader *h, size_t slot) {
+        return (const NetworkStateDBRecord*) ((const uint8_t*) header_index(h) +
+                                              h->n_records * sizeof(int32_t) +
+                                              slot * h->record_size);
+}
+
+static bool header_is_valid(const NetworkStateDBHeader *h, size_t size) {
+        uint64_t n;
+
+        assert(h);
+
+        if (size < sizeof(NetworkStateDBHeader))
+                return false;
+
+        if (memcmp(h->signature, NETWORK_STATE_DB_SIGNATURE, sizeof(h->signature)) != 0)
+                return false;
+
+        if (h->header_size < sizeof(NetworkStateDBHeader) ||
+            h->record_size < offsetof(NetworkStateDBRecord, data) ||
+            h->n_records == 0)
+                return false;
+
+        if (h->n_records > (size - h->header_size) / (sizeof(int32_t) + h->record_size))
+                return false;
+
+        n = h->header_size + h->n_records * (sizeof(int32_t) + h->record_size);
+        return n <= size;
+}
+
+static void cache_flush(void) {
+        if (cache.header)
+                (void) munmap((void*) cache.header, cache.size);
+
+        cache.header = NULL;
+        cache.size = 0;
+}
+
+static _destructor_ void cache_destroy(void) {
+        cache_flush();
+}
+
+static int db_map(const char *path, const NetworkStateDBHeader **ret) {
+        _cleanup_close_ int fd = -1;
+        struct stat st;
+        void *p;
+
+        assert(path);
+        assert(ret);
+
+        if (stat(path, &st) < 0)
+                return -errno;
+
+        if (cache.header &&
+            cache.dev == st.st_dev &&
+            cache.ino == st.st_ino &&
+            cache.size == (size_t) st.st_size) {
+
+                /* networkd invalidates the signature while it resets the database */
+                if (!header_is_valid(cache.header, cache.size))
+                        return -ENOENT;
+
+                *ret = cache.header;
+                return 0;
+        }
+
+        cache_flush();
+
+        fd = open(path, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        if (st.st_size < (off_t) sizeof(NetworkStateDBHeader))
+                return -ENOENT;
+
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        cache.header = p;
+        cache.size = st.st_size;
+        cache.dev = st.st_dev;
+        cache.ino = st.st_ino;
+
+        if (!header_is_valid(cache.header, cache.size))
+                return -ENOENT;
+
+        *ret = cache.header;
+        return 0;
+}
+
+static int db_read(const char *path, int ifindex, char **ret_data, size_t *ret_size, uint64_t *ret_seqnum) {
+        const NetworkStateDBHeader *h;
+        const NetworkStateDBRecord *record;
+        const int32_t *index;
+        unsigned attempt;
+        size_t slot;
+        int r;
+
+        assert(path);
+        assert(ifindex >= 0);
+        assert(ret_data);
+
+        r = db_map(path, &h);
+        if (r < 0)
+                return r;
+
+        index = header_index(h);
+
+        if (ifindex == 0)
+                slot = 0;
+        else {
+                for (slot = 1; slot < h->n_records; slot++)
+                        if (index[slot] == ifindex)
+                                break;
+
+                if (slot >= h->n_records)
+                        return -ENODATA;
+        }
+
+        record = header_record(h, slot);
+
+        for (attempt = 0; attempt < NETWORK_STATE_DB_READ_ATTEMPTS; attempt++) {
+                _cleanup_free_ char *data = NULL;
+                uint64_t seqnum;
+                uint32_t flags, size;
+
+                seqnum = record->seqnum;
+                if (seqnum == 0) {
+                        /* The global state has not been written yet? Otherwise we are racing with a writer */
+                        if (slot == 0 && h->seqnum == 0)
+                                return -ENODATA;
+                        continue;
+                }
+                __sync_synchronize();
+
+                flags = record->flags;
+                size = record->data_size;
+
+                if (record->ifindex != ifindex ||
+                    size > h->record_size - offsetof(NetworkStateDBRecord, data))
+                        continue;
+
+                data = memdup_suffix0(record->data, size);
+                if (!data)
+                        return -ENOMEM;
+                __sync_synchronize();
+
+                if (record->seqnum != seqnum)
+                        continue;
+
+                if (flags & NETWORK_STATE_DB_OVERFLOW)
+                        return -EFBIG;
+
+                *ret_data = TAKE_PTR(data);
+                if (ret_size)
+                        *ret_size = size;
+                if (ret_seqnum)
+                        *ret_seqnum = seqnum;
+                return 0;
+        }
+
+        return -EBUSY;
+}
+
+int network_state_db_read(const char *path, int ifindex, char **ret_data, size_t *ret_size, uint64_t *ret_seqnum) {
+        int r;
+
+        assert_se(pthread_mutex_lock(&cache_mutex) == 0);
+        r = db_read(path, ifindex, ret_data, ret_size, ret_seqnum);
+        assert_se(pthread_mutex_unlock(&cache_mutex) == 0);
+
+        return r;
+}
+
+static int link_compare(const void *a, const void *b) {
+        const NetworkStateDBLink *x = a, *y = b;
+
+        if (x->ifindex < y->ifindex)
+                return -1;
+        if (x->ifindex > y->ifindex)
+                return 1;
+
+        return 0;
+}
+
+static int db_list(const char *path, NetworkStateDBLink **ret, size_t *ret_n) {
+        _cleanup_free_ NetworkStateDBLink *links = NULL;
+        const NetworkStateDBHeader *h;
+        const int32_t *index;
+        size_t slot, n = 0, allocated = 0;
+        int r;
+
+        assert(path);
+        assert(ret);
+        assert(ret_n);
+
+        r = db_map(path, &h);
+        if (r < 0)
+                return r;
+
+        index = header_index(h);
+
+        for (slot = 1; slot < h->n_records; slot++) {
+                int32_t ifindex;
+
+                ifindex = index[slot];
+                if (ifindex <= 0)
+                        continue;
+
+                if (!GREEDY_REALLOC(links, allocated, n + 1))
+                        return -ENOMEM;
+
+                /* No need for the full protocol here, a torn read only makes the link look changed */
+                links[n++] = (NetworkStateDBLink) {
+                        .ifindex = ifindex,
+                        .seqnum = header_record(h, slot)->seqnum,
+                };
+        }
+
+        qsort_safe(links, n, sizeof(NetworkStateDBLink), link_compare);
+
+        *ret = TAKE_PTR(links);
+        *ret_n = n;
+        return 0;
+}
+
+int network_state_db_list(const char *path, NetworkStateDBLink **ret, size_t *ret_n) {
+        int r;
+
+        assert_se(pthread_mutex_lock(&cache_mutex) == 0);
+        r = db_list(path, ret, ret_n);
+        assert_se(pthread_mutex_unlock(&cache_mutex) == 0);
+
+        return r;
+}
+
+static NetworkStateDBRecord *db_record(NetworkStateDB *db, size_t slot) {
+        return (NetworkStateDBRecord*) header_record(db->header, slot);
+}
+
+int network_state_db_open(const char *path, NetworkStateDB **ret) {
+        _cleanup_(network_state_db_freep) NetworkStateDB *db = NULL;
+        NetworkStateDBHeader *h;
+        uint64_t seqnum = 0;
+        struct stat st;
+        size_t slot;
+        void *p;
+
+        assert(path);
+        assert(ret);
+
+        db = new0(NetworkStateDB, 1);
+        if (!db)
+                return -ENOMEM;
+
+        /* Reuse the file if it is there already, so that existing inotify watches and readers that still
+         * have it mapped keep working */
+        db->fd = open(path, O_RDWR|O_CREAT|O_CLOEXEC|O_NOCTTY, 0644);
+        if (db->fd < 0)
+                return -errno;
+
+        if (fstat(db->fd, &st) < 0)
+                return -errno;
+
+        /* Readers may have the file mapped, hence never shrink it, that would get them SIGBUS. Growing it is
+         * fine, the file is sparse. */
+        if (st.st_size < (off_t) NETWORK_STATE_DB_SIZE &&
+            ftruncate(db->fd, NETWORK_STATE_DB_SIZE) < 0)
+                return -errno;
+
+        p = mmap(NULL, NETWORK_STATE_DB_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, db->fd, 0);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        db->header = h = p;
+
+        if (header_is_valid(h, NETWORK_STATE_DB_SIZE) &&
+            h->header_size == sizeof(NetworkStateDBHeader) &&
+            h->record_size == sizeof(NetworkStateDBRecord) &&
+            h->n_records == NETWORK_STATE_DB_RECORDS_MAX)
+                /* Keep counting where the previous instance stopped, so that seqnums never go backwards
+                 * for readers */
+                seqnum = h->seqnum;
+
+        /* Invalidate the database while we reset it, readers will fall back to the state files meanwhile */
+        memzero(h->signature, sizeof(h->signature));
+        __sync_synchronize();
+
+        h->header_size = sizeof(NetworkStateDBHeader);
+        h->record_size = sizeof(NetworkStateDBRecord);
+        h->n_records = NETWORK_STATE_DB_RECORDS_MAX;
+        h->seqnum = seqnum;
+
+        db->index = (int32_t*) header_index(h);
+
+        /* Only touch the slots that are in use, so that we don't populate the whole file */
+        for (slot = 0; slot < NETWORK_STATE_DB_RECORDS_MAX; slot++)
+                if (slot == 0 || db->index[slot] != 0) {
+                        db->index[slot] = 0;
+                        db_record(db, slot)->seqnum = 0;
+                }
+        __sync_synchronize();
+
+        memcpy(h->signature, NETWORK_STATE_DB_SIGNATURE, sizeof(h->signature));
+        db->changed = true;
+
+        *ret = TAKE_PTR(db);
+        return 0;
+}
+
+NetworkStateDB *network_state_db_free(NetworkStateDB *db) {
+        if (!db)
+                return NULL;
+
+        if (db->header)
+                (void) munmap(db->header, NETWORK_STATE_DB_SIZE);
+
+        safe_close(db->fd);
+
+        return mfree(db);
+}
+
+static size_t db_find(NetworkStateDB *db, int ifindex) {
+        size_t slot;
+
+        if (ifindex == 0)
+                return 0;
+
+        for (slot = 1; slot < NETWORK_STATE_DB_RECORDS_MAX; slot++)
+                if (db->index[slot] == ifindex)
+                        return slot;
+
+        return (size_t) -1;
+}
+
+int network_state_db_update(NetworkStateDB *db, int ifindex, const char *data, size_t size) {
+        NetworkStateDBRecord *record;
+        bool overflow;
+        uint64_t seqnum;
+        size_t slot;
+
+        assert(db);
+        assert(ifindex >= 0);
+        assert(data || size == 0);
+
+        /* Returns 0 if the record did not change, 1 if it was updated, and -EFBIG or -ENOSPC if the data
+         * could not be stored, in which case the state file needs to be written. */
+
+        overflow = size > NETWORK_STATE_DB_DATA_MAX;
+
+        slot = db_find(db, ifindex);
+        if (slot != (size_t) -1) {
+                record = db_record(db, slot);
+
+                if (record->seqnum != 0) {
+                        if (record->flags & NETWORK_STATE_DB_OVERFLOW) {
+                                if (overflow)
+                                        return -EFBIG;
+                        } else if (!overflow &&
+                                   record->data_size == size &&
+                                   memcmp(record->data, data, size) == 0)
+                                return 0;
+                }
+        } else {
+                for (slot = 1; slot < NETWORK_STATE_DB_RECORDS_MAX; slot++)
+                        if (db->index[slot] == 0)
+                                break;
+
+                if (slot >= NETWORK_STATE_DB_RECORDS_MAX)
+                        return -ENOSPC;
+
+                record = db_record(db, slot);
+        }
+
+        record->seqnum = 0;
+        __sync_synchronize();
+
+        record->ifindex = ifindex;
+        record->flags = overflow ? NETWORK_STATE_DB_OVERFLOW : 0;
+        record->data_size = overflow ? 0 : size;
+        if (!overflow)
+                memcpy_safe(record->data, data, size);
+        __sync_synchronize();
+
+        seqnum = db->header->seqnum + 1;
+        record->seqnum = seqnum;
+        if (slot > 0)
+                db->index[slot] = ifindex;
+        __sync_synchronize();
+
+        db->header->seqnum = seqnum;
+        db->changed = true;
+
+        return overflow ? -EFBIG : 1;
+}
+
+int network_state_db_remove(NetworkStateDB *db, int ifindex) {
+        size_t slot;
+
+        assert(db);
+        assert(ifindex >= 0);
+
+        slot = db_find(db, ifindex);
+        if (slot == (size_t) -1)
+                return 0;
+
+        db_record(db, slot)->seqnum = 0;
+        __sync_synchronize();
+
+        if (slot > 0)
+                db->index[slot] = 0;
+        __sync_synchronize();
+
+        db->header->seqnum++;
+        db->changed = true;
+
+        return 1;
+}
+
+int network_state_db_flush(NetworkStateDB *db) {
+        uint64_t seqnum;
+        ssize_t n;
+
+        assert(db);
+
+        if (!db->changed)
+                return 0;
+
+        /* Stores through the mapping don't generate inotify events, hence write the header seqnum once more
+         * with an explicit write(), so that monitors get an IN_MODIFY event. */
+        seqnum = db->header->seqnum;
+
+        n = pwrite(db->fd, &seqnum, sizeof(seqnum), offsetof(NetworkStateDBHeader, seqnum));
+        if (n < 0)
+                return -errno;
+        if (n != sizeof(seqnum))
+                return -EIO;
+
+        db->changed = false;
+        return 1;
+}
@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+/***
+  This file is part of systemd.
+***/
+
+#include <stdint.h>
+
+#include "macro.h"
+
+/* The state database is a file networkd keeps mapped in /run, holding the same "KEY=value" text it writes to
+ * /run/systemd/netif/state and /run/systemd/netif/links/<ifindex>, so that readers can get at it without
+ * parsing a file, and networkd can update it without creating and renaming one on every change. The header
+ * is followed by an index of n_records ifindexes, and then by n_records fixed-size records. Slot 0 holds the
+ * global state, the others hold the state of the link whose ifindex is stored at the same position in the
+ * index, or are unused if that is 0.
+ *
+ * A record is updated by first setting its seqnum to 0, then writing the payload, and finally setting its
+ * seqnum to the header's seqnum, which is increased by one on every change. A reader hence copies the
+ * record, and checks that its seqnum is non-zero and matches before and after the copy. Records whose data
+ * did not fit are flagged with NETWORK_STATE_DB_OVERFLOW, in which case the state files are authoritative.
+ * After each batch of changes networkd rewrites the header seqnum with write(), so that an inotify
+ * IN_MODIFY watch on the database fires. The file is reset in place when networkd starts, and never shrunk,
+ * so that readers which have it mapped don't get SIGBUS, and inotify watches keep working. */
+
+#define NETWORK_STATE_DB_PATH "/run/systemd/netif/state.db"
+#define NETWORK_STATE_DB_SIGNATURE ((const char[8]) { 'S', 'D', 'N', 'E', 'T', 'D', 'B', '1' })
+#define NETWORK_STATE_DB_RECORDS_MAX 1024U
+#define NETWORK_STATE_DB_DATA_MAX (8192U - 24U)
+
+enum {
+        NETWORK_STATE_DB_OVERFLOW = 1U << 0,
+};
+
+typedef struct NetworkStateDBHeader {
+        uint8_t signature[8];
+        uint64_t header_size;
+        uint64_t record_size;
+        uint64_t n_records;
+        uint64_t seqnum;
+        uint8_t reserved[24];
+} NetworkStateDBHeader;
+
+typedef struct NetworkStateDBRecord {
+        uint64_t seqnum;
+        int32_t ifindex;
+        uint32_t flags;
+        uint32_t data_size;
+        uint32_t reserved;
+        char data[NETWORK_STATE_DB_DATA_MAX];
+} NetworkStateDBRecord;
+
+assert_cc(sizeof(NetworkStateDBHeader) == 64);
+assert_cc(sizeof(NetworkStateDBRecord) == 8192);
+
+#define NETWORK_STATE_DB_SIZE                                           \
+        (sizeof(NetworkStateDBHeader) +                                 \
+         NETWORK_STATE_DB_RECORDS_MAX * (sizeof(int32_t) + sizeof(NetworkStateDBRecord)))
+
+/* Reader side. Returns -ENOENT if the database is not available, and -ENODATA if it carries nothing for
+ * ifindex (0 for the global state). In both cases, as well as for -EFBIG (data overflowed) and -EBUSY
+ * (networkd kept updating the record under us), callers should fall back to the state files. */
+int network_state_db_read(const char *path, int ifindex, char **ret_data, size_t *ret_size, uint64_t *ret_seqnum);
+
+typedef struct NetworkStateDBLink {
+        int ifindex;
+        uint64_t seqnum;
+} NetworkStateDBLink;
+
+/* Returns the ifindexes of all links in the database together with the seqnums of their records, ordered by
+ * ifindex, so that callers can tell which links changed since they last looked. */
+int network_state_db_list(const char *path, NetworkStateDBLink **ret, size_t *ret_n);
+
+/* Writer side, only used by networkd */
+typedef struct NetworkStateDB NetworkStateDB;
+
+int network_state_db_open(const char *path, NetworkStateDB **ret);
+NetworkStateDB *network_state_db_free(NetworkStateDB *db);
+DEFINE_TRIVIAL_CLEANUP_FUNC(NetworkStateDB*, network_state_db_free);
+
+int network_state_db_update(NetworkStateDB *db, int ifindex, const char *data, size_t size);
+int network_state_db_remove(NetworkStateDB *db, int ifindex);
+int network_state_db_flush(NetworkStateDB *db);
@@ -8,6 +8,7 @@
 #include "alloc-util.h"
 #include "fd-util.h"
 #include "network-util.h"
+#include "string-table.h"
 #include "strv.h"
 
 bool network_is_online(void) {
@@ -23,3 +24,14 @@ bool network_is_online(void) {
 
         return false;
 }
+
+static const char* const link_operstate_table[_LINK_OPERSTATE_MAX] = {
+        [LINK_OPERSTATE_OFF] = "off",
+        [LINK_OPERSTATE_NO_CARRIER] = "no-carrier",
+        [LINK_OPERSTATE_DORMANT] = "dormant",
+        [LINK_OPERSTATE_CARRIER] = "carrier",
+        [LINK_OPERSTATE_DEGRADED] = "degraded",
+        [LINK_OPERSTATE_ROUTABLE] = "routable",
+};
+
+DEFINE_STRING_TABLE_LOOKUP(link_operstate, LinkOperationalState);
@@ -18,19 +18,45 @@
 #include "fileio.h"
 #include "fs-util.h"
 #include "macro.h"
+#include "network-state-db.h"
 #include "parse-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
 #include "strv.h"
 #include "util.h"
 
+/* Looks up key in the state networkd published for ifindex (0 for the global state), preferably from the state
+ * database, falling back to the state file at path. */
+static int network_parse_state(int ifindex, const char *path, const char *key, char **ret) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *data = NULL;
+        size_t size;
+        int r;
+
+        r = network_state_db_read(NETWORK_STATE_DB_PATH, ifindex, &data, &size, NULL);
+        if (IN_SET(r, -ENOENT, -ENODATA, -EFBIG, -EBUSY))
+                return parse_env_file(NULL, path, NEWLINE, key, ret, NULL);
+        if (r < 0)
+                return r;
+
+        /* fmemopen() refuses empty buffers */
+        if (size == 0)
+                return 0;
+
+        f = fmemopen(data, size, "re");
+        if (!f)
+                return -errno;
+
+        return parse_env_file(f, path, NEWLINE, key, ret, NULL);
+}
+
 _public_ int sd_network_get_operational_state(char **state) {
         _cleanup_free_ char *s = NULL;
         int r;
 
         assert_return(state, -EINVAL);
 
-        r = parse_env_file(NULL, "/run/systemd/netif/state", NEWLINE, "OPER_STATE", &s, NULL);
+        r = network_parse_state(0, "/run/systemd/netif/state", "OPER_STATE", &s);
         if (r == -ENOENT)
                 return -ENODATA;
         if (r < 0)
@@ -50,7 +76,7 @@ static int network_get_strv(const char *key, char ***ret) {
 
         assert_return(ret, -EINVAL);
 
-        r = parse_env_file(NULL, "/run/systemd/netif/state", NEWLINE, key, &s, NULL);
+        r = network_parse_state(0, "/run/systemd/netif/state", key, &s);
         if (r == -ENOENT)
                 return -ENODATA;
         if (r < 0)
@@ -98,7 +124,7 @@ static int network_link_get_string(int ifindex, const char *field, char **ret) {
 
         xsprintf(path, "/run/systemd/netif/links/%i", ifindex);
 
-        r = parse_env_file(NULL, path, NEWLINE, field, &s, NULL);
+        r = network_parse_state(ifindex, path, field, &s);
         if (r == -ENOENT)
                 return -ENODATA;
         if (r < 0)
@@ -121,7 +147,7 @@ static int network_link_get_strv(int ifindex, const char *key, char ***ret) {
         assert_return(ret, -EINVAL);
 
         xsprintf(path, "/run/systemd/netif/links/%i", ifindex);
-        r = parse_env_file(NULL, path, NEWLINE, key, &s, NULL);
+        r = network_parse_state(ifindex, path, key, &s);
         if (r == -ENOENT)
                 return -ENODATA;
         if (r < 0)
@@ -218,7 +244,7 @@ static int network_link_get_ifindexes(int ifindex, const char *key, int **ret) {
         assert_return(ret, -EINVAL);
 
         xsprintf(path, "/run/systemd/netif/links/%i", ifindex);
-        r = parse_env_file(NULL, path, NEWLINE, key, &s, NULL);
+        r = network_parse_state(ifindex, path, key, &s);
         if (r == -ENOENT)
                 return -ENODATA;
         if (r < 0)
@@ -259,21 +285,29 @@ _public_ int sd_network_link_get_carrier_bound_by(int ifindex, int **ret) {
         return network_link_get_ifindexes(ifindex, "CARRIER_BOUND_BY", ret);
 }
 
-static inline int MONITOR_TO_FD(sd_network_monitor *m) {
-        return (int) (unsigned long) m - 1;
-}
+struct sd_network_monitor {
+        int fd;
 
-static inline sd_network_monitor* FD_TO_MONITOR(int fd) {
-        return (sd_network_monitor*) (unsigned long) (fd + 1);
-}
+        /* The links in the state database and the seqnums of their records as of the last flush, so that
+         * a change of the database can be narrowed down to the links that actually changed */
+        NetworkStateDBLink *links;
+        size_t n_links;
+        bool have_links;
+};
 
 static int monitor_add_inotify_watch(int fd) {
         int k;
 
         k = inotify_add_watch(fd, "/run/systemd/netif/links/", IN_MOVED_TO|IN_DELETE);
-        if (k >= 0)
+        if (k >= 0) {
+                /* networkd creates the state database before the links directory, and updates it in
+                 * place. Older versions don't have one, the state files are all there is then. */
+                k = inotify_add_watch(fd, NETWORK_STATE_DB_PATH, IN_MODIFY);
+                if (k < 0 && errno != ENOENT)
+                        return -errno;
+
                 return 0;
-        else if (errno != ENOENT)
+        } else if (errno != ENOENT)
                 return -errno;
 
         k = inotify_add_watch(fd, "/run/systemd/netif/", IN_CREATE|IN_ISDIR);
@@ -289,19 +323,78 @@ static int monitor_add_inotify_watch(int fd) {
         return 0;
 }
 
+/* Takes a new snapshot of the state database. If ifindexes is non-NULL, the links which were added, removed or
+ * updated since the last snapshot are appended to it. Returns 0 if that could not be determined, in which case
+ * any link might have changed, and > 0 otherwise. */
+static int monitor_update_links(sd_network_monitor *m, int **ifindexes, size_t *n_ifindexes, size_t *allocated) {
+        _cleanup_free_ NetworkStateDBLink *links = NULL;
+        size_t n = 0, i = 0, j = 0;
+        bool had_links;
+        int r;
+
+        assert(m);
+
+        r = network_state_db_list(NETWORK_STATE_DB_PATH, &links, &n);
+        if (r == -ENOMEM)
+                return r;
+        had_links = m->have_links;
+
+        m->have_links = r >= 0;
+        if (r < 0) {
+                m->links = mfree(m->links);
+                m->n_links = 0;
+                return 0;
+        }
+
+        if (had_links && ifindexes)
+                /* Both lists are ordered by ifindex */
+                while (i < m->n_links || j < n) {
+                        int ifindex;
+
+                        if (j >= n || (i < m->n_links && m->links[i].ifindex < links[j].ifindex))
+                                ifindex = m->links[i++].ifindex;
+                        else if (i >= m->n_links || links[j].ifindex < m->links[i].ifindex)
+                                ifindex = links[j++].ifindex;
+                        else if (m->links[i++].seqnum != links[j].seqnum)
+                                ifindex = links[j++].ifindex;
+                        else {
+                                j++;
+                                continue;
+                        }
+
+                        if (!GREEDY_REALLOC(*ifindexes, *allocated, *n_ifindexes + 1))
+                                return -ENOMEM;
+
+                        (*ifindexes)[(*n_ifindexes)++] = ifindex;
+                }
+
+        free_and_replace(m->links, links);
+        m->n_links = n;
+
+        return had_links;
+}
+
 _public_ int sd_network_monitor_new(sd_network_monitor **m, const char *category) {
-        _cleanup_close_ int fd = -1;
+        _cleanup_(sd_network_monitor_unrefp) sd_network_monitor *monitor = NULL;
         int k;
         bool good = false;
 
         assert_return(m, -EINVAL);
 
-        fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
-        if (fd < 0)
+        monitor = new0(sd_network_monitor, 1);
+        if (!monitor)
+                return -ENOMEM;
+
+        monitor->fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+        if (monitor->fd < 0)
                 return -errno;
 
         if (!category || streq(category, "links")) {
-                k = monitor_add_inotify_watch(fd);
+                k = monitor_add_inotify_watch(monitor->fd);
+                if (k < 0)
+                        return k;
+
+                k = monitor_update_links(monitor, NULL, NULL, NULL);
                 if (k < 0)
                         return k;
 
@@ -311,61 +404,140 @@ _public_ int sd_network_monitor_new(sd_network_monitor **m, const char *category
         if (!good)
                 return -EINVAL;
 
-        *m = FD_TO_MONITOR(fd);
-        fd = -1;
+        *m = TAKE_PTR(monitor);
 
         return 0;
 }
 
 _public_ sd_network_monitor* sd_network_monitor_unref(sd_network_monitor *m) {
-        int fd;
+        if (!m)
+                return NULL;
 
-        if (m) {
-                fd = MONITOR_TO_FD(m);
-                close_nointr(fd);
-        }
+        safe_close(m->fd);
+        free(m->links);
 
-        return NULL;
+        return mfree(m);
 }
 
-_public_ int sd_network_monitor_flush(sd_network_monitor *m) {
+static int monitor_flush(sd_network_monitor *m, int **ifindexes, size_t *n_ifindexes) {
         union inotify_event_buffer buffer;
         struct inotify_event *e;
+        size_t allocated = 0;
+        bool all = false, db_changed = false;
         ssize_t l;
-        int fd, k;
+        int k;
 
-        assert_return(m, -EINVAL);
+        assert(m);
 
-        fd = MONITOR_TO_FD(m);
+        /* Returns 0 if any link might have changed, > 0 if the changed links are known. Only in the
+         * latter case they are collected in ifindexes, if that is non-NULL. */
 
-        l = read(fd, &buffer, sizeof(buffer));
+        l = read(m->fd, &buffer, sizeof(buffer));
         if (l < 0) {
                 if (IN_SET(errno, EAGAIN, EINTR))
-                        return 0;
+                        return 1;
 
                 return -errno;
         }
 
         FOREACH_INOTIFY_EVENT(e, buffer, l) {
+                int ifindex;
+
                 if (e->mask & IN_ISDIR) {
-                        k = monitor_add_inotify_watch(fd);
+                        k = monitor_add_inotify_watch(m->fd);
                         if (k < 0)
                                 return k;
 
-                        k = inotify_rm_watch(fd, e->wd);
+                        k = inotify_rm_watch(m->fd, e->wd);
                         if (k < 0)
                                 return -errno;
+
+                        /* The links directory just showed up, everything in it is new */
+                        all = true;
+                        continue;
+                }
+
+                if (e->mask & IN_Q_OVERFLOW) {
+                        all = true;
+                        continue;
+                }
+
+                /* The state database changed, or went away. It doesn't tell which links changed, that's
+                 * what the snapshot is for. */
+                if (e->len == 0) {
+                        if (e->mask & IN_MODIFY)
+                                db_changed = true;
+                        else
+                                all = true;
+                        continue;
                 }
+
+                if (all || !ifindexes)
+                        continue;
+
+                /* The state files are named after the interface index of the link */
+                if (safe_atoi(e->name, &ifindex) < 0 || ifindex <= 0)
+                        continue;
+
+                if (!GREEDY_REALLOC(*ifindexes, allocated, *n_ifindexes + 1))
+                        return -ENOMEM;
+
+                (*ifindexes)[(*n_ifindexes)++] = ifindex;
         }
 
+        /* Keep the snapshot current even if the result is "everything", so that the next flush only
+         * reports what changed after this one */
+        if (db_changed || all) {
+                k = monitor_update_links(m, all ? NULL : ifindexes, n_ifindexes, &allocated);
+                if (k < 0)
+                        return k;
+                if (k == 0)
+                        all = true;
+        }
+
+        return !all;
+}
+
+_public_ int sd_network_monitor_flush(sd_network_monitor *m) {
+        int r;
+
+        assert_return(m, -EINVAL);
+
+        r = monitor_flush(m, NULL, NULL);
+        if (r < 0)
+                return r;
+
         return 0;
 }
 
+_public_ int sd_network_monitor_flush_links(sd_network_monitor *m, int **ret_ifindexes, size_t *ret_n) {
+        _cleanup_free_ int *ifindexes = NULL;
+        size_t n = 0;
+        int r;
+
+        assert_return(m, -EINVAL);
+        assert_return(ret_ifindexes, -EINVAL);
+        assert_return(ret_n, -EINVAL);
+
+        r = monitor_flush(m, &ifindexes, &n);
+        if (r < 0)
+                return r;
+        if (r == 0) {
+                *ret_ifindexes = NULL;
+                *ret_n = 0;
+                return 0;
+        }
+
+        *ret_ifindexes = TAKE_PTR(ifindexes);
+        *ret_n = n;
+        return 1;
+}
+
 _public_ int sd_network_monitor_get_fd(sd_network_monitor *m) {
 
         assert_return(m, -EINVAL);
 
-        return MONITOR_TO_FD(m);
+        return m->fd;
 }
 
 _public_ int sd_network_monitor_get_events(sd_network_monitor *m) {
@@ -0,0 +1,149 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+***/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "network-state-db.h"
+#include "string-util.h"
+#include "util.h"
+
+static void test_read_write(void) {
+        _cleanup_(unlink_tempfilep) char p[] = "/tmp/test-network-state-db.XXXXXX";
+        _cleanup_(network_state_db_freep) NetworkStateDB *db = NULL;
+        _cleanup_close_ int fd = -1, inotify_fd = -1;
+        _cleanup_free_ NetworkStateDBLink *links = NULL;
+        _cleanup_free_ char *data = NULL, *big = NULL;
+        uint64_t seqnum, seqnum2;
+        size_t size, n_links;
+        struct stat st;
+        unsigned i;
+
+        fd = mkostemp_safe(p);
+        assert_se(fd >= 0);
+
+        /* Not a database yet */
+        assert_se(network_state_db_read(p, 1, &data, NULL, NULL) == -ENOENT);
+
+        assert_se(network_state_db_open(p, &db) >= 0);
+        assert_se(network_state_db_read(p, 0, &data, NULL, NULL) == -ENODATA);
+        assert_se(network_state_db_read(p, 1, &data, NULL, NULL) == -ENODATA);
+
+        assert_se(network_state_db_update(db, 0, "OPER_STATE=routable\n", 20) == 1);
+        assert_se(network_state_db_update(db, 1, "ADMIN_STATE=unmanaged\n", 22) == 1);
+        assert_se(network_state_db_update(db, 7, "ADMIN_STATE=configured\n", 23) == 1);
+
+        assert_se(network_state_db_read(p, 0, &data, &size, &seqnum) == 0);
+        assert_se(streq(data, "OPER_STATE=routable\n"));
+        assert_se(size == 20);
+        assert_se(seqnum == 1);
+        data = mfree(data);
+
+        assert_se(network_state_db_read(p, 7, &data, &size, &seqnum) == 0);
+        assert_se(streq(data, "ADMIN_STATE=configured\n"));
+        assert_se(seqnum == 3);
+        data = mfree(data);
+
+        /* Unchanged data must not bump the seqnum */
+        assert_se(network_state_db_update(db, 7, "ADMIN_STATE=configured\n", 23) == 0);
+        assert_se(network_state_db_read(p, 7, &data, NULL, &seqnum2) == 0);
+        assert_se(seqnum2 == seqnum);
+        data = mfree(data);
+
+        assert_se(network_state_db_update(db, 7, "ADMIN_STATE=failed\n", 19) == 1);
+        assert_se(network_state_db_read(p, 7, &data, NULL, &seqnum2) == 0);
+        assert_se(streq(data, "ADMIN_STATE=failed\n"));
+        assert_se(seqnum2 > seqnum);
+        data = mfree(data);
+
+        /* Data that does not fit is flagged, readers need to go to the file */
+        assert_se(big = malloc(NETWORK_STATE_DB_DATA_MAX + 1));
+        memset(big, 'x', NETWORK_STATE_DB_DATA_MAX + 1);
+        assert_se(network_state_db_update(db, 7, big, NETWORK_STATE_DB_DATA_MAX + 1) == -EFBIG);
+        assert_se(network_state_db_update(db, 7, big, NETWORK_STATE_DB_DATA_MAX + 1) == -EFBIG);
+        assert_se(network_state_db_read(p, 7, &data, NULL, NULL) == -EFBIG);
+        assert_se(network_state_db_update(db, 7, big, NETWORK_STATE_DB_DATA_MAX) == 1);
+        assert_se(network_state_db_read(p, 7, &data, &size, NULL) == 0);
+        assert_se(size == NETWORK_STATE_DB_DATA_MAX);
+        data = mfree(data);
+
+        assert_se(network_state_db_remove(db, 7) == 1);
+        assert_se(network_state_db_remove(db, 7) == 0);
+        assert_se(network_state_db_read(p, 7, &data, NULL, NULL) == -ENODATA);
+        assert_se(network_state_db_read(p, 1, &data, NULL, NULL) == 0);
+        assert_se(streq(data, "ADMIN_STATE=unmanaged\n"));
+        data = mfree(data);
+
+        /* Listing reports every link with the seqnum of its record */
+        assert_se(network_state_db_update(db, 9, "ADMIN_STATE=configuring\n", 24) == 1);
+        assert_se(network_state_db_read(p, 9, &data, NULL, &seqnum) == 0);
+        data = mfree(data);
+        assert_se(network_state_db_list(p, &links, &n_links) == 0);
+        assert_se(n_links == 2);
+        assert_se(links[0].ifindex == 1);
+        assert_se(links[1].ifindex == 9);
+        assert_se(links[1].seqnum == seqnum);
+        links = mfree(links);
+        assert_se(network_state_db_remove(db, 9) == 1);
+
+        /* Once all slots are used up, the caller has to write the files */
+        for (i = 2; i < NETWORK_STATE_DB_RECORDS_MAX; i++)
+                assert_se(network_state_db_update(db, 100 + i, "ADMIN_STATE=pending\n", 20) == 1);
+        assert_se(network_state_db_update(db, 10000, "ADMIN_STATE=pending\n", 20) == -ENOSPC);
+
+        /* Changes are announced with a single write to the file */
+        inotify_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+        assert_se(inotify_fd >= 0);
+        assert_se(inotify_add_watch(inotify_fd, p, IN_MODIFY) >= 0);
+
+        assert_se(network_state_db_flush(db) == 1);
+        assert_se(network_state_db_flush(db) == 0);
+        {
+                union inotify_event_buffer buffer;
+
+                assert_se(read(inotify_fd, &buffer, sizeof(buffer)) > 0);
+                assert_se(read(inotify_fd, &buffer, sizeof(buffer)) < 0 && errno == EAGAIN);
+        }
+
+        /* Reopening resets the database, but seqnums keep increasing */
+        assert_se(network_state_db_read(p, 1, &data, NULL, &seqnum) == 0);
+        data = mfree(data);
+        db = network_state_db_free(db);
+
+        assert_se(network_state_db_open(p, &db) >= 0);
+        assert_se(network_state_db_read(p, 1, &data, NULL, NULL) == -ENODATA);
+        assert_se(network_state_db_list(p, &links, &n_links) == 0);
+        assert_se(n_links == 0);
+        links = mfree(links);
+        assert_se(network_state_db_update(db, 1, "ADMIN_STATE=unmanaged\n", 22) == 1);
+        assert_se(network_state_db_read(p, 1, &data, NULL, &seqnum2) == 0);
+        assert_se(seqnum2 > seqnum);
+        db = network_state_db_free(db);
+
+        /* A file that isn't ours is reset in place, and never shrunk, as readers might have it mapped */
+        assert_se(ftruncate(fd, 0) == 0);
+        assert_se(ftruncate(fd, NETWORK_STATE_DB_SIZE * 2) == 0);
+        assert_se(network_state_db_open(p, &db) >= 0);
+        assert_se(fstat(fd, &st) == 0);
+        assert_se(st.st_size == (off_t) (NETWORK_STATE_DB_SIZE * 2));
+        assert_se(network_state_db_read(p, 1, &data, NULL, NULL) == -ENODATA);
+}
+
+int main(int argc, char *argv[]) {
+        log_set_max_level(LOG_DEBUG);
+        log_parse_environment();
+        log_open();
+
+        test_read_write();
+
+        return 0;
+}
@@ -30,10 +30,13 @@
 #include "process-util.h"
 
 #define WORKERS_MIN 1U
-#define WORKERS_MAX 16U
+#define WORKERS_MAX 64U
 #define QUERIES_MAX 256U
 #define BUFSIZE 10240U
 
+/* How many responses we process at most per wakeup of the event loop */
+#define RESPONSES_PER_WAKEUP 16U
+
 typedef enum {
         REQUEST_ADDRINFO,
         RESPONSE_ADDRINFO,
@@ -124,19 +127,11 @@ typedef struct AddrInfoResponse {
         int ret;
         int _errno;
         int _h_errno;
-        /* followed by addrinfo_serialization[] */
+        /* The workers are threads of the same process, hence we simply pass on what getaddrinfo() returned.
+         * Whoever receives the response owns it and releases it with freeaddrinfo(). */
+        struct addrinfo *addrinfo;
 } AddrInfoResponse;
 
-typedef struct AddrInfoSerialization {
-        int ai_flags;
-        int ai_family;
-        int ai_socktype;
-        int ai_protocol;
-        size_t ai_addrlen;
-        size_t canonname_len;
-        /* Followed by ai_addr amd ai_canonname with variable lengths */
-} AddrInfoSerialization;
-
 typedef struct NameInfoRequest {
         struct RHeader header;
         int flags;
@@ -190,37 +185,6 @@ static int send_died(int out_fd) {
         return 0;
 }
 
-static void *serialize_addrinfo(void *p, const struct addrinfo *ai, size_t *length, size_t maxlength) {
-        AddrInfoSerialization s;
-        size_t cnl, l;
-
-        assert(p);
-        assert(ai);
-        assert(length);
-        assert(*length <= maxlength);
-
-        cnl = ai->ai_canonname ? strlen(ai->ai_canonname)+1 : 0;
-        l = sizeof(AddrInfoSerialization) + ai->ai_addrlen + cnl;
-
-        if (*length + l > maxlength)
-                return NULL;
-
-        s.ai_flags = ai->ai_flags;
-        s.ai_family = ai->ai_family;
-        s.ai_socktype = ai->ai_socktype;
-        s.ai_protocol = ai->ai_protocol;
-        s.ai_addrlen = ai->ai_addrlen;
-        s.canonname_len = cnl;
-
-        memcpy((uint8_t*) p, &s, sizeof(AddrInfoSerialization));
-        memcpy((uint8_t*) p + sizeof(AddrInfoSerialization), ai->ai_addr, ai->ai_addrlen);
-        memcpy_safe((char*) p + sizeof(AddrInfoSerialization) + ai->ai_addrlen,
-                    ai->ai_canonname, cnl);
-
-        *length += l;
-        return (uint8_t*) p + l;
-}
-
 static int send_addrinfo_reply(
                 int out_fd,
                 unsigned id,
@@ -236,40 +200,19 @@ static int send_addrinfo_reply(
                 .ret = ret,
                 ._errno = _errno,
                 ._h_errno = _h_errno,
+                .addrinfo = ret == 0 ? ai : NULL,
         };
 
-        union {
-                AddrInfoSerialization ais;
-                uint8_t space[BUFSIZE];
-        } buffer;
-        struct iovec iov[2];
-        struct msghdr mh;
-
         assert(out_fd >= 0);
 
-        if (ret == 0 && ai) {
-                void *p = &buffer;
-                struct addrinfo *k;
-
-                for (k = ai; k; k = k->ai_next) {
-                        p = serialize_addrinfo(p, k, &resp.header.length, (uint8_t*) &buffer + BUFSIZE - (uint8_t*) p);
-                        if (!p) {
-                                freeaddrinfo(ai);
-                                return -ENOBUFS;
-                        }
-                }
-        }
-
-        if (ai)
+        if (ai && ret != 0)
                 freeaddrinfo(ai);
 
-        iov[0] = (struct iovec) { .iov_base = &resp, .iov_len = sizeof(AddrInfoResponse) };
-        iov[1] = (struct iovec) { .iov_base = &buffer, .iov_len = resp.header.length - sizeof(AddrInfoResponse) };
-
-        mh = (struct msghdr) { .msg_iov = iov, .msg_iovlen = ELEMENTSOF(iov) };
-
-        if (sendmsg(out_fd, &mh, MSG_NOSIGNAL) < 0)
+        if (send(out_fd, &resp, resp.header.length, MSG_NOSIGNAL) < 0) {
+                if (resp.addrinfo)
+                        freeaddrinfo(resp.addrinfo);
                 return -errno;
+        }
 
         return 0;
 }
@@ -583,6 +526,27 @@ static void resolve_free(sd_resolve *resolve) {
         for (i = 0; i < resolve->n_valid_workers; i++)
                 (void) pthread_join(resolve->workers[i], NULL);
 
+        /* Release the results nobody picked up */
+        if (resolve->fds[RESPONSE_RECV_FD] >= 0)
+                for (;;) {
+                        union {
+                                Packet packet;
+                                uint8_t space[BUFSIZE];
+                        } buf;
+                        ssize_t l;
+
+                        l = recv(resolve->fds[RESPONSE_RECV_FD], &buf, sizeof buf, MSG_DONTWAIT);
+                        if (l < 0 && errno == EINTR)
+                                continue;
+                        if (l <= 0)
+                                break;
+
+                        if ((size_t) l == sizeof(AddrInfoResponse) &&
+                            buf.packet.rheader.type == RESPONSE_ADDRINFO &&
+                            buf.packet.addrinfo_response.addrinfo)
+                                freeaddrinfo(buf.packet.addrinfo_response.addrinfo);
+                }
+
         /* Close all communication channels */
         close_many(resolve->fds, _FD_MAX);
         free(resolve);
@@ -684,63 +648,9 @@ static int complete_query(sd_resolve *resolve, sd_resolve_query *q) {
         return r;
 }
 
-static int unserialize_addrinfo(const void **p, size_t *length, struct addrinfo **ret_ai) {
-        AddrInfoSerialization s;
-        size_t l;
-        struct addrinfo *ai;
-
-        assert(p);
-        assert(*p);
-        assert(ret_ai);
-        assert(length);
-
-        if (*length < sizeof(AddrInfoSerialization))
-                return -EBADMSG;
-
-        memcpy(&s, *p, sizeof(s));
-
-        l = sizeof(AddrInfoSerialization) + s.ai_addrlen + s.canonname_len;
-        if (*length < l)
-                return -EBADMSG;
-
-        ai = new0(struct addrinfo, 1);
-        if (!ai)
-                return -ENOMEM;
-
-        ai->ai_flags = s.ai_flags;
-        ai->ai_family = s.ai_family;
-        ai->ai_socktype = s.ai_socktype;
-        ai->ai_protocol = s.ai_protocol;
-        ai->ai_addrlen = s.ai_addrlen;
-
-        if (s.ai_addrlen > 0) {
-                ai->ai_addr = memdup((const uint8_t*) *p + sizeof(AddrInfoSerialization), s.ai_addrlen);
-                if (!ai->ai_addr) {
-                        free(ai);
-                        return -ENOMEM;
-                }
-        }
-
-        if (s.canonname_len > 0) {
-                ai->ai_canonname = memdup((const uint8_t*) *p + sizeof(AddrInfoSerialization) + s.ai_addrlen, s.canonname_len);
-                if (!ai->ai_canonname) {
-                        free(ai->ai_addr);
-                        free(ai);
-                        return -ENOMEM;
-                }
-        }
-
-        *length -= l;
-        *ret_ai = ai;
-        *p = ((const uint8_t*) *p) + l;
-
-        return 0;
-}
-
 static int handle_response(sd_resolve *resolve, const Packet *packet, size_t length) {
         const RHeader *resp;
         sd_resolve_query *q;
-        int r;
 
         assert(resolve);
         assert(packet);
@@ -758,43 +668,23 @@ static int handle_response(sd_resolve *resolve, const Packet *packet, size_t len
         resolve->n_outstanding--;
 
         q = lookup_query(resolve, resp->id);
-        if (!q)
+        if (!q) {
+                /* Nobody wants the result anymore */
+                if (resp->type == RESPONSE_ADDRINFO && length >= sizeof(AddrInfoResponse) && packet->addrinfo_response.addrinfo)
+                        freeaddrinfo(packet->addrinfo_response.addrinfo);
                 return 0;
+        }
 
         switch (resp->type) {
 
         case RESPONSE_ADDRINFO: {
                 const AddrInfoResponse *ai_resp = &packet->addrinfo_response;
-                const void *p;
-                size_t l;
-                struct addrinfo *prev = NULL;
 
-                assert_return(length >= sizeof(AddrInfoResponse), -EBADMSG);
+                assert_return(length == sizeof(AddrInfoResponse), -EBADMSG);
                 assert_return(q->type == REQUEST_ADDRINFO, -EBADMSG);
 
                 query_assign_errno(q, ai_resp->ret, ai_resp->_errno, ai_resp->_h_errno);
-
-                l = length - sizeof(AddrInfoResponse);
-                p = (const uint8_t*) resp + sizeof(AddrInfoResponse);
-
-                while (l > 0 && p) {
-                        struct addrinfo *ai = NULL;
-
-                        r = unserialize_addrinfo(&p, &l, &ai);
-                        if (r < 0) {
-                                query_assign_errno(q, EAI_SYSTEM, r, 0);
-                                freeaddrinfo(q->addrinfo);
-                                q->addrinfo = NULL;
-                                break;
-                        }
-
-                        if (prev)
-                                prev->ai_next = ai;
-                        else
-                                q->addrinfo = ai;
-
-                        prev = ai;
-                }
+                q->addrinfo = ai_resp->addrinfo;
 
                 return complete_query(resolve, q);
         }
@@ -1080,17 +970,6 @@ _public_ sd_resolve_query* sd_resolve_query_ref(sd_resolve_query *q) {
         return q;
 }
 
-static void resolve_freeaddrinfo(struct addrinfo *ai) {
-        while (ai) {
-                struct addrinfo *next = ai->ai_next;
-
-                free(ai->ai_addr);
-                free(ai->ai_canonname);
-                free(ai);
-                ai = next;
-        }
-}
-
 static void resolve_query_disconnect(sd_resolve_query *q) {
         sd_resolve *resolve;
         unsigned i;
@@ -1124,7 +1003,8 @@ static void resolve_query_free(sd_resolve_query *q) {
 
         resolve_query_disconnect(q);
 
-        resolve_freeaddrinfo(q->addrinfo);
+        if (q->addrinfo)
+                freeaddrinfo(q->addrinfo);
         free(q->host);
         free(q->serv);
         free(q);
@@ -1178,13 +1058,20 @@ _public_ sd_resolve *sd_resolve_query_get_resolve(sd_resolve_query *q) {
 
 static int io_callback(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
         sd_resolve *resolve = userdata;
+        RESOLVE_DONT_DESTROY(resolve); /* The callbacks might drop the last reference to us */
+        unsigned i;
         int r;
 
         assert(resolve);
 
-        r = sd_resolve_process(resolve);
-        if (r < 0)
-                return r;
+        /* Reap whatever the workers have finished meanwhile, up to a limit */
+        for (i = 0; i < RESPONSES_PER_WAKEUP; i++) {
+                r = sd_resolve_process(resolve);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+        }
 
         return 1;
 }
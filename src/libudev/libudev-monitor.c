@@ -6,6 +6,7 @@
 ***/
 
 #include <errno.h>
+#include <fnmatch.h>
 #include <linux/filter.h>
 #include <linux/netlink.h>
 #include <poll.h>
@@ -25,6 +26,7 @@
 #include "libudev-private.h"
 #include "missing.h"
 #include "mount-util.h"
+#include "MurmurHash2.h"
 #include "socket-util.h"
 #include "string-util.h"
 
@@ -50,6 +52,8 @@ struct udev_monitor {
         socklen_t addrlen;
         struct udev_list filter_subsystem_list;
         struct udev_list filter_tag_list;
+        struct udev_list filter_property_list;
+        struct udev_list filter_sysname_list;
         bool bound;
 };
 
@@ -60,6 +64,17 @@ enum udev_monitor_netlink_group {
 };
 
 #define UDEV_MONITOR_MAGIC                0xfeedcafe
+
+/* Properties, as "KEY=value", and all prefixes of the sysname up to UDEV_MONITOR_SYSNAME_PREFIX_MAX
+ * characters are added to a bloom filter in the header, setting UDEV_MONITOR_BLOOM_K bits each, so that
+ * property and sysname matches can be executed in the kernel too. Both use different hash seeds. */
+#define UDEV_MONITOR_BLOOM_WORDS          16U
+#define UDEV_MONITOR_BLOOM_BITS           (UDEV_MONITOR_BLOOM_WORDS * 32U)
+#define UDEV_MONITOR_BLOOM_K              3U
+#define UDEV_MONITOR_BLOOM_SEED_PROPERTY  0U
+#define UDEV_MONITOR_BLOOM_SEED_SYSNAME   1U
+#define UDEV_MONITOR_SYSNAME_PREFIX_MAX   16U
+
 struct udev_monitor_netlink_header {
         /* "libudev" prefix to distinguish libudev and kernel messages */
         char prefix[8];
@@ -81,8 +96,15 @@ struct udev_monitor_netlink_header {
         unsigned int filter_devtype_hash;
         unsigned int filter_tag_bloom_hi;
         unsigned int filter_tag_bloom_lo;
+        /*
+         * bloom filter of properties and sysname prefixes, only present if header_size
+         * covers it; values need to be stored in network order
+         */
+        unsigned int filter_bloom[UDEV_MONITOR_BLOOM_WORDS];
 };
 
+assert_cc(UDEV_MONITOR_BLOOM_BITS == 1U << 9);
+
 static struct udev_monitor *udev_monitor_new(struct udev *udev) {
         struct udev_monitor *udev_monitor;
 
@@ -95,6 +117,8 @@ static struct udev_monitor *udev_monitor_new(struct udev *udev) {
         udev_monitor->udev = udev;
         udev_list_init(udev, &udev_monitor->filter_subsystem_list, false);
         udev_list_init(udev, &udev_monitor->filter_tag_list, true);
+        udev_list_init(udev, &udev_monitor->filter_property_list, false);
+        udev_list_init(udev, &udev_monitor->filter_sysname_list, true);
         return udev_monitor;
 }
 
@@ -265,6 +289,54 @@ static inline void bpf_jmp(struct sock_filter *inss, unsigned int *i,
         (*i)++;
 }
 
+/* The length of a bloom filter check generated by bpf_bloom_match() */
+#define BPF_BLOOM_MATCH_LEN (UDEV_MONITOR_BLOOM_K * 3 + 1)
+
+static void bloom_bits(const void *p, size_t n, unsigned seed, unsigned bits[static UDEV_MONITOR_BLOOM_K]) {
+        uint32_t hash = MurmurHash2(p, n, seed);
+        unsigned k;
+
+        for (k = 0; k < UDEV_MONITOR_BLOOM_K; k++)
+                bits[k] = (hash >> (9 * k)) & (UDEV_MONITOR_BLOOM_BITS - 1);
+}
+
+static void bloom_add(uint32_t bloom[static UDEV_MONITOR_BLOOM_WORDS], const void *p, size_t n, unsigned seed) {
+        unsigned bits[UDEV_MONITOR_BLOOM_K], k;
+
+        bloom_bits(p, n, seed, bits);
+        for (k = 0; k < UDEV_MONITOR_BLOOM_K; k++)
+                bloom[bits[k] / 32] |= 1U << (bits[k] % 32);
+}
+
+/* Checks whether all bits of the string are set in the bloom filter of the header. If so, jumps over the
+ * @remaining checks of the same kind that follow, and the statement dropping the packet after them. */
+static void bpf_bloom_match(struct sock_filter *ins, unsigned int *i,
+                            const void *p, size_t n, unsigned seed, unsigned remaining)
+{
+        unsigned bits[UDEV_MONITOR_BLOOM_K], k;
+
+        bloom_bits(p, n, seed, bits);
+        for (k = 0; k < UDEV_MONITOR_BLOOM_K; k++) {
+                uint32_t mask = 1U << (bits[k] % 32);
+
+                /* load bloom word in A */
+                bpf_stmt(ins, i, BPF_LD|BPF_W|BPF_ABS,
+                         offsetof(struct udev_monitor_netlink_header, filter_bloom) + bits[k] / 32 * 4);
+                /* clear all other bits */
+                bpf_stmt(ins, i, BPF_ALU|BPF_AND|BPF_K, mask);
+                /* jump to next check if bit is not set */
+                bpf_jmp(ins, i, BPF_JMP|BPF_JEQ|BPF_K, mask, 0, (UDEV_MONITOR_BLOOM_K - 1 - k) * 3 + 1);
+        }
+
+        /* all bits set, jump behind end of block */
+        bpf_stmt(ins, i, BPF_JMP|BPF_JA, remaining * BPF_BLOOM_MATCH_LEN + 1);
+}
+
+static size_t sysname_prefix_len(const char *sysname) {
+        /* The part of a sysname glob that every matching sysname starts with */
+        return MIN(strcspn(sysname, GLOB_CHARS "\\"), UDEV_MONITOR_SYSNAME_PREFIX_MAX);
+}
+
 /**
  * udev_monitor_filter_update:
  * @udev_monitor: monitor
@@ -278,12 +350,14 @@ _public_ int udev_monitor_filter_update(struct udev_monitor *udev_monitor)
 {
         struct sock_filter ins[512];
         struct sock_fprog filter;
-        unsigned int i;
+        unsigned int i, sysname_matches, property_matches;
         struct udev_list_entry *list_entry;
         int err;
 
         if (udev_list_get_entry(&udev_monitor->filter_subsystem_list) == NULL &&
-            udev_list_get_entry(&udev_monitor->filter_tag_list) == NULL)
+            udev_list_get_entry(&udev_monitor->filter_tag_list) == NULL &&
+            udev_list_get_entry(&udev_monitor->filter_property_list) == NULL &&
+            udev_list_get_entry(&udev_monitor->filter_sysname_list) == NULL)
                 return 0;
 
         memzero(ins, sizeof(ins));
@@ -330,6 +404,70 @@ _public_ int udev_monitor_filter_update(struct udev_monitor *udev_monitor)
                 bpf_stmt(ins, &i, BPF_RET|BPF_K, 0);
         }
 
+        /* Sysname globs can only be checked if all of them start with a literal prefix. Properties are
+         * always checked, unless there are too many of them. */
+        sysname_matches = 0;
+        udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_monitor->filter_sysname_list)) {
+                if (sysname_prefix_len(udev_list_entry_get_name(list_entry)) == 0) {
+                        sysname_matches = 0;
+                        break;
+                }
+                sysname_matches++;
+        }
+
+        property_matches = 0;
+        udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_monitor->filter_property_list))
+                property_matches++;
+
+        if ((sysname_matches + property_matches) * BPF_BLOOM_MATCH_LEN + 16 > ELEMENTSOF(ins) - i) {
+                sysname_matches = 0;
+                property_matches = 0;
+        }
+
+        if (sysname_matches > 0 || property_matches > 0) {
+                unsigned int skip;
+
+                /* The bloom filter is only there if the header was sent by a sender knowing about
+                 * it. Note that header_size is stored in host order, unlike the other fields. */
+                bpf_stmt(ins, &i, BPF_LD|BPF_W|BPF_ABS, offsetof(struct udev_monitor_netlink_header, header_size));
+                /* jump if the header contains the bloom filter */
+                bpf_jmp(ins, &i, BPF_JMP|BPF_JEQ|BPF_K, be32toh(sizeof(struct udev_monitor_netlink_header)), 1, 0);
+                /* no bloom filter, skip its checks, the filter is applied when the device is received */
+                skip = i;
+                bpf_stmt(ins, &i, BPF_JMP|BPF_JA, 0);
+
+                /* add all sysname matches */
+                if (sysname_matches > 0) {
+                        udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_monitor->filter_sysname_list)) {
+                                const char *sysname = udev_list_entry_get_name(list_entry);
+
+                                bpf_bloom_match(ins, &i, sysname, sysname_prefix_len(sysname),
+                                                UDEV_MONITOR_BLOOM_SEED_SYSNAME, --sysname_matches);
+                        }
+
+                        /* nothing matched, drop packet */
+                        bpf_stmt(ins, &i, BPF_RET|BPF_K, 0);
+                }
+
+                /* add all property matches */
+                if (property_matches > 0) {
+                        udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_monitor->filter_property_list)) {
+                                const char *property;
+
+                                property = strjoina(udev_list_entry_get_name(list_entry), "=",
+                                                    udev_list_entry_get_value(list_entry));
+
+                                bpf_bloom_match(ins, &i, property, strlen(property),
+                                                UDEV_MONITOR_BLOOM_SEED_PROPERTY, --property_matches);
+                        }
+
+                        /* nothing matched, drop packet */
+                        bpf_stmt(ins, &i, BPF_RET|BPF_K, 0);
+                }
+
+                ins[skip].k = i - skip - 1;
+        }
+
         /* add all subsystem matches */
         if (udev_list_get_entry(&udev_monitor->filter_subsystem_list) != NULL) {
                 udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_monitor->filter_subsystem_list)) {
@@ -480,6 +618,8 @@ _public_ struct udev_monitor *udev_monitor_unref(struct udev_monitor *udev_monit
                 close(udev_monitor->sock);
         udev_list_cleanup(&udev_monitor->filter_subsystem_list);
         udev_list_cleanup(&udev_monitor->filter_tag_list);
+        udev_list_cleanup(&udev_monitor->filter_property_list);
+        udev_list_cleanup(&udev_monitor->filter_sysname_list);
         return mfree(udev_monitor);
 }
 
@@ -541,11 +681,35 @@ static int passes_filter(struct udev_monitor *udev_monitor, struct udev_device *
 
 tag:
         if (udev_list_get_entry(&udev_monitor->filter_tag_list) == NULL)
-                return 1;
+                goto sysname;
         udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_monitor->filter_tag_list)) {
                 const char *tag = udev_list_entry_get_name(list_entry);
 
                 if (udev_device_has_tag(udev_device, tag))
+                        goto sysname;
+        }
+        return 0;
+
+sysname:
+        if (udev_list_get_entry(&udev_monitor->filter_sysname_list) == NULL)
+                goto property;
+        udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_monitor->filter_sysname_list)) {
+                const char *sysname = udev_list_entry_get_name(list_entry);
+                const char *dsysname = udev_device_get_sysname(udev_device);
+
+                if (dsysname && fnmatch(sysname, dsysname, 0) == 0)
+                        goto property;
+        }
+        return 0;
+
+property:
+        if (udev_list_get_entry(&udev_monitor->filter_property_list) == NULL)
+                return 1;
+        udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_monitor->filter_property_list)) {
+                const char *key = udev_list_entry_get_name(list_entry);
+                const char *value = udev_list_entry_get_value(list_entry);
+
+                if (streq_ptr(udev_device_get_property_value(udev_device, key), value))
                         return 1;
         }
         return 0;
@@ -731,6 +895,10 @@ int udev_monitor_send_device(struct udev_monitor *udev_monitor,
         };
         struct udev_list_entry *list_entry;
         uint64_t tag_bloom_bits;
+        uint32_t bloom[UDEV_MONITOR_BLOOM_WORDS] = {};
+        const char *p;
+        size_t l;
+        unsigned k;
 
         blen = udev_device_get_properties_monitor_buf(udev_device, &buf);
         if (blen < 32) {
@@ -755,6 +923,20 @@ int udev_monitor_send_device(struct udev_monitor *udev_monitor,
                 nlh.filter_tag_bloom_lo = htobe32(tag_bloom_bits & 0xffffffff);
         }
 
+        /* add property and sysname bloom filter */
+        for (p = buf; p < buf + blen && *p; p += l + 1) {
+                l = strnlen(p, buf + blen - p);
+                bloom_add(bloom, p, l, UDEV_MONITOR_BLOOM_SEED_PROPERTY);
+        }
+
+        val = udev_device_get_sysname(udev_device);
+        if (val != NULL)
+                for (l = 1; l <= MIN(strlen(val), UDEV_MONITOR_SYSNAME_PREFIX_MAX); l++)
+                        bloom_add(bloom, val, l, UDEV_MONITOR_BLOOM_SEED_SYSNAME);
+
+        for (k = 0; k < UDEV_MONITOR_BLOOM_WORDS; k++)
+                nlh.filter_bloom[k] = htobe32(bloom[k]);
+
         /* add properties list */
         nlh.properties_off = iov[0].iov_len;
         nlh.properties_len = blen;
@@ -832,6 +1014,53 @@ _public_ int udev_monitor_filter_add_match_tag(struct udev_monitor *udev_monitor
         return 0;
 }
 
+/**
+ * udev_monitor_filter_add_match_property:
+ * @udev_monitor: the monitor
+ * @property: the name of a property
+ * @value: the value the property needs to have
+ *
+ * Like the other matches, this filter is usually executed inside the kernel. Devices pass if any of the
+ * property matches matches.
+ *
+ * The filter must be installed before the monitor is switched to listening mode.
+ *
+ * Returns: 0 on success, otherwise a negative error value.
+ */
+int udev_monitor_filter_add_match_property(struct udev_monitor *udev_monitor, const char *property, const char *value)
+{
+        if (udev_monitor == NULL)
+                return -EINVAL;
+        if (property == NULL || value == NULL)
+                return -EINVAL;
+        if (udev_list_entry_add(&udev_monitor->filter_property_list, property, value) == NULL)
+                return -ENOMEM;
+        return 0;
+}
+
+/**
+ * udev_monitor_filter_add_match_sysname:
+ * @udev_monitor: the monitor
+ * @sysname: a shell glob the sysname needs to match
+ *
+ * Like the other matches, this filter is usually executed inside the kernel, as long as all sysname
+ * globs start with a literal prefix. Devices pass if any of the sysname matches matches.
+ *
+ * The filter must be installed before the monitor is switched to listening mode.
+ *
+ * Returns: 0 on success, otherwise a negative error value.
+ */
+int udev_monitor_filter_add_match_sysname(struct udev_monitor *udev_monitor, const char *sysname)
+{
+        if (udev_monitor == NULL)
+                return -EINVAL;
+        if (sysname == NULL)
+                return -EINVAL;
+        if (udev_list_entry_add(&udev_monitor->filter_sysname_list, sysname, NULL) == NULL)
+                return -ENOMEM;
+        return 0;
+}
+
 /**
  * udev_monitor_filter_remove:
  * @udev_monitor: monitor
@@ -845,6 +1074,8 @@ _public_ int udev_monitor_filter_remove(struct udev_monitor *udev_monitor)
         static const struct sock_fprog filter = { 0, NULL };
 
         udev_list_cleanup(&udev_monitor->filter_subsystem_list);
+        udev_list_cleanup(&udev_monitor->filter_property_list);
+        udev_list_cleanup(&udev_monitor->filter_sysname_list);
         if (setsockopt(udev_monitor->sock, SOL_SOCKET, SO_ATTACH_FILTER, &filter, sizeof(filter)) < 0)
                 return -errno;
 
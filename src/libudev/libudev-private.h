@@ -68,6 +68,8 @@ int udev_monitor_allow_unicast_sender(struct udev_monitor *udev_monitor, struct
 int udev_monitor_send_device(struct udev_monitor *udev_monitor,
                              struct udev_monitor *destination, struct udev_device *udev_device);
 struct udev_monitor *udev_monitor_new_from_netlink_fd(struct udev *udev, const char *name, int fd);
+int udev_monitor_filter_add_match_property(struct udev_monitor *udev_monitor, const char *property, const char *value);
+int udev_monitor_filter_add_match_sysname(struct udev_monitor *udev_monitor, const char *sysname);
 
 /* libudev-list.c */
 struct udev_list_node {
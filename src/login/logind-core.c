@@ -17,9 +17,12 @@
 #include "cgroup-util.h"
 #include "conf-parser.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "logind.h"
+#include "mkdir.h"
 #include "parse-util.h"
 #include "process-util.h"
+#include "siphash24.h"
 #include "strv.h"
 #include "terminal-util.h"
 #include "udev-util.h"
@@ -412,6 +415,43 @@ int manager_get_idle_hint(Manager *m, dual_timestamp *t) {
         return idle_hint;
 }
 
+int manager_write_state_file(const char *directory, const char *path, const char *contents, size_t size, uint64_t *last_hash) {
+        /* Any fixed key will do, the hash never leaves the process */
+        static const uint8_t key[16] = {
+                0x3b, 0x91, 0x0e, 0xd4, 0x57, 0xa2, 0x6c, 0x18,
+                0xe9, 0x40, 0x7f, 0x25, 0xb3, 0xc6, 0x0a, 0x8d,
+        };
+        uint64_t h;
+        int r;
+
+        assert(directory);
+        assert(path);
+        assert(contents);
+        assert(last_hash);
+
+        /* Sessions, users and seats are saved on pretty much every change, even if nothing that ends up in the
+         * state file changed. Rewriting the file anyway costs a temporary file and a rename() each time, and
+         * wakes up every sd-login client watching the directory. Hence skip it if the contents are the same as
+         * what we wrote last time. Returns 0 in that case, and 1 if the file was written. */
+
+        h = siphash24(contents, size, key);
+        if (*last_hash == h && access(path, F_OK) >= 0)
+                return 0;
+
+        *last_hash = 0;
+
+        r = mkdir_safe_label(directory, 0755, 0, 0, MKDIR_WARN_MODE);
+        if (r < 0)
+                return r;
+
+        r = write_string_file(path, contents, WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC|WRITE_STRING_FILE_AVOID_NEWLINE);
+        if (r < 0)
+                return r;
+
+        *last_hash = h;
+        return 1;
+}
+
 bool manager_shall_kill(Manager *m, const char *user) {
         assert(m);
         assert(user);
@@ -19,7 +19,6 @@
 #include "format-util.h"
 #include "logind-acl.h"
 #include "logind-seat.h"
-#include "mkdir.h"
 #include "parse-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
@@ -73,8 +72,9 @@ void seat_free(Seat *s) {
 }
 
 int seat_save(Seat *s) {
-        _cleanup_free_ char *temp_path = NULL;
+        _cleanup_free_ char *contents = NULL;
         _cleanup_fclose_ FILE *f = NULL;
+        size_t size = 0;
         int r;
 
         assert(s);
@@ -82,16 +82,13 @@ int seat_save(Seat *s) {
         if (!s->started)
                 return 0;
 
-        r = mkdir_safe_label("/run/systemd/seats", 0755, 0, 0, MKDIR_WARN_MODE);
-        if (r < 0)
-                goto fail;
-
-        r = fopen_temporary(s->state_file, &f, &temp_path);
-        if (r < 0)
+        f = open_memstream(&contents, &size);
+        if (!f) {
+                r = -ENOMEM;
                 goto fail;
+        }
 
         (void) __fsetlocking(f, FSETLOCKING_BYCALLER);
-        (void) fchmod(fileno(f), 0644);
 
         fprintf(f,
                 "# This is private data. Do not parse.\n"
@@ -137,18 +134,17 @@ int seat_save(Seat *s) {
         if (r < 0)
                 goto fail;
 
-        if (rename(temp_path, s->state_file) < 0) {
-                r = -errno;
+        f = safe_fclose(f);
+
+        r = manager_write_state_file("/run/systemd/seats", s->state_file, contents, size, &s->state_file_hash);
+        if (r < 0)
                 goto fail;
-        }
 
         return 0;
 
 fail:
         (void) unlink(s->state_file);
-
-        if (temp_path)
-                (void) unlink(temp_path);
+        s->state_file_hash = 0;
 
         return log_error_errno(r, "Failed to save seat data %s: %m", s->state_file);
 }
@@ -441,6 +437,7 @@ int seat_stop(Seat *s, bool force) {
         seat_stop_sessions(s, force);
 
         unlink(s->state_file);
+        s->state_file_hash = 0;
         seat_add_to_gc_queue(s);
 
         if (s->started)
@@ -17,6 +17,7 @@ struct Seat {
         char *id;
 
         char *state_file;
+        uint64_t state_file_hash;
 
         LIST_HEAD(Device, devices);
 
@@ -10,6 +10,7 @@
 #include <linux/kd.h>
 #include <linux/vt.h>
 #include <signal.h>
+#include <stdio_ext.h>
 #include <string.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
@@ -155,8 +156,9 @@ static void session_save_devices(Session *s, FILE *f) {
 }
 
 int session_save(Session *s) {
-        _cleanup_free_ char *temp_path = NULL;
+        _cleanup_free_ char *contents = NULL;
         _cleanup_fclose_ FILE *f = NULL;
+        size_t size = 0;
         int r = 0;
 
         assert(s);
@@ -167,18 +169,16 @@ int session_save(Session *s) {
         if (!s->started)
                 return 0;
 
-        r = mkdir_safe_label("/run/systemd/sessions", 0755, 0, 0, MKDIR_WARN_MODE);
-        if (r < 0)
+        f = open_memstream(&contents, &size);
+        if (!f) {
+                r = -ENOMEM;
                 goto fail;
+        }
 
-        r = fopen_temporary(s->state_file, &f, &temp_path);
-        if (r < 0)
-                goto fail;
+        (void) __fsetlocking(f, FSETLOCKING_BYCALLER);
 
         assert(s->user);
 
-        fchmod(fileno(f), 0644);
-
         fprintf(f,
                 "# This is private data. Do not parse.\n"
                 "UID="UID_FMT"\n"
@@ -291,18 +291,17 @@ int session_save(Session *s) {
         if (r < 0)
                 goto fail;
 
-        if (rename(temp_path, s->state_file) < 0) {
-                r = -errno;
+        f = safe_fclose(f);
+
+        r = manager_write_state_file("/run/systemd/sessions", s->state_file, contents, size, &s->state_file_hash);
+        if (r < 0)
                 goto fail;
-        }
 
         return 0;
 
 fail:
         (void) unlink(s->state_file);
-
-        if (temp_path)
-                (void) unlink(temp_path);
+        s->state_file_hash = 0;
 
         return log_error_errno(r, "Failed to save session data %s: %m", s->state_file);
 }
@@ -733,6 +732,7 @@ int session_finalize(Session *s) {
                 session_device_free(sd);
 
         (void) unlink(s->state_file);
+        s->state_file_hash = 0;
         session_add_to_gc_queue(s);
         user_add_to_gc_queue(s->user);
 
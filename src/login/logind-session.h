@@ -61,6 +61,7 @@ struct Session {
         SessionClass class;
 
         char *state_file;
+        uint64_t state_file_hash;
 
         User *user;
 
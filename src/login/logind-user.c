@@ -24,7 +24,6 @@
 #include "hashmap.h"
 #include "label.h"
 #include "logind-user.h"
-#include "mkdir.h"
 #include "parse-util.h"
 #include "path-util.h"
 #include "rm-rf.h"
@@ -119,23 +118,21 @@ User *user_free(User *u) {
 }
 
 static int user_save_internal(User *u) {
-        _cleanup_free_ char *temp_path = NULL;
+        _cleanup_free_ char *contents = NULL;
         _cleanup_fclose_ FILE *f = NULL;
+        size_t size = 0;
         int r;
 
         assert(u);
         assert(u->state_file);
 
-        r = mkdir_safe_label("/run/systemd/users", 0755, 0, 0, MKDIR_WARN_MODE);
-        if (r < 0)
-                goto fail;
-
-        r = fopen_temporary(u->state_file, &f, &temp_path);
-        if (r < 0)
+        f = open_memstream(&contents, &size);
+        if (!f) {
+                r = -ENOMEM;
                 goto fail;
+        }
 
         (void) __fsetlocking(f, FSETLOCKING_BYCALLER);
-        (void) fchmod(fileno(f), 0644);
 
         fprintf(f,
                 "# This is private data. Do not parse.\n"
@@ -255,18 +252,17 @@ static int user_save_internal(User *u) {
         if (r < 0)
                 goto fail;
 
-        if (rename(temp_path, u->state_file) < 0) {
-                r = -errno;
+        f = safe_fclose(f);
+
+        r = manager_write_state_file("/run/systemd/users", u->state_file, contents, size, &u->state_file_hash);
+        if (r < 0)
                 goto fail;
-        }
 
         return 0;
 
 fail:
         (void) unlink(u->state_file);
-
-        if (temp_path)
-                (void) unlink(temp_path);
+        u->state_file_hash = 0;
 
         return log_error_errno(r, "Failed to save user data %s: %m", u->state_file);
 }
@@ -486,6 +482,7 @@ int user_finalize(User *u) {
         }
 
         unlink(u->state_file);
+        u->state_file_hash = 0;
         user_add_to_gc_queue(u);
 
         if (u->started) {
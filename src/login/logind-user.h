@@ -30,6 +30,7 @@ struct User {
         gid_t gid;
         char *name;
         char *state_file;
+        uint64_t state_file_hash;
         char *runtime_path;
         char *slice;
         char *service;
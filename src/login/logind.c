@@ -22,6 +22,7 @@
 #include "fd-util.h"
 #include "format-util.h"
 #include "fs-util.h"
+#include "libudev-private.h"
 #include "logind.h"
 #include "parse-util.h"
 #include "process-util.h"
@@ -948,6 +949,10 @@ static int manager_connect_udev(Manager *m) {
                 if (r < 0)
                         return r;
 
+                r = udev_monitor_filter_add_match_sysname(m->udev_vcsa_monitor, "vcsa*");
+                if (r < 0)
+                        return r;
+
                 r = udev_monitor_enable_receiving(m->udev_vcsa_monitor);
                 if (r < 0)
                         return r;
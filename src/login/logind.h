@@ -146,6 +146,8 @@ int manager_spawn_autovt(Manager *m, unsigned int vtnr);
 
 bool manager_shall_kill(Manager *m, const char *user);
 
+int manager_write_state_file(const char *directory, const char *path, const char *contents, size_t size, uint64_t *last_hash);
+
 int manager_get_idle_hint(Manager *m, dual_timestamp *t);
 
 int manager_get_user_by_pid(Manager *m, pid_t pid, User **user);
@@ -235,6 +235,9 @@ int bus_image_method_mark_read_only(
         if (r < 0)
                 return r;
 
+        /* Not all ways of marking an image read-only are visible to inotify */
+        manager_flush_image_discovery(m);
+
         return sd_bus_reply_method_return(message, NULL);
 }
 
@@ -466,8 +469,9 @@ char *image_bus_path(const char *name) {
 }
 
 int image_node_enumerator(sd_bus *bus, const char *path, void *userdata, char ***nodes, sd_bus_error *error) {
-        _cleanup_(image_hashmap_freep) Hashmap *images = NULL;
         _cleanup_strv_free_ char **l = NULL;
+        Manager *m = userdata;
+        Hashmap *images;
         Image *image;
         Iterator i;
         int r;
@@ -475,12 +479,9 @@ int image_node_enumerator(sd_bus *bus, const char *path, void *userdata, char **
         assert(bus);
         assert(path);
         assert(nodes);
+        assert(m);
 
-        images = hashmap_new(&string_hash_ops);
-        if (!images)
-                return -ENOMEM;
-
-        r = image_discover(IMAGE_MACHINE, images);
+        r = manager_discover_images(m, &images);
         if (r < 0)
                 return r;
 
@@ -7,6 +7,8 @@
 
 #include <errno.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
 #include <unistd.h>
 
 #include "sd-daemon.h"
@@ -26,6 +28,9 @@
 #include "signal-util.h"
 #include "special.h"
 
+/* How long to use the cached image discovery at most, see manager_discover_images() */
+#define IMAGE_DISCOVERY_CACHE_USEC (5*USEC_PER_SEC)
+
 static Manager* manager_unref(Manager *m);
 DEFINE_TRIVIAL_CLEANUP_FUNC(Manager*, manager_unref);
 
@@ -39,6 +44,8 @@ static int manager_new(Manager **ret) {
         if (!m)
                 return -ENOMEM;
 
+        m->image_inotify_fd = -1;
+
         m->machines = hashmap_new(&string_hash_ops);
         m->machine_units = hashmap_new(&string_hash_ops);
         m->machine_leaders = hashmap_new(NULL);
@@ -86,6 +93,8 @@ static Manager* manager_unref(Manager *m) {
 
         sd_event_source_unref(m->image_cache_defer_event);
 
+        manager_flush_image_discovery(m);
+
         bus_verify_polkit_async_registry_free(m->polkit_registry);
 
         sd_bus_unref(m->bus);
@@ -94,6 +103,80 @@ static Manager* manager_unref(Manager *m) {
         return mfree(m);
 }
 
+void manager_flush_image_discovery(Manager *m) {
+        assert(m);
+
+        m->image_discovery = image_hashmap_free(m->image_discovery);
+        m->image_inotify_event_source = sd_event_source_unref(m->image_inotify_event_source);
+        m->image_inotify_fd = safe_close(m->image_inotify_fd);
+}
+
+static int manager_dispatch_image_inotify(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+
+        /* Something changed in one of the image directories. Drop the cached discovery, and the watches with it.
+         * They are set up anew with the next discovery, which then also covers directories created since. */
+        manager_flush_image_discovery(m);
+
+        return 0;
+}
+
+int manager_discover_images(Manager *m, Hashmap **ret) {
+        _cleanup_(image_hashmap_freep) Hashmap *images = NULL;
+        _cleanup_close_ int fd = -1;
+        usec_t n;
+        int r;
+
+        assert(m);
+        assert(ret);
+
+        /* Returns the images in the search path, in a hashmap owned by the manager that is only valid until the
+         * event loop runs again. Discovering images is expensive: each one is stat()ed, and subvolumes have their
+         * quota queried and block devices are opened. Hence cache the result until the directories change. The
+         * disk usage of an image may change without any inotify event, so don't keep it for too long either. */
+
+        n = now(CLOCK_MONOTONIC);
+
+        if (m->image_discovery && n < usec_add(m->image_discovery_timestamp, IMAGE_DISCOVERY_CACHE_USEC)) {
+                *ret = m->image_discovery;
+                return 0;
+        }
+
+        manager_flush_image_discovery(m);
+
+        /* Set up the watches first, so that we don't miss changes done while we look at the directories */
+        fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+
+        r = image_watch_search_path(IMAGE_MACHINE, fd);
+        if (r < 0)
+                return r;
+
+        images = hashmap_new(&string_hash_ops);
+        if (!images)
+                return -ENOMEM;
+
+        r = image_discover(IMAGE_MACHINE, images);
+        if (r < 0)
+                return r;
+
+        r = sd_event_add_io(m->event, &m->image_inotify_event_source, fd, EPOLLIN, manager_dispatch_image_inotify, m);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(m->image_inotify_event_source, "image-inotify");
+
+        m->image_inotify_fd = TAKE_FD(fd);
+        m->image_discovery = TAKE_PTR(images);
+        m->image_discovery_timestamp = n;
+
+        *ret = m->image_discovery;
+        return 0;
+}
+
 static int manager_add_host_machine(Manager *m) {
         _cleanup_free_ char *rd = NULL, *unit = NULL;
         sd_id128_t mid;
@@ -35,6 +35,12 @@ struct Manager {
         Hashmap *image_cache;
         sd_event_source *image_cache_defer_event;
 
+        /* The result of the last image discovery, valid until the inotify watches fire, or it gets too old */
+        Hashmap *image_discovery;
+        usec_t image_discovery_timestamp;
+        int image_inotify_fd;
+        sd_event_source *image_inotify_event_source;
+
         LIST_HEAD(Machine, machine_gc_queue);
 
         Machine *host_machine;
@@ -44,6 +50,9 @@ struct Manager {
 };
 
 int manager_add_machine(Manager *m, const char *name, Machine **_machine);
+
+int manager_discover_images(Manager *m, Hashmap **ret);
+void manager_flush_image_discovery(Manager *m);
 int manager_get_machine_by_pid(Manager *m, pid_t pid, Machine **machine);
 
 extern const sd_bus_vtable manager_vtable[];
@@ -11,18 +11,27 @@
 #include <limits.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
+#include "alloc-util.h"
 #include "conf-files.h"
 #include "def.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "log.h"
+#include "hashmap.h"
 #include "module-util.h"
 #include "proc-cmdline.h"
+#include "process-util.h"
+#include "set.h"
 #include "string-util.h"
 #include "strv.h"
+#include "time-util.h"
 #include "util.h"
 
+/* Upper bound for the number of modules we insert at the same time */
+#define MODULES_LOAD_JOBS_MAX 8U
+
 static char **arg_proc_cmdline_modules = NULL;
 
 static const char conf_file_dirs[] = CONF_PATHS_NULSTR("modules-load.d");
@@ -123,12 +132,264 @@ static int load_module(struct kmod_ctx *ctx, const char *m) {
         return r;
 }
 
-static int apply_file(struct kmod_ctx *ctx, const char *path, bool ignore_enoent) {
-        _cleanup_fclose_ FILE *f = NULL;
+static int load_module_timed(struct kmod_ctx *ctx, const char *m) {
+        char ts[FORMAT_TIMESPAN_MAX];
+        usec_t start;
+        int r;
+
+        start = now(CLOCK_MONOTONIC);
+        r = load_module(ctx, m);
+        log_debug("Processed '%s' in %s.", m, format_timespan(ts, sizeof(ts), now(CLOCK_MONOTONIC) - start, 1));
+
+        return r;
+}
+
+static int collect_dependencies(struct kmod_module *mod, Set *names) {
+        _cleanup_(kmod_module_unref_listp) struct kmod_list *deps = NULL, *pre = NULL, *post = NULL;
+        struct kmod_list *l[3], *itr;
+        unsigned i;
         int r;
 
+        assert(mod);
+        assert(names);
+
+        r = set_put_strdup(names, kmod_module_get_name(mod));
+        if (r <= 0)
+                return r;
+
+        deps = kmod_module_get_dependencies(mod);
+        (void) kmod_module_get_softdeps(mod, &pre, &post);
+
+        l[0] = deps;
+        l[1] = pre;
+        l[2] = post;
+
+        for (i = 0; i < ELEMENTSOF(l); i++)
+                kmod_list_foreach(itr, l[i]) {
+                        _cleanup_(kmod_module_unrefp) struct kmod_module *dep = NULL;
+
+                        dep = kmod_module_get_module(itr);
+                        r = collect_dependencies(dep, names);
+                        if (r < 0)
+                                return r;
+                }
+
+        return 0;
+}
+
+static unsigned group_find(unsigned *parent, unsigned i) {
+        while (parent[i] != i)
+                i = parent[i] = parent[parent[i]];
+
+        return i;
+}
+
+static int assign_jobs(struct kmod_ctx *ctx, char **modules, unsigned n, unsigned *job, unsigned *ret_n_jobs) {
+        _cleanup_free_ unsigned *parent = NULL;
+        Hashmap *owners = NULL;
+        unsigned i, n_groups = 0, n_jobs, k = 0;
+        char *name;
+        long ncpus;
+        int r = 0;
+
+        assert(ctx);
+        assert(modules);
+        assert(job);
+        assert(ret_n_jobs);
+
+        /* Modules that share a dependency, directly or through a soft dependency, are loaded one after the
+         * other by the same job, in the order they were listed in. Otherwise two jobs would try to insert the
+         * same dependency at the same time, and one of them would just wait for the other in the kernel. */
+
+        parent = new(unsigned, n);
+        if (!parent)
+                return log_oom();
+
+        for (i = 0; i < n; i++)
+                parent[i] = i;
+
+        owners = hashmap_new(&string_hash_ops);
+        if (!owners)
+                return log_oom();
+
+        for (i = 0; i < n; i++) {
+                _cleanup_(kmod_module_unref_listp) struct kmod_list *modlist = NULL;
+                _cleanup_set_free_free_ Set *names = NULL;
+                struct kmod_list *itr;
+                Iterator it;
+                void *v;
+
+                /* Lookup failures are reported when the module is loaded, keep it in a group of its own */
+                if (kmod_module_new_from_lookup(ctx, modules[i], &modlist) < 0 || !modlist)
+                        continue;
+
+                names = set_new(&string_hash_ops);
+                if (!names) {
+                        r = log_oom();
+                        goto finish;
+                }
+
+                kmod_list_foreach(itr, modlist) {
+                        _cleanup_(kmod_module_unrefp) struct kmod_module *mod = NULL;
+
+                        mod = kmod_module_get_module(itr);
+                        r = collect_dependencies(mod, names);
+                        if (r < 0) {
+                                log_oom();
+                                goto finish;
+                        }
+                }
+
+                SET_FOREACH(name, names, it) {
+                        _cleanup_free_ char *c = NULL;
+
+                        v = hashmap_get(owners, name);
+                        if (v) {
+                                unsigned a, b;
+
+                                a = group_find(parent, i);
+                                b = group_find(parent, PTR_TO_UINT(v) - 1);
+                                parent[MAX(a, b)] = MIN(a, b);
+                                continue;
+                        }
+
+                        c = strdup(name);
+                        if (!c) {
+                                r = log_oom();
+                                goto finish;
+                        }
+
+                        r = hashmap_put(owners, c, UINT_TO_PTR(i + 1));
+                        if (r < 0) {
+                                log_oom();
+                                goto finish;
+                        }
+                        c = NULL;
+                }
+        }
+
+        for (i = 0; i < n; i++)
+                if (group_find(parent, i) == i)
+                        n_groups++;
+
+        ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_jobs = MIN3(n_groups, ncpus > 0 ? (unsigned) ncpus : 1U, MODULES_LOAD_JOBS_MAX);
+
+        /* The root of each group is its first module, hence this assigns the groups to the jobs in turn, in
+         * the order they were listed in */
+        for (i = 0; i < n; i++) {
+                unsigned g;
+
+                g = group_find(parent, i);
+                if (g == i)
+                        job[i] = k++ % n_jobs;
+                else
+                        job[i] = job[g];
+        }
+
+        log_debug("Loading %u modules in %u groups with %u jobs.", n, n_groups, n_jobs);
+
+        *ret_n_jobs = n_jobs;
+        r = 0;
+
+finish:
+        while ((name = hashmap_steal_first_key(owners)))
+                free(name);
+        hashmap_free(owners);
+
+        return r;
+}
+
+static int load_modules_of_job(struct kmod_ctx *ctx, char **modules, unsigned n, const unsigned *job, unsigned j) {
+        unsigned i;
+        int r = 0, k;
+
+        for (i = 0; i < n; i++) {
+                if (job[i] != j)
+                        continue;
+
+                k = load_module_timed(ctx, modules[i]);
+                if (k < 0 && r == 0)
+                        r = k;
+        }
+
+        return r;
+}
+
+static int load_modules(struct kmod_ctx *ctx, char **modules) {
+        _cleanup_free_ unsigned *job = NULL;
+        _cleanup_free_ pid_t *pids = NULL;
+        char ts[FORMAT_TIMESPAN_MAX];
+        unsigned n, n_jobs = 1, j;
+        usec_t start;
+        int r = 0, k;
+
         assert(ctx);
+
+        n = strv_length(modules);
+        if (n == 0)
+                return 0;
+
+        start = now(CLOCK_MONOTONIC);
+
+        job = new0(unsigned, n);
+        if (!job)
+                return log_oom();
+
+        if (n > 1) {
+                r = assign_jobs(ctx, modules, n, job, &n_jobs);
+                if (r < 0)
+                        return r;
+        }
+
+        if (n_jobs <= 1) {
+                r = load_modules_of_job(ctx, modules, n, job, 0);
+                goto finish;
+        }
+
+        pids = new0(pid_t, n_jobs);
+        if (!pids)
+                return log_oom();
+
+        /* libkmod is not thread-safe, hence every job gets a process, inheriting the context with its
+         * indexes already loaded */
+        for (j = 0; j < n_jobs; j++) {
+                k = safe_fork("(modules-load)", FORK_DEATHSIG|FORK_LOG, pids + j);
+                if (k == 0) {
+                        k = load_modules_of_job(ctx, modules, n, job, j);
+                        _exit(k < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+                }
+                if (k < 0) {
+                        /* Do it ourselves then */
+                        pids[j] = 0;
+                        k = load_modules_of_job(ctx, modules, n, job, j);
+                        if (k < 0 && r == 0)
+                                r = k;
+                }
+        }
+
+        for (j = 0; j < n_jobs; j++) {
+                if (pids[j] <= 0)
+                        continue;
+
+                k = wait_for_terminate_and_check("(modules-load)", pids[j], WAIT_LOG_ABNORMAL);
+                if (k < 0 && r == 0)
+                        r = k;
+                else if (k != EXIT_SUCCESS && r == 0)
+                        r = -EPROTO;
+        }
+
+finish:
+        log_debug("Loaded %u modules in %s.", n, format_timespan(ts, sizeof(ts), now(CLOCK_MONOTONIC) - start, 1));
+        return r;
+}
+
+static int parse_file(const char *path, bool ignore_enoent, char ***modules) {
+        _cleanup_fclose_ FILE *f = NULL;
+        int r;
+
         assert(path);
+        assert(modules);
 
         r = search_and_fopen_nulstr(path, "re", NULL, conf_file_dirs, &f);
         if (r < 0) {
@@ -141,7 +402,6 @@ static int apply_file(struct kmod_ctx *ctx, const char *path, bool ignore_enoent
         log_debug("apply: %s", path);
         for (;;) {
                 char line[LINE_MAX], *l;
-                int k;
 
                 if (!fgets(line, sizeof(line), f)) {
                         if (feof(f))
@@ -156,9 +416,8 @@ static int apply_file(struct kmod_ctx *ctx, const char *path, bool ignore_enoent
                 if (strchr(COMMENTS "\n", *l))
                         continue;
 
-                k = load_module(ctx, l);
-                if (k < 0 && r == 0)
-                        r = k;
+                if (strv_extend(modules, l) < 0)
+                        return log_oom();
         }
 
         return r;
@@ -213,6 +472,7 @@ static int parse_argv(int argc, char *argv[]) {
 int main(int argc, char *argv[]) {
         int r, k;
         _cleanup_(kmod_unrefp) struct kmod_ctx *ctx = NULL;
+        _cleanup_strv_free_ char **modules = NULL;
 
         r = parse_argv(argc, argv);
         if (r <= 0)
@@ -239,23 +499,23 @@ int main(int argc, char *argv[]) {
 
         r = 0;
 
+        /* First collect everything, so that the modules can be scheduled with their dependencies in mind */
         if (argc > optind) {
                 int i;
 
                 for (i = optind; i < argc; i++) {
-                        k = apply_file(ctx, argv[i], false);
+                        k = parse_file(argv[i], false, &modules);
                         if (k < 0 && r == 0)
                                 r = k;
                 }
 
         } else {
                 _cleanup_strv_free_ char **files = NULL;
-                char **fn, **i;
+                char **fn;
 
-                STRV_FOREACH(i, arg_proc_cmdline_modules) {
-                        k = load_module(ctx, *i);
-                        if (k < 0 && r == 0)
-                                r = k;
+                if (strv_extend_strv(&modules, arg_proc_cmdline_modules, false) < 0) {
+                        r = log_oom();
+                        goto finish;
                 }
 
                 k = conf_files_list_nulstr(&files, ".conf", NULL, 0, conf_file_dirs);
@@ -263,16 +523,20 @@ int main(int argc, char *argv[]) {
                         log_error_errno(k, "Failed to enumerate modules-load.d files: %m");
                         if (r == 0)
                                 r = k;
-                        goto finish;
-                }
-
-                STRV_FOREACH(fn, files) {
-                        k = apply_file(ctx, *fn, true);
-                        if (k < 0 && r == 0)
-                                r = k;
-                }
+                } else
+                        STRV_FOREACH(fn, files) {
+                                k = parse_file(*fn, true, &modules);
+                                if (k < 0 && r == 0)
+                                        r = k;
+                        }
         }
 
+        strv_uniq(modules);
+
+        k = load_modules(ctx, modules);
+        if (k < 0 && r == 0)
+                r = k;
+
 finish:
         strv_free(arg_proc_cmdline_modules);
 
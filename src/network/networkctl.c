@@ -21,6 +21,7 @@
 #include "device-util.h"
 #include "ether-addr-util.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "hwdb-util.h"
 #include "local-addresses.h"
 #include "locale-util.h"
@@ -29,7 +30,6 @@
 #include "pager.h"
 #include "parse-util.h"
 #include "socket-util.h"
-#include "sparse-endian.h"
 #include "stdio-util.h"
 #include "string-table.h"
 #include "string-util.h"
@@ -606,78 +606,54 @@ static int list_address_labels(int argc, char *argv[], void *userdata) {
         return 0;
 }
 
-static int open_lldp_neighbors(int ifindex, FILE **ret) {
-        _cleanup_free_ char *p = NULL;
-        FILE *f;
+static sd_lldp_neighbor **lldp_neighbors_free(sd_lldp_neighbor **l, int n) {
+        int i;
 
-        if (asprintf(&p, "/run/systemd/netif/lldp/%i", ifindex) < 0)
-                return -ENOMEM;
-
-        f = fopen(p, "re");
-        if (!f)
-                return -errno;
+        for (i = 0; i < n; i++)
+                sd_lldp_neighbor_unref(l[i]);
 
-        *ret = f;
-        return 0;
+        return mfree(l);
 }
 
-static int next_lldp_neighbor(FILE *f, sd_lldp_neighbor **ret) {
-        _cleanup_free_ void *raw = NULL;
-        size_t l;
-        le64_t u;
+static int acquire_lldp_neighbors(int ifindex, sd_lldp_neighbor ***ret) {
+        _cleanup_free_ char *p = NULL, *data = NULL;
+        size_t size;
         int r;
 
-        assert(f);
         assert(ret);
 
-        l = fread(&u, 1, sizeof(u), f);
-        if (l == 0 && feof(f))
-                return 0;
-        if (l != sizeof(u))
-                return -EBADMSG;
-
-        raw = new(uint8_t, le64toh(u));
-        if (!raw)
+        if (asprintf(&p, "/run/systemd/netif/lldp/%i", ifindex) < 0)
                 return -ENOMEM;
 
-        if (fread(raw, 1, le64toh(u), f) != le64toh(u))
-                return -EBADMSG;
-
-        r = sd_lldp_neighbor_from_raw(ret, raw, le64toh(u));
+        /* Read and parse all neighbors in one go */
+        r = read_full_file(p, &data, &size);
         if (r < 0)
                 return r;
 
-        return 1;
+        return sd_lldp_neighbors_from_raw(ret, data, size);
 }
 
 static int dump_lldp_neighbors(const char *prefix, int ifindex) {
-        _cleanup_fclose_ FILE *f = NULL;
-        int r, c = 0;
+        sd_lldp_neighbor **l = NULL;
+        int c, n;
 
         assert(prefix);
         assert(ifindex > 0);
 
-        r = open_lldp_neighbors(ifindex, &f);
-        if (r < 0)
-                return r;
+        n = acquire_lldp_neighbors(ifindex, &l);
+        if (n < 0)
+                return n;
 
-        for (;;) {
+        for (c = 0; c < n; c++) {
                 const char *system_name = NULL, *port_id = NULL, *port_description = NULL;
-                _cleanup_(sd_lldp_neighbor_unrefp) sd_lldp_neighbor *n = NULL;
-
-                r = next_lldp_neighbor(f, &n);
-                if (r < 0)
-                        return r;
-                if (r == 0)
-                        break;
 
                 printf("%*s",
                        (int) strlen(prefix),
                        c == 0 ? prefix : "");
 
-                (void) sd_lldp_neighbor_get_system_name(n, &system_name);
-                (void) sd_lldp_neighbor_get_port_id_as_string(n, &port_id);
-                (void) sd_lldp_neighbor_get_port_description(n, &port_description);
+                (void) sd_lldp_neighbor_get_system_name(l[c], &system_name);
+                (void) sd_lldp_neighbor_get_port_id_as_string(l[c], &port_id);
+                (void) sd_lldp_neighbor_get_port_description(l[c], &port_description);
 
                 printf("%s on port %s", strna(system_name), strna(port_id));
 
@@ -685,11 +661,11 @@ static int dump_lldp_neighbors(const char *prefix, int ifindex) {
                         printf(" (%s)", port_description);
 
                 putchar('\n');
-
-                c++;
         }
 
-        return c;
+        lldp_neighbors_free(l, n);
+
+        return n;
 }
 
 static void dump_ifindexes(const char *prefix, const int *ifindexes) {
@@ -990,30 +966,23 @@ static int link_lldp_status(int argc, char *argv[], void *userdata) {
                        "PORT DESCRIPTION");
 
         for (i = 0; i < c; i++) {
-                _cleanup_fclose_ FILE *f = NULL;
+                sd_lldp_neighbor **l = NULL;
+                int j, k;
 
-                r = open_lldp_neighbors(links[i].ifindex, &f);
-                if (r == -ENOENT)
+                k = acquire_lldp_neighbors(links[i].ifindex, &l);
+                if (k == -ENOENT)
                         continue;
-                if (r < 0) {
-                        log_warning_errno(r, "Failed to open LLDP data for %i, ignoring: %m", links[i].ifindex);
+                if (k < 0) {
+                        log_warning_errno(k, "Failed to read LLDP data for %i, ignoring: %m", links[i].ifindex);
                         continue;
                 }
 
-                for (;;) {
+                for (j = 0; j < k; j++) {
                         _cleanup_free_ char *cid = NULL, *pid = NULL, *sname = NULL, *pdesc = NULL;
                         const char *chassis_id = NULL, *port_id = NULL, *system_name = NULL, *port_description = NULL, *capabilities = NULL;
-                        _cleanup_(sd_lldp_neighbor_unrefp) sd_lldp_neighbor *n = NULL;
+                        sd_lldp_neighbor *n = l[j];
                         uint16_t cc;
 
-                        r = next_lldp_neighbor(f, &n);
-                        if (r < 0) {
-                                log_warning_errno(r, "Failed to read neighbor data: %m");
-                                break;
-                        }
-                        if (r == 0)
-                                break;
-
                         (void) sd_lldp_neighbor_get_chassis_id_as_string(n, &chassis_id);
                         (void) sd_lldp_neighbor_get_port_id_as_string(n, &port_id);
                         (void) sd_lldp_neighbor_get_system_name(n, &system_name);
@@ -1058,6 +1027,8 @@ static int link_lldp_status(int argc, char *argv[], void *userdata) {
 
                         m++;
                 }
+
+                lldp_neighbors_free(l, k);
         }
 
         if (arg_legend) {
@@ -43,6 +43,7 @@ struct Address {
         union in_addr_union in_addr_peer;
 
         bool ip_masquerade_done:1;
+        bool marked:1; /* Same as for Link */
         bool duplicate_address_detection;
         bool manage_temporary_address;
         bool home_address;
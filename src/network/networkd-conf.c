@@ -6,7 +6,9 @@
  ***/
 
 #include <ctype.h>
+#include <linux/rtnetlink.h>
 
+#include "bitmap.h"
 #include "conf-parser.h"
 #include "def.h"
 #include "dhcp-identifier.h"
@@ -14,6 +16,8 @@
 #include "hexdecoct.h"
 #include "networkd-conf.h"
 #include "networkd-network.h"
+#include "networkd-route.h"
+#include "parse-util.h"
 #include "string-table.h"
 
 int manager_parse_config_file(Manager *m) {
@@ -21,7 +25,7 @@ int manager_parse_config_file(Manager *m) {
 
         return config_parse_many_nulstr(PKGSYSCONFDIR "/networkd.conf",
                                         CONF_PATHS_NULSTR("systemd/networkd.conf.d"),
-                                        "DHCP\0",
+                                        "Network\0DHCP\0",
                                         config_item_perf_lookup, networkd_gperf_lookup,
                                         CONFIG_PARSE_WARN, m);
 }
@@ -99,3 +103,103 @@ int config_parse_duid_rawdata(
         ret->raw_data_len = count;
         return 0;
 }
+
+static int route_table_from_string(const char *s, unsigned char *ret) {
+        assert(s);
+        assert(ret);
+
+        if (streq(s, "default"))
+                *ret = RT_TABLE_DEFAULT;
+        else if (streq(s, "main"))
+                *ret = RT_TABLE_MAIN;
+        else if (streq(s, "local"))
+                *ret = RT_TABLE_LOCAL;
+        else
+                return safe_atou8(s, ret);
+
+        return 0;
+}
+
+static int config_parse_ignore_foreign_routes_internal(
+                const char *unit,
+                const char *filename,
+                unsigned line,
+                const char *lvalue,
+                const char *rvalue,
+                Bitmap **bitmap,
+                int (*parse)(const char *s, unsigned char *ret)) {
+
+        const char *p = rvalue;
+        int r;
+
+        assert(filename);
+        assert(lvalue);
+        assert(rvalue);
+        assert(bitmap);
+        assert(parse);
+
+        if (isempty(rvalue)) {
+                bitmap_free(*bitmap);
+                *bitmap = NULL;
+                return 0;
+        }
+
+        for (;;) {
+                _cleanup_free_ char *word = NULL;
+                unsigned char n;
+
+                r = extract_first_word(&p, &word, NULL, 0);
+                if (r == -ENOMEM)
+                        return log_oom();
+                if (r < 0) {
+                        log_syntax(unit, LOG_ERR, filename, line, r, "Failed to parse %s=, ignoring: %s", lvalue, rvalue);
+                        return 0;
+                }
+                if (r == 0)
+                        return 0;
+
+                r = parse(word, &n);
+                if (r < 0) {
+                        log_syntax(unit, LOG_ERR, filename, line, r, "Failed to parse %s= value, ignoring: %s", lvalue, word);
+                        continue;
+                }
+
+                r = bitmap_ensure_allocated(bitmap);
+                if (r < 0)
+                        return log_oom();
+
+                r = bitmap_set(*bitmap, n);
+                if (r < 0)
+                        return log_oom();
+        }
+}
+
+int config_parse_ignore_foreign_routes_protocol(
+                const char *unit,
+                const char *filename,
+                unsigned line,
+                const char *section,
+                unsigned section_line,
+                const char *lvalue,
+                int ltype,
+                const char *rvalue,
+                void *data,
+                void *userdata) {
+
+        return config_parse_ignore_foreign_routes_internal(unit, filename, line, lvalue, rvalue, data, route_protocol_from_string);
+}
+
+int config_parse_ignore_foreign_routes_table(
+                const char *unit,
+                const char *filename,
+                unsigned line,
+                const char *section,
+                unsigned section_line,
+                const char *lvalue,
+                int ltype,
+                const char *rvalue,
+                void *data,
+                void *userdata) {
+
+        return config_parse_ignore_foreign_routes_internal(unit, filename, line, lvalue, rvalue, data, route_table_from_string);
+}
@@ -17,3 +17,5 @@ const struct ConfigPerfItem* networkd_gperf_lookup(const char *key, GPERF_LEN_TY
 
 CONFIG_PARSER_PROTOTYPE(config_parse_duid_type);
 CONFIG_PARSER_PROTOTYPE(config_parse_duid_rawdata);
+CONFIG_PARSER_PROTOTYPE(config_parse_ignore_foreign_routes_protocol);
+CONFIG_PARSER_PROTOTYPE(config_parse_ignore_foreign_routes_table);
@@ -475,6 +475,7 @@ static int link_new(Manager *manager, sd_netlink_message *message, Link **ret) {
 
         if (asprintf(&link->lldp_file, "/run/systemd/netif/lldp/%d", link->ifindex) < 0)
                 return -ENOMEM;
+        link->lldp_dirty = true;
 
         r = hashmap_ensure_allocated(&manager->links, NULL);
         if (r < 0)
@@ -541,7 +542,10 @@ static void link_free(Link *link) {
 
         free(link->kind);
 
-        (void)unlink(link->state_file);
+        if (link->manager)
+                manager_drop_state(link->manager, link->ifindex, link->state_file);
+        else
+                (void) unlink(link->state_file);
         free(link->state_file);
 
         udev_device_unref(link->udev_device);
@@ -845,17 +849,27 @@ static int link_enter_set_routes(Link *link) {
 
         link_set_state(link, LINK_STATE_SETTING_ROUTES);
 
+        /* Send all routes in one go rather than one syscall each. If sending fails, route_handler() is
+         * called with the error for each of them. */
+        r = 0;
+        (void) sd_netlink_batch_begin(link->manager->rtnl);
+
         LIST_FOREACH(routes, rt, link->network->static_routes) {
                 r = route_configure(rt, link, route_handler);
-                if (r < 0) {
-                        log_link_warning_errno(link, r, "Could not set routes: %m");
-                        link_enter_failed(link);
-                        return r;
-                }
+                if (r < 0)
+                        break;
 
                 link->route_messages++;
         }
 
+        (void) sd_netlink_batch_end(link->manager->rtnl);
+
+        if (r < 0) {
+                log_link_warning_errno(link, r, "Could not set routes: %m");
+                link_enter_failed(link);
+                return r;
+        }
+
         if (link->route_messages == 0) {
                 link->static_routes_configured = true;
                 link_check_ready(link);
@@ -1041,14 +1055,22 @@ static int link_push_uplink_ntp_to_dhcp_server(Link *link, sd_dhcp_server *s) {
 
 static int link_set_bridge_fdb(Link *link) {
         FdbEntry *fdb_entry;
-        int r;
+        int r = 0;
+
+        /* The kernel takes one FDB entry per message, hence queue them all up and send them together */
+        (void) sd_netlink_batch_begin(link->manager->rtnl);
 
         LIST_FOREACH(static_fdb_entries, fdb_entry, link->network->static_fdb_entries) {
                 r = fdb_entry_configure(link, fdb_entry);
                 if (r < 0)
-                        return log_link_error_errno(link, r, "Failed to add MAC entry to static MAC table: %m");
+                        break;
         }
 
+        (void) sd_netlink_batch_end(link->manager->rtnl);
+
+        if (r < 0)
+                return log_link_error_errno(link, r, "Failed to add MAC entry to static MAC table: %m");
+
         return 0;
 }
 
@@ -1067,28 +1089,41 @@ static int link_enter_set_addresses(Link *link) {
 
         link_set_state(link, LINK_STATE_SETTING_ADDRESSES);
 
+        /* Same as for the routes: queue up all addresses and labels, and send them together */
+        r = 0;
+        (void) sd_netlink_batch_begin(link->manager->rtnl);
+
         LIST_FOREACH(addresses, ad, link->network->static_addresses) {
                 r = address_configure(ad, link, address_handler, false);
-                if (r < 0) {
-                        log_link_warning_errno(link, r, "Could not set addresses: %m");
-                        link_enter_failed(link);
-                        return r;
-                }
+                if (r < 0)
+                        break;
 
                 link->address_messages++;
         }
 
+        if (r < 0) {
+                (void) sd_netlink_batch_end(link->manager->rtnl);
+                log_link_warning_errno(link, r, "Could not set addresses: %m");
+                link_enter_failed(link);
+                return r;
+        }
+
         LIST_FOREACH(labels, label, link->network->address_labels) {
                 r = address_label_configure(label, link, address_label_handler, false);
-                if (r < 0) {
-                        log_link_warning_errno(link, r, "Could not set address label: %m");
-                        link_enter_failed(link);
-                        return r;
-                }
+                if (r < 0)
+                        break;
 
                 link->address_label_messages++;
         }
 
+        (void) sd_netlink_batch_end(link->manager->rtnl);
+
+        if (r < 0) {
+                log_link_warning_errno(link, r, "Could not set address label: %m");
+                link_enter_failed(link);
+                return r;
+        }
+
         /* now that we can figure out a default address for the dhcp server,
            start it */
         if (link_dhcp4_server_enabled(link)) {
@@ -1591,7 +1626,13 @@ static void lldp_handler(sd_lldp *lldp, sd_lldp_event event, sd_lldp_neighbor *n
 
         assert(link);
 
-        (void) link_lldp_save(link);
+        /* A neighbor that only repeated what it told us before isn't worth rewriting the file for. Other
+         * changes are written out together with the rest of the link state, so that a burst of updates
+         * only causes a single write. */
+        if (event != SD_LLDP_EVENT_REFRESHED) {
+                link->lldp_dirty = true;
+                link_dirty(link);
+        }
 
         if (link_lldp_emit_enabled(link) && event == SD_LLDP_EVENT_ADDED) {
                 /* If we received information about a new neighbor, restart the LLDP "fast" logic */
@@ -2154,7 +2195,7 @@ void link_drop(Link *link) {
 
         log_link_debug(link, "Link removed");
 
-        (void)unlink(link->state_file);
+        manager_drop_state(link->manager, link->ifindex, link->state_file);
         link_unref(link);
 
         return;
@@ -2178,6 +2219,9 @@ static int link_joined(Link *link) {
                 }
         }
 
+        /* The bridge port settings and VLANs go out in the same sendmsg(), they are processed in order */
+        (void) sd_netlink_batch_begin(link->manager->rtnl);
+
         if (link->network->bridge) {
                 r = link_set_bridge(link);
                 if (r < 0)
@@ -2197,6 +2241,8 @@ static int link_joined(Link *link) {
                         log_link_error_errno(link, r, "Could not set bridge vlan: %m");
         }
 
+        (void) sd_netlink_batch_end(link->manager->rtnl);
+
         /* Skip setting up addresses until it gets carrier,
            or it would try to set addresses twice,
            which is bad for non-idempotent steps. */
@@ -2595,8 +2641,13 @@ static int link_update_lldp(Link *link) {
                         log_link_debug(link, "Started LLDP.");
         } else {
                 r = sd_lldp_stop(link->lldp);
-                if (r > 0)
+                if (r > 0) {
                         log_link_debug(link, "Stopped LLDP.");
+
+                        /* Stopping forgets all neighbors without telling us one by one */
+                        link->lldp_dirty = true;
+                        link_dirty(link);
+                }
         }
 
         return r;
@@ -3431,9 +3482,10 @@ static void print_link_hashmap(FILE *f, const char *prefix, Hashmap* h) {
 }
 
 int link_save(Link *link) {
-        _cleanup_free_ char *temp_path = NULL;
+        _cleanup_free_ char *data = NULL;
         _cleanup_fclose_ FILE *f = NULL;
         const char *admin_state, *oper_state;
+        size_t size = 0;
         Address *a;
         Route *route;
         Iterator i;
@@ -3445,11 +3497,12 @@ int link_save(Link *link) {
         assert(link->manager);
 
         if (link->state == LINK_STATE_LINGER) {
-                unlink(link->state_file);
+                manager_drop_state(link->manager, link->ifindex, link->state_file);
                 return 0;
         }
 
-        link_lldp_save(link);
+        if (link->lldp_dirty && link_lldp_save(link) >= 0)
+                link->lldp_dirty = false;
 
         admin_state = link_state_to_string(link->state);
         assert(admin_state);
@@ -3457,12 +3510,13 @@ int link_save(Link *link) {
         oper_state = link_operstate_to_string(link->operstate);
         assert(oper_state);
 
-        r = fopen_temporary(link->state_file, &f, &temp_path);
-        if (r < 0)
+        f = open_memstream(&data, &size);
+        if (!f) {
+                r = -ENOMEM;
                 goto fail;
+        }
 
         (void) __fsetlocking(f, FSETLOCKING_BYCALLER);
-        (void) fchmod(fileno(f), 0644);
 
         fprintf(f,
                 "# This is private data. Do not parse.\n"
@@ -3732,17 +3786,14 @@ int link_save(Link *link) {
         if (r < 0)
                 goto fail;
 
-        if (rename(temp_path, link->state_file) < 0) {
-                r = -errno;
+        r = manager_save_state(link->manager, link->ifindex, link->state_file, data, size, link->manager->state_files);
+        if (r < 0)
                 goto fail;
-        }
 
         return 0;
 
 fail:
-        (void) unlink(link->state_file);
-        if (temp_path)
-                (void) unlink(temp_path);
+        manager_drop_state(link->manager, link->ifindex, link->state_file);
 
         return log_link_error_errno(link, r, "Failed to save link data to %s: %m", link->state_file);
 }
@@ -3790,14 +3841,3 @@ static const char* const link_state_table[_LINK_STATE_MAX] = {
 };
 
 DEFINE_STRING_TABLE_LOOKUP(link_state, LinkState);
-
-static const char* const link_operstate_table[_LINK_OPERSTATE_MAX] = {
-        [LINK_OPERSTATE_OFF] = "off",
-        [LINK_OPERSTATE_NO_CARRIER] = "no-carrier",
-        [LINK_OPERSTATE_DORMANT] = "dormant",
-        [LINK_OPERSTATE_CARRIER] = "carrier",
-        [LINK_OPERSTATE_DEGRADED] = "degraded",
-        [LINK_OPERSTATE_ROUTABLE] = "routable",
-};
-
-DEFINE_STRING_TABLE_LOOKUP(link_operstate, LinkOperationalState);
@@ -20,6 +20,7 @@
 #include "sd-netlink.h"
 
 #include "list.h"
+#include "network-util.h"
 #include "set.h"
 
 typedef enum LinkState {
@@ -35,17 +36,6 @@ typedef enum LinkState {
         _LINK_STATE_INVALID = -1
 } LinkState;
 
-typedef enum LinkOperationalState {
-        LINK_OPERSTATE_OFF,
-        LINK_OPERSTATE_NO_CARRIER,
-        LINK_OPERSTATE_DORMANT,
-        LINK_OPERSTATE_CARRIER,
-        LINK_OPERSTATE_DEGRADED,
-        LINK_OPERSTATE_ROUTABLE,
-        _LINK_OPERSTATE_MAX,
-        _LINK_OPERSTATE_INVALID = -1
-} LinkOperationalState;
-
 typedef struct Manager Manager;
 typedef struct Network Network;
 typedef struct Address Address;
@@ -68,6 +58,8 @@ typedef struct Link {
         unsigned flags;
         uint8_t kernel_operstate;
 
+        bool marked; /* Not reported again yet by the enumeration after a netlink overrun */
+
         Network *network;
 
         LinkState state;
@@ -111,6 +103,7 @@ typedef struct Link {
         sd_ndisc *ndisc;
         Set *ndisc_rdnss;
         Set *ndisc_dnssl;
+        Set *ndisc_applied;
 
         sd_radv *radv;
 
@@ -120,6 +113,7 @@ typedef struct Link {
         /* This is about LLDP reception */
         sd_lldp *lldp;
         char *lldp_file;
+        bool lldp_dirty; /* lldp_file is rewritten by the next link_save() */
 
         /* This is about LLDP transmission */
         unsigned lldp_tx_fast; /* The LLDP txFast counter (See 802.1ab-2009, section 9.2.5.18) */
@@ -169,9 +163,6 @@ int dhcp6_request_address(Link *link, int ir);
 const char* link_state_to_string(LinkState s) _const_;
 LinkState link_state_from_string(const char *s) _pure_;
 
-const char* link_operstate_to_string(LinkOperationalState s) _const_;
-LinkOperationalState link_operstate_from_string(const char *s) _pure_;
-
 extern const sd_bus_vtable link_vtable[];
 
 int link_node_enumerator(sd_bus *bus, const char *path, void *userdata, char ***nodes, sd_bus_error *error);
@@ -273,6 +273,16 @@ static int manager_connect_udev(Manager *m) {
         return 0;
 }
 
+static bool manager_tracks_foreign_route(Manager *m, unsigned char protocol, unsigned char table) {
+        assert(m);
+
+        if (!m->manage_foreign_routes)
+                return false;
+
+        return !bitmap_isset(m->ignore_foreign_routes_protocols, protocol) &&
+               !bitmap_isset(m->ignore_foreign_routes_tables, table);
+}
+
 int manager_rtnl_process_route(sd_netlink *rtnl, sd_netlink_message *message, void *userdata) {
         Manager *m = userdata;
         Link *link = NULL;
@@ -446,7 +456,11 @@ int manager_rtnl_process_route(sd_netlink *rtnl, sd_netlink_message *message, vo
         switch (type) {
         case RTM_NEWROUTE:
                 if (!route) {
-                        /* A route appeared that we did not request */
+                        /* A route appeared that we did not request. Routes of other routing daemons might
+                         * be plenty, hence don't keep them around if we were asked not to. */
+                        if (!manager_tracks_foreign_route(m, protocol, table))
+                                return 0;
+
                         r = route_add_foreign(link, family, &dst, dst_prefixlen, tos, priority, table, &route);
                         if (r < 0) {
                                 log_link_warning_errno(link, r, "Failed to add route, ignoring: %m");
@@ -455,6 +469,7 @@ int manager_rtnl_process_route(sd_netlink *rtnl, sd_netlink_message *message, vo
                 }
 
                 route_update(route, &src, src_prefixlen, &gw, &prefsrc, scope, protocol, rt_type);
+                route->marked = false;
 
                 break;
 
@@ -604,6 +619,8 @@ int manager_rtnl_process_address(sd_netlink *rtnl, sd_netlink_message *message,
                                                valid_str ? "for " : "forever", strempty(valid_str));
                 }
 
+                address->marked = false;
+
                 r = address_update(address, flags, scope, &cinfo);
                 if (r < 0) {
                         log_link_warning_errno(link, r, "Failed to update address %s/%u, ignoring: %m", buf, prefixlen);
@@ -697,6 +714,8 @@ static int manager_rtnl_process_link(sd_netlink *rtnl, sd_netlink_message *messa
                         }
                 }
 
+                link->marked = false;
+
                 r = link_update(link, message);
                 if (r < 0) {
                         log_warning_errno(r, "Could not update link, ignoring: %m");
@@ -914,6 +933,142 @@ static int manager_connect_genl(Manager *m) {
         return 0;
 }
 
+static void manager_mark_links(Manager *m) {
+        Link *link;
+        Iterator i;
+
+        assert(m);
+
+        HASHMAP_FOREACH(link, m->links, i)
+                link->marked = true;
+}
+
+static void manager_sweep_links(Manager *m) {
+        Link *link;
+        Iterator i;
+
+        assert(m);
+
+        HASHMAP_FOREACH(link, m->links, i) {
+                NetDev *netdev = NULL;
+
+                if (!link->marked || link->state == LINK_STATE_LINGER)
+                        continue;
+
+                log_link_debug(link, "Link vanished while netlink notifications were lost, removing.");
+
+                (void) netdev_get(m, link->ifname, &netdev);
+                link_drop(link);
+                netdev_drop(netdev);
+        }
+}
+
+static void manager_mark_addresses(Manager *m) {
+        Address *address;
+        Link *link;
+        Iterator i, j;
+
+        assert(m);
+
+        HASHMAP_FOREACH(link, m->links, i) {
+                SET_FOREACH(address, link->addresses, j)
+                        address->marked = true;
+                SET_FOREACH(address, link->addresses_foreign, j)
+                        address->marked = true;
+        }
+}
+
+static void manager_sweep_addresses(Manager *m) {
+        Address *address;
+        Link *link;
+        Iterator i, j;
+
+        assert(m);
+
+        HASHMAP_FOREACH(link, m->links, i) {
+                SET_FOREACH(address, link->addresses, j)
+                        if (address->marked)
+                                (void) address_drop(address);
+                SET_FOREACH(address, link->addresses_foreign, j)
+                        if (address->marked)
+                                (void) address_drop(address);
+        }
+}
+
+static void manager_mark_routes(Manager *m) {
+        Route *route;
+        Link *link;
+        Iterator i, j;
+
+        assert(m);
+
+        HASHMAP_FOREACH(link, m->links, i) {
+                SET_FOREACH(route, link->routes, j)
+                        route->marked = true;
+                SET_FOREACH(route, link->routes_foreign, j)
+                        route->marked = true;
+        }
+}
+
+static void manager_sweep_routes(Manager *m) {
+        Route *route;
+        Link *link;
+        Iterator i, j;
+
+        assert(m);
+
+        HASHMAP_FOREACH(link, m->links, i) {
+                SET_FOREACH(route, link->routes, j)
+                        if (route->marked)
+                                route_free(route);
+                SET_FOREACH(route, link->routes_foreign, j)
+                        if (route->marked)
+                                route_free(route);
+        }
+}
+
+static int manager_rtnl_process_overrun(sd_netlink *rtnl, uint64_t n_overruns, void *userdata) {
+        Manager *m = userdata;
+        int r;
+
+        assert(m);
+
+        /* Notifications were lost, hence our view of the kernel state may be out of date. Enumerate everything
+         * we track once more, which brings it up to date the same way as at startup. Further overruns while
+         * doing so are coalesced into a single additional pass. The removals we missed are caught by marking
+         * everything first: whatever the enumeration doesn't report again is gone. */
+
+        log_warning("Kernel dropped netlink notifications (%" PRIu64 " time(s) so far), re-enumerating links, addresses, routes and rules.",
+                    n_overruns);
+
+        manager_mark_links(m);
+        r = manager_rtnl_enumerate_links(m);
+        if (r < 0)
+                log_warning_errno(r, "Could not enumerate links, ignoring: %m");
+        else
+                manager_sweep_links(m);
+
+        manager_mark_addresses(m);
+        r = manager_rtnl_enumerate_addresses(m);
+        if (r < 0)
+                log_warning_errno(r, "Could not enumerate addresses, ignoring: %m");
+        else
+                manager_sweep_addresses(m);
+
+        manager_mark_routes(m);
+        r = manager_rtnl_enumerate_routes(m);
+        if (r < 0)
+                log_warning_errno(r, "Could not enumerate routes, ignoring: %m");
+        else
+                manager_sweep_routes(m);
+
+        r = manager_rtnl_enumerate_rules(m);
+        if (r < 0)
+                log_warning_errno(r, "Could not enumerate rules, ignoring: %m");
+
+        return 0;
+}
+
 static int manager_connect_rtnl(Manager *m) {
         int fd, r;
 
@@ -967,6 +1122,10 @@ static int manager_connect_rtnl(Manager *m) {
         if (r < 0)
                 return r;
 
+        r = sd_netlink_set_overrun_handler(m->rtnl, &manager_rtnl_process_overrun, m);
+        if (r < 0)
+                return r;
+
         return 0;
 }
 
@@ -1058,14 +1217,63 @@ static void print_string_set(FILE *f, const char *field, OrderedSet *s) {
         fputc('\n', f);
 }
 
+/* Publishes serialized state of the link with the given ifindex, or the global state for 0, in the state database,
+ * and with write_file also in the state file at path. The file is written in any case if the state didn't fit into
+ * the database. Returns 0 if the state did not change since it was last saved, 1 otherwise. */
+int manager_save_state(Manager *m, int ifindex, const char *path, const char *data, size_t size, bool write_file) {
+        int r;
+
+        assert(m);
+        assert(path);
+        assert(data);
+
+        if (m->state_db) {
+                r = network_state_db_update(m->state_db, ifindex, data, size);
+                if (r == 0 && (!write_file || access(path, F_OK) >= 0))
+                        return 0;
+                if (r < 0) {
+                        if (!IN_SET(r, -EFBIG, -ENOSPC))
+                                log_debug_errno(r, "Failed to update state database, writing %s instead: %m", path);
+
+                        write_file = true;
+                }
+        } else
+                write_file = true;
+
+        if (!write_file) {
+                /* Don't leave an outdated file around, e.g. from before StateFiles=no was set */
+                if (unlink(path) < 0 && errno != ENOENT)
+                        log_debug_errno(errno, "Failed to remove %s, ignoring: %m", path);
+
+                return 1;
+        }
+
+        r = write_string_file(path, data, WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC|WRITE_STRING_FILE_AVOID_NEWLINE);
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+
+void manager_drop_state(Manager *m, int ifindex, const char *path) {
+        assert(m);
+
+        if (m->state_db)
+                (void) network_state_db_remove(m->state_db, ifindex);
+
+        if (path)
+                (void) unlink(path);
+}
+
 static int manager_save(Manager *m) {
         _cleanup_ordered_set_free_free_ OrderedSet *dns = NULL, *ntp = NULL, *search_domains = NULL, *route_domains = NULL;
         Link *link;
         Iterator i;
-        _cleanup_free_ char *temp_path = NULL;
+        _cleanup_free_ char *data = NULL;
         _cleanup_fclose_ FILE *f = NULL;
         LinkOperationalState operstate = LINK_OPERSTATE_OFF;
         const char *operstate_str;
+        size_t size = 0;
         int r;
 
         assert(m);
@@ -1169,12 +1377,11 @@ static int manager_save(Manager *m) {
         operstate_str = link_operstate_to_string(operstate);
         assert(operstate_str);
 
-        r = fopen_temporary(m->state_file, &f, &temp_path);
-        if (r < 0)
-                return r;
+        f = open_memstream(&data, &size);
+        if (!f)
+                return -ENOMEM;
 
         (void) __fsetlocking(f, FSETLOCKING_BYCALLER);
-        (void) fchmod(fileno(f), 0644);
 
         fprintf(f,
                 "# This is private data. Do not parse.\n"
@@ -1193,10 +1400,11 @@ static int manager_save(Manager *m) {
         if (r < 0)
                 goto fail;
 
-        if (rename(temp_path, m->state_file) < 0) {
-                r = -errno;
+        /* The routing policy rules are read back from the global state file on restart, hence always
+         * write it */
+        r = manager_save_state(m, 0, m->state_file, data, size, true);
+        if (r < 0)
                 goto fail;
-        }
 
         if (m->operational_state != operstate) {
                 m->operational_state = operstate;
@@ -1210,8 +1418,7 @@ static int manager_save(Manager *m) {
         return 0;
 
 fail:
-        (void) unlink(m->state_file);
-        (void) unlink(temp_path);
+        manager_drop_state(m, 0, m->state_file);
 
         return log_error_errno(r, "Failed to save network state to %s: %m", m->state_file);
 }
@@ -1233,6 +1440,12 @@ static int manager_dirty_handler(sd_event_source *s, void *userdata) {
                         link_clean(link);
         }
 
+        if (m->state_db) {
+                r = network_state_db_flush(m->state_db);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to notify about state database changes, ignoring: %m");
+        }
+
         return 1;
 }
 
@@ -1383,6 +1596,9 @@ int manager_new(Manager **ret, sd_event *event) {
         if (!m)
                 return -ENOMEM;
 
+        m->manage_foreign_routes = true;
+        m->state_files = true;
+
         m->state_file = strdup("/run/systemd/netif/state");
         if (!m->state_file)
                 return -ENOMEM;
@@ -1447,6 +1663,9 @@ void manager_free(Manager *m) {
 
         free(m->state_file);
 
+        hashmap_free_free(m->networks_by_ifname);
+        free(m->networks_unindexed);
+
         while ((network = m->networks))
                 network_free(network);
 
@@ -1470,6 +1689,9 @@ void manager_free(Manager *m) {
         set_free(m->rules);
         set_free(m->rules_foreign);
 
+        bitmap_free(m->ignore_foreign_routes_protocols);
+        bitmap_free(m->ignore_foreign_routes_tables);
+
         set_free_with_destructor(m->rules_saved, routing_policy_rule_free);
 
         sd_netlink_unref(m->rtnl);
@@ -1488,6 +1710,11 @@ void manager_free(Manager *m) {
         free(m->dynamic_timezone);
         free(m->dynamic_hostname);
 
+        /* Let monitors know that all links went away */
+        if (m->state_db)
+                (void) network_state_db_flush(m->state_db);
+        network_state_db_free(m->state_db);
+
         free(m);
 }
 
@@ -1549,6 +1776,10 @@ int manager_rtnl_enumerate_links(Manager *m) {
         if (r < 0)
                 return r;
 
+        /* Links that can be configured right away start sending requests while we go through the list.
+         * Let them all queue up and go out together, rather than one syscall per request and link. */
+        (void) sd_netlink_batch_begin(m->rtnl);
+
         for (link = reply; link; link = sd_netlink_message_next(link)) {
                 int k;
 
@@ -1561,6 +1792,8 @@ int manager_rtnl_enumerate_links(Manager *m) {
                 m->enumerating = false;
         }
 
+        (void) sd_netlink_batch_end(m->rtnl);
+
         return r;
 }
 
@@ -15,9 +15,11 @@
 #include "sd-resolve.h"
 #include "udev.h"
 
+#include "bitmap.h"
 #include "dhcp-identifier.h"
 #include "hashmap.h"
 #include "list.h"
+#include "network-state-db.h"
 
 #include "networkd-address-pool.h"
 #include "networkd-link.h"
@@ -46,9 +48,18 @@ struct Manager {
         char *state_file;
         LinkOperationalState operational_state;
 
+        /* The state is published in the state database, and unless disabled with StateFiles=no also in
+         * the per link state files, which older readers rely on */
+        NetworkStateDB *state_db;
+        bool state_files;
+
         Hashmap *links;
         Hashmap *netdevs;
         Hashmap *networks_by_name;
+        /* For network_get(): interface name → NULL terminated array of the networks matching exactly that
+         * name, and all other networks, both in load order */
+        Hashmap *networks_by_ifname;
+        Network **networks_unindexed;
         Hashmap *dhcp6_prefixes;
         LIST_HEAD(Network, networks);
         LIST_HEAD(AddressPool, address_pools);
@@ -56,6 +67,14 @@ struct Manager {
         usec_t network_dirs_ts_usec;
 
         DUID duid;
+
+        /* Routes we did not configure ourselves are tracked unless disabled here, or unless their protocol
+         * (RTPROT_*) or table is set in these bitmaps. On routers with full BGP tables that saves a lot of
+         * memory and CPU. */
+        bool manage_foreign_routes;
+        Bitmap *ignore_foreign_routes_protocols;
+        Bitmap *ignore_foreign_routes_tables;
+
         char* dynamic_hostname;
         char* dynamic_timezone;
 
@@ -94,6 +113,9 @@ int manager_rtnl_process_rule(sd_netlink *nl, sd_netlink_message *message, void
 int manager_send_changed(Manager *m, const char *property, ...) _sentinel_;
 void manager_dirty(Manager *m);
 
+int manager_save_state(Manager *m, int ifindex, const char *path, const char *data, size_t size, bool write_file);
+void manager_drop_state(Manager *m, int ifindex, const char *path);
+
 int manager_address_pool_acquire(Manager *m, int family, unsigned prefixlen, union in_addr_union *found);
 
 Link* manager_find_uplink(Manager *m, Link *exclude);
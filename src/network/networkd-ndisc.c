@@ -16,6 +16,7 @@
 #define NDISC_DNSSL_MAX 64U
 #define NDISC_RDNSS_MAX 64U
 #define NDISC_PREFIX_LFT_MIN 7200U
+#define NDISC_APPLIED_MAX 256U
 
 static int ndisc_netlink_handler(sd_netlink *rtnl, sd_netlink_message *m, void *userdata) {
         _cleanup_(link_unrefp) Link *link = userdata;
@@ -27,9 +28,13 @@ static int ndisc_netlink_handler(sd_netlink *rtnl, sd_netlink_message *m, void *
         link->ndisc_messages--;
 
         r = sd_netlink_message_get_errno(m);
-        if (r < 0 && r != -EEXIST)
+        if (r < 0 && r != -EEXIST) {
                 log_link_error_errno(link, r, "Could not set NDisc route or address: %m");
 
+                /* We don't know which one it was, hence apply everything again with the next RA */
+                link->ndisc_applied = set_free_free(link->ndisc_applied);
+        }
+
         if (link->ndisc_messages == 0) {
                 link->ndisc_configured = true;
                 link_check_ready(link);
@@ -38,9 +43,95 @@ static int ndisc_netlink_handler(sd_netlink *rtnl, sd_netlink_message *m, void *
         return 1;
 }
 
+static void ndisc_applied_hash_func(const void *p, struct siphash *state) {
+        const NDiscApplied *x = p;
+
+        siphash24_compress(&x->key, sizeof(x->key), state);
+}
+
+static int ndisc_applied_compare_func(const void *_a, const void *_b) {
+        const NDiscApplied *a = _a, *b = _b;
+
+        return memcmp(&a->key, &b->key, sizeof(a->key));
+}
+
+static const struct hash_ops ndisc_applied_hash_ops = {
+        .hash = ndisc_applied_hash_func,
+        .compare = ndisc_applied_compare_func
+};
+
+static bool ndisc_applied_update(
+                Link *link,
+                NDiscAppliedKey *key,
+                bool exists,
+                usec_t time_now,
+                usec_t valid_until,
+                usec_t preferred_until) {
+
+        NDiscApplied *x;
+
+        assert(link);
+        assert(key);
+
+        /* Returns false if the RA just repeats a route or address we configured before and that is still
+         * there, with lifetimes that don't end before the ones we passed. Otherwise remembers what is about
+         * to be configured, and returns true. Chatty routers thus don't cause a netlink request per RA. */
+
+        x = set_get(link->ndisc_applied, (NDiscApplied*) key);
+        if (x && exists &&
+            time_now < x->refresh_after &&
+            valid_until >= x->valid_until &&
+            preferred_until >= x->preferred_until)
+                return false;
+
+        if (!x) {
+                if (set_size(link->ndisc_applied) >= NDISC_APPLIED_MAX)
+                        return true;
+
+                if (set_ensure_allocated(&link->ndisc_applied, &ndisc_applied_hash_ops) < 0)
+                        return true;
+
+                x = new(NDiscApplied, 1);
+                if (!x)
+                        return true;
+
+                x->key = *key;
+
+                if (set_put(link->ndisc_applied, x) < 0) {
+                        free(x);
+                        return true;
+                }
+        }
+
+        x->valid_until = valid_until;
+        x->preferred_until = preferred_until;
+
+        /* Pass the lifetimes on again once half of the shorter one is over, so that nothing gets close to
+         * expiring while the router keeps advertising it */
+        x->refresh_after = time_now + (MIN(valid_until, preferred_until) - time_now) / 2;
+
+        return true;
+}
+
+static void ndisc_applied_forget(Link *link, NDiscAppliedKey *key) {
+        assert(link);
+        assert(key);
+
+        free(set_remove(link->ndisc_applied, (NDiscApplied*) key));
+}
+
+static bool ndisc_route_exists(Link *link, const Route *route) {
+        assert(link);
+        assert(route);
+
+        return route_get(link, route->family, &route->dst, route->dst_prefixlen, route->tos,
+                         route->priority, route->table, NULL) > 0;
+}
+
 static void ndisc_router_process_default(Link *link, sd_ndisc_router *rt) {
         _cleanup_(route_freep) Route *route = NULL;
         struct in6_addr gateway;
+        NDiscAppliedKey key;
         uint16_t lifetime;
         unsigned preference;
         uint32_t mtu;
@@ -127,8 +218,21 @@ static void ndisc_router_process_default(Link *link, sd_ndisc_router *rt) {
         route->lifetime = time_now + lifetime * USEC_PER_SEC;
         route->mtu = mtu;
 
+        key = (NDiscAppliedKey) {
+                .type = NDISC_APPLIED_ROUTE,
+                .table = route->table,
+                .priority = route->priority,
+                .mtu = mtu,
+                .pref = preference,
+                .gateway = gateway,
+        };
+
+        if (!ndisc_applied_update(link, &key, ndisc_route_exists(link, route), time_now, route->lifetime, route->lifetime))
+                return;
+
         r = route_configure(route, link, ndisc_netlink_handler);
         if (r < 0) {
+                ndisc_applied_forget(link, &key);
                 log_link_warning_errno(link, r, "Could not set default route: %m");
                 link_enter_failed(link);
                 return;
@@ -141,6 +245,8 @@ static void ndisc_router_process_autonomous_prefix(Link *link, sd_ndisc_router *
         _cleanup_(address_freep) Address *address = NULL;
         Address *existing_address;
         uint32_t lifetime_valid, lifetime_preferred, lifetime_remaining;
+        NDiscAppliedKey key;
+        bool exists;
         usec_t time_now;
         unsigned prefixlen;
         int r;
@@ -209,7 +315,8 @@ static void ndisc_router_process_autonomous_prefix(Link *link, sd_ndisc_router *
 
         /* see RFC4862 section 5.5.3.e */
         r = address_get(link, address->family, &address->in_addr, address->prefixlen, &existing_address);
-        if (r > 0) {
+        exists = r > 0;
+        if (exists) {
                 lifetime_remaining = existing_address->cinfo.tstamp / 100 + existing_address->cinfo.ifa_valid - time_now / USEC_PER_SEC;
                 if (lifetime_valid > NDISC_PREFIX_LFT_MIN || lifetime_valid > lifetime_remaining)
                         address->cinfo.ifa_valid = lifetime_valid;
@@ -225,8 +332,21 @@ static void ndisc_router_process_autonomous_prefix(Link *link, sd_ndisc_router *
         if (address->cinfo.ifa_valid == 0)
                 return;
 
+        key = (NDiscAppliedKey) {
+                .type = NDISC_APPLIED_ADDRESS,
+                .flags = address->flags,
+                .prefixlen = address->prefixlen,
+                .address = address->in_addr.in6,
+        };
+
+        if (!ndisc_applied_update(link, &key, exists, time_now,
+                                  time_now + address->cinfo.ifa_valid * USEC_PER_SEC,
+                                  time_now + address->cinfo.ifa_prefered * USEC_PER_SEC))
+                return;
+
         r = address_configure(address, link, ndisc_netlink_handler, true);
         if (r < 0) {
+                ndisc_applied_forget(link, &key);
                 log_link_warning_errno(link, r, "Could not set SLAAC address: %m");
                 link_enter_failed(link);
                 return;
@@ -237,6 +357,7 @@ static void ndisc_router_process_autonomous_prefix(Link *link, sd_ndisc_router *
 
 static void ndisc_router_process_onlink_prefix(Link *link, sd_ndisc_router *rt) {
         _cleanup_(route_freep) Route *route = NULL;
+        NDiscAppliedKey key;
         usec_t time_now;
         uint32_t lifetime;
         unsigned prefixlen;
@@ -283,8 +404,21 @@ static void ndisc_router_process_onlink_prefix(Link *link, sd_ndisc_router *rt)
                 return;
         }
 
+        key = (NDiscAppliedKey) {
+                .type = NDISC_APPLIED_ROUTE,
+                .table = route->table,
+                .priority = route->priority,
+                .flags = route->flags,
+                .prefixlen = prefixlen,
+                .address = route->dst.in6,
+        };
+
+        if (!ndisc_applied_update(link, &key, ndisc_route_exists(link, route), time_now, route->lifetime, route->lifetime))
+                return;
+
         r = route_configure(route, link, ndisc_netlink_handler);
         if (r < 0) {
+                ndisc_applied_forget(link, &key);
                 log_link_warning_errno(link, r, "Could not set prefix route: %m");
                 link_enter_failed(link);
                 return;
@@ -296,6 +430,7 @@ static void ndisc_router_process_onlink_prefix(Link *link, sd_ndisc_router *rt)
 static void ndisc_router_process_route(Link *link, sd_ndisc_router *rt) {
         _cleanup_(route_freep) Route *route = NULL;
         struct in6_addr gateway;
+        NDiscAppliedKey key;
         uint32_t lifetime;
         unsigned preference, prefixlen;
         usec_t time_now;
@@ -355,8 +490,21 @@ static void ndisc_router_process_route(Link *link, sd_ndisc_router *rt) {
                 return;
         }
 
+        key = (NDiscAppliedKey) {
+                .type = NDISC_APPLIED_ROUTE,
+                .table = route->table,
+                .prefixlen = prefixlen,
+                .pref = preference,
+                .address = route->dst.in6,
+                .gateway = gateway,
+        };
+
+        if (!ndisc_applied_update(link, &key, ndisc_route_exists(link, route), time_now, route->lifetime, route->lifetime))
+                return;
+
         r = route_configure(route, link, ndisc_netlink_handler);
         if (r < 0) {
+                ndisc_applied_forget(link, &key);
                 log_link_warning_errno(link, r, "Could not set additional route: %m");
                 link_enter_failed(link);
                 return;
@@ -698,6 +846,7 @@ int ndisc_configure(Link *link) {
 }
 
 void ndisc_vacuum(Link *link) {
+        NDiscApplied *a;
         NDiscRDNSS *r;
         NDiscDNSSL *d;
         Iterator i;
@@ -705,7 +854,7 @@ void ndisc_vacuum(Link *link) {
 
         assert(link);
 
-        /* Removes all RDNSS and DNSSL entries whose validity time has passed */
+        /* Removes all RDNSS and DNSSL entries, and applied routes and addresses, whose validity time has passed */
 
         time_now = now(clock_boottime_or_monotonic());
 
@@ -720,13 +869,19 @@ void ndisc_vacuum(Link *link) {
                         free(set_remove(link->ndisc_dnssl, d));
                         link_dirty(link);
                 }
+
+        SET_FOREACH(a, link->ndisc_applied, i)
+                if (a->valid_until < time_now)
+                        free(set_remove(link->ndisc_applied, a));
 }
 
 void ndisc_flush(Link *link) {
         assert(link);
 
-        /* Removes all RDNSS and DNSSL entries, without exception */
+        /* Removes all RDNSS and DNSSL entries, and what we know about applied routes and addresses, without
+         * exception */
 
         link->ndisc_rdnss = set_free_free(link->ndisc_rdnss);
         link->ndisc_dnssl = set_free_free(link->ndisc_dnssl);
+        link->ndisc_applied = set_free_free(link->ndisc_applied);
 }
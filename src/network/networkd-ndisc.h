@@ -23,6 +23,34 @@ static inline char* NDISC_DNSSL_DOMAIN(const NDiscDNSSL *n) {
         return ((char*) n) + ALIGN(sizeof(NDiscDNSSL));
 }
 
+typedef enum NDiscAppliedType {
+        NDISC_APPLIED_ROUTE,
+        NDISC_APPLIED_ADDRESS,
+} NDiscAppliedType;
+
+/* A route or address configured from a Router Advertisement, so that we can recognize RAs that merely repeat
+ * it. The key covers everything that went into the netlink request except the lifetimes, and is compared
+ * bytewise, hence needs to be zero initialized. */
+typedef struct NDiscAppliedKey {
+        uint32_t type;
+        uint32_t table;
+        uint32_t priority;
+        uint32_t mtu;
+        uint32_t flags;
+        uint8_t prefixlen;
+        uint8_t pref;
+        uint8_t reserved[2];
+        struct in6_addr address;
+        struct in6_addr gateway;
+} NDiscAppliedKey;
+
+typedef struct NDiscApplied {
+        NDiscAppliedKey key;
+        usec_t valid_until;
+        usec_t preferred_until;
+        usec_t refresh_after;
+} NDiscApplied;
+
 int ndisc_configure(Link *link);
 void ndisc_vacuum(Link *link);
 void ndisc_flush(Link *link);
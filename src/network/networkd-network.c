@@ -13,6 +13,7 @@
 #include "conf-parser.h"
 #include "dns-domain.h"
 #include "fd-util.h"
+#include "glob-util.h"
 #include "hostname-util.h"
 #include "in-addr-util.h"
 #include "network-internal.h"
@@ -314,6 +315,114 @@ static int network_load_one(Manager *manager, const char *filename) {
         return 0;
 }
 
+static bool network_match_name_is_literal(Network *network) {
+        char **n;
+
+        assert(network);
+
+        /* Only networks whose Name= consists of plain interface names can be found by name. Negated
+         * lists match almost anything, hence are treated just like globs. */
+
+        if (strv_isempty(network->match_name))
+                return false;
+
+        if (network->match_name[0][0] == '!')
+                return false;
+
+        STRV_FOREACH(n, network->match_name)
+                if (string_is_glob(*n) || strchr(*n, '\\'))
+                        return false;
+
+        return true;
+}
+
+static int network_index_add_name(Manager *manager, const char *name, Network *network) {
+        Network **networks, **a;
+        size_t n = 0;
+        int r;
+
+        networks = hashmap_get(manager->networks_by_ifname, name);
+        if (networks) {
+                while (networks[n])
+                        n++;
+
+                /* The same name listed twice in one file */
+                if (networks[n - 1] == network)
+                        return 0;
+        }
+
+        a = reallocarray(networks, n + 2, sizeof(Network*));
+        if (!a)
+                return -ENOMEM;
+
+        a[n] = network;
+        a[n + 1] = NULL;
+
+        if (n == 0) {
+                r = hashmap_put(manager->networks_by_ifname, name, a);
+                if (r < 0) {
+                        free(a);
+                        return r;
+                }
+        } else
+                /* The name is in the hashmap already, hence this only updates the value and cannot fail */
+                assert_se(hashmap_replace(manager->networks_by_ifname, name, a) >= 0);
+
+        return 0;
+}
+
+static void network_index_free(Manager *manager) {
+        assert(manager);
+
+        manager->networks_by_ifname = hashmap_free_free(manager->networks_by_ifname);
+        manager->networks_unindexed = mfree(manager->networks_unindexed);
+}
+
+static int network_index_build(Manager *manager) {
+        Network *network;
+        size_t n = 0, n_unindexed = 0;
+        unsigned i = 0;
+        int r;
+
+        assert(manager);
+
+        /* Matching every link against every .network file one after the other gets slow with thousands of
+         * both. Hence, index the files that match by interface name only, and keep an ordered array of all
+         * others, so that network_get() only has to look at the candidates that can possibly match. */
+
+        network_index_free(manager);
+
+        LIST_FOREACH(networks, network, manager->networks)
+                n++;
+
+        manager->networks_unindexed = new(Network*, n + 1);
+        if (!manager->networks_unindexed)
+                return -ENOMEM;
+
+        r = hashmap_ensure_allocated(&manager->networks_by_ifname, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        LIST_FOREACH(networks, network, manager->networks) {
+                network->index = i++;
+
+                if (network_match_name_is_literal(network)) {
+                        char **name;
+
+                        STRV_FOREACH(name, network->match_name) {
+                                r = network_index_add_name(manager, *name, network);
+                                if (r < 0)
+                                        return r;
+                        }
+                } else
+                        manager->networks_unindexed[n_unindexed++] = network;
+        }
+
+        manager->networks_unindexed[n_unindexed] = NULL;
+
+        return 0;
+}
+
 int network_load(Manager *manager) {
         Network *network;
         _cleanup_strv_free_ char **files = NULL;
@@ -322,6 +431,8 @@ int network_load(Manager *manager) {
 
         assert(manager);
 
+        network_index_free(manager);
+
         while ((network = manager->networks))
                 network_free(network);
 
@@ -335,6 +446,10 @@ int network_load(Manager *manager) {
                         return r;
         }
 
+        r = network_index_build(manager);
+        if (r < 0)
+                return log_error_errno(r, "Failed to index network files: %m");
+
         return 0;
 }
 
@@ -455,6 +570,7 @@ int network_get_by_name(Manager *manager, const char *name, Network **ret) {
 int network_get(Manager *manager, struct udev_device *device,
                 const char *ifname, const struct ether_addr *address,
                 Network **ret) {
+        Network **named = NULL, **unindexed;
         Network *network;
         struct udev_device *parent;
         const char *path = NULL, *parent_driver = NULL, *driver = NULL, *devtype = NULL;
@@ -474,7 +590,19 @@ int network_get(Manager *manager, struct udev_device *device,
                 devtype = udev_device_get_devtype(device);
         }
 
-        LIST_FOREACH(networks, network, manager->networks) {
+        if (ifname)
+                named = hashmap_get(manager->networks_by_ifname, ifname);
+        unindexed = manager->networks_unindexed;
+
+        /* Go through the networks listing this name and all the others, in the order they were loaded in */
+        for (;;) {
+                if (named && *named && (!unindexed || !*unindexed || (*named)->index < (*unindexed)->index))
+                        network = *(named++);
+                else if (unindexed && *unindexed)
+                        network = *(unindexed++);
+                else
+                        break;
+
                 if (net_match_config(network->match_mac, network->match_path,
                                      network->match_driver, network->match_type,
                                      network->match_name, network->match_host,
@@ -257,6 +257,9 @@ struct Network {
         DnssecMode dnssec_mode;
         Set *dnssec_negative_trust_anchors;
 
+        /* Position in the list of networks, see network_get() */
+        unsigned index;
+
         LIST_FIELDS(Network, networks);
 };
 
@@ -1015,6 +1015,22 @@ int config_parse_ipv6_route_preference(
         return 0;
 }
 
+int route_protocol_from_string(const char *s, unsigned char *ret) {
+        assert(s);
+        assert(ret);
+
+        if (streq(s, "kernel"))
+                *ret = RTPROT_KERNEL;
+        else if (streq(s, "boot"))
+                *ret = RTPROT_BOOT;
+        else if (streq(s, "static"))
+                *ret = RTPROT_STATIC;
+        else
+                return safe_atou8(s, ret);
+
+        return 0;
+}
+
 int config_parse_route_protocol(
                 const char *unit,
                 const char *filename,
@@ -1035,18 +1051,10 @@ int config_parse_route_protocol(
         if (r < 0)
                 return r;
 
-        if (streq(rvalue, "kernel"))
-                n->protocol = RTPROT_KERNEL;
-        else if (streq(rvalue, "boot"))
-                n->protocol = RTPROT_BOOT;
-        else if (streq(rvalue, "static"))
-                n->protocol = RTPROT_STATIC;
-        else {
-                r = safe_atou8(rvalue , &n->protocol);
-                if (r < 0) {
-                        log_syntax(unit, LOG_ERR, filename, line, r, "Could not parse route protocol \"%s\", ignoring assignment: %m", rvalue);
-                        return 0;
-                }
+        r = route_protocol_from_string(rvalue, &n->protocol);
+        if (r < 0) {
+                log_syntax(unit, LOG_ERR, filename, line, r, "Could not parse route protocol \"%s\", ignoring assignment: %m", rvalue);
+                return 0;
         }
 
         n = NULL;
@@ -37,6 +37,8 @@ struct Route {
         unsigned char pref;
         unsigned flags;
 
+        bool marked:1; /* Same as for Link */
+
         union in_addr_union gw;
         union in_addr_union dst;
         union in_addr_union src;
@@ -61,6 +63,8 @@ void route_update(Route *route, const union in_addr_union *src, unsigned char sr
 
 int route_expire_handler(sd_event_source *s, uint64_t usec, void *userdata);
 
+int route_protocol_from_string(const char *s, unsigned char *ret);
+
 DEFINE_TRIVIAL_CLEANUP_FUNC(Route*, route_free);
 
 CONFIG_PARSER_PROTOTYPE(config_parse_gateway);
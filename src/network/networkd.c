@@ -17,6 +17,7 @@
 int main(int argc, char *argv[]) {
         sd_event *event = NULL;
         _cleanup_(manager_freep) Manager *m = NULL;
+        _cleanup_(network_state_db_freep) NetworkStateDB *db = NULL;
         const char *user = "systemd-network";
         uid_t uid;
         gid_t gid;
@@ -59,6 +60,12 @@ int main(int argc, char *argv[]) {
                         goto out;
         }
 
+        /* Create the state database before the links directory, so that whoever finds the latter
+         * can watch the former too. Without it we fall back to writing the state files only. */
+        r = network_state_db_open(NETWORK_STATE_DB_PATH, &db);
+        if (r < 0)
+                log_warning_errno(r, "Could not open state database %s, ignoring: %m", NETWORK_STATE_DB_PATH);
+
         /* Always create the directories people can create inotify watches in.
          * It is necessary to create the following subdirectories after drop_privileges()
          * to support old kernels not supporting AmbientCapabilities=. */
@@ -90,6 +97,8 @@ int main(int argc, char *argv[]) {
                 goto out;
         }
 
+        m->state_db = TAKE_PTR(db);
+
         r = manager_connect_bus(m);
         if (r < 0) {
                 log_error_errno(r, "Could not connect to bus: %m");
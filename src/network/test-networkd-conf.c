@@ -5,6 +5,9 @@
   Copyright 2016 Zbigniew Jędrzejewski-Szmek
 ***/
 
+#include <linux/rtnetlink.h>
+
+#include "bitmap.h"
 #include "ether-addr-util.h"
 #include "hexdecoct.h"
 #include "log.h"
@@ -166,6 +169,28 @@ static void test_config_parse_hwaddr(void) {
         test_config_parse_hwaddrs_one("123.4567.89ab aa:bb:cc:dd:ee:fx hogehoge 01-23-45-67-89-ab aaaa aa:Bb:CC:dd:ee:ff", t, 2);
 }
 
+static void test_config_parse_ignore_foreign_routes(void) {
+        _cleanup_bitmap_free_ Bitmap *protocols = NULL, *tables = NULL;
+
+        assert_se(config_parse_ignore_foreign_routes_protocol("network", "filename", 1, "section", 1, "lvalue", 0, "kernel 12 bird 300", &protocols, NULL) == 0);
+        assert_se(bitmap_isset(protocols, RTPROT_KERNEL));
+        assert_se(bitmap_isset(protocols, 12));
+        assert_se(!bitmap_isset(protocols, RTPROT_STATIC));
+        assert_se(!bitmap_isset(protocols, 300 & 0xff));
+
+        assert_se(config_parse_ignore_foreign_routes_protocol("network", "filename", 1, "section", 1, "lvalue", 0, "static", &protocols, NULL) == 0);
+        assert_se(bitmap_isset(protocols, RTPROT_KERNEL));
+        assert_se(bitmap_isset(protocols, RTPROT_STATIC));
+
+        assert_se(config_parse_ignore_foreign_routes_protocol("network", "filename", 1, "section", 1, "lvalue", 0, "", &protocols, NULL) == 0);
+        assert_se(!protocols);
+
+        assert_se(config_parse_ignore_foreign_routes_table("network", "filename", 1, "section", 1, "lvalue", 0, "main 100 foo", &tables, NULL) == 0);
+        assert_se(bitmap_isset(tables, RT_TABLE_MAIN));
+        assert_se(bitmap_isset(tables, 100));
+        assert_se(!bitmap_isset(tables, RT_TABLE_LOCAL));
+}
+
 int main(int argc, char **argv) {
         log_parse_environment();
         log_open();
@@ -173,6 +198,7 @@ int main(int argc, char **argv) {
         test_config_parse_duid_type();
         test_config_parse_duid_rawdata();
         test_config_parse_hwaddr();
+        test_config_parse_ignore_foreign_routes();
 
         return 0;
 }
@@ -34,6 +34,7 @@ int link_new(Manager *m, Link **ret, int ifindex, const char *ifname) {
                 return -ENOMEM;
 
         l->manager = m;
+        l->operational_state = _LINK_OPERSTATE_INVALID;
 
         l->ifname = strdup(ifname);
         if (!l->ifname)
@@ -67,6 +68,7 @@ Link *link_free(Link *l) {
         }
 
         free(l->ifname);
+        free(l->state);
         return mfree(l);
  }
 
@@ -106,13 +108,16 @@ int link_update_rtnl(Link *l, sd_netlink_message *m) {
 }
 
 int link_update_monitor(Link *l) {
+        _cleanup_free_ char *operstate = NULL;
+
         assert(l);
 
         l->required_for_online = sd_network_link_get_required_for_online(l->ifindex) != 0;
 
-        l->operational_state = mfree(l->operational_state);
-
-        sd_network_link_get_operational_state(l->ifindex, &l->operational_state);
+        if (sd_network_link_get_operational_state(l->ifindex, &operstate) >= 0)
+                l->operational_state = link_operstate_from_string(operstate);
+        else
+                l->operational_state = _LINK_OPERSTATE_INVALID;
 
         l->state = mfree(l->state);
 
@@ -10,6 +10,8 @@
 
 #include "sd-netlink.h"
 
+#include "network-util.h"
+
 typedef struct Link Link;
 typedef struct Manager Manager;
 
@@ -21,7 +23,7 @@ struct Link {
         unsigned flags;
 
         bool required_for_online;
-        char *operational_state;
+        LinkOperationalState operational_state;
         char *state;
 };
 
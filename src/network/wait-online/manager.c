@@ -26,7 +26,7 @@ bool manager_ignore_link(Manager *m, Link *link) {
                 return true;
 
         /* if interfaces are given on the command line, ignore all others */
-        if (m->interfaces && !strv_contains(m->interfaces, link->ifname))
+        if (m->interfaces && !hashmap_contains(m->interfaces, link->ifname))
                 return true;
 
         if (!link->required_for_online)
@@ -37,16 +37,17 @@ bool manager_ignore_link(Manager *m, Link *link) {
 }
 
 bool manager_all_configured(Manager *m) {
+        const char *ifname;
         Iterator i;
+        void *p;
         Link *l;
-        char **ifname;
         bool one_ready = false;
 
         /* wait for all the links given on the command line to appear */
-        STRV_FOREACH(ifname, m->interfaces) {
-                l = hashmap_get(m->links_by_name, *ifname);
+        HASHMAP_FOREACH_KEY(p, ifname, m->interfaces, i) {
+                l = hashmap_get(m->links_by_name, ifname);
                 if (!l) {
-                        log_debug("still waiting for %s", *ifname);
+                        log_debug("still waiting for %s", ifname);
                         return false;
                 }
         }
@@ -54,6 +55,8 @@ bool manager_all_configured(Manager *m) {
         /* wait for all links networkd manages to be in admin state 'configured'
            and at least one link to gain a carrier */
         HASHMAP_FOREACH(l, m->links, i) {
+                LinkOperationalState min_state;
+
                 if (manager_ignore_link(m, l)) {
                         log_info("ignoring: %s", l->ifname);
                         continue;
@@ -71,8 +74,21 @@ bool manager_all_configured(Manager *m) {
                         return false;
                 }
 
-                if (l->operational_state &&
-                    STR_IN_SET(l->operational_state, "degraded", "routable"))
+                /* if a minimum state is given for this link, it is ready
+                   only once it got there */
+                min_state = hashmap_contains(m->interfaces, l->ifname) ?
+                        PTR_TO_INT(hashmap_get(m->interfaces, l->ifname)) : _LINK_OPERSTATE_INVALID;
+                if (min_state != _LINK_OPERSTATE_INVALID) {
+                        if (l->operational_state < min_state) {
+                                log_debug("link %s is not yet %s", l->ifname, link_operstate_to_string(min_state));
+                                return false;
+                        }
+
+                        one_ready = true;
+                        continue;
+                }
+
+                if (l->operational_state >= LINK_OPERSTATE_DEGRADED)
                         /* we wait for at least one link to be ready,
                            regardless of who manages it */
                         one_ready = true;
@@ -204,20 +220,37 @@ static int manager_rtnl_listen(Manager *m) {
 }
 
 static int on_network_event(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        _cleanup_free_ int *ifindexes = NULL;
         Manager *m = userdata;
+        size_t n = 0;
         Iterator i;
         Link *l;
         int r;
 
         assert(m);
 
-        sd_network_monitor_flush(m->network_monitor);
+        r = sd_network_monitor_flush_links(m->network_monitor, &ifindexes, &n);
+        if (r < 0)
+                log_warning_errno(r, "Failed to flush network monitor, updating all links: %m");
+        if (r > 0) {
+                size_t k;
 
-        HASHMAP_FOREACH(l, m->links, i) {
-                r = link_update_monitor(l);
-                if (r < 0)
-                        log_warning_errno(r, "Failed to update monitor information for %i: %m", l->ifindex);
-        }
+                /* Only reread the state of the links that changed, not of all of them */
+                for (k = 0; k < n; k++) {
+                        l = hashmap_get(m->links, INT_TO_PTR(ifindexes[k]));
+                        if (!l)
+                                continue;
+
+                        r = link_update_monitor(l);
+                        if (r < 0)
+                                log_warning_errno(r, "Failed to update monitor information for %i: %m", l->ifindex);
+                }
+        } else
+                HASHMAP_FOREACH(l, m->links, i) {
+                        r = link_update_monitor(l);
+                        if (r < 0)
+                                log_warning_errno(r, "Failed to update monitor information for %i: %m", l->ifindex);
+                }
 
         if (manager_all_configured(m))
                 sd_event_exit(m->event, 0);
@@ -250,7 +283,7 @@ static int manager_network_monitor_listen(Manager *m) {
         return 0;
 }
 
-int manager_new(Manager **ret, char **interfaces, char **ignore, usec_t timeout) {
+int manager_new(Manager **ret, Hashmap *interfaces, char **ignore, usec_t timeout) {
         _cleanup_(manager_freep) Manager *m = NULL;
         int r;
 
@@ -20,7 +20,8 @@ struct Manager {
         Hashmap *links;
         Hashmap *links_by_name;
 
-        char **interfaces;
+        /* Interface name → minimum operational state (LinkOperationalState), or _LINK_OPERSTATE_INVALID */
+        Hashmap *interfaces;
         char **ignore;
 
         sd_netlink *rtnl;
@@ -33,7 +34,7 @@ struct Manager {
 };
 
 void manager_free(Manager *m);
-int manager_new(Manager **ret, char **interfaces, char **ignore, usec_t timeout);
+int manager_new(Manager **ret, Hashmap *interfaces, char **ignore, usec_t timeout);
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(Manager*, manager_free);
 
@@ -10,13 +10,16 @@
 
 #include "sd-daemon.h"
 
+#include "alloc-util.h"
+#include "hashmap.h"
 #include "manager.h"
+#include "network-util.h"
 #include "signal-util.h"
 #include "strv.h"
 
 static bool arg_quiet = false;
 static usec_t arg_timeout = 120 * USEC_PER_SEC;
-static char **arg_interfaces = NULL;
+static Hashmap *arg_interfaces = NULL;
 static char **arg_ignore = NULL;
 
 static void help(void) {
@@ -25,7 +28,9 @@ static void help(void) {
                "  -h --help                 Show this help\n"
                "     --version              Print version string\n"
                "  -q --quiet                Do not show status information\n"
-               "  -i --interface=INTERFACE  Block until at least these interfaces have appeared\n"
+               "  -i --interface=INTERFACE[:OPERSTATE]\n"
+               "                            Block until at least these interfaces have appeared,\n"
+               "                            and optionally reached the given operational state\n"
                "     --ignore=INTERFACE     Don't take these interfaces into account\n"
                "     --timeout=SECS         Maximum time to wait for network connectivity\n"
                , program_invocation_short_name);
@@ -69,11 +74,42 @@ static int parse_argv(int argc, char *argv[]) {
                 case ARG_VERSION:
                         return version();
 
-                case 'i':
-                        if (strv_extend(&arg_interfaces, optarg) < 0)
+                case 'i': {
+                        LinkOperationalState state = _LINK_OPERSTATE_INVALID;
+                        _cleanup_free_ char *ifname = NULL;
+                        const char *colon;
+
+                        /* Interface names cannot contain colons, hence whatever follows one is the state */
+                        colon = strchr(optarg, ':');
+                        if (colon) {
+                                state = link_operstate_from_string(colon + 1);
+                                if (state < 0) {
+                                        log_error("Invalid operational state: %s", colon + 1);
+                                        return -EINVAL;
+                                }
+
+                                ifname = strndup(optarg, colon - optarg);
+                        } else
+                                ifname = strdup(optarg);
+                        if (!ifname)
                                 return log_oom();
 
+                        r = hashmap_ensure_allocated(&arg_interfaces, &string_hash_ops);
+                        if (r < 0)
+                                return log_oom();
+
+                        r = hashmap_put(arg_interfaces, ifname, INT_TO_PTR(state));
+                        if (r == -EEXIST) {
+                                /* Listed more than once, the last one wins */
+                                assert_se(hashmap_update(arg_interfaces, ifname, INT_TO_PTR(state)) >= 0);
+                                break;
+                        }
+                        if (r < 0)
+                                return log_oom();
+
+                        ifname = NULL;
                         break;
+                }
 
                 case ARG_IGNORE:
                         if (strv_extend(&arg_ignore, optarg) < 0)
@@ -100,6 +136,7 @@ static int parse_argv(int argc, char *argv[]) {
 
 int main(int argc, char *argv[]) {
         _cleanup_(manager_freep) Manager *m = NULL;
+        char *ifname;
         int r;
 
         log_set_target(LOG_TARGET_AUTO);
@@ -139,7 +176,9 @@ int main(int argc, char *argv[]) {
         }
 
 finish:
-        strv_free(arg_interfaces);
+        while ((ifname = hashmap_steal_first_key(arg_interfaces)))
+                free(ifname);
+        hashmap_free(arg_interfaces);
         strv_free(arg_ignore);
 
         if (r >= 0) {
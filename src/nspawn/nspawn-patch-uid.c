@@ -7,18 +7,21 @@
 
 #include <fcntl.h>
 #include <linux/magic.h>
+#include <pthread.h>
 #if HAVE_ACL
 #include <sys/acl.h>
 #endif
 #include <sys/stat.h>
 #include <sys/statvfs.h>
 #include <sys/vfs.h>
+#include <sys/xattr.h>
 #include <unistd.h>
 
 #include "acl-util.h"
 #include "dirent-util.h"
 #include "fd-util.h"
 #include "fs-util.h"
+#include "list.h"
 #include "missing.h"
 #include "nspawn-def.h"
 #include "nspawn-patch-uid.h"
@@ -28,6 +31,53 @@
 #include "strv.h"
 #include "user-util.h"
 
+/* Unless the tree is tiny, the time is spent in syscalls on individual inodes, which scale well with the
+ * number of threads issuing them. Don't go overboard though, the disk is the limit after a while. */
+#define PATCH_UID_THREADS_MAX 16U
+
+typedef struct PatchDir PatchDir;
+
+struct PatchDir {
+        PatchDir *parent;
+
+        int fd;
+        DIR *dir;
+        struct stat st;
+        bool is_toplevel:1;
+        bool skip:1;
+
+        /* One for the scan of the directory itself, plus one for each subdirectory that is not done yet. The
+         * directory is patched when this drops to zero. */
+        unsigned n_ref;
+
+        LIST_FIELDS(PatchDir, queue);
+};
+
+typedef struct PatchContext {
+        uid_t shift;
+        bool resume;
+
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+
+        LIST_HEAD(PatchDir, queue);
+        unsigned n_queued;
+        unsigned n_idle;
+
+        bool done;
+        bool changed;
+        int error;
+} PatchContext;
+
+typedef struct PatchWorker {
+        PatchContext *context;
+        bool changed;
+
+        /* The last file system that told us it does not do ACLs */
+        bool acl_unsupported;
+        dev_t acl_unsupported_dev;
+} PatchWorker;
+
 #if HAVE_ACL
 
 static int get_acl(int fd, const char *name, acl_type_t type, acl_t *ret) {
@@ -167,11 +217,56 @@ static int shift_acl(acl_t acl, uid_t shift, acl_t *ret) {
         return !!*ret;
 }
 
-static int patch_acls(int fd, const char *name, const struct stat *st, uid_t shift) {
+static int has_acl(int fd, const char *name, const char *xattr) {
+        char procfs_path[STRLEN("/proc/self/fd/") + DECIMAL_STR_MAX(int) + 1 + NAME_MAX + 1];
+        ssize_t n;
+
+        assert(fd >= 0);
+        assert(xattr);
+
+        /* Files without an extended ACL carry no xattr for it, and there's nothing to shift for them. This is
+         * the common case, and much cheaper to find out than getting the ACL, which needs an O_PATH fd and
+         * synthesizes the ACL from the mode if there's none. */
+
+        if (name) {
+                xsprintf(procfs_path, "/proc/self/fd/%i/%s", fd, name);
+                n = lgetxattr(procfs_path, xattr, NULL, 0);
+        } else
+                n = fgetxattr(fd, xattr, NULL, 0);
+        if (n < 0) {
+                if (errno == ENODATA)
+                        return 0;
+
+                return -errno;
+        }
+
+        return 1;
+}
+
+static int patch_acl(int fd, const char *name, acl_type_t type, uid_t shift) {
         _cleanup_(acl_freep) acl_t acl = NULL, shifted = NULL;
+        int r;
+
+        r = get_acl(fd, name, type, &acl);
+        if (r < 0)
+                return r;
+
+        r = shift_acl(acl, shift, &shifted);
+        if (r <= 0)
+                return r;
+
+        r = set_acl(fd, name, type, shifted);
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+
+static int patch_acls(PatchWorker *w, int fd, const char *name, const struct stat *st) {
         bool changed = false;
         int r;
 
+        assert(w);
         assert(fd >= 0);
         assert(st);
 
@@ -179,42 +274,35 @@ static int patch_acls(int fd, const char *name, const struct stat *st, uid_t shi
         if (S_ISLNK(st->st_mode))
                 return 0;
 
-        r = get_acl(fd, name, ACL_TYPE_ACCESS, &acl);
-        if (r == -EOPNOTSUPP)
+        if (w->acl_unsupported && w->acl_unsupported_dev == st->st_dev)
                 return 0;
-        if (r < 0)
-                return r;
 
-        r = shift_acl(acl, shift, &shifted);
+        r = has_acl(fd, name, "system.posix_acl_access");
+        if (r == -EOPNOTSUPP) {
+                w->acl_unsupported = true;
+                w->acl_unsupported_dev = st->st_dev;
+                return 0;
+        }
         if (r < 0)
                 return r;
         if (r > 0) {
-                r = set_acl(fd, name, ACL_TYPE_ACCESS, shifted);
+                r = patch_acl(fd, name, ACL_TYPE_ACCESS, w->context->shift);
                 if (r < 0)
                         return r;
-
-                changed = true;
+                if (r > 0)
+                        changed = true;
         }
 
         if (S_ISDIR(st->st_mode)) {
-                acl_free(acl);
-                acl_free(shifted);
-
-                acl = shifted = NULL;
-
-                r = get_acl(fd, name, ACL_TYPE_DEFAULT, &acl);
-                if (r < 0)
-                        return r;
-
-                r = shift_acl(acl, shift, &shifted);
+                r = has_acl(fd, name, "system.posix_acl_default");
                 if (r < 0)
                         return r;
                 if (r > 0) {
-                        r = set_acl(fd, name, ACL_TYPE_DEFAULT, shifted);
+                        r = patch_acl(fd, name, ACL_TYPE_DEFAULT, w->context->shift);
                         if (r < 0)
                                 return r;
-
-                        changed = true;
+                        if (r > 0)
+                                changed = true;
                 }
         }
 
@@ -223,27 +311,38 @@ static int patch_acls(int fd, const char *name, const struct stat *st, uid_t shi
 
 #else
 
-static int patch_acls(int fd, const char *name, const struct stat *st, uid_t shift) {
+static int patch_acls(PatchWorker *w, int fd, const char *name, const struct stat *st) {
         return 0;
 }
 
 #endif
 
-static int patch_fd(int fd, const char *name, const struct stat *st, uid_t shift) {
-        uid_t new_uid;
+static int patch_fd(PatchWorker *w, int fd, const char *name, const struct stat *st) {
+        uid_t new_uid, shift;
         gid_t new_gid;
         bool changed = false;
         int r;
 
+        assert(w);
         assert(fd >= 0);
         assert(st);
 
+        shift = w->context->shift;
+
         new_uid =         shift | (st->st_uid & UINT32_C(0xFFFF));
         new_gid = (gid_t) shift | (st->st_gid & UINT32_C(0xFFFF));
 
         if (!uid_is_valid(new_uid) || !gid_is_valid(new_gid))
                 return -EINVAL;
 
+        /* Patch the ACLs first, so that an inode that is owned by the new range is done entirely. We rely on
+         * this when resuming an interrupted run. */
+        r = patch_acls(w, fd, name, st);
+        if (r < 0)
+                return r;
+        if (r > 0)
+                changed = true;
+
         if (st->st_uid != new_uid || st->st_gid != new_gid) {
                 if (name)
                         r = fchownat(fd, name, new_uid, new_gid, AT_SYMLINK_NOFOLLOW);
@@ -266,11 +365,7 @@ static int patch_fd(int fd, const char *name, const struct stat *st, uid_t shift
                 changed = true;
         }
 
-        r = patch_acls(fd, name, st, shift);
-        if (r < 0)
-                return r;
-
-        return r > 0 || changed;
+        return changed;
 }
 
 /*
@@ -301,125 +396,352 @@ static int is_fs_fully_userns_compatible(const struct statfs *sfs) {
                F_TYPE_EQUAL(sfs->f_type, SYSFS_MAGIC);
 }
 
-static int recurse_fd(int fd, bool donate_fd, const struct stat *st, uid_t shift, bool is_toplevel) {
-        _cleanup_closedir_ DIR *d = NULL;
-        bool changed = false;
-        struct statfs sfs;
-        int r;
+static void patch_context_fail(PatchContext *c, int error) {
+        assert(c);
+        assert(error < 0);
+
+        /* Only the first error is reported. Everything still queued is released without being looked at. */
+        assert_se(pthread_mutex_lock(&c->mutex) == 0);
+        if (c->error == 0)
+                c->error = error;
+        assert_se(pthread_mutex_unlock(&c->mutex) == 0);
+}
+
+static int patch_dir_fd(PatchDir *d) {
+        return d->dir ? dirfd(d->dir) : d->fd;
+}
+
+static void patch_dir_unref(PatchWorker *w, PatchDir *d) {
+        PatchContext *c;
+
+        assert(w);
+
+        c = w->context;
+
+        while (d) {
+                PatchDir *parent;
+                unsigned n_ref;
+                bool failed;
+                int r;
+
+                assert_se(pthread_mutex_lock(&c->mutex) == 0);
+                assert(d->n_ref > 0);
+                n_ref = --d->n_ref;
+                failed = c->error < 0;
+                assert_se(pthread_mutex_unlock(&c->mutex) == 0);
+
+                if (n_ref > 0)
+                        return;
+
+                /* Everything below is done, patch the directory itself. It's key to do this in this order so
+                 * that the top-level directory is patched as very last object in the tree, so that we can use
+                 * it as quick indicator whether the tree is properly chown()ed already. The same holds for each
+                 * subdirectory, which allows us to skip them when resuming. */
+                if (!failed && !d->skip) {
+                        r = patch_fd(w, patch_dir_fd(d), NULL, &d->st);
+                        if (r == -EROFS && !d->is_toplevel) {
+                                _cleanup_free_ char *name = NULL;
+
+                                (void) fd_get_path(patch_dir_fd(d), &name);
+                                log_debug("Skipping read-only directory %s.", strna(name));
+                        } else if (r < 0)
+                                patch_context_fail(c, r);
+                        else if (r > 0)
+                                w->changed = true;
+                }
+
+                parent = d->parent;
+
+                if (d->dir)
+                        closedir(d->dir);
+                else
+                        safe_close(d->fd);
+                free(d);
+
+                if (!parent) {
+                        assert_se(pthread_mutex_lock(&c->mutex) == 0);
+                        c->done = true;
+                        assert_se(pthread_cond_broadcast(&c->cond) == 0);
+                        assert_se(pthread_mutex_unlock(&c->mutex) == 0);
+                        return;
+                }
+
+                d = parent;
+        }
+}
+
+static int patch_dir_new(PatchDir *parent, int fd, const struct stat *st, PatchDir **ret) {
+        PatchDir *d;
 
         assert(fd >= 0);
+        assert(st);
+        assert(ret);
+
+        d = new0(PatchDir, 1);
+        if (!d)
+                return -ENOMEM;
+
+        d->parent = parent;
+        d->fd = fd;
+        d->st = *st;
+        d->is_toplevel = !parent;
+        d->n_ref = 1;
+
+        *ret = d;
+        return 0;
+}
+
+static void patch_dir_process(PatchWorker *w, PatchDir *d);
+
+static int patch_dir_add_subdir(PatchWorker *w, PatchDir *d, const char *name, const struct stat *st) {
+        PatchContext *c = w->context;
+        _cleanup_close_ int fd = -1;
+        PatchDir *subdir;
+        bool enqueue;
+        int r;
+
+        fd = openat(dirfd(d->dir), name, O_RDONLY|O_NONBLOCK|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW|O_NOATIME);
+        if (fd < 0)
+                return -errno;
 
-        if (fstatfs(fd, &sfs) < 0)
+        r = patch_dir_new(d, fd, st, &subdir);
+        if (r < 0)
+                return r;
+        fd = -1;
+
+        /* Hand the subdirectory to another thread if one is waiting for work, and process it right here
+         * otherwise. This way the number of open directories stays low, and work is only shared if needed. */
+        assert_se(pthread_mutex_lock(&c->mutex) == 0);
+        r = c->error;
+        d->n_ref++;
+        enqueue = r == 0 && c->n_idle > c->n_queued;
+        if (enqueue) {
+                LIST_APPEND(queue, c->queue, subdir);
+                c->n_queued++;
+                assert_se(pthread_cond_signal(&c->cond) == 0);
+        }
+        assert_se(pthread_mutex_unlock(&c->mutex) == 0);
+
+        if (r < 0) {
+                /* Some other thread failed, just drop what we have */
+                patch_dir_unref(w, subdir);
+                return -ECANCELED;
+        }
+
+        if (!enqueue)
+                patch_dir_process(w, subdir);
+
+        return 0;
+}
+
+static int patch_dir_scan(PatchWorker *w, PatchDir *d) {
+        struct dirent *de;
+        int r;
+
+        assert(w);
+        assert(d);
+
+        d->dir = fdopendir(d->fd);
+        if (!d->dir)
                 return -errno;
+        d->fd = -1;
+
+        FOREACH_DIRENT_ALL(de, d->dir, return -errno) {
+                struct stat fst;
+
+                if (dot_or_dot_dot(de->d_name))
+                        continue;
+
+                if (fstatat(dirfd(d->dir), de->d_name, &fst, AT_SYMLINK_NOFOLLOW) < 0)
+                        return -errno;
+
+                if (S_ISDIR(fst.st_mode))
+                        r = patch_dir_add_subdir(w, d, de->d_name, &fst);
+                else {
+                        r = patch_fd(w, dirfd(d->dir), de->d_name, &fst);
+                        if (r > 0)
+                                w->changed = true;
+                }
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static void patch_dir_process(PatchWorker *w, PatchDir *d) {
+        PatchContext *c = w->context;
+        struct statfs sfs;
+        int r;
+
+        assert(w);
+        assert(d);
+
+        /* Did a previous, interrupted run finish this subtree already? */
+        if (c->resume && !d->is_toplevel &&
+            ((uint32_t) (d->st.st_uid ^ c->shift) >> 16) == 0 &&
+            ((uint32_t) (d->st.st_gid ^ c->shift) >> 16) == 0) {
+                d->skip = true;
+                goto finish;
+        }
+
+        if (fstatfs(d->fd, &sfs) < 0) {
+                r = -errno;
+                goto fail;
+        }
 
         /* We generally want to permit crossing of mount boundaries when patching the UIDs/GIDs. However, we probably
          * shouldn't do this for /proc and /sys if that is already mounted into place. Hence, let's stop the recursion
          * when we hit procfs, sysfs or some other special file systems. */
-
-        r = is_fs_fully_userns_compatible(&sfs);
-        if (r < 0)
-                goto finish;
-        if (r > 0) {
-                r = 0; /* don't recurse */
+        if (is_fs_fully_userns_compatible(&sfs)) {
+                d->skip = true;
                 goto finish;
         }
 
         /* Also, if we hit a read-only file system, then don't bother, skip the whole subtree */
         if ((sfs.f_flags & ST_RDONLY) ||
-            access_fd(fd, W_OK) == -EROFS)
-                goto read_only;
+            access_fd(d->fd, W_OK) == -EROFS) {
+                if (!d->is_toplevel) {
+                        _cleanup_free_ char *name = NULL;
 
-        if (S_ISDIR(st->st_mode)) {
-                struct dirent *de;
+                        /* When we hit a ready-only subtree we simply skip it, but log about it. */
+                        (void) fd_get_path(d->fd, &name);
+                        log_debug("Skipping read-only file or directory %s.", strna(name));
+                }
 
-                if (!donate_fd) {
-                        int copy;
+                d->skip = true;
+                goto finish;
+        }
 
-                        copy = fcntl(fd, F_DUPFD_CLOEXEC, 3);
-                        if (copy < 0) {
-                                r = -errno;
-                                goto finish;
-                        }
+        r = patch_dir_scan(w, d);
+        if (r == -ECANCELED)
+                goto finish;
+        if (r < 0)
+                goto fail;
 
-                        fd = copy;
-                        donate_fd = true;
-                }
+        goto finish;
 
-                d = fdopendir(fd);
-                if (!d) {
-                        r = -errno;
-                        goto finish;
-                }
-                fd = -1;
+fail:
+        patch_context_fail(c, r);
+finish:
+        patch_dir_unref(w, d);
+}
 
-                FOREACH_DIRENT_ALL(de, d, r = -errno; goto finish) {
-                        struct stat fst;
+static void *patch_worker(void *userdata) {
+        PatchWorker w = {
+                .context = userdata,
+        };
+        PatchContext *c = w.context;
 
-                        if (dot_or_dot_dot(de->d_name))
-                                continue;
+        assert_se(pthread_mutex_lock(&c->mutex) == 0);
 
-                        if (fstatat(dirfd(d), de->d_name, &fst, AT_SYMLINK_NOFOLLOW) < 0) {
-                                r = -errno;
-                                goto finish;
-                        }
+        for (;;) {
+                bool failed;
+                PatchDir *d;
 
-                        if (S_ISDIR(fst.st_mode)) {
-                                int subdir_fd;
+                while (!c->done && !c->queue) {
+                        c->n_idle++;
+                        assert_se(pthread_cond_wait(&c->cond, &c->mutex) == 0);
+                        c->n_idle--;
+                }
 
-                                subdir_fd = openat(dirfd(d), de->d_name, O_RDONLY|O_NONBLOCK|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW|O_NOATIME);
-                                if (subdir_fd < 0) {
-                                        r = -errno;
-                                        goto finish;
+                if (c->done)
+                        break;
 
-                                }
+                d = c->queue;
+                LIST_REMOVE(queue, c->queue, d);
+                c->n_queued--;
+                failed = c->error < 0;
 
-                                r = recurse_fd(subdir_fd, true, &fst, shift, false);
-                                if (r < 0)
-                                        goto finish;
-                                if (r > 0)
-                                        changed = true;
+                assert_se(pthread_mutex_unlock(&c->mutex) == 0);
 
-                        } else {
-                                r = patch_fd(dirfd(d), de->d_name, &fst, shift);
-                                if (r < 0)
-                                        goto finish;
-                                if (r > 0)
-                                        changed = true;
-                        }
-                }
+                if (failed)
+                        patch_dir_unref(&w, d);
+                else
+                        patch_dir_process(&w, d);
+
+                assert_se(pthread_mutex_lock(&c->mutex) == 0);
         }
 
-        /* After we descended, also patch the directory itself. It's key to do this in this order so that the top-level
-         * directory is patched as very last object in the tree, so that we can use it as quick indicator whether the
-         * tree is properly chown()ed already. */
-        r = patch_fd(d ? dirfd(d) : fd, NULL, st, shift);
-        if (r == -EROFS)
-                goto read_only;
-        if (r > 0)
-                changed = true;
+        if (w.changed)
+                c->changed = true;
 
-        r = changed;
-        goto finish;
+        assert_se(pthread_mutex_unlock(&c->mutex) == 0);
+
+        return NULL;
+}
+
+static unsigned patch_threads(void) {
+        long n;
+
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+        if (n <= 0)
+                return 1;
+
+        return MIN((unsigned) n, PATCH_UID_THREADS_MAX);
+}
+
+static int recurse_fd(int fd, bool donate_fd, const struct stat *st, uid_t shift, bool resume) {
+        PatchContext c = {
+                .shift = shift,
+                .resume = resume,
+        };
+        pthread_t threads[PATCH_UID_THREADS_MAX];
+        unsigned n_threads = 0, n, i;
+        PatchDir *d;
+        int r;
 
-read_only:
-        if (!is_toplevel) {
-                _cleanup_free_ char *name = NULL;
+        assert(fd >= 0);
+        assert(st);
 
-                /* When we hit a ready-only subtree we simply skip it, but log about it. */
-                (void) fd_get_path(fd, &name);
-                log_debug("Skippping read-only file or directory %s.", strna(name));
-                r = changed;
+        if (!donate_fd) {
+                fd = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+                if (fd < 0)
+                        return -errno;
         }
 
-finish:
-        if (donate_fd)
+        r = patch_dir_new(NULL, fd, st, &d);
+        if (r < 0) {
                 safe_close(fd);
+                return r;
+        }
 
-        return r;
+        assert_se(pthread_mutex_init(&c.mutex, NULL) == 0);
+        assert_se(pthread_cond_init(&c.cond, NULL) == 0);
+
+        LIST_PREPEND(queue, c.queue, d);
+        c.n_queued = 1;
+
+        /* We take part in the work ourselves, hence start one thread less. If we can't start any, we do it all
+         * on our own. */
+        n = patch_threads();
+        for (; n_threads + 1 < n; n_threads++) {
+                r = pthread_create(threads + n_threads, NULL, patch_worker, &c);
+                if (r > 0) {
+                        log_debug_errno(r, "Failed to start UID patching thread, continuing with %u threads: %m", n_threads + 1);
+                        break;
+                }
+        }
+
+        (void) patch_worker(&c);
+
+        for (i = 0; i < n_threads; i++)
+                (void) pthread_join(threads[i], NULL);
+
+        assert(!c.queue);
+
+        pthread_cond_destroy(&c.cond);
+        pthread_mutex_destroy(&c.mutex);
+
+        if (c.error < 0)
+                return c.error;
+
+        return c.changed;
 }
 
 static int fd_patch_uid_internal(int fd, bool donate_fd, uid_t shift, uid_t range) {
         struct stat st;
+        bool resume;
         int r;
 
         assert(fd >= 0);
@@ -464,9 +786,14 @@ static int fd_patch_uid_internal(int fd, bool donate_fd, uid_t shift, uid_t rang
 
         /* Before we start recursively chowning, mark the top-level dir as "busy" by chowning it to the "busy"
          * range. Should we be interrupted in the middle of our work, we'll see it owned by this user and will start
-         * chown()ing it again, unconditionally, as the busy UID is not a valid UID we'd everpick for ourselves. */
-
-        if ((st.st_uid & UID_BUSY_MASK) != UID_BUSY_BASE) {
+         * chown()ing it again, unconditionally, as the busy UID is not a valid UID we'd everpick for ourselves.
+         *
+         * Since each directory is patched only after everything below it, a subdirectory that is owned by the
+         * target range at that point has been completed by the interrupted run, and is skipped. Note that this
+         * extends the assumption made above to the subdirectories of a tree we were interrupted on. */
+
+        resume = (st.st_uid & UID_BUSY_MASK) == UID_BUSY_BASE;
+        if (!resume) {
                 if (fchown(fd,
                            UID_BUSY_BASE | (st.st_uid & ~UID_BUSY_MASK),
                            (gid_t) UID_BUSY_BASE | (st.st_gid & ~(gid_t) UID_BUSY_MASK)) < 0) {
@@ -475,7 +802,7 @@ static int fd_patch_uid_internal(int fd, bool donate_fd, uid_t shift, uid_t rang
                 }
         }
 
-        return recurse_fd(fd, donate_fd, &st, shift, true);
+        return recurse_fd(fd, donate_fd, &st, shift, resume);
 
 finish:
         if (donate_fd)
@@ -48,6 +48,7 @@
 #include "dev-setup.h"
 #include "dissect-image.h"
 #include "env-util.h"
+#include "escape.h"
 #include "fd-util.h"
 #include "fdset.h"
 #include "fileio.h"
@@ -107,6 +108,9 @@
 #define STATIC_RESOLV_CONF "/usr/lib/systemd/resolv.conf"
 #endif
 
+/* Prepared /dev trees for --dev-template=, one per UID shift */
+#define DEV_TEMPLATE_DIR "/run/systemd/nspawn/dev-template"
+
 /* nspawn is listening on the socket at the path in the constant nspawn_notify_socket_path
  * nspawn_notify_socket_path is relative to the container
  * the init process in the container pid can send messages to nspawn following the sd_notify(3) protocol */
@@ -193,6 +197,7 @@ static int arg_settings_trusted = -1;
 static char **arg_parameters = NULL;
 static const char *arg_container_service_name = "systemd-nspawn";
 static bool arg_notify_ready = false;
+static bool arg_dev_template = false;
 static bool arg_use_cgns = true;
 static unsigned long arg_clone_ns_flags = CLONE_NEWIPC|CLONE_NEWPID|CLONE_NEWUTS;
 static MountSettingsMask arg_mount_settings = MOUNT_APPLY_APIVFS_RO;
@@ -304,6 +309,7 @@ static void help(void) {
                "     --volatile[=MODE]      Run the system in volatile mode\n"
                "     --settings=BOOLEAN     Load additional settings from .nspawn file\n"
                "     --notify-ready=BOOLEAN Receive notifications from the child init process\n"
+               "     --dev-template=BOOLEAN Set up /dev from a cached template\n"
                , program_invocation_short_name);
 }
 
@@ -453,6 +459,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_PIVOT_ROOT,
                 ARG_PRIVATE_USERS_CHOWN,
                 ARG_NOTIFY_READY,
+                ARG_DEV_TEMPLATE,
                 ARG_ROOT_HASH,
                 ARG_SYSTEM_CALL_FILTER,
                 ARG_RLIMIT,
@@ -515,6 +522,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "chdir",                  required_argument, NULL, ARG_CHDIR                  },
                 { "pivot-root",             required_argument, NULL, ARG_PIVOT_ROOT             },
                 { "notify-ready",           required_argument, NULL, ARG_NOTIFY_READY           },
+                { "dev-template",           required_argument, NULL, ARG_DEV_TEMPLATE           },
                 { "root-hash",              required_argument, NULL, ARG_ROOT_HASH              },
                 { "system-call-filter",     required_argument, NULL, ARG_SYSTEM_CALL_FILTER     },
                 { "rlimit",                 required_argument, NULL, ARG_RLIMIT                 },
@@ -1093,6 +1101,14 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_settings_mask |= SETTING_NOTIFY_READY;
                         break;
 
+                case ARG_DEV_TEMPLATE:
+                        r = parse_boolean(optarg);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse --dev-template= argument: %s", optarg);
+
+                        arg_dev_template = r;
+                        break;
+
                 case ARG_ROOT_HASH: {
                         void *k;
                         size_t l;
@@ -1758,7 +1774,7 @@ static int setup_boot_id(void) {
         return mount_verbose(LOG_ERR, NULL, to, NULL, MS_BIND|MS_REMOUNT|MS_RDONLY|MS_NOSUID|MS_NOEXEC|MS_NODEV, NULL);
 }
 
-static int copy_devnodes(const char *dest) {
+static int copy_devnodes(const char *dest, bool bind_fallback) {
         static const char devnodes[] =
                 "null\0"
                 "zero\0"
@@ -1804,6 +1820,8 @@ static int copy_devnodes(const char *dest) {
                                         log_notice("%s/dev is pre-mounted and pre-populated. If a pre-mounted /dev is provided it needs to be an unpopulated file system.", dest);
                                 if (errno != EPERM)
                                         return log_error_errno(errno, "mknod(%s) failed: %m", to);
+                                if (!bind_fallback)
+                                        return log_debug_errno(errno, "mknod(%s) failed: %m", to);
 
                                 /* Some systems abusively restrict mknod but
                                  * allow bind mounts. */
@@ -1900,6 +1918,139 @@ static int setup_dev_console(const char *dest, const char *console) {
         return mount_verbose(LOG_ERR, console, to, NULL, MS_BIND, NULL);
 }
 
+static int dev_template_prepare(char **ret) {
+        _cleanup_free_ char *p = NULL, *t = NULL;
+        int r;
+
+        assert(ret);
+
+        /* The device nodes and symlinks in the template are owned by the container's root user, hence we keep one
+         * template per UID shift. It's built in a temporary directory and renamed into place, so that concurrently
+         * starting containers either see a complete template or none at all. */
+
+        if (asprintf(&p, DEV_TEMPLATE_DIR "/" UID_FMT, arg_userns_mode == USER_NAMESPACE_NO ? 0 : arg_uid_shift) < 0)
+                return -ENOMEM;
+
+        if (access(p, F_OK) >= 0) {
+                *ret = TAKE_PTR(p);
+                return 0;
+        }
+        if (errno != ENOENT)
+                return -errno;
+
+        r = mkdir_p(DEV_TEMPLATE_DIR, 0755);
+        if (r < 0)
+                return r;
+
+        r = tempfn_random(p, NULL, &t);
+        if (r < 0)
+                return r;
+
+        if (mkdir(t, 0755) < 0)
+                return -errno;
+
+        r = userns_mkdir(t, "/dev", 0755, 0, 0);
+        if (r < 0)
+                goto fail;
+
+        /* Don't fall back to bind mounts here, they wouldn't survive our mount namespace */
+        r = copy_devnodes(t, false);
+        if (r < 0)
+                goto fail;
+
+        dev_setup(t, arg_uid_shift, arg_uid_shift);
+
+        if (rename(t, p) < 0) {
+                r = -errno;
+                (void) rm_rf(t, REMOVE_ROOT);
+
+                /* Somebody else was quicker? */
+                if (!IN_SET(r, -EEXIST, -ENOTEMPTY))
+                        return r;
+        }
+
+        *ret = TAKE_PTR(p);
+        return 1;
+
+fail:
+        (void) rm_rf(t, REMOVE_ROOT);
+        return r;
+}
+
+static int setup_dev_template(const char *dest) {
+        _cleanup_free_ char *template = NULL, *lower = NULL;
+        char staging[] = "/run/systemd/nspawn/dev-upper.XXXXXX";
+        const char *upper, *work, *where, *options;
+        int r, q;
+
+        assert(dest);
+
+        /* Instead of populating a fresh tmpfs on every start, mount the prepared template as the lower layer of an
+         * overlay, with a private tmpfs as upper layer, so that the container can still modify its /dev. Returns 1
+         * if /dev has been set up that way, and 0 if the caller needs to populate /dev itself. */
+
+        if (arg_selinux_apifs_context)
+                return 0;
+
+        r = dev_template_prepare(&template);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to prepare /dev template, populating /dev directly: %m");
+                return 0;
+        }
+
+        lower = shell_escape(prefix_roota(template, "/dev"), ",:");
+        if (!lower)
+                return log_oom();
+
+        if (!mkdtemp(staging))
+                return log_error_errno(errno, "Failed to create /dev staging directory: %m");
+
+        r = mount_verbose(LOG_ERR, "tmpfs", staging, "tmpfs", MS_NOSUID|MS_NODEV|MS_STRICTATIME, "mode=700");
+        if (r < 0) {
+                (void) rmdir(staging);
+                return r;
+        }
+
+        upper = strjoina(staging, "/upper");
+        work = strjoina(staging, "/work");
+
+        if (mkdir(upper, 0755) < 0 || mkdir(work, 0700) < 0) {
+                r = log_error_errno(errno, "Failed to create overlay directories for /dev: %m");
+                goto finish;
+        }
+
+        r = userns_lchown(upper, 0, 0);
+        if (r < 0) {
+                log_error_errno(r, "Failed to chown %s: %m", upper);
+                goto finish;
+        }
+
+        r = userns_mkdir(dest, "/dev", 0755, 0, 0);
+        if (r < 0) {
+                log_error_errno(r, "Failed to create /dev: %m");
+                goto finish;
+        }
+
+        where = prefix_roota(dest, "/dev");
+        options = strjoina("lowerdir=", lower, ",upperdir=", upper, ",workdir=", work);
+
+        r = mount_verbose(LOG_DEBUG, "overlay", where, "overlay", MS_NOSUID, options);
+        if (r < 0) {
+                /* No overlayfs? Then do it the slow way. */
+                log_debug_errno(r, "Failed to mount /dev from template, populating /dev directly: %m");
+                r = 0;
+        } else
+                r = 1;
+
+finish:
+        /* The overlay keeps the tmpfs pinned, we don't need it mounted anywhere else */
+        q = umount_verbose(staging);
+        if (q >= 0)
+                (void) rmdir(staging);
+
+        return r;
+}
+
 static int setup_keyring(void) {
         key_serial_t keyring;
 
@@ -2823,6 +2974,7 @@ static int outer_child(
                 int netns_fd) {
 
         _cleanup_close_ int fd = -1;
+        bool dev_prepared = false;
         int r, which_failed;
         pid_t pid;
         ssize_t l;
@@ -2993,6 +3145,15 @@ static int outer_child(
                         return log_error_errno(r, "Failed to make tree read-only: %m");
         }
 
+        if (arg_dev_template) {
+                r = setup_dev_template(directory);
+                if (r < 0)
+                        return r;
+
+                dev_prepared = r > 0;
+        }
+
+        /* Skips /dev if it has been mounted from the template above */
         r = mount_all(directory,
                       arg_mount_settings,
                       arg_uid_shift,
@@ -3001,11 +3162,13 @@ static int outer_child(
         if (r < 0)
                 return r;
 
-        r = copy_devnodes(directory);
-        if (r < 0)
-                return r;
+        if (!dev_prepared) {
+                r = copy_devnodes(directory, true);
+                if (r < 0)
+                        return r;
 
-        dev_setup(directory, arg_uid_shift, arg_uid_shift);
+                dev_setup(directory, arg_uid_shift, arg_uid_shift);
+        }
 
         r = setup_pts(directory);
         if (r < 0)
@@ -4461,7 +4624,7 @@ int main(int argc, char *argv[]) {
                 if (!arg_root_hash && dissected_image->can_verity)
                         log_notice("Note: image %s contains verity information, but no root hash specified! Proceeding without integrity checking.", arg_image);
 
-                r = dissected_image_decrypt_interactively(dissected_image, NULL, arg_root_hash, arg_root_hash_size, 0, &decrypted_image);
+                r = dissected_image_decrypt_interactively(dissected_image, NULL, arg_root_hash, arg_root_hash_size, DISSECT_IMAGE_VERITY_SHARE, &decrypted_image);
                 if (r < 0)
                         goto finish;
 
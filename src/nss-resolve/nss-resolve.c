@@ -8,15 +8,19 @@
 #include <errno.h>
 #include <netdb.h>
 #include <nss.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include "sd-bus.h"
 
+#include "alloc-util.h"
 #include "bus-common-errors.h"
 #include "in-addr-util.h"
 #include "macro.h"
 #include "nss-util.h"
+#include "process-util.h"
 #include "resolved-def.h"
 #include "string-util.h"
 #include "util.h"
@@ -96,6 +100,176 @@ static uint32_t ifindex_to_scopeid(int family, const void *a, int ifindex) {
         return IN6_IS_ADDR_LINKLOCAL(&in6) ? ifindex : 0;
 }
 
+#define DIRECT_BUS_ADDRESS "unix:path=" SD_RESOLVED_PRIVATE_BUS_PATH
+
+/* One direct connection to resolved is kept around for the following lookups, so that a lookup doesn't have to
+ * set up and authenticate a new connection each time. A lookup takes it out of the cache and puts it back
+ * when done, lookups in other threads meanwhile use connections of their own, which aren't cached. The
+ * connection is identified by the inode of its socket too, so that we notice when the application closed our
+ * fd behind our back, and by the process it was opened in, so that we notice when we got forked off. */
+static pthread_mutex_t cached_bus_mutex = PTHREAD_MUTEX_INITIALIZER;
+static sd_bus *cached_bus = NULL;
+static pid_t cached_bus_pid = 0;
+static dev_t cached_bus_dev = 0;
+static ino_t cached_bus_ino = 0;
+
+static bool bus_is_direct(sd_bus *bus) {
+        const char *address;
+
+        return sd_bus_get_address(bus, &address) >= 0 && streq(address, DIRECT_BUS_ADDRESS);
+}
+
+static int open_direct_bus(sd_bus **ret) {
+        _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
+        int r;
+
+        assert(ret);
+
+        r = sd_bus_new(&bus);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_set_address(bus, DIRECT_BUS_ADDRESS);
+        if (r < 0)
+                return r;
+
+        /* We never pass fds, hence spare us the negotiation */
+        r = sd_bus_negotiate_fds(bus, false);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_start(bus);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(bus);
+        return 0;
+}
+
+static sd_bus *take_cached_bus(void) {
+        sd_bus *bus;
+        struct stat st;
+        pid_t pid;
+        dev_t dev;
+        ino_t ino;
+        int r;
+
+        if (pthread_mutex_trylock(&cached_bus_mutex) != 0)
+                return NULL;
+
+        bus = TAKE_PTR(cached_bus);
+        pid = cached_bus_pid;
+        dev = cached_bus_dev;
+        ino = cached_bus_ino;
+
+        assert_se(pthread_mutex_unlock(&cached_bus_mutex) == 0);
+
+        if (!bus)
+                return NULL;
+
+        if (pid != getpid_cached())
+                /* The connection belongs to our parent. Free our copy, but don't attempt to flush anything onto
+                 * it. */
+                return sd_bus_unref(bus);
+
+        if (fstat(sd_bus_get_fd(bus), &st) < 0 ||
+            st.st_dev != dev ||
+            st.st_ino != ino)
+                /* Our fd was closed and maybe reused for something else. Don't free the connection, that would
+                 * close the fd once more, just forget about it. */
+                return NULL;
+
+        /* Process whatever the other side queued for us in the meantime. If resolved went away since the last
+         * lookup, we notice that now. */
+        do
+                r = sd_bus_process(bus, NULL);
+        while (r > 0);
+
+        if (r < 0 || sd_bus_is_open(bus) <= 0)
+                return sd_bus_flush_close_unref(bus);
+
+        return bus;
+}
+
+static void release_bus(sd_bus *bus) {
+        struct stat st;
+
+        if (!bus)
+                return;
+
+        /* Only cache direct connections to resolved, and only if they are still good */
+        if (!bus_is_direct(bus) ||
+            sd_bus_is_open(bus) <= 0 ||
+            fstat(sd_bus_get_fd(bus), &st) < 0 ||
+            pthread_mutex_trylock(&cached_bus_mutex) != 0) {
+                sd_bus_flush_close_unref(bus);
+                return;
+        }
+
+        if (!cached_bus) {
+                cached_bus = TAKE_PTR(bus);
+                cached_bus_pid = getpid_cached();
+                cached_bus_dev = st.st_dev;
+                cached_bus_ino = st.st_ino;
+        }
+
+        assert_se(pthread_mutex_unlock(&cached_bus_mutex) == 0);
+
+        sd_bus_flush_close_unref(bus);
+}
+
+static void release_busp(sd_bus **bus) {
+        release_bus(*bus);
+}
+
+static int acquire_bus(sd_bus **ret) {
+        int r;
+
+        assert(ret);
+
+        /* Talk to resolved directly if it lets us, that saves the roundtrips through the bus daemon. If it
+         * doesn't, maybe because it is an older version or isn't running, go through the system bus, so that
+         * we get the usual errors to decide on falling back to other modules. */
+
+        *ret = take_cached_bus();
+        if (*ret)
+                return 0;
+
+        r = open_direct_bus(ret);
+        if (r >= 0)
+                return 0;
+
+        return sd_bus_open_system(ret);
+}
+
+static int call_bus(sd_bus **bus, sd_bus_message *req, sd_bus_error *error, sd_bus_message **reply) {
+        int r;
+
+        assert(bus);
+        assert(*bus);
+
+        r = sd_bus_call(*bus, req, SD_RESOLVED_QUERY_TIMEOUT_USEC, error, reply);
+        if (r >= 0 || !bus_is_direct(*bus) || sd_bus_is_open(*bus) > 0)
+                return r;
+
+        /* resolved dropped the direct connection, maybe because it has too many already, or it was restarted.
+         * Try once more through the system bus. */
+        *bus = sd_bus_flush_close_unref(*bus);
+        sd_bus_error_free(error);
+
+        r = sd_bus_open_system(bus);
+        if (r < 0)
+                return r;
+
+        return sd_bus_call(*bus, req, SD_RESOLVED_QUERY_TIMEOUT_USEC, error, reply);
+}
+
+static _destructor_ void cached_bus_destroy(void) {
+        /* The module may be unloaded, don't leave the connection behind */
+        if (cached_bus && cached_bus_pid == getpid_cached())
+                cached_bus = sd_bus_flush_close_unref(cached_bus);
+}
+
 enum nss_status _nss_resolve_gethostbyname4_r(
                 const char *name,
                 struct gaih_addrtuple **pat,
@@ -106,7 +280,7 @@ enum nss_status _nss_resolve_gethostbyname4_r(
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *req = NULL, *reply = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         struct gaih_addrtuple *r_tuple, *r_tuple_first = NULL;
-        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_(release_busp) sd_bus *bus = NULL;
         enum nss_status ret = NSS_STATUS_UNAVAIL;
         const char *canonical = NULL;
         size_t l, ms, idx;
@@ -121,7 +295,7 @@ enum nss_status _nss_resolve_gethostbyname4_r(
         assert(errnop);
         assert(h_errnop);
 
-        r = sd_bus_open_system(&bus);
+        r = acquire_bus(&bus);
         if (r < 0)
                 goto fail;
 
@@ -143,7 +317,7 @@ enum nss_status _nss_resolve_gethostbyname4_r(
         if (r < 0)
                 goto fail;
 
-        r = sd_bus_call(bus, req, SD_RESOLVED_QUERY_TIMEOUT_USEC, &error, &reply);
+        r = call_bus(&bus, req, &error, &reply);
         if (r < 0) {
                 if (sd_bus_error_has_name(&error, _BUS_ERROR_DNS "NXDOMAIN")) {
                         *errnop = ESRCH;
@@ -277,7 +451,7 @@ enum nss_status _nss_resolve_gethostbyname3_r(
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *req = NULL, *reply = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         char *r_name, *r_aliases, *r_addr, *r_addr_list;
-        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_(release_busp) sd_bus *bus = NULL;
         enum nss_status ret = NSS_STATUS_UNAVAIL;
         size_t l, idx, ms, alen;
         const char *canonical;
@@ -299,7 +473,7 @@ enum nss_status _nss_resolve_gethostbyname3_r(
                 goto fail;
         }
 
-        r = sd_bus_open_system(&bus);
+        r = acquire_bus(&bus);
         if (r < 0)
                 goto fail;
 
@@ -321,7 +495,7 @@ enum nss_status _nss_resolve_gethostbyname3_r(
         if (r < 0)
                 goto fail;
 
-        r = sd_bus_call(bus, req, SD_RESOLVED_QUERY_TIMEOUT_USEC, &error, &reply);
+        r = call_bus(&bus, req, &error, &reply);
         if (r < 0) {
                 if (sd_bus_error_has_name(&error, _BUS_ERROR_DNS "NXDOMAIN")) {
                         *errnop = ESRCH;
@@ -462,7 +636,7 @@ enum nss_status _nss_resolve_gethostbyaddr2_r(
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *req = NULL, *reply = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         char *r_name, *r_aliases, *r_addr, *r_addr_list;
-        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_(release_busp) sd_bus *bus = NULL;
         enum nss_status ret = NSS_STATUS_UNAVAIL;
         unsigned c = 0, i = 0;
         size_t ms = 0, idx;
@@ -489,7 +663,7 @@ enum nss_status _nss_resolve_gethostbyaddr2_r(
                 return NSS_STATUS_UNAVAIL;
         }
 
-        r = sd_bus_open_system(&bus);
+        r = acquire_bus(&bus);
         if (r < 0)
                 goto fail;
 
@@ -519,7 +693,7 @@ enum nss_status _nss_resolve_gethostbyaddr2_r(
         if (r < 0)
                 goto fail;
 
-        r = sd_bus_call(bus, req, SD_RESOLVED_QUERY_TIMEOUT_USEC, &error, &reply);
+        r = call_bus(&bus, req, &error, &reply);
         if (r < 0) {
                 if (sd_bus_error_has_name(&error, _BUS_ERROR_DNS "NXDOMAIN")) {
                         *errnop = ESRCH;
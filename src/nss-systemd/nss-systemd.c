@@ -148,7 +148,7 @@ enum nss_status _nss_systemd_getpwnam_r(
         _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         uint32_t translated;
         size_t l;
-        int bypass, r;
+        int bypass, k, r;
 
         BLOCK_SIGNALS(NSS_SIGNALS_BLOCK);
 
@@ -179,19 +179,24 @@ enum nss_status _nss_systemd_getpwnam_r(
         if (getenv_bool_secure("SYSTEMD_NSS_DYNAMIC_BYPASS") > 0)
                 goto not_found;
 
+        /* PID 1 mirrors all dynamic users as symlinks in /run/systemd/dynamic-uid/, which are much cheaper to
+         * look at than doing a bus round trip. Only if that doesn't know the user ask PID 1, as its /run might
+         * not be the one visible to us. */
+        r = direct_lookup_name(name, (uid_t*) &translated);
+        if (r >= 0)
+                goto found;
+
         bypass = getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS");
         if (bypass <= 0) {
-                r = sd_bus_open_system(&bus);
-                if (r < 0)
+                k = sd_bus_open_system(&bus);
+                if (k < 0)
                         bypass = 1;
         }
 
         if (bypass > 0) {
-                r = direct_lookup_name(name, (uid_t*) &translated);
                 if (r == -ENOENT)
                         goto not_found;
-                if (r < 0)
-                        goto fail;
+                goto fail;
         } else {
                 r = sd_bus_call_method(bus,
                                        "org.freedesktop.systemd1",
@@ -214,6 +219,7 @@ enum nss_status _nss_systemd_getpwnam_r(
                         goto fail;
         }
 
+found:
         l = strlen(name);
         if (buflen < l+1) {
                 *errnop = ERANGE;
@@ -254,7 +260,7 @@ enum nss_status _nss_systemd_getpwuid_r(
         _cleanup_free_ char *direct = NULL;
         const char *translated;
         size_t l;
-        int bypass, r;
+        int bypass, k, r;
 
         BLOCK_SIGNALS(NSS_SIGNALS_BLOCK);
 
@@ -282,21 +288,24 @@ enum nss_status _nss_systemd_getpwuid_r(
         if (getenv_bool_secure("SYSTEMD_NSS_DYNAMIC_BYPASS") > 0)
                 goto not_found;
 
+        /* Try the symlinks first, see above */
+        r = direct_lookup_uid(uid, &direct);
+        if (r >= 0) {
+                translated = direct;
+                goto found;
+        }
+
         bypass = getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS");
         if (bypass <= 0) {
-                r = sd_bus_open_system(&bus);
-                if (r < 0)
+                k = sd_bus_open_system(&bus);
+                if (k < 0)
                         bypass = 1;
         }
 
         if (bypass > 0) {
-                r = direct_lookup_uid(uid, &direct);
                 if (r == -ENOENT)
                         goto not_found;
-                if (r < 0)
-                        goto fail;
-
-                translated = direct;
+                goto fail;
 
         } else {
                 r = sd_bus_call_method(bus,
@@ -320,6 +329,7 @@ enum nss_status _nss_systemd_getpwuid_r(
                         goto fail;
         }
 
+found:
         l = strlen(translated) + 1;
         if (buflen < l) {
                 *errnop = ERANGE;
@@ -361,7 +371,7 @@ enum nss_status _nss_systemd_getgrnam_r(
         _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         uint32_t translated;
         size_t l;
-        int bypass, r;
+        int bypass, k, r;
 
         BLOCK_SIGNALS(NSS_SIGNALS_BLOCK);
 
@@ -389,19 +399,22 @@ enum nss_status _nss_systemd_getgrnam_r(
         if (getenv_bool_secure("SYSTEMD_NSS_DYNAMIC_BYPASS") > 0)
                 goto not_found;
 
+        /* Try the symlinks first, see above */
+        r = direct_lookup_name(name, (uid_t*) &translated);
+        if (r >= 0)
+                goto found;
+
         bypass = getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS");
         if (bypass <= 0) {
-                r = sd_bus_open_system(&bus);
-                if (r < 0)
+                k = sd_bus_open_system(&bus);
+                if (k < 0)
                         bypass = 1;
         }
 
         if (bypass > 0) {
-                r = direct_lookup_name(name, (uid_t*) &translated);
                 if (r == -ENOENT)
                         goto not_found;
-                if (r < 0)
-                        goto fail;
+                goto fail;
         } else {
                 r = sd_bus_call_method(bus,
                                        "org.freedesktop.systemd1",
@@ -424,6 +437,7 @@ enum nss_status _nss_systemd_getgrnam_r(
                         goto fail;
         }
 
+found:
         l = sizeof(char*) + strlen(name) + 1;
         if (buflen < l) {
                 *errnop = ERANGE;
@@ -462,7 +476,7 @@ enum nss_status _nss_systemd_getgrgid_r(
         _cleanup_free_ char *direct = NULL;
         const char *translated;
         size_t l;
-        int bypass, r;
+        int bypass, k, r;
 
         BLOCK_SIGNALS(NSS_SIGNALS_BLOCK);
 
@@ -490,21 +504,24 @@ enum nss_status _nss_systemd_getgrgid_r(
         if (getenv_bool_secure("SYSTEMD_NSS_DYNAMIC_BYPASS") > 0)
                 goto not_found;
 
+        /* Try the symlinks first, see above */
+        r = direct_lookup_uid(gid, &direct);
+        if (r >= 0) {
+                translated = direct;
+                goto found;
+        }
+
         bypass = getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS");
         if (bypass <= 0) {
-                r = sd_bus_open_system(&bus);
-                if (r < 0)
+                k = sd_bus_open_system(&bus);
+                if (k < 0)
                         bypass = 1;
         }
 
         if (bypass > 0) {
-                r = direct_lookup_uid(gid, &direct);
                 if (r == -ENOENT)
                         goto not_found;
-                if (r < 0)
-                        goto fail;
-
-                translated = direct;
+                goto fail;
 
         } else {
                 r = sd_bus_call_method(bus,
@@ -528,6 +545,7 @@ enum nss_status _nss_systemd_getgrgid_r(
                         goto fail;
         }
 
+found:
         l = sizeof(char*) + strlen(translated) + 1;
         if (buflen < l) {
                 *errnop = ERANGE;
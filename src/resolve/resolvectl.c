@@ -973,7 +973,8 @@ static int show_statistics(int argc, char **argv, void *userdata) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         sd_bus *bus = userdata;
         uint64_t n_current_transactions, n_total_transactions,
-                cache_size, n_cache_hit, n_cache_miss,
+                n_coalesced_transactions, n_lookahead, n_lookahead_used,
+                cache_size, n_cache_hit, n_cache_miss, n_cache_evicted,
                 n_dnssec_secure, n_dnssec_insecure, n_dnssec_bogus, n_dnssec_indeterminate;
         int r, dnssec_supported;
 
@@ -1022,6 +1023,35 @@ static int show_statistics(int argc, char **argv, void *userdata) {
 
         reply = sd_bus_message_unref(reply);
 
+        r = sd_bus_get_property(bus,
+                                "org.freedesktop.resolve1",
+                                "/org/freedesktop/resolve1",
+                                "org.freedesktop.resolve1.Manager",
+                                "TransactionCoalescingStatistics",
+                                &error,
+                                &reply,
+                                "(ttt)");
+        if (r >= 0) {
+                r = sd_bus_message_read(reply, "(ttt)",
+                                        &n_coalesced_transactions,
+                                        &n_lookahead,
+                                        &n_lookahead_used);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+
+                printf("   Coalesced Lookups: %" PRIu64 "\n"
+                       "  Lookahead Searches: %" PRIu64 " (%" PRIu64 " used)\n",
+                       n_coalesced_transactions,
+                       n_lookahead,
+                       n_lookahead_used);
+
+                reply = sd_bus_message_unref(reply);
+        } else if (sd_bus_error_has_name(&error, SD_BUS_ERROR_UNKNOWN_PROPERTY))
+                /* Older versions of resolved don't know about this yet */
+                sd_bus_error_free(&error);
+        else
+                return log_error_errno(r, "Failed to get transaction coalescing statistics: %s", bus_error_message(&error, r));
+
         r = sd_bus_get_property(bus,
                                 "org.freedesktop.resolve1",
                                 "/org/freedesktop/resolve1",
@@ -1052,6 +1082,22 @@ static int show_statistics(int argc, char **argv, void *userdata) {
 
         reply = sd_bus_message_unref(reply);
 
+        r = sd_bus_get_property_trivial(bus,
+                                        "org.freedesktop.resolve1",
+                                        "/org/freedesktop/resolve1",
+                                        "org.freedesktop.resolve1.Manager",
+                                        "CacheEvictions",
+                                        &error,
+                                        't',
+                                        &n_cache_evicted);
+        if (r >= 0)
+                printf("     Cache Evictions: %" PRIu64 "\n", n_cache_evicted);
+        else if (sd_bus_error_has_name(&error, SD_BUS_ERROR_UNKNOWN_PROPERTY))
+                /* Older versions of resolved don't know about this yet */
+                sd_bus_error_free(&error);
+        else
+                return log_error_errno(r, "Failed to get cache evictions: %s", bus_error_message(&error, r));
+
         r = sd_bus_get_property(bus,
                                 "org.freedesktop.resolve1",
                                 "/org/freedesktop/resolve1",
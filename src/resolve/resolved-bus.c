@@ -5,16 +5,21 @@
   Copyright 2014 Lennart Poettering
 ***/
 
+#include <sys/socket.h>
+#include <sys/stat.h>
+
 #include "alloc-util.h"
 #include "bus-common-errors.h"
 #include "bus-util.h"
 #include "dns-domain.h"
+#include "fd-util.h"
 #include "resolved-bus.h"
 #include "resolved-def.h"
 #include "resolved-dns-synthesize.h"
 #include "resolved-dnssd.h"
 #include "resolved-dnssd-bus.h"
 #include "resolved-link-bus.h"
+#include "socket-util.h"
 #include "user-util.h"
 #include "utf8.h"
 
@@ -1392,6 +1397,26 @@ static int bus_property_get_transaction_statistics(
                                      (uint64_t) m->n_transactions_total);
 }
 
+static int bus_property_get_transaction_coalescing_statistics(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        Manager *m = userdata;
+
+        assert(reply);
+        assert(m);
+
+        return sd_bus_message_append(reply, "(ttt)",
+                                     (uint64_t) m->n_transactions_coalesced,
+                                     (uint64_t) m->n_search_domain_lookahead,
+                                     (uint64_t) m->n_search_domain_lookahead_used);
+}
+
 static int bus_property_get_cache_statistics(
                 sd_bus *bus,
                 const char *path,
@@ -1417,6 +1442,28 @@ static int bus_property_get_cache_statistics(
         return sd_bus_message_append(reply, "(ttt)", size, hit, miss);
 }
 
+static int bus_property_get_cache_evictions(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        uint64_t evicted = 0;
+        Manager *m = userdata;
+        DnsScope *s;
+
+        assert(reply);
+        assert(m);
+
+        LIST_FOREACH(scopes, s, m->dns_scopes)
+                evicted += s->cache.n_evicted;
+
+        return sd_bus_message_append(reply, "t", evicted);
+}
+
 static int bus_property_get_dnssec_statistics(
                 sd_bus *bus,
                 const char *path,
@@ -1480,9 +1527,11 @@ static int bus_method_reset_statistics(sd_bus_message *message, void *userdata,
         assert(m);
 
         LIST_FOREACH(scopes, s, m->dns_scopes)
-                s->cache.n_hit = s->cache.n_miss = 0;
+                s->cache.n_hit = s->cache.n_miss = s->cache.n_evicted = 0;
 
         m->n_transactions_total = 0;
+        m->n_transactions_coalesced = 0;
+        m->n_search_domain_lookahead = m->n_search_domain_lookahead_used = 0;
         zero(m->n_dnssec_verdict);
 
         return sd_bus_reply_method_return(message, NULL);
@@ -1836,7 +1885,9 @@ static const sd_bus_vtable resolve_vtable[] = {
         SD_BUS_PROPERTY("CurrentDNSServer", "(iiay)", bus_property_get_current_dns_server, offsetof(Manager, current_dns_server), 0),
         SD_BUS_PROPERTY("Domains", "a(isb)", bus_property_get_domains, 0, 0),
         SD_BUS_PROPERTY("TransactionStatistics", "(tt)", bus_property_get_transaction_statistics, 0, 0),
+        SD_BUS_PROPERTY("TransactionCoalescingStatistics", "(ttt)", bus_property_get_transaction_coalescing_statistics, 0, 0),
         SD_BUS_PROPERTY("CacheStatistics", "(ttt)", bus_property_get_cache_statistics, 0, 0),
+        SD_BUS_PROPERTY("CacheEvictions", "t", bus_property_get_cache_evictions, 0, 0),
         SD_BUS_PROPERTY("DNSSEC", "s", bus_property_get_dnssec_mode, 0, 0),
         SD_BUS_PROPERTY("DNSSECStatistics", "(tttt)", bus_property_get_dnssec_statistics, 0, 0),
         SD_BUS_PROPERTY("DNSSECSupported", "b", bus_property_get_dnssec_supported, 0, 0),
@@ -1941,3 +1992,195 @@ int manager_connect_bus(Manager *m) {
 
         return 0;
 }
+
+/* Only the lookup methods are exported on direct connections: everything else is privileged and wants to
+ * talk to polkit, or needs a sender name to track, neither of which exists without the bus daemon. */
+static const sd_bus_vtable resolve_private_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("ResolveHostname", "isit", "a(iiay)st", bus_method_resolve_hostname, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("ResolveAddress", "iiayt", "a(is)t", bus_method_resolve_address, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("ResolveRecord", "isqqt", "a(iqqay)t", bus_method_resolve_record, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("ResolveService", "isssit", "a(qqqsa(iiay)s)aayssst", bus_method_resolve_service, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_VTABLE_END,
+};
+
+#define PRIVATE_BUS_CONNECTIONS_MAX 4096
+
+static int on_private_bus_disconnected(sd_bus_message *message, void *userdata, sd_bus_error *ret_error) {
+        Manager *m = userdata;
+        sd_bus *bus;
+
+        assert(message);
+        assert(m);
+        assert_se(bus = sd_bus_message_get_bus(message));
+
+        if (set_remove(m->private_buses, bus)) {
+                log_debug("Got disconnect on private connection.");
+                sd_bus_flush_close_unref(bus);
+        }
+
+        return 0;
+}
+
+static int on_private_bus_connection(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_close_ int nfd = -1;
+        Manager *m = userdata;
+        sd_id128_t id;
+        int r;
+
+        assert(s);
+        assert(m);
+
+        nfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK|SOCK_CLOEXEC);
+        if (nfd < 0) {
+                log_warning_errno(errno, "Failed to accept private connection, ignoring: %m");
+                return 0;
+        }
+
+        if (set_size(m->private_buses) >= PRIVATE_BUS_CONNECTIONS_MAX) {
+                log_warning("Too many concurrent private connections, refusing.");
+                return 0;
+        }
+
+        r = set_ensure_allocated(&m->private_buses, NULL);
+        if (r < 0) {
+                log_oom();
+                return 0;
+        }
+
+        r = sd_bus_new(&bus);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to allocate new private connection bus: %m");
+                return 0;
+        }
+
+        (void) sd_bus_set_description(bus, "private-bus-connection");
+
+        r = sd_bus_set_fd(bus, nfd, nfd);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to set fd on new connection bus: %m");
+                return 0;
+        }
+
+        nfd = -1;
+
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        r = sd_bus_set_server(bus, 1, id);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to enable server support for new connection bus: %m");
+                return 0;
+        }
+
+        r = sd_bus_set_sender(bus, "org.freedesktop.resolve1");
+        if (r < 0) {
+                log_warning_errno(r, "Failed to set direct connection sender: %m");
+                return 0;
+        }
+
+        r = sd_bus_start(bus);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to start new connection bus: %m");
+                return 0;
+        }
+
+        r = sd_bus_attach_event(bus, m->event, 0);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to attach new connection bus to event loop: %m");
+                return 0;
+        }
+
+        r = sd_bus_match_signal(
+                        bus,
+                        NULL,
+                        "org.freedesktop.DBus.Local",
+                        "/org/freedesktop/DBus/Local",
+                        "org.freedesktop.DBus.Local",
+                        "Disconnected",
+                        on_private_bus_disconnected,
+                        m);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to request match for disconnection on new connection bus: %m");
+                return 0;
+        }
+
+        r = sd_bus_add_object_vtable(bus, NULL, "/org/freedesktop/resolve1", "org.freedesktop.resolve1.Manager", resolve_private_vtable, m);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to register object on new connection bus: %m");
+                return 0;
+        }
+
+        r = set_put(m->private_buses, bus);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to add new connection bus to set: %m");
+                return 0;
+        }
+
+        bus = NULL;
+
+        log_debug("Accepted new private connection.");
+
+        return 0;
+}
+
+int manager_connect_private_bus(Manager *m) {
+        union sockaddr_union sa = {
+                .un.sun_family = AF_UNIX,
+                .un.sun_path = SD_RESOLVED_PRIVATE_BUS_PATH,
+        };
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        assert(m);
+
+        /* nss-resolve is used by every process on the system doing a host lookup. Going through the bus daemon
+         * for each of those means a connection, authentication and Hello() roundtrip per lookup, plus the
+         * marshalling through dbus-daemon. Hence, offer a socket clients can talk to us directly on, and keep
+         * their connection open across lookups. */
+
+        if (m->private_bus_fd >= 0)
+                return 0;
+
+        (void) unlink(sa.un.sun_path);
+
+        fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0);
+        if (fd < 0)
+                return -errno;
+
+        if (bind(fd, &sa.sa, SOCKADDR_UN_LEN(sa.un)) < 0)
+                return -errno;
+
+        /* Everybody may resolve host names, hence everybody may connect */
+        if (chmod(sa.un.sun_path, 0666) < 0)
+                return -errno;
+
+        if (listen(fd, SOMAXCONN) < 0)
+                return -errno;
+
+        r = sd_event_add_io(m->event, &m->private_bus_event_source, fd, EPOLLIN, on_private_bus_connection, m);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(m->private_bus_event_source, "bus-connection");
+
+        m->private_bus_fd = TAKE_FD(fd);
+
+        log_debug("Listening for private D-Bus connections on %s.", sa.un.sun_path);
+
+        return 0;
+}
+
+void manager_disconnect_private_bus(Manager *m) {
+        sd_bus *b;
+
+        assert(m);
+
+        while ((b = set_steal_first(m->private_buses)))
+                sd_bus_flush_close_unref(b);
+
+        m->private_buses = set_free(m->private_buses);
+
+        m->private_bus_event_source = sd_event_source_unref(m->private_bus_event_source);
+        m->private_bus_fd = safe_close(m->private_bus_fd);
+}
@@ -10,6 +10,8 @@
 #include "resolved-manager.h"
 
 int manager_connect_bus(Manager *m);
+int manager_connect_private_bus(Manager *m);
+void manager_disconnect_private_bus(Manager *m);
 int bus_dns_server_append(sd_bus_message *reply, DnsServer *s, bool with_ifindex);
 int bus_property_get_resolve_support(sd_bus *bus, const char *path, const char *interface,
                                      const char *property, sd_bus_message *reply,
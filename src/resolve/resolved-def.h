@@ -29,5 +29,8 @@
 
 #define SD_RESOLVED_QUERY_TIMEOUT_USEC (120 * USEC_PER_SEC)
 
+/* The socket resolved accepts direct D-Bus connections on, used by nss-resolve */
+#define SD_RESOLVED_PRIVATE_BUS_PATH "/run/systemd/resolve/bus"
+
 /* 127.0.0.53 in native endian */
 #define INADDR_DNS_STUB ((in_addr_t) 0x7f000035U)
@@ -15,19 +15,20 @@
 #include "resolved-dns-packet.h"
 #include "string-util.h"
 
-/* Never cache more than 4K entries. RFC 1536, Section 5 suggests to
- * leave DNS caches unbounded, but that's crazy. */
-#define CACHE_MAX 4096
-
 /* We never keep any item longer than 2h in our cache */
 #define CACHE_TTL_MAX_USEC (2 * USEC_PER_HOUR)
 
+/* The TTL we return for entries served after they have expired, as suggested by RFC 8767 */
+#define CACHE_STALE_TTL_SEC 30U
+
+/* Entries that got looked up at least this often are refreshed shortly before they expire, if enabled */
+#define CACHE_PREFETCH_HITS_MIN 3U
+
 /* How long to cache strange rcodes, i.e. rcodes != SUCCESS and != NXDOMAIN (specifically: that's only SERVFAIL for
  * now) */
 #define CACHE_TTL_STRANGE_RCODE_USEC (30 * USEC_PER_SEC)
 
 typedef enum DnsCacheItemType DnsCacheItemType;
-typedef struct DnsCacheItem DnsCacheItem;
 
 enum DnsCacheItemType {
         DNS_CACHE_POSITIVE,
@@ -42,9 +43,13 @@ struct DnsCacheItem {
         DnsResourceRecord *rr;
         int rcode;
 
+        usec_t since;
         usec_t until;
         bool authenticated:1;
         bool shared_owner:1;
+        bool used:1;
+        bool prefetched:1;
+        unsigned n_hit;
 
         int ifindex;
         int owner_family;
@@ -52,6 +57,7 @@ struct DnsCacheItem {
 
         unsigned prioq_idx;
         LIST_FIELDS(DnsCacheItem, by_key);
+        LIST_FIELDS(DnsCacheItem, by_use);
 };
 
 static const char *dns_cache_item_type_to_string(DnsCacheItem *item) {
@@ -86,6 +92,24 @@ static void dns_cache_item_free(DnsCacheItem *i) {
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(DnsCacheItem*, dns_cache_item_free);
 
+static void dns_cache_item_use_link(DnsCache *c, DnsCacheItem *i) {
+        assert(c);
+        assert(i);
+
+        LIST_PREPEND(by_use, c->by_use, i);
+        if (!c->by_use_tail)
+                c->by_use_tail = i;
+}
+
+static void dns_cache_item_use_unlink(DnsCache *c, DnsCacheItem *i) {
+        assert(c);
+        assert(i);
+
+        if (c->by_use_tail == i)
+                c->by_use_tail = i->by_use_prev;
+        LIST_REMOVE(by_use, c->by_use, i);
+}
+
 static void dns_cache_item_unlink_and_free(DnsCache *c, DnsCacheItem *i) {
         DnsCacheItem *first;
 
@@ -103,6 +127,7 @@ static void dns_cache_item_unlink_and_free(DnsCache *c, DnsCacheItem *i) {
                 hashmap_remove(c->by_key, i->key);
 
         prioq_remove(c->by_expiry, i, &i->prioq_idx);
+        dns_cache_item_use_unlink(c, i);
 
         dns_cache_item_free(i);
 }
@@ -137,6 +162,7 @@ static bool dns_cache_remove_by_key(DnsCache *c, DnsResourceKey *key) {
 
         LIST_FOREACH_SAFE(by_key, i, n, first) {
                 prioq_remove(c->by_expiry, i, &i->prioq_idx);
+                dns_cache_item_use_unlink(c, i);
                 dns_cache_item_free(i);
         }
 
@@ -153,39 +179,68 @@ void dns_cache_flush(DnsCache *c) {
 
         assert(hashmap_size(c->by_key) == 0);
         assert(prioq_size(c->by_expiry) == 0);
+        assert(!c->by_use);
+        assert(!c->by_use_tail);
 
         c->by_key = hashmap_free(c->by_key);
         c->by_expiry = prioq_free(c->by_expiry);
 }
 
 static void dns_cache_make_space(DnsCache *c, unsigned add) {
+        unsigned max;
+
         assert(c);
 
         if (add <= 0)
                 return;
 
+        max = c->max > 0 ? c->max : DNS_CACHE_SIZE_DEFAULT;
+
         /* Makes space for n new entries. Note that we actually allow
-         * the cache to grow beyond CACHE_MAX, but only when we shall
-         * add more RRs to the cache than CACHE_MAX at once. In that
+         * the cache to grow beyond the maximum, but only when we shall
+         * add more RRs to the cache than that at once. In that
          * case the cache will be emptied completely otherwise. */
 
+        if (prioq_size(c->by_expiry) + add < max)
+                return;
+
+        /* First, get rid of everything that is past its TTL anyway */
+        dns_cache_prune(c);
+
+        /* Then, evict the oldest entries, but give those a second chance that were looked up since they
+         * were added or got their last chance, so that popular names stay around even if lots of
+         * different names are looked up once. */
         for (;;) {
                 _cleanup_(dns_resource_key_unrefp) DnsResourceKey *key = NULL;
+                char key_str[DNS_RESOURCE_KEY_STRING_MAX];
                 DnsCacheItem *i;
 
                 if (prioq_size(c->by_expiry) <= 0)
                         break;
 
-                if (prioq_size(c->by_expiry) + add < CACHE_MAX)
+                if (prioq_size(c->by_expiry) + add < max)
                         break;
 
-                i = prioq_peek(c->by_expiry);
+                i = c->by_use_tail;
                 assert(i);
 
+                if (i->used) {
+                        i->used = false;
+
+                        dns_cache_item_use_unlink(c, i);
+                        dns_cache_item_use_link(c, i);
+                        continue;
+                }
+
+                log_debug("Evicting cache entry for %s",
+                          dns_resource_key_to_string(i->key, key_str, sizeof key_str));
+
                 /* Take an extra reference to the key so that it
                  * doesn't go away in the middle of the remove call */
                 key = dns_resource_key_ref(i->key);
                 dns_cache_remove_by_key(c, key);
+
+                c->n_evicted++;
         }
 }
 
@@ -207,7 +262,7 @@ void dns_cache_prune(DnsCache *c) {
                 if (t <= 0)
                         t = now(clock_boottime_or_monotonic());
 
-                if (i->until > t)
+                if (usec_add(i->until, c->stale_retention_usec) > t)
                         break;
 
                 /* Depending whether this is an mDNS shared entry
@@ -230,22 +285,13 @@ void dns_cache_prune(DnsCache *c) {
         }
 }
 
-static int dns_cache_item_prioq_compare_func(const void *a, const void *b) {
-        const DnsCacheItem *x = a, *y = b;
-
-        if (x->until < y->until)
-                return -1;
-        if (x->until > y->until)
-                return 1;
-        return 0;
-}
-
 static int dns_cache_init(DnsCache *c) {
         int r;
 
         assert(c);
 
-        r = prioq_ensure_allocated(&c->by_expiry, dns_cache_item_prioq_compare_func);
+        /* Items are ordered by their expiry time alone, which we store as the prioq key */
+        r = prioq_ensure_allocated(&c->by_expiry, NULL);
         if (r < 0)
                 return r;
 
@@ -263,10 +309,12 @@ static int dns_cache_link_item(DnsCache *c, DnsCacheItem *i) {
         assert(c);
         assert(i);
 
-        r = prioq_put(c->by_expiry, i, &i->prioq_idx);
+        r = prioq_put_key(c->by_expiry, i, i->until, &i->prioq_idx);
         if (r < 0)
                 return r;
 
+        dns_cache_item_use_link(c, i);
+
         first = hashmap_get(c->by_key, i->key);
         if (first) {
                 _cleanup_(dns_resource_key_unrefp) DnsResourceKey *k = NULL;
@@ -288,6 +336,7 @@ static int dns_cache_link_item(DnsCache *c, DnsCacheItem *i) {
                 r = hashmap_put(c->by_key, i->key, i);
                 if (r < 0) {
                         prioq_remove(c->by_expiry, i, &i->prioq_idx);
+                        dns_cache_item_use_unlink(c, i);
                         return r;
                 }
         }
@@ -375,16 +424,18 @@ static void dns_cache_item_update_positive(
         dns_resource_key_unref(i->key);
         i->key = dns_resource_key_ref(rr->key);
 
+        i->since = timestamp;
         i->until = calculate_until(rr, (uint32_t) -1, timestamp, false);
         i->authenticated = authenticated;
         i->shared_owner = shared_owner;
+        i->prefetched = false;
 
         i->ifindex = ifindex;
 
         i->owner_family = owner_family;
         i->owner_address = *owner_address;
 
-        prioq_reshuffle(c->by_expiry, i, &i->prioq_idx);
+        prioq_set_key(c->by_expiry, i, i->until, &i->prioq_idx);
 }
 
 static int dns_cache_put_positive(
@@ -444,6 +495,11 @@ static int dns_cache_put_positive(
 
         dns_cache_make_space(c, 1);
 
+        /* Serialize larger RRs once now, so that replies built from the cache can copy their RDATA
+         * instead of encoding it again every time. */
+        if (dns_resource_record_rdata_is_opaque(rr))
+                (void) dns_resource_record_to_wire_format(rr, false);
+
         i = new0(DnsCacheItem, 1);
         if (!i)
                 return -ENOMEM;
@@ -451,6 +507,7 @@ static int dns_cache_put_positive(
         i->type = DNS_CACHE_POSITIVE;
         i->key = dns_resource_key_ref(rr->key);
         i->rr = dns_resource_record_ref(rr);
+        i->since = timestamp;
         i->until = calculate_until(rr, (uint32_t) -1, timestamp, false);
         i->authenticated = authenticated;
         i->shared_owner = shared_owner;
@@ -535,6 +592,7 @@ static int dns_cache_put_negative(
         i->type =
                 rcode == DNS_RCODE_SUCCESS ? DNS_CACHE_NODATA :
                 rcode == DNS_RCODE_NXDOMAIN ? DNS_CACHE_NXDOMAIN : DNS_CACHE_RCODE;
+        i->since = timestamp;
         i->until =
                 i->type == DNS_CACHE_RCODE ? timestamp + CACHE_TTL_STRANGE_RCODE_USEC :
                 calculate_until(soa, nsec_ttl, timestamp, true);
@@ -825,7 +883,53 @@ static DnsCacheItem *dns_cache_get_by_key_follow_cname_dname_nsec(DnsCache *c, D
         return NULL;
 }
 
-int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcode, DnsAnswer **ret, bool *authenticated) {
+static bool dns_cache_items_expired(DnsCacheItem *first, usec_t current) {
+        DnsCacheItem *j;
+
+        LIST_FOREACH(by_key, j, first)
+                if (j->until <= current)
+                        return true;
+
+        return false;
+}
+
+static bool dns_cache_items_want_prefetch(DnsCache *c, DnsCacheItem *first, usec_t current) {
+        DnsCacheItem *j;
+
+        assert(c);
+
+        /* Refresh entries that are popular, once they are in the last tenth of their lifetime */
+
+        if (!c->prefetch)
+                return false;
+
+        LIST_FOREACH(by_key, j, first) {
+                if (j->prefetched)
+                        return false;
+
+                if (j->n_hit >= CACHE_PREFETCH_HITS_MIN &&
+                    current >= j->until - (j->until - j->since) / 10)
+                        break;
+        }
+        if (!j)
+                return false;
+
+        LIST_FOREACH(by_key, j, first)
+                j->prefetched = true;
+
+        return true;
+}
+
+int dns_cache_lookup(
+                DnsCache *c,
+                DnsResourceKey *key,
+                bool clamp_ttl,
+                bool stale,
+                int *rcode,
+                DnsAnswer **ret,
+                bool *authenticated,
+                bool *ret_prefetch) {
+
         _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL;
         char key_str[DNS_RESOURCE_KEY_STRING_MAX];
         unsigned n = 0;
@@ -842,6 +946,12 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
         assert(ret);
         assert(authenticated);
 
+        /* Entries past their TTL are only kept if serving stale data is enabled. They are only returned if
+         * explicitly asked for, i.e. when the upstream servers cannot be reached. */
+
+        if (ret_prefetch)
+                *ret_prefetch = false;
+
         if (key->type == DNS_TYPE_ANY || key->class == DNS_CLASS_ANY) {
                 /* If we have ANY lookups we don't use the cache, so
                  * that the caller refreshes via the network. */
@@ -858,8 +968,10 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
                 return 0;
         }
 
+        current = now(clock_boottime_or_monotonic());
+
         first = dns_cache_get_by_key_follow_cname_dname_nsec(c, key);
-        if (!first) {
+        if (!first || (!stale && dns_cache_items_expired(first, current))) {
                 /* If one question cannot be answered we need to refresh */
 
                 log_debug("Cache miss for %s",
@@ -875,6 +987,9 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
         }
 
         LIST_FOREACH(by_key, j, first) {
+                j->used = true;
+                j->n_hit++;
+
                 if (j->rr) {
                         if (j->rr->key->type == DNS_TYPE_NSEC)
                                 nsec = j;
@@ -892,6 +1007,9 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
         }
 
         if (found_rcode >= 0) {
+                if (ret_prefetch)
+                        *ret_prefetch = dns_cache_items_want_prefetch(c, first, current);
+
                 log_debug("RCODE %s cache hit for %s",
                           dns_rcode_to_string(found_rcode),
                           dns_resource_key_to_string(key, key_str, sizeof(key_str)));
@@ -922,6 +1040,9 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
                 if (!bitmap_isset(nsec->rr->nsec.types, key->type) &&
                     !bitmap_isset(nsec->rr->nsec.types, DNS_TYPE_CNAME) &&
                     !bitmap_isset(nsec->rr->nsec.types, DNS_TYPE_DNAME)) {
+                        if (ret_prefetch)
+                                *ret_prefetch = dns_cache_items_want_prefetch(c, first, current);
+
                         c->n_hit++;
                         return 1;
                 }
@@ -935,6 +1056,9 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
                   nxdomain ? "NXDOMAIN" : "NODATA",
                   dns_resource_key_to_string(key, key_str, sizeof key_str));
 
+        if (ret_prefetch)
+                *ret_prefetch = dns_cache_items_want_prefetch(c, first, current);
+
         if (n <= 0) {
                 c->n_hit++;
 
@@ -948,16 +1072,19 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
         if (!answer)
                 return -ENOMEM;
 
-        if (clamp_ttl)
-                current = now(clock_boottime_or_monotonic());
-
         LIST_FOREACH(by_key, j, first) {
                 _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *rr = NULL;
 
                 if (!j->rr)
                         continue;
 
-                if (clamp_ttl) {
+                if (j->until <= current) {
+                        rr = dns_resource_record_ref(j->rr);
+
+                        r = dns_resource_record_clamp_ttl(&rr, CACHE_STALE_TTL_SEC);
+                        if (r < 0)
+                                return r;
+                } else if (clamp_ttl) {
                         rr = dns_resource_record_ref(j->rr);
 
                         r = dns_resource_record_clamp_ttl(&rr, LESS_BY(j->until, current) / USEC_PER_SEC);
@@ -12,11 +12,31 @@
 #include "prioq.h"
 #include "time-util.h"
 
+/* Never cache more than 4K entries by default. RFC 1536, Section 5 suggests to
+ * leave DNS caches unbounded, but that's crazy. */
+#define DNS_CACHE_SIZE_DEFAULT 4096U
+
+typedef struct DnsCacheItem DnsCacheItem;
+
 typedef struct DnsCache {
         Hashmap *by_key;
         Prioq *by_expiry;
+
+        /* All items, most recently added first. Evicted from the end, unless they were used since. */
+        LIST_HEAD(DnsCacheItem, by_use);
+        DnsCacheItem *by_use_tail;
+
+        unsigned max;
+
+        /* How long to keep entries past their TTL, to serve them when the servers cannot be reached */
+        usec_t stale_retention_usec;
+
+        /* Refresh popular entries before they expire */
+        bool prefetch;
+
         unsigned n_hit;
         unsigned n_miss;
+        unsigned n_evicted;
 } DnsCache;
 
 #include "resolved-dns-answer.h"
@@ -28,7 +48,7 @@ void dns_cache_flush(DnsCache *c);
 void dns_cache_prune(DnsCache *c);
 
 int dns_cache_put(DnsCache *c, DnsResourceKey *key, int rcode, DnsAnswer *answer, bool authenticated, uint32_t nsec_ttl, usec_t timestamp, int owner_family, const union in_addr_union *owner_address);
-int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcode, DnsAnswer **answer, bool *authenticated);
+int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, bool stale, int *rcode, DnsAnswer **answer, bool *authenticated, bool *prefetch);
 
 int dns_cache_check_conflicts(DnsCache *cache, DnsResourceRecord *rr, int owner_family, const union in_addr_union *owner_address);
 
@@ -17,11 +17,16 @@
 #include "fileio.h"
 #include "gcrypt-util.h"
 #include "hexdecoct.h"
+#include "random-util.h"
 #include "resolved-dns-dnssec.h"
 #include "resolved-dns-packet.h"
+#include "siphash24.h"
 #include "string-table.h"
 
 #define VERIFY_RRS_MAX 256
+
+/* How many signature verification results to remember */
+#define VERIFY_CACHE_MAX 256
 #define MAX_KEY_SIZE (32*1024)
 
 /* Permit a maximum clock skew of 1h 10min. This should be enough to deal with DST confusion */
@@ -692,6 +697,128 @@ static void dnssec_fix_rrset_ttl(
         rrsig->expiry = rrsig->rrsig.expiration * USEC_PER_SEC;
 }
 
+/* Checking a signature is expensive, and the same RRsets tend to be validated over and over again, for example
+ * the DNSKEY RRsets of popular zones, or when the same lookup is done via multiple transactions. Hence remember
+ * the outcome for the last couple of digest/signature/key combinations. The cache is keyed by everything the
+ * public key operation depends on, and the entries are compared in full, hence a hit gives the same answer the
+ * verification would have given. */
+typedef struct VerifyCacheEntry {
+        uint64_t fingerprint;
+        uint8_t algorithm;
+        void *data;
+        size_t data_size;
+        void *signature;
+        size_t signature_size;
+        void *key;
+        size_t key_size;
+        bool valid;
+} VerifyCacheEntry;
+
+static VerifyCacheEntry verify_cache[VERIFY_CACHE_MAX] = {};
+static uint8_t verify_cache_hash_key[16];
+static bool verify_cache_hash_key_initialized = false;
+
+static void verify_cache_entry_clear(VerifyCacheEntry *e) {
+        assert(e);
+
+        free(e->data);
+        free(e->signature);
+        free(e->key);
+
+        *e = (VerifyCacheEntry) {};
+}
+
+static uint64_t verify_cache_fingerprint(
+                uint8_t algorithm,
+                const void *data, size_t data_size,
+                DnsResourceRecord *rrsig,
+                DnsResourceRecord *dnskey) {
+
+        struct siphash state;
+
+        if (!verify_cache_hash_key_initialized) {
+                random_bytes(verify_cache_hash_key, sizeof(verify_cache_hash_key));
+                verify_cache_hash_key_initialized = true;
+        }
+
+        siphash24_init(&state, verify_cache_hash_key);
+        siphash24_compress(&algorithm, sizeof(algorithm), &state);
+        siphash24_compress(data, data_size, &state);
+        siphash24_compress(rrsig->rrsig.signature, rrsig->rrsig.signature_size, &state);
+        siphash24_compress(dnskey->dnskey.key, dnskey->dnskey.key_size, &state);
+
+        return siphash24_finalize(&state);
+}
+
+static bool verify_cache_blob_equal(const void *a, size_t a_size, const void *b, size_t b_size) {
+        if (a_size != b_size)
+                return false;
+
+        return a_size == 0 || memcmp(a, b, a_size) == 0;
+}
+
+static int verify_cache_get(
+                uint64_t fingerprint,
+                uint8_t algorithm,
+                const void *data, size_t data_size,
+                DnsResourceRecord *rrsig,
+                DnsResourceRecord *dnskey) {
+
+        VerifyCacheEntry *e;
+
+        /* Returns > 0 if the signature is known to be valid, 0 if it is known to be invalid, -ENOENT if we don't
+         * know */
+
+        e = verify_cache + fingerprint % VERIFY_CACHE_MAX;
+
+        if (!e->data ||
+            e->fingerprint != fingerprint ||
+            e->algorithm != algorithm ||
+            !verify_cache_blob_equal(e->data, e->data_size, data, data_size) ||
+            !verify_cache_blob_equal(e->signature, e->signature_size, rrsig->rrsig.signature, rrsig->rrsig.signature_size) ||
+            !verify_cache_blob_equal(e->key, e->key_size, dnskey->dnskey.key, dnskey->dnskey.key_size))
+                return -ENOENT;
+
+        return e->valid;
+}
+
+static void verify_cache_put(
+                uint64_t fingerprint,
+                uint8_t algorithm,
+                const void *data, size_t data_size,
+                DnsResourceRecord *rrsig,
+                DnsResourceRecord *dnskey,
+                bool valid) {
+
+        VerifyCacheEntry *e;
+
+        e = verify_cache + fingerprint % VERIFY_CACHE_MAX;
+        verify_cache_entry_clear(e);
+
+        e->data = memdup(data, data_size);
+        e->signature = memdup(rrsig->rrsig.signature, rrsig->rrsig.signature_size);
+        e->key = memdup(dnskey->dnskey.key, dnskey->dnskey.key_size);
+        if (!e->data || !e->signature || !e->key) {
+                /* It's just a cache, don't bother */
+                verify_cache_entry_clear(e);
+                return;
+        }
+
+        e->fingerprint = fingerprint;
+        e->algorithm = algorithm;
+        e->data_size = data_size;
+        e->signature_size = rrsig->rrsig.signature_size;
+        e->key_size = dnskey->dnskey.key_size;
+        e->valid = valid;
+}
+
+void dnssec_verify_cache_flush(void) {
+        size_t i;
+
+        for (i = 0; i < VERIFY_CACHE_MAX; i++)
+                verify_cache_entry_clear(verify_cache + i);
+}
+
 int dnssec_verify_rrset(
                 DnsAnswer *a,
                 const DnsResourceKey *key,
@@ -711,6 +838,9 @@ int dnssec_verify_rrset(
         _cleanup_fclose_ FILE *f = NULL;
         size_t hash_size;
         void *hash;
+        const void *data;
+        size_t data_size;
+        uint64_t fingerprint;
         bool wildcard;
 
         assert(key);
@@ -897,40 +1027,56 @@ int dnssec_verify_rrset(
                         return -EIO;
         }
 
-        switch (rrsig->rrsig.algorithm) {
+        /* EdDSA signs the data itself, everything else its digest */
+        if (rrsig->rrsig.algorithm == DNSSEC_ALGORITHM_ED25519) {
+                data = sig_data;
+                data_size = sig_size;
+        } else {
+                data = hash;
+                data_size = hash_size;
+        }
 
-        case DNSSEC_ALGORITHM_RSASHA1:
-        case DNSSEC_ALGORITHM_RSASHA1_NSEC3_SHA1:
-        case DNSSEC_ALGORITHM_RSASHA256:
-        case DNSSEC_ALGORITHM_RSASHA512:
-                r = dnssec_rsa_verify(
-                                gcry_md_algo_name(md_algorithm),
-                                hash, hash_size,
-                                rrsig,
-                                dnskey);
-                break;
+        fingerprint = verify_cache_fingerprint(rrsig->rrsig.algorithm, data, data_size, rrsig, dnskey);
+
+        r = verify_cache_get(fingerprint, rrsig->rrsig.algorithm, data, data_size, rrsig, dnskey);
+        if (r == -ENOENT) {
+                switch (rrsig->rrsig.algorithm) {
+
+                case DNSSEC_ALGORITHM_RSASHA1:
+                case DNSSEC_ALGORITHM_RSASHA1_NSEC3_SHA1:
+                case DNSSEC_ALGORITHM_RSASHA256:
+                case DNSSEC_ALGORITHM_RSASHA512:
+                        r = dnssec_rsa_verify(
+                                        gcry_md_algo_name(md_algorithm),
+                                        hash, hash_size,
+                                        rrsig,
+                                        dnskey);
+                        break;
 
-        case DNSSEC_ALGORITHM_ECDSAP256SHA256:
-        case DNSSEC_ALGORITHM_ECDSAP384SHA384:
-                r = dnssec_ecdsa_verify(
-                                gcry_md_algo_name(md_algorithm),
-                                rrsig->rrsig.algorithm,
-                                hash, hash_size,
-                                rrsig,
-                                dnskey);
-                break;
+                case DNSSEC_ALGORITHM_ECDSAP256SHA256:
+                case DNSSEC_ALGORITHM_ECDSAP384SHA384:
+                        r = dnssec_ecdsa_verify(
+                                        gcry_md_algo_name(md_algorithm),
+                                        rrsig->rrsig.algorithm,
+                                        hash, hash_size,
+                                        rrsig,
+                                        dnskey);
+                        break;
 #if GCRYPT_VERSION_NUMBER >= 0x010600
-        case DNSSEC_ALGORITHM_ED25519:
-                r = dnssec_eddsa_verify(
-                                rrsig->rrsig.algorithm,
-                                sig_data, sig_size,
-                                rrsig,
-                                dnskey);
-                break;
+                case DNSSEC_ALGORITHM_ED25519:
+                        r = dnssec_eddsa_verify(
+                                        rrsig->rrsig.algorithm,
+                                        sig_data, sig_size,
+                                        rrsig,
+                                        dnskey);
+                        break;
 #endif
+                }
+                if (r < 0)
+                        return r;
+
+                verify_cache_put(fingerprint, rrsig->rrsig.algorithm, data, data_size, rrsig, dnskey, r > 0);
         }
-        if (r < 0)
-                return r;
 
         /* Now, fix the ttl, expiry, and remember the synthesizing source and the signer */
         if (r > 0)
@@ -2226,6 +2372,9 @@ int dnssec_test_positive_wildcard(
 
 #else
 
+void dnssec_verify_cache_flush(void) {
+}
+
 int dnssec_verify_rrset(
                 DnsAnswer *a,
                 const DnsResourceKey *key,
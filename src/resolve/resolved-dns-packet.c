@@ -842,6 +842,16 @@ int dns_packet_append_rr(DnsPacket *p, const DnsResourceRecord *rr, const DnsAns
 
         rds = p->size - saved_size;
 
+        /* If the RR was serialized before, and its RDATA contains nothing that depends on where it ends
+         * up in the packet, just copy it over instead of encoding all fields again. The RRSIG signer
+         * name is lower-cased in the canonical form though, hence only reuse it in the same form. */
+        if (rr->wire_format &&
+            dns_resource_record_rdata_is_opaque(rr) &&
+            (rr->key->type != DNS_TYPE_RRSIG || rr->wire_format_canonical == p->canonical_form)) {
+                r = dns_packet_append_blob(p, DNS_RESOURCE_RECORD_RDATA(rr), DNS_RESOURCE_RECORD_RDATA_SIZE(rr), NULL);
+                goto rdata_done;
+        }
+
         switch (rr->unparseable ? _DNS_TYPE_INVALID : rr->key->type) {
 
         case DNS_TYPE_SRV:
@@ -1132,6 +1142,8 @@ int dns_packet_append_rr(DnsPacket *p, const DnsResourceRecord *rr, const DnsAns
                 r = dns_packet_append_blob(p, rr->generic.data, rr->generic.data_size, NULL);
                 break;
         }
+
+rdata_done:
         if (r < 0)
                 goto fail;
 
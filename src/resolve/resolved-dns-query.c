@@ -62,6 +62,10 @@ DnsQueryCandidate* dns_query_candidate_free(DnsQueryCandidate *c) {
         set_free(c->transactions);
         dns_search_domain_unref(c->search_domain);
 
+        dns_query_candidate_free(c->lookahead);
+        if (c->lookahead_for)
+                c->lookahead_for->lookahead = NULL;
+
         if (c->query)
                 LIST_REMOVE(candidates_by_query, c->query->candidates, c);
 
@@ -113,6 +117,8 @@ static int dns_query_candidate_add_transaction(DnsQueryCandidate *c, DnsResource
         } else {
                 if (set_contains(c->transactions, t))
                         return 0;
+
+                c->scope->manager->n_transactions_coalesced++;
         }
 
         r = set_ensure_allocated(&c->transactions, NULL);
@@ -287,12 +293,53 @@ fail:
         return r;
 }
 
+static int dns_query_candidate_setup_lookahead(DnsQueryCandidate *c) {
+        DnsQueryCandidate *l;
+        int r;
+
+        assert(c);
+        assert(!c->lookahead_for);
+
+        c->lookahead = dns_query_candidate_free(c->lookahead);
+
+        if (!c->search_domain)
+                return 0;
+
+        r = dns_query_candidate_new(&l, c->query, c->scope);
+        if (r < 0)
+                return r;
+
+        l->search_domain = dns_search_domain_ref(c->search_domain);
+        l->lookahead_for = c;
+        c->lookahead = l;
+
+        r = dns_query_candidate_next_search_domain(l);
+        if (r <= 0)
+                goto fail;
+
+        r = dns_query_candidate_setup_transactions(l);
+        if (r <= 0)
+                goto fail;
+
+        c->scope->manager->n_search_domain_lookahead++;
+        return 1;
+
+fail:
+        dns_query_candidate_free(l);
+        return r;
+}
+
 void dns_query_candidate_notify(DnsQueryCandidate *c) {
         DnsTransactionState state;
         int r;
 
         assert(c);
 
+        /* The transactions of a lookahead candidate are picked up by the candidate it looks ahead for, once
+         * (and if) that one gets to its search domain */
+        if (c->lookahead_for)
+                return;
+
         state = dns_query_candidate_state(c);
 
         if (DNS_TRANSACTION_IS_LIVE(state))
@@ -305,13 +352,28 @@ void dns_query_candidate_notify(DnsQueryCandidate *c) {
                         goto fail;
 
                 if (r > 0) {
-                        /* OK, there's another search domain to try, let's do so. */
+                        /* OK, there's another search domain to try, let's do so. If we looked ahead
+                         * already, the transactions are running or even complete by now, and are found
+                         * again by dns_query_candidate_add_transaction(). */
 
                         r = dns_query_candidate_setup_transactions(c);
                         if (r < 0)
                                 goto fail;
 
+                        if (c->lookahead && c->lookahead->search_domain == c->search_domain)
+                                c->scope->manager->n_search_domain_lookahead_used++;
+
                         if (r > 0) {
+                                /* Look ahead further, before we start, as that might already finish us */
+                                r = dns_query_candidate_setup_lookahead(c);
+                                if (r < 0)
+                                        log_debug_errno(r, "Failed to look ahead to the next search domain, ignoring: %m");
+                                else if (r > 0) {
+                                        r = dns_query_candidate_go(c->lookahead);
+                                        if (r < 0)
+                                                goto fail;
+                                }
+
                                 /* New transactions where queued. Start them and wait */
 
                                 r = dns_query_candidate_go(c);
@@ -576,6 +638,12 @@ static int dns_query_add_candidate(DnsQuery *q, DnsScope *s) {
         if (r < 0)
                 goto fail;
 
+        if (r > 0) {
+                r = dns_query_candidate_setup_lookahead(c);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to look ahead to the next search domain, ignoring: %m");
+        }
+
         return 0;
 
 fail:
@@ -903,6 +971,10 @@ void dns_query_ready(DnsQuery *q) {
         LIST_FOREACH(candidates_by_query, c, q->candidates) {
                 DnsTransactionState state;
 
+                /* Lookahead candidates only matter once their owner moves on to their search domain */
+                if (c->lookahead_for)
+                        continue;
+
                 state = dns_query_candidate_state(c);
                 switch (state) {
 
@@ -1064,6 +1136,11 @@ int dns_query_bus_track(DnsQuery *q, sd_bus_message *m) {
         assert(q);
         assert(m);
 
+        /* Direct connections have no sender name to track. If such a client goes away, the connection is
+         * closed and the reply is simply dropped once the query completes. */
+        if (!sd_bus_message_get_sender(m))
+                return 0;
+
         if (!q->bus_track) {
                 r = sd_bus_track_new(sd_bus_message_get_bus(m), &q->bus_track, on_bus_track, q);
                 if (r < 0)
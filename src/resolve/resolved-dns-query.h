@@ -25,6 +25,12 @@ struct DnsQueryCandidate {
 
         DnsSearchDomain *search_domain;
 
+        /* While a candidate waits for the replies for its search domain, the next search domain is already
+         * tried by a second candidate, so that its transactions are ready to be picked up if we need to move
+         * on. Such a lookahead candidate never completes the query on its own. */
+        DnsQueryCandidate *lookahead;
+        DnsQueryCandidate *lookahead_for;
+
         int error_code;
         Set *transactions;
 
@@ -19,6 +19,7 @@
 #include "string-util.h"
 #include "strv.h"
 #include "terminal-util.h"
+#include "unaligned.h"
 
 DnsResourceKey* dns_resource_key_new(uint16_t class, uint16_t type, const char *name) {
         DnsResourceKey *k;
@@ -1719,11 +1720,56 @@ DnsResourceRecord *dns_resource_record_copy(DnsResourceRecord *rr) {
                 break;
         }
 
+        if (rr->wire_format) {
+                copy->wire_format = memdup(rr->wire_format, rr->wire_format_size);
+                if (!copy->wire_format)
+                        return NULL;
+                copy->wire_format_size = rr->wire_format_size;
+                copy->wire_format_rdata_offset = rr->wire_format_rdata_offset;
+                copy->wire_format_canonical = rr->wire_format_canonical;
+        }
+
         t = TAKE_PTR(copy);
 
         return t;
 }
 
+static void dns_resource_record_set_ttl(DnsResourceRecord *rr, uint32_t ttl) {
+        assert(rr);
+
+        rr->ttl = ttl;
+
+        /* Keep the serialized form in sync, the TTL field precedes the RDLENGTH field right before the
+         * RDATA */
+        if (rr->wire_format) {
+                assert(rr->wire_format_rdata_offset >= sizeof(uint32_t) + sizeof(uint16_t));
+                unaligned_write_be32((uint8_t*) rr->wire_format + rr->wire_format_rdata_offset - sizeof(uint32_t) - sizeof(uint16_t), ttl);
+        }
+}
+
+bool dns_resource_record_rdata_is_opaque(const DnsResourceRecord *rr) {
+        assert(rr);
+
+        /* Returns true if the RDATA of this RR contains no domain names that would be compressed when
+         * serializing it, i.e. if its serialized RDATA may be copied verbatim into any packet. */
+
+        if (rr->unparseable)
+                return true;
+
+        return IN_SET(rr->key->type,
+                      DNS_TYPE_TXT,
+                      DNS_TYPE_SPF,
+                      DNS_TYPE_DS,
+                      DNS_TYPE_SSHFP,
+                      DNS_TYPE_DNSKEY,
+                      DNS_TYPE_RRSIG,
+                      DNS_TYPE_NSEC,
+                      DNS_TYPE_NSEC3,
+                      DNS_TYPE_TLSA,
+                      DNS_TYPE_CAA,
+                      DNS_TYPE_OPENPGPKEY);
+}
+
 int dns_resource_record_clamp_ttl(DnsResourceRecord **rr, uint32_t max_ttl) {
         DnsResourceRecord *old_rr, *new_rr;
         uint32_t new_ttl;
@@ -1740,7 +1786,7 @@ int dns_resource_record_clamp_ttl(DnsResourceRecord **rr, uint32_t max_ttl) {
 
         if (old_rr->n_ref == 1) {
                 /* Patch in place */
-                old_rr->ttl = new_ttl;
+                dns_resource_record_set_ttl(old_rr, new_ttl);
                 return 1;
         }
 
@@ -1748,7 +1794,7 @@ int dns_resource_record_clamp_ttl(DnsResourceRecord **rr, uint32_t max_ttl) {
         if (!new_rr)
                 return -ENOMEM;
 
-        new_rr->ttl = new_ttl;
+        dns_resource_record_set_ttl(new_rr, new_ttl);
 
         dns_resource_record_unref(*rr);
         *rr = new_rr;
@@ -44,6 +44,12 @@ int dns_scope_new(Manager *m, DnsScope **ret, Link *l, DnsProtocol protocol, int
         s->protocol = protocol;
         s->family = family;
         s->resend_timeout = MULTICAST_RESEND_TIMEOUT_MIN_USEC;
+        s->cache.max = m->cache_size;
+
+        if (protocol == DNS_PROTOCOL_DNS) {
+                s->cache.stale_retention_usec = m->stale_retention_usec;
+                s->cache.prefetch = m->cache_prefetch;
+        }
 
         if (protocol == DNS_PROTOCOL_DNS) {
                 /* Copy DNSSEC mode from the link if it is set there,
@@ -111,6 +117,9 @@ DnsScope* dns_scope_free(DnsScope *s) {
 
         sd_event_source_unref(s->announce_event_source);
 
+        set_free_with_destructor(s->prefetch_keys, dns_resource_key_unref);
+        sd_event_source_unref(s->prefetch_event_source);
+
         dns_cache_flush(&s->cache);
         dns_zone_flush(&s->zone);
 
@@ -810,6 +819,76 @@ DnsTransaction *dns_scope_find_transaction(DnsScope *scope, DnsResourceKey *key,
         return t;
 }
 
+static int on_prefetch(sd_event_source *s, void *userdata) {
+        DnsScope *scope = userdata;
+        DnsResourceKey *key;
+        int r;
+
+        assert(s);
+        assert(scope);
+
+        scope->prefetch_event_source = sd_event_source_unref(scope->prefetch_event_source);
+
+        while ((key = set_steal_first(scope->prefetch_keys))) {
+                _cleanup_(dns_resource_key_unrefp) DnsResourceKey *k = key;
+                char key_str[DNS_RESOURCE_KEY_STRING_MAX];
+                DnsTransaction *t;
+
+                /* Already being looked up? */
+                t = dns_scope_find_transaction(scope, k, false);
+                if (t && DNS_TRANSACTION_IS_LIVE(t->state))
+                        continue;
+
+                r = dns_transaction_new(&t, scope, k);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to create transaction for refreshing cache entry, ignoring: %m");
+                        continue;
+                }
+
+                t->prefetch = true;
+
+                log_debug("Refreshing cache entry for <%s> before it expires.",
+                          dns_resource_key_to_string(k, key_str, sizeof key_str));
+
+                /* Note that the transaction frees itself once it's complete, as nobody is referencing it */
+                r = dns_transaction_go(t);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to start transaction for refreshing cache entry, ignoring: %m");
+                        dns_transaction_free(t);
+                }
+        }
+
+        return 0;
+}
+
+int dns_scope_prefetch(DnsScope *scope, DnsResourceKey *key) {
+        int r;
+
+        assert(scope);
+        assert(key);
+
+        r = set_ensure_allocated(&scope->prefetch_keys, &dns_resource_key_hash_ops);
+        if (r < 0)
+                return r;
+
+        r = set_put(scope->prefetch_keys, key);
+        if (r <= 0)
+                return r;
+
+        dns_resource_key_ref(key);
+
+        if (scope->prefetch_event_source)
+                return 0;
+
+        r = sd_event_add_defer(scope->manager->event, &scope->prefetch_event_source, on_prefetch, scope);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(scope->prefetch_event_source, "dns-scope-prefetch");
+
+        return 0;
+}
+
 static int dns_scope_make_conflict_packet(
                 DnsScope *s,
                 DnsResourceRecord *rr,
@@ -47,6 +47,10 @@ struct DnsScope {
         bool announced:1;
         sd_event_source *announce_event_source;
 
+        /* Keys of cache entries to refresh, before they expire */
+        Set *prefetch_keys;
+        sd_event_source *prefetch_event_source;
+
         RateLimit ratelimit;
 
         usec_t resend_timeout;
@@ -92,6 +96,7 @@ int dns_scope_make_reply_packet(DnsScope *s, uint16_t id, int rcode, DnsQuestion
 void dns_scope_process_query(DnsScope *s, DnsStream *stream, DnsPacket *p);
 
 DnsTransaction *dns_scope_find_transaction(DnsScope *scope, DnsResourceKey *key, bool cache_ok);
+int dns_scope_prefetch(DnsScope *scope, DnsResourceKey *key);
 
 int dns_scope_notify_conflict(DnsScope *scope, DnsResourceRecord *rr);
 void dns_scope_check_conflicts(DnsScope *scope, DnsPacket *p);
@@ -123,6 +123,8 @@ DnsServer* dns_server_unref(DnsServer *s)  {
         if (s->n_ref > 0)
                 return NULL;
 
+        dns_server_unref_stream(s);
+
         free(s->server_string);
         return mfree(s);
 }
@@ -168,9 +170,27 @@ void dns_server_unlink(DnsServer *s) {
         if (s->manager->current_dns_server == s)
                 manager_set_dns_server(s->manager, NULL);
 
+        /* No new transactions will use this server, hence there's no point in keeping the connection */
+        dns_server_unref_stream(s);
+
         dns_server_unref(s);
 }
 
+void dns_server_unref_stream(DnsServer *s) {
+        DnsStream *ref;
+
+        assert(s);
+
+        /* Detaches the stream from the server. Transactions still waiting for a reply on it keep it around until
+         * they are done. The stream only has a weak reference to the server, clear it first. */
+
+        ref = TAKE_PTR(s->stream);
+        if (ref) {
+                ref->server = NULL;
+                dns_stream_unref(ref);
+        }
+}
+
 void dns_server_move_back_and_unmark(DnsServer *s) {
         DnsServer *tail;
 
@@ -831,6 +851,9 @@ void dns_server_reset_features(DnsServer *s) {
 
         s->warned_downgrade = false;
 
+        /* The network changed, the old connection might not be usable anymore */
+        dns_server_unref_stream(s);
+
         dns_server_reset_counters(s);
 }
 
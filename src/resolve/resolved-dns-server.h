@@ -81,6 +81,9 @@ struct DnsServer {
         /* If linked is set, then this server appears in the servers linked list */
         bool linked:1;
         LIST_FIELDS(DnsServer, servers);
+
+        /* The TCP connection to this server, kept open for reuse by further transactions */
+        DnsStream *stream;
 };
 
 int dns_server_new(
@@ -96,6 +99,7 @@ DnsServer* dns_server_ref(DnsServer *s);
 DnsServer* dns_server_unref(DnsServer *s);
 
 void dns_server_unlink(DnsServer *s);
+void dns_server_unref_stream(DnsServer *s);
 void dns_server_move_back_and_unmark(DnsServer *s);
 
 void dns_server_packet_received(DnsServer *s, int protocol, DnsServerFeatureLevel level, usec_t rtt, size_t size);
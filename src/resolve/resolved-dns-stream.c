@@ -29,7 +29,7 @@ static int dns_stream_update_io(DnsStream *s) {
 
         assert(s);
 
-        if (s->write_packet && s->n_written < sizeof(s->write_size) + s->write_packet->size)
+        if (!ordered_set_isempty(s->write_queue))
                 f |= EPOLLOUT;
         if (!s->read_packet || s->n_read < sizeof(s->read_size) + s->read_packet->size)
                 f |= EPOLLIN;
@@ -37,6 +37,13 @@ static int dns_stream_update_io(DnsStream *s) {
         return sd_event_source_set_io_events(s->io_event_source, f);
 }
 
+static int dns_stream_update_timeout(DnsStream *s) {
+        assert(s);
+
+        /* Streams are closed after they have been idle for a while, i.e. nothing was queued or received */
+        return sd_event_source_set_time(s->timeout_event_source, now(clock_boottime_or_monotonic()) + DNS_STREAM_TIMEOUT_USEC);
+}
+
 static int dns_stream_complete(DnsStream *s, int error) {
         assert(s);
 
@@ -184,26 +191,32 @@ static int on_stream_timeout(sd_event_source *es, usec_t usec, void *userdata) {
 }
 
 static int on_stream_io(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        _cleanup_(dns_stream_unrefp) DnsStream *ref = NULL;
         DnsStream *s = userdata;
+        DnsPacket *p;
         int r;
 
         assert(s);
 
+        /* The packet and completion handlers might drop the last reference to the stream */
+        ref = dns_stream_ref(s);
+
         r = dns_stream_identify(s);
         if (r < 0)
                 return dns_stream_complete(s, -r);
 
-        if ((revents & EPOLLOUT) &&
-            s->write_packet &&
-            s->n_written < sizeof(s->write_size) + s->write_packet->size) {
-
+        p = ordered_set_first(s->write_queue);
+        if ((revents & EPOLLOUT) && p) {
                 struct iovec iov[2];
+                be16_t write_size;
                 ssize_t ss;
 
-                iov[0].iov_base = &s->write_size;
-                iov[0].iov_len = sizeof(s->write_size);
-                iov[1].iov_base = DNS_PACKET_DATA(s->write_packet);
-                iov[1].iov_len = s->write_packet->size;
+                write_size = htobe16(p->size);
+
+                iov[0].iov_base = &write_size;
+                iov[0].iov_len = sizeof(write_size);
+                iov[1].iov_base = DNS_PACKET_DATA(p);
+                iov[1].iov_len = p->size;
 
                 IOVEC_INCREMENT(iov, 2, s->n_written);
 
@@ -214,8 +227,14 @@ static int on_stream_io(sd_event_source *es, int fd, uint32_t revents, void *use
                 } else
                         s->n_written += ss;
 
-                /* Are we done? If so, disable the event source for EPOLLOUT */
-                if (s->n_written >= sizeof(s->write_size) + s->write_packet->size) {
+                /* Are we done? If so, go on with the next packet, or disable the event source for EPOLLOUT */
+                if (s->n_written >= sizeof(write_size) + p->size) {
+                        assert_se(ordered_set_remove(s->write_queue, p) == p);
+                        dns_packet_unref(p);
+
+                        s->n_written = 0;
+                        s->written = true;
+
                         r = dns_stream_update_io(s);
                         if (r < 0)
                                 return dns_stream_complete(s, -r);
@@ -295,16 +314,33 @@ static int on_stream_io(sd_event_source *es, int fd, uint32_t revents, void *use
                                 if (r < 0)
                                         return dns_stream_complete(s, -r);
 
+                                r = dns_stream_update_timeout(s);
+                                if (r < 0)
+                                        return dns_stream_complete(s, -r);
+
                                 /* If there's a packet handler
                                  * installed, call that. Note that
                                  * this is optional... */
-                                if (s->on_packet)
-                                        return s->on_packet(s);
+                                if (s->on_packet) {
+                                        r = s->on_packet(s);
+                                        if (r < 0)
+                                                return r;
+
+                                        /* If the handler took the packet, and the stream is still around,
+                                         * continue with reading the next one. */
+                                        if (!s->read_packet && s->fd >= 0) {
+                                                r = dns_stream_update_io(s);
+                                                if (r < 0)
+                                                        return dns_stream_complete(s, -r);
+                                        }
+
+                                        return 0;
+                                }
                         }
                 }
         }
 
-        if ((s->write_packet && s->n_written >= sizeof(s->write_size) + s->write_packet->size) &&
+        if (s->written && ordered_set_isempty(s->write_queue) &&
             (s->read_packet && s->n_read >= sizeof(s->read_size) + s->read_packet->size))
                 return dns_stream_complete(s, 0);
 
@@ -328,14 +364,16 @@ DnsStream *dns_stream_unref(DnsStream *s) {
                 s->manager->n_dns_streams--;
         }
 
-        dns_packet_unref(s->write_packet);
+        /* The server holds a reference to its stream, hence it must have let go of it already */
+        assert(!s->server);
+        assert(!s->transactions);
+
+        ordered_set_free_with_destructor(s->write_queue, dns_packet_unref);
         dns_packet_unref(s->read_packet);
 
         return mfree(s);
 }
 
-DEFINE_TRIVIAL_CLEANUP_FUNC(DnsStream*, dns_stream_unref);
-
 DnsStream *dns_stream_ref(DnsStream *s) {
         if (!s)
                 return NULL;
@@ -392,14 +430,40 @@ int dns_stream_new(Manager *m, DnsStream **ret, DnsProtocol protocol, int fd) {
 }
 
 int dns_stream_write_packet(DnsStream *s, DnsPacket *p) {
+        int r;
+
         assert(s);
+        assert(p);
 
-        if (s->write_packet)
-                return -EBUSY;
+        r = ordered_set_ensure_allocated(&s->write_queue, &trivial_hash_ops);
+        if (r < 0)
+                return r;
 
-        s->write_packet = dns_packet_ref(p);
-        s->write_size = htobe16(p->size);
-        s->n_written = 0;
+        /* Returns 0 if the packet is already queued */
+        r = ordered_set_put(s->write_queue, p);
+        if (r < 0)
+                return r;
+        if (r > 0)
+                dns_packet_ref(p);
+
+        r = dns_stream_update_timeout(s);
+        if (r < 0)
+                return r;
 
         return dns_stream_update_io(s);
 }
+
+DnsPacket *dns_stream_take_read_packet(DnsStream *s) {
+        assert(s);
+
+        /* Returns the packet that was just read completely, and starts reading the next one */
+
+        if (!s->read_packet)
+                return NULL;
+
+        if (s->n_read < sizeof(s->read_size) + s->read_packet->size)
+                return NULL;
+
+        s->n_read = 0;
+        return TAKE_PTR(s->read_packet);
+}
@@ -7,6 +7,7 @@
   Copyright 2014 Lennart Poettering
 ***/
 
+#include "ordered-set.h"
 #include "socket-util.h"
 
 typedef struct DnsStream DnsStream;
@@ -20,6 +21,9 @@ typedef struct DnsStream DnsStream;
  *   1. The normal transaction logic when doing a DNS or LLMNR lookup via TCP
  *   2. The LLMNR logic when accepting a TCP-based lookup
  *   3. The DNS stub logic when accepting a TCP-based lookup
+ *
+ * Streams to upstream DNS servers are kept open and shared by all transactions talking to that server, with
+ * replies being matched to the transactions by their ID.
  */
 
 struct DnsStream {
@@ -40,14 +44,20 @@ struct DnsStream {
         sd_event_source *io_event_source;
         sd_event_source *timeout_event_source;
 
-        be16_t write_size, read_size;
-        DnsPacket *write_packet, *read_packet;
+        /* Packets waiting to be written, the first one is the one currently being written */
+        OrderedSet *write_queue;
+        be16_t read_size;
+        DnsPacket *read_packet;
         size_t n_written, n_read;
+        bool written:1;
 
         int (*on_packet)(DnsStream *s);
         int (*complete)(DnsStream *s, int error);
 
-        DnsTransaction *transaction; /* when used by the transaction logic */
+        /* when used by the transaction logic */
+        DnsServer *server;           /* weak reference, the server keeps a reference to its stream */
+        LIST_HEAD(DnsTransaction, transactions);
+
         DnsQuery *query;             /* when used by the DNS stub logic */
 
         LIST_FIELDS(DnsStream, streams);
@@ -57,7 +67,10 @@ int dns_stream_new(Manager *m, DnsStream **s, DnsProtocol protocol, int fd);
 DnsStream *dns_stream_unref(DnsStream *s);
 DnsStream *dns_stream_ref(DnsStream *s);
 
+DEFINE_TRIVIAL_CLEANUP_FUNC(DnsStream*, dns_stream_unref);
+
 int dns_stream_write_packet(DnsStream *s, DnsPacket *p);
+DnsPacket *dns_stream_take_read_packet(DnsStream *s);
 
 static inline bool DNS_STREAM_QUEUED(DnsStream *s) {
         assert(s);
@@ -65,5 +78,5 @@ static inline bool DNS_STREAM_QUEUED(DnsStream *s) {
         if (s->fd < 0) /* already stopped? */
                 return false;
 
-        return !!s->write_packet;
+        return !ordered_set_isempty(s->write_queue);
 }
@@ -7,12 +7,16 @@
 
 #include "fd-util.h"
 #include "resolved-dns-stub.h"
+#include "resolved-etc-hosts.h"
 #include "socket-util.h"
 
 /* The MTU of the loopback device is 64K on Linux, advertise that as maximum datagram size, but subtract the Ethernet,
  * IP and UDP header sizes */
 #define ADVERTISE_DATAGRAM_SIZE_MAX (65536U-14U-20U-8U)
 
+/* The maximum number of UDP queries to read in one go */
+#define DNS_STUB_UDP_BATCH_MAX 64U
+
 static int manager_dns_stub_udp_fd(Manager *m);
 static int manager_dns_stub_tcp_fd(Manager *m);
 
@@ -285,6 +289,112 @@ static int dns_stub_stream_complete(DnsStream *s, int error) {
         return 0;
 }
 
+static DnsScope *dns_stub_find_cache_scope(Manager *m, const char *name) {
+        DnsScope *s, *found = NULL;
+
+        assert(m);
+        assert(name);
+
+        /* Finds the scope dns_query_go() would route this lookup to, but only if it is a single unicast DNS
+         * scope. Lookups that go to multiple scopes, or are synthesized locally, take the full path. */
+
+        LIST_FOREACH(scopes, s, m->dns_scopes) {
+                DnsScopeMatch match;
+
+                match = dns_scope_good_domain(s, 0, SD_RESOLVED_PROTOCOLS_ALL|SD_RESOLVED_NO_SEARCH, name);
+                if (match < 0)
+                        return NULL;
+                if (match == DNS_SCOPE_NO)
+                        continue;
+
+                if (found)
+                        return NULL;
+
+                found = s;
+        }
+
+        if (!found || found->protocol != DNS_PROTOCOL_DNS)
+                return NULL;
+
+        return found;
+}
+
+static int dns_stub_try_cache(Manager *m, DnsPacket *p) {
+        _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL;
+        _cleanup_(dns_packet_unrefp) DnsPacket *reply = NULL;
+        bool authenticated, prefetch, truncated;
+        DnsResourceRecord *rr;
+        DnsScope *scope;
+        int r, rcode;
+
+        assert(m);
+        assert(p);
+
+        /* Answers the query right away if the cache has a positive answer for it, without setting up a
+         * DnsQuery and its transactions. Returns > 0 if a reply was sent, 0 if the caller should do a
+         * full lookup. Anything that needs more than a single cache lookup (DNSSEC data, CNAME chasing,
+         * /etc/hosts, multiple scopes) is left to the full lookup. */
+
+        if (dns_question_size(p->question) != 1)
+                return 0;
+        if (DNS_PACKET_DO(p))
+                return 0;
+
+        scope = dns_stub_find_cache_scope(m, dns_question_first_name(p->question));
+        if (!scope)
+                return 0;
+
+        r = manager_etc_hosts_lookup(m, p->question, &answer);
+        if (r != 0)
+                return 0;
+
+        (void) dns_scope_get_dns_server(scope);
+        dns_cache_prune(&scope->cache);
+
+        r = dns_cache_lookup(&scope->cache, p->question->keys[0], true, false, &rcode, &answer, &authenticated, &prefetch);
+        if (r < 0)
+                return r;
+        if (r == 0) {
+                /* The full lookup will consult the cache again, don't count the miss twice */
+                scope->cache.n_miss--;
+                return 0;
+        }
+
+        DNS_ANSWER_FOREACH(rr, answer) {
+                r = dns_question_matches_rr(p->question, rr, NULL);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        break;
+        }
+        if (rcode != DNS_RCODE_SUCCESS || r == 0) {
+                /* Negative or CNAME-only answer, let the full lookup deal with it */
+                scope->cache.n_hit--;
+                return 0;
+        }
+
+        if (prefetch) {
+                r = dns_scope_prefetch(scope, p->question->keys[0]);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to schedule refreshing cache entry, ignoring: %m");
+        }
+
+        r = dns_stub_make_reply_packet(&reply, DNS_PACKET_PAYLOAD_SIZE_MAX(p), p->question, answer, &truncated);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to build reply packet: %m");
+
+        r = dns_stub_finish_reply_packet(reply, DNS_PACKET_ID(p), DNS_RCODE_SUCCESS, truncated, !!p->opt, false, authenticated);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to finish reply packet: %m");
+
+        r = dns_stub_send(m, NULL, p, reply);
+        if (r < 0)
+                return r;
+
+        log_debug("Answered query from cache.");
+        return 1;
+}
+
 static void dns_stub_process_query(Manager *m, DnsStream *s, DnsPacket *p) {
         DnsQuery *q = NULL;
         int r;
@@ -340,6 +450,16 @@ static void dns_stub_process_query(Manager *m, DnsStream *s, DnsPacket *p) {
                 goto fail;
         }
 
+        if (!s) {
+                r = dns_stub_try_cache(m, p);
+                if (r < 0) {
+                        dns_stub_send_failure(m, s, p, DNS_RCODE_SERVFAIL, false);
+                        goto fail;
+                }
+                if (r > 0)
+                        return;
+        }
+
         r = dns_query_new(m, &q, p->question, p->question, 0, SD_RESOLVED_PROTOCOLS_ALL|SD_RESOLVED_NO_SEARCH);
         if (r < 0) {
                 log_error_errno(r, "Failed to generate query object: %m");
@@ -378,20 +498,29 @@ fail:
 }
 
 static int on_dns_stub_packet(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
-        _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
         Manager *m = userdata;
+        unsigned n;
         int r;
 
-        r = manager_recv(m, fd, DNS_PROTOCOL_DNS, &p);
-        if (r <= 0)
-                return r;
+        /* Process all queued queries at once (up to a limit, so that we don't starve the other event
+         * sources), instead of going through the event loop for each of them. Most of them are answered
+         * right-away from the cache. */
+        for (n = 0; n < DNS_STUB_UDP_BATCH_MAX; n++) {
+                _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
 
-        if (dns_packet_validate_query(p) > 0) {
-                log_debug("Got DNS stub UDP query packet for id %u", DNS_PACKET_ID(p));
+                r = manager_recv(m, fd, DNS_PROTOCOL_DNS, &p);
+                if (IN_SET(r, -EAGAIN, -EINTR))
+                        break;
+                if (r <= 0)
+                        return r;
 
-                dns_stub_process_query(m, NULL, p);
-        } else
-                log_debug("Invalid DNS stub UDP packet, ignoring.");
+                if (dns_packet_validate_query(p) > 0) {
+                        log_debug("Got DNS stub UDP query packet for id %u", DNS_PACKET_ID(p));
+
+                        dns_stub_process_query(m, NULL, p);
+                } else
+                        log_debug("Invalid DNS stub UDP packet, ignoring.");
+        }
 
         return 0;
 }
@@ -50,10 +50,9 @@ static void dns_transaction_close_connection(DnsTransaction *t) {
         assert(t);
 
         if (t->stream) {
-                /* Let's detach the stream from our transaction, in case something else keeps a reference to it. */
-                t->stream->complete = NULL;
-                t->stream->on_packet = NULL;
-                t->stream->transaction = NULL;
+                /* Let's detach the stream from our transaction, in case something else keeps a reference to it,
+                 * for example the server, or other transactions sharing it. */
+                LIST_REMOVE(transactions_by_stream, t->stream->transactions, t);
                 t->stream = dns_stream_unref(t->stream);
         }
 
@@ -134,6 +133,10 @@ bool dns_transaction_gc(DnsTransaction *t) {
         if (t->block_gc > 0)
                 return true;
 
+        /* Prefetch transactions have nobody listening, keep them around until the answer got cached */
+        if (t->prefetch && DNS_TRANSACTION_IS_LIVE(t->state))
+                return true;
+
         if (set_isempty(t->notify_query_candidates) &&
             set_isempty(t->notify_query_candidates_done) &&
             set_isempty(t->notify_zone_items) &&
@@ -293,6 +296,37 @@ static void dns_transaction_tentative(DnsTransaction *t, DnsPacket *p) {
         dns_transaction_gc(t);
 }
 
+static bool dns_transaction_serve_stale(DnsTransaction *t) {
+        char key_str[DNS_RESOURCE_KEY_STRING_MAX];
+        int r;
+
+        assert(t);
+
+        /* If the servers cannot be reached, answer with what we have in the cache, even if it expired
+         * already, as suggested by RFC 8767. */
+
+        if (t->scope->protocol != DNS_PROTOCOL_DNS)
+                return false;
+        if (t->scope->cache.stale_retention_usec <= 0)
+                return false;
+        if (t->prefetch || !set_isempty(t->notify_zone_items))
+                return false;
+
+        dns_transaction_reset_answer(t);
+
+        r = dns_cache_lookup(&t->scope->cache, t->key, t->clamp_ttl, true, &t->answer_rcode, &t->answer, &t->answer_authenticated, NULL);
+        if (r <= 0) {
+                if (r < 0)
+                        log_debug_errno(r, "Failed to look up stale cache entries, ignoring: %m");
+                return false;
+        }
+
+        log_debug("Serving stale cache entries for <%s>.", dns_resource_key_to_string(t->key, key_str, sizeof key_str));
+
+        t->answer_source = DNS_TRANSACTION_CACHE;
+        return true;
+}
+
 void dns_transaction_complete(DnsTransaction *t, DnsTransactionState state) {
         DnsQueryCandidate *c;
         DnsZoneItem *z;
@@ -303,6 +337,16 @@ void dns_transaction_complete(DnsTransaction *t, DnsTransactionState state) {
         assert(t);
         assert(!DNS_TRANSACTION_IS_LIVE(state));
 
+        if (IN_SET(state,
+                   DNS_TRANSACTION_NO_SERVERS,
+                   DNS_TRANSACTION_TIMEOUT,
+                   DNS_TRANSACTION_ATTEMPTS_MAX_REACHED,
+                   DNS_TRANSACTION_INVALID_REPLY,
+                   DNS_TRANSACTION_ERRNO,
+                   DNS_TRANSACTION_NETWORK_DOWN) &&
+            dns_transaction_serve_stale(t))
+                state = t->answer_rcode == DNS_RCODE_SUCCESS ? DNS_TRANSACTION_SUCCESS : DNS_TRANSACTION_RCODE_FAILURE;
+
         if (state == DNS_TRANSACTION_DNSSEC_FAILED) {
                 dns_resource_key_to_string(t->key, key_str, sizeof key_str);
 
@@ -449,18 +493,14 @@ static int dns_transaction_maybe_restart(DnsTransaction *t) {
         return 1;
 }
 
-static int on_stream_complete(DnsStream *s, int error) {
-        _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
-        DnsTransaction *t;
+static int dns_transaction_open_tcp(DnsTransaction *t);
 
-        assert(s);
-        assert(s->transaction);
+static void on_transaction_stream_error(DnsTransaction *t, int error) {
+        bool reused;
 
-        /* Copy the data we care about out of the stream before we
-         * destroy it. */
-        t = s->transaction;
-        p = dns_packet_ref(s->read_packet);
+        assert(t);
 
+        reused = t->stream_reused;
         dns_transaction_close_connection(t);
 
         if (ERRNO_IS_DISCONNECT(error)) {
@@ -470,7 +510,14 @@ static int on_stream_complete(DnsStream *s, int error) {
                         /* If the LLMNR/TCP connection failed, the host doesn't support LLMNR, and we cannot answer the
                          * question on this scope. */
                         dns_transaction_complete(t, DNS_TRANSACTION_NOT_FOUND);
-                        return 0;
+                        return;
+                }
+
+                /* Servers close idle connections whenever they like, don't hold that against the server, but
+                 * simply try again on a new connection. */
+                if (reused && dns_transaction_open_tcp(t) >= 0) {
+                        log_debug_errno(error, "Reused DNS TCP stream got closed, reconnecting: %m");
+                        return;
                 }
 
                 log_debug_errno(error, "Connection failure for DNS TCP stream: %m");
@@ -478,14 +525,53 @@ static int on_stream_complete(DnsStream *s, int error) {
                 dns_server_packet_lost(t->server, IPPROTO_TCP, t->current_feature_level, usec - t->start_usec);
 
                 dns_transaction_retry(t, true);
-                return 0;
+                return;
         }
-        if (error != 0) {
-                t->answer_errno = error;
-                dns_transaction_complete(t, DNS_TRANSACTION_ERRNO);
+
+        t->answer_errno = error;
+        dns_transaction_complete(t, DNS_TRANSACTION_ERRNO);
+}
+
+static int on_stream_complete(DnsStream *s, int error) {
+        _cleanup_(dns_stream_unrefp) DnsStream *ref = NULL;
+        DnsTransaction *t;
+
+        assert(s);
+
+        ref = dns_stream_ref(s);
+
+        /* Make sure no new transactions are queued on this stream */
+        if (s->server && s->server->stream == s)
+                dns_server_unref_stream(s->server);
+
+        /* Every reply is taken from the stream as it arrives, hence all transactions still waiting lose theirs.
+         * Each one detaches itself from the stream before retrying. */
+        while ((t = s->transactions))
+                on_transaction_stream_error(t, error != 0 ? error : ECONNRESET);
+
+        return 0;
+}
+
+static int on_stream_packet(DnsStream *s) {
+        _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
+        DnsTransaction *t;
+
+        assert(s);
+
+        p = dns_stream_take_read_packet(s);
+        assert(p);
+
+        /* Responses may arrive in any order, find the transaction by the ID */
+        LIST_FOREACH(transactions_by_stream, t, s->transactions)
+                if (t->id == DNS_PACKET_ID(p))
+                        break;
+        if (!t) {
+                log_debug("Received unexpected TCP reply packet with id %" PRIu16 ", ignoring.", DNS_PACKET_ID(p));
                 return 0;
         }
 
+        dns_transaction_close_connection(t);
+
         if (dns_packet_validate_reply(p) <= 0) {
                 log_debug("Invalid TCP reply packet.");
                 dns_transaction_complete(t, DNS_TRANSACTION_INVALID_REPLY);
@@ -509,7 +595,20 @@ static int on_stream_complete(DnsStream *s, int error) {
         return 0;
 }
 
+static bool dns_stream_has_transaction_id(DnsStream *s, uint16_t id) {
+        DnsTransaction *t;
+
+        assert(s);
+
+        LIST_FOREACH(transactions_by_stream, t, s->transactions)
+                if (t->id == id)
+                        return true;
+
+        return false;
+}
+
 static int dns_transaction_open_tcp(DnsTransaction *t) {
+        _cleanup_(dns_stream_unrefp) DnsStream *s = NULL;
         _cleanup_close_ int fd = -1;
         int r;
 
@@ -531,6 +630,13 @@ static int dns_transaction_open_tcp(DnsTransaction *t) {
                 if (r < 0)
                         return r;
 
+                /* Queue the query on the server's open connection, unless an ID clash prevents us from telling
+                 * the replies apart */
+                if (t->server->stream && !dns_stream_has_transaction_id(t->server->stream, t->id)) {
+                        s = dns_stream_ref(t->server->stream);
+                        break;
+                }
+
                 fd = dns_scope_socket_tcp(t->scope, AF_UNSPEC, NULL, t->server, 53);
                 break;
 
@@ -563,27 +669,38 @@ static int dns_transaction_open_tcp(DnsTransaction *t) {
                 return -EAFNOSUPPORT;
         }
 
-        if (fd < 0)
-                return fd;
+        t->stream_reused = !!s;
 
-        r = dns_stream_new(t->scope->manager, &t->stream, t->scope->protocol, fd);
-        if (r < 0)
-                return r;
-        fd = -1;
+        if (!s) {
+                if (fd < 0)
+                        return fd;
 
-        r = dns_stream_write_packet(t->stream, t->sent);
-        if (r < 0) {
-                t->stream = dns_stream_unref(t->stream);
-                return r;
+                r = dns_stream_new(t->scope->manager, &s, t->scope->protocol, fd);
+                if (r < 0)
+                        return r;
+                fd = -1;
+
+                s->on_packet = on_stream_packet;
+                s->complete = on_stream_complete;
+
+                /* The interface index is difficult to determine if we are
+                 * connecting to the local host, hence fill this in right away
+                 * instead of determining it from the socket */
+                s->ifindex = dns_scope_ifindex(t->scope);
+
+                /* Keep connections to DNS servers open, so that further lookups don't need to connect again */
+                if (t->server && !t->server->stream) {
+                        s->server = t->server;
+                        t->server->stream = dns_stream_ref(s);
+                }
         }
 
-        t->stream->complete = on_stream_complete;
-        t->stream->transaction = t;
+        r = dns_stream_write_packet(s, t->sent);
+        if (r < 0)
+                return r;
 
-        /* The interface index is difficult to determine if we are
-         * connecting to the local host, hence fill this in right away
-         * instead of determining it from the socket */
-        t->stream->ifindex = dns_scope_ifindex(t->scope);
+        LIST_PREPEND(transactions_by_stream, s->transactions, t);
+        t->stream = TAKE_PTR(s);
 
         dns_transaction_reset_answer(t);
 
@@ -1350,8 +1467,10 @@ static int dns_transaction_prepare(DnsTransaction *t, usec_t ts) {
         }
 
         /* Check the cache, but only if this transaction is not used
-         * for probing or verifying a zone item. */
-        if (set_isempty(t->notify_zone_items)) {
+         * for probing or verifying a zone item, nor for refreshing
+         * the cache itself. */
+        if (set_isempty(t->notify_zone_items) && !t->prefetch) {
+                bool prefetch;
 
                 /* Before trying the cache, let's make sure we figured out a
                  * server to use. Should this cause a change of server this
@@ -1361,10 +1480,16 @@ static int dns_transaction_prepare(DnsTransaction *t, usec_t ts) {
                 /* Let's then prune all outdated entries */
                 dns_cache_prune(&t->scope->cache);
 
-                r = dns_cache_lookup(&t->scope->cache, t->key, t->clamp_ttl, &t->answer_rcode, &t->answer, &t->answer_authenticated);
+                r = dns_cache_lookup(&t->scope->cache, t->key, t->clamp_ttl, false, &t->answer_rcode, &t->answer, &t->answer_authenticated, &prefetch);
                 if (r < 0)
                         return r;
                 if (r > 0) {
+                        if (prefetch) {
+                                r = dns_scope_prefetch(t->scope, t->key);
+                                if (r < 0)
+                                        log_debug_errno(r, "Failed to schedule refreshing cache entry, ignoring: %m");
+                        }
+
                         t->answer_source = DNS_TRANSACTION_CACHE;
                         if (t->answer_rcode == DNS_RCODE_SUCCESS)
                                 dns_transaction_complete(t, DNS_TRANSACTION_SUCCESS);
@@ -68,6 +68,9 @@ struct DnsTransaction {
 
         bool probing:1;
 
+        /* Refreshes a cache entry before it expires, nobody is waiting for the result */
+        bool prefetch:1;
+
         DnsPacket *sent, *received;
 
         DnsAnswer *answer;
@@ -102,8 +105,10 @@ struct DnsTransaction {
         int dns_udp_fd;
         sd_event_source *dns_udp_event_source;
 
-        /* TCP connection logic, if we need it */
+        /* TCP connection logic, if we need it. The stream might be shared with other transactions talking to
+         * the same server. */
         DnsStream *stream;
+        bool stream_reused:1;
 
         /* The active server */
         DnsServer *server;
@@ -136,6 +141,7 @@ struct DnsTransaction {
         unsigned block_gc;
 
         LIST_FIELDS(DnsTransaction, transactions_by_scope);
+        LIST_FIELDS(DnsTransaction, transactions_by_stream);
 };
 
 int dns_transaction_new(DnsTransaction **ret, DnsScope *s, DnsResourceKey *key);
@@ -5,8 +5,11 @@
   Copyright 2016 Lennart Poettering
 ***/
 
+#include <sys/inotify.h>
+
 #include "fd-util.h"
 #include "fileio.h"
+#include "fs-util.h"
 #include "hostname-util.h"
 #include "resolved-etc-hosts.h"
 #include "resolved-dns-synthesize.h"
@@ -239,16 +242,18 @@ static int parse_line(Manager *m, unsigned nr, const char *line) {
 
 int manager_etc_hosts_read(Manager *m) {
         _cleanup_fclose_ FILE *f = NULL;
-        char line[LINE_MAX];
+        char line[LINE_MAX], buf[FORMAT_TIMESPAN_MAX];
         struct stat st;
-        usec_t ts;
+        usec_t ts, start;
         unsigned nr = 0;
         int r;
 
         assert_se(sd_event_now(m->event, clock_boottime_or_monotonic(), &ts) >= 0);
 
-        /* See if we checked /etc/hosts recently already */
-        if (m->etc_hosts_last != USEC_INFINITY && m->etc_hosts_last + ETC_HOSTS_RECHECK_USEC > ts)
+        /* If we watch /etc for changes, the inotify handler invalidates our copy, hence there's no need to
+         * stat() the file on every lookup. Otherwise, see if we checked /etc/hosts recently already */
+        if (m->etc_hosts_last != USEC_INFINITY &&
+            (m->etc_hosts_event_source || m->etc_hosts_last + ETC_HOSTS_RECHECK_USEC > ts))
                 return 0;
 
         m->etc_hosts_last = ts;
@@ -286,6 +291,8 @@ int manager_etc_hosts_read(Manager *m) {
 
         manager_etc_hosts_flush(m);
 
+        start = now(clock_boottime_or_monotonic());
+
         FOREACH_LINE(line, f, return log_error_errno(errno, "Failed to read /etc/hosts: %m")) {
                 char *l;
 
@@ -304,6 +311,14 @@ int manager_etc_hosts_read(Manager *m) {
 
         m->etc_hosts_mtime = timespec_load(&st.st_mtim);
         m->etc_hosts_last = ts;
+        m->etc_hosts_n_lines = nr;
+        m->etc_hosts_parse_usec = usec_sub_unsigned(now(clock_boottime_or_monotonic()), start);
+
+        log_debug("Read /etc/hosts: %u lines, %u addresses, %u names, took %s.",
+                  m->etc_hosts_n_lines,
+                  set_size(m->etc_hosts_by_address),
+                  hashmap_size(m->etc_hosts_by_name),
+                  format_timespan(buf, sizeof(buf), m->etc_hosts_parse_usec, USEC_PER_MSEC/10));
 
         return 1;
 
@@ -312,6 +327,117 @@ clear:
         return r;
 }
 
+static void manager_etc_hosts_unwatch(Manager *m) {
+        assert(m);
+
+        m->etc_hosts_event_source = sd_event_source_unref(m->etc_hosts_event_source);
+        m->etc_hosts_inotify_fd = safe_close(m->etc_hosts_inotify_fd);
+
+        /* Make sure the next lookup checks the file again, now that nobody tells us about changes anymore */
+        m->etc_hosts_last = USEC_INFINITY;
+}
+
+static int on_etc_hosts_inotify(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        union inotify_event_buffer buffer;
+        struct inotify_event *e;
+        Manager *m = userdata;
+        bool changed = false;
+        ssize_t l;
+
+        assert(m);
+
+        l = read(fd, &buffer, sizeof(buffer));
+        if (l < 0) {
+                if (IN_SET(errno, EAGAIN, EINTR))
+                        return 0;
+
+                log_warning_errno(errno, "Failed to read inotify event for /etc, falling back to checking /etc/hosts periodically: %m");
+                manager_etc_hosts_unwatch(m);
+                return 0;
+        }
+
+        FOREACH_INOTIFY_EVENT(e, buffer, l) {
+                if (e->mask & (IN_IGNORED|IN_DELETE_SELF|IN_MOVE_SELF)) {
+                        /* /etc itself went away or was replaced, our watch is useless now */
+                        manager_etc_hosts_unwatch(m);
+                        changed = true;
+                        break;
+                }
+
+                if (e->mask & IN_Q_OVERFLOW)
+                        changed = true;
+                else if (e->len > 0 && streq(e->name, "hosts"))
+                        changed = true;
+        }
+
+        if (!changed)
+                return 0;
+
+        /* Reload right away, so that the next lookup doesn't have to pay for parsing the file */
+        m->etc_hosts_last = m->etc_hosts_mtime = USEC_INFINITY;
+        (void) manager_etc_hosts_read(m);
+
+        return 0;
+}
+
+int manager_etc_hosts_watch(Manager *m) {
+        _cleanup_close_ int fd = -1;
+        struct stat st;
+        int r;
+
+        assert(m);
+
+        if (m->etc_hosts_event_source)
+                return 0;
+
+        /* If /etc/hosts is a symlink, changes to the file pointed to aren't reported on /etc, hence stick to
+         * checking the mtime in that case */
+        if (lstat("/etc/hosts", &st) >= 0 && S_ISLNK(st.st_mode))
+                return -EOPNOTSUPP;
+
+        fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+
+        if (inotify_add_watch(fd, "/etc", IN_CLOSE_WRITE|IN_MOVED_TO|IN_MOVED_FROM|IN_CREATE|IN_DELETE|IN_DELETE_SELF|IN_MOVE_SELF|IN_ONLYDIR) < 0)
+                return -errno;
+
+        r = sd_event_add_io(m->event, &m->etc_hosts_event_source, fd, EPOLLIN, on_etc_hosts_inotify, m);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(m->etc_hosts_event_source, "etc-hosts-inotify");
+
+        m->etc_hosts_inotify_fd = TAKE_FD(fd);
+
+        /* Whatever we read before, we didn't get notified about changes to it */
+        m->etc_hosts_last = USEC_INFINITY;
+
+        return 1;
+}
+
+void manager_etc_hosts_dump(Manager *m, FILE *f) {
+        char buf[FORMAT_TIMESPAN_MAX];
+
+        assert(m);
+
+        if (!f)
+                f = stdout;
+
+        fprintf(f,
+                "[/etc/hosts]\n"
+                "\tAddresses: %u\n"
+                "\tNames: %u\n"
+                "\tLines: %u\n"
+                "\tParse time: %s\n"
+                "\tWatched: %s\n",
+                set_size(m->etc_hosts_by_address),
+                hashmap_size(m->etc_hosts_by_name),
+                m->etc_hosts_n_lines,
+                format_timespan(buf, sizeof(buf), m->etc_hosts_parse_usec, USEC_PER_MSEC/10),
+                yes_no(m->etc_hosts_event_source));
+}
+
 int manager_etc_hosts_lookup(Manager *m, DnsQuestion* q, DnsAnswer **answer) {
         bool found_a = false, found_aaaa = false;
         EtcHostsItemByName *bn;
@@ -14,3 +14,5 @@
 void manager_etc_hosts_flush(Manager *m);
 int manager_etc_hosts_read(Manager *m);
 int manager_etc_hosts_lookup(Manager *m, DnsQuestion* q, DnsAnswer **answer);
+int manager_etc_hosts_watch(Manager *m);
+void manager_etc_hosts_dump(Manager *m, FILE *f);
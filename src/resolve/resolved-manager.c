@@ -531,6 +531,8 @@ static int manager_sigusr1(sd_event_source *s, const struct signalfd_siginfo *si
                 LIST_FOREACH(servers, server, l->dns_servers)
                         dns_server_dump(server, f);
 
+        manager_etc_hosts_dump(m, f);
+
         if (fflush_and_check(f) < 0)
                 return log_oom();
 
@@ -581,10 +583,13 @@ int manager_new(Manager **ret) {
         m->mdns_support = RESOLVE_SUPPORT_YES;
         m->dnssec_mode = DEFAULT_DNSSEC_MODE;
         m->enable_cache = true;
+        m->cache_size = DNS_CACHE_SIZE_DEFAULT;
         m->dns_stub_listener_mode = DNS_STUB_LISTENER_UDP;
         m->read_resolv_conf = true;
         m->need_builtin_fallbacks = true;
         m->etc_hosts_last = m->etc_hosts_mtime = USEC_INFINITY;
+        m->etc_hosts_inotify_fd = -1;
+        m->private_bus_fd = -1;
 
         r = dns_trust_anchor_load(&m->trust_anchor);
         if (r < 0)
@@ -647,6 +652,14 @@ int manager_start(Manager *m) {
         if (r < 0)
                 return r;
 
+        r = manager_etc_hosts_watch(m);
+        if (r < 0)
+                log_debug_errno(r, "Failed to watch /etc/hosts, checking it periodically instead: %m");
+
+        r = manager_connect_private_bus(m);
+        if (r < 0)
+                log_warning_errno(r, "Failed to set up private bus socket, nss-resolve will use the system bus: %m");
+
         return 0;
 }
 
@@ -689,6 +702,7 @@ Manager *manager_free(Manager *m) {
 
         sd_bus_slot_unref(m->prepare_for_sleep_slot);
         sd_bus_unref(m->bus);
+        manager_disconnect_private_bus(m);
 
         sd_event_source_unref(m->sigusr1_event_source);
         sd_event_source_unref(m->sigusr2_event_source);
@@ -696,6 +710,8 @@ Manager *manager_free(Manager *m) {
 
         sd_event_unref(m->event);
 
+        dnssec_verify_cache_flush();
+
         dns_resource_key_unref(m->llmnr_host_ipv4_key);
         dns_resource_key_unref(m->llmnr_host_ipv6_key);
         dns_resource_key_unref(m->mdns_host_ipv4_key);
@@ -714,6 +730,8 @@ Manager *manager_free(Manager *m) {
 
         dns_trust_anchor_flush(&m->trust_anchor);
         manager_etc_hosts_flush(m);
+        sd_event_source_unref(m->etc_hosts_event_source);
+        safe_close(m->etc_hosts_inotify_fd);
 
         return mfree(m);
 }
@@ -1423,6 +1441,8 @@ void manager_flush_caches(Manager *m) {
         LIST_FOREACH(scopes, scope, m->dns_scopes)
                 dns_cache_flush(&scope->cache);
 
+        dnssec_verify_cache_flush();
+
         log_info("Flushed all caches.");
 }
 
@@ -36,6 +36,9 @@ struct Manager {
         ResolveSupport mdns_support;
         DnssecMode dnssec_mode;
         bool enable_cache;
+        unsigned cache_size;
+        usec_t stale_retention_usec;
+        bool cache_prefetch;
         DnsStubListenerMode dns_stub_listener_mode;
 
         /* Network */
@@ -98,6 +101,11 @@ struct Manager {
         /* dbus */
         sd_bus *bus;
 
+        /* Direct connections from nss-resolve, bypassing the bus daemon */
+        int private_bus_fd;
+        sd_event_source *private_bus_event_source;
+        Set *private_buses;
+
         /* The hostname we publish on LLMNR and mDNS */
         char *full_hostname;
         char *llmnr_hostname;
@@ -119,12 +127,18 @@ struct Manager {
         sd_event_source *sigrtmin1_event_source;
 
         unsigned n_transactions_total;
+        unsigned n_transactions_coalesced;
+        unsigned n_search_domain_lookahead, n_search_domain_lookahead_used;
         unsigned n_dnssec_verdict[_DNSSEC_VERDICT_MAX];
 
         /* Data from /etc/hosts */
         Set* etc_hosts_by_address;
         Hashmap* etc_hosts_by_name;
         usec_t etc_hosts_last, etc_hosts_mtime;
+        int etc_hosts_inotify_fd;
+        sd_event_source *etc_hosts_event_source; /* inotify watch on /etc, if we have one */
+        unsigned etc_hosts_n_lines;
+        usec_t etc_hosts_parse_usec;
 
         /* Local DNS stub on 127.0.0.53:53 */
         int dns_stub_udp_fd;
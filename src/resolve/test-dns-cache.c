@@ -0,0 +1,225 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+***/
+
+#include "alloc-util.h"
+#include "log.h"
+#include "resolved-dns-answer.h"
+#include "resolved-dns-cache.h"
+#include "resolved-dns-packet.h"
+#include "resolved-dns-rr.h"
+
+static void put_full(DnsCache *c, const char *name, uint32_t ttl, usec_t timestamp) {
+        _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *rr = NULL;
+        _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL;
+        union in_addr_union address = {
+                .in.s_addr = htobe32(0x7f000001),
+        };
+
+        assert_se(dns_resource_record_new_address(&rr, AF_INET, &address, name) >= 0);
+        rr->ttl = ttl;
+
+        assert_se(answer = dns_answer_new(1));
+        assert_se(dns_answer_add(answer, rr, 0, DNS_ANSWER_CACHEABLE) >= 0);
+
+        assert_se(dns_cache_put(c, NULL, DNS_RCODE_SUCCESS, answer, false, UINT32_MAX, timestamp, AF_INET, &address) >= 0);
+}
+
+static void put(DnsCache *c, const char *name) {
+        put_full(c, name, 3600, 0);
+}
+
+static int lookup_full(DnsCache *c, const char *name, bool stale, uint32_t *ret_ttl, bool *ret_prefetch) {
+        _cleanup_(dns_resource_key_unrefp) DnsResourceKey *key = NULL;
+        _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL;
+        bool authenticated;
+        int rcode, r;
+
+        assert_se(key = dns_resource_key_new(DNS_CLASS_IN, DNS_TYPE_A, name));
+
+        r = dns_cache_lookup(c, key, false, stale, &rcode, &answer, &authenticated, ret_prefetch);
+        assert_se(r >= 0);
+
+        if (ret_ttl && r > 0) {
+                assert_se(dns_answer_size(answer) == 1);
+                *ret_ttl = answer->items[0].rr->ttl;
+        }
+
+        return r;
+}
+
+static int lookup(DnsCache *c, const char *name) {
+        return lookup_full(c, name, false, NULL, NULL);
+}
+
+static void test_dns_cache_evict(void) {
+        DnsCache c = {
+                .max = 4,
+        };
+
+        put(&c, "a.test");
+        put(&c, "b.test");
+        put(&c, "c.test");
+        assert_se(dns_cache_size(&c) == 3);
+        assert_se(c.n_evicted == 0);
+
+        /* a.test is the oldest entry, but was looked up, hence b.test is evicted instead */
+        assert_se(lookup(&c, "a.test") > 0);
+        put(&c, "d.test");
+        assert_se(dns_cache_size(&c) == 3);
+        assert_se(c.n_evicted == 1);
+
+        assert_se(lookup(&c, "a.test") > 0);
+        assert_se(lookup(&c, "b.test") == 0);
+        assert_se(lookup(&c, "c.test") > 0);
+        assert_se(lookup(&c, "d.test") > 0);
+
+        /* Everything was used now, so after all got their second chance, the one that had not been
+         * moved to the front before goes */
+        put(&c, "e.test");
+        assert_se(dns_cache_size(&c) == 3);
+        assert_se(c.n_evicted == 2);
+        assert_se(lookup(&c, "c.test") == 0);
+        assert_se(lookup(&c, "a.test") > 0);
+        assert_se(lookup(&c, "e.test") > 0);
+
+        assert_se(c.n_hit == 6);
+        assert_se(c.n_miss == 2);
+
+        dns_cache_flush(&c);
+        assert_se(dns_cache_is_empty(&c));
+}
+
+static void test_dns_cache_stale(void) {
+        DnsCache c = {
+                .stale_retention_usec = USEC_PER_DAY,
+        };
+        usec_t n;
+        uint32_t ttl;
+
+        n = now(clock_boottime_or_monotonic());
+
+        /* Expired an hour ago, but kept around */
+        put_full(&c, "stale.test", 3600, n - 2 * USEC_PER_HOUR);
+        put(&c, "fresh.test");
+        dns_cache_prune(&c);
+        assert_se(dns_cache_size(&c) == 2);
+
+        assert_se(lookup(&c, "stale.test") == 0);
+        assert_se(lookup_full(&c, "stale.test", true, &ttl, NULL) > 0);
+        assert_se(ttl == 30);
+
+        assert_se(lookup_full(&c, "fresh.test", true, &ttl, NULL) > 0);
+        assert_se(ttl == 3600);
+
+        /* Past the retention time, the entry is gone for good */
+        c.stale_retention_usec = USEC_PER_MINUTE;
+        dns_cache_prune(&c);
+        assert_se(dns_cache_size(&c) == 1);
+        assert_se(lookup_full(&c, "stale.test", true, NULL, NULL) == 0);
+
+        dns_cache_flush(&c);
+}
+
+static void test_dns_cache_prefetch(void) {
+        DnsCache c = {
+                .prefetch = true,
+        };
+        bool prefetch;
+        usec_t n;
+
+        n = now(clock_boottime_or_monotonic());
+
+        /* In the last tenth of its lifetime, but not popular enough yet */
+        put_full(&c, "hot.test", 100, n - 95 * USEC_PER_SEC);
+        put_full(&c, "young.test", 100, n);
+
+        assert_se(lookup_full(&c, "hot.test", false, NULL, &prefetch) > 0);
+        assert_se(!prefetch);
+        assert_se(lookup_full(&c, "hot.test", false, NULL, &prefetch) > 0);
+        assert_se(!prefetch);
+
+        /* Now it is, but it's refreshed only once */
+        assert_se(lookup_full(&c, "hot.test", false, NULL, &prefetch) > 0);
+        assert_se(prefetch);
+        assert_se(lookup_full(&c, "hot.test", false, NULL, &prefetch) > 0);
+        assert_se(!prefetch);
+
+        /* Popular, but far from expiring */
+        assert_se(lookup_full(&c, "young.test", false, NULL, &prefetch) > 0);
+        assert_se(lookup_full(&c, "young.test", false, NULL, &prefetch) > 0);
+        assert_se(lookup_full(&c, "young.test", false, NULL, &prefetch) > 0);
+        assert_se(lookup_full(&c, "young.test", false, NULL, &prefetch) > 0);
+        assert_se(!prefetch);
+
+        dns_cache_flush(&c);
+}
+
+static DnsResourceRecord *make_txt(const char *name, const char *text, uint32_t ttl) {
+        DnsResourceRecord *rr;
+        DnsTxtItem *i;
+
+        assert_se(rr = dns_resource_record_new_full(DNS_CLASS_IN, DNS_TYPE_TXT, name));
+        rr->ttl = ttl;
+
+        assert_se(i = malloc0(offsetof(DnsTxtItem, data) + strlen(text) + 1));
+        i->length = strlen(text);
+        memcpy(i->data, text, i->length);
+        LIST_PREPEND(items, rr->txt.items, i);
+
+        return rr;
+}
+
+static void test_dns_cache_wire_format(void) {
+        _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *rr = NULL, *fresh = NULL;
+        _cleanup_(dns_resource_key_unrefp) DnsResourceKey *key = NULL;
+        _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL, *cached = NULL;
+        _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
+        union in_addr_union address = {};
+        DnsCache c = {};
+        bool authenticated;
+        size_t start;
+        int rcode;
+
+        /* Cached TXT records are serialized once, and replies copy their RDATA. Make sure the result is
+         * the same as encoding the record from scratch, including a clamped TTL. */
+
+        rr = make_txt("txt.test", "v=spf1 include:example.com ~all", 3600);
+        assert_se(answer = dns_answer_new(1));
+        assert_se(dns_answer_add(answer, rr, 0, DNS_ANSWER_CACHEABLE) >= 0);
+        assert_se(dns_cache_put(&c, NULL, DNS_RCODE_SUCCESS, answer, false, UINT32_MAX,
+                                now(clock_boottime_or_monotonic()) - 1000 * USEC_PER_SEC, AF_INET, &address) >= 0);
+        assert_se(rr->wire_format);
+
+        assert_se(key = dns_resource_key_new(DNS_CLASS_IN, DNS_TYPE_TXT, "txt.test"));
+        assert_se(dns_cache_lookup(&c, key, true, false, &rcode, &cached, &authenticated, NULL) > 0);
+        assert_se(dns_answer_size(cached) == 1);
+        assert_se(cached->items[0].rr->ttl < 3600);
+        assert_se(cached->items[0].rr->wire_format);
+
+        assert_se(dns_packet_new(&p, DNS_PROTOCOL_DNS, 0, DNS_PACKET_SIZE_MAX) >= 0);
+        assert_se(dns_packet_append_rr(p, cached->items[0].rr, 0, &start, NULL) >= 0);
+
+        fresh = make_txt("txt.test", "v=spf1 include:example.com ~all", cached->items[0].rr->ttl);
+        assert_se(dns_resource_record_to_wire_format(fresh, false) >= 0);
+
+        assert_se(p->size - start == fresh->wire_format_size);
+        assert_se(memcmp(DNS_PACKET_DATA(p) + start, fresh->wire_format, fresh->wire_format_size) == 0);
+
+        dns_cache_flush(&c);
+}
+
+int main(int argc, char **argv) {
+
+        log_set_max_level(LOG_DEBUG);
+        log_parse_environment();
+        log_open();
+
+        test_dns_cache_evict();
+        test_dns_cache_stale();
+        test_dns_cache_prefetch();
+        test_dns_cache_wire_format();
+
+        return 0;
+}
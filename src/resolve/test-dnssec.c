@@ -374,6 +374,28 @@ static void test_dnssec_verify_rrset(void) {
         /* Validate the RR as it if was 2015-12-2 today */
         assert_se(dnssec_verify_rrset(answer, a->key, rrsig, dnskey, 1449092754*USEC_PER_SEC, &result) >= 0);
         assert_se(result == DNSSEC_VALIDATED);
+
+        /* Once more, now the result is known already */
+        assert_se(dnssec_verify_rrset(answer, a->key, rrsig, dnskey, 1449092754*USEC_PER_SEC, &result) >= 0);
+        assert_se(result == DNSSEC_VALIDATED);
+
+        /* A different RRset with the same signature must still fail */
+        a->a.in_addr.s_addr = inet_addr("52.0.14.117");
+        a->wire_format = mfree(a->wire_format);
+        assert_se(dnssec_verify_rrset(answer, a->key, rrsig, dnskey, 1449092754*USEC_PER_SEC, &result) >= 0);
+        assert_se(result == DNSSEC_INVALID);
+
+        a->a.in_addr.s_addr = inet_addr("52.0.14.116");
+        a->wire_format = mfree(a->wire_format);
+        assert_se(dnssec_verify_rrset(answer, a->key, rrsig, dnskey, 1449092754*USEC_PER_SEC, &result) >= 0);
+        assert_se(result == DNSSEC_VALIDATED);
+
+        /* As must a tampered signature */
+        ((uint8_t*) rrsig->rrsig.signature)[0] ^= 0xff;
+        assert_se(dnssec_verify_rrset(answer, a->key, rrsig, dnskey, 1449092754*USEC_PER_SEC, &result) >= 0);
+        assert_se(result == DNSSEC_INVALID);
+
+        dnssec_verify_cache_flush();
 }
 
 static void test_dnssec_verify_rrset2(void) {
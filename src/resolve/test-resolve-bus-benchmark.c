@@ -0,0 +1,152 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+***/
+
+#include <stdio.h>
+
+#include "sd-bus.h"
+
+#include "bus-error.h"
+#include "log.h"
+#include "parse-util.h"
+#include "resolved-def.h"
+#include "tests.h"
+#include "time-util.h"
+#include "util.h"
+
+/* This program compares the cost of a host name lookup through systemd-resolved when going through the
+ * system bus with a new connection for each lookup (what nss-resolve used to do), with a new direct
+ * connection for each lookup, and with a direct connection that is kept open across lookups (what
+ * nss-resolve does now). "localhost" is synthesized by resolved, hence this measures the transport only.
+ *
+ * Usage: test-resolve-bus-benchmark [ITERATIONS] [HOSTNAME]
+ *
+ * The results are logged, and written to stdout in the format of benchmark_report(). */
+
+static unsigned arg_iterations = 1000;
+static const char *arg_hostname = "localhost";
+
+static int open_private(sd_bus **ret) {
+        _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
+        int r;
+
+        r = sd_bus_new(&bus);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_set_address(bus, "unix:path=" SD_RESOLVED_PRIVATE_BUS_PATH);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_negotiate_fds(bus, false);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_start(bus);
+        if (r < 0)
+                return r;
+
+        *ret = bus;
+        bus = NULL;
+
+        return 0;
+}
+
+static int resolve(sd_bus *bus) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        int r;
+
+        r = sd_bus_call_method(bus,
+                               "org.freedesktop.resolve1",
+                               "/org/freedesktop/resolve1",
+                               "org.freedesktop.resolve1.Manager",
+                               "ResolveHostname",
+                               &error,
+                               &reply,
+                               "isit", 0, arg_hostname, AF_UNSPEC, UINT64_C(0));
+        if (r < 0)
+                return log_error_errno(r, "Failed to resolve %s: %s", arg_hostname, bus_error_message(&error, r));
+
+        return 0;
+}
+
+static int bench_system_bus(void) {
+        usec_t start;
+        unsigned i;
+        int r;
+
+        start = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < arg_iterations; i++) {
+                _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+
+                r = sd_bus_open_system(&bus);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to connect to system bus: %m");
+
+                r = resolve(bus);
+                if (r < 0)
+                        return r;
+        }
+
+        benchmark_report("system bus", arg_iterations, start);
+        return 0;
+}
+
+static int bench_private(bool reuse) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *cached = NULL;
+        usec_t start;
+        unsigned i;
+        int r;
+
+        start = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < arg_iterations; i++) {
+                _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+
+                if (!reuse || !cached) {
+                        r = open_private(&bus);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to connect to %s: %m", SD_RESOLVED_PRIVATE_BUS_PATH);
+
+                        if (reuse)
+                                cached = sd_bus_ref(bus);
+                } else
+                        bus = sd_bus_ref(cached);
+
+                r = resolve(bus);
+                if (r < 0)
+                        return r;
+
+                if (reuse)
+                        bus = sd_bus_unref(bus);
+        }
+
+        benchmark_report(reuse ? "direct, reused" : "direct, new connection", arg_iterations, start);
+        return 0;
+}
+
+int main(int argc, char *argv[]) {
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        if (argc >= 2)
+                assert_se(safe_atou(argv[1], &arg_iterations) >= 0);
+        if (argc >= 3)
+                arg_hostname = argv[2];
+
+        if (access(SD_RESOLVED_PRIVATE_BUS_PATH, F_OK) < 0) {
+                log_notice_errno(errno, "Skipping test: %s not available: %m", SD_RESOLVED_PRIVATE_BUS_PATH);
+                return EXIT_TEST_SKIP;
+        }
+
+        if (bench_system_bus() < 0 ||
+            bench_private(false) < 0 ||
+            bench_private(true) < 0)
+                return EXIT_FAILURE;
+
+        return EXIT_SUCCESS;
+}
@@ -16,6 +16,7 @@
 #include "fd-util.h"
 #include "fileio.h"
 #include "io-util.h"
+#include "libudev-private.h"
 #include "mkdir.h"
 #include "parse-util.h"
 #include "proc-cmdline.h"
@@ -124,6 +125,10 @@ static int wait_for_initialized(
         if (r < 0)
                 return log_error_errno(r, "Failed to add rfkill udev match to monitor: %m");
 
+        r = udev_monitor_filter_add_match_sysname(monitor, sysname);
+        if (r < 0)
+                return log_error_errno(r, "Failed to add rfkill udev sysname match to monitor: %m");
+
         r = udev_monitor_enable_receiving(monitor);
         if (r < 0)
                 return log_error_errno(r, "Failed to enable udev receiving: %m");
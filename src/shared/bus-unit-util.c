@@ -718,6 +718,10 @@ static int bus_append_execute_property(sd_bus_message *m, const char *field, con
 
                 return bus_append_log_level_from_string(m, field, eq);
 
+        if (streq(field, "LogRateLimitBytes"))
+
+                return bus_append_parse_size(m, field, eq, 1024);
+
         if (streq(field, "SyslogFacility"))
 
                 return bus_append_log_facility_unshifted_from_string(m, field, eq);
@@ -1380,7 +1384,8 @@ static int bus_append_socket_property(sd_bus_message *m, const char *field, cons
 
                 return bus_append_ip_tos_from_string(m, field, eq);
 
-        if (STR_IN_SET(field, "Backlog", "MaxConnections", "MaxConnectionsPerSource", "KeepAliveProbes", "TriggerLimitBurst"))
+        if (STR_IN_SET(field, "Backlog", "MaxConnections", "MaxConnectionsPerSource", "KeepAliveProbes", "TriggerLimitBurst",
+                       "ReusePortListeners"))
 
                 return bus_append_safe_atou(m, field, eq);
 
@@ -5,6 +5,7 @@
   Copyright 2016 Lennart Poettering
 ***/
 
+#include <pthread.h>
 #include <sys/mount.h>
 #include <sys/prctl.h>
 #include <sys/wait.h>
@@ -96,6 +97,55 @@ not_found:
 #endif
 }
 
+#if HAVE_BLKID
+typedef struct ProbeJob {
+        DissectedPartition *partition;
+        pthread_t thread;
+        bool started;
+        int r;
+} ProbeJob;
+
+static void *probe_thread(void *userdata) {
+        ProbeJob *j = userdata;
+
+        j->r = probe_filesystem(j->partition->node, &j->partition->fstype);
+        return NULL;
+}
+
+static int probe_filesystems(DissectedImage *m) {
+        ProbeJob jobs[_PARTITION_DESIGNATOR_MAX] = {};
+        unsigned i, n = 0;
+        int r = 0;
+
+        assert(m);
+
+        for (i = 0; i < _PARTITION_DESIGNATOR_MAX; i++) {
+                DissectedPartition *p = m->partitions + i;
+
+                if (p->found && !p->fstype && p->node)
+                        jobs[n++].partition = p;
+        }
+
+        /* Probing is mostly waiting for reads of the superblocks, and the probes don't share any state, hence
+         * probe all partitions at once. If we can't get a thread, just probe in this one. */
+        if (n > 1)
+                for (i = 0; i < n; i++)
+                        jobs[i].started = pthread_create(&jobs[i].thread, NULL, probe_thread, jobs + i) == 0;
+
+        for (i = 0; i < n; i++) {
+                if (jobs[i].started)
+                        (void) pthread_join(jobs[i].thread, NULL);
+                else
+                        (void) probe_thread(jobs + i);
+
+                if (jobs[i].r < 0 && jobs[i].r != -EUCLEAN && r == 0)
+                        r = jobs[i].r;
+        }
+
+        return r;
+}
+#endif
+
 /* Detect RPMB and Boot partitions, which are not listed by blkid.
  * See https://github.com/systemd/systemd/issues/5806. */
 static bool device_is_mmc_special_partition(struct udev_device *d) {
@@ -636,18 +686,16 @@ int dissect_image(
         b = NULL;
 
         /* Fill in file system types if we don't know them yet. */
+        r = probe_filesystems(m);
+        if (r < 0)
+                return r;
+
         for (i = 0; i < _PARTITION_DESIGNATOR_MAX; i++) {
                 DissectedPartition *p = m->partitions + i;
 
                 if (!p->found)
                         continue;
 
-                if (!p->fstype && p->node) {
-                        r = probe_filesystem(p->node, &p->fstype);
-                        if (r < 0 && r != -EUCLEAN)
-                                return r;
-                }
-
                 if (streq_ptr(p->fstype, "crypto_LUKS"))
                         m->encrypted = true;
 
@@ -830,6 +878,7 @@ typedef struct DecryptedPartition {
         struct crypt_device *device;
         char *name;
         bool relinquished;
+        bool shared; /* Others may be using it, only remove it once they are done */
 } DecryptedPartition;
 
 struct DecryptedImage {
@@ -837,6 +886,8 @@ struct DecryptedImage {
         size_t n_decrypted;
         size_t n_allocated;
 };
+
+static int deferred_remove(DecryptedPartition *p);
 #endif
 
 DecryptedImage* decrypted_image_unref(DecryptedImage* d) {
@@ -851,7 +902,10 @@ DecryptedImage* decrypted_image_unref(DecryptedImage* d) {
                 DecryptedPartition *p = d->decrypted + i;
 
                 if (p->device && p->name && !p->relinquished) {
-                        r = crypt_deactivate(p->device, p->name);
+                        if (p->shared)
+                                r = deferred_remove(p);
+                        else
+                                r = crypt_deactivate(p->device, p->name);
                         if (r < 0)
                                 log_debug_errno(r, "Failed to deactivate encrypted partition %s", p->name);
                 }
@@ -878,9 +932,7 @@ static int make_dm_name_and_node(const void *original_node, const char *suffix,
         assert(ret_node);
 
         base = strrchr(original_node, '/');
-        if (!base)
-                return -EINVAL;
-        base++;
+        base = base ? base + 1 : original_node;
         if (isempty(base))
                 return -EINVAL;
 
@@ -954,6 +1006,24 @@ static int decrypt_partition(
         return 0;
 }
 
+static int verity_find_shared(const char *name, struct crypt_device **ret) {
+        _cleanup_(crypt_freep) struct crypt_device *cd = NULL;
+        int r;
+
+        assert(name);
+        assert(ret);
+
+        r = crypt_init_by_name(&cd, name);
+        if (r < 0)
+                return r;
+
+        if (!streq_ptr(crypt_get_type(cd), CRYPT_VERITY))
+                return -EEXIST;
+
+        *ret = TAKE_PTR(cd);
+        return 0;
+}
+
 static int verity_partition(
                 DissectedPartition *m,
                 DissectedPartition *v,
@@ -962,8 +1032,9 @@ static int verity_partition(
                 DissectImageFlags flags,
                 DecryptedImage *d) {
 
-        _cleanup_free_ char *node = NULL, *name = NULL;
+        _cleanup_free_ char *node = NULL, *name = NULL, *hash = NULL;
         _cleanup_(crypt_freep) struct crypt_device *cd = NULL;
+        bool share, shared = false;
         int r;
 
         assert(m);
@@ -980,31 +1051,67 @@ static int verity_partition(
         if (!streq(v->fstype, "DM_verity_hash"))
                 return 0;
 
-        r = make_dm_name_and_node(m->node, "-verity", &name, &node);
+        /* When sharing, the device is named after the root hash rather than after the partition, so that all
+         * users of the same image find it. The root hash pins down every single block, hence it does not
+         * matter which loopback device the existing one was set up on. */
+        share = (flags & DISSECT_IMAGE_VERITY_SHARE) && root_hash_size * 2 + STRLEN("-verity") < DM_NAME_LEN;
+        if (share) {
+                hash = hexmem(root_hash, root_hash_size);
+                if (!hash)
+                        return -ENOMEM;
+        }
+
+        r = make_dm_name_and_node(share ? hash : m->node, "-verity", &name, &node);
         if (r < 0)
                 return r;
 
         if (!GREEDY_REALLOC0(d->decrypted, d->n_allocated, d->n_decrypted + 1))
                 return -ENOMEM;
 
-        r = crypt_init(&cd, v->node);
-        if (r < 0)
-                return r;
+        if (share) {
+                r = verity_find_shared(name, &cd);
+                if (r >= 0)
+                        shared = true;
+                else if (r != -ENODEV)
+                        return r;
+        }
 
-        r = crypt_load(cd, CRYPT_VERITY, NULL);
-        if (r < 0)
-                return r;
+        if (!shared) {
+                r = crypt_init(&cd, v->node);
+                if (r < 0)
+                        return r;
 
-        r = crypt_set_data_device(cd, m->node);
-        if (r < 0)
-                return r;
+                r = crypt_load(cd, CRYPT_VERITY, NULL);
+                if (r < 0)
+                        return r;
 
-        r = crypt_activate_by_volume_key(cd, name, root_hash, root_hash_size, CRYPT_ACTIVATE_READONLY);
-        if (r < 0)
-                return r;
+                r = crypt_set_data_device(cd, m->node);
+                if (r < 0)
+                        return r;
+
+                r = crypt_activate_by_volume_key(cd, name, root_hash, root_hash_size, CRYPT_ACTIVATE_READONLY);
+                if (r == -EEXIST && share) {
+                        /* Somebody else set it up in the meantime */
+                        crypt_free(cd);
+                        cd = NULL;
+
+                        r = verity_find_shared(name, &cd);
+                        if (r < 0)
+                                return r;
+
+                        shared = true;
+                } else if (r < 0)
+                        return r;
+        }
+
+        if (shared)
+                log_debug("Reusing verity device %s.", name);
 
         d->decrypted[d->n_decrypted].name = TAKE_PTR(name);
         d->decrypted[d->n_decrypted].device = TAKE_PTR(cd);
+        /* Whoever set up a shared device is responsible for removing it, not us */
+        d->decrypted[d->n_decrypted].relinquished = shared;
+        d->decrypted[d->n_decrypted].shared = share;
         d->n_decrypted++;
 
         m->decrypted_node = TAKE_PTR(node);
@@ -711,24 +711,89 @@ static bool is_symlink_with_known_name(const UnitFileInstallInfo *i, const char
         return false;
 }
 
-static int find_symlinks_fd(
+static int find_symlinks_match(
                 const char *root_dir,
                 UnitFileInstallInfo *i,
                 bool match_aliases,
-                int fd,
-                const char *path,
+                const char *p,
+                const char *dest,
                 const char *config_path,
                 bool *same_name_link) {
 
+        _cleanup_free_ char *x = NULL;
+        bool found_path, found_dest, b = false;
+        int q;
+
+        assert(i);
+        assert(p);
+        assert(dest);
+        assert(config_path);
+        assert(same_name_link);
+
+        /* Make absolute */
+        if (!path_is_absolute(dest)) {
+                x = prefix_root(root_dir, dest);
+                if (!x)
+                        return -ENOMEM;
+
+                dest = x;
+        }
+
+        /* Check if the symlink itself matches what we
+         * are looking for */
+        if (path_is_absolute(i->name))
+                found_path = path_equal(p, i->name);
+        else
+                found_path = streq(basename(p), i->name);
+
+        /* Check if what the symlink points to
+         * matches what we are looking for */
+        if (path_is_absolute(i->name))
+                found_dest = path_equal(dest, i->name);
+        else
+                found_dest = streq(basename(dest), i->name);
+
+        if (found_path && found_dest) {
+                _cleanup_free_ char *t = NULL;
+
+                /* Filter out same name links in the main
+                 * config path */
+                t = path_make_absolute(i->name, config_path);
+                if (!t)
+                        return -ENOMEM;
+
+                b = path_equal(t, p);
+        }
+
+        if (b)
+                *same_name_link = true;
+        else if (found_path || found_dest) {
+                if (!match_aliases)
+                        return 1;
+
+                /* Check if symlink name is in the set of names used by [Install] */
+                q = is_symlink_with_known_name(i, basename(p));
+                if (q < 0)
+                        return q;
+                if (q > 0)
+                        return 1;
+        }
+
+        return 0;
+}
+
+typedef int (*symlink_func_t)(const char *p, const char *dest, void *userdata);
+
+static int walk_symlinks_fd(int fd, const char *path, symlink_func_t func, void *userdata) {
         _cleanup_closedir_ DIR *d = NULL;
         struct dirent *de;
         int r = 0;
 
-        assert(i);
         assert(fd >= 0);
         assert(path);
-        assert(config_path);
-        assert(same_name_link);
+        assert(func);
+
+        /* Calls func for every symlink below path, recursively. Stops early if func returns > 0. */
 
         d = fdopendir(fd);
         if (!d) {
@@ -761,16 +826,16 @@ static int find_symlinks_fd(
                         }
 
                         /* This will close nfd, regardless whether it succeeds or not */
-                        q = find_symlinks_fd(root_dir, i, match_aliases, nfd,
-                                             p, config_path, same_name_link);
+                        q = walk_symlinks_fd(nfd, p, func, userdata);
                         if (q > 0)
                                 return 1;
+                        if (q == -ENOMEM)
+                                return q;
                         if (r == 0)
                                 r = q;
 
                 } else if (de->d_type == DT_LNK) {
                         _cleanup_free_ char *p = NULL, *dest = NULL;
-                        bool found_path, found_dest, b = false;
                         int q;
 
                         /* Acquire symlink name */
@@ -788,91 +853,154 @@ static int find_symlinks_fd(
                                 continue;
                         }
 
-                        /* Make absolute */
-                        if (!path_is_absolute(dest)) {
-                                char *x;
+                        q = func(p, dest, userdata);
+                        if (q != 0)
+                                return q;
+                }
+        }
 
-                                x = prefix_root(root_dir, dest);
-                                if (!x)
-                                        return -ENOMEM;
+        return r;
+}
 
-                                free(dest);
-                                dest = x;
-                        }
+static int walk_symlinks(const char *config_path, symlink_func_t func, void *userdata) {
+        int fd;
 
-                        /* Check if the symlink itself matches what we
-                         * are looking for */
-                        if (path_is_absolute(i->name))
-                                found_path = path_equal(p, i->name);
-                        else
-                                found_path = streq(de->d_name, i->name);
+        assert(config_path);
 
-                        /* Check if what the symlink points to
-                         * matches what we are looking for */
-                        if (path_is_absolute(i->name))
-                                found_dest = path_equal(dest, i->name);
-                        else
-                                found_dest = streq(basename(dest), i->name);
+        fd = open(config_path, O_RDONLY|O_NONBLOCK|O_DIRECTORY|O_CLOEXEC);
+        if (fd < 0) {
+                if (IN_SET(errno, ENOENT, ENOTDIR, EACCES))
+                        return 0;
+                return -errno;
+        }
 
-                        if (found_path && found_dest) {
-                                _cleanup_free_ char *t = NULL;
+        /* This takes possession of fd and closes it */
+        return walk_symlinks_fd(fd, config_path, func, userdata);
+}
 
-                                /* Filter out same name links in the main
-                                 * config path */
-                                t = path_make_absolute(i->name, config_path);
-                                if (!t)
-                                        return -ENOMEM;
+/* When the state of many units is queried in one go, the symlinks below each search path are read only once,
+ * instead of walking all of them again for every single unit. Maps search path → SymlinksDir. */
+typedef struct SymlinksDir {
+        char **links;   /* pairs of symlink path and destination as read */
+        int error;      /* first error hit while reading the directory, if any */
+} SymlinksDir;
 
-                                b = path_equal(t, p);
-                        }
+static SymlinksDir *symlinks_dir_free(SymlinksDir *d) {
+        if (!d)
+                return NULL;
 
-                        if (b)
-                                *same_name_link = true;
-                        else if (found_path || found_dest) {
-                                if (!match_aliases)
-                                        return 1;
-
-                                /* Check if symlink name is in the set of names used by [Install] */
-                                q = is_symlink_with_known_name(i, de->d_name);
-                                if (q < 0)
-                                        return q;
-                                if (q > 0)
-                                        return 1;
-                        }
-                }
+        strv_free(d->links);
+        return mfree(d);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(SymlinksDir*, symlinks_dir_free);
+
+static Hashmap *symlinks_cache_free(Hashmap *cache) {
+        return hashmap_free_with_destructor(cache, symlinks_dir_free);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(Hashmap*, symlinks_cache_free);
+
+static int symlinks_dir_add(const char *p, const char *dest, void *userdata) {
+        SymlinksDir *d = userdata;
+
+        if (strv_extend(&d->links, p) < 0 ||
+            strv_extend(&d->links, dest) < 0)
+                return -ENOMEM;
+
+        return 0;
+}
+
+static int symlinks_cache_get(Hashmap *cache, const char *config_path, SymlinksDir **ret) {
+        _cleanup_(symlinks_dir_freep) SymlinksDir *d = NULL;
+        SymlinksDir *found;
+        int r;
+
+        assert(cache);
+        assert(config_path);
+        assert(ret);
+
+        found = hashmap_get(cache, config_path);
+        if (found) {
+                *ret = found;
+                return 0;
         }
 
-        return r;
+        d = new0(SymlinksDir, 1);
+        if (!d)
+                return -ENOMEM;
+
+        d->error = walk_symlinks(config_path, symlinks_dir_add, d);
+        if (d->error == -ENOMEM)
+                return -ENOMEM;
+
+        /* The keys are owned by the LookupPaths object the cache is used with */
+        r = hashmap_put(cache, config_path, d);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(d);
+        return 0;
+}
+
+typedef struct FindSymlinksData {
+        const char *root_dir;
+        UnitFileInstallInfo *info;
+        bool match_aliases;
+        const char *config_path;
+        bool *same_name_link;
+} FindSymlinksData;
+
+static int find_symlinks_one(const char *p, const char *dest, void *userdata) {
+        FindSymlinksData *data = userdata;
+
+        return find_symlinks_match(data->root_dir, data->info, data->match_aliases, p, dest,
+                                   data->config_path, data->same_name_link);
 }
 
 static int find_symlinks(
                 const char *root_dir,
+                Hashmap *cache,
                 UnitFileInstallInfo *i,
                 bool match_name,
                 const char *config_path,
                 bool *same_name_link) {
 
-        int fd;
+        FindSymlinksData data = {
+                .root_dir = root_dir,
+                .info = i,
+                .match_aliases = match_name,
+                .config_path = config_path,
+                .same_name_link = same_name_link,
+        };
+        SymlinksDir *d;
+        char **p, **dest;
+        int r;
 
         assert(i);
         assert(config_path);
         assert(same_name_link);
 
-        fd = open(config_path, O_RDONLY|O_NONBLOCK|O_DIRECTORY|O_CLOEXEC);
-        if (fd < 0) {
-                if (IN_SET(errno, ENOENT, ENOTDIR, EACCES))
-                        return 0;
-                return -errno;
+        if (!cache)
+                return walk_symlinks(config_path, find_symlinks_one, &data);
+
+        r = symlinks_cache_get(cache, config_path, &d);
+        if (r < 0)
+                return r;
+
+        STRV_FOREACH_PAIR(p, dest, d->links) {
+                r = find_symlinks_one(*p, *dest, &data);
+                if (r != 0)
+                        return r;
         }
 
-        /* This takes possession of fd and closes it */
-        return find_symlinks_fd(root_dir, i, match_name, fd,
-                                config_path, config_path, same_name_link);
+        return d->error;
 }
 
 static int find_symlinks_in_scope(
                 UnitFileScope scope,
                 const LookupPaths *paths,
+                Hashmap *cache,
                 UnitFileInstallInfo *i,
                 bool match_name,
                 UnitFileState *state) {
@@ -888,7 +1016,7 @@ static int find_symlinks_in_scope(
         STRV_FOREACH(p, paths->search_path)  {
                 bool same_name_link = false;
 
-                r = find_symlinks(paths->root_dir, i, match_name, *p, &same_name_link);
+                r = find_symlinks(paths->root_dir, cache, i, match_name, *p, &same_name_link);
                 if (r < 0)
                         return r;
                 if (r > 0) {
@@ -2641,9 +2769,10 @@ int unit_file_get_default(
         return 0;
 }
 
-int unit_file_lookup_state(
+static int unit_file_lookup_state_full(
                 UnitFileScope scope,
                 const LookupPaths *paths,
+                Hashmap *symlinks_cache,
                 const char *name,
                 UnitFileState *ret) {
 
@@ -2697,7 +2826,7 @@ int unit_file_lookup_state(
                 /* Check if any of the Alias= symlinks have been created.
                  * We ignore other aliases, and only check those that would
                  * be created by systemctl enable for this unit. */
-                r = find_symlinks_in_scope(scope, paths, i, true, &state);
+                r = find_symlinks_in_scope(scope, paths, symlinks_cache, i, true, &state);
                 if (r < 0)
                         return r;
                 if (r > 0)
@@ -2705,7 +2834,7 @@ int unit_file_lookup_state(
 
                 /* Check if the file is known under other names. If it is,
                  * it might be in use. Report that as UNIT_FILE_INDIRECT. */
-                r = find_symlinks_in_scope(scope, paths, i, false, &state);
+                r = find_symlinks_in_scope(scope, paths, symlinks_cache, i, false, &state);
                 if (r < 0)
                         return r;
                 if (r > 0)
@@ -2729,6 +2858,15 @@ int unit_file_lookup_state(
         return 0;
 }
 
+int unit_file_lookup_state(
+                UnitFileScope scope,
+                const LookupPaths *paths,
+                const char *name,
+                UnitFileState *ret) {
+
+        return unit_file_lookup_state_full(scope, paths, NULL, name, ret);
+}
+
 int unit_file_get_state(
                 UnitFileScope scope,
                 const char *root_dir,
@@ -3146,6 +3284,7 @@ int unit_file_get_list(
                 char **patterns) {
 
         _cleanup_(lookup_paths_free) LookupPaths paths = {};
+        _cleanup_(symlinks_cache_freep) Hashmap *symlinks_cache = NULL;
         char **i;
         int r;
 
@@ -3157,6 +3296,12 @@ int unit_file_get_list(
         if (r < 0)
                 return r;
 
+        /* The state of every single unit file is determined by looking at all symlinks in the search path,
+         * hence read them only once for all of them */
+        symlinks_cache = hashmap_new(&path_hash_ops);
+        if (!symlinks_cache)
+                return -ENOMEM;
+
         STRV_FOREACH(i, paths.search_path) {
                 _cleanup_closedir_ DIR *d = NULL;
                 struct dirent *de;
@@ -3198,7 +3343,7 @@ int unit_file_get_list(
                         if (!f->path)
                                 return -ENOMEM;
 
-                        r = unit_file_lookup_state(scope, &paths, de->d_name, &f->state);
+                        r = unit_file_lookup_state_full(scope, &paths, symlinks_cache, de->d_name, &f->state);
                         if (r < 0)
                                 f->state = UNIT_FILE_BAD;
 
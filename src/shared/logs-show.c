@@ -743,15 +743,27 @@ void json_escape(
                 fputc('\"', f);
 
                 while (l > 0) {
+                        size_t n;
+
+                        /* Write out runs of characters that need no escaping in one go */
+                        for (n = 0; n < l; n++)
+                                if (IN_SET(p[n], '"', '\\') || (uint8_t) p[n] < ' ')
+                                        break;
+
+                        if (n > 0) {
+                                fwrite(p, 1, n, f);
+                                p += n;
+                                l -= n;
+                                continue;
+                        }
+
                         if (IN_SET(*p, '"', '\\')) {
                                 fputc('\\', f);
                                 fputc(*p, f);
                         } else if (*p == '\n')
                                 fputs("\\n", f);
-                        else if ((uint8_t) *p < ' ')
-                                fprintf(f, "\\u%04x", (uint8_t) *p);
                         else
-                                fputc(*p, f);
+                                fprintf(f, "\\u%04x", (uint8_t) *p);
 
                         p++;
                         l--;
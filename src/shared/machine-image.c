@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/file.h>
+#include <sys/inotify.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <linux/fs.h>
@@ -520,6 +521,34 @@ int image_find_harder(ImageClass class, const char *name_or_path, Image **ret) {
         return image_from_path(name_or_path, ret);
 }
 
+int image_watch_search_path(ImageClass class, int inotify_fd) {
+        const char *path;
+        int n = 0;
+
+        assert(class >= 0);
+        assert(class < _IMAGE_CLASS_MAX);
+        assert(inotify_fd >= 0);
+
+        /* Adds inotify watches for all directories image_discover() looks at, so that callers can cache its result
+         * until images are added, removed, renamed or have their attributes changed. Directories that don't exist
+         * are skipped. Returns the number of watches added. */
+
+        NULSTR_FOREACH(path, image_search_path[class]) {
+                if (inotify_add_watch(inotify_fd, path,
+                                      IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_ATTRIB|IN_CLOSE_WRITE|
+                                      IN_DELETE_SELF|IN_MOVE_SELF|IN_ONLYDIR) < 0) {
+                        if (IN_SET(errno, ENOENT, ENOTDIR))
+                                continue;
+
+                        return -errno;
+                }
+
+                n++;
+        }
+
+        return n;
+}
+
 int image_discover(ImageClass class, Hashmap *h) {
         const char *path;
         int r;
@@ -887,7 +916,7 @@ int image_clone(Image *i, const char *new_name, bool read_only) {
         case IMAGE_RAW:
                 new_path = strjoina("/var/lib/machines/", new_name, ".raw");
 
-                r = copy_file_atomic(i->path, new_path, read_only ? 0444 : 0644, FS_NOCOW_FL, COPY_REFLINK);
+                r = copy_file_atomic(i->path, new_path, read_only ? 0444 : 0644, FS_NOCOW_FL, COPY_REFLINK|COPY_HOLES);
                 break;
 
         case IMAGE_BLOCK:
@@ -1082,6 +1111,137 @@ int image_set_limit(Image *i, uint64_t referenced_max) {
         return btrfs_subvol_set_subtree_quota_limit(i->path, 0, referenced_max);
 }
 
+/* Reading the metadata of a raw image means setting up a loopback device, dissecting it and mounting its root
+ * file system in a child process. machined and portabled are asked for it over and over again, hence remember
+ * what we found, for as long as the image file is neither replaced nor modified. */
+#define IMAGE_METADATA_CACHE_MAX 64U
+
+typedef struct ImageMetadata {
+        dev_t dev;
+        ino_t ino;
+        usec_t mtime;
+
+        char *hostname;
+        sd_id128_t machine_id;
+        char **machine_info;
+        char **os_release;
+} ImageMetadata;
+
+static Hashmap *metadata_cache = NULL;
+
+static void image_metadata_free(ImageMetadata *c) {
+        if (!c)
+                return;
+
+        free(c->hostname);
+        strv_free(c->machine_info);
+        strv_free(c->os_release);
+        free(c);
+}
+
+static void metadata_cache_flush(void) {
+        char *path;
+
+        while ((path = hashmap_first_key(metadata_cache))) {
+                image_metadata_free(hashmap_remove(metadata_cache, path));
+                free(path);
+        }
+}
+
+static int metadata_copy(const char *hostname, sd_id128_t machine_id, char **machine_info, char **os_release,
+                         char **ret_hostname, sd_id128_t *ret_machine_id, char ***ret_machine_info, char ***ret_os_release) {
+
+        _cleanup_strv_free_ char **mi = NULL, **osr = NULL;
+        _cleanup_free_ char *h = NULL;
+
+        if (hostname) {
+                h = strdup(hostname);
+                if (!h)
+                        return -ENOMEM;
+        }
+
+        if (machine_info) {
+                mi = strv_copy(machine_info);
+                if (!mi)
+                        return -ENOMEM;
+        }
+
+        if (os_release) {
+                osr = strv_copy(os_release);
+                if (!osr)
+                        return -ENOMEM;
+        }
+
+        free_and_replace(*ret_hostname, h);
+        *ret_machine_id = machine_id;
+        strv_free_and_replace(*ret_machine_info, mi);
+        strv_free_and_replace(*ret_os_release, osr);
+
+        return 0;
+}
+
+static int metadata_cache_get(Image *i, const struct stat *st) {
+        ImageMetadata *c;
+
+        c = hashmap_get(metadata_cache, i->path);
+        if (!c)
+                return 0;
+
+        if (c->dev != st->st_dev || c->ino != st->st_ino || c->mtime != timespec_load(&st->st_mtim))
+                return 0;
+
+        return metadata_copy(c->hostname, c->machine_id, c->machine_info, c->os_release,
+                             &i->hostname, &i->machine_id, &i->machine_info, &i->os_release) < 0 ? -ENOMEM : 1;
+}
+
+static int metadata_cache_put(Image *i, const struct stat *st) {
+        _cleanup_free_ char *path = NULL;
+        ImageMetadata *c;
+        int r;
+
+        r = hashmap_ensure_allocated(&metadata_cache, &path_hash_ops);
+        if (r < 0)
+                return r;
+
+        c = hashmap_get(metadata_cache, i->path);
+        if (!c) {
+                if (hashmap_size(metadata_cache) >= IMAGE_METADATA_CACHE_MAX)
+                        metadata_cache_flush();
+
+                path = strdup(i->path);
+                if (!path)
+                        return -ENOMEM;
+
+                c = new0(ImageMetadata, 1);
+                if (!c)
+                        return -ENOMEM;
+
+                r = hashmap_put(metadata_cache, path, c);
+                if (r < 0) {
+                        free(c);
+                        return r;
+                }
+
+                path = NULL;
+        }
+
+        c->dev = st->st_dev;
+        c->ino = st->st_ino;
+        c->mtime = timespec_load(&st->st_mtim);
+
+        r = metadata_copy(i->hostname, i->machine_id, i->machine_info, i->os_release,
+                          &c->hostname, &c->machine_id, &c->machine_info, &c->os_release);
+        if (r < 0) {
+                char *key = NULL;
+
+                image_metadata_free(hashmap_remove2(metadata_cache, i->path, (void**) &key));
+                free(key);
+                return r;
+        }
+
+        return 0;
+}
+
 int image_read_metadata(Image *i) {
         _cleanup_(release_lock_file) LockFile global_lock = LOCK_FILE_INIT, local_lock = LOCK_FILE_INIT;
         int r;
@@ -1155,6 +1315,18 @@ int image_read_metadata(Image *i) {
         case IMAGE_BLOCK: {
                 _cleanup_(loop_device_unrefp) LoopDevice *d = NULL;
                 _cleanup_(dissected_image_unrefp) DissectedImage *m = NULL;
+                struct stat st;
+                bool cacheable;
+
+                /* Block devices may change under us without their timestamps being updated, only cache files */
+                cacheable = i->type == IMAGE_RAW && stat(i->path, &st) >= 0 && S_ISREG(st.st_mode);
+                if (cacheable) {
+                        r = metadata_cache_get(i, &st);
+                        if (r < 0)
+                                return r;
+                        if (r > 0)
+                                break;
+                }
 
                 r = loop_device_make_by_path(i->path, O_RDONLY, &d);
                 if (r < 0)
@@ -1173,6 +1345,12 @@ int image_read_metadata(Image *i) {
                 strv_free_and_replace(i->machine_info, m->machine_info);
                 strv_free_and_replace(i->os_release, m->os_release);
 
+                if (cacheable) {
+                        r = metadata_cache_put(i, &st);
+                        if (r < 0)
+                                log_debug_errno(r, "Failed to cache metadata of image %s, ignoring: %m", i->name);
+                }
+
                 break;
         }
 
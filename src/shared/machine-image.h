@@ -74,6 +74,7 @@ int image_find(ImageClass class, const char *name, Image **ret);
 int image_from_path(const char *path, Image **ret);
 int image_find_harder(ImageClass class, const char *name_or_path, Image **ret);
 int image_discover(ImageClass class, Hashmap *map);
+int image_watch_search_path(ImageClass class, int inotify_fd);
 
 int image_remove(Image *i);
 int image_rename(Image *i, const char *new_name);
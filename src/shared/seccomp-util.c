@@ -6,16 +6,20 @@
 ***/
 
 #include <errno.h>
+#include <linux/filter.h>
 #include <linux/seccomp.h>
 #include <seccomp.h>
 #include <stddef.h>
 #include <sys/mman.h>
 #include <sys/prctl.h>
 #include <sys/shm.h>
+#include <sys/stat.h>
 
 #include "af-list.h"
 #include "alloc-util.h"
+#include "fd-util.h"
 #include "macro.h"
+#include "memfd-util.h"
 #include "nsflags.h"
 #include "process-util.h"
 #include "seccomp-util.h"
@@ -889,43 +893,308 @@ int seccomp_load_syscall_filter_set(uint32_t default_action, const SyscallFilter
         return 0;
 }
 
-int seccomp_load_syscall_filter_set_raw(uint32_t default_action, Hashmap* set, uint32_t action) {
+/* Compiling a big system call filter with libseccomp is expensive, and services are started with the same
+ * filters over and over again. Hence PID 1 compiles SystemCallFilter= before forking off the service process
+ * and keeps the resulting BPF programs around, keyed by what went into them. The forked off child finds them
+ * in its copy of the cache, and only has to hand them to the kernel. */
+#define SECCOMP_FILTER_CACHE_MAX 256U
+
+typedef struct SeccompFilterRule {
+        int id;         /* system call number */
+        int error;      /* errno to return, or -1 for the default */
+} SeccompFilterRule;
+
+typedef struct SeccompProgram {
         uint32_t arch;
+        struct sock_fprog fprog;
+} SeccompProgram;
+
+typedef struct SeccompFilterCacheEntry {
+        uint32_t default_action;
+        uint32_t action;
+        SeccompFilterRule *rules;
+        size_t n_rules;
+
+        SeccompProgram *programs;
+        size_t n_programs, n_allocated;
+} SeccompFilterCacheEntry;
+
+static Hashmap *seccomp_filter_cache = NULL;
+
+static void seccomp_filter_cache_entry_hash_func(const void *p, struct siphash *state) {
+        const SeccompFilterCacheEntry *e = p;
+
+        siphash24_compress(&e->default_action, sizeof(e->default_action), state);
+        siphash24_compress(&e->action, sizeof(e->action), state);
+        siphash24_compress(&e->n_rules, sizeof(e->n_rules), state);
+        siphash24_compress(e->rules, e->n_rules * sizeof(SeccompFilterRule), state);
+}
+
+static int seccomp_filter_cache_entry_compare_func(const void *_a, const void *_b) {
+        const SeccompFilterCacheEntry *a = _a, *b = _b;
+
+        if (a->default_action != b->default_action)
+                return a->default_action < b->default_action ? -1 : 1;
+        if (a->action != b->action)
+                return a->action < b->action ? -1 : 1;
+        if (a->n_rules != b->n_rules)
+                return a->n_rules < b->n_rules ? -1 : 1;
+        if (a->n_rules == 0)
+                return 0;
+
+        return memcmp(a->rules, b->rules, a->n_rules * sizeof(SeccompFilterRule));
+}
+
+static const struct hash_ops seccomp_filter_cache_hash_ops = {
+        .hash = seccomp_filter_cache_entry_hash_func,
+        .compare = seccomp_filter_cache_entry_compare_func,
+};
+
+static SeccompFilterCacheEntry *seccomp_filter_cache_entry_free(SeccompFilterCacheEntry *e) {
+        size_t i;
+
+        if (!e)
+                return NULL;
+
+        for (i = 0; i < e->n_programs; i++)
+                free(e->programs[i].fprog.filter);
+
+        free(e->programs);
+        free(e->rules);
+        return mfree(e);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(SeccompFilterCacheEntry*, seccomp_filter_cache_entry_free);
+
+static int seccomp_filter_rule_compare(const void *_a, const void *_b) {
+        const SeccompFilterRule *a = _a, *b = _b;
+
+        if (a->id != b->id)
+                return a->id < b->id ? -1 : 1;
+
+        return 0;
+}
+
+static int seccomp_filter_rules_from_set(Hashmap *set, SeccompFilterRule **ret, size_t *ret_n) {
+        _cleanup_free_ SeccompFilterRule *rules = NULL;
+        size_t n = 0;
+        Iterator i;
+        void *id, *val;
+
+        /* Turns the Hashmap into an array sorted by system call, so that it can be compared with others */
+
+        if (!hashmap_isempty(set)) {
+                rules = new(SeccompFilterRule, hashmap_size(set));
+                if (!rules)
+                        return -ENOMEM;
+
+                HASHMAP_FOREACH_KEY(val, id, set, i)
+                        rules[n++] = (SeccompFilterRule) {
+                                .id = PTR_TO_INT(id) - 1,
+                                .error = PTR_TO_INT(val),
+                        };
+
+                qsort_safe(rules, n, sizeof(SeccompFilterRule), seccomp_filter_rule_compare);
+        }
+
+        *ret = TAKE_PTR(rules);
+        *ret_n = n;
+        return 0;
+}
+
+static int seccomp_init_for_arch_with_rules(
+                scmp_filter_ctx *ret,
+                uint32_t arch,
+                uint32_t default_action,
+                const SeccompFilterRule *rules,
+                size_t n_rules,
+                uint32_t action) {
+
+        _cleanup_(seccomp_releasep) scmp_filter_ctx seccomp = NULL;
+        size_t i;
         int r;
 
-        /* Similar to seccomp_load_syscall_filter_set(), but takes a raw Set* of syscalls, instead of a
-         * SyscallFilterSet* table. */
+        log_debug("Operating on architecture: %s", seccomp_arch_to_string(arch));
+
+        r = seccomp_init_for_arch(&seccomp, arch, default_action);
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < n_rules; i++) {
+                uint32_t a = action;
+
+                if (action != SCMP_ACT_ALLOW && rules[i].error >= 0)
+                        a = SCMP_ACT_ERRNO(rules[i].error);
+
+                r = seccomp_rule_add_exact(seccomp, a, rules[i].id, 0);
+                if (r < 0) {
+                        /* If the system call is not known on this architecture, then that's fine, let's ignore it */
+                        _cleanup_free_ char *n = NULL;
+
+                        n = seccomp_syscall_resolve_num_arch(SCMP_ARCH_NATIVE, rules[i].id);
+                        log_debug_errno(r, "Failed to add rule for system call %s() / %d, ignoring: %m", strna(n), rules[i].id);
+                }
+        }
+
+        *ret = TAKE_PTR(seccomp);
+        return 0;
+}
+
+static int seccomp_export_program(scmp_filter_ctx seccomp, struct sock_fprog *ret) {
+        _cleanup_free_ struct sock_filter *filter = NULL;
+        _cleanup_close_ int fd = -1;
+        struct stat st;
+        ssize_t n;
+        int r;
+
+        assert(seccomp);
+        assert(ret);
+
+        fd = memfd_new("seccomp-filter");
+        if (fd < 0)
+                return fd;
+
+        r = seccomp_export_bpf(seccomp, fd);
+        if (r < 0)
+                return r;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        if (st.st_size <= 0 ||
+            st.st_size % sizeof(struct sock_filter) != 0 ||
+            st.st_size / sizeof(struct sock_filter) > USHRT_MAX)
+                return -EBADMSG;
+
+        filter = malloc(st.st_size);
+        if (!filter)
+                return -ENOMEM;
+
+        n = pread(fd, filter, st.st_size, 0);
+        if (n < 0)
+                return -errno;
+        if (n != st.st_size)
+                return -EIO;
+
+        *ret = (struct sock_fprog) {
+                .len = st.st_size / sizeof(struct sock_filter),
+                .filter = TAKE_PTR(filter),
+        };
+
+        return 0;
+}
+
+int seccomp_precompile_syscall_filter_set_raw(uint32_t default_action, Hashmap* set, uint32_t action) {
+        _cleanup_(seccomp_filter_cache_entry_freep) SeccompFilterCacheEntry *e = NULL;
+        uint32_t arch;
+        int r;
+
+        /* Compiles what seccomp_load_syscall_filter_set_raw() would load, and remembers it, so that later calls
+         * to it in this process or in forked off children with the same parameters are cheap. */
 
         if (hashmap_isempty(set) && default_action == SCMP_ACT_ALLOW)
                 return 0;
 
+        e = new0(SeccompFilterCacheEntry, 1);
+        if (!e)
+                return -ENOMEM;
+
+        e->default_action = default_action;
+        e->action = action;
+
+        r = seccomp_filter_rules_from_set(set, &e->rules, &e->n_rules);
+        if (r < 0)
+                return r;
+
+        if (hashmap_get(seccomp_filter_cache, e))
+                return 0;
+
         SECCOMP_FOREACH_LOCAL_ARCH(arch) {
                 _cleanup_(seccomp_releasep) scmp_filter_ctx seccomp = NULL;
-                Iterator i;
-                void *id, *val;
 
-                log_debug("Operating on architecture: %s", seccomp_arch_to_string(arch));
+                r = seccomp_init_for_arch_with_rules(&seccomp, arch, default_action, e->rules, e->n_rules, action);
+                if (r < 0)
+                        return r;
 
-                r = seccomp_init_for_arch(&seccomp, arch, default_action);
+                if (!GREEDY_REALLOC(e->programs, e->n_allocated, e->n_programs + 1))
+                        return -ENOMEM;
+
+                r = seccomp_export_program(seccomp, &e->programs[e->n_programs].fprog);
                 if (r < 0)
                         return r;
 
-                HASHMAP_FOREACH_KEY(val, id, set, i) {
-                        uint32_t a = action;
-                        int e = PTR_TO_INT(val);
+                e->programs[e->n_programs++].arch = arch;
+        }
 
-                        if (action != SCMP_ACT_ALLOW && e >= 0)
-                                a = SCMP_ACT_ERRNO(e);
+        /* Units come and go, don't let the cache grow without bounds */
+        if (hashmap_size(seccomp_filter_cache) >= SECCOMP_FILTER_CACHE_MAX)
+                seccomp_filter_cache = hashmap_free_with_destructor(seccomp_filter_cache, seccomp_filter_cache_entry_free);
 
-                        r = seccomp_rule_add_exact(seccomp, a, PTR_TO_INT(id) - 1, 0);
-                        if (r < 0) {
-                                /* If the system call is not known on this architecture, then that's fine, let's ignore it */
-                                _cleanup_free_ char *n = NULL;
+        r = hashmap_ensure_allocated(&seccomp_filter_cache, &seccomp_filter_cache_hash_ops);
+        if (r < 0)
+                return r;
 
-                                n = seccomp_syscall_resolve_num_arch(SCMP_ARCH_NATIVE, PTR_TO_INT(id) - 1);
-                                log_debug_errno(r, "Failed to add rule for system call %s() / %d, ignoring: %m", strna(n), PTR_TO_INT(id) - 1);
-                        }
+        r = hashmap_put(seccomp_filter_cache, e, e);
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(e);
+        return 1;
+}
+
+static int seccomp_load_programs(const SeccompFilterCacheEntry *e) {
+        size_t i;
+
+        assert(e);
+
+        for (i = 0; i < e->n_programs; i++) {
+                log_debug("Operating on architecture: %s", seccomp_arch_to_string(e->programs[i].arch));
+
+                if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &e->programs[i].fprog, 0, 0) < 0) {
+                        if (IN_SET(errno, EPERM, EACCES))
+                                return -errno;
+
+                        log_debug_errno(errno, "Failed to install filter set for architecture %s, skipping: %m", seccomp_arch_to_string(e->programs[i].arch));
                 }
+        }
+
+        return 0;
+}
+
+int seccomp_load_syscall_filter_set_raw(uint32_t default_action, Hashmap* set, uint32_t action) {
+        _cleanup_free_ SeccompFilterRule *rules = NULL;
+        SeccompFilterCacheEntry key, *e;
+        size_t n_rules;
+        uint32_t arch;
+        int r;
+
+        /* Similar to seccomp_load_syscall_filter_set(), but takes a raw Set* of syscalls, instead of a
+         * SyscallFilterSet* table. */
+
+        if (hashmap_isempty(set) && default_action == SCMP_ACT_ALLOW)
+                return 0;
+
+        r = seccomp_filter_rules_from_set(set, &rules, &n_rules);
+        if (r < 0)
+                return r;
+
+        key = (SeccompFilterCacheEntry) {
+                .default_action = default_action,
+                .action = action,
+                .rules = rules,
+                .n_rules = n_rules,
+        };
+
+        e = hashmap_get(seccomp_filter_cache, &key);
+        if (e)
+                return seccomp_load_programs(e);
+
+        SECCOMP_FOREACH_LOCAL_ARCH(arch) {
+                _cleanup_(seccomp_releasep) scmp_filter_ctx seccomp = NULL;
+
+                r = seccomp_init_for_arch_with_rules(&seccomp, arch, default_action, rules, n_rules, action);
+                if (r < 0)
+                        return r;
 
                 r = seccomp_load(seccomp);
                 if (IN_SET(r, -EPERM, -EACCES))
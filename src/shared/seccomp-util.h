@@ -67,6 +67,7 @@ int seccomp_add_syscall_filter_item(scmp_filter_ctx *ctx, const char *name, uint
 
 int seccomp_load_syscall_filter_set(uint32_t default_action, const SyscallFilterSet *set, uint32_t action);
 int seccomp_load_syscall_filter_set_raw(uint32_t default_action, Hashmap* set, uint32_t action);
+int seccomp_precompile_syscall_filter_set_raw(uint32_t default_action, Hashmap* set, uint32_t action);
 
 typedef enum SeccompParseFlags {
         SECCOMP_PARSE_INVERT     = 1U << 0,
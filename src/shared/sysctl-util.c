@@ -42,17 +42,23 @@ char *sysctl_normalize(char *s) {
         return s;
 }
 
-int sysctl_write(const char *property, const char *value) {
-        char *p;
+int sysctl_write_at(int dir_fd, const char *property, const char *value) {
         _cleanup_close_ int fd = -1;
 
+        assert(dir_fd >= 0 || dir_fd == AT_FDCWD);
         assert(property);
         assert(value);
 
         log_debug("Setting '%s' to '%s'", property, value);
 
-        p = strjoina("/proc/sys/", property);
-        fd = open(p, O_WRONLY|O_CLOEXEC);
+        /* Callers writing many values keep /proc/sys open, and save us the lookup of the whole path every
+         * time. The property must be relative to it then. */
+        if (dir_fd == AT_FDCWD)
+                property = strjoina("/proc/sys/", property);
+        else
+                property += strspn(property, "/");
+
+        fd = openat(dir_fd, property, O_WRONLY|O_CLOEXEC|O_NOCTTY);
         if (fd < 0)
                 return -errno;
 
@@ -65,6 +71,10 @@ int sysctl_write(const char *property, const char *value) {
         return 0;
 }
 
+int sysctl_write(const char *property, const char *value) {
+        return sysctl_write_at(AT_FDCWD, property, value);
+}
+
 int sysctl_read(const char *property, char **content) {
         char *p;
 
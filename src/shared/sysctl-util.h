@@ -10,4 +10,5 @@
 char *sysctl_normalize(char *s);
 int sysctl_read(const char *property, char **value);
 int sysctl_write(const char *property, const char *value);
+int sysctl_write_at(int dir_fd, const char *property, const char *value);
 
@@ -8,9 +8,11 @@
 #include <alloc-util.h>
 #include <fs-util.h>
 #include <libgen.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <util.h>
 
+#include "log.h"
 #include "tests.h"
 #include "path-util.h"
 
@@ -59,3 +61,20 @@ const char* get_testdata_dir(const char *suffix) {
         strncpy(testdir + strlen(testdir), suffix, sizeof(testdir) - strlen(testdir) - 1);
         return testdir;
 }
+
+void benchmark_report(const char *label, uint64_t n, usec_t start) {
+        double rate;
+        usec_t t;
+
+        assert(label);
+
+        t = now(CLOCK_MONOTONIC) - start;
+        rate = t > 0 ? (double) n * USEC_PER_SEC / t : 0.0;
+
+        log_info("%-32s %10" PRIu64 " in %8.3fs (%12.0f/s, %10.1fns each)",
+                 label, n, (double) t / USEC_PER_SEC, rate,
+                 n > 0 ? (double) t * NSEC_PER_USEC / n : 0.0);
+
+        printf("%s\t%" PRIu64 "\t" USEC_FMT "\t%.0f\n", label, n, t, rate);
+        fflush(stdout);
+}
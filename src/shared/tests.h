@@ -7,5 +7,13 @@
   Copyright 2016 Lennart Poettering
 ***/
 
+#include <inttypes.h>
+
+#include "time-util.h"
+
 char* setup_fake_runtime_dir(void);
 const char* get_testdata_dir(const char *suffix);
+
+/* Logs how long the n operations of a benchmark case took since start, and writes them to stdout as one
+ * tab-separated "<case> <operations> <elapsed usec> <operations per second>" line for scripts. */
+void benchmark_report(const char *label, uint64_t n, usec_t start);
@@ -31,18 +31,46 @@
 #include "util.h"
 
 #define BUFFER_SIZE (256 * 1024)
+
+/* How many drained pipe buffers to keep around for reuse by later connections */
+#define PIPE_POOL_MAX 64U
+
 static unsigned arg_connections_max = 256;
+static unsigned arg_pool_size = 0;
 
 static const char *arg_remote_host = NULL;
 
+typedef struct PipeBuffer {
+        int fd[2];
+        size_t size;
+} PipeBuffer;
+
 typedef struct Context {
         sd_event *event;
         sd_resolve *resolve;
 
         Set *listen;
         Set *connections;
+
+        /* Idle connections to the remote host, see --pool-size= */
+        Set *pool;
+        union sockaddr_union remote_address;
+        socklen_t remote_address_len;
+        sd_resolve_query *resolve_query;
+
+        PipeBuffer *pipes;
+        size_t n_pipes, n_pipes_allocated;
 } Context;
 
+typedef struct PoolConnection {
+        Context *context;
+
+        int fd;
+        bool connected;
+
+        sd_event_source *event_source;
+} PoolConnection;
+
 typedef struct Connection {
         Context *context;
 
@@ -58,6 +86,30 @@ typedef struct Connection {
         sd_resolve_query *resolve_query;
 } Connection;
 
+static void context_release_pipe(Context *context, int buffer[2], size_t full, size_t size) {
+        assert(buffer);
+
+        if (buffer[0] < 0)
+                return;
+
+        /* Only pipes we know are empty may be handed to another connection */
+        if (context &&
+            full == 0 &&
+            context->n_pipes < PIPE_POOL_MAX &&
+            GREEDY_REALLOC(context->pipes, context->n_pipes_allocated, context->n_pipes + 1)) {
+
+                context->pipes[context->n_pipes++] = (PipeBuffer) {
+                        .fd = { buffer[0], buffer[1] },
+                        .size = size,
+                };
+
+                buffer[0] = buffer[1] = -1;
+                return;
+        }
+
+        safe_close_pair(buffer);
+}
+
 static void connection_free(Connection *c) {
         assert(c);
 
@@ -70,19 +122,40 @@ static void connection_free(Connection *c) {
         safe_close(c->server_fd);
         safe_close(c->client_fd);
 
-        safe_close_pair(c->server_to_client_buffer);
-        safe_close_pair(c->client_to_server_buffer);
+        context_release_pipe(c->context, c->server_to_client_buffer, c->server_to_client_buffer_full, c->server_to_client_buffer_size);
+        context_release_pipe(c->context, c->client_to_server_buffer, c->client_to_server_buffer_full, c->client_to_server_buffer_size);
 
         sd_resolve_query_unref(c->resolve_query);
 
         free(c);
 }
 
+static void pool_connection_free(PoolConnection *p) {
+        assert(p);
+
+        if (p->context)
+                set_remove(p->context->pool, p);
+
+        sd_event_source_unref(p->event_source);
+        safe_close(p->fd);
+
+        free(p);
+}
+
 static void context_free(Context *context) {
+        size_t i;
+
         assert(context);
 
         set_free_with_destructor(context->listen, sd_event_source_unref);
         set_free_with_destructor(context->connections, connection_free);
+        set_free_with_destructor(context->pool, pool_connection_free);
+
+        for (i = 0; i < context->n_pipes; i++)
+                safe_close_pair(context->pipes[i].fd);
+        free(context->pipes);
+
+        sd_resolve_query_unref(context->resolve_query);
 
         sd_event_unref(context->event);
         sd_resolve_unref(context->resolve);
@@ -98,6 +171,16 @@ static int connection_create_pipes(Connection *c, int buffer[2], size_t *sz) {
         if (buffer[0] >= 0)
                 return 0;
 
+        if (c->context->n_pipes > 0) {
+                PipeBuffer *b = c->context->pipes + --c->context->n_pipes;
+
+                buffer[0] = b->fd[0];
+                buffer[1] = b->fd[1];
+                *sz = b->size;
+
+                return 0;
+        }
+
         r = pipe2(buffer, O_CLOEXEC|O_NONBLOCK);
         if (r < 0)
                 return log_error_errno(errno, "Failed to allocate pipe buffer: %m");
@@ -370,42 +453,73 @@ fail:
         return 0; /* ignore errors, continue serving */
 }
 
-static int resolve_remote(Connection *c) {
+static const struct addrinfo resolve_hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_flags = AI_ADDRCONFIG
+};
 
-        static const struct addrinfo hints = {
-                .ai_family = AF_UNSPEC,
-                .ai_socktype = SOCK_STREAM,
-                .ai_flags = AI_ADDRCONFIG
-        };
+static int parse_remote(union sockaddr_union *sa, socklen_t *salen, char **node, const char **service) {
+        const char *e;
 
-        union sockaddr_union sa = {};
-        const char *node, *service;
-        int r;
+        assert(sa);
+        assert(salen);
+        assert(node);
+        assert(service);
+
+        /* Returns 1 if the remote host is an AF_UNIX socket and sa is initialized, 0 if node and service need to be
+         * resolved first */
 
         if (path_is_absolute(arg_remote_host)) {
-                sa.un.sun_family = AF_UNIX;
-                strncpy(sa.un.sun_path, arg_remote_host, sizeof(sa.un.sun_path));
-                return connection_start(c, &sa.sa, SOCKADDR_UN_LEN(sa.un));
+                *sa = (union sockaddr_union) {};
+                sa->un.sun_family = AF_UNIX;
+                strncpy(sa->un.sun_path, arg_remote_host, sizeof(sa->un.sun_path));
+                *salen = SOCKADDR_UN_LEN(sa->un);
+                return 1;
         }
 
         if (arg_remote_host[0] == '@') {
-                sa.un.sun_family = AF_UNIX;
-                sa.un.sun_path[0] = 0;
-                strncpy(sa.un.sun_path+1, arg_remote_host+1, sizeof(sa.un.sun_path)-1);
-                return connection_start(c, &sa.sa, SOCKADDR_UN_LEN(sa.un));
+                *sa = (union sockaddr_union) {};
+                sa->un.sun_family = AF_UNIX;
+                sa->un.sun_path[0] = 0;
+                strncpy(sa->un.sun_path+1, arg_remote_host+1, sizeof(sa->un.sun_path)-1);
+                *salen = SOCKADDR_UN_LEN(sa->un);
+                return 1;
         }
 
-        service = strrchr(arg_remote_host, ':');
-        if (service) {
-                node = strndupa(arg_remote_host, service - arg_remote_host);
-                service++;
+        e = strrchr(arg_remote_host, ':');
+        if (e) {
+                *node = strndup(arg_remote_host, e - arg_remote_host);
+                if (!*node)
+                        return -ENOMEM;
+                *service = e + 1;
         } else {
-                node = arg_remote_host;
-                service = "80";
+                *node = strdup(arg_remote_host);
+                if (!*node)
+                        return -ENOMEM;
+                *service = "80";
         }
 
+        return 0;
+}
+
+static int resolve_remote(Connection *c) {
+        _cleanup_free_ char *node = NULL;
+        union sockaddr_union sa;
+        const char *service;
+        socklen_t salen;
+        int r;
+
+        r = parse_remote(&sa, &salen, &node, &service);
+        if (r < 0) {
+                log_oom();
+                goto fail;
+        }
+        if (r > 0)
+                return connection_start(c, &sa.sa, salen);
+
         log_debug("Looking up address info for %s:%s", node, service);
-        r = sd_resolve_getaddrinfo(c->context->resolve, &c->resolve_query, node, service, &hints, resolve_cb, c);
+        r = sd_resolve_getaddrinfo(c->context->resolve, &c->resolve_query, node, service, &resolve_hints, resolve_cb, c);
         if (r < 0) {
                 log_error_errno(r, "Failed to resolve remote host: %m");
                 goto fail;
@@ -418,6 +532,173 @@ fail:
         return 0; /* ignore errors, continue serving */
 }
 
+static int pool_idle_cb(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        PoolConnection *p = userdata;
+        char b;
+        ssize_t n;
+
+        assert(s);
+        assert(p);
+
+        /* Some protocols have the server speak first, keep such connections, the data is forwarded once a client
+         * takes the connection. Anything else means the remote host gave up on us. */
+        n = recv(fd, &b, 1, MSG_PEEK|MSG_DONTWAIT);
+        if (n > 0) {
+                (void) sd_event_source_set_enabled(s, SD_EVENT_OFF);
+                return 0;
+        }
+        if (n < 0 && IN_SET(errno, EAGAIN, EINTR))
+                return 0;
+
+        log_debug("Idle connection to remote host was closed.");
+        pool_connection_free(p);
+        return 0;
+}
+
+static int pool_connection_watch(PoolConnection *p) {
+        assert(p);
+        assert(!p->event_source);
+
+        p->connected = true;
+
+        return sd_event_add_io(p->context->event, &p->event_source, p->fd, EPOLLIN|EPOLLRDHUP, pool_idle_cb, p);
+}
+
+static int pool_connect_cb(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        PoolConnection *p = userdata;
+        socklen_t solen;
+        int error, r;
+
+        assert(s);
+        assert(p);
+
+        solen = sizeof(error);
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &solen) < 0) {
+                log_debug_errno(errno, "Failed to issue SO_ERROR: %m");
+                goto fail;
+        }
+
+        if (error != 0) {
+                log_debug_errno(error, "Failed to connect idle connection to remote host: %m");
+                goto fail;
+        }
+
+        p->event_source = sd_event_source_unref(p->event_source);
+
+        r = pool_connection_watch(p);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to watch idle connection: %m");
+                goto fail;
+        }
+
+        return 0;
+
+fail:
+        pool_connection_free(p);
+        return 0;
+}
+
+static int pool_refill(Context *context) {
+        int r;
+
+        assert(context);
+
+        /* Until we know where to connect to, all connections go through resolve_remote() */
+        if (context->remote_address_len == 0)
+                return 0;
+
+        /* Failed connects are not retried right away, but only on the next incoming connection, so that we don't
+         * spin while the remote host is down. They aren't fatal either, the pool is just short until then. */
+        while (set_size(context->pool) < arg_pool_size) {
+                PoolConnection *p;
+
+                r = set_ensure_allocated(&context->pool, NULL);
+                if (r < 0)
+                        return log_oom();
+
+                p = new0(PoolConnection, 1);
+                if (!p)
+                        return log_oom();
+
+                p->context = context;
+
+                p->fd = socket(context->remote_address.sa.sa_family, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+                if (p->fd < 0) {
+                        free(p);
+                        log_warning_errno(errno, "Failed to get remote socket for idle connection, retrying later: %m");
+                        return 0;
+                }
+
+                r = set_put(context->pool, p);
+                if (r < 0) {
+                        safe_close(p->fd);
+                        free(p);
+                        return log_oom();
+                }
+
+                if (connect(p->fd, &context->remote_address.sa, context->remote_address_len) >= 0)
+                        r = pool_connection_watch(p);
+                else if (errno == EINPROGRESS) {
+                        r = sd_event_add_io(context->event, &p->event_source, p->fd, EPOLLOUT, pool_connect_cb, p);
+                        if (r >= 0)
+                                r = sd_event_source_set_enabled(p->event_source, SD_EVENT_ONESHOT);
+                } else
+                        r = log_debug_errno(errno, "Failed to connect idle connection to remote host, retrying later: %m");
+                if (r < 0) {
+                        pool_connection_free(p);
+                        return 0;
+                }
+        }
+
+        return 0;
+}
+
+static int pool_take(Context *context) {
+        PoolConnection *p;
+        Iterator i;
+        int fd;
+
+        assert(context);
+
+        SET_FOREACH(p, context->pool, i) {
+                if (!p->connected)
+                        continue;
+
+                fd = p->fd;
+                p->fd = -1;
+                pool_connection_free(p);
+
+                return fd;
+        }
+
+        return -EAGAIN;
+}
+
+static int context_resolve_cb(sd_resolve_query *q, int ret, const struct addrinfo *ai, void *userdata) {
+        Context *context = userdata;
+
+        assert(q);
+        assert(context);
+
+        context->resolve_query = sd_resolve_query_unref(context->resolve_query);
+
+        if (ret != 0) {
+                log_warning("Failed to resolve host, not keeping idle connections: %s", gai_strerror(ret));
+                return 0;
+        }
+
+        if (ai->ai_addrlen > sizeof(context->remote_address)) {
+                log_warning("Address of remote host too long, not keeping idle connections.");
+                return 0;
+        }
+
+        memcpy(&context->remote_address, ai->ai_addr, ai->ai_addrlen);
+        context->remote_address_len = ai->ai_addrlen;
+
+        (void) pool_refill(context);
+        return 0;
+}
+
 static int add_connection_socket(Context *context, int fd) {
         Connection *c;
         int r;
@@ -456,9 +737,47 @@ static int add_connection_socket(Context *context, int fd) {
                 return 0;
         }
 
+        if (arg_pool_size > 0) {
+                int client_fd;
+
+                client_fd = pool_take(context);
+                (void) pool_refill(context);
+
+                if (client_fd >= 0) {
+                        log_debug("Using idle connection to remote host.");
+                        c->client_fd = client_fd;
+                        return connection_complete(c);
+                }
+        }
+
         return resolve_remote(c);
 }
 
+static int context_setup_pool(Context *context) {
+        _cleanup_free_ char *node = NULL;
+        const char *service;
+        int r;
+
+        assert(context);
+
+        if (arg_pool_size == 0)
+                return 0;
+
+        /* The pool always connects to the first address the remote host resolved to at startup */
+        r = parse_remote(&context->remote_address, &context->remote_address_len, &node, &service);
+        if (r < 0)
+                return log_oom();
+        if (r > 0)
+                return pool_refill(context);
+
+        log_debug("Looking up address info for %s:%s", node, service);
+        r = sd_resolve_getaddrinfo(context->resolve, &context->resolve_query, node, service, &resolve_hints, context_resolve_cb, context);
+        if (r < 0)
+                return log_error_errno(r, "Failed to resolve remote host: %m");
+
+        return 0;
+}
+
 static int accept_cb(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
         _cleanup_free_ char *peer = NULL;
         Context *context = userdata;
@@ -544,6 +863,8 @@ static void help(void) {
                "%1$s [SOCKET]\n\n"
                "Bidirectionally proxy local sockets to another (possibly remote) socket.\n\n"
                "  -c --connections-max=  Set the maximum number of connections to be accepted\n"
+               "     --pool-size=        Keep the given number of idle connections to the\n"
+               "                         remote host open\n"
                "  -h --help              Show this help\n"
                "     --version           Show package version\n",
                program_invocation_short_name);
@@ -553,11 +874,13 @@ static int parse_argv(int argc, char *argv[]) {
 
         enum {
                 ARG_VERSION = 0x100,
-                ARG_IGNORE_ENV
+                ARG_IGNORE_ENV,
+                ARG_POOL_SIZE,
         };
 
         static const struct option options[] = {
                 { "connections-max", required_argument, NULL, 'c'           },
+                { "pool-size",       required_argument, NULL, ARG_POOL_SIZE },
                 { "help",            no_argument,       NULL, 'h'           },
                 { "version",         no_argument,       NULL, ARG_VERSION   },
                 {}
@@ -590,6 +913,15 @@ static int parse_argv(int argc, char *argv[]) {
 
                         break;
 
+                case ARG_POOL_SIZE:
+                        r = safe_atou(optarg, &arg_pool_size);
+                        if (r < 0) {
+                                log_error("Failed to parse --pool-size= argument: %s", optarg);
+                                return r;
+                        }
+
+                        break;
+
                 case ARG_VERSION:
                         return version();
 
@@ -662,6 +994,10 @@ int main(int argc, char *argv[]) {
                         goto finish;
         }
 
+        r = context_setup_pool(&context);
+        if (r < 0)
+                goto finish;
+
         r = sd_event_loop(context.event);
         if (r < 0) {
                 log_error_errno(r, "Failed to run event loop: %m");
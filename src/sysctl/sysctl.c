@@ -6,6 +6,7 @@
 ***/
 
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <limits.h>
 #include <stdbool.h>
@@ -24,20 +25,34 @@
 #include "strv.h"
 #include "sysctl-util.h"
 #include "terminal-util.h"
+#include "time-util.h"
 #include "util.h"
 
 static char **arg_prefixes = NULL;
 static bool arg_cat_config = false;
 
 static int apply_all(OrderedHashmap *sysctl_options) {
+        _cleanup_close_ int dir_fd = -1;
+        char ts[FORMAT_TIMESPAN_MAX];
         char *property, *value;
+        usec_t start;
         Iterator i;
         int r = 0;
 
+        start = now(CLOCK_MONOTONIC);
+
+        /* Resolve /proc/sys only once for the whole batch, if that fails every write resolves it anew */
+        dir_fd = open("/proc/sys", O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (dir_fd < 0)
+                log_debug_errno(errno, "Failed to open /proc/sys, ignoring: %m");
+
         ORDERED_HASHMAP_FOREACH_KEY(value, property, sysctl_options, i) {
+                usec_t t;
                 int k;
 
-                k = sysctl_write(property, value);
+                t = now(CLOCK_MONOTONIC);
+                k = sysctl_write_at(dir_fd >= 0 ? dir_fd : AT_FDCWD, property, value);
+                log_debug("Wrote '%s' in %s.", property, format_timespan(ts, sizeof(ts), now(CLOCK_MONOTONIC) - t, 1));
                 if (k < 0) {
                         /* If the sysctl is not available in the kernel or we are running with reduced privileges and
                          * cannot write it, then log about the issue at LOG_NOTICE level, and proceed without
@@ -54,6 +69,9 @@ static int apply_all(OrderedHashmap *sysctl_options) {
                 }
         }
 
+        log_debug("Applied %u sysctl settings in %s.", ordered_hashmap_size(sysctl_options),
+                  format_timespan(ts, sizeof(ts), now(CLOCK_MONOTONIC) - start, 1));
+
         return r;
 }
 
@@ -4907,11 +4907,126 @@ static const char* const systemctl_show_mode_table[] = {
 
 DEFINE_PRIVATE_STRING_TABLE_LOOKUP_FROM_STRING(systemctl_show_mode, SystemctlShowMode);
 
-static int show_one(
+/* Up to this many explicitly requested properties are queried one by one, instead of retrieving all of
+ * them with GetAll(), which makes PID 1 call every single getter of every interface of the unit. */
+#define SHOW_PROPERTIES_ONE_BY_ONE_MAX 8U
+
+static int get_unit_property(
+                sd_bus *bus,
+                const char *path,
+                const char *unit,
+                const char *name,
+                sd_bus_message **ret) {
+
+        const char *interface;
+        int r;
+
+        assert(bus);
+        assert(path);
+        assert(unit);
+        assert(name);
+        assert(ret);
+
+        /* The property might be on the generic unit interface or on the type specific one. Returns 0 if it
+         * is on neither. */
+
+        FOREACH_STRING(interface, "org.freedesktop.systemd1.Unit", unit_dbus_interface_from_type(unit_name_to_type(unit))) {
+                _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+
+                r = sd_bus_call_method(
+                                bus,
+                                "org.freedesktop.systemd1",
+                                path,
+                                "org.freedesktop.DBus.Properties",
+                                "Get",
+                                &error,
+                                &reply,
+                                "ss", interface, name);
+                if (r >= 0) {
+                        *ret = TAKE_PTR(reply);
+                        return 1;
+                }
+                if (!sd_bus_error_has_name(&error, SD_BUS_ERROR_UNKNOWN_PROPERTY) &&
+                    !sd_bus_error_has_name(&error, SD_BUS_ERROR_UNKNOWN_INTERFACE))
+                        return log_error_errno(r, "Failed to get property %s: %s", name, bus_error_message(&error, r));
+        }
+
+        return 0;
+}
+
+static int show_properties_one_by_one(
+                sd_bus *bus,
+                const char *path,
+                const char *unit,
+                bool *new_line) {
+
+        _cleanup_set_free_ Set *found_properties = NULL;
+        char **pp;
+        int r;
+
+        assert(bus);
+        assert(path);
+        assert(unit);
+        assert(new_line);
+
+        found_properties = set_new(&string_hash_ops);
+        if (!found_properties)
+                return log_oom();
+
+        if (*new_line)
+                printf("\n");
+
+        *new_line = true;
+
+        STRV_FOREACH(pp, arg_properties) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+                const char *contents;
+
+                /* Print every property only once, even if specified multiple times */
+                r = set_put(found_properties, *pp);
+                if (r < 0)
+                        return log_oom();
+                if (r == 0)
+                        continue;
+
+                r = get_unit_property(bus, path, unit, *pp, &reply);
+                if (r < 0)
+                        return r;
+                if (r == 0) {
+                        log_debug("Property %s does not exist.", *pp);
+                        continue;
+                }
+
+                r = sd_bus_message_peek_type(reply, NULL, &contents);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+
+                r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_VARIANT, contents);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+
+                r = print_property(*pp, reply, arg_value, arg_all);
+                if (r == 0)
+                        r = bus_print_property(*pp, reply, arg_value, arg_all);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+        }
+
+        return 0;
+}
+
+static bool show_one_uses_get_all(const char *unit, SystemctlShowMode show_mode) {
+        return !(show_mode == SYSTEMCTL_SHOW_PROPERTIES && unit && !arg_all &&
+                 !strv_isempty(arg_properties) && strv_length(arg_properties) <= SHOW_PROPERTIES_ONE_BY_ONE_MAX);
+}
+
+static int show_one_full(
                 sd_bus *bus,
                 const char *path,
                 const char *unit,
                 SystemctlShowMode show_mode,
+                sd_bus_message *prefetched,
                 bool *new_line,
                 bool *ellipsized) {
 
@@ -5012,15 +5127,29 @@ static int show_one(
 
         log_debug("Showing one %s", path);
 
-        r = bus_map_all_properties(
-                        bus,
-                        "org.freedesktop.systemd1",
-                        path,
-                        show_mode == SYSTEMCTL_SHOW_STATUS ? status_map : property_map,
-                        BUS_MAP_BOOLEAN_AS_BOOL,
-                        &error,
-                        &reply,
-                        &info);
+        if (!show_one_uses_get_all(unit, show_mode))
+                return show_properties_one_by_one(bus, path, unit, new_line);
+
+        if (prefetched) {
+                /* The GetAll() reply was already requested by the caller */
+                r = bus_message_map_all_properties(
+                                prefetched,
+                                show_mode == SYSTEMCTL_SHOW_STATUS ? status_map : property_map,
+                                BUS_MAP_BOOLEAN_AS_BOOL,
+                                &error,
+                                &info);
+                if (r >= 0)
+                        reply = sd_bus_message_ref(prefetched);
+        } else
+                r = bus_map_all_properties(
+                                bus,
+                                "org.freedesktop.systemd1",
+                                path,
+                                show_mode == SYSTEMCTL_SHOW_STATUS ? status_map : property_map,
+                                BUS_MAP_BOOLEAN_AS_BOOL,
+                                &error,
+                                &reply,
+                                &info);
         if (r < 0)
                 return log_error_errno(r, "Failed to get properties: %s", bus_error_message(&error, r));
 
@@ -5101,6 +5230,183 @@ static int get_unit_dbus_path_by_pid(
         return 0;
 }
 
+static int show_one(
+                sd_bus *bus,
+                const char *path,
+                const char *unit,
+                SystemctlShowMode show_mode,
+                bool *new_line,
+                bool *ellipsized) {
+
+        return show_one_full(bus, path, unit, show_mode, NULL, new_line, ellipsized);
+}
+
+/* When showing many units, the properties of the next units are requested while the current one is shown, so that
+ * we don't wait for one round trip per unit, which adds up on remote connections. */
+#define SHOW_PREFETCH_MAX 32U
+
+typedef struct ShowPrefetch {
+        char *path;
+        sd_bus_slot *slot;
+        sd_bus_message *reply;
+        sd_bus_error error;
+        bool done;
+} ShowPrefetch;
+
+static void show_prefetch_free_many(ShowPrefetch *p, size_t n) {
+        size_t i;
+
+        for (i = 0; i < n; i++) {
+                free(p[i].path);
+                sd_bus_slot_unref(p[i].slot);
+                sd_bus_message_unref(p[i].reply);
+                sd_bus_error_free(&p[i].error);
+        }
+
+        free(p);
+}
+
+static int show_prefetch_handler(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        ShowPrefetch *p = userdata;
+
+        assert(m);
+        assert(p);
+
+        if (sd_bus_message_is_method_error(m, NULL))
+                (void) sd_bus_error_copy(&p->error, sd_bus_message_get_error(m));
+        else
+                p->reply = sd_bus_message_ref(m);
+
+        p->slot = sd_bus_slot_unref(p->slot);
+        p->done = true;
+
+        return 0;
+}
+
+static int show_prefetch_queue(sd_bus *bus, ShowPrefetch *p) {
+        assert(bus);
+        assert(p);
+
+        return sd_bus_call_method_async(
+                        bus,
+                        &p->slot,
+                        "org.freedesktop.systemd1",
+                        p->path,
+                        "org.freedesktop.DBus.Properties",
+                        "GetAll",
+                        show_prefetch_handler,
+                        p,
+                        "s", "");
+}
+
+static int show_prefetch_wait(sd_bus *bus, ShowPrefetch *p) {
+        int r;
+
+        assert(bus);
+        assert(p);
+
+        while (!p->done) {
+                r = sd_bus_process(bus, NULL);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        continue;
+
+                r = sd_bus_wait(bus, (uint64_t) -1);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int show_many(
+                sd_bus *bus,
+                char **names,
+                SystemctlShowMode show_mode,
+                bool *new_line,
+                bool *ellipsized) {
+
+        ShowPrefetch *p = NULL;
+        size_t n, i, n_queued = 0;
+        int r, ret = 0;
+
+        assert(bus);
+
+        n = strv_length(names);
+        if (n <= 1 || !show_one_uses_get_all(names[0], show_mode)) {
+                char **name;
+
+                STRV_FOREACH(name, names) {
+                        _cleanup_free_ char *path = NULL;
+
+                        path = unit_dbus_path_from_name(*name);
+                        if (!path)
+                                return log_oom();
+
+                        r = show_one(bus, path, *name, show_mode, new_line, ellipsized);
+                        if (r < 0)
+                                return r;
+                        if (r > 0 && ret == 0)
+                                ret = r;
+                }
+
+                return ret;
+        }
+
+        p = new0(ShowPrefetch, n);
+        if (!p)
+                return log_oom();
+
+        for (i = 0; i < n; i++) {
+                p[i].path = unit_dbus_path_from_name(names[i]);
+                if (!p[i].path) {
+                        r = log_oom();
+                        goto finish;
+                }
+        }
+
+        for (i = 0; i < n; i++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+
+                /* Keep a limited number of requests in flight, so that we don't pile up replies for thousands
+                 * of units in memory */
+                for (; n_queued < n && n_queued < i + SHOW_PREFETCH_MAX; n_queued++) {
+                        r = show_prefetch_queue(bus, p + n_queued);
+                        if (r < 0) {
+                                log_error_errno(r, "Failed to request properties: %m");
+                                goto finish;
+                        }
+                }
+
+                r = show_prefetch_wait(bus, p + i);
+                if (r < 0) {
+                        log_error_errno(r, "Failed to get properties: %m");
+                        goto finish;
+                }
+
+                if (!p[i].reply) {
+                        r = log_error_errno(sd_bus_error_get_errno(&p[i].error),
+                                            "Failed to get properties: %s", bus_error_message(&p[i].error, 0));
+                        goto finish;
+                }
+
+                reply = TAKE_PTR(p[i].reply);
+
+                r = show_one_full(bus, p[i].path, names[i], show_mode, reply, new_line, ellipsized);
+                if (r < 0)
+                        goto finish;
+                if (r > 0 && ret == 0)
+                        ret = r;
+        }
+
+        r = ret;
+
+finish:
+        show_prefetch_free_many(p, n);
+        return r;
+}
+
 static int show_all(
                 sd_bus *bus,
                 bool *new_line,
@@ -5108,9 +5414,9 @@ static int show_all(
 
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         _cleanup_free_ UnitInfo *unit_infos = NULL;
-        const UnitInfo *u;
-        unsigned c;
-        int r, ret = 0;
+        _cleanup_free_ char **names = NULL;
+        unsigned c, i;
+        int r;
 
         r = get_unit_list(bus, NULL, NULL, &unit_infos, 0, &reply);
         if (r < 0)
@@ -5122,21 +5428,15 @@ static int show_all(
 
         qsort_safe(unit_infos, c, sizeof(UnitInfo), compare_unit_info);
 
-        for (u = unit_infos; u < unit_infos + c; u++) {
-                _cleanup_free_ char *p = NULL;
+        /* The strings are owned by the reply */
+        names = new0(char*, c + 1);
+        if (!names)
+                return log_oom();
 
-                p = unit_dbus_path_from_name(u->id);
-                if (!p)
-                        return log_oom();
+        for (i = 0; i < c; i++)
+                names[i] = (char*) unit_infos[i].id;
 
-                r = show_one(bus, p, u->id, SYSTEMCTL_SHOW_STATUS, new_line, ellipsized);
-                if (r < 0)
-                        return r;
-                else if (r > 0 && ret == 0)
-                        ret = r;
-        }
-
-        return ret;
+        return show_many(bus, names, SYSTEMCTL_SHOW_STATUS, new_line, ellipsized);
 }
 
 static int show_system_status(sd_bus *bus) {
@@ -5205,6 +5505,105 @@ static int show_system_status(sd_bus *bus) {
         return 0;
 }
 
+static int show_properties_by_patterns(sd_bus *bus, char **patterns, bool *new_line) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_strv_free_ char **globs = NULL;
+        char **name;
+        int r;
+
+        assert(bus);
+        assert(new_line);
+
+        /* Shows the properties of all units matching the globs with a single call, instead of one call per
+         * unit. Returns 0 if this cannot be done, in which case the caller should query the units
+         * individually: plain unit names need to be shown even if the unit is not loaded, and the manager
+         * might be too old to know the method. */
+
+        STRV_FOREACH(name, patterns) {
+                char *t;
+
+                r = unit_name_mangle(*name, UNIT_NAME_MANGLE_GLOB | (arg_quiet ? 0 : UNIT_NAME_MANGLE_WARN), &t);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to mangle name: %m");
+
+                if (!string_is_glob(t)) {
+                        free(t);
+                        return 0;
+                }
+
+                r = strv_consume(&globs, t);
+                if (r < 0)
+                        return log_oom();
+        }
+
+        r = sd_bus_message_new_method_call(
+                        bus,
+                        &m,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "ListUnitPropertiesByPatterns");
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_message_append_strv(m, arg_states);
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_message_append_strv(m, globs);
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_message_append_strv(m, arg_properties);
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_call(bus, m, 0, &error, &reply);
+        if (r < 0 && (sd_bus_error_has_name(&error, SD_BUS_ERROR_UNKNOWN_METHOD) ||
+                      sd_bus_error_has_name(&error, SD_BUS_ERROR_ACCESS_DENIED))) {
+                log_debug_errno(r, "Failed to list unit properties: %s Falling back to querying units individually.", bus_error_message(&error, r));
+                return 0;
+        }
+        if (r < 0)
+                return log_error_errno(r, "Failed to list unit properties: %s", bus_error_message(&error, r));
+
+        r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(sa{sv})");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        while ((r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_STRUCT, "sa{sv}")) > 0) {
+                const char *id;
+
+                r = sd_bus_message_read(reply, "s", &id);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+
+                log_debug("Showing one %s", id);
+
+                if (*new_line)
+                        printf("\n");
+
+                *new_line = true;
+
+                r = bus_message_print_all_properties(reply, print_property, arg_properties, arg_value, arg_all, NULL);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+
+                r = sd_bus_message_exit_container(reply);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+        }
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        r = sd_bus_message_exit_container(reply);
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        return 1;
+}
+
 static int show(int argc, char *argv[], void *userdata) {
         bool new_line = false, ellipsized = false;
         SystemctlShowMode show_mode;
@@ -5285,6 +5684,15 @@ static int show(int argc, char *argv[], void *userdata) {
                                 ret = r;
                 }
 
+                /* Only with a property filter, a reply with all properties of many units might get too big */
+                if (!strv_isempty(patterns) && show_mode == SYSTEMCTL_SHOW_PROPERTIES && !strv_isempty(arg_properties)) {
+                        r = show_properties_by_patterns(bus, patterns, &new_line);
+                        if (r < 0)
+                                return r;
+                        if (r > 0)
+                                patterns = mfree(patterns);
+                }
+
                 if (!strv_isempty(patterns)) {
                         _cleanup_strv_free_ char **names = NULL;
 
@@ -5292,19 +5700,11 @@ static int show(int argc, char *argv[], void *userdata) {
                         if (r < 0)
                                 return log_error_errno(r, "Failed to expand names: %m");
 
-                        STRV_FOREACH(name, names) {
-                                _cleanup_free_ char *path;
-
-                                path = unit_dbus_path_from_name(*name);
-                                if (!path)
-                                        return log_oom();
-
-                                r = show_one(bus, path, *name, show_mode, &new_line, &ellipsized);
-                                if (r < 0)
-                                        return r;
-                                if (r > 0 && ret == 0)
-                                        ret = r;
-                        }
+                        r = show_many(bus, names, show_mode, &new_line, &ellipsized);
+                        if (r < 0)
+                                return r;
+                        if (r > 0 && ret == 0)
+                                ret = r;
                 }
         }
 
@@ -73,6 +73,7 @@ enum {
         SD_JOURNAL_SYSTEM       = 1 << 2,
         SD_JOURNAL_CURRENT_USER = 1 << 3,
         SD_JOURNAL_OS_ROOT      = 1 << 4,
+        SD_JOURNAL_SHARE_MAPPINGS = 1 << 5,
 
         SD_JOURNAL_SYSTEM_ONLY = SD_JOURNAL_SYSTEM /* deprecated name */
 };
@@ -41,6 +41,7 @@ typedef enum {SD_GENL_ID_CTRL, SD_GENL_WIREGUARD} sd_genl_family;
 /* callback */
 
 typedef int (*sd_netlink_message_handler_t)(sd_netlink *nl, sd_netlink_message *m, void *userdata);
+typedef int (*sd_netlink_overrun_handler_t)(sd_netlink *nl, uint64_t n_overruns, void *userdata);
 
 /* bus */
 int sd_netlink_new_from_netlink(sd_netlink **nl, int fd);
@@ -58,6 +59,8 @@ int sd_netlink_call_async(sd_netlink *nl, sd_netlink_message *message,
 int sd_netlink_call_async_cancel(sd_netlink *nl, uint32_t serial);
 int sd_netlink_call(sd_netlink *nl, sd_netlink_message *message, uint64_t timeout,
                  sd_netlink_message **reply);
+int sd_netlink_batch_begin(sd_netlink *nl);
+int sd_netlink_batch_end(sd_netlink *nl);
 
 int sd_netlink_get_events(sd_netlink *nl);
 int sd_netlink_get_timeout(sd_netlink *nl, uint64_t *timeout);
@@ -67,6 +70,9 @@ int sd_netlink_wait(sd_netlink *nl, uint64_t timeout);
 int sd_netlink_add_match(sd_netlink *nl, uint16_t match, sd_netlink_message_handler_t c, void *userdata);
 int sd_netlink_remove_match(sd_netlink *nl, uint16_t match, sd_netlink_message_handler_t c, void *userdata);
 
+int sd_netlink_set_overrun_handler(sd_netlink *nl, sd_netlink_overrun_handler_t c, void *userdata);
+int sd_netlink_get_overruns(sd_netlink *nl, uint64_t *ret);
+
 int sd_netlink_attach_event(sd_netlink *nl, sd_event *e, int64_t priority);
 int sd_netlink_detach_event(sd_netlink *nl);
 
@@ -169,6 +169,11 @@ sd_network_monitor* sd_network_monitor_unref(sd_network_monitor *m);
 /* Flushes the monitor */
 int sd_network_monitor_flush(sd_network_monitor *m);
 
+/* Flushes the monitor, and returns the interface indexes of the links whose state changed since the
+ * last flush. Returns > 0 if those are known, and 0 if any link might have changed (for example because
+ * events were lost), in which case the array is NULL. */
+int sd_network_monitor_flush_links(sd_network_monitor *m, int **ret_ifindexes, size_t *ret_n);
+
 /* Get FD from monitor */
 int sd_network_monitor_get_fd(sd_network_monitor *m);
 
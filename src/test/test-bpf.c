@@ -29,6 +29,8 @@ int main(int argc, char *argv[]) {
         CGroupContext *cc = NULL;
         _cleanup_(bpf_program_unrefp) BPFProgram *p = NULL;
         _cleanup_(manager_freep) Manager *m = NULL;
+        BPFProgram *ingress, *egress;
+        int deny_map_fd;
         Unit *u;
         char log_buf[65535];
         int r;
@@ -123,6 +125,15 @@ int main(int argc, char *argv[]) {
         assert(u->ip_bpf_ingress);
         assert(u->ip_bpf_egress);
 
+        /* Nothing changed, hence compiling again must keep the programs and maps */
+        ingress = u->ip_bpf_ingress;
+        egress = u->ip_bpf_egress;
+        deny_map_fd = u->ipv4_deny_map_fd;
+        assert_se(bpf_firewall_compile(u) >= 0);
+        assert_se(u->ip_bpf_ingress == ingress);
+        assert_se(u->ip_bpf_egress == egress);
+        assert_se(u->ipv4_deny_map_fd == deny_map_fd);
+
         r = bpf_program_load_kernel(u->ip_bpf_ingress, log_buf, ELEMENTSOF(log_buf));
 
         log_notice("log:");
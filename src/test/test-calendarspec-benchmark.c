@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+***/
+
+#include <stdio.h>
+
+#include "alloc-util.h"
+#include "calendarspec.h"
+#include "log.h"
+#include "parse-util.h"
+#include "tests.h"
+#include "time-util.h"
+#include "util.h"
+
+/* This program measures how quickly calendar specs are evaluated, by looking for each spec's next elapse
+ * repeatedly, starting from its previous result.
+ *
+ * Usage: test-calendarspec-benchmark [ITERATIONS]
+ *
+ * The results are logged, and written to stdout in the format of benchmark_report(). */
+
+static unsigned arg_iterations = 100000;
+
+static void measure(const char *input) {
+        _cleanup_(calendar_spec_freep) CalendarSpec *c = NULL;
+        usec_t start, u;
+        unsigned i;
+
+        assert_se(calendar_spec_from_string(input, &c) >= 0);
+
+        start = now(CLOCK_MONOTONIC);
+
+        for (i = 0, u = 0; i < arg_iterations; i++)
+                if (calendar_spec_next_usec(c, u, &u) < 0)
+                        u = 0;
+
+        benchmark_report(input, arg_iterations, start);
+}
+
+int main(int argc, char *argv[]) {
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        if (argc >= 2)
+                assert_se(safe_atou(argv[1], &arg_iterations) >= 0);
+
+        measure("*:*:*");
+        measure("hourly");
+        measure("Mon *-*-* 00:00:00");
+        measure("Sat..Sun *-*~01 12:00:00");
+        measure("*-02-29 00:00:00");
+        measure("Fri *-*-13 13:13:13 UTC");
+
+        return 0;
+}
@@ -5,10 +5,12 @@
   Copyright 2014 Ronny Chevalier
 ***/
 
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "alloc-util.h"
 #include "copy.h"
+#include "dirent-util.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "fs-util.h"
@@ -148,6 +150,60 @@ static void test_copy_tree(void) {
         (void) rm_rf(original_dir, REMOVE_ROOT|REMOVE_PHYSICAL);
 }
 
+static void test_copy_tree_hardlinks(void) {
+        char original_dir[] = "/tmp/test-copy_tree_hardlinks/";
+        char copy_dir[] = "/tmp/test-copy_tree_hardlinks-copy/";
+        const char *f, *a, *b, *c;
+        struct stat st_a, st_b, st_c, st_f;
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+        unsigned n = 0;
+
+        log_info("%s", __func__);
+
+        (void) rm_rf(copy_dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+        (void) rm_rf(original_dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        f = strjoina(original_dir, "file");
+        a = strjoina(original_dir, "a");
+        b = strjoina(original_dir, "dir/b");
+        assert_se(mkdir_parents(b, 0755) >= 0);
+        assert_se(write_string_file(a, "hardlinked", WRITE_STRING_FILE_CREATE) == 0);
+        assert_se(link(a, b) == 0);
+        assert_se(write_string_file(f, "single", WRITE_STRING_FILE_CREATE) == 0);
+
+        assert_se(copy_tree(original_dir, copy_dir, UID_INVALID, GID_INVALID, COPY_REFLINK|COPY_HARDLINKS) == 0);
+
+        a = strjoina(copy_dir, "a");
+        b = strjoina(copy_dir, "dir/b");
+        f = strjoina(copy_dir, "file");
+        assert_se(stat(a, &st_a) >= 0);
+        assert_se(stat(b, &st_b) >= 0);
+        assert_se(stat(f, &st_f) >= 0);
+        assert_se(st_a.st_ino == st_b.st_ino);
+        assert_se(st_a.st_nlink == 2);
+        assert_se(st_f.st_nlink == 1);
+
+        /* The lookup table must be gone */
+        assert_se(d = opendir("/tmp"));
+        FOREACH_DIRENT_ALL(de, d, break)
+                if (startswith(de->d_name, ".#hardlinktest-copy_tree_hardlinks-copy"))
+                        n++;
+        assert_se(n == 0);
+
+        /* Without the flag each link gets its own copy */
+        assert_se(rm_rf(copy_dir, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        assert_se(copy_tree(original_dir, copy_dir, UID_INVALID, GID_INVALID, COPY_REFLINK) == 0);
+
+        c = strjoina(copy_dir, "dir/b");
+        assert_se(stat(a, &st_a) >= 0);
+        assert_se(stat(c, &st_c) >= 0);
+        assert_se(st_a.st_ino != st_c.st_ino);
+
+        (void) rm_rf(copy_dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+        (void) rm_rf(original_dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+}
+
 static void test_copy_bytes(void) {
         _cleanup_close_pair_ int pipefd[2] = {-1, -1};
         _cleanup_close_ int infd = -1;
@@ -240,10 +296,60 @@ static void test_copy_bytes_regular_file(const char *src, bool try_reflink, uint
         unlink(fn3);
 }
 
+static void test_copy_holes(void) {
+        char fn[] = "/tmp/test-copy-hole-fd-XXXXXX";
+        char fn_copy[] = "/tmp/test-copy-hole-fd-XXXXXX";
+        _cleanup_free_ char *a = NULL, *b = NULL;
+        _cleanup_close_ int fd = -1, fd_copy = -1;
+        const uint64_t limits[] = { UINT64_MAX, 512 * 1024, 1024 * 1024 + 100 };
+        struct stat st_copy;
+        size_t la, lb;
+        unsigned i;
+        char buf[4096];
+
+        fd = mkostemp_safe(fn);
+        assert_se(fd >= 0);
+        fd_copy = mkostemp_safe(fn_copy);
+        assert_se(fd_copy >= 0);
+
+        memset(buf, 'a', sizeof(buf));
+
+        /* Data, a hole, more data, and another hole at the end */
+        assert_se(write(fd, buf, sizeof(buf)) == sizeof(buf));
+        assert_se(lseek(fd, 1024 * 1024, SEEK_SET) >= 0);
+        assert_se(write(fd, buf, sizeof(buf)) == sizeof(buf));
+        assert_se(ftruncate(fd, 2 * 1024 * 1024) >= 0);
+
+        assert_se(read_full_file(fn, &a, &la) >= 0);
+        assert_se(la == 2 * 1024 * 1024);
+
+        for (i = 0; i < ELEMENTSOF(limits); i++) {
+                size_t expected = MIN(limits[i], (uint64_t) la);
+
+                assert_se(lseek(fd, 0, SEEK_SET) == 0);
+                assert_se(lseek(fd_copy, 0, SEEK_SET) == 0);
+                assert_se(ftruncate(fd_copy, 0) >= 0);
+
+                assert_se(copy_bytes(fd, fd_copy, limits[i], COPY_HOLES) == (limits[i] == UINT64_MAX ? 0 : 1));
+
+                assert_se(fstat(fd_copy, &st_copy) >= 0);
+                assert_se((uint64_t) st_copy.st_size == expected);
+
+                b = mfree(b);
+                assert_se(read_full_file(fn_copy, &b, &lb) >= 0);
+                assert_se(lb == expected);
+                assert_se(memcmp(a, b, lb) == 0);
+        }
+
+        unlink(fn);
+        unlink(fn_copy);
+}
+
 int main(int argc, char *argv[]) {
         test_copy_file();
         test_copy_file_fd();
         test_copy_tree();
+        test_copy_tree_hardlinks();
         test_copy_bytes();
         test_copy_bytes_regular_file(argv[0], false, (uint64_t) -1);
         test_copy_bytes_regular_file(argv[0], true, (uint64_t) -1);
@@ -251,6 +357,7 @@ int main(int argc, char *argv[]) {
         test_copy_bytes_regular_file(argv[0], true, 1000);
         test_copy_bytes_regular_file(argv[0], false, 32000); /* larger than copy buffer size */
         test_copy_bytes_regular_file(argv[0], true, 32000);
+        test_copy_holes();
 
         return 0;
 }
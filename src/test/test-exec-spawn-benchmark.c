@@ -0,0 +1,136 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+***/
+
+#include <errno.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "env-util.h"
+#include "fileio.h"
+#include "manager.h"
+#include "parse-util.h"
+#include "rm-rf.h"
+#include "service.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "unit.h"
+
+/* This program measures how long exec_spawn() takes to fork off a trivial command and have it
+ * exit again, depending on how much memory the forking process has mapped. PID 1 on a large system
+ * carries a lot of state, and fork() has to copy the page tables for all of it.
+ *
+ * Usage: test-exec-spawn-benchmark [ITERATIONS]
+ *
+ * The results are logged, and written to stdout in the format of benchmark_report(). */
+
+static unsigned arg_iterations;
+
+static const size_t ballast_mb[] = { 0, 64, 256 };
+
+static void spawn_many(Unit *u, const char *label) {
+        Service *s = SERVICE(u);
+        ExecParameters p = {
+                .stdin_fd  = -1,
+                .stdout_fd = -1,
+                .stderr_fd = -1,
+        };
+        usec_t start;
+        unsigned i;
+
+        unit_set_exec_params(u, &p);
+
+        start = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < arg_iterations; i++) {
+                siginfo_t si = {};
+                pid_t pid;
+
+                assert_se(exec_spawn(u, s->exec_command[SERVICE_EXEC_START], &s->exec_context, &p,
+                                     s->exec_runtime, &s->dynamic_creds, &pid) >= 0);
+
+                assert_se(waitid(P_PID, pid, &si, WEXITED) >= 0);
+                assert_se(si.si_code == CLD_EXITED);
+                assert_se(si.si_status == EXIT_SUCCESS);
+        }
+
+        benchmark_report(label, arg_iterations, start);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        _cleanup_(manager_freep) Manager *m = NULL;
+        char t[] = "/tmp/exec-spawn-benchmark-XXXXXX";
+        const char *p;
+        unsigned k;
+        Unit *u;
+        int r;
+
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        if (argc >= 2)
+                assert_se(safe_atou(argv[1], &arg_iterations) >= 0);
+        else {
+                bool slow;
+
+                r = getenv_bool("SYSTEMD_SLOW_TESTS");
+                slow = r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT;
+
+                arg_iterations = slow ? 2000 : 100;
+        }
+        assert_se(arg_iterations > 0);
+
+        r = enter_cgroup_subroot();
+        if (r == -ENOMEDIUM) {
+                log_notice_errno(r, "Skipping test: cgroupfs not available");
+                return EXIT_TEST_SKIP;
+        }
+
+        assert_se(mkdtemp(t));
+
+        p = strjoina(t, "/bench.service");
+        assert_se(write_string_file(p,
+                                    "[Service]\nExecStart=/bin/true\n"
+                                    "StandardOutput=null\nStandardError=null\n",
+                                    WRITE_STRING_FILE_CREATE) >= 0);
+
+        assert_se(set_unit_path(t) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+
+        r = manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_BASIC, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                (void) rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL);
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        assert_se(manager_load_startable_unit_or_warn(m, "bench.service", NULL, &u) >= 0);
+
+        for (k = 0; k < ELEMENTSOF(ballast_mb); k++) {
+                _cleanup_free_ void *ballast = NULL;
+                char label[LINE_MAX];
+
+                /* Dirty the ballast, so that it is actually backed by pages the kernel has to take care of
+                 * when forking */
+                if (ballast_mb[k] > 0) {
+                        assert_se(ballast = malloc(ballast_mb[k] * 1024U * 1024U));
+                        memset(ballast, 0x55, ballast_mb[k] * 1024U * 1024U);
+                }
+
+                xsprintf(label, "spawn (+%zu MiB)", ballast_mb[k]);
+                spawn_many(u, label);
+        }
+
+        (void) rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        return 0;
+}
@@ -339,6 +339,41 @@ static void test_environment_gathering(void) {
         assert_se(endswith(strv_env_get(env, "PATH"), ":/no/such/file"));
 }
 
+static void test_execution_timing(void) {
+        char template[] = "/tmp/test-exec-util.XXXXXXX";
+        const char *dirs[] = {template, NULL};
+        const char *quick, *slow;
+        ExecTiming *timings = NULL;
+        size_t n_timings = 0;
+        usec_t start;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp(template));
+
+        quick = strjoina(template, "/quick");
+        slow = strjoina(template, "/slow");
+
+        assert_se(write_string_file(quick, "#!/bin/sh\ntrue", WRITE_STRING_FILE_CREATE) == 0);
+        assert_se(write_string_file(slow, "#!/bin/sh\nsleep 60", WRITE_STRING_FILE_CREATE) == 0);
+        assert_se(chmod(quick, 0755) == 0);
+        assert_se(chmod(slow, 0755) == 0);
+
+        /* The slow one is killed after its budget, and only the quick one reports a time */
+        start = now(CLOCK_MONOTONIC);
+        assert_se(execute_directories_full(dirs, DEFAULT_TIMEOUT_USEC, USEC_PER_SEC, NULL, NULL, NULL,
+                                           &timings, &n_timings) >= 0);
+        assert_se(now(CLOCK_MONOTONIC) - start < 30 * USEC_PER_SEC);
+
+        assert_se(n_timings == 1);
+        assert_se(streq(timings[0].path, quick));
+        assert_se(timings[0].usec < USEC_PER_SEC);
+
+        exec_timing_free_many(timings, n_timings);
+
+        (void) rm_rf(template, REMOVE_ROOT|REMOVE_PHYSICAL);
+}
+
 int main(int argc, char *argv[]) {
         log_set_max_level(LOG_DEBUG);
         log_parse_environment();
@@ -349,6 +384,7 @@ int main(int argc, char *argv[]) {
         test_execution_order();
         test_stdout_gathering();
         test_environment_gathering();
+        test_execution_timing();
 
         return 0;
 }
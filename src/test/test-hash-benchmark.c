@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+***/
+
+#include <stdio.h>
+
+#include "alloc-util.h"
+#include "hashmap.h"
+#include "log.h"
+#include "parse-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "time-util.h"
+#include "util.h"
+
+/* This program compares the cost of the hash functions hashmaps may use, by filling a map with pointer keys
+ * and looking all of them up again, once with SipHash and once with the fast hash for trusted keys.
+ *
+ * Usage: test-hash-benchmark [KEYS] [ROUNDS]
+ *
+ * The results are logged, and written to stdout in the format of benchmark_report(). */
+
+static unsigned arg_keys = 10000;
+static unsigned arg_rounds = 100;
+
+static void measure(const char *label, const struct hash_ops *ops, void **keys) {
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        usec_t start;
+        unsigned i, k;
+
+        assert_se(h = hashmap_new(ops));
+
+        start = now(CLOCK_MONOTONIC);
+        for (i = 0; i < arg_keys; i++)
+                assert_se(hashmap_put(h, keys[i], keys[i]) > 0);
+        benchmark_report(strjoina(label, " put"), arg_keys, start);
+
+        start = now(CLOCK_MONOTONIC);
+        for (k = 0; k < arg_rounds; k++)
+                for (i = 0; i < arg_keys; i++)
+                        assert_se(hashmap_get(h, keys[i]) == keys[i]);
+        benchmark_report(strjoina(label, " get"), (uint64_t) arg_keys * arg_rounds, start);
+}
+
+int main(int argc, char *argv[]) {
+        void **keys;
+        unsigned i;
+
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        if (argc >= 2)
+                assert_se(safe_atou(argv[1], &arg_keys) >= 0);
+        if (argc >= 3)
+                assert_se(safe_atou(argv[2], &arg_rounds) >= 0);
+        assert_se(arg_keys > 0);
+
+        /* Real heap pointers, like the Unit objects the dependency maps are keyed by */
+        assert_se(keys = new(void*, arg_keys));
+        for (i = 0; i < arg_keys; i++)
+                assert_se(keys[i] = malloc(64));
+
+        measure("siphash", &trivial_hash_ops, keys);
+        measure("fast", &trusted_trivial_hash_ops, keys);
+
+        for (i = 0; i < arg_keys; i++)
+                free(keys[i]);
+        free(keys);
+
+        return 0;
+}
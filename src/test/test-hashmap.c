@@ -5,6 +5,8 @@
   Copyright 2013 Daniel Buch
 ***/
 
+#include <pthread.h>
+
 #include "hashmap.h"
 #include "util.h"
 
@@ -152,6 +154,93 @@ static void test_path_hashmap(void) {
         assert_se(!hashmap_get(h, "/foo////bar////quux/////"));
 }
 
+static void test_trusted_trivial_hashmap(void) {
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        static uint64_t objects[1000];
+        unsigned i;
+
+        assert_se(h = hashmap_new(&trusted_trivial_hash_ops));
+
+        /* Aligned pointers next to each other, which differ in the middle bits only */
+        for (i = 0; i < ELEMENTSOF(objects); i++)
+                assert_se(hashmap_put(h, objects + i, UINT_TO_PTR(i + 1)) > 0);
+        assert_se(hashmap_put(h, objects, UINT_TO_PTR(1)) == 0);
+        assert_se(hashmap_size(h) == ELEMENTSOF(objects));
+
+        for (i = 0; i < ELEMENTSOF(objects); i++)
+                assert_se(hashmap_get(h, objects + i) == UINT_TO_PTR(i + 1));
+
+        for (i = 0; i < ELEMENTSOF(objects); i += 2)
+                assert_se(hashmap_remove(h, objects + i) == UINT_TO_PTR(i + 1));
+        for (i = 0; i < ELEMENTSOF(objects); i++)
+                assert_se(hashmap_get(h, objects + i) == (i % 2 ? UINT_TO_PTR(i + 1) : NULL));
+}
+
+#define N_THREAD_HASHMAPS 1000
+
+static void* hashmap_thread(void *p) {
+        Hashmap **handover = p;
+        unsigned i;
+
+        /* Free what the main thread allocated from its pools, and allocate some of our own */
+        for (i = 0; i < N_THREAD_HASHMAPS; i++) {
+                handover[i] = hashmap_free(handover[i]);
+                assert_se(handover[i] = hashmap_new(NULL));
+                assert_se(hashmap_put(handover[i], UINT_TO_PTR(i + 1), UINT_TO_PTR(i)) == 1);
+        }
+
+        return NULL;
+}
+
+static void* hashmap_free_thread(void *p) {
+        Hashmap **handover = p;
+        unsigned i;
+
+        /* Only free, like a consumer of maps built elsewhere does */
+        for (i = 0; i < N_THREAD_HASHMAPS; i++)
+                handover[i] = hashmap_free(handover[i]);
+
+        return NULL;
+}
+
+static void test_hashmap_threads(void) {
+        static Hashmap *handover[5][N_THREAD_HASHMAPS];
+        pthread_t t[ELEMENTSOF(handover)];
+        unsigned i, k;
+
+        for (k = 0; k < ELEMENTSOF(handover); k++)
+                for (i = 0; i < N_THREAD_HASHMAPS; i++) {
+                        assert_se(handover[k][i] = hashmap_new(NULL));
+                        assert_se(hashmap_put(handover[k][i], UINT_TO_PTR(i + 1), UINT_TO_PTR(i)) == 1);
+                }
+
+        /* Run all threads at the same time, the last one only frees */
+        for (k = 0; k < ELEMENTSOF(t); k++)
+                assert_se(pthread_create(&t[k], NULL,
+                                         k == ELEMENTSOF(t) - 1 ? hashmap_free_thread : hashmap_thread,
+                                         handover[k]) == 0);
+        for (k = 0; k < ELEMENTSOF(t); k++)
+                assert_se(pthread_join(t[k], NULL) == 0);
+
+        /* The exited threads handed their free tiles back, these must be usable without corrupting the
+         * maps still around */
+        for (i = 0; i < 2 * N_THREAD_HASHMAPS; i++) {
+                _cleanup_hashmap_free_ Hashmap *m = NULL;
+
+                assert_se(m = hashmap_new(NULL));
+                assert_se(hashmap_put(m, UINT_TO_PTR(1), UINT_TO_PTR(2)) == 1);
+        }
+
+        for (k = 0; k < ELEMENTSOF(handover) - 1; k++)
+                for (i = 0; i < N_THREAD_HASHMAPS; i++) {
+                        assert_se(hashmap_get(handover[k][i], UINT_TO_PTR(i + 1)) == UINT_TO_PTR(i));
+                        hashmap_free(handover[k][i]);
+                }
+
+        for (i = 0; i < N_THREAD_HASHMAPS; i++)
+                assert_se(!handover[ELEMENTSOF(handover) - 1][i]);
+}
+
 int main(int argc, const char *argv[]) {
         test_hashmap_funcs();
         test_ordered_hashmap_funcs();
@@ -163,6 +252,8 @@ int main(int argc, const char *argv[]) {
         test_string_compare_func();
         test_iterated_cache();
         test_path_hashmap();
+        test_trusted_trivial_hashmap();
+        test_hashmap_threads();
 
         return 0;
 }
@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+***/
+
+#include <stdio.h>
+
+#include "alloc-util.h"
+#include "hexdecoct.h"
+#include "log.h"
+#include "parse-util.h"
+#include "random-util.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "time-util.h"
+#include "util.h"
+
+/* This program measures the hex and base64 encoders and decoders on random binary data of typical journal
+ * field sizes, as used when exporting journal entries.
+ *
+ * Usage: test-hexdecoct-benchmark [ROUNDS]
+ *
+ * The results are logged per byte, and written to stdout in the format of benchmark_report(). */
+
+static unsigned arg_rounds = 10000;
+
+static const size_t sizes[] = { 16, 64, 256, 1024, 4096, 65536 };
+
+static void measure(size_t size) {
+        _cleanup_free_ char *hex = NULL, *b64 = NULL;
+        _cleanup_free_ void *data = NULL;
+        char label[STRLEN("unbase64mem ") + DECIMAL_STR_MAX(size_t)];
+        usec_t start;
+        unsigned k;
+
+        assert_se(data = malloc(size));
+        random_bytes(data, size);
+
+        start = now(CLOCK_MONOTONIC);
+        for (k = 0; k < arg_rounds; k++) {
+                hex = mfree(hex);
+                assert_se(hex = hexmem(data, size));
+        }
+        xsprintf(label, "hexmem %zu", size);
+        benchmark_report(label, (uint64_t) arg_rounds * size, start);
+
+        start = now(CLOCK_MONOTONIC);
+        for (k = 0; k < arg_rounds; k++) {
+                _cleanup_free_ void *p = NULL;
+                size_t l;
+
+                assert_se(unhexmem(hex, size * 2, &p, &l) >= 0);
+                assert_se(l == size);
+        }
+        xsprintf(label, "unhexmem %zu", size);
+        benchmark_report(label, (uint64_t) arg_rounds * size, start);
+
+        start = now(CLOCK_MONOTONIC);
+        for (k = 0; k < arg_rounds; k++) {
+                b64 = mfree(b64);
+                assert_se(base64mem(data, size, &b64) > 0);
+        }
+        xsprintf(label, "base64mem %zu", size);
+        benchmark_report(label, (uint64_t) arg_rounds * size, start);
+
+        start = now(CLOCK_MONOTONIC);
+        for (k = 0; k < arg_rounds; k++) {
+                _cleanup_free_ void *p = NULL;
+                size_t l;
+
+                assert_se(unbase64mem(b64, (size_t) -1, &p, &l) >= 0);
+                assert_se(l == size);
+        }
+        xsprintf(label, "unbase64mem %zu", size);
+        benchmark_report(label, (uint64_t) arg_rounds * size, start);
+}
+
+int main(int argc, char *argv[]) {
+        size_t i;
+
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        if (argc >= 2)
+                assert_se(safe_atou(argv[1], &arg_rounds) >= 0);
+        assert_se(arg_rounds > 0);
+
+        for (i = 0; i < ELEMENTSOF(sizes); i++)
+                measure(sizes[i]);
+
+        return 0;
+}
@@ -110,6 +110,33 @@ static void test_unhexmem(void) {
         test_unhexmem_one(hex, (size_t) -1, 0);
         test_unhexmem_one(hex_space, strlen(hex_space), 0);
         test_unhexmem_one(hex_space, (size_t) -1, 0);
+
+        /* Whitespace, invalid characters and the end in the middle and right after runs of digits */
+        test_unhexmem_one("0011223344556677 8899aabbccddeeff", (size_t) -1, 0);
+        test_unhexmem_one("0011223344556677\n8899aabbccddeef", (size_t) -1, -EPIPE);
+        test_unhexmem_one("00112233445566778 899aabbccddeeff", (size_t) -1, 0);
+        test_unhexmem_one("0011223344556677x899aabbccddeeff", (size_t) -1, -EINVAL);
+        test_unhexmem_one("0011223344556677889x", (size_t) -1, -EINVAL);
+}
+
+static void test_hexmem_roundtrip(void) {
+        uint8_t data[256];
+        size_t i;
+
+        for (i = 0; i < ELEMENTSOF(data); i++)
+                data[i] = i;
+
+        for (i = 0; i <= ELEMENTSOF(data); i++) {
+                _cleanup_free_ char *hex = NULL;
+                _cleanup_free_ void *mem = NULL;
+                size_t len;
+
+                assert_se(hex = hexmem(data + ELEMENTSOF(data) - i, i));
+                assert_se(strlen(hex) == i * 2);
+                assert_se(unhexmem(hex, (size_t) -1, &mem, &len) >= 0);
+                assert_se(len == i);
+                assert_se(memcmp(mem, data + ELEMENTSOF(data) - i, i) == 0);
+        }
 }
 
 /* https://tools.ietf.org/html/rfc4648#section-10 */
@@ -318,6 +345,34 @@ static void test_unbase64mem(void) {
         test_unbase64mem_one("AAB==", NULL, -EINVAL);
         test_unbase64mem_one(" A A A B = ", NULL, -EINVAL);
         test_unbase64mem_one(" Z m 8 = q u u x ", NULL, -ENAMETOOLONG);
+
+        /* Whitespace, padding and invalid characters right after runs of complete groups */
+        test_unbase64mem_one("Zm9vYmFyZm9vYmFy Zm9vYmFy", "foobarfoobarfoobar", 0);
+        test_unbase64mem_one("Zm9vYmFyZm9v\nYmFyYg==", "foobarfoobarb", 0);
+        test_unbase64mem_one("Zm9vYmFyZm9vYm Fy", "foobarfoobar", 0);
+        test_unbase64mem_one("Zm9vYmFyZm9vYmE=", "foobarfooba", 0);
+        test_unbase64mem_one("Zm9vYmFyZm9vYmE=Zm9v", NULL, -ENAMETOOLONG);
+        test_unbase64mem_one("Zm9vYmFyZm9vY*Fy", NULL, -EINVAL);
+        test_unbase64mem_one("Zm9vYmFyZm9vYmF", NULL, -EPIPE);
+}
+
+static void test_base64mem_roundtrip(void) {
+        uint8_t data[256];
+        size_t i;
+
+        for (i = 0; i < ELEMENTSOF(data); i++)
+                data[i] = i;
+
+        for (i = 0; i <= ELEMENTSOF(data); i++) {
+                _cleanup_free_ char *b64 = NULL;
+                _cleanup_free_ void *mem = NULL;
+                size_t len;
+
+                assert_se(base64mem(data + ELEMENTSOF(data) - i, i, &b64) == (ssize_t) DIV_ROUND_UP(i, 3) * 4);
+                assert_se(unbase64mem(b64, (size_t) -1, &mem, &len) >= 0);
+                assert_se(len == i);
+                assert_se(memcmp(mem, data + ELEMENTSOF(data) - i, i) == 0);
+        }
 }
 
 static void test_hexdump(void) {
@@ -351,10 +406,12 @@ int main(int argc, char *argv[]) {
         test_decchar();
         test_undecchar();
         test_unhexmem();
+        test_hexmem_roundtrip();
         test_base32hexmem();
         test_unbase32hexmem();
         test_base64mem();
         test_unbase64mem();
+        test_base64mem_roundtrip();
         test_hexdump();
 
         return 0;
@@ -988,6 +988,30 @@ static void test_with_dropin_template(const char *root) {
         assert_se(unit_file_get_state(UNIT_FILE_SYSTEM, root, "with-dropin-3@instance-2.service", &state) >= 0 && state == UNIT_FILE_ENABLED);
 }
 
+static void test_list_matches_state(const char *root) {
+        UnitFileList *fl;
+        UnitFileState state;
+        Hashmap *h;
+        Iterator j;
+        unsigned n = 0;
+
+        /* By now the root contains units in all kinds of states, make sure listing them all in one go, which
+         * reads the symlinks only once, agrees with looking at each unit individually */
+        assert_se(h = hashmap_new(&string_hash_ops));
+        assert_se(unit_file_get_list(UNIT_FILE_SYSTEM, root, h, NULL, NULL) >= 0);
+
+        HASHMAP_FOREACH(fl, h, j) {
+                if (unit_file_get_state(UNIT_FILE_SYSTEM, root, basename(fl->path), &state) < 0)
+                        state = UNIT_FILE_BAD;
+                assert_se(fl->state == state);
+                n++;
+        }
+
+        assert_se(n > 0);
+
+        unit_file_list_free(h);
+}
+
 int main(int argc, char *argv[]) {
         char root[] = "/tmp/rootXXXXXX";
         const char *p;
@@ -1021,6 +1045,7 @@ int main(int argc, char *argv[]) {
         test_static_instance(root);
         test_with_dropin(root);
         test_with_dropin_template(root);
+        test_list_matches_state(root);
 
         assert_se(rm_rf(root, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
 
@@ -0,0 +1,107 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+***/
+
+#include <poll.h>
+#include <unistd.h>
+
+#include "libudev.h"
+
+#include "libudev-private.h"
+#include "log.h"
+#include "string-util.h"
+#include "udev-util.h"
+#include "util.h"
+
+/* Sends the device from one monitor to another one with the filter installed, using unicast so that no
+ * privileges beyond being root (for the credentials check) are needed. Returns whether the device made
+ * it through the socket filter (> 0 if it also passed the filter in userspace). */
+static int send_device(struct udev *udev, struct udev_device *device, struct udev_monitor *receiver) {
+        _cleanup_(udev_monitor_unrefp) struct udev_monitor *sender = NULL;
+        _cleanup_(udev_device_unrefp) struct udev_device *d = NULL;
+        struct pollfd pfd = {
+                .events = POLLIN,
+        };
+
+        assert_se(sender = udev_monitor_new_from_netlink(udev, NULL));
+        assert_se(udev_monitor_enable_receiving(sender) >= 0);
+        assert_se(udev_monitor_enable_receiving(receiver) >= 0);
+        assert_se(udev_monitor_allow_unicast_sender(receiver, sender) >= 0);
+
+        assert_se(udev_monitor_send_device(sender, receiver, device) > 0);
+
+        pfd.fd = udev_monitor_get_fd(receiver);
+        assert_se(poll(&pfd, 1, 100) >= 0);
+        if (!(pfd.revents & POLLIN))
+                return -1;
+
+        d = udev_monitor_receive_device(receiver);
+        if (!d)
+                return 0;
+
+        assert_se(streq(udev_device_get_syspath(d), udev_device_get_syspath(device)));
+        return 1;
+}
+
+static void test_filter(struct udev *udev, struct udev_device *device,
+                        const char *sysname, const char *property, const char *value,
+                        int expected) {
+        _cleanup_(udev_monitor_unrefp) struct udev_monitor *receiver = NULL;
+
+        assert_se(receiver = udev_monitor_new_from_netlink(udev, NULL));
+        if (sysname)
+                assert_se(udev_monitor_filter_add_match_sysname(receiver, sysname) >= 0);
+        if (property)
+                assert_se(udev_monitor_filter_add_match_property(receiver, property, value) >= 0);
+
+        log_info("sysname=%s %s=%s: expecting %i", strnull(sysname), strnull(property), strnull(value), expected);
+        assert_se(send_device(udev, device, receiver) == expected);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(udev_device_unrefp) struct udev_device *device = NULL;
+        _cleanup_(udev_unrefp) struct udev *udev = NULL;
+
+        log_set_max_level(LOG_DEBUG);
+        log_parse_environment();
+        log_open();
+
+        if (getuid() != 0) {
+                log_info("Not root, skipping.");
+                return EXIT_TEST_SKIP;
+        }
+
+        assert_se(udev = udev_new());
+
+        /* Receivers want the properties udevd adds to events */
+        device = udev_device_new_from_synthetic_event(udev, "/sys/devices/virtual/mem/null", "change");
+        if (!device) {
+                log_info_errno(errno, "Failed to open /dev/null device, skipping: %m");
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(udev_device_add_property(device, "SEQNUM", "1") >= 0);
+
+        test_filter(udev, device, NULL, NULL, NULL, 1);
+
+        /* sysname matches with a literal prefix are checked in the kernel */
+        test_filter(udev, device, "null", NULL, NULL, 1);
+        test_filter(udev, device, "nu*", NULL, NULL, 1);
+        test_filter(udev, device, "zero", NULL, NULL, -1);
+        test_filter(udev, device, "nulll", NULL, NULL, -1);
+
+        /* the rest of the glob only in userspace */
+        test_filter(udev, device, "nul[abc]", NULL, NULL, 0);
+        test_filter(udev, device, "*ull", NULL, NULL, 1);
+        test_filter(udev, device, "*ero", NULL, NULL, 0);
+
+        /* and so are property matches */
+        test_filter(udev, device, NULL, "SUBSYSTEM", "mem", 1);
+        test_filter(udev, device, NULL, "SUBSYSTEM", "block", -1);
+        test_filter(udev, device, NULL, "SUBSYSTEMX", "mem", -1);
+        test_filter(udev, device, "null", "SUBSYSTEM", "mem", 1);
+        test_filter(udev, device, "null", "SUBSYSTEM", "block", -1);
+        test_filter(udev, device, "zero", "SUBSYSTEM", "mem", -1);
+
+        return 0;
+}
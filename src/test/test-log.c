@@ -72,5 +72,20 @@ int main(int argc, char* argv[]) {
                 test_long_lines();
         }
 
+        /* Same again, but queue entries up for the journal */
+        log_set_buffered(true);
+
+        for (target = 0; target <  _LOG_TARGET_MAX; target++) {
+                log_set_target(target);
+                log_open();
+
+                test_log_console();
+                test_log_journal();
+                test_long_lines();
+                (void) log_flush();
+        }
+
+        log_set_buffered(false);
+
         return 0;
 }
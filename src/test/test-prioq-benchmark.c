@@ -0,0 +1,116 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+***/
+
+#include <stdlib.h>
+
+#include "alloc-util.h"
+#include "log.h"
+#include "parse-util.h"
+#include "prioq.h"
+#include "string-util.h"
+#include "tests.h"
+#include "time-util.h"
+#include "util.h"
+
+/* This program compares the cost of keeping timer-like objects in a prioq ordered by a comparison function
+ * looking at the objects, with keeping the same timestamps as the prioq's inline keys. Each round moves every
+ * item to a new time, the way timer event sources are rescheduled, and finally everything is popped.
+ *
+ * Usage: test-prioq-benchmark [ITEMS] [ROUNDS]
+ *
+ * The results are logged, and written to stdout in the format of benchmark_report(). */
+
+static unsigned arg_items = 10000;
+static unsigned arg_rounds = 20;
+
+typedef struct Item {
+        usec_t until;
+        unsigned idx;
+        char payload[48]; /* Make the objects as large as real ones, so that dereferencing them costs something */
+} Item;
+
+static int item_compare(const void *a, const void *b) {
+        const Item *x = a, *y = b;
+
+        if (x->until < y->until)
+                return -1;
+        if (x->until > y->until)
+                return 1;
+        return 0;
+}
+
+static void measure(const char *label, bool keyed, Item **items) {
+        Prioq *q;
+        usec_t start, previous = 0;
+        unsigned i, k;
+
+        srand(0);
+
+        assert_se(q = prioq_new(keyed ? NULL : item_compare));
+
+        start = now(CLOCK_MONOTONIC);
+        for (i = 0; i < arg_items; i++) {
+                items[i]->until = (usec_t) rand();
+
+                if (keyed)
+                        assert_se(prioq_put_key(q, items[i], items[i]->until, &items[i]->idx) >= 0);
+                else
+                        assert_se(prioq_put(q, items[i], &items[i]->idx) >= 0);
+        }
+        benchmark_report(strjoina(label, " put"), arg_items, start);
+
+        start = now(CLOCK_MONOTONIC);
+        for (k = 0; k < arg_rounds; k++)
+                for (i = 0; i < arg_items; i++) {
+                        items[i]->until = (usec_t) rand();
+
+                        if (keyed)
+                                assert_se(prioq_set_key(q, items[i], items[i]->until, &items[i]->idx) > 0);
+                        else
+                                assert_se(prioq_reshuffle(q, items[i], &items[i]->idx) > 0);
+                }
+        benchmark_report(strjoina(label, " move"), (uint64_t) arg_items * arg_rounds, start);
+
+        start = now(CLOCK_MONOTONIC);
+        for (i = 0; i < arg_items; i++) {
+                Item *t;
+
+                assert_se(t = prioq_pop(q));
+                assert_se(t->until >= previous);
+                previous = t->until;
+        }
+        benchmark_report(strjoina(label, " pop"), arg_items, start);
+
+        prioq_free(q);
+}
+
+int main(int argc, char *argv[]) {
+        Item **items;
+        unsigned i;
+
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        if (argc >= 2)
+                assert_se(safe_atou(argv[1], &arg_items) >= 0);
+        if (argc >= 3)
+                assert_se(safe_atou(argv[2], &arg_rounds) >= 0);
+        assert_se(arg_items > 0);
+
+        /* Allocate the items one by one, like the event sources or cache entries a prioq is used for */
+        assert_se(items = new(Item*, arg_items));
+        for (i = 0; i < arg_items; i++)
+                assert_se(items[i] = new0(Item, 1));
+
+        measure("comparator", false, items);
+        measure("keyed", true, items);
+
+        for (i = 0; i < arg_items; i++)
+                free(items[i]);
+        free(items);
+
+        return 0;
+}
@@ -150,10 +150,102 @@ static void test_struct(void) {
         set_free(s);
 }
 
+static void test_keys(void) {
+        struct test *items, *t;
+        uint64_t *keys, previous_key = 0;
+        unsigned previous = 0, i;
+        Prioq *q;
+
+        srand(0);
+
+        /* Keys are compared first, the comparison function only orders items with equal keys. Use few
+         * distinct keys, so that there are plenty of those. */
+        q = prioq_new(test_compare);
+        assert_se(q);
+
+        assert_se(items = new0(struct test, SET_SIZE));
+        assert_se(keys = new(uint64_t, SET_SIZE));
+
+        for (i = 0; i < SET_SIZE; i++) {
+                items[i].value = (unsigned) rand();
+                keys[i] = (uint64_t) rand() % 64;
+                assert_se(prioq_put_key(q, items + i, keys[i], &items[i].idx) >= 0);
+        }
+
+        /* Move every other item, some towards the top, some away from it */
+        for (i = 0; i < SET_SIZE; i += 2) {
+                keys[i] = (uint64_t) rand() % 64;
+                assert_se(prioq_set_key(q, items + i, keys[i], &items[i].idx) > 0);
+        }
+
+        /* Without an index the item is looked for */
+        keys[1] = 0;
+        assert_se(prioq_set_key(q, items + 1, keys[1], NULL) > 0);
+        assert_se(prioq_set_key(q, &previous, 0, NULL) == 0);
+
+        for (i = 0; i < SET_SIZE; i++) {
+                uint64_t key;
+
+                assert_se(prioq_size(q) == SET_SIZE - i);
+
+                t = prioq_pop(q);
+                assert_se(t);
+                key = keys[t - items];
+
+                assert_se(previous_key < key || (previous_key == key && previous <= t->value));
+                previous_key = key;
+                previous = t->value;
+        }
+
+        assert_se(prioq_isempty(q));
+        prioq_free(q);
+
+        /* Setting the first key later on switches a queue over to keys, the items must stay in order */
+        q = prioq_new(test_compare);
+        assert_se(q);
+
+        for (i = 0; i < SET_SIZE; i++)
+                items[i].value = i;
+
+        for (i = 0; i < SET_SIZE - 1; i++)
+                assert_se(prioq_put(q, items + i, &items[i].idx) >= 0);
+
+        assert_se(prioq_set_key(q, items, 1, NULL) > 0);
+        assert_se(prioq_put_key(q, items + SET_SIZE - 1, 0, &items[SET_SIZE - 1].idx) >= 0);
+
+        for (i = 1; i < SET_SIZE; i++)
+                assert_se(prioq_pop(q) == items + i);
+        assert_se(prioq_pop(q) == items);
+
+        assert_se(prioq_isempty(q));
+        prioq_free(q);
+
+        /* Keys alone are enough, too */
+        q = prioq_new(NULL);
+        assert_se(q);
+
+        for (i = 0; i < SET_SIZE; i++)
+                assert_se(prioq_put_key(q, items + i, SET_SIZE - i, &items[i].idx) >= 0);
+
+        assert_se(prioq_set_key(q, items + SET_SIZE / 2, 0, &items[SET_SIZE / 2].idx) > 0);
+        assert_se(prioq_pop(q) == items + SET_SIZE / 2);
+
+        for (i = SET_SIZE; i > 0; i--)
+                if (i - 1 != SET_SIZE / 2)
+                        assert_se(prioq_pop(q) == items + i - 1);
+
+        assert_se(prioq_isempty(q));
+        prioq_free(q);
+
+        free(items);
+        free(keys);
+}
+
 int main(int argc, char* argv[]) {
 
         test_unsigned();
         test_struct();
+        test_keys();
 
         return 0;
 }
@@ -42,6 +42,7 @@ static void test_get_process_comm(pid_t pid) {
         uid_t u;
         gid_t g;
         dev_t h;
+        uint64_t t, t2;
         int r;
 
         xsprintf(path, "/proc/"PID_FMT"/comm", pid);
@@ -66,6 +67,11 @@ static void test_get_process_comm(pid_t pid) {
         log_info("PID"PID_FMT" PPID: "PID_FMT, pid, e);
         assert_se(pid == 1 ? e == 0 : e > 0);
 
+        assert_se(get_process_start_time(pid, &t) >= 0);
+        log_info("PID"PID_FMT" start time: %"PRIu64, pid, t);
+        assert_se(get_process_start_time(pid, &t2) >= 0);
+        assert_se(t == t2);
+
         assert_se(is_kernel_thread(pid) == 0 || pid != 1);
 
         r = get_process_exe(pid, &f);
@@ -0,0 +1,92 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+***/
+
+#include <errno.h>
+#include <stdio.h>
+
+#include "alloc-util.h"
+#include "state-stream.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "util.h"
+
+static void append(StateStreamHeader *h, unsigned i) {
+        StateStreamRecord record = {
+                .type = STATE_STREAM_UNIT,
+                .realtime = i,
+        };
+
+        xsprintf(record.unit, "test-%u.service", i);
+        state_stream_append(h, &record);
+}
+
+static void test_state_stream(void) {
+        _cleanup_free_ StateStreamHeader *h = NULL;
+        StateStreamRecord record;
+        uint64_t i;
+
+        assert_se(h = malloc0(STATE_STREAM_SIZE));
+        state_stream_init(h);
+
+        assert_se(memcmp(h->signature, STATE_STREAM_SIGNATURE, sizeof(h->signature)) == 0);
+        assert_se(h->seqnum == 0);
+        assert_se(state_stream_read(h, 0, &record) == -EINVAL);
+        assert_se(state_stream_read(h, 1, &record) == 0);
+
+        append(h, 1);
+        assert_se(h->seqnum == 1);
+        assert_se(state_stream_read(h, 1, &record) > 0);
+        assert_se(record.seqnum == 1);
+        assert_se(record.type == STATE_STREAM_UNIT);
+        assert_se(record.realtime == 1);
+        assert_se(streq(record.unit, "test-1.service"));
+        assert_se(state_stream_read(h, 2, &record) == 0);
+
+        /* Wrap around, and make sure the records that got overwritten are refused */
+        for (i = 2; i <= STATE_STREAM_RECORDS_MAX + 10; i++)
+                append(h, i);
+
+        assert_se(h->seqnum == STATE_STREAM_RECORDS_MAX + 10);
+        for (i = 1; i <= 10; i++)
+                assert_se(state_stream_read(h, i, &record) == -ESTALE);
+
+        for (i = 11; i <= h->seqnum; i++) {
+                char name[STRLEN("test-.service") + DECIMAL_STR_MAX(uint64_t)];
+
+                assert_se(state_stream_read(h, i, &record) > 0);
+                assert_se(record.seqnum == i);
+                assert_se(record.realtime == i);
+
+                xsprintf(name, "test-%" PRIu64 ".service", i);
+                assert_se(streq(record.unit, name));
+        }
+
+        assert_se(state_stream_read(h, h->seqnum + 1, &record) == 0);
+}
+
+static void test_state_stream_bogus_header(void) {
+        _cleanup_free_ StateStreamHeader *h = NULL;
+        StateStreamRecord record;
+
+        assert_se(h = malloc0(STATE_STREAM_SIZE));
+        state_stream_init(h);
+
+        /* The layout fields of the header are informational only, and are never used to find a record */
+        h->header_size = (uint64_t) -1;
+        h->record_size = 0;
+        h->n_records = 0;
+
+        append(h, 1);
+        assert_se(state_stream_read(h, 1, &record) > 0);
+        assert_se(streq(record.unit, "test-1.service"));
+        assert_se(streq(((StateStreamRecord*) (h + 1))[1].unit, "test-1.service"));
+}
+
+int main(int argc, char *argv[]) {
+        test_state_stream();
+        test_state_stream_bogus_header();
+
+        return 0;
+}
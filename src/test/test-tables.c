@@ -74,6 +74,7 @@ int main(int argc, char **argv) {
         test_table(mac_policy, MACPOLICY);
         test_table(manager_state, MANAGER_STATE);
         test_table(manager_timestamp, MANAGER_TIMESTAMP);
+        test_table(manager_trace_phase, MANAGER_TRACE_PHASE);
         test_table(mount_exec_command, MOUNT_EXEC_COMMAND);
         test_table(mount_result, MOUNT_RESULT);
         test_table(mount_state, MOUNT_STATE);
@@ -0,0 +1,241 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+***/
+
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "bus-error.h"
+#include "env-util.h"
+#include "fd-util.h"
+#include "fdset.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "manager.h"
+#include "mkdir.h"
+#include "parse-util.h"
+#include "rm-rf.h"
+#include "set.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "unit.h"
+
+/* This program generates a large synthetic unit graph and measures how long loading it, the transactions
+ * and dependency walks on it, serializing and reloading it, and garbage collecting it take.
+ *
+ * Usage: test-unit-graph-benchmark [UNITS [WANTS]]
+ *
+ * WANTS is the number of additional requirements each unit pulls in from across the graph, 1 by default.
+ * The results are logged, and also written to stdout in the format of benchmark_report(), so that they can
+ * be compared between versions by scripts. */
+
+static unsigned arg_units;
+static unsigned arg_wants = 1;
+
+static void generate(const char *directory) {
+        const char *wants;
+        unsigned i;
+
+        wants = strjoina(directory, "/bench.target.wants");
+        assert_se(mkdir_p(wants, 0755) >= 0);
+
+        assert_se(write_string_file(strjoina(directory, "/bench.target"),
+                                    "[Unit]\nDescription=Benchmark\nAllowIsolate=yes\n",
+                                    WRITE_STRING_FILE_CREATE) >= 0);
+
+        for (i = 0; i < arg_units; i++) {
+                char name[STRLEN("bench-.service") + DECIMAL_STR_MAX(unsigned)];
+                _cleanup_free_ char *contents = NULL, *wants_line = NULL;
+                const char *p, *l;
+                unsigned k;
+
+                xsprintf(name, "bench-%u.service", i);
+                p = strjoina(directory, "/", name);
+
+                /* A tree of ordering dependencies, so that the transaction has no cycles to break, plus a
+                 * couple of unordered requirements across the graph, like a real system has. */
+                if (i == 0)
+                        assert_se(asprintf(&contents,
+                                           "[Unit]\nDescription=Benchmark %u\n"
+                                           "[Service]\nExecStart=/bin/true\n", i) >= 0);
+                else {
+                        assert_se(asprintf(&wants_line, "Wants=bench-%u.service", (i - 1) / 2) >= 0);
+
+                        for (k = 0; k < arg_wants; k++) {
+                                char other[STRLEN(" bench-.service") + DECIMAL_STR_MAX(unsigned)];
+
+                                xsprintf(other, " bench-%u.service",
+                                         (unsigned) (((uint64_t) i * 7919 + (uint64_t) k * 104729) % arg_units));
+                                assert_se(strextend(&wants_line, other, NULL));
+                        }
+
+                        assert_se(asprintf(&contents,
+                                           "[Unit]\nDescription=Benchmark %u\n"
+                                           "%s\n"
+                                           "After=bench-%u.service\n"
+                                           "Conflicts=bench-missing-%u.service\n"
+                                           "[Service]\nExecStart=/bin/true\n",
+                                           i, wants_line, (i - 1) / 2, i % 16) >= 0);
+                }
+
+                assert_se(write_string_file(p, contents, WRITE_STRING_FILE_CREATE) >= 0);
+
+                l = strjoina(wants, "/", name);
+                assert_se(symlink(p, l) >= 0);
+        }
+}
+
+static uint64_t walk(Unit *u, Set *seen) {
+        static const UnitDependency deps[] = {
+                UNIT_REQUIRES,
+                UNIT_WANTS,
+                UNIT_BINDS_TO,
+                UNIT_AFTER,
+                UNIT_BEFORE,
+        };
+        uint64_t n = 0;
+        unsigned d;
+
+        /* Visits everything reachable via the dependencies transactions look at, and counts the edges */
+
+        for (d = 0; d < ELEMENTSOF(deps); d++) {
+                Iterator i;
+                Unit *other;
+                void *v;
+
+                HASHMAP_FOREACH_KEY(v, other, u->dependencies[deps[d]], i) {
+                        n++;
+
+                        if (set_put(seen, other) <= 0)
+                                continue;
+
+                        n += walk(other, seen);
+                }
+        }
+
+        return n;
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error err = SD_BUS_ERROR_NULL;
+        _cleanup_(manager_freep) Manager *m = NULL;
+        _cleanup_set_free_ Set *seen = NULL;
+        _cleanup_fdset_free_ FDSet *fds = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        char t[] = "/tmp/unit-graph-benchmark-XXXXXX";
+        unsigned n_units;
+        usec_t start;
+        Iterator i;
+        Unit *target, *u;
+        uint64_t n;
+        Job *j;
+        int r;
+
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        if (argc >= 2)
+                assert_se(safe_atou(argv[1], &arg_units) >= 0);
+        else {
+                bool slow;
+
+                r = getenv_bool("SYSTEMD_SLOW_TESTS");
+                slow = r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT;
+
+                arg_units = slow ? 20000 : 1000;
+        }
+        assert_se(arg_units > 0);
+
+        if (argc >= 3)
+                assert_se(safe_atou(argv[2], &arg_wants) >= 0);
+
+        r = enter_cgroup_subroot();
+        if (r == -ENOMEDIUM) {
+                log_notice_errno(r, "Skipping test: cgroupfs not available");
+                return EXIT_TEST_SKIP;
+        }
+
+        assert_se(mkdtemp(t));
+
+        start = now(CLOCK_MONOTONIC);
+        generate(t);
+        benchmark_report("generate", arg_units, start);
+
+        assert_se(set_unit_path(t) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+
+        r = manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_BASIC, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                (void) rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL);
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        start = now(CLOCK_MONOTONIC);
+        assert_se(manager_load_startable_unit_or_warn(m, "bench.target", NULL, &target) >= 0);
+        benchmark_report("load", hashmap_size(m->units), start);
+
+        assert_se(seen = set_new(NULL));
+
+        start = now(CLOCK_MONOTONIC);
+        n = walk(target, seen);
+        benchmark_report("dependency-walk", n, start);
+
+        start = now(CLOCK_MONOTONIC);
+        assert_se(manager_add_job(m, JOB_START, target, JOB_REPLACE, &err, &j) == 0);
+        benchmark_report("start-transaction", hashmap_size(m->jobs), start);
+
+        manager_clear_jobs(m);
+
+        start = now(CLOCK_MONOTONIC);
+        assert_se(manager_add_job(m, JOB_RESTART, target, JOB_REPLACE, &err, &j) == 0);
+        benchmark_report("restart-transaction", hashmap_size(m->jobs), start);
+
+        manager_clear_jobs(m);
+
+        start = now(CLOCK_MONOTONIC);
+        assert_se(manager_add_job(m, JOB_START, target, JOB_ISOLATE, &err, &j) == 0);
+        benchmark_report("isolate-transaction", hashmap_size(m->jobs), start);
+
+        manager_clear_jobs(m);
+
+        assert_se(manager_open_serialization(m, &f) >= 0);
+        assert_se(fds = fdset_new());
+
+        start = now(CLOCK_MONOTONIC);
+        assert_se(manager_serialize(m, f, fds, false) >= 0);
+        benchmark_report("serialize", hashmap_size(m->units), start);
+
+        /* Make sure the units are really reloaded, even though none of them changed */
+        n_units = hashmap_size(m->units);
+        m->unit_files_fingerprint_valid = false;
+
+        start = now(CLOCK_MONOTONIC);
+        assert_se(manager_reload(m) >= 0);
+        benchmark_report("reload", n_units, start);
+
+        /* Nothing references the units anymore now that there are no jobs, hence all of them can go */
+        n_units = hashmap_size(m->units);
+
+        start = now(CLOCK_MONOTONIC);
+        HASHMAP_FOREACH(u, m->units, i)
+                unit_add_to_gc_queue(u);
+        while (m->gc_unit_queue) {
+                (void) manager_dispatch_gc_unit_queue(m);
+                (void) manager_dispatch_cleanup_queue(m);
+        }
+        benchmark_report("gc", n_units - hashmap_size(m->units), start);
+
+        (void) rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        return 0;
+}
@@ -0,0 +1,100 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+***/
+
+#include <stdio.h>
+
+#include "alloc-util.h"
+#include "log.h"
+#include "parse-util.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "time-util.h"
+#include "utf8.h"
+#include "util.h"
+
+/* This program measures the UTF-8 validation and escaping functions on strings of typical log line
+ * lengths, once with plain ASCII and once with some multi-byte characters mixed in.
+ *
+ * Usage: test-utf8-benchmark [ROUNDS]
+ *
+ * The results are logged per byte, and written to stdout in the format of benchmark_report(). */
+
+static unsigned arg_rounds = 100000;
+
+static const size_t sizes[] = { 16, 64, 128, 256, 1024, 4096 };
+
+static char *make_line(size_t size, bool mixed) {
+        static const char ascii[] = "Started Session 42 of user lennart. ";
+        char *s, *p;
+
+        assert_se(s = new(char, size + 1));
+
+        for (p = s; p < s + size; p++)
+                *p = ascii[(p - s) % (sizeof(ascii) - 1)];
+
+        /* Replace every 32nd character by a two byte sequence, keeping the length and the first byte */
+        if (mixed)
+                for (p = s + 8; p + 1 < s + size; p += 32)
+                        memcpy(p, "\303\244", 2);
+
+        s[size] = 0;
+        return s;
+}
+
+static void measure(size_t size, bool mixed) {
+        _cleanup_free_ char *s = NULL;
+        char label[STRLEN("escape_non_printable ") + DECIMAL_STR_MAX(size_t) + STRLEN(" mixed")];
+        usec_t start;
+        unsigned k;
+
+        s = make_line(size, mixed);
+
+        /* The functions are pure, hence touch the string in every round, so that the calls are not
+         * hoisted out of the loops */
+        start = now(CLOCK_MONOTONIC);
+        for (k = 0; k < arg_rounds; k++) {
+                s[0] = 'a' + k % 26;
+                assert_se(utf8_is_valid(s));
+        }
+        xsprintf(label, "is_valid %zu %s", size, mixed ? "mixed" : "ascii");
+        benchmark_report(label, (uint64_t) arg_rounds * size, start);
+
+        start = now(CLOCK_MONOTONIC);
+        for (k = 0; k < arg_rounds; k++) {
+                s[0] = 'a' + k % 26;
+                assert_se(utf8_is_printable(s, size));
+        }
+        xsprintf(label, "is_printable %zu %s", size, mixed ? "mixed" : "ascii");
+        benchmark_report(label, (uint64_t) arg_rounds * size, start);
+
+        start = now(CLOCK_MONOTONIC);
+        for (k = 0; k < arg_rounds; k++) {
+                _cleanup_free_ char *e = NULL;
+
+                assert_se(e = utf8_escape_non_printable(s));
+        }
+        xsprintf(label, "escape_non_printable %zu %s", size, mixed ? "mixed" : "ascii");
+        benchmark_report(label, (uint64_t) arg_rounds * size, start);
+}
+
+int main(int argc, char *argv[]) {
+        size_t i;
+
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        if (argc >= 2)
+                assert_se(safe_atou(argv[1], &arg_rounds) >= 0);
+        assert_se(arg_rounds > 0);
+
+        for (i = 0; i < ELEMENTSOF(sizes); i++) {
+                measure(sizes[i], false);
+                measure(sizes[i], true);
+        }
+
+        return 0;
+}
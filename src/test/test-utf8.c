@@ -81,6 +81,42 @@ static void test_utf8_escaping_printable(void) {
         assert_se(utf8_is_valid(p6));
 }
 
+static void test_utf8_word_boundaries(void) {
+        const char *inserts[] = { "\342\204\242", "\t", "\n", "\001", "\177", "\341\204" };
+        char buf[64], *p;
+        size_t i, j;
+
+        /* The ASCII fast paths process eight bytes at a time, hence put the interesting bits at every
+         * position relative to the word boundaries */
+        for (i = 0; i < ELEMENTSOF(inserts); i++)
+                for (j = 0; j <= 24; j++) {
+                        _cleanup_free_ char *e = NULL;
+                        bool valid, printable;
+                        size_t l;
+
+                        memset(buf, 'x', j);
+                        p = stpcpy(buf + j, inserts[i]);
+                        strcpy(p, "0123456789abcdef");
+                        l = strlen(buf);
+
+                        valid = i != 5;
+                        printable = i < 3;
+
+                        assert_se(!!utf8_is_valid(buf) == valid);
+                        assert_se(utf8_is_printable(buf, l) == printable);
+                        assert_se(utf8_is_printable_newline(buf, l, false) == (printable && i != 2));
+
+                        assert_se(e = utf8_escape_non_printable(buf));
+                        assert_se(utf8_is_valid(e));
+                        assert_se(streq(e, buf) == printable);
+                        e = mfree(e);
+
+                        assert_se(e = utf8_escape_invalid(buf));
+                        assert_se(utf8_is_valid(e));
+                        assert_se(streq(e, buf) == valid);
+                }
+}
+
 static void test_utf16_to_utf8(void) {
         char *a = NULL;
         const uint16_t utf16[] = { htole16('a'), htole16(0xd800), htole16('b'), htole16(0xdc00), htole16('c'), htole16(0xd801), htole16(0xdc37) };
@@ -118,6 +154,7 @@ int main(int argc, char *argv[]) {
         test_utf8_encoded_valid_unichar();
         test_utf8_escaping();
         test_utf8_escaping_printable();
+        test_utf8_word_boundaries();
         test_utf16_to_utf8();
         test_utf8_n_codepoints();
         test_utf8_console_width();
@@ -61,10 +61,14 @@
 
 #define TIMEOUT_USEC (10*USEC_PER_SEC)
 
+/* How long to wait for the other replies of a burst, after sending it */
+#define BURST_WAIT_USEC (1*USEC_PER_SEC)
+
 static int manager_arm_timer(Manager *m, usec_t next);
 static int manager_clock_watch_setup(Manager *m);
 static int manager_listen_setup(Manager *m);
 static void manager_listen_stop(Manager *m);
+static int manager_burst_select(Manager *m, bool all);
 
 static double ntp_ts_short_to_d(const struct ntp_ts_short *ts) {
         return be16toh(ts->sec) + (be16toh(ts->frac) / 65536.0);
@@ -92,6 +96,91 @@ static int manager_timeout(sd_event_source *source, usec_t usec, void *userdata)
         return manager_connect(m);
 }
 
+static int manager_burst_timeout(sd_event_source *source, usec_t usec, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+
+        return manager_burst_select(m, false);
+}
+
+static int manager_burst_send(Manager *m, const struct ntp_msg *ntpmsg) {
+        ServerAddress *a;
+        unsigned n_sent = 0, i;
+        int r;
+
+        assert(m);
+        assert(ntpmsg);
+        assert(m->current_server_address);
+
+        /* Until we are synchronized, ask the next few addresses of the server name all at once, and go with
+         * the best reply. Server names usually resolve to several servers, hence this gets us a good
+         * sample right away, rather than after a number of timeouts or a few poll intervals. The addresses
+         * need to be of the same family, so that the socket can reach them. Returns 0 if no request could be
+         * sent, and 1 otherwise. The burst is left empty if there is only one suitable address. */
+
+        m->n_burst = 0;
+        m->event_burst = sd_event_source_unref(m->event_burst);
+
+        for (a = m->current_server_address; a && m->n_burst < NTP_BURST_MAX; a = a->addresses_next)
+                if (a->sockaddr.sa.sa_family == m->current_server_address->sockaddr.sa.sa_family)
+                        m->burst[m->n_burst++] = (NTPBurstReply) { .address = a };
+
+        if (m->n_burst < 2) {
+                m->n_burst = 0;
+                return 1;
+        }
+
+        for (i = 0; i < m->n_burst; i++) {
+                _cleanup_free_ char *pretty = NULL;
+                ssize_t len;
+
+                a = m->burst[i].address;
+                server_address_pretty(a, &pretty);
+
+                len = sendto(m->server_socket, ntpmsg, sizeof(*ntpmsg), MSG_DONTWAIT, &a->sockaddr.sa, a->socklen);
+                if (len != sizeof(*ntpmsg)) {
+                        log_debug_errno(errno, "Sending NTP request to %s (%s) failed: %m", strna(pretty), m->current_server_name->string);
+                        m->burst[i].done = true;
+                        continue;
+                }
+
+                log_debug("Sent NTP request to %s (%s).", strna(pretty), m->current_server_name->string);
+                n_sent++;
+        }
+
+        if (n_sent == 0) {
+                m->n_burst = 0;
+                return 0;
+        }
+
+        m->pending = true;
+
+        r = sd_event_add_time(
+                        m->event,
+                        &m->event_burst,
+                        clock_boottime_or_monotonic(),
+                        now(clock_boottime_or_monotonic()) + BURST_WAIT_USEC, 0,
+                        manager_burst_timeout, m);
+        if (r < 0)
+                return log_error_errno(r, "Failed to arm burst timer: %m");
+
+        return 1;
+}
+
+static NTPBurstReply *manager_burst_find(Manager *m, const union sockaddr_union *sa) {
+        unsigned i;
+
+        assert(m);
+        assert(sa);
+
+        for (i = 0; i < m->n_burst; i++)
+                if (sockaddr_equal(sa, &m->burst[i].address->sockaddr))
+                        return m->burst + i;
+
+        return NULL;
+}
+
 static int manager_send_request(Manager *m) {
         _cleanup_free_ char *pretty = NULL;
         struct ntp_msg ntpmsg = {
@@ -130,15 +219,25 @@ static int manager_send_request(Manager *m) {
         ntpmsg.trans_time.sec = htobe32(m->trans_time.tv_sec + OFFSET_1900_1970);
         ntpmsg.trans_time.frac = htobe32(m->trans_time.tv_nsec);
 
-        server_address_pretty(m->current_server_address, &pretty);
+        if (!m->good) {
+                r = manager_burst_send(m, &ntpmsg);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        return manager_connect(m);
+        }
 
-        len = sendto(m->server_socket, &ntpmsg, sizeof(ntpmsg), MSG_DONTWAIT, &m->current_server_address->sockaddr.sa, m->current_server_address->socklen);
-        if (len == sizeof(ntpmsg)) {
-                m->pending = true;
-                log_debug("Sent NTP request to %s (%s).", strna(pretty), m->current_server_name->string);
-        } else {
-                log_debug_errno(errno, "Sending NTP request to %s (%s) failed: %m", strna(pretty), m->current_server_name->string);
-                return manager_connect(m);
+        if (m->n_burst == 0) {
+                server_address_pretty(m->current_server_address, &pretty);
+
+                len = sendto(m->server_socket, &ntpmsg, sizeof(ntpmsg), MSG_DONTWAIT, &m->current_server_address->sockaddr.sa, m->current_server_address->socklen);
+                if (len == sizeof(ntpmsg)) {
+                        m->pending = true;
+                        log_debug("Sent NTP request to %s (%s).", strna(pretty), m->current_server_name->string);
+                } else {
+                        log_debug_errno(errno, "Sending NTP request to %s (%s) failed: %m", strna(pretty), m->current_server_name->string);
+                        return manager_connect(m);
+                }
         }
 
         /* re-arm timer with increasing timeout, in case the packets never arrive back */
@@ -412,125 +511,42 @@ static void manager_adjust_poll(Manager *m, double offset, bool spike) {
         }
 }
 
-static int manager_receive_response(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
-        Manager *m = userdata;
-        struct ntp_msg ntpmsg;
-
-        struct iovec iov = {
-                .iov_base = &ntpmsg,
-                .iov_len = sizeof(ntpmsg),
-        };
-        union {
-                struct cmsghdr cmsghdr;
-                uint8_t buf[CMSG_SPACE(sizeof(struct timeval))];
-        } control;
-        union sockaddr_union server_addr;
-        struct msghdr msghdr = {
-                .msg_iov = &iov,
-                .msg_iovlen = 1,
-                .msg_control = &control,
-                .msg_controllen = sizeof(control),
-                .msg_name = &server_addr,
-                .msg_namelen = sizeof(server_addr),
-        };
-        struct cmsghdr *cmsg;
-        struct timespec *recv_time = NULL;
-        ssize_t len;
-        double origin, receive, trans, dest;
-        double delay, offset;
-        double root_distance;
-        bool spike;
-        int leap_sec;
-        int r;
-
-        assert(source);
+static int manager_verify_response(Manager *m, const struct ntp_msg *ntpmsg, double *ret_root_distance) {
         assert(m);
+        assert(ntpmsg);
+        assert(ret_root_distance);
 
-        if (revents & (EPOLLHUP|EPOLLERR)) {
-                log_warning("Server connection returned error.");
-                return manager_connect(m);
-        }
+        if (be32toh(ntpmsg->recv_time.sec) < TIME_EPOCH + OFFSET_1900_1970 ||
+            be32toh(ntpmsg->trans_time.sec) < TIME_EPOCH + OFFSET_1900_1970)
+                return log_debug_errno(EINVAL, "Invalid reply, returned times before epoch. Ignoring.");
 
-        len = recvmsg(fd, &msghdr, MSG_DONTWAIT);
-        if (len < 0) {
-                if (errno == EAGAIN)
-                        return 0;
+        if (NTP_FIELD_LEAP(ntpmsg->field) == NTP_LEAP_NOTINSYNC ||
+            ntpmsg->stratum == 0 || ntpmsg->stratum >= 16)
+                return log_debug_errno(EINVAL, "Server is not synchronized. Disconnecting.");
 
-                log_warning("Error receiving message. Disconnecting.");
-                return manager_connect(m);
-        }
+        if (!IN_SET(NTP_FIELD_VERSION(ntpmsg->field), 3, 4))
+                return log_debug_errno(EINVAL, "Response NTPv%d. Disconnecting.", NTP_FIELD_VERSION(ntpmsg->field));
 
-        /* Too short or too long packet? */
-        if (iov.iov_len < sizeof(struct ntp_msg) || (msghdr.msg_flags & MSG_TRUNC)) {
-                log_warning("Invalid response from server. Disconnecting.");
-                return manager_connect(m);
-        }
+        if (NTP_FIELD_MODE(ntpmsg->field) != NTP_MODE_SERVER)
+                return log_debug_errno(EINVAL, "Unsupported mode %d. Disconnecting.", NTP_FIELD_MODE(ntpmsg->field));
 
-        if (!m->current_server_name ||
-            !m->current_server_address ||
-            !sockaddr_equal(&server_addr, &m->current_server_address->sockaddr)) {
-                log_debug("Response from unknown server.");
-                return 0;
-        }
+        *ret_root_distance = ntp_ts_short_to_d(&ntpmsg->root_delay) / 2 + ntp_ts_short_to_d(&ntpmsg->root_dispersion);
+        if (*ret_root_distance > (double) m->max_root_distance_usec / (double) USEC_PER_SEC)
+                return log_debug_errno(EINVAL, "Server has too large root distance. Disconnecting.");
 
-        CMSG_FOREACH(cmsg, &msghdr) {
-                if (cmsg->cmsg_level != SOL_SOCKET)
-                        continue;
-
-                switch (cmsg->cmsg_type) {
-                case SCM_TIMESTAMPNS:
-                        recv_time = (struct timespec *) CMSG_DATA(cmsg);
-                        break;
-                }
-        }
-        if (!recv_time) {
-                log_error("Invalid packet timestamp.");
-                return -EINVAL;
-        }
-
-        if (!m->pending) {
-                log_debug("Unexpected reply. Ignoring.");
-                return 0;
-        }
-
-        m->missed_replies = 0;
-
-        /* check our "time cookie" (we just stored nanoseconds in the fraction field) */
-        if (be32toh(ntpmsg.origin_time.sec) != m->trans_time.tv_sec + OFFSET_1900_1970 ||
-            be32toh(ntpmsg.origin_time.frac) != (unsigned long) m->trans_time.tv_nsec) {
-                log_debug("Invalid reply; not our transmit time. Ignoring.");
-                return 0;
-        }
-
-        m->event_timeout = sd_event_source_unref(m->event_timeout);
-
-        if (be32toh(ntpmsg.recv_time.sec) < TIME_EPOCH + OFFSET_1900_1970 ||
-            be32toh(ntpmsg.trans_time.sec) < TIME_EPOCH + OFFSET_1900_1970) {
-                log_debug("Invalid reply, returned times before epoch. Ignoring.");
-                return manager_connect(m);
-        }
-
-        if (NTP_FIELD_LEAP(ntpmsg.field) == NTP_LEAP_NOTINSYNC ||
-            ntpmsg.stratum == 0 || ntpmsg.stratum >= 16) {
-                log_debug("Server is not synchronized. Disconnecting.");
-                return manager_connect(m);
-        }
-
-        if (!IN_SET(NTP_FIELD_VERSION(ntpmsg.field), 3, 4)) {
-                log_debug("Response NTPv%d. Disconnecting.", NTP_FIELD_VERSION(ntpmsg.field));
-                return manager_connect(m);
-        }
+        return 0;
+}
 
-        if (NTP_FIELD_MODE(ntpmsg.field) != NTP_MODE_SERVER) {
-                log_debug("Unsupported mode %d. Disconnecting.", NTP_FIELD_MODE(ntpmsg.field));
-                return manager_connect(m);
-        }
+static int manager_apply_response(Manager *m, const struct ntp_msg *ntpmsg, const struct timespec *recv_time, double root_distance) {
+        double origin, receive, trans, dest;
+        double delay, offset;
+        bool spike;
+        int leap_sec;
+        int r;
 
-        root_distance = ntp_ts_short_to_d(&ntpmsg.root_delay) / 2 + ntp_ts_short_to_d(&ntpmsg.root_dispersion);
-        if (root_distance > (double) m->max_root_distance_usec / (double) USEC_PER_SEC) {
-                log_debug("Server has too large root distance. Disconnecting.");
-                return manager_connect(m);
-        }
+        assert(m);
+        assert(ntpmsg);
+        assert(recv_time);
 
         /* valid packet */
         m->pending = false;
@@ -540,9 +556,9 @@ static int manager_receive_response(sd_event_source *source, int fd, uint32_t re
         manager_listen_stop(m);
 
         /* announce leap seconds */
-        if (NTP_FIELD_LEAP(ntpmsg.field) & NTP_LEAP_PLUSSEC)
+        if (NTP_FIELD_LEAP(ntpmsg->field) & NTP_LEAP_PLUSSEC)
                 leap_sec = 1;
-        else if (NTP_FIELD_LEAP(ntpmsg.field) & NTP_LEAP_MINUSSEC)
+        else if (NTP_FIELD_LEAP(ntpmsg->field) & NTP_LEAP_MINUSSEC)
                 leap_sec = -1;
         else
                 leap_sec = 0;
@@ -559,8 +575,8 @@ static int manager_receive_response(sd_event_source *source, int fd, uint32_t re
          *  d = (T4 - T1) - (T3 - T2)     t = ((T2 - T1) + (T3 - T4)) / 2"
          */
         origin = ts_to_d(&m->trans_time) + OFFSET_1900_1970;
-        receive = ntp_ts_to_d(&ntpmsg.recv_time);
-        trans = ntp_ts_to_d(&ntpmsg.trans_time);
+        receive = ntp_ts_to_d(&ntpmsg->recv_time);
+        trans = ntp_ts_to_d(&ntpmsg->trans_time);
         dest = ts_to_d(recv_time) + OFFSET_1900_1970;
 
         offset = ((receive - origin) + (trans - dest)) / 2;
@@ -587,13 +603,13 @@ static int manager_receive_response(sd_event_source *source, int fd, uint32_t re
                   "  packet count : %"PRIu64"\n"
                   "  jitter       : %.3f%s\n"
                   "  poll interval: " USEC_FMT "\n",
-                  NTP_FIELD_LEAP(ntpmsg.field),
-                  NTP_FIELD_VERSION(ntpmsg.field),
-                  NTP_FIELD_MODE(ntpmsg.field),
-                  ntpmsg.stratum,
-                  exp2(ntpmsg.precision), ntpmsg.precision,
+                  NTP_FIELD_LEAP(ntpmsg->field),
+                  NTP_FIELD_VERSION(ntpmsg->field),
+                  NTP_FIELD_MODE(ntpmsg->field),
+                  ntpmsg->stratum,
+                  exp2(ntpmsg->precision), ntpmsg->precision,
                   root_distance,
-                  ntpmsg.stratum == 1 ? ntpmsg.refid : "n/a",
+                  ntpmsg->stratum == 1 ? ntpmsg->refid : "n/a",
                   origin - OFFSET_1900_1970,
                   receive - OFFSET_1900_1970,
                   trans - OFFSET_1900_1970,
@@ -611,7 +627,7 @@ static int manager_receive_response(sd_event_source *source, int fd, uint32_t re
         }
 
         /* Save NTP response */
-        m->ntpmsg = ntpmsg;
+        m->ntpmsg = *ntpmsg;
         m->origin_time = m->trans_time;
         m->dest_time = *recv_time;
         m->spike = spike;
@@ -639,6 +655,191 @@ static int manager_receive_response(sd_event_source *source, int fd, uint32_t re
         return 0;
 }
 
+static int manager_burst_select(Manager *m, bool all) {
+        NTPBurstReply *best = NULL;
+        double best_distance = 0;
+        struct ntp_msg ntpmsg;
+        struct timespec recv_time;
+        double root_distance;
+        unsigned i, n_done = 0;
+
+        assert(m);
+
+        /* Picks the reply with the smallest synchronization distance, i.e. root distance plus half of our
+         * own round trip, once all replies of the burst are in, or when we stop waiting for them. */
+
+        for (i = 0; i < m->n_burst; i++) {
+                NTPBurstReply *b = m->burst + i;
+                double origin, receive, trans, dest, distance;
+
+                if (!b->done)
+                        continue;
+
+                n_done++;
+
+                if (!b->valid)
+                        continue;
+
+                origin = ts_to_d(&m->trans_time) + OFFSET_1900_1970;
+                receive = ntp_ts_to_d(&b->ntpmsg.recv_time);
+                trans = ntp_ts_to_d(&b->ntpmsg.trans_time);
+                dest = ts_to_d(&b->recv_time) + OFFSET_1900_1970;
+
+                distance = b->root_distance + ((dest - origin) - (trans - receive)) / 2;
+                if (!best || distance < best_distance) {
+                        best = b;
+                        best_distance = distance;
+                }
+        }
+
+        if (all && n_done < m->n_burst)
+                return 0;
+
+        m->event_burst = sd_event_source_unref(m->event_burst);
+        m->n_burst = 0;
+
+        if (!best) {
+                /* Nothing useful came back yet. Keep waiting like for a single request, late replies of the
+                 * current address are still accepted, and the retry timer sends the next burst. */
+                if (n_done == 0 || !all)
+                        return 0;
+
+                return manager_connect(m);
+        }
+
+        ntpmsg = best->ntpmsg;
+        recv_time = best->recv_time;
+        root_distance = best->root_distance;
+
+        if (best->address != m->current_server_address) {
+                _cleanup_free_ char *pretty = NULL;
+
+                m->current_server_address = best->address;
+
+                server_address_pretty(m->current_server_address, &pretty);
+                log_debug("Selected address %s of server %s, with the best of %u replies.",
+                          strna(pretty), m->current_server_name->string, n_done);
+        }
+
+        return manager_apply_response(m, &ntpmsg, &recv_time, root_distance);
+}
+
+static int manager_receive_response(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        Manager *m = userdata;
+        struct ntp_msg ntpmsg;
+
+        struct iovec iov = {
+                .iov_base = &ntpmsg,
+                .iov_len = sizeof(ntpmsg),
+        };
+        union {
+                struct cmsghdr cmsghdr;
+                uint8_t buf[CMSG_SPACE(sizeof(struct timeval))];
+        } control;
+        union sockaddr_union server_addr;
+        struct msghdr msghdr = {
+                .msg_iov = &iov,
+                .msg_iovlen = 1,
+                .msg_control = &control,
+                .msg_controllen = sizeof(control),
+                .msg_name = &server_addr,
+                .msg_namelen = sizeof(server_addr),
+        };
+        struct cmsghdr *cmsg;
+        struct timespec *recv_time = NULL;
+        NTPBurstReply *b = NULL;
+        double root_distance;
+        ssize_t len;
+        int r;
+
+        assert(source);
+        assert(m);
+
+        if (revents & (EPOLLHUP|EPOLLERR)) {
+                log_warning("Server connection returned error.");
+                return manager_connect(m);
+        }
+
+        len = recvmsg(fd, &msghdr, MSG_DONTWAIT);
+        if (len < 0) {
+                if (errno == EAGAIN)
+                        return 0;
+
+                log_warning("Error receiving message. Disconnecting.");
+                return manager_connect(m);
+        }
+
+        /* Too short or too long packet? */
+        if (iov.iov_len < sizeof(struct ntp_msg) || (msghdr.msg_flags & MSG_TRUNC)) {
+                log_warning("Invalid response from server. Disconnecting.");
+                return manager_connect(m);
+        }
+
+        if (m->n_burst > 0)
+                b = manager_burst_find(m, &server_addr);
+
+        if (!m->current_server_name ||
+            !m->current_server_address ||
+            (m->n_burst > 0 ? !b : !sockaddr_equal(&server_addr, &m->current_server_address->sockaddr))) {
+                log_debug("Response from unknown server.");
+                return 0;
+        }
+
+        CMSG_FOREACH(cmsg, &msghdr) {
+                if (cmsg->cmsg_level != SOL_SOCKET)
+                        continue;
+
+                switch (cmsg->cmsg_type) {
+                case SCM_TIMESTAMPNS:
+                        recv_time = (struct timespec *) CMSG_DATA(cmsg);
+                        break;
+                }
+        }
+        if (!recv_time) {
+                log_error("Invalid packet timestamp.");
+                return -EINVAL;
+        }
+
+        if (!m->pending) {
+                log_debug("Unexpected reply. Ignoring.");
+                return 0;
+        }
+
+        m->missed_replies = 0;
+
+        /* check our "time cookie" (we just stored nanoseconds in the fraction field) */
+        if (be32toh(ntpmsg.origin_time.sec) != m->trans_time.tv_sec + OFFSET_1900_1970 ||
+            be32toh(ntpmsg.origin_time.frac) != (unsigned long) m->trans_time.tv_nsec) {
+                log_debug("Invalid reply; not our transmit time. Ignoring.");
+                return 0;
+        }
+
+        m->event_timeout = sd_event_source_unref(m->event_timeout);
+
+        r = manager_verify_response(m, &ntpmsg, &root_distance);
+
+        if (b) {
+                /* Replies of a burst are collected, and bad ones just drop out */
+                if (b->done)
+                        return 0;
+
+                b->done = true;
+                if (r >= 0) {
+                        b->valid = true;
+                        b->ntpmsg = ntpmsg;
+                        b->recv_time = *recv_time;
+                        b->root_distance = root_distance;
+                }
+
+                return manager_burst_select(m, true);
+        }
+
+        if (r < 0)
+                return manager_connect(m);
+
+        return manager_apply_response(m, &ntpmsg, recv_time, root_distance);
+}
+
 static int manager_listen_setup(Manager *m) {
         union sockaddr_union addr = {};
         static const int tos = IPTOS_LOWDELAY;
@@ -916,6 +1117,9 @@ void manager_disconnect(Manager *m) {
 
         m->event_timeout = sd_event_source_unref(m->event_timeout);
 
+        m->event_burst = sd_event_source_unref(m->event_burst);
+        m->n_burst = 0;
+
         sd_notifyf(false, "STATUS=Idle.");
 }
 
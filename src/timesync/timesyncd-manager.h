@@ -30,6 +30,18 @@ typedef struct Manager Manager;
 #define NTP_POLL_INTERVAL_MIN_USEC      (32 * USEC_PER_SEC)
 #define NTP_POLL_INTERVAL_MAX_USEC      (2048 * USEC_PER_SEC)
 
+/* Number of addresses of a server name queried at the same time until we are synchronized */
+#define NTP_BURST_MAX                   4
+
+typedef struct NTPBurstReply {
+        ServerAddress *address;
+        struct ntp_msg ntpmsg;
+        struct timespec recv_time;
+        double root_distance;
+        bool done:1;
+        bool valid:1;
+} NTPBurstReply;
+
 struct Manager {
         sd_bus *bus;
         sd_event *event;
@@ -65,6 +77,11 @@ struct Manager {
         usec_t retry_interval;
         bool pending;
 
+        /* requests sent to several addresses at once, while not synchronized yet */
+        NTPBurstReply burst[NTP_BURST_MAX];
+        unsigned n_burst;
+        sd_event_source *event_burst;
+
         /* poll timer */
         sd_event_source *event_timer;
         usec_t poll_interval_usec;
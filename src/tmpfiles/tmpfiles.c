@@ -13,6 +13,7 @@
 #include <glob.h>
 #include <limits.h>
 #include <linux/fs.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -54,6 +55,7 @@
 #include "rm-rf.h"
 #include "selinux-util.h"
 #include "set.h"
+#include "siphash24.h"
 #include "specifier.h"
 #include "stat-util.h"
 #include "stdio-util.h"
@@ -156,6 +158,7 @@ static bool arg_create = false;
 static bool arg_clean = false;
 static bool arg_remove = false;
 static bool arg_boot = false;
+static bool arg_force = false;
 
 static char **arg_include_prefixes = NULL;
 static char **arg_exclude_prefixes = NULL;
@@ -164,8 +167,38 @@ static char *arg_replace = NULL;
 
 #define MAX_DEPTH 256
 
+/* Clean-up of independent items is spread over this many threads at most */
+#define CLEAN_THREADS_MAX 8U
+
+/* Digests of items whose on-disk state was brought in line with the configuration by the previous run */
+#define STATE_PATH "/var/lib/systemd/tmpfiles-state"
+
+typedef struct CleanStats {
+        unsigned n_files;
+        unsigned n_directories;
+} CleanStats;
+
+typedef struct CleanJob {
+        Item *item;
+        char *path;
+        dev_t dev;
+        bool propagate_error;
+        bool started;
+        bool finished;
+        int r;
+} CleanJob;
+
 static OrderedHashmap *items = NULL, *globs = NULL;
 static Set *unix_sockets = NULL;
+static bool unix_sockets_loaded = false;
+
+/* Digests loaded from STATE_PATH, and the ones to write back; state_new is NULL if the state is not used */
+static Set *state_old = NULL, *state_new = NULL;
+
+static CleanJob *clean_jobs = NULL;
+static size_t n_clean_jobs = 0, n_clean_jobs_allocated = 0;
+static pthread_mutex_t clean_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t clean_cond = PTHREAD_COND_INITIALIZER;
 
 static int specifier_machine_id_safe(char specifier, void *data, void *userdata, char **ret);
 static int specifier_directory(char specifier, void *data, void *userdata, char **ret);
@@ -369,10 +402,12 @@ static void load_unix_sockets(void) {
         _cleanup_fclose_ FILE *f = NULL;
         int r;
 
-        if (unix_sockets)
+        if (unix_sockets_loaded)
                 return;
 
-        /* We maintain a cache of the sockets we found in /proc/net/unix to speed things up a little. */
+        /* We maintain a cache of the sockets we found in /proc/net/unix to speed things up a little. If reading it
+         * fails we don't try again, but consider all sockets alive. */
+        unix_sockets_loaded = true;
 
         unix_sockets = set_new(&path_hash_ops);
         if (!unix_sockets) {
@@ -458,14 +493,19 @@ static bool unix_socket_alive(const char *fn) {
         return true;
 }
 
-static int dir_is_mount_point(DIR *d, const char *subdir) {
+static int dir_is_mount_point(DIR *d, int *mount_id_parent, int *r_parent, const char *subdir) {
 
-        int mount_id_parent, mount_id;
+        int mount_id;
         int r_p, r;
 
-        r_p = name_to_handle_at_loop(dirfd(d), ".", NULL, &mount_id_parent, 0);
-        if (r_p < 0)
-                r_p = -errno;
+        assert(mount_id_parent);
+        assert(r_parent);
+
+        /* The parent is the same for all entries of a directory, hence look it up only once. Callers initialize
+         * *r_parent to 1 to indicate that it hasn't been looked up yet. */
+        if (*r_parent > 0)
+                *r_parent = name_to_handle_at_loop(dirfd(d), ".", NULL, mount_id_parent, 0);
+        r_p = *r_parent;
 
         r = name_to_handle_at_loop(dirfd(d), subdir, NULL, &mount_id, 0);
         if (r < 0)
@@ -477,7 +517,7 @@ static int dir_is_mount_point(DIR *d, const char *subdir) {
 
         /* got both handles; if they differ, it is a mount point */
         if (r_p >= 0 && r >= 0)
-                return mount_id_parent != mount_id;
+                return *mount_id_parent != mount_id;
 
         /* got only one handle; assume different mount points if one
          * of both queries was not supported by the filesystem */
@@ -521,13 +561,17 @@ static int dir_cleanup(
                 dev_t rootdev,
                 bool mountpoint,
                 int maxdepth,
-                bool keep_this_level) {
+                bool keep_this_level,
+                CleanStats *stats) {
 
         struct dirent *dent;
         struct timespec times[2];
         bool deleted = false;
+        int mount_id_parent = 0, r_parent = 1;
         int r = 0;
 
+        assert(stats);
+
         FOREACH_DIRENT_ALL(dent, d, break) {
                 struct stat s;
                 usec_t age;
@@ -555,7 +599,7 @@ static int dir_cleanup(
                 /* Try to detect bind mounts of the same filesystem instance; they
                  * do not differ in device major/minors. This type of query is not
                  * supported on all kernels or filesystem types though. */
-                if (S_ISDIR(s.st_mode) && dir_is_mount_point(d, dent->d_name) > 0) {
+                if (S_ISDIR(s.st_mode) && dir_is_mount_point(d, &mount_id_parent, &r_parent, dent->d_name) > 0) {
                         log_debug("Ignoring \"%s/%s\": different mount of the same filesystem.",
                                   p, dent->d_name);
                         continue;
@@ -601,7 +645,7 @@ static int dir_cleanup(
                                         continue;
                                 }
 
-                                q = dir_cleanup(i, sub_path, sub_dir, &s, cutoff, rootdev, false, maxdepth-1, false);
+                                q = dir_cleanup(i, sub_path, sub_dir, &s, cutoff, rootdev, false, maxdepth-1, false, stats);
                                 if (q < 0)
                                         r = q;
                         }
@@ -639,9 +683,11 @@ static int dir_cleanup(
                         }
 
                         log_debug("Removing directory \"%s\".", sub_path);
-                        if (unlinkat(dirfd(d), dent->d_name, AT_REMOVEDIR) < 0)
+                        if (unlinkat(dirfd(d), dent->d_name, AT_REMOVEDIR) < 0) {
                                 if (!IN_SET(errno, ENOENT, ENOTEMPTY))
                                         r = log_error_errno(errno, "rmdir(%s): %m", sub_path);
+                        } else
+                                stats->n_directories++;
 
                 } else {
                         /* Skip files for which the sticky bit is
@@ -711,9 +757,11 @@ static int dir_cleanup(
 
                         log_debug("unlink \"%s\"", sub_path);
 
-                        if (unlinkat(dirfd(d), dent->d_name, 0) < 0)
+                        if (unlinkat(dirfd(d), dent->d_name, 0) < 0) {
                                 if (errno != ENOENT)
                                         r = log_error_errno(errno, "unlink(%s): %m", sub_path);
+                        } else
+                                stats->n_files++;
 
                         deleted = true;
                 }
@@ -1461,7 +1509,7 @@ static int create_item(Item *i) {
                 r = copy_tree(i->argument, i->path,
                               i->uid_set ? i->uid : UID_INVALID,
                               i->gid_set ? i->gid : GID_INVALID,
-                              COPY_REFLINK);
+                              COPY_REFLINK|COPY_HOLES);
 
                 if (r == -EROFS && stat(i->path, &st) == 0)
                         r = -EEXIST;
@@ -1800,6 +1848,229 @@ static int create_item(Item *i) {
         return 0;
 }
 
+static bool item_state_supported(Item *i) {
+        assert(i);
+
+        /* Only items that apply to a single file system object qualify, as that is what the digest covers. Items
+         * that write contents or set up quota leave no trace in the inode's ctime, hence we don't skip those. */
+
+        if (!state_new)
+                return false;
+
+        if (i->force)
+                return false;
+
+        if (!IN_SET(i->type,
+                    CREATE_FILE,
+                    CREATE_DIRECTORY,
+                    TRUNCATE_DIRECTORY,
+                    CREATE_SUBVOLUME,
+                    CREATE_FIFO,
+                    CREATE_SYMLINK,
+                    CREATE_CHAR_DEVICE,
+                    CREATE_BLOCK_DEVICE,
+                    COPY_FILES,
+                    ADJUST_MODE,
+                    RELABEL_PATH,
+                    SET_XATTR,
+                    SET_ACL,
+                    SET_ATTRIBUTE))
+                return false;
+
+        return !string_is_glob(i->path);
+}
+
+static void item_state_digest(Item *i, const struct stat *st, char ret[static 33]) {
+        /* Two random keys, so that we get a 128bit digest out of siphash24() */
+        static const uint8_t keys[2][16] = {
+                { 0x6f, 0x1d, 0xa1, 0x4c, 0x8e, 0x22, 0x47, 0x95, 0xb3, 0x60, 0x0c, 0x5a, 0x93, 0xde, 0x27, 0x81 },
+                { 0x3a, 0xc4, 0x7e, 0x19, 0x52, 0xb8, 0x4d, 0x0f, 0x86, 0xe1, 0x35, 0x9b, 0x2c, 0x74, 0xfa, 0x06 },
+        };
+        uint64_t h[2];
+        size_t k;
+
+        assert(i);
+        assert(st);
+        assert(ret);
+
+        /* The digest covers everything the item is configured with, and the state of the inode after it has been
+         * applied. Any change to the inode's mode, ownership, ACLs, attributes, extended attributes or label
+         * updates its ctime, and hence makes the digest differ. */
+
+        for (k = 0; k < ELEMENTSOF(keys); k++) {
+                struct siphash state;
+                uint8_t flags;
+                char type = (char) i->type;
+
+                siphash24_init(&state, keys[k]);
+
+                siphash24_compress(PACKAGE_VERSION, sizeof(PACKAGE_VERSION), &state);
+                siphash24_compress(&type, sizeof(type), &state);
+                siphash24_compress(i->path, strlen(i->path) + 1, &state);
+                siphash24_compress(strempty(i->argument), strlen(strempty(i->argument)) + 1, &state);
+                siphash24_compress(&i->uid, sizeof(i->uid), &state);
+                siphash24_compress(&i->gid, sizeof(i->gid), &state);
+                siphash24_compress(&i->mode, sizeof(i->mode), &state);
+                siphash24_compress(&i->major_minor, sizeof(i->major_minor), &state);
+                siphash24_compress(&i->attribute_value, sizeof(i->attribute_value), &state);
+                siphash24_compress(&i->attribute_mask, sizeof(i->attribute_mask), &state);
+
+                flags = i->uid_set | i->gid_set << 1 | i->mode_set << 2 | i->mask_perms << 3 | i->attribute_set << 4;
+                siphash24_compress(&flags, sizeof(flags), &state);
+
+                siphash24_compress(&st->st_dev, sizeof(st->st_dev), &state);
+                siphash24_compress(&st->st_ino, sizeof(st->st_ino), &state);
+                siphash24_compress(&st->st_mode, sizeof(st->st_mode), &state);
+                siphash24_compress(&st->st_uid, sizeof(st->st_uid), &state);
+                siphash24_compress(&st->st_gid, sizeof(st->st_gid), &state);
+                siphash24_compress(&st->st_rdev, sizeof(st->st_rdev), &state);
+                siphash24_compress(&st->st_ctim.tv_sec, sizeof(st->st_ctim.tv_sec), &state);
+                siphash24_compress(&st->st_ctim.tv_nsec, sizeof(st->st_ctim.tv_nsec), &state);
+
+                h[k] = siphash24_finalize(&state);
+        }
+
+        assert_se(snprintf(ret, 33, "%016" PRIx64 "%016" PRIx64, h[0], h[1]) == 32);
+}
+
+static int item_state_record(Item *i) {
+        char digest[33];
+        struct stat st;
+        char *d;
+        int r;
+
+        assert(i);
+
+        if (lstat(i->path, &st) < 0)
+                return 0;
+
+        item_state_digest(i, &st, digest);
+
+        d = strdup(digest);
+        if (!d)
+                return log_oom();
+
+        r = set_consume(state_new, d);
+        if (r < 0)
+                return log_oom();
+
+        return 0;
+}
+
+static int create_item_with_state(Item *i) {
+        int r;
+
+        assert(i);
+
+        if (!item_state_supported(i))
+                return create_item(i);
+
+        if (!arg_force) {
+                char digest[33];
+                struct stat st;
+
+                if (lstat(i->path, &st) >= 0) {
+                        item_state_digest(i, &st, digest);
+
+                        if (set_contains(state_old, digest)) {
+                                log_debug("Skipping entry %c %s, unchanged since last run.", (char) i->type, i->path);
+                                return item_state_record(i);
+                        }
+                }
+        }
+
+        r = create_item(i);
+        if (r < 0)
+                return r;
+
+        (void) item_state_record(i);
+        return r;
+}
+
+static int state_load(void) {
+        _cleanup_fclose_ FILE *f = NULL;
+        int r;
+
+        /* The state is only used for full runs on the host, and not with an SELinux policy, since that might
+         * have changed the labels we are supposed to apply without touching any of the files. */
+        if (!arg_create || arg_user || arg_root || mac_selinux_use())
+                return 0;
+
+        state_new = set_new(&string_hash_ops);
+        if (!state_new)
+                return log_oom();
+
+        if (arg_force)
+                return 0;
+
+        f = fopen(STATE_PATH, "re");
+        if (!f) {
+                if (errno != ENOENT)
+                        log_debug_errno(errno, "Failed to open " STATE_PATH ", ignoring: %m");
+                return 0;
+        }
+
+        state_old = set_new(&string_hash_ops);
+        if (!state_old)
+                return log_oom();
+
+        for (;;) {
+                _cleanup_free_ char *line = NULL;
+
+                r = read_line(f, LONG_LINE_MAX, &line);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to read " STATE_PATH ", ignoring: %m");
+                        state_old = set_free_free(state_old);
+                        return 0;
+                }
+                if (r == 0)
+                        break;
+
+                if (strlen(line) != 32)
+                        continue;
+
+                r = set_consume(state_old, TAKE_PTR(line));
+                if (r < 0 && r != -EEXIST)
+                        return log_oom();
+        }
+
+        return 0;
+}
+
+static int state_save(void) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *t = NULL;
+        Iterator i;
+        char *d;
+        int r;
+
+        if (!state_new)
+                return 0;
+
+        (void) mkdir_parents(STATE_PATH, 0755);
+
+        r = fopen_temporary(STATE_PATH, &f, &t);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to write " STATE_PATH ", ignoring: %m");
+
+        (void) fchmod(fileno(f), 0644);
+
+        SET_FOREACH(d, state_new, i) {
+                fputs(d, f);
+                fputc('\n', f);
+        }
+
+        r = fflush_and_check(f);
+        if (r >= 0 && rename(t, STATE_PATH) < 0)
+                r = -errno;
+        if (r < 0) {
+                (void) unlink(t);
+                return log_debug_errno(r, "Failed to write " STATE_PATH ", ignoring: %m");
+        }
+
+        return 0;
+}
+
 static int remove_item_instance(Item *i, const char *instance) {
         int r;
 
@@ -1852,8 +2123,10 @@ static int clean_item_instance(Item *i, const char* instance) {
         _cleanup_closedir_ DIR *d = NULL;
         struct stat s, ps;
         bool mountpoint;
-        usec_t cutoff, n;
-        char timestamp[FORMAT_TIMESTAMP_MAX];
+        usec_t cutoff, n, start;
+        char timestamp[FORMAT_TIMESTAMP_MAX], timespan[FORMAT_TIMESPAN_MAX];
+        CleanStats stats = {};
+        int r;
 
         assert(i);
 
@@ -1894,8 +2167,158 @@ static int clean_item_instance(Item *i, const char* instance) {
                   instance,
                   format_timestamp_us(timestamp, sizeof(timestamp), cutoff));
 
-        return dir_cleanup(i, instance, d, &s, cutoff, s.st_dev, mountpoint,
-                           MAX_DEPTH, i->keep_first_level);
+        start = now(CLOCK_MONOTONIC);
+
+        r = dir_cleanup(i, instance, d, &s, cutoff, s.st_dev, mountpoint,
+                        MAX_DEPTH, i->keep_first_level, &stats);
+
+        log_debug("Cleaned up \"%s\" in %s, removed %u files and %u directories.",
+                  instance,
+                  format_timespan(timespan, sizeof(timespan), now(CLOCK_MONOTONIC) - start, USEC_PER_MSEC),
+                  stats.n_files, stats.n_directories);
+
+        return r;
+}
+
+static int queue_clean_job(Item *i, const char *instance, bool propagate_error) {
+        _cleanup_free_ char *p = NULL;
+        struct stat st;
+
+        assert(i);
+        assert(instance);
+
+        /* Clean-up is deferred until all items have been processed, so that independent directories can be cleaned
+         * up in parallel, see run_clean_jobs(). */
+
+        if (!i->age_set)
+                return 0;
+
+        p = strdup(instance);
+        if (!p)
+                return log_oom();
+
+        if (!GREEDY_REALLOC(clean_jobs, n_clean_jobs_allocated, n_clean_jobs + 1))
+                return log_oom();
+
+        clean_jobs[n_clean_jobs++] = (CleanJob) {
+                .item = i,
+                .path = TAKE_PTR(p),
+                .dev = stat(instance, &st) >= 0 ? st.st_dev : 0,
+                .propagate_error = propagate_error,
+        };
+
+        return 0;
+}
+
+static int queue_clean_job_glob(Item *i, const char *instance) {
+        return queue_clean_job(i, instance, true);
+}
+
+static CleanJob *clean_job_next(bool *ret_pending) {
+        size_t k, l;
+
+        assert(ret_pending);
+
+        /* Returns the next job that is not on the same device as one that is already being cleaned up, so that we
+         * don't make a single disk seek between two trees. Sets *ret_pending if there are jobs left, even if none
+         * can be started right now. */
+
+        *ret_pending = false;
+
+        for (k = 0; k < n_clean_jobs; k++) {
+                bool busy = false;
+
+                if (clean_jobs[k].started)
+                        continue;
+
+                *ret_pending = true;
+
+                if (clean_jobs[k].dev != 0)
+                        for (l = 0; l < n_clean_jobs; l++)
+                                if (clean_jobs[l].started &&
+                                    !clean_jobs[l].finished &&
+                                    clean_jobs[l].dev == clean_jobs[k].dev) {
+                                        busy = true;
+                                        break;
+                                }
+
+                if (!busy)
+                        return clean_jobs + k;
+        }
+
+        return NULL;
+}
+
+static void *clean_thread(void *userdata) {
+        assert_se(pthread_mutex_lock(&clean_mutex) == 0);
+
+        for (;;) {
+                CleanJob *j;
+                bool pending;
+
+                j = clean_job_next(&pending);
+                if (!j) {
+                        if (!pending)
+                                break;
+
+                        assert_se(pthread_cond_wait(&clean_cond, &clean_mutex) == 0);
+                        continue;
+                }
+
+                j->started = true;
+                assert_se(pthread_mutex_unlock(&clean_mutex) == 0);
+
+                j->r = clean_item_instance(j->item, j->path);
+
+                assert_se(pthread_mutex_lock(&clean_mutex) == 0);
+                j->finished = true;
+                assert_se(pthread_cond_broadcast(&clean_cond) == 0);
+        }
+
+        assert_se(pthread_mutex_unlock(&clean_mutex) == 0);
+        return NULL;
+}
+
+static int run_clean_jobs(void) {
+        pthread_t threads[CLEAN_THREADS_MAX - 1];
+        unsigned n_threads = 0, n;
+        size_t k;
+        int r = 0;
+
+        if (n_clean_jobs == 0)
+                return 0;
+
+        /* dir_cleanup() only reads the configuration, and the socket cache, which we hence fill in before we
+         * start any threads. The main thread works on the jobs too. */
+        n = MIN(n_clean_jobs, CLEAN_THREADS_MAX);
+        if (n > 1)
+                load_unix_sockets();
+
+        for (; n_threads + 1 < n; n_threads++) {
+                r = pthread_create(threads + n_threads, NULL, clean_thread, NULL);
+                if (r != 0) {
+                        log_debug_errno(r, "Failed to start clean-up thread, continuing with fewer: %m");
+                        break;
+                }
+        }
+
+        (void) clean_thread(NULL);
+
+        while (n_threads > 0)
+                assert_se(pthread_join(threads[--n_threads], NULL) == 0);
+
+        r = 0;
+        for (k = 0; k < n_clean_jobs; k++) {
+                if (clean_jobs[k].propagate_error && clean_jobs[k].r < 0 && r == 0)
+                        r = clean_jobs[k].r;
+
+                free(clean_jobs[k].path);
+        }
+
+        clean_jobs = mfree(clean_jobs);
+        n_clean_jobs = n_clean_jobs_allocated = 0;
+
+        return r;
 }
 
 static int clean_item(Item *i) {
@@ -1911,11 +2334,10 @@ static int clean_item(Item *i) {
         case TRUNCATE_DIRECTORY:
         case IGNORE_PATH:
         case COPY_FILES:
-                clean_item_instance(i, i->path);
-                return 0;
+                return queue_clean_job(i, i->path, false);
         case EMPTY_DIRECTORY:
         case IGNORE_DIRECTORY_PATH:
-                return glob_item(i, clean_item_instance);
+                return glob_item(i, queue_clean_job_glob);
         default:
                 return 0;
         }
@@ -1954,7 +2376,7 @@ static int process_item(Item *i) {
         if (chase_symlinks(i->path, NULL, CHASE_NO_AUTOFS, NULL) == -EREMOTE)
                 return t;
 
-        r = arg_create ? create_item(i) : 0;
+        r = arg_create ? create_item_with_state(i) : 0;
         q = arg_remove ? remove_item(i) : 0;
         p = arg_clean ? clean_item(i) : 0;
 
@@ -2507,6 +2929,7 @@ static void help(void) {
                "     --clean                Clean up marked directories\n"
                "     --remove               Remove marked files/directories\n"
                "     --boot                 Execute actions only safe at boot\n"
+               "     --force                Apply items even if they are unchanged\n"
                "     --prefix=PATH          Only apply rules with the specified prefix\n"
                "     --exclude-prefix=PATH  Ignore rules with the specified prefix\n"
                "     --root=PATH            Operate on an alternate filesystem root\n"
@@ -2524,6 +2947,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_CLEAN,
                 ARG_REMOVE,
                 ARG_BOOT,
+                ARG_FORCE,
                 ARG_PREFIX,
                 ARG_EXCLUDE_PREFIX,
                 ARG_ROOT,
@@ -2539,6 +2963,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "clean",          no_argument,         NULL, ARG_CLEAN          },
                 { "remove",         no_argument,         NULL, ARG_REMOVE         },
                 { "boot",           no_argument,         NULL, ARG_BOOT           },
+                { "force",          no_argument,         NULL, ARG_FORCE          },
                 { "prefix",         required_argument,   NULL, ARG_PREFIX         },
                 { "exclude-prefix", required_argument,   NULL, ARG_EXCLUDE_PREFIX },
                 { "root",           required_argument,   NULL, ARG_ROOT           },
@@ -2586,6 +3011,10 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_boot = true;
                         break;
 
+                case ARG_FORCE:
+                        arg_force = true;
+                        break;
+
                 case ARG_PREFIX:
                         if (strv_push(&arg_include_prefixes, optarg) < 0)
                                 return log_oom();
@@ -2830,6 +3259,15 @@ int main(int argc, char *argv[]) {
         if (r < 0)
                 goto finish;
 
+        /* Only a run over the complete configuration may replace the recorded state */
+        if ((arg_replace || optind >= argc) &&
+            strv_isempty(arg_include_prefixes) &&
+            strv_isempty(arg_exclude_prefixes)) {
+                r = state_load();
+                if (r < 0)
+                        goto finish;
+        }
+
         /* The non-globbing ones usually create things, hence we apply
          * them first */
         ORDERED_HASHMAP_FOREACH(a, items, iterator) {
@@ -2846,6 +3284,12 @@ int main(int argc, char *argv[]) {
                         r_process = k;
         }
 
+        k = run_clean_jobs();
+        if (k < 0 && r_process == 0)
+                r_process = k;
+
+        (void) state_save();
+
 finish:
         ordered_hashmap_free_with_destructor(items, item_array_free);
         ordered_hashmap_free_with_destructor(globs, item_array_free);
@@ -2855,6 +3299,8 @@ finish:
         free(arg_root);
 
         set_free_free(unix_sockets);
+        set_free_free(state_old);
+        set_free_free(state_new);
 
         mac_selinux_finish();
 
@@ -27,6 +27,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include "sd-id128.h"
 
@@ -34,80 +35,104 @@
 #include "blkid-util.h"
 #include "efivars.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "gpt.h"
+#include "mkdir.h"
 #include "parse-util.h"
+#include "siphash24.h"
+#include "stdio-util.h"
 #include "string-util.h"
+#include "strv.h"
 #include "udev.h"
 
-static void print_property(struct udev_device *dev, bool test, const char *name, const char *value) {
+/* The results of a probe are cached, keyed by a fingerprint of the device covering its identity, the
+ * probing options and the areas of the disk that hold partition tables and superblocks. Repeated events
+ * for unchanged devices then only need to read those areas once, instead of blkid reading each of the
+ * places it looks at. */
+#define BLKID_CACHE_DIR "/run/udev/blkid"
+#define BLKID_CACHE_AREA_SIZE (256U * 1024U)
+
+static void add_property(struct udev_device *dev, bool test, char ***properties, const char *name, const char *value) {
+        udev_builtin_add_property(dev, test, name, value);
+
+        if (!properties || !*properties)
+                return;
+
+        /* Don't cache anything we cannot store */
+        if (strchr(name, '=') || strchr(name, '\n') || strchr(value, '\n') ||
+            strv_extendf(properties, "%s=%s", name, value) < 0)
+                *properties = strv_free(*properties);
+}
+
+static void print_property(struct udev_device *dev, bool test, char ***properties, const char *name, const char *value) {
         char s[256];
 
         s[0] = '\0';
 
         if (streq(name, "TYPE")) {
-                udev_builtin_add_property(dev, test, "ID_FS_TYPE", value);
+                add_property(dev, test, properties, "ID_FS_TYPE", value);
 
         } else if (streq(name, "USAGE")) {
-                udev_builtin_add_property(dev, test, "ID_FS_USAGE", value);
+                add_property(dev, test, properties, "ID_FS_USAGE", value);
 
         } else if (streq(name, "VERSION")) {
-                udev_builtin_add_property(dev, test, "ID_FS_VERSION", value);
+                add_property(dev, test, properties, "ID_FS_VERSION", value);
 
         } else if (streq(name, "UUID")) {
                 blkid_safe_string(value, s, sizeof(s));
-                udev_builtin_add_property(dev, test, "ID_FS_UUID", s);
+                add_property(dev, test, properties, "ID_FS_UUID", s);
                 blkid_encode_string(value, s, sizeof(s));
-                udev_builtin_add_property(dev, test, "ID_FS_UUID_ENC", s);
+                add_property(dev, test, properties, "ID_FS_UUID_ENC", s);
 
         } else if (streq(name, "UUID_SUB")) {
                 blkid_safe_string(value, s, sizeof(s));
-                udev_builtin_add_property(dev, test, "ID_FS_UUID_SUB", s);
+                add_property(dev, test, properties, "ID_FS_UUID_SUB", s);
                 blkid_encode_string(value, s, sizeof(s));
-                udev_builtin_add_property(dev, test, "ID_FS_UUID_SUB_ENC", s);
+                add_property(dev, test, properties, "ID_FS_UUID_SUB_ENC", s);
 
         } else if (streq(name, "LABEL")) {
                 blkid_safe_string(value, s, sizeof(s));
-                udev_builtin_add_property(dev, test, "ID_FS_LABEL", s);
+                add_property(dev, test, properties, "ID_FS_LABEL", s);
                 blkid_encode_string(value, s, sizeof(s));
-                udev_builtin_add_property(dev, test, "ID_FS_LABEL_ENC", s);
+                add_property(dev, test, properties, "ID_FS_LABEL_ENC", s);
 
         } else if (streq(name, "PTTYPE")) {
-                udev_builtin_add_property(dev, test, "ID_PART_TABLE_TYPE", value);
+                add_property(dev, test, properties, "ID_PART_TABLE_TYPE", value);
 
         } else if (streq(name, "PTUUID")) {
-                udev_builtin_add_property(dev, test, "ID_PART_TABLE_UUID", value);
+                add_property(dev, test, properties, "ID_PART_TABLE_UUID", value);
 
         } else if (streq(name, "PART_ENTRY_NAME")) {
                 blkid_encode_string(value, s, sizeof(s));
-                udev_builtin_add_property(dev, test, "ID_PART_ENTRY_NAME", s);
+                add_property(dev, test, properties, "ID_PART_ENTRY_NAME", s);
 
         } else if (streq(name, "PART_ENTRY_TYPE")) {
                 blkid_encode_string(value, s, sizeof(s));
-                udev_builtin_add_property(dev, test, "ID_PART_ENTRY_TYPE", s);
+                add_property(dev, test, properties, "ID_PART_ENTRY_TYPE", s);
 
         } else if (startswith(name, "PART_ENTRY_")) {
                 strscpyl(s, sizeof(s), "ID_", name, NULL);
-                udev_builtin_add_property(dev, test, s, value);
+                add_property(dev, test, properties, s, value);
 
         } else if (streq(name, "SYSTEM_ID")) {
                 blkid_encode_string(value, s, sizeof(s));
-                udev_builtin_add_property(dev, test, "ID_FS_SYSTEM_ID", s);
+                add_property(dev, test, properties, "ID_FS_SYSTEM_ID", s);
 
         } else if (streq(name, "PUBLISHER_ID")) {
                 blkid_encode_string(value, s, sizeof(s));
-                udev_builtin_add_property(dev, test, "ID_FS_PUBLISHER_ID", s);
+                add_property(dev, test, properties, "ID_FS_PUBLISHER_ID", s);
 
         } else if (streq(name, "APPLICATION_ID")) {
                 blkid_encode_string(value, s, sizeof(s));
-                udev_builtin_add_property(dev, test, "ID_FS_APPLICATION_ID", s);
+                add_property(dev, test, properties, "ID_FS_APPLICATION_ID", s);
 
         } else if (streq(name, "BOOT_SYSTEM_ID")) {
                 blkid_encode_string(value, s, sizeof(s));
-                udev_builtin_add_property(dev, test, "ID_FS_BOOT_SYSTEM_ID", s);
+                add_property(dev, test, properties, "ID_FS_BOOT_SYSTEM_ID", s);
         }
 }
 
-static int find_gpt_root(struct udev_device *dev, blkid_probe pr, bool test) {
+static int find_gpt_root(struct udev_device *dev, blkid_probe pr, bool test, char ***properties) {
 
 #if defined(GPT_ROOT_NATIVE) && ENABLE_EFI
 
@@ -185,7 +210,7 @@ static int find_gpt_root(struct udev_device *dev, blkid_probe pr, bool test) {
         /* We found the ESP on this disk, and also found a root
          * partition, nice! Let's export its UUID */
         if (found_esp && root_id)
-                udev_builtin_add_property(dev, test, "ID_PART_GPT_AUTO_ROOT_UUID", root_id);
+                add_property(dev, test, properties, "ID_PART_GPT_AUTO_ROOT_UUID", root_id);
 #endif
 
         return 0;
@@ -223,12 +248,152 @@ static int probe_superblocks(blkid_probe pr) {
         return blkid_do_safeprobe(pr);
 }
 
+static int hash_area(int fd, uint64_t offset, void *buf, struct siphash *state) {
+        ssize_t n;
+
+        n = pread(fd, buf, BLKID_CACHE_AREA_SIZE, offset);
+        if (n < 0)
+                return -errno;
+
+        siphash24_compress(&offset, sizeof(offset), state);
+        siphash24_compress(buf, n, state);
+        return 0;
+}
+
+static int blkid_cache_key(struct udev_device *dev, blkid_probe pr, int fd, int64_t offset, bool noraid, uint64_t *ret) {
+        static const uint8_t hash_key[16] = {
+                0x5d, 0x2e, 0x8a, 0x01, 0x7c, 0x94, 0x4b, 0x3f, 0xa6, 0x19, 0xe2, 0x50, 0xcb, 0x73, 0x0d, 0xb8
+        };
+        _cleanup_free_ void *buf = NULL;
+        struct udev_device *parent;
+        struct siphash state;
+        const char *s, *v;
+        blkid_loff_t size;
+        dev_t devnum;
+        int r;
+
+        size = blkid_probe_get_size(pr);
+        if (size < 0)
+                return -EIO;
+
+        buf = malloc(BLKID_CACHE_AREA_SIZE);
+        if (!buf)
+                return -ENOMEM;
+
+        siphash24_init(&state, hash_key);
+
+        devnum = udev_device_get_devnum(dev);
+        siphash24_compress(&devnum, sizeof(devnum), &state);
+        siphash24_compress(&offset, sizeof(offset), &state);
+        siphash24_compress_byte(noraid, &state);
+        siphash24_compress(&size, sizeof(size), &state);
+
+        /* The partition entry and the size are exposed by the kernel, the disk sequence number changes
+         * with the media, on kernels that have it */
+        FOREACH_STRING(s, "start", "size", "diskseq") {
+                v = udev_device_get_sysattr_value(dev, s);
+                siphash24_compress_byte(!!v, &state);
+                if (v)
+                        siphash24_compress(v, strlen(v) + 1, &state);
+        }
+
+        /* Our results depend on what our parent passed on to us */
+        v = udev_device_get_property_value(dev, "ID_PART_GPT_AUTO_ROOT_UUID");
+        siphash24_compress(strempty(v), strlen(strempty(v)) + 1, &state);
+
+        r = hash_area(fd, offset, buf, &state);
+        if (r < 0)
+                return r;
+
+        if (size > BLKID_CACHE_AREA_SIZE) {
+                r = hash_area(fd, offset + size - BLKID_CACHE_AREA_SIZE, buf, &state);
+                if (r < 0)
+                        return r;
+        }
+
+        /* The partition entry details come from the partition table of the disk */
+        parent = udev_device_get_parent_with_subsystem_devtype(dev, "block", "disk");
+        if (parent && streq_ptr(udev_device_get_devtype(dev), "partition")) {
+                _cleanup_close_ int parent_fd = -1;
+
+                if (!udev_device_get_devnode(parent))
+                        return -ENODEV;
+
+                parent_fd = open(udev_device_get_devnode(parent), O_RDONLY|O_CLOEXEC|O_NOCTTY);
+                if (parent_fd < 0)
+                        return -errno;
+
+                r = hash_area(parent_fd, 0, buf, &state);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = siphash24_finalize(&state);
+        return 0;
+}
+
+static int blkid_cache_load(struct udev_device *dev, bool test, uint64_t key) {
+        _cleanup_strv_free_ char **lines = NULL;
+        _cleanup_free_ char *contents = NULL;
+        char k[STRLEN("K:") + 16 + 1];
+        const char *path;
+        char **l;
+        int r;
+
+        path = strjoina(BLKID_CACHE_DIR "/", udev_device_get_id_filename(dev));
+
+        r = read_full_file(path, &contents, NULL);
+        if (r < 0)
+                return r;
+
+        lines = strv_split_newlines(contents);
+        if (!lines)
+                return -ENOMEM;
+
+        xsprintf(k, "K:%016" PRIx64, key);
+        if (!streq_ptr(lines[0], k))
+                return -ESTALE;
+
+        STRV_FOREACH(l, lines + 1) {
+                char *e;
+
+                e = strchr(*l, '=');
+                if (!e)
+                        continue;
+
+                *e = 0;
+                udev_builtin_add_property(dev, test, *l, e + 1);
+        }
+
+        return 0;
+}
+
+static int blkid_cache_save(struct udev_device *dev, uint64_t key, char **properties) {
+        _cleanup_free_ char *joined = NULL, *contents = NULL;
+        const char *path;
+
+        joined = strv_join(properties, "\n");
+        if (!joined)
+                return -ENOMEM;
+
+        if (asprintf(&contents, "K:%016" PRIx64 "%s%s", key, isempty(joined) ? "" : "\n", joined) < 0)
+                return -ENOMEM;
+
+        (void) mkdir_p(BLKID_CACHE_DIR, 0755);
+
+        path = strjoina(BLKID_CACHE_DIR "/", udev_device_get_id_filename(dev));
+        return write_string_file(path, contents, WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC);
+}
+
 static int builtin_blkid(struct udev_device *dev, int argc, char *argv[], bool test) {
         const char *root_partition;
         int64_t offset = 0;
         bool noraid = false;
         _cleanup_close_ int fd = -1;
         _cleanup_(blkid_free_probep) blkid_probe pr = NULL;
+        _cleanup_strv_free_ char **properties = NULL;
+        bool have_key = false;
+        uint64_t key;
         const char *data;
         const char *name;
         int nvals;
@@ -287,6 +452,26 @@ static int builtin_blkid(struct udev_device *dev, int argc, char *argv[], bool t
         if (err < 0)
                 goto out;
 
+        /* When testing, always look at the device itself */
+        if (!test && udev_device_get_id_filename(dev)) {
+                err = blkid_cache_key(dev, pr, fd, offset, noraid, &key);
+                if (err < 0)
+                        log_debug_errno(err, "Failed to fingerprint %s, not using cached results: %m",
+                                        udev_device_get_devnode(dev));
+                else {
+                        err = blkid_cache_load(dev, test, key);
+                        if (err >= 0) {
+                                log_debug("using cached probe results for %s", udev_device_get_devnode(dev));
+                                return EXIT_SUCCESS;
+                        }
+
+                        have_key = true;
+                        properties = strv_new(NULL, NULL);
+                }
+
+                err = 0;
+        }
+
         log_debug("probe %s %sraid offset=%"PRIi64,
                   udev_device_get_devnode(dev),
                   noraid ? "no" : "", offset);
@@ -304,7 +489,7 @@ static int builtin_blkid(struct udev_device *dev, int argc, char *argv[], bool t
                 if (blkid_probe_get_value(pr, i, &name, &data, NULL))
                         continue;
 
-                print_property(dev, test, name, data);
+                print_property(dev, test, &properties, name, data);
 
                 /* Is this a disk with GPT partition table? */
                 if (streq(name, "PTTYPE") && streq(data, "gpt"))
@@ -313,11 +498,19 @@ static int builtin_blkid(struct udev_device *dev, int argc, char *argv[], bool t
                 /* Is this a partition that matches the root partition
                  * property we inherited from our parent? */
                 if (root_partition && streq(name, "PART_ENTRY_UUID") && streq(data, root_partition))
-                        udev_builtin_add_property(dev, test, "ID_PART_GPT_AUTO_ROOT", "1");
+                        add_property(dev, test, &properties, "ID_PART_GPT_AUTO_ROOT", "1");
         }
 
         if (is_gpt)
-                find_gpt_root(dev, pr, test);
+                find_gpt_root(dev, pr, test, &properties);
+
+        if (have_key && properties) {
+                err = blkid_cache_save(dev, key, properties);
+                if (err < 0)
+                        log_debug_errno(err, "Failed to cache probe results for %s, ignoring: %m",
+                                        udev_device_get_devnode(dev));
+                err = 0;
+        }
 
 out:
         if (err < 0)
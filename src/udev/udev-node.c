@@ -29,6 +29,8 @@
 #include "dirent-util.h"
 #include "format-util.h"
 #include "fs-util.h"
+#include "parse-util.h"
+#include "path-util.h"
 #include "selinux-util.h"
 #include "smack-util.h"
 #include "stdio-util.h"
@@ -127,6 +129,45 @@ exit:
         return err;
 }
 
+/* A claim of a symlink is a symlink in its stack directory, named after the device id, pointing to
+ * "<priority>:<device node>" */
+static int link_claim_read(DIR *dir, const char *name, int *ret_priority, char **ret_devnode) {
+        _cleanup_free_ char *buf = NULL;
+        char *devnode;
+        int r, priority;
+
+        r = readlinkat_malloc(dirfd(dir), name, &buf);
+        if (r < 0)
+                return r;
+
+        devnode = strchr(buf, ':');
+        if (!devnode)
+                return -EINVAL;
+        *devnode++ = '\0';
+
+        if (!path_startswith(devnode, "/dev/"))
+                return -EINVAL;
+
+        r = safe_atoi(buf, &priority);
+        if (r < 0)
+                return r;
+
+        devnode = strdup(devnode);
+        if (!devnode)
+                return -ENOMEM;
+
+        *ret_priority = priority;
+        *ret_devnode = devnode;
+        return 0;
+}
+
+static bool link_claim_device_exists(const char *id_filename) {
+        const char *path;
+
+        path = strjoina("/run/udev/data/", id_filename);
+        return access(path, F_OK) >= 0;
+}
+
 /* find device node of device with highest priority */
 static const char *link_find_prioritized(struct udev_device *dev, bool add, const char *stackdir, char *buf, size_t bufsize) {
         struct udev *udev = udev_device_get_udev(dev);
@@ -146,6 +187,8 @@ static const char *link_find_prioritized(struct udev_device *dev, bool add, cons
                 return target;
         FOREACH_DIRENT_ALL(dent, dir, break) {
                 struct udev_device *dev_db;
+                _cleanup_free_ char *db_devnode = NULL;
+                int db_priority;
 
                 if (dent->d_name[0] == '\0')
                         break;
@@ -158,6 +201,27 @@ static const char *link_find_prioritized(struct udev_device *dev, bool add, cons
                 if (streq(dent->d_name, udev_device_get_id_filename(dev)))
                         continue;
 
+                /* the claim carries the priority and device node, no need to read the database */
+                if (link_claim_read(dir, dent->d_name, &db_priority, &db_devnode) >= 0) {
+                        /* but the device must still have one, otherwise it went away without its claim
+                         * being removed */
+                        if (!link_claim_device_exists(dent->d_name)) {
+                                log_debug("ignoring stale claim of '%s' for '%s'", dent->d_name, stackdir);
+                                db_devnode = mfree(db_devnode);
+                                continue;
+                        }
+
+                        if (target == NULL || db_priority > priority) {
+                                log_debug("'%s' claims priority %i for '%s'", db_devnode, db_priority, stackdir);
+                                priority = db_priority;
+                                strscpy(buf, bufsize, db_devnode);
+                                target = buf;
+                        }
+                        db_devnode = mfree(db_devnode);
+                        continue;
+                }
+
+                /* claims of older versions are empty files */
                 dev_db = udev_device_new_from_device_id(udev, dent->d_name);
                 if (dev_db != NULL) {
                         const char *devnode;
@@ -205,19 +269,16 @@ static void link_update(struct udev_device *dev, const char *slink, bool add) {
         }
 
         if (add) {
+                char claim[DECIMAL_STR_MAX(int) + 1 + UTIL_PATH_SIZE];
                 int err;
 
-                do {
-                        int fd;
+                xsprintf(claim, "%i:%s", udev_device_get_devlink_priority(dev), udev_device_get_devnode(dev));
 
+                do {
                         err = mkdir_parents(filename, 0755);
                         if (!IN_SET(err, 0, -ENOENT))
                                 break;
-                        fd = open(filename, O_WRONLY|O_CREAT|O_CLOEXEC|O_TRUNC|O_NOFOLLOW, 0444);
-                        if (fd >= 0)
-                                close(fd);
-                        else
-                                err = -errno;
+                        err = symlink_atomic(claim, filename);
                 } while (err == -ENOENT);
         }
 }
@@ -34,6 +34,7 @@
 #include "dirent-util.h"
 #include "escape.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "fs-util.h"
 #include "glob-util.h"
 #include "path-util.h"
@@ -49,6 +50,7 @@
 #include "util.h"
 
 #define PREALLOC_TOKEN          2048
+#define RULES_CACHE_FILE        "/run/udev/rules.cache"
 
 struct uid_gid {
         unsigned int name_off;
@@ -78,6 +80,10 @@ struct udev_rules {
         /* all key strings are copied and de-duplicated in a single continuous string buffer */
         struct strbuf *strbuf;
 
+        /* one filter per rule, plus one for the end token */
+        struct rule_filter *filters;
+        unsigned int filters_cur;
+
         /* during rule parsing, uid/gid lookup results are cached */
         struct uid_gid *uids;
         unsigned int uids_cur;
@@ -223,6 +229,44 @@ struct token {
         };
 };
 
+/* The literal ACTION, SUBSYSTEM and KERNEL prefix a rule requires, so that rules can be skipped without
+ * walking their tokens. Consecutive rules requiring the same ACTION or SUBSYSTEM are skipped in one go. */
+struct rule_filter {
+        unsigned int token;                /* index of the TK_RULE token */
+        unsigned int action_off;           /* 0 if not required */
+        unsigned int subsystem_off;        /* 0 if not required */
+        unsigned int kernel_off;           /* 0 if not required */
+        unsigned int kernel_len;
+        unsigned int next_action;          /* next filter with a different action_off */
+        unsigned int next_subsystem;       /* next filter with a different subsystem_off */
+};
+
+/* The compiled rules are cached in RULES_CACHE_FILE: the header is followed by the manifest, the tokens, the
+ * filters and the string buffer. The manifest lists the stat data of every rules file (and the user and group
+ * databases, if names are resolved), the cache is only used if it is unchanged. The cache is tied to the
+ * running udev binary, hence nothing is converted to a portable format. */
+struct rules_cache_header {
+        uint8_t signature[8];
+        char version[16];
+        uint64_t header_size;
+        uint64_t token_size;
+        uint64_t filter_size;
+        int64_t resolve_names;
+        uint64_t manifest_len;
+        uint64_t tokens_cur;
+        uint64_t filters_cur;
+        uint64_t strings_len;
+};
+
+#define RULES_CACHE_SIGNATURE ((const char[8]) { 'U', 'D', 'E', 'V', 'R', 'U', 'L', 'E' })
+
+struct rules_manifest_entry {
+        uint64_t dev;
+        uint64_t ino;
+        uint64_t size;
+        uint64_t mtime_nsec;
+};
+
 #define MAX_TK                64
 struct rule_tmp {
         struct udev_rules *rules;
@@ -1529,11 +1573,262 @@ static int parse_file(struct udev_rules *rules, const char *filename) {
         return 0;
 }
 
+static int build_filters(struct udev_rules *rules) {
+        unsigned int i, n = 0;
+
+        for (i = 0; i < rules->token_cur; i++)
+                if (rules->tokens[i].type == TK_RULE)
+                        n++;
+
+        rules->filters = new0(struct rule_filter, n + 1);
+        if (!rules->filters)
+                return -ENOMEM;
+
+        for (i = 0; i < rules->token_cur; i++) {
+                struct rule_filter *filter;
+                unsigned int j;
+
+                if (rules->tokens[i].type != TK_RULE)
+                        continue;
+
+                filter = rules->filters + rules->filters_cur++;
+                filter->token = i;
+
+                /* Only plain keys are considered, all match keys are sorted before the first action key */
+                for (j = i + 1; j < i + rules->tokens[i].rule.token_count; j++) {
+                        struct token *key = rules->tokens + j;
+
+                        if (key->type > TK_M_MAX)
+                                break;
+                        if (key->key.op != OP_MATCH)
+                                continue;
+
+                        if (key->type == TK_M_ACTION && key->key.glob == GL_PLAIN)
+                                filter->action_off = key->key.value_off;
+                        else if (key->type == TK_M_SUBSYSTEM && key->key.glob == GL_PLAIN)
+                                filter->subsystem_off = key->key.value_off;
+                        else if (key->type == TK_M_KERNEL && IN_SET(key->key.glob, GL_PLAIN, GL_GLOB)) {
+                                const char *value = rules_str(rules, key->key.value_off);
+
+                                filter->kernel_off = key->key.value_off;
+                                filter->kernel_len = strcspn(value, "*?[\\");
+                                if (filter->kernel_len == 0)
+                                        filter->kernel_off = 0;
+                        }
+                }
+        }
+
+        assert(rules->filters_cur == n);
+
+        /* the end token terminates every run */
+        rules->filters[n] = (struct rule_filter) {
+                .token = rules->token_cur - 1,
+                .next_action = n,
+                .next_subsystem = n,
+        };
+
+        for (i = n; i-- > 0; ) {
+                struct rule_filter *filter = rules->filters + i, *next = filter + 1;
+
+                filter->next_action = next->action_off == filter->action_off ? next->next_action : i + 1;
+                filter->next_subsystem = next->subsystem_off == filter->subsystem_off ? next->next_subsystem : i + 1;
+        }
+
+        return 0;
+}
+
+static struct rule_filter *find_filter(struct udev_rules *rules, struct rule_filter *hint, struct token *rule) {
+        unsigned int idx = rule - rules->tokens, l = 0, r = rules->filters_cur;
+
+        if (hint->token == idx)
+                return hint;
+        if (hint < rules->filters + rules->filters_cur && hint[1].token == idx)
+                return hint + 1;
+
+        /* we got here by a GOTO */
+        while (l < r) {
+                unsigned int m = (l + r) / 2;
+
+                if (rules->filters[m].token < idx)
+                        l = m + 1;
+                else
+                        r = m;
+        }
+
+        assert(rules->filters[l].token == idx);
+        return rules->filters + l;
+}
+
+static int manifest_add(char **buf, size_t *allocated, size_t *size, const char *path) {
+        struct rules_manifest_entry entry = {};
+        struct stat st;
+        size_t l;
+
+        if (stat(path, &st) >= 0)
+                entry = (struct rules_manifest_entry) {
+                        .dev = st.st_dev,
+                        .ino = st.st_ino,
+                        .size = st.st_size,
+                        .mtime_nsec = timespec_load_nsec(&st.st_mtim),
+                };
+        else if (errno != ENOENT)
+                return -errno;
+
+        l = strlen(path) + 1;
+        if (!GREEDY_REALLOC(*buf, *allocated, *size + l + sizeof(entry)))
+                return -ENOMEM;
+
+        memcpy(*buf + *size, path, l);
+        memcpy(*buf + *size + l, &entry, sizeof(entry));
+        *size += l + sizeof(entry);
+
+        return 0;
+}
+
+static int rules_manifest(char **files, int resolve_names, char **ret, size_t *ret_size) {
+        _cleanup_free_ char *buf = NULL;
+        size_t allocated = 0, size = 0;
+        char **f;
+        int r;
+
+        STRV_FOREACH(f, files) {
+                r = manifest_add(&buf, &allocated, &size, *f);
+                if (r < 0)
+                        return r;
+        }
+
+        /* OWNER= and GROUP= are resolved while compiling the rules */
+        if (resolve_names > 0)
+                STRV_FOREACH(f, STRV_MAKE("/etc/passwd", "/etc/group")) {
+                        r = manifest_add(&buf, &allocated, &size, *f);
+                        if (r < 0)
+                                return r;
+                }
+
+        *ret = TAKE_PTR(buf);
+        *ret_size = size;
+        return 0;
+}
+
+static int load_cache(struct udev_rules *rules, const char *manifest, size_t manifest_len) {
+        _cleanup_free_ char *data = NULL;
+        struct rules_cache_header h;
+        size_t size, tokens_size, filters_size;
+        const char *p;
+        char *strings;
+        int r;
+
+        r = read_full_file(RULES_CACHE_FILE, &data, &size);
+        if (r < 0)
+                return r;
+
+        if (size < sizeof(h))
+                return -EBADMSG;
+        memcpy(&h, data, sizeof(h));
+
+        if (memcmp(h.signature, RULES_CACHE_SIGNATURE, sizeof(h.signature)) != 0 ||
+            !strneq(h.version, PACKAGE_VERSION, sizeof(h.version)) ||
+            h.header_size != sizeof(h) ||
+            h.token_size != sizeof(struct token) ||
+            h.filter_size != sizeof(struct rule_filter))
+                return -EBADMSG;
+
+        if (h.resolve_names != rules->resolve_names ||
+            h.manifest_len != manifest_len)
+                return -ESTALE;
+
+        if (h.tokens_cur == 0 || h.tokens_cur > size / sizeof(struct token) ||
+            h.filters_cur > h.tokens_cur ||
+            h.manifest_len > size ||
+            h.strings_len == 0 || h.strings_len > size)
+                return -EBADMSG;
+
+        tokens_size = h.tokens_cur * sizeof(struct token);
+        filters_size = (h.filters_cur + 1) * sizeof(struct rule_filter);
+        if (size != sizeof(h) + h.manifest_len + tokens_size + filters_size + h.strings_len)
+                return -EBADMSG;
+
+        p = data + sizeof(h);
+        if (memcmp(p, manifest, manifest_len) != 0)
+                return -ESTALE;
+        p += manifest_len;
+
+        rules->tokens = mfree(rules->tokens);
+        rules->tokens = memdup(p, tokens_size);
+        if (!rules->tokens)
+                return -ENOMEM;
+        rules->token_cur = rules->token_max = h.tokens_cur;
+        p += tokens_size;
+
+        rules->filters = memdup(p, filters_size);
+        if (!rules->filters)
+                return -ENOMEM;
+        rules->filters_cur = h.filters_cur;
+        p += filters_size;
+
+        strings = memdup(p, h.strings_len);
+        if (!strings)
+                return -ENOMEM;
+        free(rules->strbuf->buf);
+        rules->strbuf->buf = strings;
+        rules->strbuf->len = h.strings_len;
+
+        return 0;
+}
+
+static int save_cache(struct udev_rules *rules, const char *manifest, size_t manifest_len) {
+        _cleanup_free_ char *temp_path = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        struct rules_cache_header h = {
+                .header_size = sizeof(h),
+                .token_size = sizeof(struct token),
+                .filter_size = sizeof(struct rule_filter),
+                .resolve_names = rules->resolve_names,
+                .manifest_len = manifest_len,
+                .tokens_cur = rules->token_cur,
+                .filters_cur = rules->filters_cur,
+                .strings_len = rules->strbuf->len,
+        };
+        int r;
+
+        memcpy(h.signature, RULES_CACHE_SIGNATURE, sizeof(h.signature));
+        strncpy(h.version, PACKAGE_VERSION, sizeof(h.version));
+
+        r = fopen_temporary(RULES_CACHE_FILE, &f, &temp_path);
+        if (r < 0)
+                return r;
+        (void) fchmod(fileno(f), 0644);
+
+        fwrite(&h, sizeof(h), 1, f);
+        fwrite(manifest, manifest_len, 1, f);
+        fwrite(rules->tokens, sizeof(struct token), rules->token_cur, f);
+        fwrite(rules->filters, sizeof(struct rule_filter), rules->filters_cur + 1, f);
+        fwrite(rules->strbuf->buf, rules->strbuf->len, 1, f);
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto fail;
+
+        if (rename(temp_path, RULES_CACHE_FILE) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        return 0;
+
+fail:
+        (void) unlink(temp_path);
+        return r;
+}
+
 struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names) {
         struct udev_rules *rules;
         struct udev_list file_list;
         struct token end_token;
-        char **files, **f;
+        _cleanup_strv_free_ char **files = NULL;
+        _cleanup_free_ char *manifest = NULL;
+        size_t manifest_len = 0;
+        char **f;
         int r;
 
         rules = new0(struct udev_rules, 1);
@@ -1561,6 +1856,24 @@ struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names) {
                 return udev_rules_unref(rules);
         }
 
+        /* Use the compiled rules from the last time, if no rules file changed since then */
+        r = rules_manifest(files, resolve_names, &manifest, &manifest_len);
+        if (r < 0)
+                log_debug_errno(r, "Failed to stat rules files, not using cache: %m");
+        else {
+                r = load_cache(rules, manifest, manifest_len);
+                if (r >= 0) {
+                        log_debug("Loaded %u rules tokens from " RULES_CACHE_FILE, rules->token_cur);
+                        strbuf_complete(rules->strbuf);
+                        dump_rules(rules);
+                        return rules;
+                }
+                if (r == -ENOMEM)
+                        return udev_rules_unref(rules);
+                if (r != -ENOENT)
+                        log_debug_errno(r, "Not using " RULES_CACHE_FILE ": %m");
+        }
+
         /*
          * The offset value in the rules strct is limited; add all
          * rules file names to the beginning of the string buffer.
@@ -1571,14 +1884,21 @@ struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names) {
         STRV_FOREACH(f, files)
                 parse_file(rules, *f);
 
-        strv_free(files);
-
         memzero(&end_token, sizeof(struct token));
         end_token.type = TK_END;
         add_token(rules, &end_token);
         log_debug("rules contain %zu bytes tokens (%u * %zu bytes), %zu bytes strings",
                   rules->token_max * sizeof(struct token), rules->token_max, sizeof(struct token), rules->strbuf->len);
 
+        if (build_filters(rules) < 0)
+                return udev_rules_unref(rules);
+
+        if (manifest) {
+                r = save_cache(rules, manifest, manifest_len);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to write " RULES_CACHE_FILE ", ignoring: %m");
+        }
+
         /* cleanup temporary strbuf data */
         log_debug("%zu strings (%zu bytes), %zu de-duplicated (%zu bytes), %zu trie nodes used",
                   rules->strbuf->in_count, rules->strbuf->in_len,
@@ -1601,6 +1921,7 @@ struct udev_rules *udev_rules_unref(struct udev_rules *rules) {
         if (rules == NULL)
                 return NULL;
         free(rules->tokens);
+        free(rules->filters);
         strbuf_cleanup(rules->strbuf);
         free(rules->uids);
         free(rules->gids);
@@ -1748,6 +2069,8 @@ void udev_rules_apply_to_event(struct udev_rules *rules,
                                struct udev_list *properties_list) {
         struct token *cur;
         struct token *rule;
+        struct rule_filter *filter;
+        const char *action, *subsystem, *sysname;
         enum escape_type esc = ESCAPE_UNSET;
         bool can_set_name;
         int r;
@@ -1759,6 +2082,11 @@ void udev_rules_apply_to_event(struct udev_rules *rules,
                         (major(udev_device_get_devnum(event->dev)) > 0 ||
                          udev_device_get_ifindex(event->dev) > 0));
 
+        action = strempty(udev_device_get_action(event->dev));
+        subsystem = strempty(udev_device_get_subsystem(event->dev));
+        sysname = strempty(udev_device_get_sysname(event->dev));
+        filter = rules->filters;
+
         /* loop through token list, match, run actions or forward to next rule */
         cur = &rules->tokens[0];
         rule = cur;
@@ -1768,13 +2096,27 @@ void udev_rules_apply_to_event(struct udev_rules *rules,
                 case TK_RULE:
                         /* current rule */
                         rule = cur;
+                        /* skip the rule, and all following ones requiring the same ACTION or SUBSYSTEM */
+                        filter = find_filter(rules, filter, rule);
+                        if (filter->action_off != 0 && !streq(rules_str(rules, filter->action_off), action)) {
+                                filter = rules->filters + filter->next_action;
+                                cur = rules->tokens + filter->token;
+                                continue;
+                        }
+                        if (filter->subsystem_off != 0 && !streq(rules_str(rules, filter->subsystem_off), subsystem)) {
+                                filter = rules->filters + filter->next_subsystem;
+                                cur = rules->tokens + filter->token;
+                                continue;
+                        }
+                        if (filter->kernel_off != 0 && !strneq(rules_str(rules, filter->kernel_off), sysname, filter->kernel_len))
+                                goto nomatch;
                         /* possibly skip rules which want to set NAME, SYMLINK, OWNER, GROUP, MODE */
                         if (!can_set_name && rule->rule.can_set_name)
                                 goto nomatch;
                         esc = ESCAPE_UNSET;
                         break;
                 case TK_M_ACTION:
-                        if (match_key(rules, cur, udev_device_get_action(event->dev)) != 0)
+                        if (match_key(rules, cur, action) != 0)
                                 goto nomatch;
                         break;
                 case TK_M_DEVPATH:
@@ -1782,7 +2124,7 @@ void udev_rules_apply_to_event(struct udev_rules *rules,
                                 goto nomatch;
                         break;
                 case TK_M_KERNEL:
-                        if (match_key(rules, cur, udev_device_get_sysname(event->dev)) != 0)
+                        if (match_key(rules, cur, sysname) != 0)
                                 goto nomatch;
                         break;
                 case TK_M_DEVLINK: {
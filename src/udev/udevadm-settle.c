@@ -25,9 +25,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/inotify.h>
 #include <unistd.h>
 
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "io-util.h"
+
 #include "parse-util.h"
+#include "path-util.h"
 #include "udev.h"
 #include "udevadm-util.h"
 #include "util.h"
@@ -56,7 +62,8 @@ static int adm_settle(struct udev *udev, int argc, char *argv[]) {
         usec_t deadline;
         const char *exists = NULL;
         unsigned int timeout = 120;
-        struct pollfd pfd[1] = { {.fd = -1}, };
+        struct pollfd pfd[2] = { { .fd = -1 }, { .fd = -1 } };
+        _cleanup_close_ int fd_exists = -1;
         int c;
         struct udev_queue *queue;
         int rc = EXIT_FAILURE;
@@ -137,7 +144,28 @@ static int adm_settle(struct udev *udev, int argc, char *argv[]) {
                 goto out;
         }
 
+        /* wake up when the file we are waiting for shows up, if its directory exists already */
+        if (exists) {
+                _cleanup_free_ char *dir = NULL;
+
+                dir = dirname_malloc(exists);
+                if (!dir) {
+                        log_oom();
+                        goto out;
+                }
+
+                fd_exists = inotify_init1(IN_CLOEXEC|IN_NONBLOCK);
+                if (fd_exists >= 0 && inotify_add_watch(fd_exists, dir, IN_CREATE|IN_MOVED_TO) < 0)
+                        fd_exists = safe_close(fd_exists);
+
+                pfd[1].events = POLLIN;
+                pfd[1].fd = fd_exists;
+        }
+
         for (;;) {
+                usec_t n;
+                int timeout_msec;
+
                 if (exists && access(exists, F_OK) >= 0) {
                         rc = EXIT_SUCCESS;
                         break;
@@ -149,12 +177,22 @@ static int adm_settle(struct udev *udev, int argc, char *argv[]) {
                         break;
                 }
 
-                if (now(CLOCK_MONOTONIC) >= deadline)
+                n = now(CLOCK_MONOTONIC);
+                if (n >= deadline)
                         break;
 
+                /* sleep until the deadline, unless we need to look for the file regularly */
+                timeout_msec = (int) MIN(DIV_ROUND_UP(deadline - n, USEC_PER_MSEC), (usec_t) INT_MAX);
+                if (exists && fd_exists < 0)
+                        timeout_msec = MIN(timeout_msec, (int) MSEC_PER_SEC);
+
                 /* wake up when queue is empty */
-                if (poll(pfd, 1, MSEC_PER_SEC) > 0 && pfd[0].revents & POLLIN)
-                        udev_queue_flush(queue);
+                if (poll(pfd, ELEMENTSOF(pfd), timeout_msec) > 0) {
+                        if (pfd[0].revents & POLLIN)
+                                udev_queue_flush(queue);
+                        if (pfd[1].revents & POLLIN)
+                                (void) flush_fd(fd_exists);
+                }
         }
 
 out:
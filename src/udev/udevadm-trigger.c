@@ -25,7 +25,9 @@
 #include <unistd.h>
 
 #include "fd-util.h"
-#include "set.h"
+#include "fileio.h"
+#include "hashmap.h"
+#include "parse-util.h"
 #include "string-util.h"
 #include "udev-util.h"
 #include "udev.h"
@@ -34,8 +36,122 @@
 
 static int verbose;
 static int dry_run;
+static unsigned arg_max_queue;
 
-static int exec_list(struct udev_enumerate *udev_enumerate, const char *action, Set *settle_set) {
+/* If no event is received for this long while waiting for the queue to shrink, assume that some events got
+ * lost and the queue is empty */
+#define QUEUE_RESYNC_USEC (1 * USEC_PER_SEC)
+
+typedef struct TriggerMonitor {
+        struct udev_monitor *monitor;
+        int fd_ep;
+
+        /* syspath → time the event was triggered, if we settle */
+        Hashmap *settle_hashmap;
+
+        /* the number of events queued in udevd, estimated by the number of events the kernel sent
+         * minus the number of events udevd finished */
+        uint64_t seqnum_base;
+        uint64_t n_received;
+} TriggerMonitor;
+
+static int read_kernel_seqnum(uint64_t *ret) {
+        _cleanup_free_ char *line = NULL;
+        int r;
+
+        r = read_one_line_file("/sys/kernel/uevent_seqnum", &line);
+        if (r < 0)
+                return r;
+
+        return safe_atou64(line, ret);
+}
+
+static int monitor_queue_size(TriggerMonitor *m, uint64_t *ret) {
+        uint64_t seqnum;
+        int r;
+
+        r = read_kernel_seqnum(&seqnum);
+        if (r < 0)
+                return r;
+
+        *ret = seqnum > m->seqnum_base + m->n_received ? seqnum - m->seqnum_base - m->n_received : 0;
+        return 0;
+}
+
+/* Returns 0 on timeout, 1 if at least one event was received */
+static int monitor_receive(TriggerMonitor *m, int timeout_msec) {
+        struct epoll_event ev[4];
+        int fdcount, i;
+        bool received = false;
+
+        fdcount = epoll_wait(m->fd_ep, ev, ELEMENTSOF(ev), timeout_msec);
+        if (fdcount < 0) {
+                if (errno != EINTR)
+                        log_error_errno(errno, "error receiving uevent message: %m");
+                return 1;
+        }
+
+        for (i = 0; i < fdcount; i++) {
+                _cleanup_(udev_device_unrefp) struct udev_device *device = NULL;
+                _cleanup_free_ usec_t *start = NULL;
+                _cleanup_free_ char *key = NULL;
+                const char *syspath;
+
+                if (!(ev[i].events & EPOLLIN))
+                        continue;
+
+                device = udev_monitor_receive_device(m->monitor);
+                if (!device)
+                        continue;
+
+                m->n_received++;
+                received = true;
+
+                if (!m->settle_hashmap)
+                        continue;
+
+                syspath = udev_device_get_syspath(device);
+                start = hashmap_remove2(m->settle_hashmap, syspath, (void**) &key);
+                if (!start) {
+                        log_debug("Got epoll event on syspath %s not present in syspath set", syspath);
+                        continue;
+                }
+
+                if (verbose) {
+                        char ts[FORMAT_TIMESPAN_MAX];
+
+                        printf("settle %s (%s)\n", syspath,
+                               format_timespan(ts, sizeof(ts), now(CLOCK_MONOTONIC) - *start, USEC_PER_MSEC));
+                }
+        }
+
+        return received;
+}
+
+static void monitor_wait_queue(TriggerMonitor *m) {
+        for (;;) {
+                uint64_t n;
+                int r;
+
+                r = monitor_queue_size(m, &n);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to read kernel uevent seqnum, not throttling: %m");
+                        return;
+                }
+
+                if (n < arg_max_queue)
+                        return;
+
+                r = monitor_receive(m, QUEUE_RESYNC_USEC / USEC_PER_MSEC);
+                if (r == 0) {
+                        log_debug("No events finished for a while, assuming the queue ran empty");
+                        m->n_received += n;
+                        return;
+                }
+        }
+}
+
+static int exec_list(struct udev_enumerate *udev_enumerate, const char *action, TriggerMonitor *m) {
         struct udev_list_entry *entry;
         int r;
 
@@ -55,10 +171,28 @@ static int exec_list(struct udev_enumerate *udev_enumerate, const char *action,
                 if (fd < 0)
                         continue;
 
-                if (settle_set) {
-                        r = set_put_strdup(settle_set, syspath);
-                        if (r < 0)
+                /* don't fill udevd's queue faster than it gets processed */
+                if (arg_max_queue > 0)
+                        monitor_wait_queue(m);
+
+                if (m->settle_hashmap) {
+                        _cleanup_free_ char *key = NULL;
+                        _cleanup_free_ usec_t *start = NULL;
+
+                        key = strdup(syspath);
+                        start = new(usec_t, 1);
+                        if (!key || !start)
+                                return log_oom();
+
+                        *start = now(CLOCK_MONOTONIC);
+
+                        r = hashmap_put(m->settle_hashmap, key, start);
+                        if (r < 0 && r != -EEXIST)
                                 return log_oom();
+                        if (r > 0) {
+                                key = NULL;
+                                start = NULL;
+                        }
                 }
 
                 if (write(fd, action, strlen(action)) < 0)
@@ -102,12 +236,14 @@ static void help(void) {
                "     --name-match=NAME              Trigger devices with this /dev name\n"
                "  -b --parent-match=NAME            Trigger devices with that parent device\n"
                "  -w --settle                       Wait for the triggered events to complete\n"
+               "     --max-queue=NUMBER             Do not let more than this many events queue up\n"
                , program_invocation_short_name);
 }
 
 static int adm_trigger(struct udev *udev, int argc, char *argv[]) {
         enum {
                 ARG_NAME = 0x100,
+                ARG_MAX_QUEUE,
         };
 
         static const struct option options[] = {
@@ -125,6 +261,7 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[]) {
                 { "name-match",        required_argument, NULL, ARG_NAME },
                 { "parent-match",      required_argument, NULL, 'b'      },
                 { "settle",            no_argument,       NULL, 'w'      },
+                { "max-queue",         required_argument, NULL, ARG_MAX_QUEUE },
                 { "version",           no_argument,       NULL, 'V'      },
                 { "help",              no_argument,       NULL, 'h'      },
                 {}
@@ -140,7 +277,8 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[]) {
         int fd_udev = -1;
         struct epoll_event ep_udev;
         bool settle = false;
-        _cleanup_set_free_free_ Set *settle_set = NULL;
+        _cleanup_hashmap_free_free_free_ Hashmap *settle_hashmap = NULL;
+        TriggerMonitor m = {};
         int c, r;
 
         udev_enumerate = udev_enumerate_new(udev);
@@ -249,6 +387,14 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[]) {
                         settle = true;
                         break;
 
+                case ARG_MAX_QUEUE:
+                        r = safe_atou(optarg, &arg_max_queue);
+                        if (r < 0) {
+                                log_error_errno(r, "invalid maximum queue size '%s': %m", optarg);
+                                return 2;
+                        }
+                        break;
+
                 case ARG_NAME: {
                         _cleanup_(udev_device_unrefp) struct udev_device *dev;
 
@@ -295,7 +441,7 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[]) {
                 }
         }
 
-        if (settle) {
+        if (settle || arg_max_queue > 0) {
                 fd_ep = epoll_create1(EPOLL_CLOEXEC);
                 if (fd_ep < 0) {
                         log_error_errno(errno, "error creating epoll fd: %m");
@@ -320,11 +466,25 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[]) {
                         return 5;
                 }
 
-                settle_set = set_new(&string_hash_ops);
-                if (!settle_set) {
+                m.monitor = udev_monitor;
+                m.fd_ep = fd_ep;
+        }
+
+        if (settle) {
+                settle_hashmap = hashmap_new(&string_hash_ops);
+                if (!settle_hashmap) {
                         log_oom();
                         return 1;
                 }
+
+                m.settle_hashmap = settle_hashmap;
+        }
+
+        if (arg_max_queue > 0) {
+                /* only events sent from now on are counted */
+                r = read_kernel_seqnum(&m.seqnum_base);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to read kernel uevent seqnum, not throttling: %m");
         }
 
         switch (device_type) {
@@ -337,39 +497,12 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[]) {
         default:
                 assert_not_reached("device_type");
         }
-        r = exec_list(udev_enumerate, action, settle_set);
+        r = exec_list(udev_enumerate, action, &m);
         if (r < 0)
                 return 1;
 
-        while (!set_isempty(settle_set)) {
-                int fdcount;
-                struct epoll_event ev[4];
-                int i;
-
-                fdcount = epoll_wait(fd_ep, ev, ELEMENTSOF(ev), -1);
-                if (fdcount < 0) {
-                        if (errno != EINTR)
-                                log_error_errno(errno, "error receiving uevent message: %m");
-                        continue;
-                }
-
-                for (i = 0; i < fdcount; i++) {
-                        if (ev[i].data.fd == fd_udev && ev[i].events & EPOLLIN) {
-                                _cleanup_(udev_device_unrefp) struct udev_device *device;
-                                const char *syspath = NULL;
-
-                                device = udev_monitor_receive_device(udev_monitor);
-                                if (!device)
-                                        continue;
-
-                                syspath = udev_device_get_syspath(device);
-                                if (verbose)
-                                        printf("settle %s\n", syspath);
-                                if (!set_remove(settle_set, syspath))
-                                        log_debug("Got epoll event on syspath %s not present in syspath set", syspath);
-                        }
-                }
-        }
+        while (!hashmap_isempty(settle_hashmap))
+                (void) monitor_receive(&m, -1);
 
         return 0;
 }
@@ -75,12 +75,20 @@ static unsigned arg_children_max;
 static int arg_exec_delay;
 static usec_t arg_event_timeout_usec = 180 * USEC_PER_SEC;
 static usec_t arg_event_timeout_warn_usec = 180 * USEC_PER_SEC / 3;
+static usec_t arg_watch_debounce_usec = 1 * USEC_PER_SEC;
+
+/* how long idle workers are kept around, waiting for further events */
+#define WORKER_IDLE_TIMEOUT_USEC (3 * USEC_PER_SEC)
+
+/* how often the watch statistics in the service status are updated at most */
+#define WATCH_STATUS_INTERVAL_USEC (1 * USEC_PER_SEC)
 
 typedef struct Manager {
         struct udev *udev;
         sd_event *event;
         Hashmap *workers;
         LIST_HEAD(struct event, events);
+        Hashmap *events_by_seqnum;
         const char *cgroup;
         pid_t pid; /* the process that originally allocated the manager object */
 
@@ -93,9 +101,19 @@ typedef struct Manager {
         int fd_inotify;
         int worker_watch[2];
 
+        /* watched devices that were closed after writing less than arg_watch_debounce_usec ago */
+        Hashmap *watch_debounce;
+        unsigned n_watch_pending;
+        uint64_t n_watch_closed;
+        uint64_t n_watch_synthesized;
+        uint64_t n_watch_debounced;
+        uint64_t n_watch_coalesced;
+        usec_t watch_status_usec;
+
         sd_event_source *ctrl_event;
         sd_event_source *uevent_event;
         sd_event_source *inotify_event;
+        sd_event_source *kill_workers_event;
 
         usec_t last_usec;
 
@@ -129,6 +147,14 @@ struct event {
         sd_event_source *timeout;
 };
 
+typedef struct WatchDebounce {
+        Manager *manager;
+        int wd;
+        /* closed again during the window, a 'change' needs to be synthesized when it ends */
+        bool pending;
+        sd_event_source *timer;
+} WatchDebounce;
+
 static void event_queue_cleanup(Manager *manager, enum event_state type);
 
 enum worker_state {
@@ -159,6 +185,7 @@ static void event_free(struct event *event) {
         assert(event->manager);
 
         LIST_REMOVE(event, event->manager->events, event);
+        hashmap_remove_value(event->manager->events_by_seqnum, &event->seqnum, event);
         udev_device_unref(event->dev);
         udev_device_unref(event->dev_kernel);
 
@@ -168,7 +195,9 @@ static void event_free(struct event *event) {
         if (event->worker)
                 event->worker->event = NULL;
 
-        if (LIST_IS_EMPTY(event->manager->events)) {
+        /* 'change' events waiting for the end of a debounce window count as queued too, so that settle
+         * waits for them */
+        if (LIST_IS_EMPTY(event->manager->events) && event->manager->n_watch_pending == 0) {
                 /* only clean up the queue from the process that created it */
                 if (event->manager->pid == getpid_cached()) {
                         r = unlink("/run/udev/queue");
@@ -180,6 +209,28 @@ static void event_free(struct event *event) {
         free(event);
 }
 
+static WatchDebounce *watch_debounce_free(WatchDebounce *w) {
+        if (!w)
+                return NULL;
+
+        if (w->pending)
+                w->manager->n_watch_pending--;
+
+        hashmap_remove(w->manager->watch_debounce, INT_TO_PTR(w->wd));
+        sd_event_source_unref(w->timer);
+
+        return mfree(w);
+}
+
+static void manager_watch_debounce_free(Manager *manager) {
+        WatchDebounce *w;
+
+        while ((w = hashmap_first(manager->watch_debounce)))
+                watch_debounce_free(w);
+
+        manager->watch_debounce = hashmap_free(manager->watch_debounce);
+}
+
 static void worker_free(struct worker *worker) {
         if (!worker)
                 return;
@@ -297,11 +348,14 @@ static void manager_free(Manager *manager) {
         sd_event_source_unref(manager->ctrl_event);
         sd_event_source_unref(manager->uevent_event);
         sd_event_source_unref(manager->inotify_event);
+        sd_event_source_unref(manager->kill_workers_event);
+        manager_watch_debounce_free(manager);
 
         udev_unref(manager->udev);
         sd_event_unref(manager->event);
         manager_workers_free(manager);
         event_queue_cleanup(manager, EVENT_UNDEF);
+        hashmap_free(manager->events_by_seqnum);
 
         udev_monitor_unref(manager->monitor);
         udev_ctrl_unref(manager->ctrl);
@@ -367,6 +421,7 @@ static void worker_spawn(Manager *manager, struct event *event) {
                 manager->ctrl_event = sd_event_source_unref(manager->ctrl_event);
                 manager->uevent_event = sd_event_source_unref(manager->uevent_event);
                 manager->inotify_event = sd_event_source_unref(manager->inotify_event);
+                manager->kill_workers_event = sd_event_source_unref(manager->kill_workers_event);
 
                 manager->event = sd_event_unref(manager->event);
 
@@ -543,7 +598,8 @@ out:
         }
 }
 
-static void event_run(Manager *manager, struct event *event) {
+/* Returns 0 if all workers are busy and no new ones may be spawned */
+static int event_run(Manager *manager, struct event *event) {
         struct worker *worker;
         Iterator i;
 
@@ -565,17 +621,18 @@ static void event_run(Manager *manager, struct event *event) {
                         continue;
                 }
                 worker_attach_event(worker, event);
-                return;
+                return 1;
         }
 
         if (hashmap_size(manager->workers) >= arg_children_max) {
                 if (arg_children_max > 1)
                         log_debug("maximum number (%i) of children reached", hashmap_size(manager->workers));
-                return;
+                return 0;
         }
 
         /* start new worker and pass initial device */
         worker_spawn(manager, event);
+        return 1;
 }
 
 static int event_queue_insert(Manager *manager, struct udev_device *dev) {
@@ -591,16 +648,26 @@ static int event_queue_insert(Manager *manager, struct udev_device *dev) {
 
         assert(manager->pid == getpid_cached());
 
+        r = hashmap_ensure_allocated(&manager->events_by_seqnum, &uint64_hash_ops);
+        if (r < 0)
+                return r;
+
         event = new0(struct event, 1);
         if (!event)
                 return -ENOMEM;
 
+        event->seqnum = udev_device_get_seqnum(dev);
+        r = hashmap_put(manager->events_by_seqnum, &event->seqnum, event);
+        if (r == -ENOMEM) {
+                free(event);
+                return r;
+        }
+
         event->udev = udev_device_get_udev(dev);
         event->manager = manager;
         event->dev = dev;
         event->dev_kernel = udev_device_shallow_clone(dev);
         udev_device_copy_properties(event->dev_kernel, dev);
-        event->seqnum = udev_device_get_seqnum(dev);
         event->devpath = udev_device_get_devpath(dev);
         event->devpath_len = strlen(event->devpath);
         event->devpath_old = udev_device_get_devpath_old(dev);
@@ -613,7 +680,7 @@ static int event_queue_insert(Manager *manager, struct udev_device *dev) {
 
         event->state = EVENT_QUEUED;
 
-        if (LIST_IS_EMPTY(manager->events)) {
+        if (LIST_IS_EMPTY(manager->events) && manager->n_watch_pending == 0) {
                 r = touch("/run/udev/queue");
                 if (r < 0)
                         log_warning_errno(r, "could not touch /run/udev/queue: %m");
@@ -644,6 +711,11 @@ static bool is_devpath_busy(Manager *manager, struct event *event) {
         struct event *loop_event;
         size_t common;
 
+        /* the event we found blocking us the last time is still around? */
+        if (event->delaying_seqnum > 0 &&
+            hashmap_contains(manager->events_by_seqnum, &event->delaying_seqnum))
+                return true;
+
         /* check if queue contains events we depend on */
         LIST_FOREACH(event, loop_event, manager->events) {
                 /* we already found a later event, earlier cannot block us, no need to check again */
@@ -740,6 +812,11 @@ static void manager_exit(Manager *manager) {
         manager->inotify_event = sd_event_source_unref(manager->inotify_event);
         manager->fd_inotify = safe_close(manager->fd_inotify);
 
+        /* discard pending 'change' events of watched devices */
+        if (manager->n_watch_pending > 0 && LIST_IS_EMPTY(manager->events) && manager->pid == getpid_cached())
+                (void) unlink("/run/udev/queue");
+        manager_watch_debounce_free(manager);
+
         manager->uevent_event = sd_event_source_unref(manager->uevent_event);
         manager->monitor = udev_monitor_unref(manager->monitor);
 
@@ -773,6 +850,51 @@ static void manager_reload(Manager *manager) {
                    "STATUS=Processing with %u children at max", arg_children_max);
 }
 
+static int on_kill_workers_event(sd_event_source *s, uint64_t usec, void *userdata) {
+        Manager *manager = userdata;
+
+        assert(manager);
+
+        log_debug("cleanup idle workers");
+        manager_kill_workers(manager);
+
+        return 1;
+}
+
+static void manager_enable_kill_workers_event(Manager *manager) {
+        int enabled, r;
+        usec_t usec;
+
+        assert(manager);
+
+        if (manager->kill_workers_event &&
+            sd_event_source_get_enabled(manager->kill_workers_event, &enabled) >= 0 &&
+            enabled != SD_EVENT_OFF)
+                return;
+
+        assert_se(sd_event_now(manager->event, CLOCK_MONOTONIC, &usec) >= 0);
+        usec += WORKER_IDLE_TIMEOUT_USEC;
+
+        if (manager->kill_workers_event) {
+                r = sd_event_source_set_time(manager->kill_workers_event, usec);
+                if (r >= 0)
+                        r = sd_event_source_set_enabled(manager->kill_workers_event, SD_EVENT_ONESHOT);
+        } else
+                r = sd_event_add_time(manager->event, &manager->kill_workers_event, CLOCK_MONOTONIC,
+                                      usec, USEC_PER_SEC, on_kill_workers_event, manager);
+        if (r < 0) {
+                log_debug_errno(r, "failed to set up idle timer, killing idle workers right away: %m");
+                manager_kill_workers(manager);
+        }
+}
+
+static void manager_disable_kill_workers_event(Manager *manager) {
+        assert(manager);
+
+        if (manager->kill_workers_event)
+                (void) sd_event_source_set_enabled(manager->kill_workers_event, SD_EVENT_OFF);
+}
+
 static void event_queue_start(Manager *manager) {
         struct event *event;
         usec_t usec;
@@ -783,6 +905,9 @@ static void event_queue_start(Manager *manager) {
             manager->exit || manager->stop_exec_queue)
                 return;
 
+        /* keep the idle workers, they are about to get something to do */
+        manager_disable_kill_workers_event(manager);
+
         assert_se(sd_event_now(manager->event, CLOCK_MONOTONIC, &usec) >= 0);
         /* check for changed config, every 3 seconds at most */
         if (manager->last_usec == 0 ||
@@ -810,7 +935,9 @@ static void event_queue_start(Manager *manager) {
                 if (is_devpath_busy(manager, event))
                         continue;
 
-                event_run(manager, event);
+                /* no worker to pick up the remaining events anyway */
+                if (event_run(manager, event) == 0)
+                        break;
         }
 }
 
@@ -1008,13 +1135,18 @@ static int on_ctrl_msg(sd_event_source *s, int fd, uint32_t revents, void *userd
         return 1;
 }
 
+/* For these, synthesize_change() tries to re-read the partition table */
+static bool synthesize_change_rereads_partitions(struct udev_device *dev) {
+        return streq_ptr("block", udev_device_get_subsystem(dev)) &&
+               streq_ptr("disk", udev_device_get_devtype(dev)) &&
+               !startswith(udev_device_get_sysname(dev), "dm-");
+}
+
 static int synthesize_change(struct udev_device *dev) {
         char filename[UTIL_PATH_SIZE];
         int r;
 
-        if (streq_ptr("block", udev_device_get_subsystem(dev)) &&
-            streq_ptr("disk", udev_device_get_devtype(dev)) &&
-            !startswith(udev_device_get_sysname(dev), "dm-")) {
+        if (synthesize_change_rereads_partitions(dev)) {
                 bool part_table_read = false;
                 bool has_partitions = false;
                 int fd;
@@ -1112,6 +1244,178 @@ static int synthesize_change(struct udev_device *dev) {
         return 0;
 }
 
+/* lookup a queued 'change' event for the device, which will pick up what was written to it anyway */
+static bool event_queue_has_change(Manager *manager, struct udev_device *dev) {
+        const char *devpath;
+        struct event *event;
+
+        devpath = udev_device_get_devpath(dev);
+        if (!devpath)
+                return false;
+
+        LIST_FOREACH(event, event, manager->events)
+                if (event->state == EVENT_QUEUED &&
+                    streq(event->devpath, devpath) &&
+                    streq_ptr(udev_device_get_action(event->dev), "change"))
+                        return true;
+
+        return false;
+}
+
+static void manager_update_watch_status(Manager *manager) {
+        usec_t usec;
+
+        assert_se(sd_event_now(manager->event, CLOCK_MONOTONIC, &usec) >= 0);
+        if (manager->watch_status_usec > 0 && usec < manager->watch_status_usec + WATCH_STATUS_INTERVAL_USEC)
+                return;
+
+        manager->watch_status_usec = usec;
+
+        (void) sd_notifyf(false,
+                          "STATUS=Processing with %u children at max, "
+                          "synthesized %" PRIu64 " 'change' events for %" PRIu64 " writes to watched devices "
+                          "(%" PRIu64 " debounced, %" PRIu64 " coalesced with queued events)",
+                          arg_children_max,
+                          manager->n_watch_synthesized, manager->n_watch_closed,
+                          manager->n_watch_debounced, manager->n_watch_coalesced);
+}
+
+static void watch_synthesize_change(Manager *manager, struct udev_device *dev) {
+
+        /* Whole disks get their partition table re-read, which is not covered by a queued event */
+        if (!synthesize_change_rereads_partitions(dev) && event_queue_has_change(manager, dev)) {
+                log_debug("device %s closed, 'change' already queued", udev_device_get_devnode(dev));
+                manager->n_watch_coalesced++;
+        } else {
+                synthesize_change(dev);
+                manager->n_watch_synthesized++;
+
+                /* settle might be waiting on us to determine the queue
+                 * state. If we just handled an inotify event, we might have
+                 * generated a "change" event, but we won't have queued up
+                 * the resultant uevent yet. Do that.
+                 */
+                on_uevent(NULL, -1, 0, manager);
+        }
+
+        manager_update_watch_status(manager);
+}
+
+static int on_watch_debounce(sd_event_source *s, uint64_t usec, void *userdata) {
+        _cleanup_(udev_device_unrefp) struct udev_device *dev = NULL;
+        WatchDebounce *w = userdata;
+        Manager *manager;
+        int r;
+
+        assert(w);
+
+        manager = w->manager;
+
+        /* Not closed again during the window, the next close synthesizes right away */
+        if (!w->pending) {
+                watch_debounce_free(w);
+                return 1;
+        }
+
+        w->pending = false;
+        manager->n_watch_pending--;
+
+        dev = udev_watch_lookup(manager->udev, w->wd);
+        if (dev)
+                watch_synthesize_change(manager, dev);
+
+        if (LIST_IS_EMPTY(manager->events) && manager->n_watch_pending == 0 && manager->pid == getpid_cached()) {
+                r = unlink("/run/udev/queue");
+                if (r < 0)
+                        log_warning_errno(errno, "could not unlink /run/udev/queue: %m");
+        }
+
+        /* Start the next window */
+        r = sd_event_source_set_time(s, usec + arg_watch_debounce_usec);
+        if (r >= 0)
+                r = sd_event_source_set_enabled(s, SD_EVENT_ONESHOT);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to restart debounce timer, ignoring: %m");
+                watch_debounce_free(w);
+        }
+
+        return 1;
+}
+
+static int watch_debounce_start(Manager *manager, int wd) {
+        WatchDebounce *w;
+        usec_t usec;
+        int r;
+
+        r = hashmap_ensure_allocated(&manager->watch_debounce, NULL);
+        if (r < 0)
+                return r;
+
+        w = new0(WatchDebounce, 1);
+        if (!w)
+                return -ENOMEM;
+
+        w->manager = manager;
+        w->wd = wd;
+
+        r = hashmap_put(manager->watch_debounce, INT_TO_PTR(wd), w);
+        if (r < 0) {
+                free(w);
+                return r;
+        }
+
+        assert_se(sd_event_now(manager->event, CLOCK_MONOTONIC, &usec) >= 0);
+
+        r = sd_event_add_time(manager->event, &w->timer, CLOCK_MONOTONIC,
+                              usec + arg_watch_debounce_usec, 0, on_watch_debounce, w);
+        if (r < 0) {
+                watch_debounce_free(w);
+                return r;
+        }
+
+        return 0;
+}
+
+static void watch_closed(Manager *manager, int wd, struct udev_device *dev) {
+        WatchDebounce *w;
+        int r;
+
+        manager->n_watch_closed++;
+
+        /* The first close after writing synthesizes a 'change' right away, further ones during the
+         * following debounce window are folded into a single one at its end */
+        w = hashmap_get(manager->watch_debounce, INT_TO_PTR(wd));
+        if (w) {
+                log_debug("device %s closed again, delaying 'change'", udev_device_get_devnode(dev));
+
+                if (!w->pending) {
+                        /* only one process can add events to the queue */
+                        if (manager->pid == 0)
+                                manager->pid = getpid_cached();
+
+                        if (LIST_IS_EMPTY(manager->events) && manager->n_watch_pending == 0) {
+                                r = touch("/run/udev/queue");
+                                if (r < 0)
+                                        log_warning_errno(r, "could not touch /run/udev/queue: %m");
+                        }
+
+                        w->pending = true;
+                        manager->n_watch_pending++;
+                }
+
+                manager->n_watch_debounced++;
+                return;
+        }
+
+        watch_synthesize_change(manager, dev);
+
+        if (arg_watch_debounce_usec > 0) {
+                r = watch_debounce_start(manager, wd);
+                if (r < 0)
+                        log_warning_errno(r, "Failed to start debouncing %s, ignoring: %m", udev_device_get_devnode(dev));
+        }
+}
+
 static int on_inotify(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
         Manager *manager = userdata;
         union inotify_event_buffer buffer;
@@ -1136,17 +1440,12 @@ static int on_inotify(sd_event_source *s, int fd, uint32_t revents, void *userda
                         continue;
 
                 log_debug("inotify event: %x for %s", e->mask, udev_device_get_devnode(dev));
-                if (e->mask & IN_CLOSE_WRITE) {
-                        synthesize_change(dev);
-
-                        /* settle might be waiting on us to determine the queue
-                         * state. If we just handled an inotify event, we might have
-                         * generated a "change" event, but we won't have queued up
-                         * the resultant uevent yet. Do that.
-                         */
-                        on_uevent(NULL, -1, 0, manager);
-                } else if (e->mask & IN_IGNORED)
+                if (e->mask & IN_CLOSE_WRITE)
+                        watch_closed(manager, e->wd, dev);
+                else if (e->mask & IN_IGNORED) {
+                        watch_debounce_free(hashmap_get(manager->watch_debounce, INT_TO_PTR(e->wd)));
                         udev_watch_end(manager->udev, dev);
+                }
         }
 
         return 1;
@@ -1237,9 +1536,12 @@ static int on_post(sd_event_source *s, void *userdata) {
         if (LIST_IS_EMPTY(manager->events)) {
                 /* no pending events */
                 if (!hashmap_isempty(manager->workers)) {
-                        /* there are idle workers */
-                        log_debug("cleanup idle workers");
-                        manager_kill_workers(manager);
+                        /* there are idle workers, keep them around for a while, so that the next
+                         * events don't have to wait for new workers to be forked off */
+                        if (manager->exit)
+                                manager_kill_workers(manager);
+                        else
+                                manager_enable_kill_workers_event(manager);
                 } else {
                         /* we are idle */
                         if (manager->exit) {
@@ -1349,6 +1651,7 @@ static int listen_fds(int *rctrl, int *rnetlink) {
  *   udev.children_max=<number of workers>     events are fully serialized if set to 1
  *   udev.exec_delay=<number of seconds>       delay execution of every executed program
  *   udev.event_timeout=<number of seconds>    seconds to wait before terminating an event
+ *   udev.watch_debounce=<time span>           window in which writes to watched devices are coalesced
  */
 static int parse_proc_cmdline_item(const char *key, const char *value, void *data) {
         int r = 0;
@@ -1392,6 +1695,13 @@ static int parse_proc_cmdline_item(const char *key, const char *value, void *dat
 
                 r = safe_atoi(value, &arg_exec_delay);
 
+        } else if (proc_cmdline_key_streq(key, "udev.watch_debounce")) {
+
+                if (proc_cmdline_value_missing(key, value))
+                        return 0;
+
+                r = parse_sec(value, &arg_watch_debounce_usec);
+
         } else if (startswith(key, "udev."))
                 log_warning("Unknown udev kernel command line option \"%s\"", key);
 
@@ -1411,12 +1721,18 @@ static void help(void) {
                "  -c --children-max=INT       Set maximum number of workers\n"
                "  -e --exec-delay=SECONDS     Seconds to wait before executing RUN=\n"
                "  -t --event-timeout=SECONDS  Seconds to wait before terminating an event\n"
+               "     --watch-debounce=TIME    Time window in which writes to watched devices\n"
+               "                              are coalesced into one 'change' event\n"
                "  -N --resolve-names=early|late|never\n"
                "                              When to resolve users and groups\n"
                , program_invocation_short_name);
 }
 
 static int parse_argv(int argc, char *argv[]) {
+        enum {
+                ARG_WATCH_DEBOUNCE = 0x100,
+        };
+
         static const struct option options[] = {
                 { "daemon",             no_argument,            NULL, 'd' },
                 { "debug",              no_argument,            NULL, 'D' },
@@ -1424,6 +1740,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "exec-delay",         required_argument,      NULL, 'e' },
                 { "event-timeout",      required_argument,      NULL, 't' },
                 { "resolve-names",      required_argument,      NULL, 'N' },
+                { "watch-debounce",     required_argument,      NULL, ARG_WATCH_DEBOUNCE },
                 { "help",               no_argument,            NULL, 'h' },
                 { "version",            no_argument,            NULL, 'V' },
                 {}
@@ -1461,6 +1778,11 @@ static int parse_argv(int argc, char *argv[]) {
                                 arg_event_timeout_warn_usec = (arg_event_timeout_usec / 3) ? : 1;
                         }
                         break;
+                case ARG_WATCH_DEBOUNCE:
+                        r = parse_sec(optarg, &arg_watch_debounce_usec);
+                        if (r < 0)
+                                log_warning("Invalid --watch-debounce ignored: %s", optarg);
+                        break;
                 case 'D':
                         arg_debug = true;
                         break;
@@ -1284,6 +1284,24 @@ KERNEL=="sda1", SYMLINK+="", LABEL="NO"
 KERNEL=="sda1", SYMLINK+="right", LABEL="TEST", GOTO="end"
 KERNEL=="sda1", SYMLINK+="wrong2", LABEL="BAD"
 LABEL="end"
+EOF
+        },
+        {
+                desc            => "skip rules for other actions, subsystems and kernel names",
+                devpath         => "/devices/pci0000:00/0000:00:1f.2/host0/target0:0:0/0:0:0:0/block/sda/sda1",
+                exp_name        => "right",
+                not_exp_name    => "wrong",
+                rules           => <<EOF
+ACTION=="remove", SYMLINK+="wrong"
+ACTION=="remove", GOTO="end"
+SUBSYSTEM=="net", SYMLINK+="wrong"
+SUBSYSTEM=="block", KERNEL=="sda*", GOTO="block"
+SUBSYSTEM=="net", SYMLINK+="wrong"
+SUBSYSTEM=="net", SYMLINK+="wrong", LABEL="block"
+SUBSYSTEM=="net", SYMLINK+="wrong"
+KERNEL=="sdb*", SYMLINK+="wrong"
+ACTION=="add", SUBSYSTEM=="block", KERNEL=="sda1", SYMLINK+="right"
+LABEL="end"
 EOF
         },
         {